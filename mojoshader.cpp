@@ -19,24 +19,16 @@
 #include "profiles/mojoshader_profile.h"
 #include "mojoshader.h"
 
+#include <new>
 
-// Deal with register lists...  !!! FIXME: I sort of hate this.
 
-static void free_reglist(MOJOSHADER_free f, void *d, RegisterList *item)
-{
-    while (item != NULL)
-    {
-        RegisterList *next = item->next;
-        f(item, d);
-        item = next;
-    } // while
-} // free_reglist
+// Deal with register lists...
 
-static inline const RegisterList *reglist_exists(RegisterList *prev,
+static inline const RegisterList *reglist_exists(RegisterTable *table,
                                                  const RegisterType regtype,
                                                  const int regnum)
 {
-    return (reglist_find(prev, regtype, regnum));
+    return (reglist_find(table, regtype, regnum));
 } // reglist_exists
 
 static inline int register_was_written(Context *ctx, const RegisterType rtype,
@@ -353,6 +345,115 @@ static const struct { const char *from; const char *to; } profileMap[] =
      PROFILE_EMITTER_SPIRV(op) \
 }
 
+
+// The front end doesn't call emitters as it goes. Every time it would, it
+//  saves off the parts of the Context that the emitter reads instead, as a
+//  small fixed-size record in one flat array. Once the whole shader is
+//  decoded, emit_steps() runs down that array, putting each record back and
+//  calling the real emitter. MOJOSHADER_parse() does both halves at once;
+//  MOJOSHADER_decode() keeps the records around so MOJOSHADER_emit() can
+//  replay them for any number of profiles.
+
+typedef enum
+{
+    EMITTER_START,
+    EMITTER_INSTRUCTION,
+    EMITTER_END,
+    EMITTER_PHASE
+} EmitterType;
+
+// DestArgInfo, packed down. The writemask0..3 fields come back out of
+//  writemask, and nothing past the front end looks at the token pointer.
+typedef struct DecodedDestArg
+{
+    uint16 regnum;
+    uint8 regtype;
+    uint8 relative;
+    uint8 writemask;
+    uint8 orig_writemask;
+    uint8 result_mod;
+    uint8 result_shift;
+} DecodedDestArg;
+
+// SourceArgInfo, packed down. The swizzle_* fields come back out of swizzle,
+//  and relative_array is a variable_position(), not a pointer.
+typedef struct DecodedSourceArg
+{
+    uint16 regnum;
+    uint16 relative_regnum;
+    uint16 relative_array;
+    uint8 regtype;
+    uint8 swizzle;
+    uint8 src_mod;
+    uint8 relative;
+    uint8 relative_regtype;
+    uint8 relative_component;
+} DecodedSourceArg;
+
+// Loop nesting and texm3x*pad tracking hardly ever change from one step to
+//  the next, so steps just index a list of the distinct values.
+typedef struct DecodedNesting
+{
+    int loops;
+    int reps;
+    int max_reps;
+    int texm3x2pad_dst0;
+    int texm3x2pad_src0;
+    int texm3x3pad_dst0;
+    int texm3x3pad_src0;
+    int texm3x3pad_dst1;
+    int texm3x3pad_src1;
+} DecodedNesting;
+
+typedef struct DecodedStep
+{
+    uint8 type;  // EmitterType
+    uint8 instruction_controls;
+    uint8 coissue;
+    uint8 predicated;
+    uint16 opcode;
+    uint16 previous_opcode;
+    int pass;  // trip through the token loop this came from.
+    int error_count;  // front end errors reported before this point.
+    int current_position;
+    int nesting;  // index into MOJOSHADER_decodedShader::nesting.
+    uint32 dwords[4];
+    DecodedDestArg dest_arg;
+    DecodedSourceArg source_args[5];
+    DecodedSourceArg predicate_arg;
+} DecodedStep;
+
+struct MOJOSHADER_decodedShader
+{
+    Context *ctx;  // front end state as of the end of the shader.
+    Buffer *stepbuf;  // steps pile up here during the walk.
+    DecodedStep *steps;
+    int step_count;
+    Buffer *nestingbuf;  // ...and their DecodedNestings here.
+    DecodedNesting *nesting;
+    int nesting_count;
+    DecodedNesting last_nesting;  // the newest entry in nestingbuf.
+    DecodedStep final_state;
+    int pass;
+    int failed;  // the "failed" flag from the token loop.
+    int isfail;  // ctx->isfail at the end of the token loop.
+    int not_bytecode;
+    int ctab_sensitive;
+    unsigned int bufsize;
+    int error_count;
+    MOJOSHADER_error *errors;
+};
+
+// Relative addressing is the one place the front end behaves differently
+//  depending on the profile (see ignores_ctab). MOJOSHADER_decode() doesn't
+//  have a profile yet, so note that the answer mattered.
+static inline int profile_ignores_ctab(Context *ctx)
+{
+    if (ctx->decoding != NULL)
+        ctx->decoding->ctab_sensitive = 1;
+    return ctx->ignores_ctab;
+} // profile_ignores_ctab
+
 static int parse_destination_token(Context *ctx, DestArgInfo *info)
 {
     // !!! FIXME: recheck against the spec for ranges (like RASTOUT values, etc).
@@ -415,7 +516,7 @@ static int parse_destination_token(Context *ctx, DestArgInfo *info)
             fail(ctx, "Relative addressing in non-vertex shader");
         if (!shader_version_atleast(ctx, 3, 0))
             fail(ctx, "Relative addressing in vertex shader version < 3.0");
-        if ((!ctx->ctab.have_ctab) && (!ctx->ignores_ctab))
+        if ((!ctx->ctab.have_ctab) && (!profile_ignores_ctab(ctx)))
         {
             // it's hard to do this efficiently without!
             fail(ctx, "relative addressing unsupported without a CTAB");
@@ -753,7 +854,7 @@ static int parse_source_token(Context *ctx, SourceArgInfo *info)
         else if (info->regtype == REG_TYPE_CONST)
         {
             // figure out what array we're in...
-            if (!ctx->ignores_ctab)
+            if (!profile_ignores_ctab(ctx))
             {
                 if (!ctx->ctab.have_ctab)  // hard to do efficiently without!
                     fail(ctx, "relative addressing unsupported without a CTAB");
@@ -1238,7 +1339,7 @@ static ConstantsList *alloc_constant_listitem(Context *ctx)
     if (item == NULL)
         return NULL;
 
-    item->constant = *new MOJOSHADER_constant();
+    item->constant = MOJOSHADER_constant();
     item->next = ctx->constants;
     ctx->constants = item;
     ctx->constant_count++;
@@ -2038,6 +2139,158 @@ static const Instruction instructions[] =
 };
 
 
+// Variables only ever get added to the front of ctx->variables, so counting
+//  from the end of the list gives each one a position that stays put, and
+//  that matches up with the copy MOJOSHADER_emit() makes. Zero means NULL.
+static int variable_position(const VariableList *var)
+{
+    int retval = 0;
+    for (; var != NULL; var = var->next)
+        retval++;
+    return retval;
+} // variable_position
+
+
+static const VariableList *variable_at_position(const Context *ctx,
+                                                const int position)
+{
+    const VariableList *var = ctx->variables;
+    int skip;
+
+    if (position == 0)
+        return NULL;
+
+    skip = variable_position(var) - position;
+    while ((skip-- > 0) && (var != NULL))
+        var = var->next;
+    return var;
+} // variable_at_position
+
+
+static void save_destarg(DecodedDestArg *arg, const DestArgInfo *info)
+{
+    arg->regnum = (uint16) info->regnum;
+    arg->regtype = (uint8) info->regtype;
+    arg->relative = (uint8) info->relative;
+    arg->writemask = (uint8) info->writemask;
+    arg->orig_writemask = (uint8) info->orig_writemask;
+    arg->result_mod = (uint8) info->result_mod;
+    arg->result_shift = (uint8) info->result_shift;
+} // save_destarg
+
+
+static void save_srcarg(DecodedSourceArg *arg, const SourceArgInfo *info)
+{
+    arg->regnum = (uint16) info->regnum;
+    arg->relative_regnum = (uint16) info->relative_regnum;
+    arg->relative_array = (uint16) variable_position(info->relative_array);
+    arg->regtype = (uint8) info->regtype;
+    arg->swizzle = (uint8) info->swizzle;
+    arg->src_mod = (uint8) info->src_mod;
+    arg->relative = (uint8) info->relative;
+    arg->relative_regtype = (uint8) info->relative_regtype;
+    arg->relative_component = (uint8) info->relative_component;
+} // save_srcarg
+
+
+// Returns the index of the current DecodedNesting, adding it if it changed.
+static int save_nesting(MOJOSHADER_decodedShader *decoded, const Context *ctx)
+{
+    DecodedNesting nesting;
+    nesting.loops = ctx->loops;
+    nesting.reps = ctx->reps;
+    nesting.max_reps = ctx->max_reps;
+    nesting.texm3x2pad_dst0 = ctx->texm3x2pad_dst0;
+    nesting.texm3x2pad_src0 = ctx->texm3x2pad_src0;
+    nesting.texm3x3pad_dst0 = ctx->texm3x3pad_dst0;
+    nesting.texm3x3pad_src0 = ctx->texm3x3pad_src0;
+    nesting.texm3x3pad_dst1 = ctx->texm3x3pad_dst1;
+    nesting.texm3x3pad_src1 = ctx->texm3x3pad_src1;
+
+    if ( (decoded->nesting_count == 0) ||
+         (memcmp(&nesting, &decoded->last_nesting, sizeof (nesting)) != 0) )
+    {
+        if (buffer_append(decoded->nestingbuf, &nesting, sizeof (nesting)))
+        {
+            memcpy(&decoded->last_nesting, &nesting, sizeof (nesting));
+            decoded->nesting_count++;
+        } // if
+    } // if
+
+    return decoded->nesting_count - 1;
+} // save_nesting
+
+
+static void save_step(MOJOSHADER_decodedShader *decoded, const Context *ctx,
+                      DecodedStep *step)
+{
+    size_t i;
+    step->instruction_controls = (uint8) ctx->instruction_controls;
+    step->coissue = (uint8) ctx->coissue;
+    step->predicated = (uint8) ctx->predicated;
+    step->previous_opcode = (uint16) ctx->previous_opcode;
+    step->current_position = ctx->current_position;
+    step->nesting = save_nesting(decoded, ctx);
+    memcpy(step->dwords, ctx->dwords, sizeof (step->dwords));
+    save_destarg(&step->dest_arg, &ctx->dest_arg);
+    for (i = 0; i < STATICARRAYLEN(step->source_args); i++)
+        save_srcarg(&step->source_args[i], &ctx->source_args[i]);
+    save_srcarg(&step->predicate_arg, &ctx->predicate_arg);
+} // save_step
+
+
+static void record_step(Context *ctx, const EmitterType type,
+                        const uint32 opcode)
+{
+    MOJOSHADER_decodedShader *decoded = ctx->decoding;
+    DecodedStep step;
+    save_step(decoded, ctx, &step);
+    step.type = (uint8) type;
+    step.opcode = (uint16) opcode;
+    step.pass = decoded->pass;
+    step.error_count = errorlist_count(ctx->errors);
+    buffer_append(decoded->stepbuf, &step, sizeof (step));
+} // record_step
+
+
+// The front end hands off to the profile through here.
+static void call_emitter(Context *ctx, const EmitterType type,
+                         const uint32 opcode, const char *profilestr)
+{
+    // The start emitter sets up things the rest of the front end needs to
+    //  know (like ignores_ctab), so if we have a profile, it runs right away.
+    if ((ctx->decoding != NULL) &&
+        ((type != EMITTER_START) || (ctx->profile == NULL)))
+    {
+        record_step(ctx, type, opcode);
+        return;
+    } // if
+
+    switch (type)
+    {
+        case EMITTER_START:
+            ctx->profile->start_emitter(ctx, profilestr);
+            break;
+
+        case EMITTER_INSTRUCTION:
+            // Reflection runs these too: they're where a profile notices an
+            //  instruction it can't translate, and it has to fail the same
+            //  way MOJOSHADER_parse() would. Only the final output is skipped.
+            instructions[opcode].emitter[ctx->profileid](ctx);
+            ctx->scratch_registers = 0;  // reset after every instruction.
+            break;
+
+        case EMITTER_END:
+            ctx->profile->end_emitter(ctx);
+            break;
+
+        case EMITTER_PHASE:
+            ctx->profile->phase_emitter(ctx);
+            break;
+    } // switch
+} // call_emitter
+
+
 // parse various token types...
 
 static int parse_instruction_token(Context *ctx)
@@ -2057,7 +2310,6 @@ static int parse_instruction_token(Context *ctx)
         return 0;  // not an instruction token, or just not handled here.
 
     const Instruction *instruction = &instructions[opcode];
-    const emit_function emitter = instruction->emitter[ctx->profileid];
 
     if ((token & 0x80000000) != 0)
         fail(ctx, "instruction token high bit must be zero.");  // so says msdn.
@@ -2088,6 +2340,7 @@ static int parse_instruction_token(Context *ctx)
     ctx->predicated = predicated;
 
     // Update the context with instruction's arguments.
+    STATS_COUNT(ctx, instruction_count, 1);
     adjust_token_position(ctx, 1);
     retval = instruction->parse_args(ctx);
 
@@ -2105,7 +2358,7 @@ static int parse_instruction_token(Context *ctx)
     ctx->instruction_count += instruction->slots;
 
     if (!isfail(ctx))
-        emitter(ctx);  // call the profile's emitter.
+        call_emitter(ctx, EMITTER_INSTRUCTION, opcode, NULL);
 
     if (ctx->reset_texmpad)
     {
@@ -2119,7 +2372,6 @@ static int parse_instruction_token(Context *ctx)
     } // if
 
     ctx->previous_opcode = opcode;
-    ctx->scratch_registers = 0;  // reset after every instruction.
 
     if (!shader_version_atleast(ctx, 2, 0))
     {
@@ -2183,7 +2435,7 @@ static int parse_version_token(Context *ctx, const char *profilestr)
     } // if
 
     if (!isfail(ctx))
-        ctx->profile->start_emitter(ctx, profilestr);
+        call_emitter(ctx, EMITTER_START, 0, profilestr);
 
     return 1;  // ate one token.
 } // parse_version_token
@@ -2253,7 +2505,7 @@ static int parse_ctab_typeinfo(Context *ctx, const uint8 *start,
         } // if
 
         const size_t len = sizeof (MOJOSHADER_symbolStructMember) * member_count;
-        info->members = (MOJOSHADER_symbolStructMember *) Malloc(ctx, len);
+        info->members = (MOJOSHADER_symbolStructMember *) UserMalloc(ctx, len);
         if (info->members == NULL)
             return 1;  // we'll check ctx->out_of_memory later.
         memset(info->members, '\0', len);
@@ -2272,7 +2524,7 @@ static int parse_ctab_typeinfo(Context *ctx, const uint8 *start,
         if (!parse_ctab_string(start, bytes, name))
             return 0;  // info->members will be free()'d elsewhere.
 
-        mbr->name = StrDup(ctx, (const char *) (start + name));
+        mbr->name = UserStrDup(ctx, (const char *) (start + name));
         if (mbr->name == NULL)
             return 1;  // we'll check ctx->out_of_memory later.
         if (!parse_ctab_typeinfo(ctx, start, bytes, memberinfopos, &mbr->info, depth + 1))
@@ -2338,7 +2590,7 @@ static void parse_constant_table(Context *ctx, const uint32 *tokens,
     ctab->symbols = NULL;
     if (constants > 0)
     {
-        ctab->symbols = (MOJOSHADER_symbol *) Malloc(ctx, sizeof (MOJOSHADER_symbol) * constants);
+        ctab->symbols = (MOJOSHADER_symbol *) UserMalloc(ctx, sizeof (MOJOSHADER_symbol) * constants);
         if (ctab->symbols == NULL)
             return;
         memset(ctab->symbols, '\0', sizeof (MOJOSHADER_symbol) * constants);
@@ -2535,7 +2787,7 @@ static void parse_preshader(Context *ctx, const uint32 *tokens, uint32 tokcount)
     // prsi.seen is optional, apparently.
 
     MOJOSHADER_preshader *preshader = (MOJOSHADER_preshader *)
-                                    Malloc(ctx, sizeof (MOJOSHADER_preshader));
+                                    UserMalloc(ctx, sizeof (MOJOSHADER_preshader));
     if (preshader == NULL)
         return;
 
@@ -2562,7 +2814,7 @@ static void parse_preshader(Context *ctx, const uint32 *tokens, uint32 tokcount)
             preshader->literal_count = (unsigned int) lit_count;
             assert(sizeof (double) == 8);  // just in case.
             const size_t len = sizeof (double) * lit_count;
-            preshader->literals = (double *) Malloc(ctx, len);
+            preshader->literals = (double *) UserMalloc(ctx, len);
             if (preshader->literals == NULL)
                 return;  // oh well.
             const double *litptr = (const double *) (clit.tokens + 2);
@@ -2626,7 +2878,7 @@ static void parse_preshader(Context *ctx, const uint32 *tokens, uint32 tokcount)
 
     const size_t len = sizeof (MOJOSHADER_preshaderInstruction) * opcode_count;
     preshader->instruction_count = (unsigned int) opcode_count;
-    preshader->instructions = (MOJOSHADER_preshaderInstruction *) Malloc(ctx, len);
+    preshader->instructions = (MOJOSHADER_preshaderInstruction *) UserMalloc(ctx, len);
     if (preshader->instructions == NULL)
         return;
     memset(preshader->instructions, '\0', len);
@@ -2740,7 +2992,7 @@ static void parse_preshader(Context *ctx, const uint32 *tokens, uint32 tokcount)
                         // malloc the array symbol name array
                         const uint32 siz = numarrays * sizeof (uint32);
                         operand->array_register_count = numarrays;
-                        operand->array_registers = (uint32 *) Malloc(ctx, siz);
+                        operand->array_registers = (uint32 *) UserMalloc(ctx, siz);
                         memset(operand->array_registers, '\0', siz);
                         // Get each register base, indicating the arrays used.
                         // !!! FIXME: fail if fxlc.tokcount*2 > numarrays ?
@@ -2817,7 +3069,7 @@ static void parse_preshader(Context *ctx, const uint32 *tokens, uint32 tokcount)
     if (largest > 0)
     {
         const size_t len = largest * sizeof (float) * 4;
-        preshader->registers = (float *) Malloc(ctx, len);
+        preshader->registers = (float *) UserMalloc(ctx, len);
         memset(preshader->registers, '\0', len);
         preshader->register_count = largest;
     } // if
@@ -2828,11 +3080,16 @@ static int parse_comment_token(Context *ctx)
     uint32 commenttoks = 0;
     if (is_comment_token(ctx, *ctx->tokens, &commenttoks))
     {
+        STATS_COUNT(ctx, comment_count, 1);
         if ((commenttoks >= 2) && (commenttoks < ctx->tokencount))
         {
             const uint32 id = SWAP32(ctx->tokens[1]);
             if (id == PRES_ID)
+            {
+                STATS_TIMER(start);
                 parse_preshader(ctx, ctx->tokens + 2, commenttoks - 2);
+                STATS_TIME(ctx, preshader_ns, start);
+            } // if
             else if (id == CTAB_ID)
             {
                 parse_constant_table(ctx, ctx->tokens, commenttoks * 4,
@@ -2857,7 +3114,7 @@ static int parse_end_token(Context *ctx)
         fail(ctx, "end token before end of stream");
 
     if (!isfail(ctx))
-        ctx->profile->end_emitter(ctx);
+        call_emitter(ctx, EMITTER_END, 0, NULL);
 
     return 1;
 } // parse_end_token
@@ -2873,7 +3130,7 @@ static int parse_phase_token(Context *ctx)
         fail(ctx, "phase token only available in 1.4 pixel shaders");
 
     if (!isfail(ctx))
-        ctx->profile->phase_emitter(ctx);
+        call_emitter(ctx, EMITTER_PHASE, 0, NULL);
 
     return 1;
 } // parse_phase_token
@@ -2950,6 +3207,18 @@ static Context *build_context(const char *profile,
     ctx->malloc = m;
     ctx->free = f;
     ctx->malloc_data = d;
+#ifdef MOJOSHADER_PARSE_STATS
+    ctx->stats_start = stats_clock();
+#endif
+
+    // most parse state comes out of the arena; see Malloc().
+    ctx->arena = arena_create(32 * 1024, m, f, d);
+    if (ctx->arena == NULL)
+    {
+        f(ctx, d);
+        return NULL;
+    } // if
+
     ctx->tokens = (const uint32 *) tokenbuf;
     ctx->orig_tokens = (const uint32 *) tokenbuf;
     ctx->know_shader_size = (bufsize != 0);
@@ -2969,9 +3238,12 @@ static Context *build_context(const char *profile,
     ctx->texm3x3pad_dst1 = -1;
     ctx->texm3x3pad_src1 = -1;
 
-    ctx->errors = errorlist_create(MallocBridge, FreeBridge, ctx);
+    // errors get flattened into the MOJOSHADER_parseData, so don't use
+    //  the arena for these.
+    ctx->errors = errorlist_create(m, f, d);
     if (ctx->errors == NULL)
     {
+        arena_destroy(ctx->arena);
         f(ctx, d);
         return NULL;
     } // if
@@ -2979,6 +3251,7 @@ static Context *build_context(const char *profile,
     if (!set_output(ctx, &ctx->mainline))
     {
         errorlist_destroy(ctx->errors);
+        arena_destroy(ctx->arena);
         f(ctx, d);
         return NULL;
     } // if
@@ -3005,28 +3278,6 @@ static Context *build_context(const char *profile,
 } // build_context
 
 
-static void free_constants_list(MOJOSHADER_free f, void *d, ConstantsList *item)
-{
-    while (item != NULL)
-    {
-        ConstantsList *next = item->next;
-        f(item, d);
-        item = next;
-    } // while
-} // free_constants_list
-
-
-static void free_variable_list(MOJOSHADER_free f, void *d, VariableList *item)
-{
-    while (item != NULL)
-    {
-        VariableList *next = item->next;
-        f(item, d);
-        item = next;
-    } // while
-} // free_variable_list
-
-
 static void free_sym_typeinfo(MOJOSHADER_free f, void *d,
                               MOJOSHADER_symbolTypeInfo *typeinfo)
 {
@@ -3053,54 +3304,103 @@ static void free_symbols(MOJOSHADER_free f, void *d, MOJOSHADER_symbol *syms,
 } // free_symbols
 
 
+// Fills in (sections) with the output buffers, in the order they make up
+//  the final program, and returns how many there are.
+static size_t output_sections(Context *ctx, Buffer **sections)
+{
+    Buffer *buffers[] = {
+        ctx->preflight, ctx->globals, ctx->inputs, ctx->outputs, ctx->helpers,
+        ctx->subroutines, ctx->mainline_intro, ctx->mainline_arguments,
+        ctx->mainline_top, ctx->mainline, ctx->postflight
+        // don't append ctx->ignore ... that's why it's called "ignore"
+    };
+    memcpy(sections, buffers, sizeof (buffers));
+    return STATICARRAYLEN(buffers);
+} // output_sections
+
+
 static void destroy_context(Context *ctx)
 {
     if (ctx != NULL)
     {
         MOJOSHADER_free f = ((ctx->free != NULL) ? ctx->free : MOJOSHADER_internal_free);
         void *d = ctx->malloc_data;
-        buffer_destroy(ctx->preflight);
-        buffer_destroy(ctx->globals);
-        buffer_destroy(ctx->inputs);
-        buffer_destroy(ctx->outputs);
-        buffer_destroy(ctx->helpers);
-        buffer_destroy(ctx->subroutines);
-        buffer_destroy(ctx->mainline_intro);
-        buffer_destroy(ctx->mainline_arguments);
-        buffer_destroy(ctx->mainline_top);
-        buffer_destroy(ctx->mainline);
-        buffer_destroy(ctx->postflight);
-        buffer_destroy(ctx->ignore);
-        free_constants_list(f, d, ctx->constants);
-        free_reglist(f, d, ctx->used_registers.next);
-        free_reglist(f, d, ctx->defined_registers.next);
-        free_reglist(f, d, ctx->uniforms.next);
-        free_reglist(f, d, ctx->attributes.next);
-        free_reglist(f, d, ctx->samplers.next);
-        free_variable_list(f, d, ctx->variables);
+
+        // The output buffers, register lists, constants, variables, etc.
+        //  all live in the arena, so they go away with it at the end.
+        //  Only things that could have ended up in a MOJOSHADER_parseData
+        //  were allocated with the app's allocator.
         errorlist_destroy(ctx->errors);
         free_symbols(f, d, ctx->ctab.symbols, ctx->ctab.symbol_count);
         MOJOSHADER_freePreshader(ctx->preshader);
-        f((void *) ctx->mainfn, d);
+
+        // ...except chunked output, which might have been headed there.
+        if (ctx->chunked_output)
+        {
+            Buffer *sections[16];
+            const size_t count = output_sections(ctx, sections);
+            size_t i;
+            for (i = 0; i < count; i++)
+                buffer_destroy(sections[i]);
+            buffer_destroy(ctx->ignore);
+        } // if
+
+        arena_destroy(ctx->arena);
         f(ctx, d);
     } // if
 } // destroy_context
 
 
-static char *build_output(Context *ctx, size_t *len)
+// Merges the output sections straight into the final string, so the
+//  program only gets copied once on its way to the app.
+static size_t build_output(Context *ctx, std::string &output)
 {
-    // add a byte for a null terminator.
-    Buffer *buffers[] = {
-        ctx->preflight, ctx->globals, ctx->inputs, ctx->outputs, ctx->helpers,
-        ctx->subroutines, ctx->mainline_intro, ctx->mainline_arguments,
-        ctx->mainline_top, ctx->mainline, ctx->postflight
-        // don't append ctx->ignore ... that's why it's called "ignore"
-    };
-    char *retval = buffer_merge(buffers, STATICARRAYLEN(buffers), len);
-    return retval;
+    Buffer *sections[16];
+    const size_t count = output_sections(ctx, sections);
+    size_t len = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (sections[i] != NULL)
+            len += buffer_size(sections[i]);
+    } // for
+
+    try
+    {
+        output.resize(len);
+    } // try
+    catch (const std::bad_alloc &)
+    {
+        out_of_memory(ctx);
+        return 0;
+    } // catch
+
+    if (len > 0)
+        buffer_merge_into(sections, count, &output[0]);
+    return len;
 } // build_output
 
 
+// Chunked output leaves the sections where they are until the app gets
+//  them in build_parsedata(); this just totals them up.
+static size_t output_chunks_size(Context *ctx)
+{
+    Buffer *sections[16];
+    const size_t count = output_sections(ctx, sections);
+    size_t len = 0;
+    size_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (sections[i] != NULL)
+            len += buffer_size(sections[i]);
+    } // for
+
+    return len;
+} // output_chunks_size
+
+
 static inline const char *alloc_varname(Context *ctx, const RegisterList *reg)
 {
     return ctx->profile->get_varname(ctx, reg->regtype, reg->regnum);
@@ -3108,7 +3408,35 @@ static inline const char *alloc_varname(Context *ctx, const RegisterList *reg)
 
 
 MOJOSHADER_parseData::MOJOSHADER_parseData() {
-
+    // the destructor frees whatever is here, so start from nothing.
+    error_count = 0;
+    errors = nullptr;
+    output_len = 0;
+    output_chunk_count = 0;
+    output_chunks = nullptr;
+    instruction_count = 0;
+    shader_type = MOJOSHADER_TYPE_UNKNOWN;
+    major_ver = 0;
+    minor_ver = 0;
+    uniform_count = 0;
+    uniforms = nullptr;
+    constant_count = 0;
+    constants = nullptr;
+    sampler_count = 0;
+    samplers = nullptr;
+    input_count = 0;
+    inputs = nullptr;
+    output_count = 0;
+    outputs = nullptr;
+    swizzle_count = 0;
+    swizzles = nullptr;
+    symbol_count = 0;
+    symbols = nullptr;
+    preshader = nullptr;
+    stats = nullptr;
+    malloc = nullptr;
+    free = nullptr;
+    malloc_data = nullptr;
 }
 
 MOJOSHADER_parseData::~MOJOSHADER_parseData() {
@@ -3121,14 +3449,15 @@ MOJOSHADER_parseData::~MOJOSHADER_parseData() {
 
 //    f((void *) this->mainfn, d);
 //    f((void *) this->output, d);
+    buffer_free_blocks((BufferBlock *) this->output_chunks, f, d);
     f((void *) this->constants, d);
     f((void *) this->swizzles, d);
 
-    for (i = 0; i < this->error_count; i++)
+    if (this->errors != nullptr)
     {
-//        f((void *) this->errors[i].error, d);
-//        f((void *) this->errors[i].filename, d);
-    } // for
+        for (i = 0; i < this->error_count; i++)
+            this->errors[i].~MOJOSHADER_error();
+    } // if
     f((void *) this->errors, d);
 
 //    for (i = 0; i < this->uniform_count; i++)
@@ -3149,6 +3478,7 @@ MOJOSHADER_parseData::~MOJOSHADER_parseData() {
 
     free_symbols(f, d, this->symbols, this->symbol_count);
     MOJOSHADER_freePreshader(this->preshader);
+    f((void *) this->stats, d);
 }
 
 MOJOSHADER_error MOJOSHADER_parseData::get_error(int idx) const {
@@ -3218,7 +3548,7 @@ bool MOJOSHADER_constant::get_bool() {
 static MOJOSHADER_uniform *build_uniforms(Context *ctx)
 {
     const size_t len = sizeof (MOJOSHADER_uniform) * ctx->uniform_count;
-    MOJOSHADER_uniform *retval = (MOJOSHADER_uniform *) Malloc(ctx, len);
+    MOJOSHADER_uniform *retval = (MOJOSHADER_uniform *) UserMalloc(ctx, len);
 
     if (retval != NULL)
     {
@@ -3246,7 +3576,7 @@ static MOJOSHADER_uniform *build_uniforms(Context *ctx)
             } // if
         } // for
 
-        RegisterList *item = ctx->uniforms.next;
+        RegisterList *item = reglist_first(&ctx->uniforms);
         MOJOSHADER_uniformType type = MOJOSHADER_UNIFORM_FLOAT;
         while (written < ctx->uniform_count)
         {
@@ -3301,7 +3631,7 @@ static MOJOSHADER_uniform *build_uniforms(Context *ctx)
 static MOJOSHADER_constant *build_constants(Context *ctx)
 {
     const size_t len = sizeof (MOJOSHADER_constant) * ctx->constant_count;
-    MOJOSHADER_constant *retval = (MOJOSHADER_constant *) Malloc(ctx, len);
+    MOJOSHADER_constant *retval = (MOJOSHADER_constant *) UserMalloc(ctx, len);
 
     if (retval != NULL)
     {
@@ -3328,11 +3658,11 @@ static MOJOSHADER_constant *build_constants(Context *ctx)
 static MOJOSHADER_sampler *build_samplers(Context *ctx)
 {
     const size_t len = sizeof (MOJOSHADER_sampler) * ctx->sampler_count;
-    MOJOSHADER_sampler *retval = (MOJOSHADER_sampler *) Malloc(ctx, len);
+    MOJOSHADER_sampler *retval = (MOJOSHADER_sampler *) UserMalloc(ctx, len);
 
     if (retval != NULL)
     {
-        RegisterList *item = ctx->samplers.next;
+        RegisterList *item = reglist_first(&ctx->samplers);
         int i;
 
         memset(retval, '\0', len);
@@ -3369,11 +3699,11 @@ static MOJOSHADER_attribute *build_attributes(Context *ctx, int *_count)
     } // if
 
     const size_t len = sizeof (MOJOSHADER_attribute) * ctx->attribute_count;
-    MOJOSHADER_attribute *retval = (MOJOSHADER_attribute *) Malloc(ctx, len);
+    MOJOSHADER_attribute *retval = (MOJOSHADER_attribute *) UserMalloc(ctx, len);
 
     if (retval != NULL)
     {
-        RegisterList *item = ctx->attributes.next;
+        RegisterList *item = reglist_first(&ctx->attributes);
         MOJOSHADER_attribute *wptr = retval;
         int ignore = 0;
         int i;
@@ -3430,11 +3760,11 @@ static MOJOSHADER_attribute *build_outputs(Context *ctx, int *_count)
     } // if
 
     const size_t len = sizeof (MOJOSHADER_attribute) * ctx->attribute_count;
-    MOJOSHADER_attribute *retval = (MOJOSHADER_attribute *) Malloc(ctx, len);
+    MOJOSHADER_attribute *retval = (MOJOSHADER_attribute *) UserMalloc(ctx, len);
 
     if (retval != NULL)
     {
-        RegisterList *item = ctx->attributes.next;
+        RegisterList *item = reglist_first(&ctx->attributes);
         MOJOSHADER_attribute *wptr = retval;
         int i;
 
@@ -3475,9 +3805,30 @@ static MOJOSHADER_attribute *build_outputs(Context *ctx, int *_count)
 } // build_outputs
 
 
+#ifdef MOJOSHADER_PARSE_STATS
+// Note how much went into each output section, before they get merged.
+static void stats_output_sections(Context *ctx)
+{
+    #define STATS_SECTION(x) \
+        ctx->stats.x##_bytes = (ctx->x) ? (unsigned int) buffer_size(ctx->x) : 0
+    STATS_SECTION(preflight);
+    STATS_SECTION(globals);
+    STATS_SECTION(inputs);
+    STATS_SECTION(outputs);
+    STATS_SECTION(helpers);
+    STATS_SECTION(subroutines);
+    STATS_SECTION(mainline_intro);
+    STATS_SECTION(mainline_arguments);
+    STATS_SECTION(mainline_top);
+    STATS_SECTION(mainline);
+    STATS_SECTION(postflight);
+    #undef STATS_SECTION
+} // stats_output_sections
+#endif
+
+
 static MOJOSHADER_parseData *build_parsedata(Context *ctx)
 {
-    char *output = NULL;
     MOJOSHADER_constant *constants = NULL;
     MOJOSHADER_uniform *uniforms = NULL;
     MOJOSHADER_attribute *attributes = NULL;
@@ -3485,7 +3836,6 @@ static MOJOSHADER_parseData *build_parsedata(Context *ctx)
     MOJOSHADER_sampler *samplers = NULL;
     MOJOSHADER_swizzle *swizzles = NULL;
     MOJOSHADER_error *errors = NULL;
-    auto *retval = new MOJOSHADER_parseData();
     size_t output_len = 0;
     int attribute_count = 0;
     int output_count = 0;
@@ -3493,11 +3843,22 @@ static MOJOSHADER_parseData *build_parsedata(Context *ctx)
     if (ctx->out_of_memory)
         return nullptr;
 
+    auto *retval = new MOJOSHADER_parseData();
     if (retval == nullptr)
         return nullptr;
 
-    if (!isfail(ctx))
-        output = build_output(ctx, &output_len);
+    STATS_TIMER(start);
+#ifdef MOJOSHADER_PARSE_STATS
+    stats_output_sections(ctx);
+#endif
+
+    if ((!isfail(ctx)) && (!ctx->reflect_only))
+    {
+        if (ctx->chunked_output)
+            output_len = output_chunks_size(ctx);
+        else
+            output_len = build_output(ctx, retval->output);
+    } // if
 
     if (!isfail(ctx))
         constants = build_constants(ctx);
@@ -3522,7 +3883,7 @@ static MOJOSHADER_parseData *build_parsedata(Context *ctx)
         if (ctx->swizzles_count > 0)
         {
             const int len = ctx->swizzles_count * sizeof (MOJOSHADER_swizzle);
-            swizzles = (MOJOSHADER_swizzle *) Malloc(ctx, len);
+            swizzles = (MOJOSHADER_swizzle *) UserMalloc(ctx, len);
             if (swizzles != NULL)
                 memcpy(swizzles, ctx->swizzles, len);
         } // if
@@ -3533,54 +3894,57 @@ static MOJOSHADER_parseData *build_parsedata(Context *ctx)
     {
         int i;
 
-        Free(ctx, output);
-        Free(ctx, constants);
-        Free(ctx, swizzles);
+        UserFree(ctx, constants);
+        UserFree(ctx, swizzles);
 
         if (uniforms != NULL)
         {
 //            for (i = 0; i < ctx->uniform_count; i++)
 //                Free(ctx, (void *) uniforms[i].name);
-            Free(ctx, uniforms);
+            UserFree(ctx, uniforms);
         } // if
 
         if (attributes != NULL)
         {
 //            for (i = 0; i < attribute_count; i++)
 //                Free(ctx, (void *) attributes[i].name);
-            Free(ctx, attributes);
+            UserFree(ctx, attributes);
         } // if
 
         if (outputs != NULL)
         {
 //            for (i = 0; i < output_count; i++)
 //                Free(ctx, (void *) outputs[i].name);
-            Free(ctx, outputs);
+            UserFree(ctx, outputs);
         } // if
 
         if (samplers != NULL)
         {
 //            for (i = 0; i < ctx->sampler_count; i++)
 //                Free(ctx, (void *) samplers[i].name);
-            Free(ctx, samplers);
+            UserFree(ctx, samplers);
         } // if
 
         if (ctx->out_of_memory)
         {
-            for (i = 0; i < error_count; i++)
-            {
-//                Free(ctx, (void *) errors[i].filename);
-//                Free(ctx, (void *) errors[i].error);
-            } // for
-            Free(ctx, errors);
-            Free(ctx, retval);
+            for (i = 0; (errors != NULL) && (i < error_count); i++)
+                errors[i].~MOJOSHADER_error();
+            UserFree(ctx, errors);
+            delete retval;
             return nullptr;
         } // if
     } // if
     else
     {
         retval->profile = ctx->profile->name;
-        retval->output = output;
+        if (ctx->chunked_output)
+        {
+            // no copies: the app gets the very blocks we emitted into.
+            Buffer *sections[16];
+            const size_t count = output_sections(ctx, sections);
+            retval->output_chunks = buffer_detach(sections, count,
+                                                  &retval->output_chunk_count);
+        } // if
         retval->output_len = (int) output_len;
         retval->instruction_count = ctx->instruction_count;
         retval->shader_type = ctx->shader_type;
@@ -3604,12 +3968,12 @@ static MOJOSHADER_parseData *build_parsedata(Context *ctx)
         retval->mainfn = ctx->mainfn;
 
 #if SUPPORT_PROFILE_SPIRV
-        if (strcmp(retval->profile, MOJOSHADER_PROFILE_SPIRV) == 0
-         || strcmp(retval->profile, MOJOSHADER_PROFILE_GLSPIRV) == 0)
+        if (retval->profile == MOJOSHADER_PROFILE_SPIRV
+         || retval->profile == MOJOSHADER_PROFILE_GLSPIRV)
         {
             size_t i, max;
             int binary_size = retval->output_len - sizeof(SpirvPatchTable);
-            uint32 *binary = (uint32 *) retval->output;
+            uint32 *binary = (uint32 *) &retval->output[0];
             SpirvPatchTable *table = (SpirvPatchTable *) &retval->output[binary_size];
 
             if (table->vpflip.offset)      binary[table->vpflip.offset]      = table->vpflip.location;
@@ -3639,6 +4003,14 @@ static MOJOSHADER_parseData *build_parsedata(Context *ctx)
     retval->free = (ctx->free == MOJOSHADER_internal_free) ? NULL : ctx->free;
     retval->malloc_data = ctx->malloc_data;
 
+#ifdef MOJOSHADER_PARSE_STATS
+    STATS_TIME(ctx, parsedata_ns, start);
+    ctx->stats.total_ns = stats_clock() - ctx->stats_start;
+    retval->stats = (MOJOSHADER_parseStats *) UserMalloc(ctx, sizeof (MOJOSHADER_parseStats));
+    if (retval->stats != NULL)
+        memcpy(retval->stats, &ctx->stats, sizeof (MOJOSHADER_parseStats));
+#endif
+
     return retval;
 } // build_parsedata
 
@@ -3650,9 +4022,8 @@ static void process_definitions(Context *ctx)
 
     determine_constants_arrays(ctx);  // in case this hasn't been called yet.
 
-    RegisterList *uitem = &ctx->uniforms;
-    RegisterList *prev = &ctx->used_registers;
-    RegisterList *item = prev->next;
+    RegisterList *prev = &ctx->used_registers.head;
+    RegisterList *item = reglist_first(&ctx->used_registers);
 
     while (item != NULL)
     {
@@ -3716,10 +4087,8 @@ static void process_definitions(Context *ctx)
                 case REG_TYPE_CONSTINT:
                 case REG_TYPE_CONSTBOOL:
                     // separate uniforms into a different list for now.
-                    prev->next = next;
-                    item->next = NULL;
-                    uitem->next = item;
-                    uitem = item;
+                    reglist_move(ctx, &ctx->used_registers, prev,
+                                 &ctx->uniforms);
                     item = prev;
                     break;
 
@@ -3777,7 +4146,7 @@ static void process_definitions(Context *ctx)
     } // for
 
     // ...and uniforms...
-    for (item = ctx->uniforms.next; item != NULL; item = item->next)
+    for (item = reglist_first(&ctx->uniforms); item != NULL; item = item->next)
     {
         int arraysize = -1;
         VariableList *var = NULL;
@@ -3818,7 +4187,7 @@ static void process_definitions(Context *ctx)
     } // for
 
     // ...and samplers...
-    for (item = ctx->samplers.next; item != NULL; item = item->next)
+    for (item = reglist_first(&ctx->samplers); item != NULL; item = item->next)
     {
         ctx->sampler_count++;
         ctx->profile->sampler_emitter(ctx, item->regnum,
@@ -3827,7 +4196,7 @@ static void process_definitions(Context *ctx)
     } // for
 
     // ...and attributes...
-    for (item = ctx->attributes.next; item != NULL; item = item->next)
+    for (item = reglist_first(&ctx->attributes); item != NULL; item = item->next)
     {
         ctx->attribute_count++;
         ctx->profile->attribute_emitter(ctx, item->regtype, item->regnum,
@@ -3852,64 +4221,29 @@ static void verify_swizzles(Context *ctx)
 } // verify_swizzles
 
 
-// API entry point...
-
-// !!! FIXME:
-// MSDN: "Shader validation will fail CreatePixelShader on any shader that
-//  attempts to read from a temporary register that has not been written by a
-//  previous instruction."  (true for ps_1_*, maybe others). Check this.
-
-const MOJOSHADER_parseData *MOJOSHADER_parse(const char *profile,
-                                             const char *mainfn,
-                                             const unsigned char *tokenbuf,
-                                             const unsigned int bufsize,
-                                             const MOJOSHADER_swizzle *swiz,
-                                             const unsigned int swizcount,
-                                             const MOJOSHADER_samplerMap *smap,
-                                             const unsigned int smapcount,
-                                             MOJOSHADER_malloc m,
-                                             MOJOSHADER_free f, void *d)
+// Run the front end over the whole shader. This is everything from the
+//  version token to the end token, calling emitters along the way (or
+//  recording them, for MOJOSHADER_decode()). Returns zero if this definitely
+//  isn't bytecode, in which case the caller should give up now to save lots
+//  of meaningless errors flooding through. (*_failed) is set if anything
+//  failed in an earlier token; ctx->isfail still has the last token's status.
+static int parse_shader(Context *ctx, const char *profilestr, int *_failed)
 {
-    auto *retval = new MOJOSHADER_parseData();
-    Context *ctx = NULL;
     int rc = 0;
     int failed = 0;
 
-    if ( ((m == NULL) && (f != NULL)) || ((m != NULL) && (f == NULL)) )
-        return nullptr;  // supply both or neither.
-
-    ctx = build_context(profile, mainfn, tokenbuf, bufsize, swiz, swizcount,
-                        smap, smapcount, m, f, d);
-    if (ctx == NULL)
-        return nullptr;
-
-    if (profile == NULL)  // build_context allows NULL; check this ourselves.
-        fail(ctx, "Profile name is NULL");
-
-    if (isfail(ctx))
-    {
-        retval = build_parsedata(ctx);
-        destroy_context(ctx);
-        return retval;
-    } // if
+    *_failed = 0;
 
     verify_swizzles(ctx);
 
-    if (!ctx->mainfn)
-        ctx->mainfn = StrDup(ctx, "main");
-
     // Version token always comes first.
+    STATS_TIMER(version_start);
     ctx->current_position = 0;
-    rc = parse_version_token(ctx, profile);
+    rc = parse_version_token(ctx, profilestr);
+    STATS_TIME(ctx, version_ns, version_start);
 
-    // drop out now if this definitely isn't bytecode. Saves lots of
-    //  meaningless errors flooding through.
     if (rc < 0)
-    {
-        retval = build_parsedata(ctx);
-        destroy_context(ctx);
-        return retval;
-    } // if
+        return 0;
 
     if ( ((uint32) rc) > ctx->tokencount )
     {
@@ -3920,6 +4254,7 @@ const MOJOSHADER_parseData *MOJOSHADER_parse(const char *profile,
     adjust_token_position(ctx, rc);
 
     // parse out the rest of the tokens after the version token...
+    STATS_TIMER(tokens_start);
     while (ctx->tokencount > 0)
     {
         if (!ctx->know_shader_size)
@@ -3932,6 +4267,9 @@ const MOJOSHADER_parseData *MOJOSHADER_parse(const char *profile,
             ctx->isfail = 0;
         } // if
 
+        if (ctx->decoding != NULL)
+            ctx->decoding->pass++;
+
         rc = parse_token(ctx);
         if ( ((uint32) rc) > ctx->tokencount )
         {
@@ -3942,6 +4280,8 @@ const MOJOSHADER_parseData *MOJOSHADER_parse(const char *profile,
         adjust_token_position(ctx, rc);
     } // while
 
+    STATS_TIME(ctx, tokens_ns, tokens_start);
+    STATS_COUNT(ctx, token_count, (uint32) (ctx->tokens - ctx->orig_tokens));
     ctx->current_position = MOJOSHADER_POSITION_AFTER;
 
     // for ps_1_*, the output color is written to r0...throw an
@@ -3953,20 +4293,1167 @@ const MOJOSHADER_parseData *MOJOSHADER_parse(const char *profile,
             fail(ctx, "r0 (pixel shader 1.x color output) never written to");
     } // if
 
-    if (!failed)
+    *_failed = failed;
+    return 1;
+} // parse_shader
+
+
+// (var) is one of (from)'s variables; find the same one in (ctx).
+static const VariableList *remap_variable(const Context *ctx,
+                                          const Context *from,
+                                          const VariableList *var)
+{
+    const VariableList *src = from->variables;
+    const VariableList *dst = ctx->variables;
+    if (var == NULL)
+        return NULL;
+
+    while ((src != NULL) && (dst != NULL))
+    {
+        if (src == var)
+            return dst;
+        src = src->next;
+        dst = dst->next;
+    } // while
+
+    return NULL;  // out of memory while copying, probably.
+} // remap_variable
+
+
+static void restore_destarg(DestArgInfo *info, const DecodedDestArg *arg)
+{
+    info->regnum = arg->regnum;
+    info->regtype = (RegisterType) arg->regtype;
+    info->relative = arg->relative;
+    info->orig_writemask = arg->orig_writemask;
+    info->result_mod = arg->result_mod;
+    info->result_shift = arg->result_shift;
+    set_dstarg_writemask(info, arg->writemask);
+} // restore_destarg
+
+
+static void restore_srcarg(const Context *ctx, SourceArgInfo *info,
+                           const DecodedSourceArg *arg)
+{
+    info->regnum = arg->regnum;
+    info->regtype = (RegisterType) arg->regtype;
+    info->swizzle = arg->swizzle;
+    info->swizzle_x = ((arg->swizzle >> 0) & 0x3);
+    info->swizzle_y = ((arg->swizzle >> 2) & 0x3);
+    info->swizzle_z = ((arg->swizzle >> 4) & 0x3);
+    info->swizzle_w = ((arg->swizzle >> 6) & 0x3);
+    info->src_mod = (SourceMod) arg->src_mod;
+    info->relative = arg->relative;
+    info->relative_regtype = (RegisterType) arg->relative_regtype;
+    info->relative_regnum = arg->relative_regnum;
+    info->relative_component = arg->relative_component;
+    info->relative_array = variable_at_position(ctx, arg->relative_array);
+} // restore_srcarg
+
+
+// (*nesting) is the DecodedNesting that ctx already has, if any.
+static void restore_step(Context *ctx, const MOJOSHADER_decodedShader *decoded,
+                         const DecodedStep *step, int *nesting)
+{
+    size_t i;
+    ctx->instruction_controls = step->instruction_controls;
+    ctx->coissue = step->coissue;
+    ctx->predicated = step->predicated;
+    ctx->previous_opcode = step->previous_opcode;
+    ctx->current_position = step->current_position;
+    memcpy(ctx->dwords, step->dwords, sizeof (ctx->dwords));
+    restore_destarg(&ctx->dest_arg, &step->dest_arg);
+    for (i = 0; i < STATICARRAYLEN(ctx->source_args); i++)
+        restore_srcarg(ctx, &ctx->source_args[i], &step->source_args[i]);
+    restore_srcarg(ctx, &ctx->predicate_arg, &step->predicate_arg);
+
+    if ( (step->nesting != *nesting) && (step->nesting >= 0) &&
+         (decoded->nesting != NULL) )
     {
-        process_definitions(ctx);
-        failed = isfail(ctx);
+        const DecodedNesting *n = &decoded->nesting[step->nesting];
+        ctx->loops = n->loops;
+        ctx->reps = n->reps;
+        ctx->max_reps = n->max_reps;
+        ctx->texm3x2pad_dst0 = n->texm3x2pad_dst0;
+        ctx->texm3x2pad_src0 = n->texm3x2pad_src0;
+        ctx->texm3x3pad_dst0 = n->texm3x3pad_dst0;
+        ctx->texm3x3pad_src0 = n->texm3x3pad_src0;
+        ctx->texm3x3pad_dst1 = n->texm3x3pad_dst1;
+        ctx->texm3x3pad_src1 = n->texm3x3pad_src1;
+        *nesting = step->nesting;
     } // if
+} // restore_step
 
-    if (!failed)
-        ctx->profile->finalize_emitter(ctx);
 
-    ctx->isfail = failed;
-    retval = build_parsedata(ctx);
-    destroy_context(ctx);
-    return retval;
-} // MOJOSHADER_parse
+static int report_decoded_errors(Context *ctx,
+                                 const MOJOSHADER_decodedShader *decoded,
+                                 int i, const int count)
+{
+    for (; i < count; i++)
+    {
+        const MOJOSHADER_error *error = &decoded->errors[i];
+        const char *fname = error->filename.empty() ? NULL : error->filename.c_str();
+        errorlist_add(ctx->errors, fname, error->error_position, error->error.c_str());
+    } // for
+    return i;
+} // report_decoded_errors
+
+
+// Run the emitters over a decoded shader's steps, with the front end's
+//  errors interleaved in the order they originally happened. An emitter
+//  failing counts against the rest of the shader just like it would have
+//  in the token loop: it sticks unless it happened on the last trip through.
+//  (*_failed) gets the token loop's "failed" flag, and ctx->isfail is left
+//  the way the token loop would have left it. Returns zero if this profile
+//  can't use the decoded steps and has to parse from scratch.
+static int emit_steps(Context *ctx, const MOJOSHADER_decodedShader *decoded,
+                      const char *profilestr, int *_failed)
+{
+    int reported = 0;
+    int failed = 0;
+    int lastfail = 0;
+    int nesting = -1;
+    int i;
+
+    for (i = 0; (i < decoded->step_count) && (!ctx->out_of_memory); i++)
+    {
+        const DecodedStep *step = &decoded->steps[i];
+        reported = report_decoded_errors(ctx, decoded, reported, step->error_count);
+        restore_step(ctx, decoded, step, &nesting);
+        ctx->isfail = 0;
+        call_emitter(ctx, (EmitterType) step->type, step->opcode, profilestr);
+
+        if (isfail(ctx))
+        {
+            if (step->pass < decoded->pass)
+                failed = 1;
+            else
+                lastfail = 1;
+        } // if
+
+        if ((step->type == EMITTER_START) && (ctx->ignores_ctab) &&
+            (decoded->ctab_sensitive))
+            return 0;
+    } // for
+
+    report_decoded_errors(ctx, decoded, reported, decoded->error_count);
+    restore_step(ctx, decoded, &decoded->final_state, &nesting);
+    ctx->isfail = (decoded->isfail || lastfail || ctx->out_of_memory);
+    *_failed = (failed || decoded->failed);
+    return 1;
+} // emit_steps
+
+
+// Optimizing decoded steps...
+
+// Since the steps are just saved-off emitter arguments, the emitters can't
+//  tell if we rewrite or drop a few of them before they're replayed. This
+//  only ever touches temp registers: everything else is either an input,
+//  an output, or something the metadata has already counted, so reflection
+//  comes out exactly the same no matter what happens here.
+//
+// !!! FIXME: this only handles straight-line code. Flow control needs real
+// !!! FIXME:  liveness across blocks (and loops), so we don't try at all.
+// !!! FIXME: ps_1_x is skipped too: r0 is the output, there's coissue, and
+// !!! FIXME:  the texture opcodes have implied register reads all over.
+
+typedef struct OptimizerTemps
+{
+    int count;
+    uint8 *live;  // component mask still needed, per temp register.
+    int *copy_of;  // -1, or the temp this temp is a plain copy of...
+    int *copy_swizzle;  // ...and the swizzle that copy was made with.
+    uint8 *dead;  // per step: nonzero if it's getting dropped.
+} OptimizerTemps;
+
+// How many source args an instruction has if it's a plain "dest = f(srcs)"
+//  opcode with no side effects, or -1 if it's anything else.
+static int optimize_srcarg_count(const Context *ctx, const uint32 opcode)
+{
+    const args_function parse_args = instructions[opcode].parse_args;
+    if (parse_args == parse_args_DS)
+        return 1;
+    else if (parse_args == parse_args_DSS)
+        return 2;
+    else if (parse_args == parse_args_DSSS)
+        return 3;
+    else if (parse_args == parse_args_DSSSS)
+        return 4;
+    else if (parse_args == parse_args_SINCOS)
+        return shader_version_atleast(ctx, 3, 0) ? 1 : 3;
+    else if (parse_args == parse_args_TEXLD)  // we only get here for sm2+.
+        return 2;
+    return -1;
+} // optimize_srcarg_count
+
+
+// The matrix opcodes read (src1) as several registers in a row.
+static int optimize_srcarg_rows(const uint32 opcode, const int argnum)
+{
+    if (argnum != 1)
+        return 1;
+
+    switch (opcode)
+    {
+        case OPCODE_M4X4: return 4;
+        case OPCODE_M4X3: return 3;
+        case OPCODE_M3X4: return 4;
+        case OPCODE_M3X3: return 3;
+        case OPCODE_M3X2: return 2;
+        default: break;
+    } // switch
+
+    return 1;
+} // optimize_srcarg_rows
+
+
+static inline int swizzle_mask(const int swizzle)
+{
+    return ( (1 << ((swizzle >> 0) & 0x3)) | (1 << ((swizzle >> 2) & 0x3)) |
+             (1 << ((swizzle >> 4) & 0x3)) | (1 << ((swizzle >> 6) & 0x3)) );
+} // swizzle_mask
+
+
+// Make sure we can reason about every step, and count the temp registers.
+//  Returns zero if this shader isn't something we know how to optimize.
+static int optimizable_steps(const Context *ctx,
+                             const MOJOSHADER_decodedShader *decoded,
+                             OptimizerTemps *temps)
+{
+    int i, j;
+
+    if ((decoded->failed) || (decoded->isfail) || (decoded->error_count > 0))
+        return 0;  // nothing is going to get emitted anyhow.
+    else if ((shader_is_pixel(ctx)) && (!shader_version_atleast(ctx, 2, 0)))
+        return 0;
+
+    temps->count = 0;
+    for (i = 0; i < decoded->step_count; i++)
+    {
+        const DecodedStep *step = &decoded->steps[i];
+        if (step->type == EMITTER_PHASE)
+            return 0;
+        else if (step->type != EMITTER_INSTRUCTION)
+            continue;
+        else if (step->coissue)
+            return 0;
+
+        const uint32 opcode = step->opcode;
+        const args_function parse_args = instructions[opcode].parse_args;
+        if (opcode == OPCODE_NOP)
+            continue;
+        else if ( (parse_args == parse_args_NULL) ||
+                  (parse_args == parse_args_S) ||
+                  (parse_args == parse_args_SS) )
+            return 0;  // everything else like this is flow control.
+
+        const int srcs = optimize_srcarg_count(ctx, opcode);
+        const DecodedDestArg *dst = &step->dest_arg;
+        if ((srcs >= 0) || (opcode == OPCODE_TEXKILL))
+        {
+            if (dst->regtype == REG_TYPE_TEMP)
+            {
+                if (dst->relative)
+                    return 0;
+                else if (dst->regnum >= temps->count)
+                    temps->count = dst->regnum + 1;
+            } // if
+        } // if
+
+        for (j = 0; j < srcs; j++)
+        {
+            const DecodedSourceArg *arg = &step->source_args[j];
+            if (arg->regtype == REG_TYPE_TEMP)
+            {
+                const int last = arg->regnum + optimize_srcarg_rows(opcode, j);
+                if (arg->relative)
+                    return 0;
+                else if (last > temps->count)
+                    temps->count = last;
+            } // if
+        } // for
+    } // for
+
+    return (temps->count > 0);
+} // optimizable_steps
+
+
+// Forget any copies that (regnum) was, or was the source of.
+static void kill_copies(OptimizerTemps *temps, const int regnum)
+{
+    int i;
+    for (i = 0; i < temps->count; i++)
+    {
+        if ((i == regnum) || (temps->copy_of[i] == regnum))
+            temps->copy_of[i] = -1;
+    } // for
+} // kill_copies
+
+
+// "mov r1, r0.yzwx" followed by "add r2, r1.x, c0" can read r0.y directly,
+//  and once nothing reads r1 anymore, the mov is dead code.
+static void propagate_copies(Context *ctx, MOJOSHADER_decodedShader *decoded,
+                             OptimizerTemps *temps)
+{
+    int i, j;
+
+    for (i = 0; i < temps->count; i++)
+        temps->copy_of[i] = -1;
+
+    for (i = 0; i < decoded->step_count; i++)
+    {
+        DecodedStep *step = &decoded->steps[i];
+        if (step->type != EMITTER_INSTRUCTION)
+            continue;
+
+        const uint32 opcode = step->opcode;
+        const int srcs = optimize_srcarg_count(ctx, opcode);
+        if (srcs < 0)
+            continue;  // TEXKILL, DCL, DEF, etc don't write temps.
+
+        for (j = 0; j < srcs; j++)
+        {
+            DecodedSourceArg *arg = &step->source_args[j];
+            if (arg->regtype != REG_TYPE_TEMP)
+                continue;
+            else if (optimize_srcarg_rows(opcode, j) != 1)
+                continue;  // matrix rows have to stay consecutive.
+
+            const int copy = temps->copy_of[arg->regnum];
+            if (copy == -1)
+                continue;
+
+            const int copyswiz = temps->copy_swizzle[arg->regnum];
+            const int swizzle = arg->swizzle;
+            const int x = (copyswiz >> (((swizzle >> 0) & 0x3) * 2)) & 0x3;
+            const int y = (copyswiz >> (((swizzle >> 2) & 0x3) * 2)) & 0x3;
+            const int z = (copyswiz >> (((swizzle >> 4) & 0x3) * 2)) & 0x3;
+            const int w = (copyswiz >> (((swizzle >> 6) & 0x3) * 2)) & 0x3;
+            arg->regnum = (uint16) copy;
+            arg->swizzle = (uint8) ((x << 0) | (y << 2) | (z << 4) | (w << 6));
+        } // for
+
+        const DecodedDestArg *dst = &step->dest_arg;
+        if (dst->regtype != REG_TYPE_TEMP)
+            continue;
+
+        kill_copies(temps, dst->regnum);
+
+        const DecodedSourceArg *src = &step->source_args[0];
+        if ( (opcode == OPCODE_MOV) && (!step->predicated) &&
+             (dst->writemask == 0xF) && (dst->result_mod == 0) &&
+             (dst->result_shift == 0) && (src->regtype == REG_TYPE_TEMP) &&
+             (src->src_mod == SRCMOD_NONE) && (src->regnum != dst->regnum) )
+        {
+            temps->copy_of[dst->regnum] = src->regnum;
+            temps->copy_swizzle[dst->regnum] = src->swizzle;
+        } // if
+    } // for
+} // propagate_copies
+
+
+// Walk backwards, dropping instructions whose results never get read.
+static void remove_dead_writes(Context *ctx, MOJOSHADER_decodedShader *decoded,
+                               OptimizerTemps *temps)
+{
+    int removed = 0;
+    int i, j;
+
+    // temps don't survive the shader in sm2+, so nothing is live at the end.
+    memset(temps->live, '\0', temps->count);
+    memset(temps->dead, '\0', decoded->step_count);
+
+    for (i = decoded->step_count - 1; i >= 0; i--)
+    {
+        DecodedStep *step = &decoded->steps[i];
+        if (step->type != EMITTER_INSTRUCTION)
+            continue;
+
+        const uint32 opcode = step->opcode;
+        const DecodedDestArg *dst = &step->dest_arg;
+        if (opcode == OPCODE_TEXKILL)  // its "destination" is really a read.
+        {
+            if (dst->regtype == REG_TYPE_TEMP)
+                temps->live[dst->regnum] |= 0xF;
+            continue;
+        } // if
+
+        const int srcs = optimize_srcarg_count(ctx, opcode);
+        if (srcs < 0)
+            continue;
+
+        if (dst->regtype == REG_TYPE_TEMP)
+        {
+            uint8 *live = &temps->live[dst->regnum];
+            if ((*live & dst->writemask) == 0)
+            {
+                temps->dead[i] = 1;
+                removed++;
+                continue;
+            } // if
+
+            // a predicated write might not happen, so it doesn't count.
+            if (!step->predicated)
+                *live &= ~dst->writemask;
+        } // if
+
+        for (j = 0; j < srcs; j++)
+        {
+            const DecodedSourceArg *arg = &step->source_args[j];
+            if (arg->regtype == REG_TYPE_TEMP)
+            {
+                const int rows = optimize_srcarg_rows(opcode, j);
+                const int mask = swizzle_mask(arg->swizzle);
+                int row;
+                for (row = 0; row < rows; row++)
+                    temps->live[arg->regnum + row] |= mask;
+            } // if
+        } // for
+    } // for
+
+    if (removed == 0)
+        return;
+
+    // errors are reported by count, so they still come out in the right
+    //  place when the step they were attached to is gone.
+    j = 0;
+    for (i = 0; i < decoded->step_count; i++)
+    {
+        if (!temps->dead[i])
+        {
+            if (i != j)
+                memcpy(&decoded->steps[j], &decoded->steps[i], sizeof (DecodedStep));
+            j++;
+        } // if
+    } // for
+    decoded->step_count = j;
+} // remove_dead_writes
+
+
+static void optimize_steps(Context *ctx, MOJOSHADER_decodedShader *decoded,
+                           const unsigned int optimize)
+{
+    OptimizerTemps temps;
+    memset(&temps, '\0', sizeof (temps));
+
+    if (!optimizable_steps(ctx, decoded, &temps))
+        return;
+
+    temps.live = (uint8 *) Malloc(ctx, temps.count);
+    temps.copy_of = (int *) Malloc(ctx, sizeof (int) * temps.count);
+    temps.copy_swizzle = (int *) Malloc(ctx, sizeof (int) * temps.count);
+    temps.dead = (uint8 *) Malloc(ctx, decoded->step_count);
+    if ( (temps.live == NULL) || (temps.copy_of == NULL) ||
+         (temps.copy_swizzle == NULL) || (temps.dead == NULL) )
+        return;  // out_of_memory is already set; the emitters will bail.
+
+    if (optimize & MOJOSHADER_OPTIMIZE_COPIES)
+        propagate_copies(ctx, decoded, &temps);
+    if (optimize & MOJOSHADER_OPTIMIZE_DEAD_CODE)
+        remove_dead_writes(ctx, decoded, &temps);
+
+    Free(ctx, temps.dead);
+    Free(ctx, temps.copy_swizzle);
+    Free(ctx, temps.copy_of);
+    Free(ctx, temps.live);
+} // optimize_steps
+
+
+// API entry point...
+
+// !!! FIXME:
+// MSDN: "Shader validation will fail CreatePixelShader on any shader that
+//  attempts to read from a temporary register that has not been written by a
+//  previous instruction."  (true for ps_1_*, maybe others). Check this.
+
+static const MOJOSHADER_parseData *parse_bytecode(const int reflect_only,
+                                                  const int chunked_output,
+                                                  const unsigned int optimize,
+                                                  const char *profile,
+                                                  const char *mainfn,
+                                                  const unsigned char *tokenbuf,
+                                                  const unsigned int bufsize,
+                                                  const MOJOSHADER_swizzle *swiz,
+                                                  const unsigned int swizcount,
+                                                  const MOJOSHADER_samplerMap *smap,
+                                                  const unsigned int smapcount,
+                                                  MOJOSHADER_malloc m,
+                                                  MOJOSHADER_free f, void *d)
+{
+    const MOJOSHADER_parseData *retval = NULL;
+    Context *ctx = NULL;
+    int failed = 0;
+    int i;
+
+    if ( ((m == NULL) && (f != NULL)) || ((m != NULL) && (f == NULL)) )
+        return nullptr;  // supply both or neither.
+
+    ctx = build_context(profile, mainfn, tokenbuf, bufsize, swiz, swizcount,
+                        smap, smapcount, m, f, d);
+    if (ctx == NULL)
+        return nullptr;
+
+    ctx->reflect_only = reflect_only;
+    ctx->chunked_output = chunked_output;
+
+#if SUPPORT_PROFILE_SPIRV
+    // SPIR-V gets patched in place at the end, so it has to be contiguous.
+    // (glspirv maps to the spirv profile, so this catches both.)
+    if ((ctx->profile != NULL) &&
+        (strcmp(ctx->profile->name, MOJOSHADER_PROFILE_SPIRV) == 0))
+        ctx->chunked_output = 0;
+#endif
+
+    // build_context() already made the mainline section, in the arena, with
+    //  nothing in it yet. Start it over with blocks the app can keep.
+    if (ctx->chunked_output)
+    {
+        ctx->mainline = NULL;
+        set_output(ctx, &ctx->mainline);
+    } // if
+
+    if (profile == NULL)  // build_context allows NULL; check this ourselves.
+        fail(ctx, "Profile name is NULL");
+
+    if (isfail(ctx))
+    {
+        retval = build_parsedata(ctx);
+        destroy_context(ctx);
+        return retval;
+    } // if
+
+    if (!ctx->mainfn)
+        ctx->mainfn = StrDup(ctx, "main");
+
+    // Decode the whole shader into steps first, then emit from those.
+    MOJOSHADER_decodedShader decoded;
+    memset(&decoded, '\0', sizeof (decoded));
+    decoded.ctx = ctx;
+    decoded.stepbuf = buffer_create(sizeof (DecodedStep) * 32, MallocBridge,
+                                    FreeBridge, ctx);
+    decoded.nestingbuf = buffer_create(sizeof (DecodedNesting) * 4,
+                                       MallocBridge, FreeBridge, ctx);
+    if ((decoded.stepbuf == NULL) || (decoded.nestingbuf == NULL))
+    {
+        retval = build_parsedata(ctx);
+        destroy_context(ctx);
+        return retval;
+    } // if
+
+    ctx->decoding = &decoded;
+    const int is_bytecode = parse_shader(ctx, profile, &decoded.failed);
+    ctx->decoding = NULL;
+
+    if (is_bytecode)
+    {
+        determine_constants_arrays(ctx);  // same as MOJOSHADER_decode().
+        decoded.isfail = ctx->isfail;
+        save_step(&decoded, ctx, &decoded.final_state);
+        decoded.step_count = (int) (buffer_size(decoded.stepbuf) / sizeof (DecodedStep));
+        decoded.steps = (DecodedStep *) buffer_flatten(decoded.stepbuf);
+        decoded.nesting = (DecodedNesting *) buffer_flatten(decoded.nestingbuf);
+        decoded.error_count = errorlist_count(ctx->errors);
+        decoded.errors = errorlist_flatten(ctx->errors);
+
+        if ((decoded.step_count > 0) && (decoded.steps == NULL))
+            out_of_memory(ctx);
+        else if ((decoded.nesting_count > 0) && (decoded.nesting == NULL))
+            out_of_memory(ctx);
+        else if ((decoded.error_count > 0) && (decoded.errors == NULL))
+            out_of_memory(ctx);
+        else  // the start emitter already ran, so this never wants a reparse.
+        {
+            // the bytecode profile passes the original tokens through.
+            if ( (optimize != 0) && (!reflect_only) &&
+                 (strcmp(ctx->profile->name, MOJOSHADER_PROFILE_BYTECODE) != 0) )
+            {
+                STATS_TIMER(optimize_start);
+                optimize_steps(ctx, &decoded, optimize);
+                STATS_TIME(ctx, optimize_ns, optimize_start);
+            } // if
+
+            STATS_TIMER(emit_start);
+            emit_steps(ctx, &decoded, profile, &failed);
+            STATS_TIME(ctx, emit_ns, emit_start);
+        } // else
+
+        for (i = 0; (decoded.errors != NULL) && (i < decoded.error_count); i++)
+            decoded.errors[i].~MOJOSHADER_error();
+        UserFree(ctx, decoded.errors);
+
+        if (!failed)
+        {
+            STATS_TIMER(definitions_start);
+            process_definitions(ctx);
+            STATS_TIME(ctx, definitions_ns, definitions_start);
+            failed = isfail(ctx);
+        } // if
+
+        if (!failed)
+        {
+            STATS_TIMER(finalize_start);
+            ctx->profile->finalize_emitter(ctx);
+            STATS_TIME(ctx, finalize_ns, finalize_start);
+        } // if
+
+        ctx->isfail = failed;
+    } // if
+
+    retval = build_parsedata(ctx);
+    destroy_context(ctx);
+    return retval;
+} // parse_bytecode
+
+
+const MOJOSHADER_parseData *MOJOSHADER_parse(const char *profile,
+                                             const char *mainfn,
+                                             const unsigned char *tokenbuf,
+                                             const unsigned int bufsize,
+                                             const MOJOSHADER_swizzle *swiz,
+                                             const unsigned int swizcount,
+                                             const MOJOSHADER_samplerMap *smap,
+                                             const unsigned int smapcount,
+                                             MOJOSHADER_malloc m,
+                                             MOJOSHADER_free f, void *d)
+{
+    return parse_bytecode(0, 0, 0, profile, mainfn, tokenbuf, bufsize, swiz,
+                          swizcount, smap, smapcount, m, f, d);
+} // MOJOSHADER_parse
+
+
+const MOJOSHADER_parseData *MOJOSHADER_parseChunked(const char *profile,
+                                                    const char *mainfn,
+                                                    const unsigned char *tokenbuf,
+                                                    const unsigned int bufsize,
+                                                    const MOJOSHADER_swizzle *swiz,
+                                                    const unsigned int swizcount,
+                                                    const MOJOSHADER_samplerMap *smap,
+                                                    const unsigned int smapcount,
+                                                    MOJOSHADER_malloc m,
+                                                    MOJOSHADER_free f, void *d)
+{
+    return parse_bytecode(0, 1, 0, profile, mainfn, tokenbuf, bufsize, swiz,
+                          swizcount, smap, smapcount, m, f, d);
+} // MOJOSHADER_parseChunked
+
+
+const MOJOSHADER_parseData *MOJOSHADER_parseOptimized(const char *profile,
+                                                      const char *mainfn,
+                                                      const unsigned char *tokenbuf,
+                                                      const unsigned int bufsize,
+                                                      const MOJOSHADER_swizzle *swiz,
+                                                      const unsigned int swizcount,
+                                                      const MOJOSHADER_samplerMap *smap,
+                                                      const unsigned int smapcount,
+                                                      const unsigned int optimize,
+                                                      MOJOSHADER_malloc m,
+                                                      MOJOSHADER_free f, void *d)
+{
+    return parse_bytecode(0, 0, optimize, profile, mainfn, tokenbuf, bufsize,
+                          swiz, swizcount, smap, smapcount, m, f, d);
+} // MOJOSHADER_parseOptimized
+
+
+const MOJOSHADER_parseData *MOJOSHADER_reflect(const char *profile,
+                                               const char *mainfn,
+                                               const unsigned char *tokenbuf,
+                                               const unsigned int bufsize,
+                                               const MOJOSHADER_swizzle *swiz,
+                                               const unsigned int swizcount,
+                                               const MOJOSHADER_samplerMap *smap,
+                                               const unsigned int smapcount,
+                                               MOJOSHADER_malloc m,
+                                               MOJOSHADER_free f, void *d)
+{
+    return parse_bytecode(1, 0, 0, profile, mainfn, tokenbuf, bufsize, swiz,
+                          swizcount, smap, smapcount, m, f, d);
+} // MOJOSHADER_reflect
+
+
+int MOJOSHADER_getOutputChunks(const MOJOSHADER_parseData *pd,
+                               const char **strings, int *lengths,
+                               const int max)
+{
+    if ((pd == NULL) || (pd->output_len == 0))
+        return 0;
+
+    if (pd->output_chunks == NULL)  // regular results are just one piece.
+    {
+        if (max > 0)
+        {
+            if (strings != NULL)
+                strings[0] = pd->output.c_str();
+            if (lengths != NULL)
+                lengths[0] = pd->output_len;
+        } // if
+        return 1;
+    } // if
+
+    const BufferBlock *item = (const BufferBlock *) pd->output_chunks;
+    int i;
+    for (i = 0; (item != NULL) && (i < max); i++, item = item->next)
+    {
+        if (strings != NULL)
+            strings[i] = (const char *) item->data;
+        if (lengths != NULL)
+            lengths[i] = (int) item->bytes;
+    } // for
+
+    return pd->output_chunk_count;
+} // MOJOSHADER_getOutputChunks
+
+
+// Decode once, emit many...
+
+void MOJOSHADER_freeDecodedShader(const MOJOSHADER_decodedShader *_decoded)
+{
+    MOJOSHADER_decodedShader *decoded = (MOJOSHADER_decodedShader *) _decoded;
+    if (decoded != NULL)
+    {
+        // everything else lives in the Context's arena.
+        Context *ctx = decoded->ctx;
+        int i;
+        for (i = 0; (decoded->errors != NULL) && (i < decoded->error_count); i++)
+            decoded->errors[i].~MOJOSHADER_error();
+        UserFree(ctx, decoded->errors);
+        destroy_context(ctx);
+    } // if
+} // MOJOSHADER_freeDecodedShader
+
+
+static inline const uint32 *rebase_token(const uint32 *from, const uint32 *to,
+                                         const uint32 *ptr)
+{
+    return (ptr == NULL) ? NULL : (to + (ptr - from));
+} // rebase_token
+
+
+const MOJOSHADER_decodedShader *MOJOSHADER_decode(const unsigned char *tokenbuf,
+                                                  const unsigned int bufsize,
+                                                  const MOJOSHADER_swizzle *swiz,
+                                                  const unsigned int swizcount,
+                                                  const MOJOSHADER_samplerMap *smap,
+                                                  const unsigned int smapcount,
+                                                  MOJOSHADER_malloc m,
+                                                  MOJOSHADER_free f, void *d)
+{
+    MOJOSHADER_decodedShader *retval = NULL;
+    Context *ctx = NULL;
+    int i;
+
+    if ( ((m == NULL) && (f != NULL)) || ((m != NULL) && (f == NULL)) )
+        return NULL;  // supply both or neither.
+
+    ctx = build_context(NULL, NULL, tokenbuf, bufsize, swiz, swizcount,
+                        smap, smapcount, m, f, d);
+    if (ctx == NULL)
+        return NULL;
+
+    retval = (MOJOSHADER_decodedShader *) Malloc(ctx, sizeof (MOJOSHADER_decodedShader));
+    if (retval == NULL)
+    {
+        destroy_context(ctx);
+        return NULL;
+    } // if
+
+    memset(retval, '\0', sizeof (MOJOSHADER_decodedShader));
+    retval->ctx = ctx;
+    retval->stepbuf = buffer_create(sizeof (DecodedStep) * 32, MallocBridge,
+                                    FreeBridge, ctx);
+    retval->nestingbuf = buffer_create(sizeof (DecodedNesting) * 4,
+                                       MallocBridge, FreeBridge, ctx);
+
+    // The caller's buffers only have to last until we return, so we keep
+    //  our own copies of anything emitters will want to look at later.
+    if (swizcount > 0)
+    {
+        const size_t len = sizeof (MOJOSHADER_swizzle) * swizcount;
+        MOJOSHADER_swizzle *swizzles = (MOJOSHADER_swizzle *) Malloc(ctx, len);
+        if (swizzles != NULL)
+            memcpy(swizzles, swiz, len);
+        ctx->swizzles = swizzles;
+    } // if
+
+    if (smapcount > 0)
+    {
+        const size_t len = sizeof (MOJOSHADER_samplerMap) * smapcount;
+        MOJOSHADER_samplerMap *samplermap = (MOJOSHADER_samplerMap *) Malloc(ctx, len);
+        if (samplermap != NULL)
+            memcpy(samplermap, smap, len);
+        ctx->samplermap = samplermap;
+    } // if
+
+    if ((retval->stepbuf == NULL) || (retval->nestingbuf == NULL) ||
+        (ctx->out_of_memory))
+    {
+        MOJOSHADER_freeDecodedShader(retval);
+        return NULL;
+    } // if
+
+    ctx->decoding = retval;
+    retval->not_bytecode = !parse_shader(ctx, NULL, &retval->failed);
+    ctx->decoding = NULL;
+
+    // process_definitions() would do this later, but emitting has to leave
+    //  the constants list alone, so several profiles can share it.
+    if (!retval->not_bytecode)
+        determine_constants_arrays(ctx);
+
+    retval->isfail = ctx->isfail;
+
+    // Now that we know how much of (tokenbuf) the front end looked at,
+    //  copy it and point everything that referenced it at the copy.
+    const uint32 *orig = ctx->orig_tokens;
+    const size_t consumed = (size_t) (ctx->tokens - orig);
+    const size_t tokencount = ctx->know_shader_size ? (bufsize / sizeof (uint32)) : consumed;
+    const size_t copycount = (tokencount > consumed) ? tokencount : consumed;
+    uint32 *tokens = (uint32 *) Malloc(ctx, (copycount + 1) * sizeof (uint32));
+    if (tokens != NULL)
+    {
+        memset(tokens, '\0', (copycount + 1) * sizeof (uint32));
+        if (tokencount > 0)
+            memcpy(tokens, orig, tokencount * sizeof (uint32));
+
+        retval->bufsize = ctx->know_shader_size ? (unsigned int) (tokencount * sizeof (uint32)) : 0;
+        retval->step_count = (int) (buffer_size(retval->stepbuf) / sizeof (DecodedStep));
+        retval->steps = (DecodedStep *) buffer_flatten(retval->stepbuf);
+        save_step(retval, ctx, &retval->final_state);
+        retval->nesting = (DecodedNesting *) buffer_flatten(retval->nestingbuf);
+
+        ctx->tokens = rebase_token(orig, tokens, ctx->tokens);
+        ctx->orig_tokens = tokens;
+        ctx->dest_arg.token = rebase_token(orig, tokens, ctx->dest_arg.token);
+        ctx->predicate_arg.token = rebase_token(orig, tokens, ctx->predicate_arg.token);
+        for (i = 0; i < (int) STATICARRAYLEN(ctx->source_args); i++)
+            ctx->source_args[i].token = rebase_token(orig, tokens, ctx->source_args[i].token);
+    } // if
+
+    buffer_destroy(retval->stepbuf);
+    retval->stepbuf = NULL;
+    buffer_destroy(retval->nestingbuf);
+    retval->nestingbuf = NULL;
+
+    retval->error_count = errorlist_count(ctx->errors);
+    retval->errors = errorlist_flatten(ctx->errors);
+
+    if (ctx->out_of_memory)
+    {
+        MOJOSHADER_freeDecodedShader(retval);
+        return NULL;
+    } // if
+
+    return retval;
+} // MOJOSHADER_decode
+
+
+static void copy_variables(Context *ctx, const VariableList *src)
+{
+    VariableList **tail = &ctx->variables;
+    *tail = NULL;
+    for (; src != NULL; src = src->next)
+    {
+        VariableList *var = (VariableList *) Malloc(ctx, sizeof (VariableList));
+        if (var == NULL)
+            return;
+        memcpy(var, src, sizeof (VariableList));
+        var->next = NULL;
+        *tail = var;
+        tail = &var->next;
+    } // for
+} // copy_variables
+
+
+static void copy_register_table(Context *ctx, RegisterTable *table,
+                                const Context *from, const RegisterTable *src)
+{
+    const RegisterList *item;
+    memset(table, '\0', sizeof (RegisterTable));
+
+    // walk the list as-is; reglist_first() would sort the original.
+    for (item = src->head.next; item != NULL; item = item->next)
+    {
+        RegisterList *copy = reglist_insert(ctx, table, item->regtype, item->regnum);
+        if (copy == NULL)
+            return;
+
+        RegisterList *next = copy->next;
+        memcpy(copy, item, sizeof (RegisterList));
+        copy->next = next;
+        copy->array = remap_variable(ctx, from, item->array);
+    } // for
+} // copy_register_table
+
+
+static void copy_sym_typeinfo(Context *ctx, MOJOSHADER_symbolTypeInfo *info,
+                              const MOJOSHADER_symbolTypeInfo *src)
+{
+    unsigned int i;
+
+    memcpy(info, src, sizeof (MOJOSHADER_symbolTypeInfo));
+    info->member_count = 0;
+    info->members = NULL;
+    if (src->member_count == 0)
+        return;
+
+    const size_t len = sizeof (MOJOSHADER_symbolStructMember) * src->member_count;
+    info->members = (MOJOSHADER_symbolStructMember *) UserMalloc(ctx, len);
+    if (info->members == NULL)
+        return;
+
+    memset(info->members, '\0', len);
+    info->member_count = src->member_count;
+    for (i = 0; i < src->member_count; i++)
+    {
+        MOJOSHADER_symbolStructMember *mbr = &info->members[i];
+        mbr->name = UserStrDup(ctx, src->members[i].name);
+        if (mbr->name == NULL)
+            return;
+        copy_sym_typeinfo(ctx, &mbr->info, &src->members[i].info);
+    } // for
+} // copy_sym_typeinfo
+
+
+static MOJOSHADER_symbol *copy_symbols(Context *ctx,
+                                       const MOJOSHADER_symbol *src,
+                                       const int count)
+{
+    int i;
+
+    if ((src == NULL) || (count <= 0))
+        return NULL;
+
+    const size_t len = sizeof (MOJOSHADER_symbol) * count;
+    MOJOSHADER_symbol *retval = (MOJOSHADER_symbol *) UserMalloc(ctx, len);
+    if (retval == NULL)
+        return NULL;
+
+    for (i = 0; i < count; i++)
+    {
+        MOJOSHADER_symbol *sym = new (&retval[i]) MOJOSHADER_symbol();
+        sym->name = src[i].name;
+        sym->register_set = src[i].register_set;
+        sym->register_index = src[i].register_index;
+        sym->register_count = src[i].register_count;
+        copy_sym_typeinfo(ctx, &sym->info, &src[i].info);
+    } // for
+
+    return retval;
+} // copy_symbols
+
+
+static MOJOSHADER_preshader *copy_preshader(Context *ctx,
+                                            const MOJOSHADER_preshader *src)
+{
+    unsigned int i, j;
+
+    if (src == NULL)
+        return NULL;
+
+    MOJOSHADER_preshader *retval = (MOJOSHADER_preshader *)
+                                UserMalloc(ctx, sizeof (MOJOSHADER_preshader));
+    if (retval == NULL)
+        return NULL;
+
+    memset(retval, '\0', sizeof (MOJOSHADER_preshader));
+    retval->malloc = ctx->malloc;
+    retval->free = ctx->free;
+    retval->malloc_data = ctx->malloc_data;
+    retval->temp_count = src->temp_count;
+
+    if (src->literal_count > 0)
+    {
+        const size_t len = sizeof (double) * src->literal_count;
+        retval->literals = (double *) UserMalloc(ctx, len);
+        if (retval->literals == NULL)
+            return retval;
+        memcpy(retval->literals, src->literals, len);
+        retval->literal_count = src->literal_count;
+    } // if
+
+    retval->symbols = copy_symbols(ctx, src->symbols, (int) src->symbol_count);
+    if (retval->symbols == NULL)
+        return retval;
+    retval->symbol_count = src->symbol_count;
+
+    if (src->instruction_count > 0)
+    {
+        const size_t len = sizeof (MOJOSHADER_preshaderInstruction) * src->instruction_count;
+        retval->instructions = (MOJOSHADER_preshaderInstruction *) UserMalloc(ctx, len);
+        if (retval->instructions == NULL)
+            return retval;
+
+        memcpy(retval->instructions, src->instructions, len);
+        retval->instruction_count = src->instruction_count;
+
+        // these still point at (src)'s arrays; fix that before anything fails.
+        for (i = 0; i < src->instruction_count; i++)
+        {
+            for (j = 0; j < src->instructions[i].operand_count; j++)
+                retval->instructions[i].operands[j].array_registers = NULL;
+        } // for
+
+        for (i = 0; i < src->instruction_count; i++)
+        {
+            for (j = 0; j < src->instructions[i].operand_count; j++)
+            {
+                const MOJOSHADER_preshaderOperand *operand = &src->instructions[i].operands[j];
+                if (operand->array_registers == NULL)
+                    continue;
+                const size_t siz = sizeof (uint32) * operand->array_register_count;
+                uint32 *regs = (uint32 *) UserMalloc(ctx, siz);
+                if (regs == NULL)
+                    return retval;
+                memcpy(regs, operand->array_registers, siz);
+                retval->instructions[i].operands[j].array_registers = regs;
+            } // for
+        } // for
+    } // if
+
+    if (src->register_count > 0)
+    {
+        const size_t len = src->register_count * sizeof (float) * 4;
+        retval->registers = (float *) UserMalloc(ctx, len);
+        if (retval->registers == NULL)
+            return retval;
+        memcpy(retval->registers, src->registers, len);
+        retval->register_count = src->register_count;
+    } // if
+
+    return retval;
+} // copy_preshader
+
+
+// Give (ctx), freshly built for some profile, the front end state from
+//  (decoded). Anything the emitters or process_definitions() might change
+//  gets copied; the rest is shared, since (decoded) never changes again.
+static void adopt_decoded_state(Context *ctx,
+                                const MOJOSHADER_decodedShader *decoded)
+{
+    const Context *from = decoded->ctx;
+    Context mine;
+
+    memcpy(&mine, ctx, sizeof (Context));
+    memcpy(ctx, from, sizeof (Context));
+
+    // ...but the allocator, output and error list are our own.
+    ctx->isfail = 0;
+    ctx->out_of_memory = mine.out_of_memory;
+    ctx->malloc = mine.malloc;
+    ctx->free = mine.free;
+    ctx->malloc_data = mine.malloc_data;
+    ctx->arena = mine.arena;
+    ctx->output = mine.output;
+    ctx->preflight = mine.preflight;
+    ctx->globals = mine.globals;
+    ctx->inputs = mine.inputs;
+    ctx->outputs = mine.outputs;
+    ctx->helpers = mine.helpers;
+    ctx->subroutines = mine.subroutines;
+    ctx->mainline_intro = mine.mainline_intro;
+    ctx->mainline_arguments = mine.mainline_arguments;
+    ctx->mainline_top = mine.mainline_top;
+    ctx->mainline = mine.mainline;
+    ctx->postflight = mine.postflight;
+    ctx->ignore = mine.ignore;
+    ctx->errors = mine.errors;
+    ctx->mainfn = mine.mainfn;
+    ctx->profileid = mine.profileid;
+    ctx->profile = mine.profile;
+#ifdef MOJOSHADER_PARSE_STATS
+    // ...and so are the stats. The decode's time and token counts belong to
+    //  MOJOSHADER_decode(), not to this call, which started at build_context().
+    ctx->stats = mine.stats;
+    ctx->stats_start = mine.stats_start;
+#endif
+
+    copy_variables(ctx, from->variables);
+    copy_register_table(ctx, &ctx->used_registers, from, &from->used_registers);
+    copy_register_table(ctx, &ctx->defined_registers, from, &from->defined_registers);
+    copy_register_table(ctx, &ctx->uniforms, from, &from->uniforms);
+    copy_register_table(ctx, &ctx->attributes, from, &from->attributes);
+    copy_register_table(ctx, &ctx->samplers, from, &from->samplers);
+
+    // these end up owned by the MOJOSHADER_parseData.
+    ctx->ctab.symbols = copy_symbols(ctx, from->ctab.symbols, from->ctab.symbol_count);
+    if (ctx->ctab.symbols == NULL)
+        ctx->ctab.symbol_count = 0;
+    ctx->preshader = copy_preshader(ctx, from->preshader);
+} // adopt_decoded_state
+
+
+const MOJOSHADER_parseData *MOJOSHADER_emit(const MOJOSHADER_decodedShader *decoded,
+                                            const char *profile,
+                                            const char *mainfn)
+{
+    const MOJOSHADER_parseData *retval = NULL;
+    Context *ctx = NULL;
+    int failed = 0;
+
+    if (decoded == NULL)
+        return nullptr;
+
+    const Context *from = decoded->ctx;
+    ctx = build_context(profile, mainfn, NULL, 0, NULL, 0, NULL, 0,
+                        from->malloc, from->free, from->malloc_data);
+    if (ctx == NULL)
+        return nullptr;
+
+    if (profile == NULL)  // build_context allows NULL; check this ourselves.
+        fail(ctx, "Profile name is NULL");
+
+    if (isfail(ctx))
+    {
+        retval = build_parsedata(ctx);
+        destroy_context(ctx);
+        return retval;
+    } // if
+
+    adopt_decoded_state(ctx, decoded);
+
+    if (!ctx->mainfn)
+        ctx->mainfn = StrDup(ctx, "main");
+
+    STATS_TIMER(emit_start);
+    const int emitted = emit_steps(ctx, decoded, profile, &failed);
+    STATS_TIME(ctx, emit_ns, emit_start);
+    if (!emitted)
+    {
+        // Profiles that ignore the CTAB parse relative addressing
+        //  differently. If that came up, this shader has to go the long way.
+        destroy_context(ctx);
+        return MOJOSHADER_parse(profile, mainfn,
+                                (const unsigned char *) from->orig_tokens,
+                                decoded->bufsize,
+                                from->swizzles, from->swizzles_count,
+                                from->samplermap, from->samplermap_count,
+                                from->malloc, from->free,
+                                from->malloc_data);
+    } // if
+
+    if (!decoded->not_bytecode)
+    {
+        if (!failed)
+        {
+            STATS_TIMER(definitions_start);
+            process_definitions(ctx);
+            STATS_TIME(ctx, definitions_ns, definitions_start);
+            failed = isfail(ctx);
+        } // if
+
+        if (!failed)
+        {
+            STATS_TIMER(finalize_start);
+            ctx->profile->finalize_emitter(ctx);
+            STATS_TIME(ctx, finalize_ns, finalize_start);
+        } // if
+
+        ctx->isfail = failed;
+    } // if
+
+    retval = build_parsedata(ctx);
+    destroy_context(ctx);
+    return retval;
+} // MOJOSHADER_emit
 
 int MOJOSHADER_version(void)
 {
@@ -498,6 +498,64 @@ typedef struct MOJOSHADER_preshader
     void *malloc_data;
 } MOJOSHADER_preshader;
 
+/*
+ * Where the time went, for a MOJOSHADER_parseData.
+ *
+ * This is only collected if MojoShader was built with MOJOSHADER_PARSE_STATS
+ *  defined (the PARSE_STATS option in CMake). Otherwise none of this costs
+ *  anything, and MOJOSHADER_parseData::stats is always NULL.
+ *
+ * Times are wall clock nanoseconds. Phases that a given call didn't run
+ *  (MOJOSHADER_emit() doesn't decode anything, for example) are zero. The
+ *  token loop includes the time spent in the CTAB and preshader, so
+ *  (preshader_ns) is part of (tokens_ns), not in addition to it.
+ */
+typedef struct MOJOSHADER_parseStats
+{
+    unsigned long long total_ns;  /* the whole call. */
+    unsigned long long version_ns;  /* the version token. */
+    unsigned long long tokens_ns;  /* decoding everything after it. */
+    unsigned long long preshader_ns;  /* preshader comments (in tokens_ns). */
+    unsigned long long optimize_ns;  /* MOJOSHADER_parseOptimized() only. */
+    unsigned long long emit_ns;  /* profile emitters for each instruction. */
+    unsigned long long definitions_ns;  /* declaring registers, uniforms... */
+    unsigned long long finalize_ns;  /* the profile's finishing touches. */
+    unsigned long long parsedata_ns;  /* building MOJOSHADER_parseData. */
+
+    /*
+     * Allocations made through the parser's memory arena, and allocations
+     *  made directly with the malloc you supplied (mostly things that end up
+     *  in the MOJOSHADER_parseData), with the number of bytes requested.
+     */
+    unsigned int arena_allocations;
+    unsigned long long arena_bytes;
+    unsigned int app_allocations;
+    unsigned long long app_bytes;
+
+    /*
+     * Tokens looked at, and how many of them were instructions and comments.
+     */
+    unsigned int token_count;
+    unsigned int instruction_count;
+    unsigned int comment_count;
+
+    /*
+     * Bytes written to each section of the output, before they were
+     *  put together. Which sections get used depends on the profile.
+     */
+    unsigned int preflight_bytes;
+    unsigned int globals_bytes;
+    unsigned int inputs_bytes;
+    unsigned int outputs_bytes;
+    unsigned int helpers_bytes;
+    unsigned int subroutines_bytes;
+    unsigned int mainline_intro_bytes;
+    unsigned int mainline_arguments_bytes;
+    unsigned int mainline_top_bytes;
+    unsigned int mainline_bytes;
+    unsigned int postflight_bytes;
+} MOJOSHADER_parseStats;
+
 /*
  * Structure used to return data from parsing of a shader...
  */
@@ -539,7 +597,8 @@ public:
     /*
      * Bytes of output from parsing. Most profiles produce a string of source
      *  code, but profiles that do binary output may not be text at all.
-     *  Will be NULL on error.
+     *  Will be NULL on error. This is empty if you used
+     *  MOJOSHADER_parseChunked(); see (output_chunks).
      */
     std::string output;
 
@@ -548,9 +607,22 @@ public:
      *  produce an ASCII string of source code (which will be null-terminated
      *  even though that null char isn't included in output_len), but profiles
      *  that do binary output may not be text at all. Will be 0 on error.
+     *  For chunked output, this is the total size of all the pieces.
      */
     int output_len;
 
+    /*
+     * The number of pieces in (output_chunks).
+     */
+    int output_chunk_count;
+
+    /*
+     * If this came from MOJOSHADER_parseChunked(), the output lives here,
+     *  in (output_chunk_count) pieces, instead of in (output). This is
+     *  opaque; use MOJOSHADER_getOutputChunks() to get at it. NULL otherwise.
+     */
+    void *output_chunks;
+
     /*
      * Count of Direct3D instruction slots used. This is meaningless in terms
      *  of the actual output, as the profile will probably grow or reduce
@@ -685,6 +757,13 @@ public:
      */
     MOJOSHADER_preshader *preshader;
 
+    /*
+     * Timing and counters for the parse that made this. This is always NULL
+     *  unless MojoShader was built with MOJOSHADER_PARSE_STATS defined.
+     *  See MOJOSHADER_parseStats.
+     */
+    MOJOSHADER_parseStats *stats;
+
     /*
      * This is the malloc implementation you passed to MOJOSHADER_parse().
      */
@@ -853,6 +932,150 @@ DECLSPEC const MOJOSHADER_parseData *MOJOSHADER_parse(const char *profile,
                                                       void *d);
 
 
+/*
+ * This works just like MOJOSHADER_parse(), and takes the same parameters,
+ *  but only gathers the shader's metadata: it doesn't generate a program.
+ *
+ * If all you want to know is what uniforms, constants, samplers, inputs and
+ *  outputs a shader uses (to build a material system or a pipeline layout
+ *  ahead of time, say), this saves putting the program together. The
+ *  bytecode is decoded and validated in full, and the profile still
+ *  translates every instruction, since that's where it finds out about
+ *  things it can't express (for example, an opcode that a given GLSL
+ *  version has no equivalent for). The pieces are thrown away instead of
+ *  being copied into one big string.
+ *
+ * The returned MOJOSHADER_parseData is what MOJOSHADER_parse() would have
+ *  given you for the same arguments, errors included, except that (output)
+ *  is empty and (output_len) is zero. Metadata that depends on the profile
+ *  (like the names of uniforms) comes out the same as it would for
+ *  (profile).
+ *
+ * Free the results with MOJOSHADER_freeParseData(), as usual.
+ *
+ * This function is thread safe, so long as (m) and (f) are too, and that
+ *  (tokenbuf) remains intact for the duration of the call.
+ */
+DECLSPEC const MOJOSHADER_parseData *MOJOSHADER_reflect(const char *profile,
+                                                        const char *mainfn,
+                                                        const unsigned char *tokenbuf,
+                                                        const unsigned int bufsize,
+                                                        const MOJOSHADER_swizzle *swiz,
+                                                        const unsigned int swizcount,
+                                                        const MOJOSHADER_samplerMap *smap,
+                                                        const unsigned int smapcount,
+                                                        MOJOSHADER_malloc m,
+                                                        MOJOSHADER_free f,
+                                                        void *d);
+
+
+/*
+ * This works just like MOJOSHADER_parse(), and takes the same parameters,
+ *  but doesn't put the output together into one string.
+ *
+ * Profiles write a program out in several sections (declarations, helper
+ *  functions, the main function, etc), and MOJOSHADER_parse() copies them
+ *  all into (output) at the end. If your API can take a program in pieces
+ *  (glShaderSource() takes an array of strings, for example), that copy is
+ *  wasted work, and for large shaders, wasted memory too. This function
+ *  hands you the pieces exactly as they were written instead.
+ *
+ * In the returned MOJOSHADER_parseData, (output) is empty, (output_len) is
+ *  the total size of the program, and the pieces themselves are found with
+ *  MOJOSHADER_getOutputChunks(). Nothing else is different. The pieces are
+ *  not null-terminated. They are freed by MOJOSHADER_freeParseData().
+ *
+ * Profiles that produce binary output that has to be patched in place after
+ *  the fact (SPIR-V) always come back in one piece, but you should still use
+ *  MOJOSHADER_getOutputChunks() to get at it.
+ *
+ * This function is thread safe, so long as (m) and (f) are too, and that
+ *  (tokenbuf) remains intact for the duration of the call.
+ */
+DECLSPEC const MOJOSHADER_parseData *MOJOSHADER_parseChunked(const char *profile,
+                                                             const char *mainfn,
+                                                             const unsigned char *tokenbuf,
+                                                             const unsigned int bufsize,
+                                                             const MOJOSHADER_swizzle *swiz,
+                                                             const unsigned int swizcount,
+                                                             const MOJOSHADER_samplerMap *smap,
+                                                             const unsigned int smapcount,
+                                                             MOJOSHADER_malloc m,
+                                                             MOJOSHADER_free f,
+                                                             void *d);
+
+
+/*
+ * Optimizations that MOJOSHADER_parseOptimized() can do. OR them together.
+ */
+#define MOJOSHADER_OPTIMIZE_NONE 0
+#define MOJOSHADER_OPTIMIZE_COPIES (1 << 0)  /* read through plain movs. */
+#define MOJOSHADER_OPTIMIZE_DEAD_CODE (1 << 1)  /* drop unused results. */
+#define MOJOSHADER_OPTIMIZE_ALL (MOJOSHADER_OPTIMIZE_COPIES | MOJOSHADER_OPTIMIZE_DEAD_CODE)
+
+/*
+ * This works just like MOJOSHADER_parse(), but cleans up the shader a little
+ *  before the profile writes it out. (optimize) is some combination of the
+ *  MOJOSHADER_OPTIMIZE_* flags; MOJOSHADER_OPTIMIZE_NONE gets you exactly
+ *  what MOJOSHADER_parse() would.
+ *
+ * Compilers tend to leave behind movs between temp registers and results
+ *  that nothing reads, and a lot of shaders in the wild were built with
+ *  optimizations turned off. MOJOSHADER_OPTIMIZE_COPIES rewrites instructions
+ *  to read the original register instead of a copy of it, and
+ *  MOJOSHADER_OPTIMIZE_DEAD_CODE removes instructions whose results are never
+ *  used (including movs that the first pass made pointless).
+ *
+ * Only temp registers are touched, so everything in the returned
+ *  MOJOSHADER_parseData except (output) and (output_len) is identical to what
+ *  MOJOSHADER_parse() gives you. That includes (instruction_count), which
+ *  still counts the instructions in the original bytecode.
+ *
+ * This is deliberately conservative. Shaders with flow control and ps_1_x
+ *  shaders are passed through untouched, and the "bytecode" profile never
+ *  changes anything, since it hands back the original tokens.
+ *
+ * This function is thread safe, so long as (m) and (f) are too, and that
+ *  (tokenbuf) remains intact for the duration of the call.
+ */
+DECLSPEC const MOJOSHADER_parseData *MOJOSHADER_parseOptimized(const char *profile,
+                                                               const char *mainfn,
+                                                               const unsigned char *tokenbuf,
+                                                               const unsigned int bufsize,
+                                                               const MOJOSHADER_swizzle *swiz,
+                                                               const unsigned int swizcount,
+                                                               const MOJOSHADER_samplerMap *smap,
+                                                               const unsigned int smapcount,
+                                                               const unsigned int optimize,
+                                                               MOJOSHADER_malloc m,
+                                                               MOJOSHADER_free f,
+                                                               void *d);
+
+
+/*
+ * Get the output of a parse as a list of pieces, in order. This is meant to
+ *  feed APIs like glShaderSource() directly.
+ *
+ * Up to (max) pieces are written to (strings) and (lengths); either of those
+ *  can be NULL if you don't need it. The return value is the total number of
+ *  pieces, which may be more than (max): call this with a (max) of zero to
+ *  find out how big your arrays need to be.
+ *
+ * This works on any MOJOSHADER_parseData. Results from MOJOSHADER_parseChunked()
+ *  will usually have several pieces; anything else gives you (output) as a
+ *  single piece. Results with no output (errors, MOJOSHADER_reflect(), etc)
+ *  have zero pieces.
+ *
+ * The strings point into (pd), and are valid until it is freed. They are not
+ *  null-terminated; use (lengths).
+ *
+ * This function is thread safe.
+ */
+DECLSPEC int MOJOSHADER_getOutputChunks(const MOJOSHADER_parseData *pd,
+                                        const char **strings, int *lengths,
+                                        const int max);
+
+
 /*
  * Call this to dispose of parsing results when you are done with them.
  *  This will call the MOJOSHADER_free function you provided to
@@ -865,6 +1088,200 @@ DECLSPEC const MOJOSHADER_parseData *MOJOSHADER_parse(const char *profile,
 DECLSPEC void MOJOSHADER_freeParseData(const MOJOSHADER_parseData *data);
 
 
+/*
+ * If you need the same shader in more than one profile (say, GLSL for one
+ *  renderer and ARB1 for another), you can decode the bytecode once and
+ *  then emit it as many times as you like, instead of calling
+ *  MOJOSHADER_parse() for each profile.
+ *
+ * MOJOSHADER_decode() does all the work of parsing and validating the
+ *  bytecode that doesn't depend on the profile, and keeps the results in
+ *  an opaque MOJOSHADER_decodedShader. The parameters mean the same thing
+ *  they do for MOJOSHADER_parse(). The decoded shader keeps its own copy of
+ *  (tokenbuf), (swiz) and (smap), so you can throw those away as soon as
+ *  this returns. The allocator is kept, too, and used for everything
+ *  MOJOSHADER_emit() produces from this decoded shader.
+ *
+ * Shaders with errors still decode; the errors are reported by each
+ *  MOJOSHADER_emit() call, exactly as MOJOSHADER_parse() would report them.
+ *
+ * Returns NULL on out of memory, or if you gave us one of (m) and (f)
+ *  without the other.
+ *
+ * This function is thread safe, so long as (m) and (f) are too.
+ */
+typedef struct MOJOSHADER_decodedShader MOJOSHADER_decodedShader;
+
+DECLSPEC const MOJOSHADER_decodedShader *MOJOSHADER_decode(const unsigned char *tokenbuf,
+                                                           const unsigned int bufsize,
+                                                           const MOJOSHADER_swizzle *swiz,
+                                                           const unsigned int swizcount,
+                                                           const MOJOSHADER_samplerMap *smap,
+                                                           const unsigned int smapcount,
+                                                           MOJOSHADER_malloc m,
+                                                           MOJOSHADER_free f,
+                                                           void *d);
+
+/*
+ * Run a decoded shader through a profile's emitter. (profile) and (mainfn)
+ *  mean the same thing they do for MOJOSHADER_parse(), and the result is
+ *  the same MOJOSHADER_parseData that MOJOSHADER_parse() would have given
+ *  you for the original bytecode. You own it, and free it the same way.
+ *
+ * Profiles that ignore the CTAB ("d3d" and "bytecode") parse relatively
+ *  addressed constants differently. If the shader has any, emitting it with
+ *  one of those profiles quietly parses the bytecode again, to get that
+ *  right. Everything else reuses the decoded shader as-is.
+ *
+ * Returns NULL on out of memory, or if (decoded) is NULL.
+ *
+ * (decoded) is never modified, so you can emit from the same decoded shader
+ *  on several threads at once, so long as its allocator is thread safe.
+ */
+DECLSPEC const MOJOSHADER_parseData *MOJOSHADER_emit(const MOJOSHADER_decodedShader *decoded,
+                                                     const char *profile,
+                                                     const char *mainfn);
+
+/*
+ * Free a decoded shader. Anything you already got from MOJOSHADER_emit()
+ *  stays valid. Passing a NULL here is a safe no-op.
+ */
+DECLSPEC void MOJOSHADER_freeDecodedShader(const MOJOSHADER_decodedShader *decoded);
+
+
+/*
+ * A parse cache remembers the results of MOJOSHADER_parse() so that the same
+ *  bytecode doesn't have to be translated more than once.
+ *
+ * Results are keyed by the contents of everything that affects translation:
+ *  the bytecode, the profile, the main function name, the swizzles and the
+ *  sampler map. Two calls with identical inputs will get the exact same
+ *  MOJOSHADER_parseData pointer back, no matter where the caller's buffers
+ *  live in memory.
+ *
+ * You can optionally give the cache a directory to persist results into.
+ *  Each successful translation is written there as a file named by its key
+ *  hash, and later processes that use the same directory will load the file
+ *  instead of parsing the shader again. Files from a different MojoShader
+ *  build (or ones that are truncated or otherwise corrupt) are ignored and
+ *  replaced. Pass NULL for (cachedir) to keep the cache in memory only.
+ *  The directory must already exist; MojoShader won't create it for you.
+ *
+ * All memory the cache and its results use comes from (m), (f) and (d),
+ *  which work like the allocator arguments to MOJOSHADER_parse().
+ *
+ * Returns NULL on out of memory.
+ */
+typedef struct MOJOSHADER_parseCache MOJOSHADER_parseCache;
+
+DECLSPEC MOJOSHADER_parseCache *MOJOSHADER_createParseCache(const char *cachedir,
+                                                            MOJOSHADER_malloc m,
+                                                            MOJOSHADER_free f,
+                                                            void *d);
+
+/*
+ * This works just like MOJOSHADER_parse(), but results come from (cache)
+ *  when possible. Parameters are the same as MOJOSHADER_parse(), minus the
+ *  allocator, which was supplied when the cache was created.
+ *
+ * Every result is reference counted: each call to this function must be
+ *  balanced by a call to MOJOSHADER_releaseCachedParseData(), and you must
+ *  not call MOJOSHADER_freeParseData() on anything this function returns.
+ *
+ * Only results without errors are kept. Shaders that fail to translate are
+ *  parsed from scratch every time, so you get a fresh set of errors back.
+ *  Likewise, a (bufsize) of zero bypasses the cache, since we can't know
+ *  how much of (tokenbuf) to hash.
+ *
+ * This function is thread safe, so long as the cache's allocator is, too.
+ *  Concurrent requests for the same uncached shader may both translate it,
+ *  but only one result is kept and both callers get that one.
+ */
+DECLSPEC const MOJOSHADER_parseData *MOJOSHADER_parseCached(MOJOSHADER_parseCache *cache,
+                                                            const char *profile,
+                                                            const char *mainfn,
+                                                            const unsigned char *tokenbuf,
+                                                            const unsigned int bufsize,
+                                                            const MOJOSHADER_swizzle *swiz,
+                                                            const unsigned int swizcount,
+                                                            const MOJOSHADER_samplerMap *smap,
+                                                            const unsigned int smapcount);
+
+/*
+ * Drop a reference obtained from MOJOSHADER_parseCached(). Cached results
+ *  stay in memory after their last reference goes away, so the next request
+ *  for the same shader is still instant; use MOJOSHADER_purgeParseCache()
+ *  to reclaim that memory. Uncached results are freed immediately.
+ *  Passing a NULL (data) is a safe no-op.
+ */
+DECLSPEC void MOJOSHADER_releaseCachedParseData(MOJOSHADER_parseCache *cache,
+                                                const MOJOSHADER_parseData *data);
+
+/*
+ * Free every cached result that currently has no outstanding references.
+ *  Persisted files in the cache directory are left alone.
+ */
+DECLSPEC void MOJOSHADER_purgeParseCache(MOJOSHADER_parseCache *cache);
+
+/*
+ * Free a parse cache and every result it holds. Any MOJOSHADER_parseData
+ *  you got from this cache is invalid after this call, whether you released
+ *  it or not. Passing a NULL here is a safe no-op.
+ */
+DECLSPEC void MOJOSHADER_destroyParseCache(MOJOSHADER_parseCache *cache);
+
+
+/*
+ * One shader to translate with MOJOSHADER_parseBatch(). Each field means the
+ *  same thing as the MOJOSHADER_parse() parameter of the same name.
+ */
+typedef struct MOJOSHADER_parseJob
+{
+    const char *profile;
+    const char *mainfn;
+    const unsigned char *tokenbuf;
+    unsigned int bufsize;
+    const MOJOSHADER_swizzle *swiz;
+    unsigned int swizcount;
+    const MOJOSHADER_samplerMap *smap;
+    unsigned int smapcount;
+} MOJOSHADER_parseJob;
+
+/*
+ * Translate a whole list of shaders in parallel.
+ *
+ * (jobs) is an array of (jobcount) shaders to translate. Each one is run
+ *  through MOJOSHADER_parse() (or MOJOSHADER_parseCached(), if (cache) is
+ *  not NULL) on a pool of (threadcount) threads, and (results[i]) is set to
+ *  the parse data for (jobs[i]), so results are in the same order as the
+ *  input no matter which thread finished first. (results) must have room
+ *  for (jobcount) pointers. The calling thread does work too, so a
+ *  (threadcount) of 1 runs everything serially on the calling thread.
+ *  Pass zero or less to use one thread per CPU core. Fewer threads are used
+ *  if there aren't that many jobs, or if the system won't start them.
+ *
+ * Every result is owned by the caller, exactly as if it came from
+ *  MOJOSHADER_parse() (or MOJOSHADER_parseCached(), in which case each one
+ *  must be released with MOJOSHADER_releaseCachedParseData()). A result can
+ *  be NULL if we ran out of memory; check each one individually.
+ *
+ * (m), (f) and (d) work like they do for MOJOSHADER_parse(), and are ignored
+ *  when (cache) is not NULL. They will be called from several threads at
+ *  once, so they must be thread safe!
+ *
+ * Returns the number of shaders that translated without errors, or -1 if
+ *  the arguments were bogus, in which case (results) is untouched.
+ */
+DECLSPEC int MOJOSHADER_parseBatch(const MOJOSHADER_parseJob *jobs,
+                                   const unsigned int jobcount,
+                                   const MOJOSHADER_parseData **results,
+                                   int threadcount,
+                                   MOJOSHADER_parseCache *cache,
+                                   MOJOSHADER_malloc m,
+                                   MOJOSHADER_free f,
+                                   void *d);
+
+
 /*
  * You almost certainly don't need this function, unless you absolutely know
  *  why you need it without hesitation. This is useful if you're doing
@@ -937,6 +1354,23 @@ typedef enum
 } MOJOSHADER_includeType;
 
 
+/*
+ * One file that the preprocessor pulled in with an #include...
+ */
+typedef struct MOJOSHADER_preprocessInclude
+{
+    /*
+     * The kind of #include this was: "blah.h" or <blah.h>.
+     */
+    MOJOSHADER_includeType type;
+
+    /*
+     * The name from the #include line, exactly as it was passed to the
+     *  includeOpen callback.
+     */
+    const char *filename;
+} MOJOSHADER_preprocessInclude;
+
 /*
  * Structure used to return data from preprocessing of a shader...
  */
@@ -967,6 +1401,22 @@ typedef struct MOJOSHADER_preprocessData
      */
     int output_len;
 
+    /*
+     * The number of elements pointed to by (includes).
+     */
+    int include_count;
+
+    /*
+     * (include_count) elements, one for each file that was successfully
+     *  opened by an #include, in the order they were first opened. Each
+     *  file is only listed once, no matter how many times it was included.
+     *  These are just names, not paths: it's up to the app to map them back
+     *  to real files, the same way its includeOpen callback did, if it wants
+     *  to do something like write out dependencies for a build system.
+     * This can be NULL if nothing was #included.
+     */
+    MOJOSHADER_preprocessInclude *includes;
+
     /*
      * This is the malloc implementation you passed to MOJOSHADER_parse().
      */
@@ -1073,6 +1523,13 @@ typedef void (MOJOSHADERCALL *MOJOSHADER_includeClose)(const char *data,
  *  behaviour for #include statements. Both are optional and can be NULL, but
  *  both must be specified if either is specified.
  *
+ * The preprocessor spots files that are wrapped in a classic include guard
+ *  (#ifndef X / #define X / ... / #endif, with nothing else outside of it),
+ *  and won't call (include_open) for them again while X is defined, since
+ *  their contents would just be skipped. Files that say "#pragma once" are
+ *  only ever included once. Like the include cache, this assumes the include
+ *  type and the name on the #include line are enough to say which file it is.
+ *
  * This will return a MOJOSHADER_preprocessorData. You should pass this
  *  return value to MOJOSHADER_freePreprocessData() when you are done with
  *  it.
@@ -1115,6 +1572,67 @@ DECLSPEC const MOJOSHADER_preprocessData *MOJOSHADER_preprocess(const char *file
 DECLSPEC void MOJOSHADER_freePreprocessData(const MOJOSHADER_preprocessData *data);
 
 
+/*
+ * An include cache holds on to the contents of every file that #include
+ *  pulls in, so preprocessing many shaders that share the same headers (for
+ *  example, every permutation of an uber-shader built with different
+ *  #defines) only has to open and read each header once.
+ *
+ * Pass a cache to MOJOSHADER_preprocessWithCache(),
+ *  MOJOSHADER_assembleWithCache() or MOJOSHADER_compileWithCache(). The first
+ *  time the cache sees an #include, it calls your includeOpen callback, keeps
+ *  its own copy of the data, and calls your includeClose callback right
+ *  away. After that, your callbacks aren't called for that file at all.
+ *
+ * Files are keyed on the include type and the name from the #include line,
+ *  so this assumes a given name always refers to the same file, no matter
+ *  which file includes it. That's true for MojoShader's own include handling,
+ *  but if your includeOpen callback resolves names differently depending on
+ *  (parent), use a separate cache for each set of search rules.
+ *
+ * The cache never looks at the filesystem again on its own. If headers
+ *  change on disk, call MOJOSHADER_purgeIncludeCache() to forget everything.
+ *
+ * All memory the cache uses comes from (m), (f) and (d), which work like the
+ *  allocator arguments to MOJOSHADER_preprocess().
+ *
+ * Returns NULL on out of memory.
+ */
+typedef struct MOJOSHADER_includeCache MOJOSHADER_includeCache;
+
+DECLSPEC MOJOSHADER_includeCache *MOJOSHADER_createIncludeCache(MOJOSHADER_malloc m,
+                                                                MOJOSHADER_free f,
+                                                                void *d);
+
+/*
+ * This works just like MOJOSHADER_preprocess(), but #includes are served
+ *  from (cache), which can be NULL to not cache anything. You can use the
+ *  same cache from several threads at once.
+ */
+DECLSPEC const MOJOSHADER_preprocessData *MOJOSHADER_preprocessWithCache(
+                             MOJOSHADER_includeCache *cache,
+                             const char *filename,
+                             const char *source, unsigned int sourcelen,
+                             const MOJOSHADER_preprocessorDefine *defines,
+                             unsigned int define_count,
+                             MOJOSHADER_includeOpen include_open,
+                             MOJOSHADER_includeClose include_close,
+                             MOJOSHADER_malloc m, MOJOSHADER_free f, void *d);
+
+/*
+ * Forget every file in the cache, so the next #include of each one goes
+ *  through your includeOpen callback again. Don't call this while another
+ *  thread is preprocessing, assembling or compiling with this cache.
+ */
+DECLSPEC void MOJOSHADER_purgeIncludeCache(MOJOSHADER_includeCache *cache);
+
+/*
+ * Free an include cache and everything in it. Don't call this while another
+ *  thread is still using the cache. Passing a NULL here is a safe no-op.
+ */
+DECLSPEC void MOJOSHADER_destroyIncludeCache(MOJOSHADER_includeCache *cache);
+
+
 /* Assembler interface... */
 
 /*
@@ -1185,6 +1703,23 @@ DECLSPEC const MOJOSHADER_parseData *MOJOSHADER_assemble(const char *filename,
                              MOJOSHADER_includeClose include_close,
                              MOJOSHADER_malloc m, MOJOSHADER_free f, void *d);
 
+/*
+ * This works just like MOJOSHADER_assemble(), but #includes are served from
+ *  (cache), which can be NULL. See MOJOSHADER_createIncludeCache().
+ */
+DECLSPEC const MOJOSHADER_parseData *MOJOSHADER_assembleWithCache(
+                             MOJOSHADER_includeCache *cache,
+                             const char *filename,
+                             const char *source, unsigned int sourcelen,
+                             const char **comments, unsigned int comment_count,
+                             const MOJOSHADER_symbol *symbols,
+                             unsigned int symbol_count,
+                             const MOJOSHADER_preprocessorDefine *defines,
+                             unsigned int define_count,
+                             MOJOSHADER_includeOpen include_open,
+                             MOJOSHADER_includeClose include_close,
+                             MOJOSHADER_malloc m, MOJOSHADER_free f, void *d);
+
 
 /* High level shading language support... */
 
@@ -2475,6 +3010,22 @@ DECLSPEC const MOJOSHADER_compileData *MOJOSHADER_compile(const char *srcprofile
                                     MOJOSHADER_malloc m, MOJOSHADER_free f,
                                     void *d);
 
+/*
+ * This works just like MOJOSHADER_compile(), but #includes are served from
+ *  (cache), which can be NULL. See MOJOSHADER_createIncludeCache().
+ */
+DECLSPEC const MOJOSHADER_compileData *MOJOSHADER_compileWithCache(
+                                    MOJOSHADER_includeCache *cache,
+                                    const char *srcprofile,
+                                    const char *filename, const char *source,
+                                    unsigned int sourcelen,
+                                    const MOJOSHADER_preprocessorDefine *defs,
+                                    unsigned int define_count,
+                                    MOJOSHADER_includeOpen include_open,
+                                    MOJOSHADER_includeClose include_close,
+                                    MOJOSHADER_malloc m, MOJOSHADER_free f,
+                                    void *d);
+
 
 /*
  * Call this to dispose of compile results when you are done with them.
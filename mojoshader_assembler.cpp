@@ -1454,6 +1454,7 @@ static Context *build_context(const char *filename,
                               unsigned int define_count,
                               MOJOSHADER_includeOpen include_open,
                               MOJOSHADER_includeClose include_close,
+                              MOJOSHADER_includeCache *include_cache,
                               MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
 {
     if (!m) m = MOJOSHADER_internal_malloc;
@@ -1489,6 +1490,7 @@ static Context *build_context(const char *filename,
 
     ctx->preprocessor = preprocessor_start(filename, source, sourcelen,
                                            include_open, include_close,
+                                           include_cache,
                                            defines, define_count, 1,
                                            MallocBridge, FreeBridge, ctx);
 
@@ -1869,7 +1871,9 @@ static const MOJOSHADER_parseData *build_final_assembly(Context *ctx)
 
 // API entry point...
 
-const MOJOSHADER_parseData *MOJOSHADER_assemble(const char *filename,
+const MOJOSHADER_parseData *MOJOSHADER_assembleWithCache(
+                             MOJOSHADER_includeCache *cache,
+                             const char *filename,
                              const char *source, unsigned int sourcelen,
                              const char **comments, unsigned int comment_count,
                              const MOJOSHADER_symbol *symbols,
@@ -1887,7 +1891,7 @@ const MOJOSHADER_parseData *MOJOSHADER_assemble(const char *filename,
         return &MOJOSHADER_out_of_mem_data;  // supply both or neither.
 
     ctx = build_context(filename, source, sourcelen, defines, define_count,
-                        include_open, include_close, m, f, d);
+                        include_open, include_close, cache, m, f, d);
     if (ctx == NULL)
         return &MOJOSHADER_out_of_mem_data;
 
@@ -1908,6 +1912,24 @@ const MOJOSHADER_parseData *MOJOSHADER_assemble(const char *filename,
     retval = build_final_assembly(ctx);
     destroy_context(ctx);
     return retval;
+} // MOJOSHADER_assembleWithCache
+
+
+const MOJOSHADER_parseData *MOJOSHADER_assemble(const char *filename,
+                             const char *source, unsigned int sourcelen,
+                             const char **comments, unsigned int comment_count,
+                             const MOJOSHADER_symbol *symbols,
+                             unsigned int symbol_count,
+                             const MOJOSHADER_preprocessorDefine *defines,
+                             unsigned int define_count,
+                             MOJOSHADER_includeOpen include_open,
+                             MOJOSHADER_includeClose include_close,
+                             MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
+{
+    return MOJOSHADER_assembleWithCache(NULL, filename, source, sourcelen,
+                                        comments, comment_count, symbols,
+                                        symbol_count, defines, define_count,
+                                        include_open, include_close, m, f, d);
 } // MOJOSHADER_assemble
 
 // end of mojoshader_assembler.c ...
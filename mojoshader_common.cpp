@@ -2,6 +2,10 @@
 #include "mojoshader_internal.h"
 #ifndef MOJOSHADER_USE_SDL_STDLIB
 #include <math.h>
+#include <new>
+#ifdef MOJOSHADER_PARSE_STATS
+#include <chrono>
+#endif
 #endif /* MOJOSHADER_USE_SDL_STDLIB */
 
 // Convenience functions for allocators...
@@ -25,17 +29,41 @@ MOJOSHADER_error MOJOSHADER_out_of_mem_error = {
 };
 
 
+// Open addressing with linear probing. Items live right in the table, so
+//  inserting doesn't allocate anything unless the table has to grow.
+//
+// Removing an item leaves a tombstone instead of shuffling its neighbors
+//  back, so it's safe to remove the item you just stepped past with
+//  hash_iter_keys(), which some callers depend on. Tombstones count against
+//  the load factor, and rehashing clears them out.
+//
+// Stackable tables can hold the same key more than once, and the newest one
+//  wins. Linear probing keeps those in insertion order along the probe
+//  sequence as long as nothing gets put into a tombstone, so stackable
+//  tables only ever insert into empty slots, and the newest item for a key
+//  is the last match before an empty slot.
+
+typedef enum
+{
+    HASHITEM_EMPTY,
+    HASHITEM_USED,
+    HASHITEM_DELETED
+} HashItemState;
+
 typedef struct HashItem
 {
     const void *key;
     const void *value;
-    struct HashItem *next;
+    uint32 hash;
+    HashItemState state;
 } HashItem;
 
 struct HashTable
 {
-    HashItem **table;
-    uint32 table_len;
+    HashItem *table;
+    uint32 table_len;  // always a power of two.
+    uint32 count;  // HASHITEM_USED slots.
+    uint32 deleted;  // HASHITEM_DELETED slots.
     int stackable;
     void *data;
     HashTable_HashFn hash;
@@ -46,114 +74,207 @@ struct HashTable
     void *d;
 };
 
-static inline uint32 calc_hash(const HashTable *table, const void *key)
+// iterators are just slot indices, offset by one so NULL means "start".
+#define HASH_ITER_INDEX(iter) ((uint32) (((size_t) (iter)) - 1))
+#define HASH_INDEX_ITER(idx) ((void *) (((size_t) (idx)) + 1))
+
+static inline int item_matches(const HashTable *table, const HashItem *item,
+                               const void *key, const uint32 hash)
 {
-    return table->hash(key, table->data) & (table->table_len-1);
-} // calc_hash
+    return ( (item->state == HASHITEM_USED) && (item->hash == hash) &&
+             (table->keymatch(key, item->key, table->data)) );
+} // item_matches
 
-int hash_find(const HashTable *table, const void *key, const void **_value)
+// Find the slot of the newest item with (key), or -1 if there isn't one.
+static int hash_find_index(const HashTable *table, const void *key,
+                           const uint32 hash)
 {
-    HashItem *i;
-    void *data = table->data;
-    const uint32 hash = calc_hash(table, key);
-    HashItem *prev = NULL;
-    for (i = table->table[hash]; i != NULL; i = i->next)
+    const uint32 mask = table->table_len - 1;
+    uint32 idx = hash & mask;
+    int retval = -1;
+
+    while (table->table[idx].state != HASHITEM_EMPTY)
     {
-        if (table->keymatch(key, i->key, data))
+        if (item_matches(table, &table->table[idx], key, hash))
         {
-            if (_value != NULL)
-                *_value = i->value;
-
-            // Matched! Move to the front of list for faster lookup next time.
-            //  (stackable tables have to remain in the same order, though!)
-            if ((!table->stackable) && (prev != NULL))
-            {
-                assert(prev->next == i);
-                prev->next = i->next;
-                i->next = table->table[hash];
-                table->table[hash] = i;
-            } // if
-
-            return 1;
+            retval = (int) idx;
+            if (!table->stackable)
+                break;  // there's only one, we're done.
         } // if
+        idx = (idx + 1) & mask;
+    } // while
 
-        prev = i;
-    } // for
+    return retval;
+} // hash_find_index
+
+int hash_find(const HashTable *table, const void *key, const void **_value)
+{
+    const int idx = hash_find_index(table, key, table->hash(key, table->data));
+    if (idx < 0)
+        return 0;
 
-    return 0;
+    if (_value != NULL)
+        *_value = table->table[idx].value;
+    return 1;
 } // hash_find
 
+int hash_find_hashed(const HashTable *table, const void *key,
+                     const uint32 hash, const void **_value)
+{
+    assert(hash == table->hash(key, table->data));
+    const int idx = hash_find_index(table, key, hash);
+    if (idx < 0)
+        return 0;
+
+    if (_value != NULL)
+        *_value = table->table[idx].value;
+    return 1;
+} // hash_find_hashed
+
 int hash_iter(const HashTable *table, const void *key,
               const void **_value, void **iter)
 {
-    HashItem *item = (HashItem *) *iter;
-    if (item == NULL)
-        item = table->table[calc_hash(table, key)];
-    else
-        item = item->next;
+    const uint32 hash = table->hash(key, table->data);
+    const uint32 mask = table->table_len - 1;
+    const uint32 home = hash & mask;
+    int idx = -1;
 
-    while (item != NULL)
+    if (*iter == NULL)
+        idx = hash_find_index(table, key, hash);
+
+    // Older items with the same key are between the last one we returned
+    //  and where the key hashes to, so walk backwards from there.
+    else if (table->stackable)
     {
-        if (table->keymatch(key, item->key, table->data))
+        uint32 i = HASH_ITER_INDEX(*iter);
+        while (i != home)
         {
-            *_value = item->value;
-            *iter = item;
-            return 1;
-        } // if
-        item = item->next;
-    } // while
+            i = (i - 1) & mask;
+            if (item_matches(table, &table->table[i], key, hash))
+            {
+                idx = (int) i;
+                break;
+            } // if
+        } // while
+    } // else if
 
-    // no more matches.
-    *_value = NULL;
-    *iter = NULL;
-    return 0;
+    if (idx < 0)  // no more matches.
+    {
+        *_value = NULL;
+        *iter = NULL;
+        return 0;
+    } // if
+
+    *_value = table->table[idx].value;
+    *iter = HASH_INDEX_ITER(idx);
+    return 1;
 } // hash_iter
 
 int hash_iter_keys(const HashTable *table, const void **_key, void **iter)
 {
-    HashItem *item = (HashItem *) *iter;
-    uint32 idx = 0;
-
-    if (item != NULL)
-    {
-        const HashItem *orig = item;
-        item = item->next;
-        if (item == NULL)
-            idx = calc_hash(table, orig->key) + 1;
-    } // if
+    uint32 idx = (*iter == NULL) ? 0 : HASH_ITER_INDEX(*iter) + 1;
 
-    while (!item && (idx < table->table_len))
-        item = table->table[idx++];  // skip empty buckets...
+    while ((idx < table->table_len) && (table->table[idx].state != HASHITEM_USED))
+        idx++;  // skip empty slots...
 
-    if (item == NULL)  // no more matches?
+    if (idx >= table->table_len)  // no more matches?
     {
         *_key = NULL;
         *iter = NULL;
         return 0;
     } // if
 
-    *_key = item->key;
-    *iter = item;
+    *_key = table->table[idx].key;
+    *iter = HASH_INDEX_ITER(idx);
     return 1;
 } // hash_iter_keys
 
+// Put everything in a new table of (new_len) slots, dropping tombstones.
+static int hash_resize(HashTable *table, const uint32 new_len)
+{
+    const uint32 old_len = table->table_len;
+    const uint32 new_mask = new_len - 1;
+    HashItem *old_table = table->table;
+    HashItem *new_table = (HashItem *) table->m(sizeof (HashItem) * new_len, table->d);
+    uint32 start, i;
+
+    if (new_table == NULL)
+        return 0;
+
+    memset(new_table, '\0', sizeof (HashItem) * new_len);
+
+    // Start right after an empty slot, so each probe sequence is copied in
+    //  order, even if it wraps around the end. That keeps stackable keys
+    //  in the right order. The load factor guarantees there's an empty one.
+    for (start = 0; start < old_len; start++)
+    {
+        if (old_table[start].state == HASHITEM_EMPTY)
+            break;
+    } // for
+    assert(start < old_len);
+
+    for (i = 1; i <= old_len; i++)
+    {
+        const HashItem *item = &old_table[(start + i) & (old_len - 1)];
+        if (item->state == HASHITEM_USED)
+        {
+            uint32 idx = item->hash & new_mask;
+            while (new_table[idx].state != HASHITEM_EMPTY)
+                idx = (idx + 1) & new_mask;
+            memcpy(&new_table[idx], item, sizeof (HashItem));
+        } // if
+    } // for
+
+    table->f(old_table, table->d);
+    table->table = new_table;
+    table->table_len = new_len;
+    table->deleted = 0;
+    return 1;
+} // hash_resize
+
 int hash_insert(HashTable *table, const void *key, const void *value)
 {
-    HashItem *item = NULL;
-    const uint32 hash = calc_hash(table, key);
-    if ( (!table->stackable) && (hash_find(table, key, NULL)) )
+    const uint32 hash = table->hash(key, table->data);
+    uint32 mask = table->table_len - 1;
+    uint32 idx;
+    int tombstone = -1;
+
+    if ( (!table->stackable) && (hash_find_index(table, key, hash) >= 0) )
         return 0;
 
-    // !!! FIXME: grow and rehash table if it gets too saturated.
-    item = (HashItem *) table->m(sizeof (HashItem), table->d);
-    if (item == NULL)
-        return -1;
+    // keep the table no more than 3/4 full, counting tombstones.
+    if (((table->count + table->deleted + 1) * 4) > (table->table_len * 3))
+    {
+        // if it's mostly tombstones, clearing them out is enough.
+        uint32 new_len = table->table_len;
+        if (((table->count + 1) * 2) > table->table_len)
+            new_len *= 2;
+        if (!hash_resize(table, new_len))
+            return -1;
+        mask = table->table_len - 1;
+    } // if
+
+    idx = hash & mask;
+    while (table->table[idx].state != HASHITEM_EMPTY)
+    {
+        if ((tombstone < 0) && (table->table[idx].state == HASHITEM_DELETED))
+            tombstone = (int) idx;
+        idx = (idx + 1) & mask;
+    } // while
 
+    // stackable tables can't reuse tombstones; see the comment up top.
+    if ((tombstone >= 0) && (!table->stackable))
+    {
+        idx = (uint32) tombstone;
+        table->deleted--;
+    } // if
+
+    HashItem *item = &table->table[idx];
     item->key = key;
     item->value = value;
-    item->next = table->table[hash];
-    table->table[hash] = item;
-
+    item->hash = hash;
+    item->state = HASHITEM_USED;
+    table->count++;
     return 1;
 } // hash_insert
 
@@ -163,14 +284,14 @@ HashTable *hash_create(void *data, const HashTable_HashFn hashfn,
               const int stackable,
               MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
 {
-    const uint32 initial_table_size = 256;
-    const uint32 alloc_len = sizeof (HashItem *) * initial_table_size;
+    const uint32 initial_table_size = 16;
+    const uint32 alloc_len = sizeof (HashItem) * initial_table_size;
     HashTable *table = (HashTable *) m(sizeof (HashTable), d);
     if (table == NULL)
         return NULL;
     memset(table, '\0', sizeof (HashTable));
 
-    table->table = (HashItem **) m(alloc_len, d);
+    table->table = (HashItem *) m(alloc_len, d);
     if (table->table == NULL)
     {
         f(table, d);
@@ -198,14 +319,9 @@ void hash_destroy(HashTable *table, const void *ctx)
     void *d = table->d;
     for (i = 0; i < table->table_len; i++)
     {
-        HashItem *item = table->table[i];
-        while (item != NULL)
-        {
-            HashItem *next = item->next;
+        const HashItem *item = &table->table[i];
+        if (item->state == HASHITEM_USED)
             table->nuke(ctx, item->key, item->value, data);
-            f(item, d);
-            item = next;
-        } // while
     } // for
 
     f(table->table, d);
@@ -214,28 +330,16 @@ void hash_destroy(HashTable *table, const void *ctx)
 
 int hash_remove(HashTable *table, const void *key, const void *ctx)
 {
-    HashItem *item = NULL;
-    HashItem *prev = NULL;
-    void *data = table->data;
-    const uint32 hash = calc_hash(table, key);
-    for (item = table->table[hash]; item != NULL; item = item->next)
-    {
-        if (table->keymatch(key, item->key, data))
-        {
-            if (prev != NULL)
-                prev->next = item->next;
-            else
-                table->table[hash] = item->next;
-
-            table->nuke(ctx, item->key, item->value, data);
-            table->f(item, table->d);
-            return 1;
-        } // if
-
-        prev = item;
-    } // for
+    const int idx = hash_find_index(table, key, table->hash(key, table->data));
+    if (idx < 0)
+        return 0;
 
-    return 0;
+    HashItem *item = &table->table[idx];
+    item->state = HASHITEM_DELETED;
+    table->count--;
+    table->deleted++;
+    table->nuke(ctx, item->key, item->value, table->data);
+    return 1;
 } // hash_remove
 
 
@@ -248,7 +352,7 @@ static inline uint32 hash_string_djbxor(const char *str, size_t len)
     return hash;
 } // hash_string_djbxor
 
-static inline uint32 hash_string(const char *str, size_t len)
+uint32 hash_string(const char *str, size_t len)
 {
     return hash_string_djbxor(str, len);
 } // hash_string
@@ -335,18 +439,25 @@ int stringmap_find(const StringMap *smap, const char *key, const char **_value)
 } // stringmap_find
 
 
-// The string cache...   !!! FIXME: use StringMap internally for this.
+// The string cache...
+//  Open addressing over (hash, length, string) triples, so most misses never
+//  touch the string data at all. Nothing is ever removed, so there are no
+//  tombstones to worry about. The strings themselves are carved out of an
+//  arena instead of getting an allocation each.
 
-typedef struct StringBucket
+typedef struct StringCacheItem
 {
-    char *string;
-    struct StringBucket *next;
-} StringBucket;
+    const char *string;  // NULL if this slot is empty.
+    uint32 hash;
+    uint32 len;
+} StringCacheItem;
 
 struct StringCache
 {
-    StringBucket **hashtable;
-    uint32 table_size;
+    StringCacheItem *table;
+    uint32 table_size;  // always a power of two.
+    uint32 count;
+    MemoryArena *strings;
     MOJOSHADER_malloc m;
     MOJOSHADER_free f;
     void *d;
@@ -358,47 +469,82 @@ const char *stringcache(StringCache *cache, const char *str)
     return stringcache_len(cache, str, strlen(str));
 } // stringcache
 
+// Double the table. Returns zero if we're out of memory.
+static int stringcache_grow(StringCache *cache)
+{
+    const uint32 new_size = cache->table_size * 2;
+    const uint32 mask = new_size - 1;
+    const size_t tablelen = sizeof (StringCacheItem) * new_size;
+    StringCacheItem *table = (StringCacheItem *) cache->m(tablelen, cache->d);
+    uint32 i;
+
+    if (table == NULL)
+        return 0;
+
+    memset(table, '\0', tablelen);
+    for (i = 0; i < cache->table_size; i++)
+    {
+        const StringCacheItem *item = &cache->table[i];
+        if (item->string != NULL)
+        {
+            uint32 idx = item->hash & mask;
+            while (table[idx].string != NULL)
+                idx = (idx + 1) & mask;
+            memcpy(&table[idx], item, sizeof (StringCacheItem));
+        } // if
+    } // for
+
+    cache->f(cache->table, cache->d);
+    cache->table = table;
+    cache->table_size = new_size;
+    return 1;
+} // stringcache_grow
+
 static const char *stringcache_len_internal(StringCache *cache,
                                             const char *str,
                                             const unsigned int len,
                                             const int addmissing)
 {
-    const uint8 hash = hash_string(str, len) & (cache->table_size-1);
-    StringBucket *bucket = cache->hashtable[hash];
-    StringBucket *prev = NULL;
-    while (bucket)
+    const uint32 hash = hash_string(str, len);
+    uint32 mask = cache->table_size - 1;
+    uint32 idx = hash & mask;
+    StringCacheItem *item;
+
+    while ((item = &cache->table[idx])->string != NULL)
     {
-        const char *bstr = bucket->string;
-        if ((strncmp(bstr, str, len) == 0) && (bstr[len] == 0))
-        {
-            // Matched! Move this to the front of the list.
-            if (prev != NULL)
-            {
-                assert(prev->next == bucket);
-                prev->next = bucket->next;
-                bucket->next = cache->hashtable[hash];
-                cache->hashtable[hash] = bucket;
-            } // if
-            return bstr; // already cached
-        } // if
-        prev = bucket;
-        bucket = bucket->next;
+        if ( (item->hash == hash) && (item->len == len) &&
+             (memcmp(item->string, str, len) == 0) )
+            return item->string; // already cached
+        idx = (idx + 1) & mask;
     } // while
 
     // no match!
     if (!addmissing)
         return NULL;
 
+    // keep it no more than 3/4 full, so probe sequences stay short.
+    if (((cache->count + 1) * 4) > (cache->table_size * 3))
+    {
+        if (!stringcache_grow(cache))
+            return NULL;
+        mask = cache->table_size - 1;
+        idx = hash & mask;
+        while (cache->table[idx].string != NULL)
+            idx = (idx + 1) & mask;
+        item = &cache->table[idx];
+    } // if
+
     // add to the table.
-    bucket = (StringBucket *) cache->m(sizeof (StringBucket) + len + 1, cache->d);
-    if (bucket == NULL)
+    char *string = (char *) arena_alloc(cache->strings, len + 1);
+    if (string == NULL)
         return NULL;
-    bucket->string = (char *)(bucket + 1);
-    memcpy(bucket->string, str, len);
-    bucket->string[len] = '\0';
-    bucket->next = cache->hashtable[hash];
-    cache->hashtable[hash] = bucket;
-    return bucket->string;
+    memcpy(string, str, len);
+    string[len] = '\0';
+    item->string = string;
+    item->hash = hash;
+    item->len = len;
+    cache->count++;
+    return string;
 } // stringcache_len_internal
 
 const char *stringcache_len(StringCache *cache, const char *str,
@@ -423,14 +569,16 @@ const char *stringcache_fmt(StringCache *cache, const char *fmt, ...)
     len = vsnprintf(buf, sizeof (buf), fmt, ap);
     va_end(ap);
 
-    if (len > sizeof (buf))
+    if (len < 0)
+        return NULL;
+    else if (len >= (int) sizeof (buf))
     {
-        ptr = (char *) cache->m(len, cache->d);
+        ptr = (char *) cache->m(len + 1, cache->d);
         if (ptr == NULL)
             return NULL;
 
         va_start(ap, fmt);
-        vsnprintf(ptr, len, fmt, ap);
+        vsnprintf(ptr, len + 1, fmt, ap);
         va_end(ap);
     } // if
 
@@ -443,20 +591,24 @@ const char *stringcache_fmt(StringCache *cache, const char *fmt, ...)
 
 StringCache *stringcache_create(MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
 {
-    const uint32 initial_table_size = 256;
-    const size_t tablelen = sizeof (StringBucket *) * initial_table_size;
+    const uint32 initial_table_size = 64;
+    const size_t tablelen = sizeof (StringCacheItem) * initial_table_size;
     StringCache *cache = (StringCache *) m(sizeof (StringCache), d);
     if (!cache)
         return NULL;
     memset(cache, '\0', sizeof (StringCache));
 
-    cache->hashtable = (StringBucket **) m(tablelen, d);
-    if (!cache->hashtable)
+    cache->table = (StringCacheItem *) m(tablelen, d);
+    cache->strings = arena_create(4 * 1024, m, f, d);
+    if ((!cache->table) || (!cache->strings))
     {
+        if (cache->table)
+            f(cache->table, d);
+        arena_destroy(cache->strings);
         f(cache, d);
         return NULL;
     } // if
-    memset(cache->hashtable, '\0', tablelen);
+    memset(cache->table, '\0', tablelen);
 
     cache->table_size = initial_table_size;
     cache->m = m;
@@ -472,21 +624,9 @@ void stringcache_destroy(StringCache *cache)
 
     MOJOSHADER_free f = cache->f;
     void *d = cache->d;
-    size_t i;
-
-    for (i = 0; i < cache->table_size; i++)
-    {
-        StringBucket *bucket = cache->hashtable[i];
-        cache->hashtable[i] = NULL;
-        while (bucket)
-        {
-            StringBucket *next = bucket->next;
-            f(bucket, d);
-            bucket = next;
-        } // while
-    } // for
 
-    f(cache->hashtable, d);
+    arena_destroy(cache->strings);
+    f(cache->table, d);
     f(cache, d);
 } // stringcache_destroy
 
@@ -546,16 +686,20 @@ int errorlist_add_fmt(ErrorList *list, const char *fname,
 int errorlist_add_va(ErrorList *list, const char *_fname,
                      const int errpos, const char *fmt, va_list va)
 {
-    ErrorItem *error = (ErrorItem *) list->m(sizeof (ErrorItem), list->d);
-    if (error == NULL)
+    void *ptr = list->m(sizeof (ErrorItem), list->d);
+    if (ptr == NULL)
         return 0;
 
+    // MOJOSHADER_error holds std::strings, so it has to be constructed.
+    ErrorItem *error = new (ptr) ErrorItem;
+
     char *fname = NULL;
     if (_fname != NULL)
     {
         fname = (char *) list->m(strlen(_fname) + 1, list->d);
         if (fname == NULL)
         {
+            error->~ErrorItem();
             list->f(error, list->d);
             return 0;
         } // if
@@ -586,6 +730,7 @@ int errorlist_add_va(ErrorList *list, const char *_fname,
     char *failstr = (char *) list->m(len + 1, list->d);
     if (failstr == NULL)
     {
+        error->~ErrorItem();
         list->f(error, list->d);
         list->f(fname, list->d);
         return 0;
@@ -603,10 +748,14 @@ int errorlist_add_va(ErrorList *list, const char *_fname,
         va_end(ap);
     } // else
 
+    // the strings keep their own copies; a NULL filename stays empty.
     error->error.error = failstr;
-    error->error.filename = fname;
+    if (fname != NULL)
+        error->error.filename = fname;
     error->error.error_position = errpos;
     error->next = NULL;
+    list->f(failstr, list->d);
+    list->f(fname, list->d);
 
     list->tail->next = error;
     list->tail = error;
@@ -638,7 +787,8 @@ MOJOSHADER_error *errorlist_flatten(ErrorList *list)
     {
         ErrorItem *next = item->next;
         // reuse the string allocations
-        memcpy(&retval[total], &item->error, sizeof (MOJOSHADER_error));
+        new (&retval[total]) MOJOSHADER_error(std::move(item->error));
+        item->~ErrorItem();
         list->f(item, list->d);
         item = next;
         total++;
@@ -663,8 +813,7 @@ void errorlist_destroy(ErrorList *list)
     while (item != NULL)
     {
         ErrorItem *next = item->next;
-//        f((void *) item->error.error, d);
-//        f((void *) item->error.filename, d);
+        item->~ErrorItem();
         f(item, d);
         item = next;
     } // while
@@ -819,6 +968,67 @@ int buffer_append_va(Buffer *buffer, const char *fmt, va_list va)
     return retval;
 } // buffer_append_va
 
+// These skip the printf machinery for the pieces text emitters glue together
+//  a line at a time; vsnprintf() has to parse the format string on every
+//  call, which shows up when you're doing it for every token of a shader.
+
+int buffer_append_str(Buffer *buffer, const char *str)
+{
+    return buffer_append(buffer, str, strlen(str));
+} // buffer_append_str
+
+int buffer_append_char(Buffer *buffer, const char ch)
+{
+    BufferBlock *tail = buffer->tail;
+    if ((tail != NULL) && (tail->bytes < buffer->block_size))
+    {
+        tail->data[tail->bytes++] = (uint8) ch;
+        buffer->total_bytes++;
+        return 1;
+    } // if
+
+    return buffer_append(buffer, &ch, 1);
+} // buffer_append_char
+
+// writes digits backwards from (end), returns the first character.
+static char *uint_to_str(char *end, unsigned int val)
+{
+    do
+    {
+        *(--end) = (char) ('0' + (val % 10));
+        val /= 10;
+    } while (val != 0);
+    return end;
+} // uint_to_str
+
+int buffer_append_uint(Buffer *buffer, const unsigned int val)
+{
+    char buf[16];
+    char *end = buf + sizeof (buf);
+    const char *str = uint_to_str(end, val);
+    return buffer_append(buffer, str, (size_t) (end - str));
+} // buffer_append_uint
+
+int buffer_append_int(Buffer *buffer, const int val)
+{
+    char buf[16];
+    char *end = buf + sizeof (buf);
+    // negate as unsigned, so INT_MIN doesn't overflow.
+    const unsigned int uval = (val < 0) ? (0u - (unsigned int) val) : val;
+    char *str = uint_to_str(end, uval);
+    if (val < 0)
+        *(--str) = '-';
+    return buffer_append(buffer, str, (size_t) (end - str));
+} // buffer_append_int
+
+int buffer_append_float(Buffer *buffer, const float f)
+{
+    char buf[128];
+    const size_t len = MOJOSHADER_printFloat(buf, sizeof (buf), f);
+    assert(len < sizeof (buf));
+    return buffer_append(buffer, buf, len);
+} // buffer_append_float
+
 size_t buffer_size(Buffer *buffer)
 {
     return buffer->total_bytes;
@@ -885,7 +1095,17 @@ char *buffer_merge(Buffer **buffers, const size_t n, size_t *_len)
     } // if
 
     *_len = len;
-    char *ptr = retval;
+    buffer_merge_into(buffers, n, retval);
+    retval[len] = '\0';
+    return retval;
+} // buffer_merge
+
+// Same as buffer_merge(), but into memory the caller already has, which
+//  must hold the total size of all the buffers. No null terminator is added.
+void buffer_merge_into(Buffer **buffers, const size_t n, char *dst)
+{
+    char *ptr = dst;
+    size_t i;
     for (i = 0; i < n; i++)
     {
         Buffer *buffer = buffers[i];
@@ -904,12 +1124,51 @@ char *buffer_merge(Buffer **buffers, const size_t n, size_t *_len)
         buffer->head = buffer->tail = NULL;
         buffer->total_bytes = 0;
     } // for
-    *ptr = '\0';
+} // buffer_merge_into
 
-    assert(ptr == (retval + len));
+// Take the blocks of several buffers without copying anything: they're
+//  chained together, in order, into one list that the caller now owns and
+//  must free with buffer_free_blocks(). The buffers are left empty.
+//  (*_count) gets the number of blocks in the list.
+BufferBlock *buffer_detach(Buffer **buffers, const size_t n, int *_count)
+{
+    BufferBlock *head = NULL;
+    BufferBlock *tail = NULL;
+    int count = 0;
+    size_t i;
+    for (i = 0; i < n; i++)
+    {
+        Buffer *buffer = buffers[i];
+        if ((buffer == NULL) || (buffer->head == NULL))
+            continue;
 
-    return retval;
-} // buffer_merge
+        BufferBlock *item;
+        for (item = buffer->head; item != NULL; item = item->next)
+            count++;
+
+        if (tail != NULL)
+            tail->next = buffer->head;
+        else
+            head = buffer->head;
+        tail = buffer->tail;
+
+        buffer->head = buffer->tail = NULL;
+        buffer->total_bytes = 0;
+    } // for
+
+    *_count = count;
+    return head;
+} // buffer_detach
+
+void buffer_free_blocks(BufferBlock *item, MOJOSHADER_free f, void *d)
+{
+    while (item != NULL)
+    {
+        BufferBlock *next = item->next;
+        f(item, d);
+        item = next;
+    } // while
+} // buffer_free_blocks
 
 void buffer_destroy(Buffer *buffer)
 {
@@ -966,89 +1225,489 @@ void buffer_patch(Buffer *buffer, const size_t start,
     } // while
 } // buffer_patch
 
-// Based on SDL_string.c's SDL_PrintFloat function
-size_t MOJOSHADER_printFloat(char *text, size_t maxlen, float arg)
+// Memory arenas...
+
+typedef struct ArenaChunk
+{
+    struct ArenaChunk *next;
+    size_t bytes;
+    size_t used;
+} ArenaChunk;
+
+struct MemoryArena
+{
+    ArenaChunk *chunks;  // head is the one we're currently carving up.
+    size_t chunk_size;
+    void *last;  // most recent allocation, so arena_free() can rewind it.
+    size_t lastlen;
+    ArenaChunk *lastchunk;
+    MOJOSHADER_malloc m;
+    MOJOSHADER_free f;
+    void *d;
+};
+
+// everything we hand out is aligned to this, which is enough for doubles
+//  and pointers everywhere we care about.
+#define ARENA_ALIGN 16
+#define ARENA_ALIGNED(x) (((x) + (ARENA_ALIGN - 1)) & ~((size_t) (ARENA_ALIGN - 1)))
+
+MemoryArena *arena_create(size_t chunksz, MOJOSHADER_malloc m,
+                          MOJOSHADER_free f, void *d)
 {
-    size_t len;
-    size_t left = maxlen;
-    char *textstart = text;
+    MemoryArena *arena = (MemoryArena *) m(sizeof (MemoryArena), d);
+    if (arena != NULL)
+    {
+        memset(arena, '\0', sizeof (MemoryArena));
+        arena->chunk_size = chunksz;
+        arena->m = m;
+        arena->f = f;
+        arena->d = d;
+    } // if
+    return arena;
+} // arena_create
+
+void *arena_alloc(MemoryArena *arena, size_t len)
+{
+    const size_t hdrlen = ARENA_ALIGNED(sizeof (ArenaChunk));
+    ArenaChunk *chunk = arena->chunks;
+
+    len = ARENA_ALIGNED(len ? len : 1);
 
-    int precision = 9;
+    if ((chunk != NULL) && ((chunk->bytes - chunk->used) >= len))
+    {
+        uint8 *retval = ((uint8 *) chunk) + hdrlen + chunk->used;
+        chunk->used += len;
+        arena->last = retval;
+        arena->lastlen = len;
+        arena->lastchunk = chunk;
+        return retval;
+    } // if
+
+    // Big allocations get a chunk to themselves, tucked in behind the
+    //  current one so we don't throw away its free space.
+    const int dedicated = (len > (arena->chunk_size / 4));
+    const size_t bytes = dedicated ? len : arena->chunk_size;
+    chunk = (ArenaChunk *) arena->m((int) (hdrlen + bytes), arena->d);
+    if (chunk == NULL)
+        return NULL;
 
-    if (isnan(arg))
+    chunk->bytes = bytes;
+    chunk->used = len;
+    if ((dedicated) && (arena->chunks != NULL))
     {
-        if (left > 3)
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+    } // if
+    else
+    {
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    } // else
+
+    arena->last = ((uint8 *) chunk) + hdrlen;
+    arena->lastlen = len;
+    arena->lastchunk = chunk;
+    return arena->last;
+} // arena_alloc
+
+void arena_free(MemoryArena *arena, void *ptr)
+{
+    // we only know where the newest allocation starts and ends, so that's
+    //  the only one we can take back. Everything else waits for
+    //  arena_destroy(). This still catches the common pattern of building
+    //  something in a scratch allocation and throwing it away right after.
+    if ((ptr == NULL) || (ptr != arena->last))
+        return;
+
+    ArenaChunk *chunk = arena->lastchunk;
+    if (chunk == arena->chunks)
+        chunk->used -= arena->lastlen;
+    else
+    {
+        // a dedicated chunk, which always sits right behind the head.
+        assert(arena->chunks->next == chunk);
+        arena->chunks->next = chunk->next;
+        arena->f(chunk, arena->d);
+    } // else
+
+    arena->last = NULL;
+    arena->lastlen = 0;
+    arena->lastchunk = NULL;
+} // arena_free
+
+void arena_destroy(MemoryArena *arena)
+{
+    if (arena != NULL)
+    {
+        MOJOSHADER_free f = arena->f;
+        void *d = arena->d;
+        ArenaChunk *chunk = arena->chunks;
+        while (chunk != NULL)
         {
-            snprintf(text, left, "NaN");
-            left -= 3;
-        } // if
-        text += 3;
+            ArenaChunk *next = chunk->next;
+            f(chunk, d);
+            chunk = next;
+        } // while
+        f(arena, d);
+    } // if
+} // arena_destroy
+
+#undef ARENA_ALIGNED
+#undef ARENA_ALIGN
+
+#ifdef MOJOSHADER_PARSE_STATS
+uint64 stats_clock(void)
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return (uint64) std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+} // stats_clock
+#endif
+
+// Float printing...
+//
+// This finds the shortest decimal string that reads back as exactly the same
+//  float, using Ulf Adams' Ryu algorithm ("Ryu: Fast Float-to-String
+//  Conversion", PLDI 2018): figure out the interval of decimals that round to
+//  this float, then strip digits off with integer math until any more would
+//  leave the interval. No printf, no locales, no long division.
+//
+// The tables are 5^i and 2^k/5^i, scaled to fit in 64 bits:
+//  float_pow5_inv_split[i] == floor(2^(pow5bits(i) - 1 + 59) / 5^i) + 1
+//  float_pow5_split[i] == floor(5^i / 2^(pow5bits(i) - 61))
+
+#define FLOAT_MANTISSA_BITS 23
+#define FLOAT_EXPONENT_BITS 8
+#define FLOAT_BIAS 127
+#define FLOAT_POW5_INV_BITCOUNT 59
+#define FLOAT_POW5_BITCOUNT 61
+
+static const uint64 float_pow5_inv_split[31] =
+{
+    0x0800000000000001ULL, 0x0666666666666667ULL, 0x051EB851EB851EB9ULL,
+    0x04189374BC6A7EFAULL, 0x068DB8BAC710CB2AULL, 0x053E2D6238DA3C22ULL,
+    0x0431BDE82D7B634EULL, 0x06B5FCA6AF2BD216ULL, 0x055E63B88C230E78ULL,
+    0x044B82FA09B5A52DULL, 0x06DF37F675EF6EAEULL, 0x057F5FF85E592558ULL,
+    0x0465E6604B7A8447ULL, 0x0709709A125DA071ULL, 0x05A126E1A84AE6C1ULL,
+    0x0480EBE7B9D58567ULL, 0x0734ACA5F6226F0BULL, 0x05C3BD5191B525A3ULL,
+    0x049C97747490EAE9ULL, 0x0760F253EDB4AB0EULL, 0x05E72843249088D8ULL,
+    0x04B8ED0283A6D3E0ULL, 0x078E480405D7B966ULL, 0x060B6CD004AC9452ULL,
+    0x04D5F0A66A23A9DBULL, 0x07BCB43D769F762BULL, 0x063090312BB2C4EFULL,
+    0x04F3A68DBC8F03F3ULL, 0x07EC3DAF94180651ULL, 0x065697BFA9ACD1DAULL,
+    0x051212FFBAF0A7E2ULL,
+};
+
+static const uint64 float_pow5_split[47] =
+{
+    0x1000000000000000ULL, 0x1400000000000000ULL, 0x1900000000000000ULL,
+    0x1F40000000000000ULL, 0x1388000000000000ULL, 0x186A000000000000ULL,
+    0x1E84800000000000ULL, 0x1312D00000000000ULL, 0x17D7840000000000ULL,
+    0x1DCD650000000000ULL, 0x12A05F2000000000ULL, 0x174876E800000000ULL,
+    0x1D1A94A200000000ULL, 0x12309CE540000000ULL, 0x16BCC41E90000000ULL,
+    0x1C6BF52634000000ULL, 0x11C37937E0800000ULL, 0x16345785D8A00000ULL,
+    0x1BC16D674EC80000ULL, 0x1158E460913D0000ULL, 0x15AF1D78B58C4000ULL,
+    0x1B1AE4D6E2EF5000ULL, 0x10F0CF064DD59200ULL, 0x152D02C7E14AF680ULL,
+    0x1A784379D99DB420ULL, 0x108B2A2C28029094ULL, 0x14ADF4B7320334B9ULL,
+    0x19D971E4FE8401E7ULL, 0x1027E72F1F128130ULL, 0x1431E0FAE6D7217CULL,
+    0x193E5939A08CE9DBULL, 0x1F8DEF8808B02452ULL, 0x13B8B5B5056E16B3ULL,
+    0x18A6E32246C99C60ULL, 0x1ED09BEAD87C0378ULL, 0x13426172C74D822BULL,
+    0x1812F9CF7920E2B6ULL, 0x1E17B84357691B64ULL, 0x12CED32A16A1B11EULL,
+    0x178287F49C4A1D66ULL, 0x1D6329F1C35CA4BFULL, 0x125DFA371A19E6F7ULL,
+    0x16F578C4E0A060B5ULL, 0x1CB2D6F618C878E3ULL, 0x11EFC659CF7D4B8DULL,
+    0x166BB7F0435C9E71ULL, 0x1C06A5EC5433C60DULL,
+};
+
+// ceil(log2(5^e)), or 1 for e == 0. Exact for 0 <= e <= 3528.
+static inline int32 pow5bits(const int32 e)
+{
+    return (int32) (((((uint32) e) * 1217359) >> 19) + 1);
+} // pow5bits
+
+// floor(log10(2^e)) and floor(log10(5^e)), for 0 <= e <= 1650.
+static inline uint32 log10pow2(const int32 e)
+{
+    return (((uint32) e) * 78913) >> 18;
+} // log10pow2
+
+static inline uint32 log10pow5(const int32 e)
+{
+    return (((uint32) e) * 732923) >> 20;
+} // log10pow5
+
+static inline int multiple_of_pow5(uint32 value, const uint32 p)
+{
+    uint32 count = 0;
+    while ((value % 5) == 0)
+    {
+        value /= 5;
+        count++;
+    } // while
+    return (count >= p);
+} // multiple_of_pow5
+
+static inline int multiple_of_pow2(const uint32 value, const uint32 p)
+{
+    return ((value & ((1u << p) - 1)) == 0);
+} // multiple_of_pow2
+
+static inline uint32 float_mulshift(const uint32 m, const uint64 factor,
+                                    const int32 shift)
+{
+    assert(shift > 32);
+    const uint64 lo = ((uint64) m) * ((uint32) factor);
+    const uint64 hi = ((uint64) m) * ((uint32) (factor >> 32));
+    return (uint32) (((lo >> 32) + hi) >> (shift - 32));
+} // float_mulshift
+
+// Splits a finite, nonzero float into (*_digits * 10^(*_exp10)), with the
+//  fewest digits that still round back to the same float.
+static void float_to_decimal(const uint32 mantissa, const uint32 exponent,
+                             uint32 *_digits, int32 *_exp10)
+{
+    int32 e2;
+    uint32 m2;
+    if (exponent == 0)  // denormal.
+    {
+        e2 = 1 - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = mantissa;
     } // if
-    else if (isinf(arg))
+    else
+    {
+        e2 = ((int32) exponent) - FLOAT_BIAS - FLOAT_MANTISSA_BITS - 2;
+        m2 = (1u << FLOAT_MANTISSA_BITS) | mantissa;
+    } // else
+
+    // round-half-even: if the mantissa is even, the bounds round to it, too.
+    const int accept_bounds = ((m2 & 1) == 0);
+
+    // the float, and halfway to its neighbors, all times 4.
+    const uint32 mv = 4 * m2;
+    const uint32 mp = 4 * m2 + 2;
+    // the gap below is half as big at the bottom of a binade.
+    const uint32 mmshift = ((mantissa != 0) || (exponent <= 1)) ? 1 : 0;
+    const uint32 mm = 4 * m2 - 1 - mmshift;
+
+    // convert those to decimal, with some digits to spare.
+    uint32 vr, vp, vm;
+    int32 e10;
+    int vm_trailing_zeros = 0;
+    int vr_trailing_zeros = 0;
+    uint32 last_removed = 0;
+    if (e2 >= 0)
     {
-        if (left > 3)
+        const uint32 q = log10pow2(e2);
+        const int32 k = FLOAT_POW5_INV_BITCOUNT + pow5bits((int32) q) - 1;
+        const int32 i = -e2 + ((int32) q) + k;
+        e10 = (int32) q;
+        vr = float_mulshift(mv, float_pow5_inv_split[q], i);
+        vp = float_mulshift(mp, float_pow5_inv_split[q], i);
+        vm = float_mulshift(mm, float_pow5_inv_split[q], i);
+        if ((q != 0) && (((vp - 1) / 10) <= (vm / 10)))
         {
-            snprintf(text, left, "inf");
-            left -= 3;
+            // the loop below won't run, but we still need the digit that
+            //  would have been removed for rounding.
+            const int32 l = FLOAT_POW5_INV_BITCOUNT + pow5bits((int32) (q - 1)) - 1;
+            last_removed = float_mulshift(mv, float_pow5_inv_split[q - 1],
+                                          -e2 + ((int32) q) - 1 + l) % 10;
         } // if
-        text += 3;
-    } // else if
-    else if (arg)
+
+        if (q <= 9)
+        {
+            // only one of mp, mv and mm can be a multiple of 5, if any.
+            if ((mv % 5) == 0)
+                vr_trailing_zeros = multiple_of_pow5(mv, q);
+            else if (accept_bounds)
+                vm_trailing_zeros = multiple_of_pow5(mm, q);
+            else
+                vp -= multiple_of_pow5(mp, q);
+        } // if
+    } // if
+    else
     {
-        /* This isn't especially accurate, but hey, it's easy. :) */
-        unsigned long value;
+        const uint32 q = log10pow5(-e2);
+        const int32 i = -e2 - ((int32) q);
+        const int32 k = pow5bits(i) - FLOAT_POW5_BITCOUNT;
+        int32 j = ((int32) q) - k;
+        e10 = ((int32) q) + e2;
+        vr = float_mulshift(mv, float_pow5_split[i], j);
+        vp = float_mulshift(mp, float_pow5_split[i], j);
+        vm = float_mulshift(mm, float_pow5_split[i], j);
+        if ((q != 0) && (((vp - 1) / 10) <= (vm / 10)))
+        {
+            j = ((int32) q) - 1 - (pow5bits(i + 1) - FLOAT_POW5_BITCOUNT);
+            last_removed = float_mulshift(mv, float_pow5_split[i + 1], j) % 10;
+        } // if
 
-        if (arg < 0)
+        if (q <= 1)
         {
-            if (left > 1)
-            {
-                *text = '-';
-                --left;
-            } // if
-            ++text;
-            arg = -arg;
+            // mv == 4 * m2, so it always has at least two trailing 0 bits.
+            vr_trailing_zeros = 1;
+            if (accept_bounds)
+                vm_trailing_zeros = (mmshift == 1);
+            else
+                vp--;  // mp == mv + 2, so it has at least one.
         } // if
-        value = (unsigned long) arg;
-        len = snprintf(text, left, "%lu", value);
-        text += len;
-        if (len >= left)
-            left = (left < 1) ? left : 1;
-        else
-            left -= len;
-        arg -= value;
+        else if (q < 31)
+        {
+            vr_trailing_zeros = multiple_of_pow2(mv, q - 1);
+        } // else if
+    } // else
 
-        int mult = 10;
-        if (left > 1)
+    // strip digits while the bounds still differ in what's left.
+    int32 removed = 0;
+    uint32 output;
+    if (vm_trailing_zeros || vr_trailing_zeros)
+    {
+        // uncommon case: the exact value might end right at a bound, or
+        //  land exactly halfway between two outputs.
+        while ((vp / 10) > (vm / 10))
         {
-            *text = '.';
-            --left;
+            vm_trailing_zeros &= ((vm % 10) == 0);
+            vr_trailing_zeros &= (last_removed == 0);
+            last_removed = vr % 10;
+            vr /= 10; vp /= 10; vm /= 10;
+            removed++;
+        } // while
+
+        if (vm_trailing_zeros)
+        {
+            while ((vm % 10) == 0)
+            {
+                vr_trailing_zeros &= (last_removed == 0);
+                last_removed = vr % 10;
+                vr /= 10; vp /= 10; vm /= 10;
+                removed++;
+            } // while
         } // if
-        ++text;
-        while (precision-- > 0)
+
+        if (vr_trailing_zeros && (last_removed == 5) && ((vr % 2) == 0))
+            last_removed = 4;  // exactly halfway: round to even.
+
+        const int at_lower = ((vr == vm) && ((!accept_bounds) || (!vm_trailing_zeros)));
+        output = vr + ((at_lower || (last_removed >= 5)) ? 1 : 0);
+    } // if
+    else
+    {
+        while ((vp / 10) > (vm / 10))
         {
-            value = (unsigned long) (arg * mult);
-            len = snprintf(text, left, "%lu", value);
-            text += len;
-            if (len >= left)
-                left = (left < 1) ? left : 1;
-            else
-                left -= len;
-            arg -= (double) value / mult;
-            if (arg < 0) arg = -arg; // Sometimes that bit gets flipped...
-            mult *= 10;
+            last_removed = vr % 10;
+            vr /= 10; vp /= 10; vm /= 10;
+            removed++;
         } // while
+        output = vr + (((vr == vm) || (last_removed >= 5)) ? 1 : 0);
+    } // else
+
+    *_digits = output;
+    *_exp10 = e10 + removed;
+} // float_to_decimal
+
+// Locale-independent, and always has a '.' in it (or is "NaN" or "inf"), so
+//  it's a float literal in every language we generate. Plain notation
+//  unless that would be silly, in which case it's like "1.5e-10".
+size_t MOJOSHADER_printFloat(char *text, size_t maxlen, float arg)
+{
+    char buf[32];
+    char *ptr = buf;
+
+    uint32 bits;
+    memcpy(&bits, &arg, sizeof (bits));
+    const uint32 mantissa = bits & ((1u << FLOAT_MANTISSA_BITS) - 1);
+    const uint32 exponent = (bits >> FLOAT_MANTISSA_BITS) & ((1u << FLOAT_EXPONENT_BITS) - 1);
+    const int negative = ((bits >> 31) != 0);
+
+    if (exponent == ((1u << FLOAT_EXPONENT_BITS) - 1))
+    {
+        if (mantissa != 0)
+            memcpy(ptr, "NaN", 3);
+        else
+            memcpy(ptr, "inf", 3);  // !!! FIXME: this loses the sign.
+        ptr += 3;
     } // if
     else
     {
-        if (left > 3)
+        if (negative)
+            *(ptr++) = '-';
+
+        if ((exponent == 0) && (mantissa == 0))
         {
-            snprintf(text, left, "0.0");
-            left -= 3;
+            memcpy(ptr, "0.0", 3);
+            ptr += 3;
         } // if
-        text += 3;
+        else
+        {
+            uint32 digits;
+            int32 exp10;
+            float_to_decimal(mantissa, exponent, &digits, &exp10);
+
+            char digitstr[16];
+            char *end = digitstr + sizeof (digitstr);
+            char *dstart = end;
+            do
+            {
+                *(--dstart) = (char) ('0' + (digits % 10));
+                digits /= 10;
+            } while (digits != 0);
+            const int32 ndigits = (int32) (end - dstart);
+
+            // value is 0.DIGITS * 10^point.
+            const int32 point = ndigits + exp10;
+            if ((point > 16) || (point < -4))  // scientific notation.
+            {
+                *(ptr++) = *(dstart++);
+                *(ptr++) = '.';
+                if (dstart == end)
+                    *(ptr++) = '0';
+                while (dstart != end)
+                    *(ptr++) = *(dstart++);
+                int32 e = point - 1;
+                *(ptr++) = 'e';
+                if (e < 0)
+                {
+                    *(ptr++) = '-';
+                    e = -e;
+                } // if
+                if (e >= 10)
+                    *(ptr++) = (char) ('0' + (e / 10));
+                *(ptr++) = (char) ('0' + (e % 10));
+            } // if
+            else if (point <= 0)  // 0.000DIGITS
+            {
+                *(ptr++) = '0';
+                *(ptr++) = '.';
+                for (int32 i = point; i < 0; i++)
+                    *(ptr++) = '0';
+                while (dstart != end)
+                    *(ptr++) = *(dstart++);
+            } // else if
+            else if (point >= ndigits)  // DIGITS000.0
+            {
+                while (dstart != end)
+                    *(ptr++) = *(dstart++);
+                for (int32 i = ndigits; i < point; i++)
+                    *(ptr++) = '0';
+                *(ptr++) = '.';
+                *(ptr++) = '0';
+            } // else if
+            else  // DIG.ITS
+            {
+                for (int32 i = 0; i < point; i++)
+                    *(ptr++) = *(dstart++);
+                *(ptr++) = '.';
+                while (dstart != end)
+                    *(ptr++) = *(dstart++);
+            } // else
+        } // else
     } // else
 
-    return (text - textstart);
+    // like snprintf(): truncate to fit, but report the whole length.
+    const size_t len = (size_t) (ptr - buf);
+    assert(len < sizeof (buf));
+    if (maxlen > 0)
+    {
+        const size_t cpy = (len < maxlen) ? len : (maxlen - 1);
+        memcpy(text, buf, cpy);
+        text[cpy] = '\0';
+    } // if
+    return len;
 } // MOJOSHADER_printFloat
 
 #if SUPPORT_PROFILE_SPIRV
@@ -13,6 +13,9 @@
 
 #define __MOJOSHADER_INTERNAL__ 1
 #include "mojoshader_internal.h"
+#ifndef MOJOSHADER_USE_SDL_STDLIB
+#include <math.h>  // fmodf(), for constant folding.
+#endif
 
 #if DEBUG_COMPILER_PARSER
 #define LEMON_SUPPORT_TRACING 1
@@ -64,19 +67,37 @@ typedef union TokenData
 
 // This tracks data types and variables, and notes when they enter/leave scope.
 
-typedef struct SymbolScope
+typedef struct Symbol
 {
-    const char *symbol;
+    const char *symbol;  // from ctx->strcache, so we compare pointers.
     const MOJOSHADER_astDataType *datatype;
     int index;  // unique positive value within a function, negative if global.
     int referenced;  // non-zero if something looked for this symbol (so we know it's used).
-    struct SymbolScope *next;
-} SymbolScope;
+    int shadowed;  // slot of the older symbol with this name, -1 if none.
+} Symbol;
+
+// Every symbol name we've seen, mapped to the newest symbol with that name.
+//  Names are never removed, they just point at -1 when out of scope.
+typedef struct SymbolName
+{
+    const char *symbol;
+    int newest;
+} SymbolName;
 
+// Symbols live in one array, oldest first; a scope is just the symbol
+//  count when it started, so leaving one is a truncate and not a free
+//  per symbol.
 typedef struct SymbolMap
 {
-    HashTable *hash;
-    SymbolScope *scope;
+    Symbol *symbols;
+    int symbol_count;
+    int symbol_alloc;
+    int *scopes;
+    int scope_count;
+    int scope_alloc;
+    SymbolName *names;  // open addressing, hashed on the string pointer.
+    int name_count;
+    int name_alloc;  // always zero or a power of two.
 } SymbolMap;
 
 typedef struct LoopLabels
@@ -86,6 +107,168 @@ typedef struct LoopLabels
     struct LoopLabels *prev;
 } LoopLabels;
 
+// A for-loop with a trip count we can figure out at compile time. These are
+//  noted while building the IR (the IR itself doesn't keep the initializer
+//  around) so unroll_ir_loops() can find them later.
+typedef struct IrLoop
+{
+    MOJOSHADER_irStatement *loop;  // the SEQ that build_ir_forstmt() made.
+    int test;  // labels from build_ir_forstmt()...
+    int body;
+    int increment;
+    int join;
+    int var;  // MEMORY index of the loop counter.
+    int start;  // counter's value on the first trip.
+    int step;
+    int trips;
+    int keep_counter;  // non-zero if the counter is visible after the loop.
+    struct IrLoop *next;
+} IrLoop;
+
+// Built-in datatypes and intrinsic functions are the same for every
+//  compile, so they're built once, the first time anything is parsed (see
+//  init_builtins()), and shared read-only by every Context after that.
+
+// This is exactly how many overloads init_builtins() registers; the assert
+//  in add_intrinsic() will let you know if it needs to grow.
+#define MAX_INTRINSICS 4098
+
+typedef struct Intrinsic
+{
+    const char *name;
+    int index;  // function index for the IR; these are negative.
+    int lead;  // overload_category() of the first parameter.
+    MOJOSHADER_astDataType datatype;
+    const MOJOSHADER_astDataType *params[4];
+} Intrinsic;
+
+typedef struct Builtins
+{
+    // Cache intrinsic types for fast lookup and consistent pointer values.
+    MOJOSHADER_astDataType dt_none;
+    MOJOSHADER_astDataType dt_bool;
+    MOJOSHADER_astDataType dt_int;
+    MOJOSHADER_astDataType dt_uint;
+    MOJOSHADER_astDataType dt_float;
+    MOJOSHADER_astDataType dt_float_snorm;
+    MOJOSHADER_astDataType dt_float_unorm;
+    MOJOSHADER_astDataType dt_half;
+    MOJOSHADER_astDataType dt_double;
+    MOJOSHADER_astDataType dt_string;
+    MOJOSHADER_astDataType dt_sampler1d;
+    MOJOSHADER_astDataType dt_sampler2d;
+    MOJOSHADER_astDataType dt_sampler3d;
+    MOJOSHADER_astDataType dt_samplercube;
+    MOJOSHADER_astDataType dt_samplerstate;
+    MOJOSHADER_astDataType dt_samplercompstate;
+    MOJOSHADER_astDataType dt_buf_bool;
+    MOJOSHADER_astDataType dt_buf_int;
+    MOJOSHADER_astDataType dt_buf_uint;
+    MOJOSHADER_astDataType dt_buf_half;
+    MOJOSHADER_astDataType dt_buf_float;
+    MOJOSHADER_astDataType dt_buf_double;
+    MOJOSHADER_astDataType dt_buf_float_snorm;
+    MOJOSHADER_astDataType dt_buf_float_unorm;
+
+    // "float4", "int3x3", etc, wrapped as user types, like a typedef does.
+    MOJOSHADER_astDataType vectors[6][4];
+    MOJOSHADER_astDataType matrices[6][4][4];
+    MOJOSHADER_astDataType usertypes[6][20];
+    char usertype_names[6][20][12];
+
+    // Overload resolution only looks at overloads that could possibly take
+    //  the arguments, so these are sorted by name, then parameter count,
+    //  (then the first parameter's category for by_lead), then newest first.
+    int intrinsic_count;
+    Intrinsic intrinsics[MAX_INTRINSICS];
+    const Intrinsic *by_arity[MAX_INTRINSICS];
+    const Intrinsic *by_lead[MAX_INTRINSICS];
+} Builtins;
+
+static Builtins builtins;
+
+static const char *builtin_scalar_names[] = {
+    "bool", "int", "uint", "half", "float", "double"
+};
+
+// "float4" and "float4x4" and friends, without going through a hash table.
+static const MOJOSHADER_astDataType *find_builtin_usertype(const char *sym)
+{
+    int i;
+    for (i = 0; i < (int) STATICARRAYLEN(builtin_scalar_names); i++)
+    {
+        const char *base = builtin_scalar_names[i];
+        const size_t len = strlen(base);
+        if (strncmp(sym, base, len) != 0)
+            continue;
+
+        const char *ptr = sym + len;
+        if ((ptr[0] < '1') || (ptr[0] > '4'))
+            return NULL;
+        const int rows = ptr[0] - '1';
+        if (ptr[1] == '\0')
+            return &builtins.usertypes[i][rows];
+        else if ((ptr[1] != 'x') || (ptr[2] < '1') || (ptr[2] > '4') || (ptr[3]))
+            return NULL;
+        return &builtins.usertypes[i][4 + (rows * 4) + (ptr[2] - '1')];
+    } // for
+
+    return NULL;
+} // find_builtin_usertype
+
+// Groups datatypes that an argument could convert between without a
+//  perfect match: same type, and same size if it's a vector or matrix.
+static int overload_category(const MOJOSHADER_astDataType *dt)
+{
+    if (dt->type & MOJOSHADER_AST_DATATYPE_CONST)
+        return 0;  // nothing converts to these. No overload has this category.
+    else if (dt->type == MOJOSHADER_AST_DATATYPE_VECTOR)
+        return (((int) dt->type) << 8) | dt->vector.elements;
+    else if (dt->type == MOJOSHADER_AST_DATATYPE_MATRIX)
+        return (((int) dt->type) << 8) | (dt->matrix.rows << 4) | dt->matrix.columns;
+    return (((int) dt->type) << 8);
+} // overload_category
+
+// Compares an overload to a (sym, argcount, lead) key. A negative
+//  (argcount) or (lead) matches anything.
+static int cmp_overload_key(const Intrinsic *intrinsic, const char *sym,
+                            const int argcount, const int lead)
+{
+    int retval = strcmp(intrinsic->name, sym);
+    if ((retval == 0) && (argcount >= 0))
+        retval = intrinsic->datatype.function.num_params - argcount;
+    if ((retval == 0) && (lead >= 0))
+        retval = intrinsic->lead - lead;
+    return retval;
+} // cmp_overload_key
+
+// Returns the first of the overloads in (sorted) that match the key, and
+//  how many there are in (*_count). (sorted) is builtins.by_arity or
+//  builtins.by_lead; only the latter can be searched with a (lead).
+static const Intrinsic **find_overloads(const Intrinsic **sorted,
+                                        const char *sym, const int argcount,
+                                        const int lead, int *_count)
+{
+    int lo = 0;
+    int hi = builtins.intrinsic_count;
+    while (lo < hi)  // find the first match.
+    {
+        const int mid = lo + ((hi - lo) / 2);
+        if (cmp_overload_key(sorted[mid], sym, argcount, lead) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    } // while
+
+    int count = 0;
+    while (((lo + count) < builtins.intrinsic_count) &&
+           (cmp_overload_key(sorted[lo + count], sym, argcount, lead) == 0))
+        count++;
+
+    *_count = count;
+    return (count > 0) ? &sorted[lo] : NULL;
+} // find_overloads
+
 // Compile state, passed around all over the place.
 
 typedef struct Context
@@ -110,7 +293,6 @@ typedef struct Context
     int var_index;  // next variable index for current function.
     int global_var_index;  // next variable index for global scope.
     int user_func_index;  // next function index for user-defined functions.
-    int intrinsic_func_index;  // next function index for intrinsic functions.
 
     MOJOSHADER_irStatement **ir;  // intermediate representation.
     int ir_label_count;  // next unused IR label index.
@@ -118,34 +300,14 @@ typedef struct Context
     int ir_end; // current function's end label during IR build.
     int ir_ret; // temp that holds current function's retval during IR build.
     LoopLabels *ir_loop;  // nested loop boundary labels during IR build.
-
-    // Cache intrinsic types for fast lookup and consistent pointer values.
-    MOJOSHADER_astDataType dt_none;
-    MOJOSHADER_astDataType dt_bool;
-    MOJOSHADER_astDataType dt_int;
-    MOJOSHADER_astDataType dt_uint;
-    MOJOSHADER_astDataType dt_float;
-    MOJOSHADER_astDataType dt_float_snorm;
-    MOJOSHADER_astDataType dt_float_unorm;
-    MOJOSHADER_astDataType dt_half;
-    MOJOSHADER_astDataType dt_double;
-    MOJOSHADER_astDataType dt_string;
-    MOJOSHADER_astDataType dt_sampler1d;
-    MOJOSHADER_astDataType dt_sampler2d;
-    MOJOSHADER_astDataType dt_sampler3d;
-    MOJOSHADER_astDataType dt_samplercube;
-    MOJOSHADER_astDataType dt_samplerstate;
-    MOJOSHADER_astDataType dt_samplercompstate;
-    MOJOSHADER_astDataType dt_buf_bool;
-    MOJOSHADER_astDataType dt_buf_int;
-    MOJOSHADER_astDataType dt_buf_uint;
-    MOJOSHADER_astDataType dt_buf_half;
-    MOJOSHADER_astDataType dt_buf_float;
-    MOJOSHADER_astDataType dt_buf_double;
-    MOJOSHADER_astDataType dt_buf_float_snorm;
-    MOJOSHADER_astDataType dt_buf_float_unorm;
-
-    Buffer *garbage;  // this is sort of hacky.
+    int *ir_rets;  // each function's retval temp, -1 if it returns nothing.
+    IrLoop *ir_loops;  // unrollable loops, innermost first.
+    FILE *ir_trace;  // if not NULL, print IR here before and after each pass.
+
+    MemoryArena *arena;  // datatypes and such, freed with the Context.
+    MemoryArena *ast_arena;  // every AST node, freed all at once.
+    MemoryArena *ir_arena;  // every IR node, freed all at once.
+    HashTable *overload_memo;  // intrinsic calls we've resolved already.
 } Context;
 
 
@@ -181,6 +343,17 @@ static inline void Free(Context *ctx, void *ptr)
     ctx->free(ptr, ctx->malloc_data);
 } // Free
 
+// Anything that lives until a whole tree (or the whole Context) goes away
+//  comes from one of the arenas, and is never Free()'d on its own.
+static inline void *ArenaMalloc(Context *ctx, MemoryArena *arena,
+                                const size_t len)
+{
+    void *retval = arena_alloc(arena, len);
+    if (retval == NULL)
+        out_of_memory(ctx);
+    return retval;
+} // ArenaMalloc
+
 static void *MallocBridge(int bytes, void *data)
 {
     return Malloc((Context *) data, (size_t) bytes);
@@ -232,17 +405,92 @@ static inline int isfail(const Context *ctx)
 } // isfail
 
 
-static void symbolmap_nuke(const void *k, const void *v, const void *value, void *d) {/*no-op*/}
-
 static int create_symbolmap(Context *ctx, SymbolMap *map)
 {
-    // !!! FIXME: should compare string pointer, with string in cache.
-    map->scope = NULL;
-    map->hash = hash_create(ctx, hash_hash_string, hash_keymatch_string,
-                            symbolmap_nuke, 1, MallocBridge, FreeBridge, ctx);
-    return (map->hash != NULL);
+    memset(map, '\0', sizeof (*map));  // everything grows on demand.
+    return 1;
 } // create_symbolmap
 
+// Make room for one more item in a growable array.
+static int grow_array(Context *ctx, void **_ptr, int *alloc, const int count,
+                      const size_t itemsize)
+{
+    if (count < *alloc)
+        return 1;
+
+    const int newalloc = (*alloc) ? (*alloc) * 2 : 16;
+    void *ptr = Malloc(ctx, itemsize * newalloc);
+    if (ptr == NULL)
+        return 0;
+    if (*_ptr != NULL)
+    {
+        memcpy(ptr, *_ptr, itemsize * count);
+        Free(ctx, *_ptr);
+    } // if
+    *_ptr = ptr;
+    *alloc = newalloc;
+    return 1;
+} // grow_array
+
+// Returns the bucket for (sym), which might be empty if we've never seen it.
+static SymbolName *symbolmap_name(const SymbolMap *map, const char *sym)
+{
+    const uint32 mask = (uint32) (map->name_alloc - 1);
+    uint32 i = ((uint32) (((size_t) sym) >> 3)) * 2654435761u;
+    while (1)
+    {
+        SymbolName *name = &map->names[i & mask];
+        if ((name->symbol == sym) || (name->symbol == NULL))
+            return name;
+        i++;
+    } // while
+    return NULL;  // shouldn't hit this, there's always an empty bucket.
+} // symbolmap_name
+
+static SymbolName *add_symbolmap_name(Context *ctx, SymbolMap *map,
+                                      const char *sym)
+{
+    if (((map->name_count + 1) * 4) > (map->name_alloc * 3))
+    {
+        SymbolName *oldnames = map->names;
+        const int oldalloc = map->name_alloc;
+        const int newalloc = oldalloc ? oldalloc * 2 : 64;
+        SymbolName *names = (SymbolName *) Malloc(ctx, sizeof (SymbolName) * newalloc);
+        if (names == NULL)
+            return NULL;
+        memset(names, '\0', sizeof (SymbolName) * newalloc);
+        map->names = names;
+        map->name_alloc = newalloc;
+
+        int i;
+        for (i = 0; i < oldalloc; i++)
+        {
+            if (oldnames[i].symbol != NULL)
+                *symbolmap_name(map, oldnames[i].symbol) = oldnames[i];
+        } // for
+        Free(ctx, oldnames);
+    } // if
+
+    SymbolName *name = symbolmap_name(map, sym);
+    if (name->symbol == NULL)
+    {
+        name->symbol = sym;
+        name->newest = -1;
+        map->name_count++;
+    } // if
+    return name;
+} // add_symbolmap_name
+
+// Slot of the newest symbol called (sym) in any scope, -1 if there isn't one.
+//  Follow (shadowed) from there to get the rest, newest first.
+static inline int find_symbol_slot(const SymbolMap *map, const char *sym)
+{
+    if (map->name_count == 0)
+        return -1;
+    const SymbolName *name = symbolmap_name(map, sym);
+    return (name->symbol != NULL) ? name->newest : -1;
+} // find_symbol_slot
+
 static int datatypes_match(const MOJOSHADER_astDataType *a,
                            const MOJOSHADER_astDataType *b)
 {
@@ -329,62 +577,64 @@ static void push_symbol(Context *ctx, SymbolMap *map, const char *sym,
         return;
 
     // Decide if this symbol is defined, and if it's in the current scope.
-    SymbolScope *item = NULL;
-    const void *value = NULL;
-    if ((check_dupes) && (sym != NULL) && (hash_find(map->hash, sym, &value)))
+    if (check_dupes)
     {
-        // check the current scope for a dupe.
-        // !!! FIXME: note current scope's starting index, see if found
-        // !!! FIXME:  item is < index (and thus, a previous scope).
-        item = map->scope;
-        while ((item) && (item->symbol))
+        const int scope_start = map->scope_count ? map->scopes[map->scope_count-1] : 0;
+        if (find_symbol_slot(map, sym) >= scope_start)
         {
-            if ( ((const void *) item) == value )
-            {
-                failf(ctx, "Symbol '%s' already defined", sym);
-                return;
-            } // if
-            item = item->next;
-        } // while
+            failf(ctx, "Symbol '%s' already defined", sym);
+            return;
+        } // if
     } // if
 
     // Add the symbol to our map and scope stack.
-    item = (SymbolScope *) Malloc(ctx, sizeof (SymbolScope));
-    if (item == NULL)
+    SymbolName *name = add_symbolmap_name(ctx, map, sym);
+    if (name == NULL)
+        return;
+    if (!grow_array(ctx, (void **) &map->symbols, &map->symbol_alloc,
+                    map->symbol_count, sizeof (Symbol)))
         return;
 
-    if (sym != NULL)  // sym can be NULL if we're pushing a new scope.
-    {
-        if (hash_insert(map->hash, sym, item) == -1)
-        {
-            Free(ctx, item);
-            return;
-        } // if
-    } // if
-
+    Symbol *item = &map->symbols[map->symbol_count];
     item->symbol = sym;  // cached strings, don't copy.
     item->index = index;
     item->datatype = dt;
     item->referenced = 0;
-    item->next = map->scope;
-    map->scope = item;
+    item->shadowed = name->newest;
+    name->newest = map->symbol_count++;
 } // push_symbol
 
+// Pop symbols, newest first, until there are only (count) left.
+static void pop_symbols(SymbolMap *map, const int count)
+{
+    while (map->symbol_count > count)
+    {
+        const Symbol *item = &map->symbols[--map->symbol_count];
+        symbolmap_name(map, item->symbol)->newest = item->shadowed;
+    } // while
+} // pop_symbols
+
+// The built-in types and intrinsics aren't in the symbol maps, but they
+//  still count as being declared in the global scope.
+static inline int is_global_scope(const SymbolMap *map)
+{
+    return (map->scope_count == 0);
+} // is_global_scope
+
 static void push_usertype(Context *ctx, const char *sym, const MOJOSHADER_astDataType *dt)
 {
     if (sym != NULL)
     {
+        if ((is_global_scope(&ctx->usertypes)) && (find_builtin_usertype(sym)))
+        {
+            failf(ctx, "Symbol '%s' already defined", sym);
+            return;
+        } // if
+
         MOJOSHADER_astDataType *userdt;
-        userdt = (MOJOSHADER_astDataType *) Malloc(ctx, sizeof (*userdt));
+        userdt = (MOJOSHADER_astDataType *) ArenaMalloc(ctx, ctx->arena, sizeof (*userdt));
         if (userdt != NULL)
         {
-            // !!! FIXME: this is hacky.
-            if (!buffer_append(ctx->garbage, &userdt, sizeof (userdt)))
-            {
-                Free(ctx, userdt);
-                return;
-            } // if
-
             userdt->type = MOJOSHADER_AST_DATATYPE_USER;
             userdt->user.details = dt;
             userdt->user.name = sym;
@@ -401,6 +651,14 @@ static inline void push_variable(Context *ctx, const char *sym, const MOJOSHADER
     int idx = 0;
     if (sym != NULL)
     {
+        int count = 0;
+        if ((!ctx->is_func_scope) &&
+            (find_overloads(builtins.by_arity, sym, -1, -1, &count)))
+        {
+            failf(ctx, "Symbol '%s' already defined", sym);
+            return;
+        } // if
+
         // leave space for individual member indexes. The IR will need this.
         int additional = 0;
         if (dt->type == MOJOSHADER_AST_DATATYPE_STRUCT)
@@ -428,34 +686,30 @@ static int push_function(Context *ctx, const char *sym,
     //  so this would be a bug.
     assert(!ctx->is_func_scope);
     assert(dt->type == MOJOSHADER_AST_DATATYPE_FUNCTION);
+    assert(!dt->function.intrinsic);  // those are in (builtins), not here.
 
     // Functions are always global, so no need to search scopes.
     //  Functions overload, though, so we have to continue iterating to
-    //  see if it matches anything.
-    const void *value = NULL;
-    void *iter = NULL;
-    while (hash_iter(ctx->variables.hash, sym, &value, &iter))
+    //  see if it matches anything. Intrinsics never match a user function.
+    int slot;
+    for (slot = find_symbol_slot(&ctx->variables, sym); slot != -1;
+         slot = ctx->variables.symbols[slot].shadowed)
     {
         // !!! FIXME: this breaks if you predeclare a function.
         // !!! FIXME:  (a declare AFTER defining works, though.)
         // there's already something called this.
-        SymbolScope *item = (SymbolScope *) value;
+        const Symbol *item = &ctx->variables.symbols[slot];
         if (datatypes_match(dt, item->datatype))
         {
             if (!just_declare)
                 failf(ctx, "Function '%s' already defined.", sym);
             return item->index;
         } // if
-    } // while
+    } // for
 
     int idx = 0;
     if ((sym != NULL) && (dt != NULL))
-    {
-        if (!dt->function.intrinsic)
-            idx = ++ctx->user_func_index;  // these are positive.
-        else
-            idx = --ctx->intrinsic_func_index;  // these are negative.
-    } // if
+        idx = ++ctx->user_func_index;  // these are positive.
 
     // push_symbol() doesn't check dupes, because we just did.
     push_symbol(ctx, &ctx->variables, sym, dt, idx, 0);
@@ -463,31 +717,27 @@ static int push_function(Context *ctx, const char *sym,
     return idx;
 } // push_function
 
-static inline void push_scope(Context *ctx)
+static void push_symbol_scope(Context *ctx, SymbolMap *map)
 {
-    push_usertype(ctx, NULL, NULL);
-    push_variable(ctx, NULL, NULL);
-} // push_scope
+    if (ctx->out_of_memory)
+        return;
+    if (grow_array(ctx, (void **) &map->scopes, &map->scope_alloc,
+                   map->scope_count, sizeof (int)))
+        map->scopes[map->scope_count++] = map->symbol_count;
+} // push_symbol_scope
 
-static void pop_symbol(Context *ctx, SymbolMap *map)
+static inline void push_scope(Context *ctx)
 {
-    SymbolScope *item = map->scope;
-    if (!item)
-        return;
-    if (item->symbol)
-        hash_remove(map->hash, item->symbol, ctx);
-    map->scope = item->next;
-    Free(ctx, item);
-} // pop_symbol
+    push_symbol_scope(ctx, &ctx->usertypes);
+    push_symbol_scope(ctx, &ctx->variables);
+} // push_scope
 
 static void pop_symbol_scope(Context *ctx, SymbolMap *map)
 {
-    while ((map->scope) && (map->scope->symbol))
-        pop_symbol(ctx, map);
+    if (map->scope_count == 0)  // out of memory, or a stray '}' in the source.
+        return;
 
-    assert(map->scope != NULL);
-    assert(map->scope->symbol == NULL);
-    pop_symbol(ctx, map);
+    pop_symbols(map, map->scopes[--map->scope_count]);
 } // pop_symbol_scope
 
 static inline void pop_scope(Context *ctx)
@@ -498,33 +748,56 @@ static inline void pop_scope(Context *ctx)
 
 static const MOJOSHADER_astDataType *find_symbol(Context *ctx, SymbolMap *map, const char *sym, int *_index)
 {
-    const void *_item = NULL;
-    hash_find(map->hash, sym, &_item);
-    SymbolScope *item = (SymbolScope *) _item;
-    if (item != NULL)
-    {
-        item->referenced++;
-        if (_index != NULL)
-            *_index = item->index;
-    } // if
-    return item ? item->datatype : NULL;
+    const int slot = find_symbol_slot(map, sym);
+    if (slot == -1)
+        return NULL;
+
+    Symbol *item = &map->symbols[slot];
+    item->referenced++;
+    if (_index != NULL)
+        *_index = item->index;
+    return item->datatype;
 } // find_symbol
 
 static inline const MOJOSHADER_astDataType *find_usertype(Context *ctx, const char *sym)
 {
-    return find_symbol(ctx, &ctx->usertypes, sym, NULL);
+    const MOJOSHADER_astDataType *retval;
+    retval = find_symbol(ctx, &ctx->usertypes, sym, NULL);
+    return retval ? retval : find_builtin_usertype(sym);
 } // find_usertype
 
-static inline const MOJOSHADER_astDataType *find_variable(Context *ctx, const char *sym, int *_index)
+static const MOJOSHADER_astDataType *find_variable(Context *ctx, const char *sym, int *_index)
 {
-    return find_symbol(ctx, &ctx->variables, sym, _index);
+    const MOJOSHADER_astDataType *retval;
+    retval = find_symbol(ctx, &ctx->variables, sym, _index);
+    if (retval == NULL)
+    {
+        int i, count = 0;
+        const Intrinsic **intrinsics;
+        intrinsics = find_overloads(builtins.by_arity, sym, -1, -1, &count);
+        if (intrinsics != NULL)
+        {
+            const Intrinsic *newest = intrinsics[0];
+            for (i = 1; i < count; i++)
+            {
+                if (intrinsics[i]->index < newest->index)
+                    newest = intrinsics[i];
+            } // for
+
+            if (_index != NULL)
+                *_index = newest->index;
+            retval = &newest->datatype;
+        } // if
+    } // if
+    return retval;
 } // find_variable
 
 static void destroy_symbolmap(Context *ctx, SymbolMap *map)
 {
-    while (map->scope)
-        pop_symbol(ctx, map);
-    hash_destroy(map->hash, ctx);
+    Free(ctx, map->symbols);
+    Free(ctx, map->scopes);
+    Free(ctx, map->names);
+    memset(map, '\0', sizeof (*map));
 } // destroy_symbolmap
 
 
@@ -533,17 +806,10 @@ static const MOJOSHADER_astDataType *new_datatype_vector(Context *ctx,
                                             const int columns)
 {
     MOJOSHADER_astDataType *retval;
-    retval = (MOJOSHADER_astDataType *) Malloc(ctx, sizeof (*retval));
-    if (retval == NULL)
-        return NULL;
-
-    // !!! FIXME: this is hacky.
     // !!! FIXME:  I'd like to cache these anyhow and reuse types.
-    if (!buffer_append(ctx->garbage, &retval, sizeof (retval)))
-    {
-        Free(ctx, retval);
+    retval = (MOJOSHADER_astDataType *) ArenaMalloc(ctx, ctx->arena, sizeof (*retval));
+    if (retval == NULL)
         return NULL;
-    } // if
 
     if ((columns < 1) || (columns > 4))
         fail(ctx, "Vector must have between 1 and 4 elements");
@@ -560,17 +826,10 @@ static const MOJOSHADER_astDataType *new_datatype_matrix(Context *ctx,
 {
     MOJOSHADER_astDataType *retval;
     // !!! FIXME: allocate enough for a matrix, but we need to cleanup things that copy without checking for subsize.
-    retval = (MOJOSHADER_astDataType *) Malloc(ctx, sizeof (*retval));
-    if (retval == NULL)
-        return NULL;
-
-    // !!! FIXME: this is hacky.
     // !!! FIXME:  I'd like to cache these anyhow and reuse types.
-    if (!buffer_append(ctx->garbage, &retval, sizeof (retval)))
-    {
-        Free(ctx, retval);
+    retval = (MOJOSHADER_astDataType *) ArenaMalloc(ctx, ctx->arena, sizeof (*retval));
+    if (retval == NULL)
         return NULL;
-    } // if
 
     if ((rows < 1) || (rows > 4))
         fail(ctx, "Matrix must have between 1 and 4 rows");
@@ -586,15 +845,16 @@ static const MOJOSHADER_astDataType *new_datatype_matrix(Context *ctx,
 
 
 // !!! FIXME: move this to mojoshader_ast.c
-// !!! FIXME: new_* and delete_* should take an allocator, not a context.
+// !!! FIXME: new_* should take an allocator, not a context.
 
-// These functions are mostly for construction and cleanup of nodes in the
-//  parse tree. Mostly this is simple allocation and initialization, so we
-//  can do as little in the lemon code as possible, and then sort it all out
-//  afterwards.
+// These functions are mostly for construction of nodes in the parse tree.
+//  Mostly this is simple allocation and initialization, so we can do as
+//  little in the lemon code as possible, and then sort it all out
+//  afterwards. Nodes come out of ctx->ast_arena, so there's nothing to free
+//  when one is replaced or dropped; the whole tree goes away at once.
 
 #define NEW_AST_NODE(retval, cls, typ) \
-    cls *retval = (cls *) Malloc(ctx, sizeof (cls)); \
+    cls *retval = (cls *) ArenaMalloc(ctx, ctx->ast_arena, sizeof (cls)); \
     do { \
         if (retval == NULL) { return NULL; } \
         retval->ast.type = typ; \
@@ -602,14 +862,6 @@ static const MOJOSHADER_astDataType *new_datatype_matrix(Context *ctx,
         retval->ast.line = ctx->sourceline; \
     } while (0)
 
-#define DELETE_AST_NODE(cls) do { \
-    if (!cls) return; \
-} while (0)
-
-
-static void delete_compilation_unit(Context*, MOJOSHADER_astCompilationUnit*);
-static void delete_statement(Context *ctx, MOJOSHADER_astStatement *stmt);
-
 static MOJOSHADER_astExpression *new_identifier_expr(Context *ctx,
                                                      const char *string)
 {
@@ -688,7 +940,7 @@ static MOJOSHADER_astExpression *new_ternary_expr(Context *ctx,
     NEW_AST_NODE(retval, MOJOSHADER_astExpressionTernary, op);
     assert(operator_is_ternary(op));
     assert(op == MOJOSHADER_AST_OP_CONDITIONAL);
-    retval->datatype = &ctx->dt_bool;
+    retval->datatype = &builtins.dt_bool;
     retval->left = left;
     retval->center = center;
     retval->right = right;
@@ -714,7 +966,7 @@ static MOJOSHADER_astExpression *new_literal_int_expr(Context *ctx,
 {
     NEW_AST_NODE(retval, MOJOSHADER_astExpressionIntLiteral,
                  MOJOSHADER_AST_OP_INT_LITERAL);
-    retval->datatype = &ctx->dt_int;
+    retval->datatype = &builtins.dt_int;
     retval->value = value;
     return (MOJOSHADER_astExpression *) retval;
 } // new_literal_int_expr
@@ -724,7 +976,7 @@ static MOJOSHADER_astExpression *new_literal_float_expr(Context *ctx,
 {
     NEW_AST_NODE(retval, MOJOSHADER_astExpressionFloatLiteral,
                  MOJOSHADER_AST_OP_FLOAT_LITERAL);
-    retval->datatype = &ctx->dt_float;
+    retval->datatype = &builtins.dt_float;
     retval->value = dbl;
     return (MOJOSHADER_astExpression *) retval;
 } // new_literal_float_expr
@@ -734,7 +986,7 @@ static MOJOSHADER_astExpression *new_literal_string_expr(Context *ctx,
 {
     NEW_AST_NODE(retval, MOJOSHADER_astExpressionStringLiteral,
                  MOJOSHADER_AST_OP_STRING_LITERAL);
-    retval->datatype = &ctx->dt_string;
+    retval->datatype = &builtins.dt_string;
     retval->string = string;  // cached; don't copy string.
     return (MOJOSHADER_astExpression *) retval;
 } // new_literal_string_expr
@@ -744,55 +996,11 @@ static MOJOSHADER_astExpression *new_literal_boolean_expr(Context *ctx,
 {
     NEW_AST_NODE(retval, MOJOSHADER_astExpressionBooleanLiteral,
                  MOJOSHADER_AST_OP_BOOLEAN_LITERAL);
-    retval->datatype = &ctx->dt_bool;
+    retval->datatype = &builtins.dt_bool;
     retval->value = value;
     return (MOJOSHADER_astExpression *) retval;
 } // new_literal_boolean_expr
 
-static void delete_arguments(Context *ctx, MOJOSHADER_astArguments *args);
-
-static void delete_expr(Context *ctx, MOJOSHADER_astExpression *_expr)
-{
-    MOJOSHADER_astNode *expr = (MOJOSHADER_astNode *) _expr;
-
-    DELETE_AST_NODE(expr);
-
-    if (expr->ast.type == MOJOSHADER_AST_OP_CAST)
-        delete_expr(ctx, expr->cast.operand);
-
-    else if (expr->ast.type == MOJOSHADER_AST_OP_CONSTRUCTOR)
-        delete_arguments(ctx, expr->constructor.args);
-
-    else if (expr->ast.type == MOJOSHADER_AST_OP_DEREF_STRUCT)
-        delete_expr(ctx, expr->derefstruct.identifier);
-
-    else if (operator_is_unary(expr->ast.type))
-        delete_expr(ctx, expr->unary.operand);
-
-    else if (operator_is_binary(expr->ast.type))
-    {
-        delete_expr(ctx, expr->binary.left);
-        delete_expr(ctx, expr->binary.right);
-    } // else if
-
-    else if (operator_is_ternary(expr->ast.type))
-    {
-        delete_expr(ctx, expr->ternary.left);
-        delete_expr(ctx, expr->ternary.center);
-        delete_expr(ctx, expr->ternary.right);
-    } // else if
-
-    else if (expr->ast.type == MOJOSHADER_AST_OP_CALLFUNC)
-    {
-        delete_expr(ctx, (MOJOSHADER_astExpression*)expr->callfunc.identifier);
-        delete_arguments(ctx, expr->callfunc.args);
-    } // else if
-
-    // rest of operators don't have extra data to free.
-
-    Free(ctx, expr);
-} // delete_expr
-
 static MOJOSHADER_astArguments *new_argument(Context *ctx,
                                              MOJOSHADER_astExpression *arg)
 {
@@ -802,13 +1010,6 @@ static MOJOSHADER_astArguments *new_argument(Context *ctx,
     return retval;
 } // new_argument
 
-static void delete_arguments(Context *ctx, MOJOSHADER_astArguments *args)
-{
-    DELETE_AST_NODE(args);
-    delete_arguments(ctx, args->next);
-    delete_expr(ctx, args->argument);
-    Free(ctx, args);
-} // delete_arguments
 
 static MOJOSHADER_astFunctionParameters *new_function_param(Context *ctx,
                         const MOJOSHADER_astInputModifier inputmod,
@@ -829,14 +1030,6 @@ static MOJOSHADER_astFunctionParameters *new_function_param(Context *ctx,
     return retval;
 } // new_function_param
 
-static void delete_function_params(Context *ctx,
-                                   MOJOSHADER_astFunctionParameters *params)
-{
-    DELETE_AST_NODE(params);
-    delete_function_params(ctx, params->next);
-    delete_expr(ctx, params->initializer);
-    Free(ctx, params);
-} // delete_function_params
 
 static MOJOSHADER_astFunctionSignature *new_function_signature(Context *ctx,
                                     const MOJOSHADER_astDataType *dt,
@@ -853,13 +1046,6 @@ static MOJOSHADER_astFunctionSignature *new_function_signature(Context *ctx,
     return retval;
 } // new_function_signature
 
-static void delete_function_signature(Context *ctx,
-                                      MOJOSHADER_astFunctionSignature *sig)
-{
-    DELETE_AST_NODE(sig);
-    delete_function_params(ctx, sig->params);
-    Free(ctx, sig);
-} // delete_function_signature
 
 static MOJOSHADER_astCompilationUnit *new_function(Context *ctx,
                                 MOJOSHADER_astFunctionSignature *declaration,
@@ -874,15 +1060,6 @@ static MOJOSHADER_astCompilationUnit *new_function(Context *ctx,
     return (MOJOSHADER_astCompilationUnit *) retval;
 } // new_function
 
-static void delete_function(Context *ctx,
-                            MOJOSHADER_astCompilationUnitFunction *unitfn)
-{
-    DELETE_AST_NODE(unitfn);
-    delete_compilation_unit(ctx, unitfn->next);
-    delete_function_signature(ctx, unitfn->declaration);
-    delete_statement(ctx, unitfn->definition);
-    Free(ctx, unitfn);
-} // delete_function
 
 static MOJOSHADER_astScalarOrArray *new_scalar_or_array(Context *ctx,
                                           const char *ident, const int isvec,
@@ -896,12 +1073,6 @@ static MOJOSHADER_astScalarOrArray *new_scalar_or_array(Context *ctx,
     return retval;
 } // new_scalar_or_array
 
-static void delete_scalar_or_array(Context *ctx,MOJOSHADER_astScalarOrArray *s)
-{
-    DELETE_AST_NODE(s);
-    delete_expr(ctx, s->dimension);
-    Free(ctx, s);
-} // delete_scalar_or_array
 
 static MOJOSHADER_astTypedef *new_typedef(Context *ctx, const int isconst,
                                           const MOJOSHADER_astDataType *dt,
@@ -915,12 +1086,6 @@ static MOJOSHADER_astTypedef *new_typedef(Context *ctx, const int isconst,
     return retval;
 } // new_typedef
 
-static void delete_typedef(Context *ctx, MOJOSHADER_astTypedef *td)
-{
-    DELETE_AST_NODE(td);
-    delete_scalar_or_array(ctx, td->details);
-    Free(ctx, td);
-} // delete_typedef
 
 static MOJOSHADER_astPackOffset *new_pack_offset(Context *ctx,
                                                  const char *a, const char *b)
@@ -931,11 +1096,6 @@ static MOJOSHADER_astPackOffset *new_pack_offset(Context *ctx,
     return retval;
 } // new_pack_offset
 
-static void delete_pack_offset(Context *ctx, MOJOSHADER_astPackOffset *o)
-{
-    DELETE_AST_NODE(o);
-    Free(ctx, o);
-} // delete_pack_offset
 
 static MOJOSHADER_astVariableLowLevel *new_variable_lowlevel(Context *ctx,
                                                MOJOSHADER_astPackOffset *po,
@@ -948,13 +1108,6 @@ static MOJOSHADER_astVariableLowLevel *new_variable_lowlevel(Context *ctx,
     return retval;
 } // new_variable_lowlevel
 
-static void delete_variable_lowlevel(Context *ctx,
-                                     MOJOSHADER_astVariableLowLevel *vll)
-{
-    DELETE_AST_NODE(vll);
-    delete_pack_offset(ctx, vll->packoffset);
-    Free(ctx, vll);
-} // delete_variable_lowlevel
 
 static MOJOSHADER_astAnnotations *new_annotation(Context *ctx,
                                         const MOJOSHADER_astDataType *dt,
@@ -967,13 +1120,6 @@ static MOJOSHADER_astAnnotations *new_annotation(Context *ctx,
     return retval;
 } // new_annotation
 
-static void delete_annotation(Context *ctx, MOJOSHADER_astAnnotations *annos)
-{
-    DELETE_AST_NODE(annos);
-    delete_annotation(ctx, annos->next);
-    delete_expr(ctx, annos->initializer);
-    Free(ctx, annos);
-} // delete_annotation
 
 static MOJOSHADER_astVariableDeclaration *new_variable_declaration(
                             Context *ctx, MOJOSHADER_astScalarOrArray *soa,
@@ -996,17 +1142,6 @@ static MOJOSHADER_astVariableDeclaration *new_variable_declaration(
     return retval;
 } // new_variable_declaration
 
-static void delete_variable_declaration(Context *ctx,
-                                        MOJOSHADER_astVariableDeclaration *dcl)
-{
-    DELETE_AST_NODE(dcl);
-    delete_variable_declaration(ctx, dcl->next);
-    delete_scalar_or_array(ctx, dcl->details);
-    delete_annotation(ctx, dcl->annotations);
-    delete_expr(ctx, dcl->initializer);
-    delete_variable_lowlevel(ctx, dcl->lowlevel);
-    Free(ctx, dcl);
-} // delete_variable_declaration
 
 static MOJOSHADER_astCompilationUnit *new_global_variable(Context *ctx,
                                       MOJOSHADER_astVariableDeclaration *decl)
@@ -1018,14 +1153,6 @@ static MOJOSHADER_astCompilationUnit *new_global_variable(Context *ctx,
     return (MOJOSHADER_astCompilationUnit *) retval;
 } // new_global_variable
 
-static void delete_global_variable(Context *ctx,
-                                   MOJOSHADER_astCompilationUnitVariable *var)
-{
-    DELETE_AST_NODE(var);
-    delete_compilation_unit(ctx, var->next);
-    delete_variable_declaration(ctx, var->declaration);
-    Free(ctx, var);
-} // delete_global_variable
 
 static MOJOSHADER_astCompilationUnit *new_global_typedef(Context *ctx,
                                                      MOJOSHADER_astTypedef *td)
@@ -1037,14 +1164,6 @@ static MOJOSHADER_astCompilationUnit *new_global_typedef(Context *ctx,
     return (MOJOSHADER_astCompilationUnit *) retval;
 } // new_global_typedef
 
-static void delete_global_typedef(Context *ctx,
-                                  MOJOSHADER_astCompilationUnitTypedef *unit)
-{
-    DELETE_AST_NODE(unit);
-    delete_compilation_unit(ctx, unit->next);
-    delete_typedef(ctx, unit->type_info);
-    Free(ctx, unit);
-} // delete_global_typedef
 
 static MOJOSHADER_astStructMembers *new_struct_member(Context *ctx,
                                             MOJOSHADER_astScalarOrArray *soa,
@@ -1060,14 +1179,6 @@ static MOJOSHADER_astStructMembers *new_struct_member(Context *ctx,
     return retval;
 } // new_struct_member
 
-static void delete_struct_member(Context *ctx,
-                                 MOJOSHADER_astStructMembers *member)
-{
-    DELETE_AST_NODE(member);
-    delete_struct_member(ctx, member->next);
-    delete_scalar_or_array(ctx, member->details);
-    Free(ctx, member);
-} // delete_struct_member
 
 static MOJOSHADER_astStructDeclaration *new_struct_declaration(Context *ctx,
                                         const char *name,
@@ -1081,13 +1192,6 @@ static MOJOSHADER_astStructDeclaration *new_struct_declaration(Context *ctx,
     return retval;
 } // new_struct_declaration
 
-static void delete_struct_declaration(Context *ctx,
-                                      MOJOSHADER_astStructDeclaration *decl)
-{
-    DELETE_AST_NODE(decl);
-    delete_struct_member(ctx, decl->members);
-    Free(ctx, decl);
-} // delete_struct_declaration
 
 static MOJOSHADER_astCompilationUnit *new_global_struct(Context *ctx,
                                            MOJOSHADER_astStructDeclaration *sd)
@@ -1099,53 +1203,6 @@ static MOJOSHADER_astCompilationUnit *new_global_struct(Context *ctx,
     return (MOJOSHADER_astCompilationUnit *) retval;
 } // new_global_struct
 
-static void delete_global_struct(Context *ctx,
-                                 MOJOSHADER_astCompilationUnitStruct *unit)
-{
-    DELETE_AST_NODE(unit);
-    delete_compilation_unit(ctx, unit->next);
-    delete_struct_declaration(ctx, unit->struct_info);
-    Free(ctx, unit);
-} // delete_global_struct
-
-static void delete_compilation_unit(Context *ctx,
-                                    MOJOSHADER_astCompilationUnit *unit)
-{
-    if (!unit) return;
-
-    // it's important to not recurse too deeply here, since you may have
-    //  thousands of items in this linked list (each line of a massive
-    //  function, for example). To avoid this, we iterate the list here,
-    //  deleting all children and making them think they have no reason
-    //  to recurse in their own delete methods.
-    // Please note that everyone should _try_ to delete their "next" member,
-    //  just in case, but hopefully this cleaned it out.
-
-    MOJOSHADER_astCompilationUnit *i = unit->next;
-    unit->next = NULL;
-    while (i)
-    {
-        MOJOSHADER_astCompilationUnit *next = i->next;
-        i->next = NULL;
-        delete_compilation_unit(ctx, i);
-        i = next;
-    } // while
-
-    switch (unit->ast.type)
-    {
-        #define DELETE_UNIT(typ, cls, fn) \
-            case MOJOSHADER_AST_COMPUNIT_##typ: delete_##fn(ctx, (cls *) unit); break;
-        DELETE_UNIT(FUNCTION, MOJOSHADER_astCompilationUnitFunction, function);
-        DELETE_UNIT(TYPEDEF, MOJOSHADER_astCompilationUnitTypedef, global_typedef);
-        DELETE_UNIT(VARIABLE, MOJOSHADER_astCompilationUnitVariable, global_variable);
-        DELETE_UNIT(STRUCT, MOJOSHADER_astCompilationUnitStruct, global_struct);
-        #undef DELETE_UNIT
-        default: assert(0 && "missing cleanup code"); break;
-    } // switch
-
-    // don't free (unit) here, the class-specific functions do it.
-} // delete_compilation_unit
-
 static MOJOSHADER_astStatement *new_typedef_statement(Context *ctx,
                                                       MOJOSHADER_astTypedef *td)
 {
@@ -1156,14 +1213,6 @@ static MOJOSHADER_astStatement *new_typedef_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_typedef_statement
 
-static void delete_typedef_statement(Context *ctx,
-                                     MOJOSHADER_astTypedefStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    delete_typedef(ctx, stmt->type_info);
-    Free(ctx, stmt);
-} // delete_typedef_statement
 
 static MOJOSHADER_astStatement *new_return_statement(Context *ctx,
                                                 MOJOSHADER_astExpression *expr)
@@ -1175,14 +1224,6 @@ static MOJOSHADER_astStatement *new_return_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_return_statement
 
-static void delete_return_statement(Context *ctx,
-                                    MOJOSHADER_astReturnStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    delete_expr(ctx, stmt->expr);
-    Free(ctx, stmt);
-} // delete_return_statement
 
 static MOJOSHADER_astStatement *new_block_statement(Context *ctx,
                                                MOJOSHADER_astStatement *stmts)
@@ -1194,14 +1235,6 @@ static MOJOSHADER_astStatement *new_block_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_block_statement
 
-static void delete_block_statement(Context *ctx,
-                                   MOJOSHADER_astBlockStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->statements);
-    delete_statement(ctx, stmt->next);
-    Free(ctx, stmt);
-} // delete_statement_block
 
 static MOJOSHADER_astStatement *new_for_statement(Context *ctx,
                                     MOJOSHADER_astVariableDeclaration *decl,
@@ -1222,17 +1255,6 @@ static MOJOSHADER_astStatement *new_for_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_for_statement
 
-static void delete_for_statement(Context *ctx,MOJOSHADER_astForStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    delete_variable_declaration(ctx, stmt->var_decl);
-    delete_expr(ctx, stmt->initializer);
-    delete_expr(ctx, stmt->looptest);
-    delete_expr(ctx, stmt->counter);
-    delete_statement(ctx, stmt->statement);
-    Free(ctx, stmt);
-} // delete_for_statement
 
 static MOJOSHADER_astStatement *new_do_statement(Context *ctx,
                                                 const int unroll,
@@ -1247,14 +1269,6 @@ static MOJOSHADER_astStatement *new_do_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_do_statement
 
-static void delete_do_statement(Context *ctx, MOJOSHADER_astDoStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    delete_statement(ctx, stmt->statement);
-    delete_expr(ctx, stmt->expr);
-    Free(ctx, stmt);
-} // delete_do_statement
 
 static MOJOSHADER_astStatement *new_while_statement(Context *ctx,
                                                 const int unroll,
@@ -1270,15 +1284,6 @@ static MOJOSHADER_astStatement *new_while_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_while_statement
 
-static void delete_while_statement(Context *ctx,
-                                   MOJOSHADER_astWhileStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    delete_statement(ctx, stmt->statement);
-    delete_expr(ctx, stmt->expr);
-    Free(ctx, stmt);
-} // delete_while_statement
 
 static MOJOSHADER_astStatement *new_if_statement(Context *ctx,
                                             const int attr,
@@ -1295,15 +1300,6 @@ static MOJOSHADER_astStatement *new_if_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_if_statement
 
-static void delete_if_statement(Context *ctx, MOJOSHADER_astIfStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    delete_expr(ctx, stmt->expr);
-    delete_statement(ctx, stmt->statement);
-    delete_statement(ctx, stmt->else_statement);
-    Free(ctx, stmt);
-} // delete_if_statement
 
 static MOJOSHADER_astSwitchCases *new_switch_case(Context *ctx,
                                                 MOJOSHADER_astExpression *expr,
@@ -1316,14 +1312,6 @@ static MOJOSHADER_astSwitchCases *new_switch_case(Context *ctx,
     return retval;
 } // new_switch_case
 
-static void delete_switch_case(Context *ctx, MOJOSHADER_astSwitchCases *sc)
-{
-    DELETE_AST_NODE(sc);
-    delete_switch_case(ctx, sc->next);
-    delete_expr(ctx, sc->expr);
-    delete_statement(ctx, sc->statement);
-    Free(ctx, sc);
-} // delete_switch_case
 
 static MOJOSHADER_astStatement *new_empty_statement(Context *ctx)
 {
@@ -1333,13 +1321,6 @@ static MOJOSHADER_astStatement *new_empty_statement(Context *ctx)
     return (MOJOSHADER_astStatement *) retval;
 } // new_empty_statement
 
-static void delete_empty_statement(Context *ctx,
-                                   MOJOSHADER_astEmptyStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    Free(ctx, stmt);
-} // delete_empty_statement
 
 static MOJOSHADER_astStatement *new_break_statement(Context *ctx)
 {
@@ -1349,13 +1330,6 @@ static MOJOSHADER_astStatement *new_break_statement(Context *ctx)
     return (MOJOSHADER_astStatement *) retval;
 } // new_break_statement
 
-static void delete_break_statement(Context *ctx,
-                                   MOJOSHADER_astBreakStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    Free(ctx, stmt);
-} // delete_break_statement
 
 static MOJOSHADER_astStatement *new_continue_statement(Context *ctx)
 {
@@ -1365,13 +1339,6 @@ static MOJOSHADER_astStatement *new_continue_statement(Context *ctx)
     return (MOJOSHADER_astStatement *) retval;
 } // new_continue_statement
 
-static void delete_continue_statement(Context *ctx,
-                                      MOJOSHADER_astContinueStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    Free(ctx, stmt);
-} // delete_continue_statement
 
 static MOJOSHADER_astStatement *new_discard_statement(Context *ctx)
 {
@@ -1381,13 +1348,6 @@ static MOJOSHADER_astStatement *new_discard_statement(Context *ctx)
     return (MOJOSHADER_astStatement *) retval;
 } // new_discard_statement
 
-static void delete_discard_statement(Context *ctx,
-                                     MOJOSHADER_astDiscardStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    Free(ctx, stmt);
-} // delete_discard_statement
 
 static MOJOSHADER_astStatement *new_expr_statement(Context *ctx,
                                                 MOJOSHADER_astExpression *expr)
@@ -1399,14 +1359,6 @@ static MOJOSHADER_astStatement *new_expr_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_expr_statement
 
-static void delete_expr_statement(Context *ctx,
-                                  MOJOSHADER_astExpressionStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    delete_expr(ctx, stmt->expr);
-    Free(ctx, stmt);
-} // delete_expr_statement
 
 static MOJOSHADER_astStatement *new_switch_statement(Context *ctx,
                                             const int attr,
@@ -1422,14 +1374,6 @@ static MOJOSHADER_astStatement *new_switch_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_switch_statement
 
-static void delete_switch_statement(Context *ctx,
-                                    MOJOSHADER_astSwitchStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_expr(ctx, stmt->expr);
-    delete_switch_case(ctx, stmt->cases);
-    Free(ctx, stmt);
-} // delete_switch_statement
 
 static MOJOSHADER_astStatement *new_struct_statement(Context *ctx,
                                         MOJOSHADER_astStructDeclaration *sd)
@@ -1441,14 +1385,6 @@ static MOJOSHADER_astStatement *new_struct_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_struct_statement
 
-static void delete_struct_statement(Context *ctx,
-                                    MOJOSHADER_astStructStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    delete_struct_declaration(ctx, stmt->struct_info);
-    Free(ctx, stmt);
-} // delete_struct_statement
 
 static MOJOSHADER_astStatement *new_vardecl_statement(Context *ctx,
                                         MOJOSHADER_astVariableDeclaration *vd)
@@ -1460,72 +1396,16 @@ static MOJOSHADER_astStatement *new_vardecl_statement(Context *ctx,
     return (MOJOSHADER_astStatement *) retval;
 } // new_vardecl_statement
 
-static void delete_vardecl_statement(Context *ctx,
-                                     MOJOSHADER_astVarDeclStatement *stmt)
-{
-    DELETE_AST_NODE(stmt);
-    delete_statement(ctx, stmt->next);
-    delete_variable_declaration(ctx, stmt->declaration);
-    Free(ctx, stmt);
-} // delete_vardecl_statement
 
-static void delete_statement(Context *ctx, MOJOSHADER_astStatement *stmt)
+static const MOJOSHADER_astDataType *get_usertype(const Context *ctx,
+                                                  const char *token)
 {
-    if (!stmt) return;
-
-    // it's important to not recurse too deeply here, since you may have
-    //  thousands of items in this linked list (each line of a massive
-    //  function, for example). To avoid this, we iterate the list here,
-    //  deleting all children and making them think they have no reason
-    //  to recurse in their own delete methods.
-    // Please note that everyone should _try_ to delete their "next" member,
-    //  just in case, but hopefully this cleaned it out.
-
-    MOJOSHADER_astStatement *i = stmt->next;
-    stmt->next = NULL;
-    while (i)
-    {
-        MOJOSHADER_astStatement *next = i->next;
-        i->next = NULL;
-        delete_statement(ctx, i);
-        i = next;
-    } // while
-
-    switch (stmt->ast.type)
-    {
-        #define DELETE_STATEMENT(typ, cls, fn) \
-            case MOJOSHADER_AST_STATEMENT_##typ: \
-                delete_##fn##_statement(ctx, (cls *) stmt); break;
-        DELETE_STATEMENT(BLOCK, MOJOSHADER_astBlockStatement, block);
-        DELETE_STATEMENT(EMPTY, MOJOSHADER_astEmptyStatement, empty);
-        DELETE_STATEMENT(IF, MOJOSHADER_astIfStatement, if);
-        DELETE_STATEMENT(SWITCH, MOJOSHADER_astSwitchStatement, switch);
-        DELETE_STATEMENT(EXPRESSION, MOJOSHADER_astExpressionStatement, expr);
-        DELETE_STATEMENT(FOR, MOJOSHADER_astForStatement, for);
-        DELETE_STATEMENT(DO, MOJOSHADER_astDoStatement, do);
-        DELETE_STATEMENT(WHILE, MOJOSHADER_astWhileStatement, while);
-        DELETE_STATEMENT(RETURN, MOJOSHADER_astReturnStatement, return);
-        DELETE_STATEMENT(BREAK, MOJOSHADER_astBreakStatement, break);
-        DELETE_STATEMENT(CONTINUE, MOJOSHADER_astContinueStatement, continue);
-        DELETE_STATEMENT(DISCARD, MOJOSHADER_astDiscardStatement, discard);
-        DELETE_STATEMENT(TYPEDEF, MOJOSHADER_astTypedefStatement, typedef);
-        DELETE_STATEMENT(STRUCT, MOJOSHADER_astStructStatement, struct);
-        DELETE_STATEMENT(VARDECL, MOJOSHADER_astVarDeclStatement, vardecl);
-        #undef DELETE_STATEMENT
-        default: assert(0 && "missing cleanup code"); break;
-    } // switch
-    // don't free (stmt) here, the class-specific functions do it.
-} // delete_statement
-
-
-static const MOJOSHADER_astDataType *get_usertype(const Context *ctx,
-                                                  const char *token)
-{
-    const void *value;  // search all scopes.
-    if (!hash_find(ctx->usertypes.hash, token, &value))
-        return NULL;
-    return value ? ((SymbolScope *) value)->datatype : NULL;
-} // get_usertype
+    // search all scopes. (token) has to be from ctx->strcache.
+    const int slot = find_symbol_slot(&ctx->usertypes, token);
+    if (slot == -1)
+        return find_builtin_usertype(token);
+    return ctx->usertypes.symbols[slot].datatype;
+} // get_usertype
 
 
 // This is where the actual parsing happens. It's Lemon-generated!
@@ -1893,27 +1773,16 @@ static const MOJOSHADER_astDataType *build_function_datatype(Context *ctx,
 
     if (paramcount > 0)
     {
-        // !!! FIXME: this is hacky.
-        ptr = Malloc(ctx, sizeof (*params) * paramcount);
+        ptr = ArenaMalloc(ctx, ctx->arena, sizeof (*params) * paramcount);
         if (ptr == NULL)
             return NULL;
-        if (!buffer_append(ctx->garbage, &ptr, sizeof (ptr)))
-        {
-            Free(ctx, ptr);
-            return NULL;
-        } // if
         dtparams = (const MOJOSHADER_astDataType **) ptr;
         memcpy(dtparams, params, sizeof (*params) * paramcount);
     }
 
-    ptr = Malloc(ctx, sizeof (MOJOSHADER_astDataType));
+    ptr = ArenaMalloc(ctx, ctx->arena, sizeof (MOJOSHADER_astDataType));
     if (ptr == NULL)
         return NULL;
-    if (!buffer_append(ctx->garbage, &ptr, sizeof (ptr)))
-    {
-        Free(ctx, ptr);
-        return NULL;
-    } // if
 
     MOJOSHADER_astDataType *dt = (MOJOSHADER_astDataType *) ptr;
     dt->type = MOJOSHADER_AST_DATATYPE_FUNCTION;
@@ -1946,17 +1815,10 @@ static const MOJOSHADER_astDataType *build_datatype(Context *ctx,
             return dt;  // reuse existing datatype!
     } // if
 
-    retval = (MOJOSHADER_astDataType *) Malloc(ctx, sizeof (*retval));
+    retval = (MOJOSHADER_astDataType *) ArenaMalloc(ctx, ctx->arena, sizeof (*retval));
     if (retval == NULL)
         return NULL;
 
-    // !!! FIXME: this is hacky.
-    if (!buffer_append(ctx->garbage, &retval, sizeof (retval)))
-    {
-        Free(ctx, retval);
-        return NULL;
-    } // if
-
     if (!soa->isarray)
     {
         assert(soa->dimension == NULL);
@@ -2232,7 +2094,6 @@ static const MOJOSHADER_astDataType *add_type_coercion(Context *ctx,
     // Ditch original (*right), force a literal value that matches
     //  ldatatype, so further processing is normalized.
     // !!! FIXME: force (right) to match (left).
-    delete_expr(ctx, *right);
     *right = new_cast_expr(ctx, _ldatatype, new_literal_int_expr(ctx, 0));
     return ldatatype;
 } // add_type_coercion
@@ -2444,16 +2305,158 @@ static DatatypeMatch compatible_arg_datatype(Context *ctx,
 
 static const MOJOSHADER_astDataType *type_check_ast(Context *ctx, void *_ast);
 
-// !!! FIXME: this function sucks.
+// Returns how well (args) fit (dtfn)'s parameters, or zero if they don't.
+static int score_overload(Context *ctx,
+                          const MOJOSHADER_astDataTypeFunction *dtfn,
+                          MOJOSHADER_astArguments *args, const int argcount)
+{
+    if (argcount != dtfn->num_params)  // !!! FIXME: default args.
+        return 0;
+
+    int i;
+    int retval = 0;
+    for (i = 0; i < argcount; i++)
+    {
+        assert(args != NULL);
+        const MOJOSHADER_astDataType *dt = args->argument->datatype;
+        args = args->next;
+        const DatatypeMatch compatible = compatible_arg_datatype(ctx, dt, dtfn->params[i]);
+        if (compatible == DT_MATCH_INCOMPATIBLE)
+            return 0;
+        retval += (int) compatible;
+    } // for
+
+    return retval;
+} // score_overload
+
+// Which intrinsic a call resolves to only depends on the function's name
+//  and the arguments' datatypes, and shaders make the same calls over and
+//  over, so we remember each answer for the rest of the compile.
+typedef struct OverloadMemo
+{
+    const char *sym;  // stringcache'd, so pointer compares are safe.
+    int argcount;
+    const MOJOSHADER_astDataType *args[4];
+    const Intrinsic *best;  // first overload with the best score, or NULL.
+    int score;  // (best)'s score.
+    int matches;  // number of overloads with that score.
+} OverloadMemo;
+
+static uint32 hash_overload_memo(const void *_key, void *data)
+{
+    (void) data;
+    const OverloadMemo *key = (const OverloadMemo *) _key;
+    uint32 retval = (uint32) (((size_t) key->sym) >> 3);
+    int i;
+    for (i = 0; i < key->argcount; i++)
+        retval = ((retval << 5) + retval) ^ (uint32) (((size_t) key->args[i]) >> 3);
+    return retval;
+} // hash_overload_memo
+
+static int keymatch_overload_memo(const void *_a, const void *_b, void *data)
+{
+    (void) data;
+    const OverloadMemo *a = (const OverloadMemo *) _a;
+    const OverloadMemo *b = (const OverloadMemo *) _b;
+    return ( (a->sym == b->sym) && (a->argcount == b->argcount) &&
+             (memcmp(a->args, b->args, sizeof (a->args[0]) * a->argcount) == 0) );
+} // keymatch_overload_memo
+
+static void nuke_overload_memo(const void *ctx, const void *key, const void *value, void *data) {/*no-op, these are in ctx->arena*/}
+
+static const OverloadMemo *match_intrinsic(Context *ctx, const char *sym,
+                                           MOJOSHADER_astArguments *args,
+                                           const int argcount)
+{
+    OverloadMemo key;
+    int i;
+
+    if ((argcount < 1) || (argcount > (int) STATICARRAYLEN(key.args)))
+        return NULL;  // no intrinsic takes this many arguments.
+
+    memset(&key, '\0', sizeof (key));
+    key.sym = sym;
+    key.argcount = argcount;
+    MOJOSHADER_astArguments *arg = args;
+    for (i = 0; i < argcount; i++, arg = arg->next)
+        key.args[i] = arg->argument->datatype;
+
+    if (ctx->overload_memo == NULL)
+    {
+        ctx->overload_memo = hash_create(ctx, hash_overload_memo,
+                                         keymatch_overload_memo,
+                                         nuke_overload_memo, 0,
+                                         MallocBridge, FreeBridge, ctx);
+        if (ctx->overload_memo == NULL)
+        {
+            out_of_memory(ctx);
+            return NULL;
+        } // if
+    } // if
+
+    const void *value = NULL;
+    if (hash_find(ctx->overload_memo, &key, &value))
+        return (const OverloadMemo *) value;
+
+    // Only look at overloads that take this many arguments. A scalar can
+    //  promote to anything, but otherwise the first argument has to be in
+    //  the same category as the first parameter, so look at just those.
+    int count = 0;
+    const Intrinsic **overloads = NULL;
+    const MOJOSHADER_astDataType *lead = reduce_datatype(ctx, key.args[0]);
+    if (is_scalar_datatype(lead))
+        overloads = find_overloads(builtins.by_arity, sym, argcount, -1, &count);
+    else
+    {
+        overloads = find_overloads(builtins.by_lead, sym, argcount,
+                                   overload_category(lead), &count);
+    } // else
+
+    // these are newest first, same as the symbol map would have them.
+    const int perfect = argcount * ((int) DT_MATCH_PERFECT);
+    for (i = 0; i < count; i++)
+    {
+        const int score = score_overload(ctx, &overloads[i]->datatype.function,
+                                         args, argcount);
+        if (score == 0)  // incompatible.
+            continue;
+
+        else if (score == perfect)  // perfection! stop looking!
+        {
+            key.best = overloads[i];
+            key.score = score;
+            key.matches = 1;
+            break;
+        } // else if
+
+        else if (score == key.score)
+            key.matches++;
+
+        else if (score > key.score)
+        {
+            key.best = overloads[i];
+            key.score = score;
+            key.matches = 1;
+        } // else if
+    } // for
+
+    OverloadMemo *memo = (OverloadMemo *) ArenaMalloc(ctx, ctx->arena, sizeof (*memo));
+    if (memo == NULL)
+        return NULL;
+    memcpy(memo, &key, sizeof (*memo));
+    if (hash_insert(ctx->overload_memo, memo, memo) == -1)
+        out_of_memory(ctx);
+    return memo;
+} // match_intrinsic
+
 static const MOJOSHADER_astDataType *match_func_to_call(Context *ctx,
                                     MOJOSHADER_astExpressionCallFunction *ast)
 {
-    SymbolScope *best = NULL;  // best choice we find.
+    const MOJOSHADER_astDataType *best = NULL;  // best choice we find.
+    int best_index = 0;
     int best_score = 0;
     MOJOSHADER_astExpressionIdentifier *ident = ast->identifier;
     const char *sym = ident->identifier;
-    const void *value = NULL;
-    void *iter = NULL;
 
     int argcount = 0;
     MOJOSHADER_astArguments *args = ast->args;
@@ -2465,43 +2468,22 @@ static const MOJOSHADER_astDataType *match_func_to_call(Context *ctx,
     } // while;
 
     // we do some tapdancing to handle function overloading here.
+    //  Everything in the symbol map comes first (newest first, so locals
+    //  shadow functions), then the intrinsics, via match_intrinsic().
     int match = 0;
-    while (hash_iter(ctx->variables.hash, sym, &value, &iter))
+    const int perfect = argcount * ((int) DT_MATCH_PERFECT);
+    int slot;
+    for (slot = find_symbol_slot(&ctx->variables, sym); slot != -1;
+         slot = ctx->variables.symbols[slot].shadowed)
     {
-        SymbolScope *item = (SymbolScope *) value;
+        const Symbol *item = &ctx->variables.symbols[slot];
         const MOJOSHADER_astDataType *dt = item->datatype;
         dt = reduce_datatype(ctx, dt);
         // there's a locally-scoped symbol with this name? It takes precedence.
         if (dt->type != MOJOSHADER_AST_DATATYPE_FUNCTION)
             return dt;
 
-        const MOJOSHADER_astDataTypeFunction *dtfn = (MOJOSHADER_astDataTypeFunction *) dt;
-        const int perfect = argcount * ((int) DT_MATCH_PERFECT);
-        int score = 0;
-
-        if (argcount == dtfn->num_params)  // !!! FIXME: default args.
-        {
-            args = ast->args;
-            int i;
-            for (i = 0; i < argcount; i++)
-            {
-                assert(args != NULL);
-                dt = args->argument->datatype;
-                args = args->next;
-                const DatatypeMatch compatible = compatible_arg_datatype(ctx, dt, dtfn->params[i]);
-                if (compatible == DT_MATCH_INCOMPATIBLE)
-                {
-                    args = NULL;
-                    score = 0;
-                    break;
-                } // if
-
-                score += (int) compatible;
-            } // for
-
-            if (args != NULL)
-                score = 0;  // too many arguments supplied. No match.
-        } // else
+        const int score = score_overload(ctx, &dt->function, ast->args, argcount);
 
         if (score == 0)  // incompatible.
             continue;
@@ -2509,7 +2491,9 @@ static const MOJOSHADER_astDataType *match_func_to_call(Context *ctx,
         else if (score == perfect)  // perfection! stop looking!
         {
             match = 1;  // ignore all other compatible matches.
-            best = item;
+            best = dt;
+            best_index = item->index;
+            best_score = score;
             break;
         } // if
 
@@ -2527,11 +2511,32 @@ static const MOJOSHADER_astDataType *match_func_to_call(Context *ctx,
             else if (score > best_score)
             {
                 match = 1;  // reset the ambiguousness count.
-                best = item;
+                best = dt;
+                best_index = item->index;
                 best_score = score;
             } // if
         } // else if
-    } // while
+    } // for
+
+    if ((best == NULL) || (best_score != perfect))
+    {
+        // fold in the intrinsics, as if we'd kept iterating over them.
+        const OverloadMemo *memo = match_intrinsic(ctx, sym, ast->args, argcount);
+        if ((memo != NULL) && (memo->best != NULL))
+        {
+            if ((memo->score == perfect) || (memo->score > best_score))
+            {
+                match = memo->matches;
+                best = &memo->best->datatype;
+                best_index = memo->best->index;
+                best_score = memo->score;
+            } // if
+            else if (memo->score == best_score)
+            {
+                match += memo->matches;
+            } // else if
+        } // if
+    } // if
 
     if (match > 1)
     {
@@ -2548,8 +2553,8 @@ static const MOJOSHADER_astDataType *match_func_to_call(Context *ctx,
     } // if
     else
     {
-        ident->datatype = reduce_datatype(ctx, best->datatype);
-        ident->index = best->index;
+        ident->datatype = reduce_datatype(ctx, best);
+        ident->index = best_index;
     } // else
 
     return ident->datatype;
@@ -2580,7 +2585,8 @@ static const MOJOSHADER_astDataType *vectype_from_base(Context *ctx,
 
     char buf[32];
     snprintf(buf, sizeof (buf), "%s%d", typestr, len);
-    const MOJOSHADER_astDataType *datatype = get_usertype(ctx, buf);
+    const char *sym = stringcache(ctx->strcache, buf);  // maps compare pointers.
+    const MOJOSHADER_astDataType *datatype = get_usertype(ctx, sym);
     assert(datatype != NULL);
     return datatype;
 } // vectype_from_base
@@ -2632,14 +2638,14 @@ static const MOJOSHADER_astDataType *type_check_ast(Context *ctx, void *_ast)
             datatype = type_check_ast(ctx, ast->unary.operand);
             require_boolean_datatype(ctx, datatype);
             // !!! FIXME: coerce to bool here.
-            ast->unary.datatype = &ctx->dt_bool;
+            ast->unary.datatype = &builtins.dt_bool;
             return datatype;
 
         case MOJOSHADER_AST_OP_DEREF_ARRAY:
             datatype = type_check_ast(ctx, ast->binary.left);
             datatype2 = type_check_ast(ctx, ast->binary.right);
             require_integer_datatype(ctx, datatype2);
-            add_type_coercion(ctx, NULL, &ctx->dt_int, &ast->binary.right, datatype2);
+            add_type_coercion(ctx, NULL, &builtins.dt_int, &ast->binary.right, datatype2);
 
             datatype = reduce_datatype(ctx, datatype);
             if (datatype->type == MOJOSHADER_AST_DATATYPE_VECTOR)
@@ -2753,7 +2759,7 @@ static const MOJOSHADER_astDataType *type_check_ast(Context *ctx, void *_ast)
             datatype2 = type_check_ast(ctx, ast->binary.right);
             add_type_coercion(ctx, &ast->binary.left, datatype,
                               &ast->binary.right, datatype2);
-            ast->binary.datatype = &ctx->dt_bool;
+            ast->binary.datatype = &builtins.dt_bool;
             return ast->binary.datatype;
 
         case MOJOSHADER_AST_OP_BINARYAND:
@@ -2776,7 +2782,7 @@ static const MOJOSHADER_astDataType *type_check_ast(Context *ctx, void *_ast)
             // !!! FIXME: coerce each to bool here, separately.
             add_type_coercion(ctx, &ast->binary.left, datatype,
                               &ast->binary.right, datatype2);
-            ast->binary.datatype = &ctx->dt_bool;
+            ast->binary.datatype = &builtins.dt_bool;
 
         case MOJOSHADER_AST_OP_ASSIGN:
         case MOJOSHADER_AST_OP_MULASSIGN:
@@ -2811,7 +2817,7 @@ static const MOJOSHADER_astDataType *type_check_ast(Context *ctx, void *_ast)
             {
                 fail(ctx, "Unknown identifier");
                 // !!! FIXME: replace with a sane default, move on.
-                datatype = &ctx->dt_int;
+                datatype = &builtins.dt_int;
             } // if
             ast->identifier.datatype = datatype;
             return ast->identifier.datatype;
@@ -2834,7 +2840,7 @@ static const MOJOSHADER_astDataType *type_check_ast(Context *ctx, void *_ast)
             // !!! FIXME: replace AST node with an int if this isn't a func.
             if (!require_function_datatype(ctx, reduced))
             {
-                ast->callfunc.datatype = &ctx->dt_int;
+                ast->callfunc.datatype = &builtins.dt_int;
                 return ast->callfunc.datatype;
             } // if
 
@@ -2896,9 +2902,8 @@ static const MOJOSHADER_astDataType *type_check_ast(Context *ctx, void *_ast)
 
                 default:
                     fail(ctx, "Invalid type for constructor");
-                    delete_arguments(ctx, ast->constructor.args);
                     ast->constructor.args = new_argument(ctx, new_literal_int_expr(ctx, 0));
-                    ast->constructor.datatype = &ctx->dt_int;
+                    ast->constructor.datatype = &builtins.dt_int;
                     return ast->constructor.datatype;
             } // switch
 
@@ -2946,7 +2951,6 @@ static const MOJOSHADER_astDataType *type_check_ast(Context *ctx, void *_ast)
                     type_check_ast(ctx, argi->argument);
                 if (prev != NULL)
                     prev->next = NULL;
-                delete_arguments(ctx, arg);
             } // if
 
             return ast->constructor.datatype;
@@ -3207,26 +3211,15 @@ static const MOJOSHADER_astDataType *type_check_ast(Context *ctx, void *_ast)
                 mbrs = mbrs->next;
             } // while
 
-            // !!! FIXME: this is hacky.
             MOJOSHADER_astDataTypeStructMember *dtmbrs;
-            void *ptr = Malloc(ctx, sizeof (*dtmbrs) * count);
+            void *ptr = ArenaMalloc(ctx, ctx->arena, sizeof (*dtmbrs) * count);
             if (ptr == NULL)
                 return NULL;
-            if (!buffer_append(ctx->garbage, &ptr, sizeof (ptr)))
-            {
-                Free(ctx, ptr);
-                return NULL;
-            } // if
             dtmbrs = (MOJOSHADER_astDataTypeStructMember *) ptr;
 
-            ptr = Malloc(ctx, sizeof (MOJOSHADER_astDataType));
+            ptr = ArenaMalloc(ctx, ctx->arena, sizeof (MOJOSHADER_astDataType));
             if (ptr == NULL)
                 return NULL;
-            if (!buffer_append(ctx->garbage, &ptr, sizeof (ptr)))
-            {
-                Free(ctx, ptr);
-                return NULL;
-            } // if
             MOJOSHADER_astDataType *dt = (MOJOSHADER_astDataType *) ptr;
 
             mbrs = ast->structdecl.members;
@@ -3545,31 +3538,18 @@ static int convert_to_lemon_token(Context *ctx, const char *token,
 } // convert_to_lemon_token
 
 
-static void delete_ir(Context *ctx, void *_ir);  // !!! FIXME: move this code around.
-
 static void destroy_context(Context *ctx)
 {
     if (ctx != NULL)
     {
         MOJOSHADER_free f = ((ctx->free != NULL) ? ctx->free : MOJOSHADER_internal_free);
         void *d = ctx->malloc_data;
-        size_t i = 0;
-
-        // !!! FIXME: this is kinda hacky.
-        const size_t count = buffer_size(ctx->garbage) / sizeof (void *);
-        if (count > 0)
-        {
-            void **garbage = (void **) buffer_flatten(ctx->garbage);
-            if (garbage != NULL)
-            {
-                for (i = 0; i < count; i++)
-                    f(garbage[i], d);
-                f(garbage, d);
-            } // if
-        } // if
-        buffer_destroy(ctx->garbage);
 
-        delete_compilation_unit(ctx, (MOJOSHADER_astCompilationUnit*)ctx->ast);
+        if (ctx->overload_memo != NULL)
+            hash_destroy(ctx->overload_memo, ctx);
+        arena_destroy(ctx->ir_arena);
+        arena_destroy(ctx->ast_arena);
+        arena_destroy(ctx->arena);
         destroy_symbolmap(ctx, &ctx->usertypes);
         destroy_symbolmap(ctx, &ctx->variables);
         stringcache_destroy(ctx->strcache);
@@ -3577,11 +3557,9 @@ static void destroy_context(Context *ctx)
         errorlist_destroy(ctx->warnings);
 
         if (ctx->ir != NULL)
-        {
-            for (i = 0; i <= ctx->user_func_index; i++)
-                delete_ir(ctx, ctx->ir[i]);
             f(ctx->ir, d);
-        } // if
+        if (ctx->ir_rets != NULL)
+            f(ctx->ir_rets, d);
 
         // !!! FIXME: more to clean up here, now.
 
@@ -3609,58 +3587,54 @@ static Context *build_context(MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
     ctx->errors = errorlist_create(MallocBridge, FreeBridge, ctx);  // !!! FIXME: check for failure.
     ctx->warnings = errorlist_create(MallocBridge, FreeBridge, ctx);  // !!! FIXME: check for failure.
 
-    // !!! FIXME: this feels hacky.
-    ctx->garbage = buffer_create(256*sizeof(void*),MallocBridge,FreeBridge,ctx);  // !!! FIXME: check for failure.
-
-    ctx->dt_none.type = MOJOSHADER_AST_DATATYPE_NONE;
-    ctx->dt_bool.type = MOJOSHADER_AST_DATATYPE_BOOL;
-    ctx->dt_int.type = MOJOSHADER_AST_DATATYPE_INT;
-    ctx->dt_uint.type = MOJOSHADER_AST_DATATYPE_UINT;
-    ctx->dt_float.type = MOJOSHADER_AST_DATATYPE_FLOAT;
-    ctx->dt_float_snorm.type = MOJOSHADER_AST_DATATYPE_FLOAT_SNORM;
-    ctx->dt_float_unorm.type = MOJOSHADER_AST_DATATYPE_FLOAT_UNORM;
-    ctx->dt_half.type = MOJOSHADER_AST_DATATYPE_HALF;
-    ctx->dt_double.type = MOJOSHADER_AST_DATATYPE_DOUBLE;
-    ctx->dt_string.type = MOJOSHADER_AST_DATATYPE_STRING;
-    ctx->dt_sampler1d.type = MOJOSHADER_AST_DATATYPE_SAMPLER_1D;
-    ctx->dt_sampler2d.type = MOJOSHADER_AST_DATATYPE_SAMPLER_2D;
-    ctx->dt_sampler3d.type = MOJOSHADER_AST_DATATYPE_SAMPLER_3D;
-    ctx->dt_samplercube.type = MOJOSHADER_AST_DATATYPE_SAMPLER_CUBE;
-    ctx->dt_samplerstate.type = MOJOSHADER_AST_DATATYPE_SAMPLER_STATE;
-    ctx->dt_samplercompstate.type = MOJOSHADER_AST_DATATYPE_SAMPLER_COMPARISON_STATE;
-
-    #define INIT_DT_BUFFER(t) \
-        ctx->dt_buf_##t.type = MOJOSHADER_AST_DATATYPE_BUFFER; \
-        ctx->dt_buf_##t.buffer.base = &ctx->dt_##t;
-    INIT_DT_BUFFER(bool);
-    INIT_DT_BUFFER(int);
-    INIT_DT_BUFFER(uint);
-    INIT_DT_BUFFER(half);
-    INIT_DT_BUFFER(float);
-    INIT_DT_BUFFER(double);
-    INIT_DT_BUFFER(float_snorm);
-    INIT_DT_BUFFER(float_unorm);
-    #undef INIT_DT_BUFFER
+    ctx->arena = arena_create(16 * 1024, m, f, d);
+    ctx->ast_arena = arena_create(64 * 1024, m, f, d);
+    ctx->ir_arena = arena_create(64 * 1024, m, f, d);
+    if ((!ctx->arena) || (!ctx->ast_arena) || (!ctx->ir_arena))
+    {
+        destroy_context(ctx);
+        return NULL;
+    } // if
 
     return ctx;
 } // build_context
 
 
+static void add_intrinsic(const char *fn, const MOJOSHADER_astDataType *ret,
+                          const int paramcount,
+                          const MOJOSHADER_astDataType **params)
+{
+    assert(builtins.intrinsic_count < (int) STATICARRAYLEN(builtins.intrinsics));
+    Intrinsic *intrinsic = &builtins.intrinsics[builtins.intrinsic_count++];
+    assert(paramcount <= (int) STATICARRAYLEN(intrinsic->params));
+    memcpy(intrinsic->params, params, sizeof (*params) * paramcount);
+    intrinsic->name = fn;
+    intrinsic->index = -builtins.intrinsic_count;  // these are negative.
+    intrinsic->datatype.type = MOJOSHADER_AST_DATATYPE_FUNCTION;
+    intrinsic->datatype.function.retval = ret;
+    intrinsic->datatype.function.params = intrinsic->params;
+    intrinsic->datatype.function.num_params = paramcount;
+    intrinsic->datatype.function.intrinsic = 1;
+
+    const MOJOSHADER_astDataType *lead = params[0];
+    while (lead->type == MOJOSHADER_AST_DATATYPE_USER)
+        lead = lead->user.details;
+    intrinsic->lead = overload_category(lead);
+} // add_intrinsic
+
 // This macro salsa is kinda nasty, but it's the smallest, least error-prone
 //  way I can find to do this well in C.  :/
 
 #define ADD_INTRINSIC(fn, ret, params) do { \
-    push_function(ctx, fn, \
-        build_function_datatype(ctx, ret, STATICARRAYLEN(params), params, 1), \
-        0); \
+    add_intrinsic(fn, ret, STATICARRAYLEN(params), params); \
 } while (0)
 
 #define ADD_INTRINSIC_VECTOR(typestr, code) do { \
     const MOJOSHADER_astDataType *dt; \
-    dt = get_usertype(ctx, typestr "1"); code; \
-    dt = get_usertype(ctx, typestr "2"); code; \
-    dt = get_usertype(ctx, typestr "3"); code; \
-    dt = get_usertype(ctx, typestr "4"); code; \
+    dt = find_builtin_usertype(typestr "1"); code; \
+    dt = find_builtin_usertype(typestr "2"); code; \
+    dt = find_builtin_usertype(typestr "3"); code; \
+    dt = find_builtin_usertype(typestr "4"); code; \
 } while (0)
 
 #define ADD_INTRINSIC_VECTOR_FLOAT(code) { \
@@ -3678,22 +3652,22 @@ static Context *build_context(MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
 
 #define ADD_INTRINSIC_MATRIX(typestr, code) do { \
     const MOJOSHADER_astDataType *dt; \
-    dt = get_usertype(ctx, typestr "1x1"); code; \
-    dt = get_usertype(ctx, typestr "1x2"); code; \
-    dt = get_usertype(ctx, typestr "1x3"); code; \
-    dt = get_usertype(ctx, typestr "1x4"); code; \
-    dt = get_usertype(ctx, typestr "2x1"); code; \
-    dt = get_usertype(ctx, typestr "2x2"); code; \
-    dt = get_usertype(ctx, typestr "2x3"); code; \
-    dt = get_usertype(ctx, typestr "2x4"); code; \
-    dt = get_usertype(ctx, typestr "3x1"); code; \
-    dt = get_usertype(ctx, typestr "3x2"); code; \
-    dt = get_usertype(ctx, typestr "3x3"); code; \
-    dt = get_usertype(ctx, typestr "3x4"); code; \
-    dt = get_usertype(ctx, typestr "4x1"); code; \
-    dt = get_usertype(ctx, typestr "4x2"); code; \
-    dt = get_usertype(ctx, typestr "4x3"); code; \
-    dt = get_usertype(ctx, typestr "4x4"); code; \
+    dt = find_builtin_usertype(typestr "1x1"); code; \
+    dt = find_builtin_usertype(typestr "1x2"); code; \
+    dt = find_builtin_usertype(typestr "1x3"); code; \
+    dt = find_builtin_usertype(typestr "1x4"); code; \
+    dt = find_builtin_usertype(typestr "2x1"); code; \
+    dt = find_builtin_usertype(typestr "2x2"); code; \
+    dt = find_builtin_usertype(typestr "2x3"); code; \
+    dt = find_builtin_usertype(typestr "2x4"); code; \
+    dt = find_builtin_usertype(typestr "3x1"); code; \
+    dt = find_builtin_usertype(typestr "3x2"); code; \
+    dt = find_builtin_usertype(typestr "3x3"); code; \
+    dt = find_builtin_usertype(typestr "3x4"); code; \
+    dt = find_builtin_usertype(typestr "4x1"); code; \
+    dt = find_builtin_usertype(typestr "4x2"); code; \
+    dt = find_builtin_usertype(typestr "4x3"); code; \
+    dt = find_builtin_usertype(typestr "4x4"); code; \
 } while (0)
 
 #define ADD_INTRINSIC_MATRIX_FLOAT(code) { \
@@ -3716,18 +3690,18 @@ static Context *build_context(MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
 } while (0)
 
 #define ADD_INTRINSIC_ANY_FLOAT(code) do { \
-    ADD_INTRINSIC_ANY(&ctx->dt_double, "double", code); \
-    ADD_INTRINSIC_ANY(&ctx->dt_half, "half", code); \
-    ADD_INTRINSIC_ANY(&ctx->dt_float, "float", code); \
+    ADD_INTRINSIC_ANY(&builtins.dt_double, "double", code); \
+    ADD_INTRINSIC_ANY(&builtins.dt_half, "half", code); \
+    ADD_INTRINSIC_ANY(&builtins.dt_float, "float", code); \
 } while (0)
 #define ADD_INTRINSIC_ANY_INT(code) do { \
-    ADD_INTRINSIC_ANY(&ctx->dt_uint, "uint", code); \
-    ADD_INTRINSIC_ANY(&ctx->dt_int, "int", code); \
+    ADD_INTRINSIC_ANY(&builtins.dt_uint, "uint", code); \
+    ADD_INTRINSIC_ANY(&builtins.dt_int, "int", code); \
 } while (0)
 
-#define ADD_INTRINSIC_ANY_BOOL(code) ADD_INTRINSIC_ANY(&ctx->dt_bool, "bool", code)
+#define ADD_INTRINSIC_ANY_BOOL(code) ADD_INTRINSIC_ANY(&builtins.dt_bool, "bool", code)
 
-static void add_intrinsic1(Context *ctx, const char *fn,
+static void add_intrinsic1(const char *fn,
                            const MOJOSHADER_astDataType *ret,
                            const MOJOSHADER_astDataType *dt1)
 {
@@ -3735,7 +3709,7 @@ static void add_intrinsic1(Context *ctx, const char *fn,
     ADD_INTRINSIC(fn, ret, params);
 } // add_intrinsic1
 
-static void add_intrinsic2(Context *ctx, const char *fn,
+static void add_intrinsic2(const char *fn,
                            const MOJOSHADER_astDataType *ret,
                            const MOJOSHADER_astDataType *dt1,
                            const MOJOSHADER_astDataType *dt2)
@@ -3744,7 +3718,7 @@ static void add_intrinsic2(Context *ctx, const char *fn,
     ADD_INTRINSIC(fn, ret, params);
 } // add_intrinsic2
 
-static void add_intrinsic3(Context *ctx, const char *fn,
+static void add_intrinsic3(const char *fn,
                            const MOJOSHADER_astDataType *ret,
                            const MOJOSHADER_astDataType *dt1,
                            const MOJOSHADER_astDataType *dt2,
@@ -3754,7 +3728,7 @@ static void add_intrinsic3(Context *ctx, const char *fn,
     ADD_INTRINSIC(fn, ret, params);
 } // add_intrinsic3
 
-static void add_intrinsic4(Context *ctx, const char *fn,
+static void add_intrinsic4(const char *fn,
                            const MOJOSHADER_astDataType *ret,
                            const MOJOSHADER_astDataType *dt1,
                            const MOJOSHADER_astDataType *dt2,
@@ -3769,512 +3743,571 @@ static void add_intrinsic4(Context *ctx, const char *fn,
 //  ADD_INTRINSIC_* macros, even though these look like functions that
 //  should be called first. They might be called multiple times by the macro.
 //  The variable "dt" is defined by the macro for use by your code.
-static void add_intrinsic_SAME1_ANYf(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_ANYf(const char *fn)
 {
-    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic1(ctx, fn, dt, dt));
+    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic1(fn, dt, dt));
 } // add_intrinsic_SAME1_ANYf
 
-static void add_intrinsic_SAME1_ANYfi(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_ANYfi(const char *fn)
 {
-    ADD_INTRINSIC_ANY_INT(add_intrinsic1(ctx, fn, dt, dt));
-    add_intrinsic_SAME1_ANYf(ctx, fn);
+    ADD_INTRINSIC_ANY_INT(add_intrinsic1(fn, dt, dt));
+    add_intrinsic_SAME1_ANYf(fn);
 } // add_intrinsic_SAME1_ANYfi
 
-static void add_intrinsic_BOOL_ANYf(Context *ctx, const char *fn)
+static void add_intrinsic_BOOL_ANYf(const char *fn)
 {
-    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic1(ctx, fn, &ctx->dt_bool, dt));
+    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic1(fn, &builtins.dt_bool, dt));
 } // add_intrinsic_BOOL_ANYf
 
-static void add_intrinsic_BOOL_ANYfib(Context *ctx, const char *fn)
+static void add_intrinsic_BOOL_ANYfib(const char *fn)
 {
-    ADD_INTRINSIC_ANY_BOOL(add_intrinsic1(ctx, fn, &ctx->dt_bool, dt));
-    ADD_INTRINSIC_ANY_INT(add_intrinsic1(ctx, fn, &ctx->dt_bool, dt));
-    add_intrinsic_BOOL_ANYf(ctx, fn);
+    ADD_INTRINSIC_ANY_BOOL(add_intrinsic1(fn, &builtins.dt_bool, dt));
+    ADD_INTRINSIC_ANY_INT(add_intrinsic1(fn, &builtins.dt_bool, dt));
+    add_intrinsic_BOOL_ANYf(fn);
 } // add_intrinsic_BOOL_ANYfib
 
-static void add_intrinsic_SAME1_ANYf_SAME1(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_ANYf_SAME1(const char *fn)
 {
-    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic2(ctx, fn, dt, dt, dt));
+    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic2(fn, dt, dt, dt));
 } // add_intrinsic_SAME1_ANYf_SAME1
 
-static void add_intrinsic_SAME1_ANYfi_SAME1(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_ANYfi_SAME1(const char *fn)
 {
-    ADD_INTRINSIC_ANY_INT(add_intrinsic2(ctx, fn, dt, dt, dt));
-    add_intrinsic_SAME1_ANYf_SAME1(ctx, fn);
+    ADD_INTRINSIC_ANY_INT(add_intrinsic2(fn, dt, dt, dt));
+    add_intrinsic_SAME1_ANYf_SAME1(fn);
 } // add_intrinsic_SAME1_ANYfi_SAME1
 
-static void add_intrinsic_SAME1_ANYf_SAME1_SAME1(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_ANYf_SAME1_SAME1(const char *fn)
 {
-    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic3(ctx, fn, dt, dt, dt, dt));
+    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic3(fn, dt, dt, dt, dt));
 } // add_intrinsic_SAME1_ANYf_SAME1_SAME1
 
-static void add_intrinsic_SAME1_ANYfi_SAME1_SAME1(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_ANYfi_SAME1_SAME1(const char *fn)
 {
-    ADD_INTRINSIC_ANY_INT(add_intrinsic3(ctx, fn, dt, dt, dt, dt));
-    add_intrinsic_SAME1_ANYf_SAME1_SAME1(ctx, fn);
+    ADD_INTRINSIC_ANY_INT(add_intrinsic3(fn, dt, dt, dt, dt));
+    add_intrinsic_SAME1_ANYf_SAME1_SAME1(fn);
 } // add_intrinsic_SAME1_ANYfi_SAME1_SAME1
 
-static void add_intrinsic_SAME1_Mfib(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_Mfib(const char *fn)
 {
-    ADD_INTRINSIC_MATRIX_BOOL(add_intrinsic1(ctx, fn, dt, dt));
-    ADD_INTRINSIC_MATRIX_INT(add_intrinsic1(ctx, fn, dt, dt));
-    ADD_INTRINSIC_MATRIX_FLOAT(add_intrinsic1(ctx, fn, dt, dt));
+    ADD_INTRINSIC_MATRIX_BOOL(add_intrinsic1(fn, dt, dt));
+    ADD_INTRINSIC_MATRIX_INT(add_intrinsic1(fn, dt, dt));
+    ADD_INTRINSIC_MATRIX_FLOAT(add_intrinsic1(fn, dt, dt));
 } // add_intrinsic_SAME1_Mfib
 
-static void add_intrinsic_SAME1_Vf(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_Vf(const char *fn)
 {
-    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic1(ctx, fn, dt, dt));
+    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic1(fn, dt, dt));
 } // add_intrinsic_SAME1_Vf
 
-static void add_intrinsic_SAME1_Vf_SAME1_SAME1(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_Vf_SAME1_SAME1(const char *fn)
 {
-    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic3(ctx, fn, dt, dt, dt, dt));
+    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic3(fn, dt, dt, dt, dt));
 } // add_intrinsic_SAME1_Vf_SAME1_SAME1
 
-static void add_intrinsic_SAME1_Vf_SAME1_f(Context *ctx, const char *fn)
+static void add_intrinsic_SAME1_Vf_SAME1_f(const char *fn)
 {
-    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic3(ctx, fn, dt, dt, dt, dt->user.details->vector.base));
+    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic3(fn, dt, dt, dt, dt->user.details->vector.base));
 } // add_intrinsic_SAME1_Vf_SAME1_f
 
-static void add_intrinsic_VOID_ANYf(Context *ctx, const char *fn)
+static void add_intrinsic_VOID_ANYf(const char *fn)
 {
-    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic1(ctx, fn, NULL, dt));
+    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic1(fn, NULL, dt));
 } // add_intrinsic_VOID_ANYf
 
-static void add_intrinsic_VOID_ANYf_SAME1_SAME1(Context *ctx, const char *fn)
+static void add_intrinsic_VOID_ANYf_SAME1_SAME1(const char *fn)
 {
-    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic3(ctx, fn, NULL, dt, dt, dt));
+    ADD_INTRINSIC_ANY_FLOAT(add_intrinsic3(fn, NULL, dt, dt, dt));
 } // add_intrinsic_VOID_ANYf_SAME1_SAME1
 
-static void add_intrinsic_f_SQUAREMATRIXf(Context *ctx, const char *fn)
+static void add_intrinsic_f_SQUAREMATRIXf(const char *fn)
 {
-    add_intrinsic1(ctx, fn, &ctx->dt_float, get_usertype(ctx, "float1x1"));
-    add_intrinsic1(ctx, fn, &ctx->dt_float, get_usertype(ctx, "float2x2"));
-    add_intrinsic1(ctx, fn, &ctx->dt_float, get_usertype(ctx, "float3x3"));
-    add_intrinsic1(ctx, fn, &ctx->dt_float, get_usertype(ctx, "float4x4"));
+    add_intrinsic1(fn, &builtins.dt_float, find_builtin_usertype("float1x1"));
+    add_intrinsic1(fn, &builtins.dt_float, find_builtin_usertype("float2x2"));
+    add_intrinsic1(fn, &builtins.dt_float, find_builtin_usertype("float3x3"));
+    add_intrinsic1(fn, &builtins.dt_float, find_builtin_usertype("float4x4"));
 } // add_intrinsic_f_SQUAREMATRIXf
 
-static void add_intrinsic_f_Vf(Context *ctx, const char *fn)
+static void add_intrinsic_f_Vf(const char *fn)
 {
-    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic1(ctx, fn, dt->user.details->vector.base, dt));
+    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic1(fn, dt->user.details->vector.base, dt));
 } // add_intrinsic_f_Vf
 
-static void add_intrinsic_fi_Vfi_SAME1(Context *ctx, const char *fn)
+static void add_intrinsic_fi_Vfi_SAME1(const char *fn)
 {
-    ADD_INTRINSIC_VECTOR_INT(add_intrinsic2(ctx, fn, dt->user.details->vector.base, dt, dt));
-    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(ctx, fn, dt->user.details->vector.base, dt, dt));
+    ADD_INTRINSIC_VECTOR_INT(add_intrinsic2(fn, dt->user.details->vector.base, dt, dt));
+    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(fn, dt->user.details->vector.base, dt, dt));
 } // add_intrinsic_fi_Vfi_SAME1
 
-static void add_intrinsic_f_Vf_SAME1(Context *ctx, const char *fn)
+static void add_intrinsic_f_Vf_SAME1(const char *fn)
 {
-    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(ctx, fn, dt->user.details->vector.base, dt, dt));
+    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(fn, dt->user.details->vector.base, dt, dt));
 } // add_intrinsic_f_Vf_SAME1
 
-static void add_intrinsic_3f_3f_3f(Context *ctx, const char *fn)
+static void add_intrinsic_3f_3f_3f(const char *fn)
 {
-    const MOJOSHADER_astDataType *dt = get_usertype(ctx, "float3");
-    add_intrinsic2(ctx, fn, dt, dt, dt);
+    const MOJOSHADER_astDataType *dt = find_builtin_usertype("float3");
+    add_intrinsic2(fn, dt, dt, dt);
 } // add_intrinsic_3f_3f_3f
 
-static void add_intrinsic_4f_f_f_f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_f_f_f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    const MOJOSHADER_astDataType *f = &ctx->dt_float;
-    add_intrinsic3(ctx, fn, f4, f, f, f);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    const MOJOSHADER_astDataType *f = &builtins.dt_float;
+    add_intrinsic3(fn, f4, f, f, f);
 } // add_intrinsic_4f_f_f_f
 
-static void add_intrinsic_4f_s1_4f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_s1_4f(const char *fn)
 {
-    const MOJOSHADER_astDataType *dt = get_usertype(ctx, "float4");
-    add_intrinsic2(ctx, fn, dt, &ctx->dt_sampler1d, dt);
+    const MOJOSHADER_astDataType *dt = find_builtin_usertype("float4");
+    add_intrinsic2(fn, dt, &builtins.dt_sampler1d, dt);
 } // add_intrinsic_4f_s1_4f
 
-static void add_intrinsic_4f_s1_f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_s1_f(const char *fn)
 {
-    const MOJOSHADER_astDataType *dt = get_usertype(ctx, "float4");
-    add_intrinsic2(ctx, fn, dt, &ctx->dt_sampler1d, &ctx->dt_float);
+    const MOJOSHADER_astDataType *dt = find_builtin_usertype("float4");
+    add_intrinsic2(fn, dt, &builtins.dt_sampler1d, &builtins.dt_float);
 } // add_intrinsic_4f_s1_f
 
-static void add_intrinsic_4f_s1_f_f_f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_s1_f_f_f(const char *fn)
 {
-    const MOJOSHADER_astDataType *dt = get_usertype(ctx, "float4");
-    const MOJOSHADER_astDataType *f = &ctx->dt_float;
-    add_intrinsic4(ctx, fn, dt, &ctx->dt_sampler1d, f, f, f);
+    const MOJOSHADER_astDataType *dt = find_builtin_usertype("float4");
+    const MOJOSHADER_astDataType *f = &builtins.dt_float;
+    add_intrinsic4(fn, dt, &builtins.dt_sampler1d, f, f, f);
 } // add_intrinsic_4f_s1_f_f_f
 
-static void add_intrinsic_4f_s2_2f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_s2_2f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    const MOJOSHADER_astDataType *f2 = get_usertype(ctx, "float2");
-    add_intrinsic2(ctx, fn, f4, &ctx->dt_sampler2d, f2);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    const MOJOSHADER_astDataType *f2 = find_builtin_usertype("float2");
+    add_intrinsic2(fn, f4, &builtins.dt_sampler2d, f2);
 } // add_intrinsic_4f_s2_2f
 
-static void add_intrinsic_4f_s2_2f_2f_2f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_s2_2f_2f_2f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    const MOJOSHADER_astDataType *f2 = get_usertype(ctx, "float2");
-    add_intrinsic4(ctx, fn, f4, &ctx->dt_sampler2d, f2, f2, f2);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    const MOJOSHADER_astDataType *f2 = find_builtin_usertype("float2");
+    add_intrinsic4(fn, f4, &builtins.dt_sampler2d, f2, f2, f2);
 } // add_intrinsic_4f_s2_2f_2f_2f
 
-static void add_intrinsic_4f_s2_4f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_s2_4f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    add_intrinsic2(ctx, fn, f4, &ctx->dt_sampler2d, f4);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    add_intrinsic2(fn, f4, &builtins.dt_sampler2d, f4);
 } // add_intrinsic_4f_s2_4f
 
-static void add_intrinsic_4f_s3_3f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_s3_3f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    const MOJOSHADER_astDataType *f3 = get_usertype(ctx, "float3");
-    add_intrinsic2(ctx, fn, f4, &ctx->dt_sampler3d, f3);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    const MOJOSHADER_astDataType *f3 = find_builtin_usertype("float3");
+    add_intrinsic2(fn, f4, &builtins.dt_sampler3d, f3);
 } // add_intrinsic_4f_s3_3f
 
-static void add_intrinsic_4f_s3_3f_3f_3f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_s3_3f_3f_3f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    const MOJOSHADER_astDataType *f3 = get_usertype(ctx, "float3");
-    add_intrinsic4(ctx, fn, f4, &ctx->dt_sampler3d, f3, f3, f3);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    const MOJOSHADER_astDataType *f3 = find_builtin_usertype("float3");
+    add_intrinsic4(fn, f4, &builtins.dt_sampler3d, f3, f3, f3);
 } // add_intrinsic_4f_s3_3f_3f_3f
 
-static void add_intrinsic_4f_s3_4f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_s3_4f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    add_intrinsic2(ctx, fn, f4, &ctx->dt_sampler3d, f4);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    add_intrinsic2(fn, f4, &builtins.dt_sampler3d, f4);
 } // add_intrinsic_4f_s3_4f
 
-static void add_intrinsic_4f_sc_3f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_sc_3f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    const MOJOSHADER_astDataType *f3 = get_usertype(ctx, "float3");
-    add_intrinsic2(ctx, fn, f4, &ctx->dt_samplercube, f3);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    const MOJOSHADER_astDataType *f3 = find_builtin_usertype("float3");
+    add_intrinsic2(fn, f4, &builtins.dt_samplercube, f3);
 } // add_intrinsic_4f_sc_3f
 
-static void add_intrinsic_4f_sc_3f_3f_3f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_sc_3f_3f_3f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    const MOJOSHADER_astDataType *f3 = get_usertype(ctx, "float3");
-    add_intrinsic4(ctx, fn, f4, &ctx->dt_samplercube, f3, f3, f3);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    const MOJOSHADER_astDataType *f3 = find_builtin_usertype("float3");
+    add_intrinsic4(fn, f4, &builtins.dt_samplercube, f3, f3, f3);
 } // add_intrinsic_4f_sc_3f_3f_3f
 
-static void add_intrinsic_4f_sc_4f(Context *ctx, const char *fn)
+static void add_intrinsic_4f_sc_4f(const char *fn)
 {
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    add_intrinsic2(ctx, fn, f4, &ctx->dt_samplercube, f4);
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    add_intrinsic2(fn, f4, &builtins.dt_samplercube, f4);
 } // add_intrinsic_4f_sc_4f
 
-static void add_intrinsic_4i_4f(Context *ctx, const char *fn)
+static void add_intrinsic_4i_4f(const char *fn)
 {
-    const MOJOSHADER_astDataType *i4 = get_usertype(ctx, "int4");
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    add_intrinsic1(ctx, fn, i4, f4);
+    const MOJOSHADER_astDataType *i4 = find_builtin_usertype("int4");
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    add_intrinsic1(fn, i4, f4);
 } // add_intrinsic_4i_4f
 
-static void add_intrinsic_mul(Context *ctx, const char *fn)
+static void add_intrinsic_mul(const char *fn)
 {
     // mul() is nasty, since there's a bunch of overloads that aren't just
     //  related to vector size.
     // !!! FIXME: needs half, double, uint...
-    const MOJOSHADER_astDataType *dtf = &ctx->dt_float;
-    const MOJOSHADER_astDataType *dti = &ctx->dt_int;
-    const MOJOSHADER_astDataType *f1 = get_usertype(ctx, "float1");
-    const MOJOSHADER_astDataType *f2 = get_usertype(ctx, "float2");
-    const MOJOSHADER_astDataType *f3 = get_usertype(ctx, "float3");
-    const MOJOSHADER_astDataType *f4 = get_usertype(ctx, "float4");
-    const MOJOSHADER_astDataType *i1 = get_usertype(ctx, "int1");
-    const MOJOSHADER_astDataType *i2 = get_usertype(ctx, "int2");
-    const MOJOSHADER_astDataType *i3 = get_usertype(ctx, "int3");
-    const MOJOSHADER_astDataType *i4 = get_usertype(ctx, "int4");
-    const MOJOSHADER_astDataType *f1x1 = get_usertype(ctx, "float1x1");
-    const MOJOSHADER_astDataType *f1x2 = get_usertype(ctx, "float1x2");
-    const MOJOSHADER_astDataType *f1x3 = get_usertype(ctx, "float1x3");
-    const MOJOSHADER_astDataType *f1x4 = get_usertype(ctx, "float1x4");
-    const MOJOSHADER_astDataType *f2x1 = get_usertype(ctx, "float2x1");
-    const MOJOSHADER_astDataType *f2x2 = get_usertype(ctx, "float2x2");
-    const MOJOSHADER_astDataType *f2x3 = get_usertype(ctx, "float2x3");
-    const MOJOSHADER_astDataType *f2x4 = get_usertype(ctx, "float2x4");
-    const MOJOSHADER_astDataType *f3x1 = get_usertype(ctx, "float3x1");
-    const MOJOSHADER_astDataType *f3x2 = get_usertype(ctx, "float3x2");
-    const MOJOSHADER_astDataType *f3x3 = get_usertype(ctx, "float3x3");
-    const MOJOSHADER_astDataType *f3x4 = get_usertype(ctx, "float3x4");
-    const MOJOSHADER_astDataType *f4x1 = get_usertype(ctx, "float4x1");
-    const MOJOSHADER_astDataType *f4x2 = get_usertype(ctx, "float4x2");
-    const MOJOSHADER_astDataType *f4x3 = get_usertype(ctx, "float4x3");
-    const MOJOSHADER_astDataType *f4x4 = get_usertype(ctx, "float4x4");
-    const MOJOSHADER_astDataType *i1x1 = get_usertype(ctx, "int1x1");
-    const MOJOSHADER_astDataType *i1x2 = get_usertype(ctx, "int1x2");
-    const MOJOSHADER_astDataType *i1x3 = get_usertype(ctx, "int1x3");
-    const MOJOSHADER_astDataType *i1x4 = get_usertype(ctx, "int1x4");
-    const MOJOSHADER_astDataType *i2x1 = get_usertype(ctx, "int2x1");
-    const MOJOSHADER_astDataType *i2x2 = get_usertype(ctx, "int2x2");
-    const MOJOSHADER_astDataType *i2x3 = get_usertype(ctx, "int2x3");
-    const MOJOSHADER_astDataType *i2x4 = get_usertype(ctx, "int2x4");
-    const MOJOSHADER_astDataType *i3x1 = get_usertype(ctx, "int3x1");
-    const MOJOSHADER_astDataType *i3x2 = get_usertype(ctx, "int3x2");
-    const MOJOSHADER_astDataType *i3x3 = get_usertype(ctx, "int3x3");
-    const MOJOSHADER_astDataType *i3x4 = get_usertype(ctx, "int3x4");
-    const MOJOSHADER_astDataType *i4x1 = get_usertype(ctx, "int4x1");
-    const MOJOSHADER_astDataType *i4x2 = get_usertype(ctx, "int4x2");
-    const MOJOSHADER_astDataType *i4x3 = get_usertype(ctx, "int4x3");
-    const MOJOSHADER_astDataType *i4x4 = get_usertype(ctx, "int4x4");
+    const MOJOSHADER_astDataType *dtf = &builtins.dt_float;
+    const MOJOSHADER_astDataType *dti = &builtins.dt_int;
+    const MOJOSHADER_astDataType *f1 = find_builtin_usertype("float1");
+    const MOJOSHADER_astDataType *f2 = find_builtin_usertype("float2");
+    const MOJOSHADER_astDataType *f3 = find_builtin_usertype("float3");
+    const MOJOSHADER_astDataType *f4 = find_builtin_usertype("float4");
+    const MOJOSHADER_astDataType *i1 = find_builtin_usertype("int1");
+    const MOJOSHADER_astDataType *i2 = find_builtin_usertype("int2");
+    const MOJOSHADER_astDataType *i3 = find_builtin_usertype("int3");
+    const MOJOSHADER_astDataType *i4 = find_builtin_usertype("int4");
+    const MOJOSHADER_astDataType *f1x1 = find_builtin_usertype("float1x1");
+    const MOJOSHADER_astDataType *f1x2 = find_builtin_usertype("float1x2");
+    const MOJOSHADER_astDataType *f1x3 = find_builtin_usertype("float1x3");
+    const MOJOSHADER_astDataType *f1x4 = find_builtin_usertype("float1x4");
+    const MOJOSHADER_astDataType *f2x1 = find_builtin_usertype("float2x1");
+    const MOJOSHADER_astDataType *f2x2 = find_builtin_usertype("float2x2");
+    const MOJOSHADER_astDataType *f2x3 = find_builtin_usertype("float2x3");
+    const MOJOSHADER_astDataType *f2x4 = find_builtin_usertype("float2x4");
+    const MOJOSHADER_astDataType *f3x1 = find_builtin_usertype("float3x1");
+    const MOJOSHADER_astDataType *f3x2 = find_builtin_usertype("float3x2");
+    const MOJOSHADER_astDataType *f3x3 = find_builtin_usertype("float3x3");
+    const MOJOSHADER_astDataType *f3x4 = find_builtin_usertype("float3x4");
+    const MOJOSHADER_astDataType *f4x1 = find_builtin_usertype("float4x1");
+    const MOJOSHADER_astDataType *f4x2 = find_builtin_usertype("float4x2");
+    const MOJOSHADER_astDataType *f4x3 = find_builtin_usertype("float4x3");
+    const MOJOSHADER_astDataType *f4x4 = find_builtin_usertype("float4x4");
+    const MOJOSHADER_astDataType *i1x1 = find_builtin_usertype("int1x1");
+    const MOJOSHADER_astDataType *i1x2 = find_builtin_usertype("int1x2");
+    const MOJOSHADER_astDataType *i1x3 = find_builtin_usertype("int1x3");
+    const MOJOSHADER_astDataType *i1x4 = find_builtin_usertype("int1x4");
+    const MOJOSHADER_astDataType *i2x1 = find_builtin_usertype("int2x1");
+    const MOJOSHADER_astDataType *i2x2 = find_builtin_usertype("int2x2");
+    const MOJOSHADER_astDataType *i2x3 = find_builtin_usertype("int2x3");
+    const MOJOSHADER_astDataType *i2x4 = find_builtin_usertype("int2x4");
+    const MOJOSHADER_astDataType *i3x1 = find_builtin_usertype("int3x1");
+    const MOJOSHADER_astDataType *i3x2 = find_builtin_usertype("int3x2");
+    const MOJOSHADER_astDataType *i3x3 = find_builtin_usertype("int3x3");
+    const MOJOSHADER_astDataType *i3x4 = find_builtin_usertype("int3x4");
+    const MOJOSHADER_astDataType *i4x1 = find_builtin_usertype("int4x1");
+    const MOJOSHADER_astDataType *i4x2 = find_builtin_usertype("int4x2");
+    const MOJOSHADER_astDataType *i4x3 = find_builtin_usertype("int4x3");
+    const MOJOSHADER_astDataType *i4x4 = find_builtin_usertype("int4x4");
 
     // scalar * scalar
-    add_intrinsic2(ctx, fn, dti, dti, dti);
-    add_intrinsic2(ctx, fn, dtf, dtf, dtf);
+    add_intrinsic2(fn, dti, dti, dti);
+    add_intrinsic2(fn, dtf, dtf, dtf);
 
     // scalar * vector
-    ADD_INTRINSIC_VECTOR_INT(add_intrinsic2(ctx, fn, dt, dti, dt));
-    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(ctx, fn, dt, dtf, dt));
+    ADD_INTRINSIC_VECTOR_INT(add_intrinsic2(fn, dt, dti, dt));
+    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(fn, dt, dtf, dt));
 
     // scalar * matrix
-    ADD_INTRINSIC_MATRIX_INT(add_intrinsic2(ctx, fn, dt, dti, dt));
-    ADD_INTRINSIC_MATRIX_FLOAT(add_intrinsic2(ctx, fn, dt, dtf, dt));
+    ADD_INTRINSIC_MATRIX_INT(add_intrinsic2(fn, dt, dti, dt));
+    ADD_INTRINSIC_MATRIX_FLOAT(add_intrinsic2(fn, dt, dtf, dt));
 
     // vector * scalar
-    ADD_INTRINSIC_VECTOR_INT(add_intrinsic2(ctx, fn, dt, dt, dti));
-    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(ctx, fn, dt, dt, dtf));
+    ADD_INTRINSIC_VECTOR_INT(add_intrinsic2(fn, dt, dt, dti));
+    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(fn, dt, dt, dtf));
 
     // vector * vector
-    ADD_INTRINSIC_VECTOR_INT(add_intrinsic2(ctx, fn, dti, dt, dt));
-    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(ctx, fn, dtf, dt, dt));
+    ADD_INTRINSIC_VECTOR_INT(add_intrinsic2(fn, dti, dt, dt));
+    ADD_INTRINSIC_VECTOR_FLOAT(add_intrinsic2(fn, dtf, dt, dt));
 
     // vector * matrix
-    add_intrinsic2(ctx, fn, i1, i1, i1x1);
-    add_intrinsic2(ctx, fn, i2, i1, i1x2);
-    add_intrinsic2(ctx, fn, i3, i1, i1x3);
-    add_intrinsic2(ctx, fn, i4, i1, i1x4);
-    add_intrinsic2(ctx, fn, i1, i2, i2x1);
-    add_intrinsic2(ctx, fn, i2, i2, i2x2);
-    add_intrinsic2(ctx, fn, i3, i2, i2x3);
-    add_intrinsic2(ctx, fn, i4, i2, i2x4);
-    add_intrinsic2(ctx, fn, i1, i3, i3x1);
-    add_intrinsic2(ctx, fn, i2, i3, i3x2);
-    add_intrinsic2(ctx, fn, i3, i3, i3x3);
-    add_intrinsic2(ctx, fn, i4, i3, i3x4);
-    add_intrinsic2(ctx, fn, i1, i4, i4x1);
-    add_intrinsic2(ctx, fn, i2, i4, i4x2);
-    add_intrinsic2(ctx, fn, i3, i4, i4x3);
-    add_intrinsic2(ctx, fn, i4, i4, i4x4);
-    add_intrinsic2(ctx, fn, f1, f1, f1x1);
-    add_intrinsic2(ctx, fn, f2, f1, f1x2);
-    add_intrinsic2(ctx, fn, f3, f1, f1x3);
-    add_intrinsic2(ctx, fn, f4, f1, f1x4);
-    add_intrinsic2(ctx, fn, f1, f2, f2x1);
-    add_intrinsic2(ctx, fn, f2, f2, f2x2);
-    add_intrinsic2(ctx, fn, f3, f2, f2x3);
-    add_intrinsic2(ctx, fn, f4, f2, f2x4);
-    add_intrinsic2(ctx, fn, f1, f3, f3x1);
-    add_intrinsic2(ctx, fn, f2, f3, f3x2);
-    add_intrinsic2(ctx, fn, f3, f3, f3x3);
-    add_intrinsic2(ctx, fn, f4, f3, f3x4);
-    add_intrinsic2(ctx, fn, f1, f4, f4x1);
-    add_intrinsic2(ctx, fn, f2, f4, f4x2);
-    add_intrinsic2(ctx, fn, f3, f4, f4x3);
-    add_intrinsic2(ctx, fn, f4, f4, f4x4);
+    add_intrinsic2(fn, i1, i1, i1x1);
+    add_intrinsic2(fn, i2, i1, i1x2);
+    add_intrinsic2(fn, i3, i1, i1x3);
+    add_intrinsic2(fn, i4, i1, i1x4);
+    add_intrinsic2(fn, i1, i2, i2x1);
+    add_intrinsic2(fn, i2, i2, i2x2);
+    add_intrinsic2(fn, i3, i2, i2x3);
+    add_intrinsic2(fn, i4, i2, i2x4);
+    add_intrinsic2(fn, i1, i3, i3x1);
+    add_intrinsic2(fn, i2, i3, i3x2);
+    add_intrinsic2(fn, i3, i3, i3x3);
+    add_intrinsic2(fn, i4, i3, i3x4);
+    add_intrinsic2(fn, i1, i4, i4x1);
+    add_intrinsic2(fn, i2, i4, i4x2);
+    add_intrinsic2(fn, i3, i4, i4x3);
+    add_intrinsic2(fn, i4, i4, i4x4);
+    add_intrinsic2(fn, f1, f1, f1x1);
+    add_intrinsic2(fn, f2, f1, f1x2);
+    add_intrinsic2(fn, f3, f1, f1x3);
+    add_intrinsic2(fn, f4, f1, f1x4);
+    add_intrinsic2(fn, f1, f2, f2x1);
+    add_intrinsic2(fn, f2, f2, f2x2);
+    add_intrinsic2(fn, f3, f2, f2x3);
+    add_intrinsic2(fn, f4, f2, f2x4);
+    add_intrinsic2(fn, f1, f3, f3x1);
+    add_intrinsic2(fn, f2, f3, f3x2);
+    add_intrinsic2(fn, f3, f3, f3x3);
+    add_intrinsic2(fn, f4, f3, f3x4);
+    add_intrinsic2(fn, f1, f4, f4x1);
+    add_intrinsic2(fn, f2, f4, f4x2);
+    add_intrinsic2(fn, f3, f4, f4x3);
+    add_intrinsic2(fn, f4, f4, f4x4);
 
     // matrix * scalar
-    ADD_INTRINSIC_MATRIX_INT(add_intrinsic2(ctx, fn, dt, dt, dti));
-    ADD_INTRINSIC_MATRIX_FLOAT(add_intrinsic2(ctx, fn, dt, dt, dtf));
+    ADD_INTRINSIC_MATRIX_INT(add_intrinsic2(fn, dt, dt, dti));
+    ADD_INTRINSIC_MATRIX_FLOAT(add_intrinsic2(fn, dt, dt, dtf));
 
     // matrix * vector
-    add_intrinsic2(ctx, fn, i1, i1x1, i1);
-    add_intrinsic2(ctx, fn, i1, i1x2, i2);
-    add_intrinsic2(ctx, fn, i1, i1x3, i3);
-    add_intrinsic2(ctx, fn, i1, i1x4, i4);
-    add_intrinsic2(ctx, fn, i2, i2x1, i1);
-    add_intrinsic2(ctx, fn, i2, i2x2, i2);
-    add_intrinsic2(ctx, fn, i2, i2x3, i3);
-    add_intrinsic2(ctx, fn, i2, i2x4, i4);
-    add_intrinsic2(ctx, fn, i3, i3x1, i1);
-    add_intrinsic2(ctx, fn, i3, i3x2, i2);
-    add_intrinsic2(ctx, fn, i3, i3x3, i3);
-    add_intrinsic2(ctx, fn, i3, i3x4, i4);
-    add_intrinsic2(ctx, fn, i4, i4x1, i1);
-    add_intrinsic2(ctx, fn, i4, i4x2, i2);
-    add_intrinsic2(ctx, fn, i4, i4x3, i3);
-    add_intrinsic2(ctx, fn, i4, i4x4, i4);
-    add_intrinsic2(ctx, fn, f1, f1x1, f1);
-    add_intrinsic2(ctx, fn, f1, f1x2, f2);
-    add_intrinsic2(ctx, fn, f1, f1x3, f3);
-    add_intrinsic2(ctx, fn, f1, f1x4, f4);
-    add_intrinsic2(ctx, fn, f2, f2x1, f1);
-    add_intrinsic2(ctx, fn, f2, f2x2, f2);
-    add_intrinsic2(ctx, fn, f2, f2x3, f3);
-    add_intrinsic2(ctx, fn, f2, f2x4, f4);
-    add_intrinsic2(ctx, fn, f3, f3x1, f1);
-    add_intrinsic2(ctx, fn, f3, f3x2, f2);
-    add_intrinsic2(ctx, fn, f3, f3x3, f3);
-    add_intrinsic2(ctx, fn, f3, f3x4, f4);
-    add_intrinsic2(ctx, fn, f4, f4x1, f1);
-    add_intrinsic2(ctx, fn, f4, f4x2, f2);
-    add_intrinsic2(ctx, fn, f4, f4x3, f3);
-    add_intrinsic2(ctx, fn, f4, f4x4, f4);
+    add_intrinsic2(fn, i1, i1x1, i1);
+    add_intrinsic2(fn, i1, i1x2, i2);
+    add_intrinsic2(fn, i1, i1x3, i3);
+    add_intrinsic2(fn, i1, i1x4, i4);
+    add_intrinsic2(fn, i2, i2x1, i1);
+    add_intrinsic2(fn, i2, i2x2, i2);
+    add_intrinsic2(fn, i2, i2x3, i3);
+    add_intrinsic2(fn, i2, i2x4, i4);
+    add_intrinsic2(fn, i3, i3x1, i1);
+    add_intrinsic2(fn, i3, i3x2, i2);
+    add_intrinsic2(fn, i3, i3x3, i3);
+    add_intrinsic2(fn, i3, i3x4, i4);
+    add_intrinsic2(fn, i4, i4x1, i1);
+    add_intrinsic2(fn, i4, i4x2, i2);
+    add_intrinsic2(fn, i4, i4x3, i3);
+    add_intrinsic2(fn, i4, i4x4, i4);
+    add_intrinsic2(fn, f1, f1x1, f1);
+    add_intrinsic2(fn, f1, f1x2, f2);
+    add_intrinsic2(fn, f1, f1x3, f3);
+    add_intrinsic2(fn, f1, f1x4, f4);
+    add_intrinsic2(fn, f2, f2x1, f1);
+    add_intrinsic2(fn, f2, f2x2, f2);
+    add_intrinsic2(fn, f2, f2x3, f3);
+    add_intrinsic2(fn, f2, f2x4, f4);
+    add_intrinsic2(fn, f3, f3x1, f1);
+    add_intrinsic2(fn, f3, f3x2, f2);
+    add_intrinsic2(fn, f3, f3x3, f3);
+    add_intrinsic2(fn, f3, f3x4, f4);
+    add_intrinsic2(fn, f4, f4x1, f1);
+    add_intrinsic2(fn, f4, f4x2, f2);
+    add_intrinsic2(fn, f4, f4x3, f3);
+    add_intrinsic2(fn, f4, f4x4, f4);
 
     // matrix * matrix
-    add_intrinsic2(ctx, fn, i1x1, i1x1, i1x1);
-    add_intrinsic2(ctx, fn, i1x2, i1x1, i1x2);
-    add_intrinsic2(ctx, fn, i1x3, i1x1, i1x3);
-    add_intrinsic2(ctx, fn, i1x4, i1x1, i1x4);
-    add_intrinsic2(ctx, fn, i1x1, i1x2, i2x1);
-    add_intrinsic2(ctx, fn, i1x2, i1x2, i2x2);
-    add_intrinsic2(ctx, fn, i1x3, i1x2, i2x3);
-    add_intrinsic2(ctx, fn, i1x4, i1x2, i2x4);
-    add_intrinsic2(ctx, fn, i1x1, i1x3, i3x1);
-    add_intrinsic2(ctx, fn, i1x2, i1x3, i3x2);
-    add_intrinsic2(ctx, fn, i1x3, i1x3, i3x3);
-    add_intrinsic2(ctx, fn, i1x4, i1x3, i3x4);
-    add_intrinsic2(ctx, fn, i1x1, i1x4, i4x1);
-    add_intrinsic2(ctx, fn, i1x2, i1x4, i4x2);
-    add_intrinsic2(ctx, fn, i1x3, i1x4, i4x3);
-    add_intrinsic2(ctx, fn, i1x4, i1x4, i4x4);
-    add_intrinsic2(ctx, fn, i2x1, i2x1, i1x1);
-    add_intrinsic2(ctx, fn, i2x2, i2x1, i1x2);
-    add_intrinsic2(ctx, fn, i2x3, i2x1, i1x3);
-    add_intrinsic2(ctx, fn, i2x4, i2x1, i1x4);
-    add_intrinsic2(ctx, fn, i2x1, i2x2, i2x1);
-    add_intrinsic2(ctx, fn, i2x2, i2x2, i2x2);
-    add_intrinsic2(ctx, fn, i2x3, i2x2, i2x3);
-    add_intrinsic2(ctx, fn, i2x4, i2x2, i2x4);
-    add_intrinsic2(ctx, fn, i2x1, i2x3, i3x1);
-    add_intrinsic2(ctx, fn, i2x2, i2x3, i3x2);
-    add_intrinsic2(ctx, fn, i2x3, i2x3, i3x3);
-    add_intrinsic2(ctx, fn, i2x4, i2x3, i3x4);
-    add_intrinsic2(ctx, fn, i2x1, i2x4, i4x1);
-    add_intrinsic2(ctx, fn, i2x2, i2x4, i4x2);
-    add_intrinsic2(ctx, fn, i2x3, i2x4, i4x3);
-    add_intrinsic2(ctx, fn, i2x4, i2x4, i4x4);
-    add_intrinsic2(ctx, fn, i3x1, i3x1, i1x1);
-    add_intrinsic2(ctx, fn, i3x2, i3x1, i1x2);
-    add_intrinsic2(ctx, fn, i3x3, i3x1, i1x3);
-    add_intrinsic2(ctx, fn, i3x4, i3x1, i1x4);
-    add_intrinsic2(ctx, fn, i3x1, i3x2, i2x1);
-    add_intrinsic2(ctx, fn, i3x2, i3x2, i2x2);
-    add_intrinsic2(ctx, fn, i3x3, i3x2, i2x3);
-    add_intrinsic2(ctx, fn, i3x4, i3x2, i2x4);
-    add_intrinsic2(ctx, fn, i3x1, i3x3, i3x1);
-    add_intrinsic2(ctx, fn, i3x2, i3x3, i3x2);
-    add_intrinsic2(ctx, fn, i3x3, i3x3, i3x3);
-    add_intrinsic2(ctx, fn, i3x4, i3x3, i3x4);
-    add_intrinsic2(ctx, fn, i3x1, i3x4, i4x1);
-    add_intrinsic2(ctx, fn, i3x2, i3x4, i4x2);
-    add_intrinsic2(ctx, fn, i3x3, i3x4, i4x3);
-    add_intrinsic2(ctx, fn, i3x4, i3x4, i4x4);
-    add_intrinsic2(ctx, fn, i4x1, i4x1, i1x1);
-    add_intrinsic2(ctx, fn, i4x2, i4x1, i1x2);
-    add_intrinsic2(ctx, fn, i4x3, i4x1, i1x3);
-    add_intrinsic2(ctx, fn, i4x4, i4x1, i1x4);
-    add_intrinsic2(ctx, fn, i4x1, i4x2, i2x1);
-    add_intrinsic2(ctx, fn, i4x2, i4x2, i2x2);
-    add_intrinsic2(ctx, fn, i4x3, i4x2, i2x3);
-    add_intrinsic2(ctx, fn, i4x4, i4x2, i2x4);
-    add_intrinsic2(ctx, fn, i4x1, i4x3, i3x1);
-    add_intrinsic2(ctx, fn, i4x2, i4x3, i3x2);
-    add_intrinsic2(ctx, fn, i4x3, i4x3, i3x3);
-    add_intrinsic2(ctx, fn, i4x4, i4x3, i3x4);
-    add_intrinsic2(ctx, fn, i4x1, i4x4, i4x1);
-    add_intrinsic2(ctx, fn, i4x2, i4x4, i4x2);
-    add_intrinsic2(ctx, fn, i4x3, i4x4, i4x3);
-    add_intrinsic2(ctx, fn, i4x4, i4x4, i4x4);
-    add_intrinsic2(ctx, fn, f1x1, f1x1, f1x1);
-    add_intrinsic2(ctx, fn, f1x2, f1x1, f1x2);
-    add_intrinsic2(ctx, fn, f1x3, f1x1, f1x3);
-    add_intrinsic2(ctx, fn, f1x4, f1x1, f1x4);
-    add_intrinsic2(ctx, fn, f1x1, f1x2, f2x1);
-    add_intrinsic2(ctx, fn, f1x2, f1x2, f2x2);
-    add_intrinsic2(ctx, fn, f1x3, f1x2, f2x3);
-    add_intrinsic2(ctx, fn, f1x4, f1x2, f2x4);
-    add_intrinsic2(ctx, fn, f1x1, f1x3, f3x1);
-    add_intrinsic2(ctx, fn, f1x2, f1x3, f3x2);
-    add_intrinsic2(ctx, fn, f1x3, f1x3, f3x3);
-    add_intrinsic2(ctx, fn, f1x4, f1x3, f3x4);
-    add_intrinsic2(ctx, fn, f1x1, f1x4, f4x1);
-    add_intrinsic2(ctx, fn, f1x2, f1x4, f4x2);
-    add_intrinsic2(ctx, fn, f1x3, f1x4, f4x3);
-    add_intrinsic2(ctx, fn, f1x4, f1x4, f4x4);
-    add_intrinsic2(ctx, fn, f2x1, f2x1, f1x1);
-    add_intrinsic2(ctx, fn, f2x2, f2x1, f1x2);
-    add_intrinsic2(ctx, fn, f2x3, f2x1, f1x3);
-    add_intrinsic2(ctx, fn, f2x4, f2x1, f1x4);
-    add_intrinsic2(ctx, fn, f2x1, f2x2, f2x1);
-    add_intrinsic2(ctx, fn, f2x2, f2x2, f2x2);
-    add_intrinsic2(ctx, fn, f2x3, f2x2, f2x3);
-    add_intrinsic2(ctx, fn, f2x4, f2x2, f2x4);
-    add_intrinsic2(ctx, fn, f2x1, f2x3, f3x1);
-    add_intrinsic2(ctx, fn, f2x2, f2x3, f3x2);
-    add_intrinsic2(ctx, fn, f2x3, f2x3, f3x3);
-    add_intrinsic2(ctx, fn, f2x4, f2x3, f3x4);
-    add_intrinsic2(ctx, fn, f2x1, f2x4, f4x1);
-    add_intrinsic2(ctx, fn, f2x2, f2x4, f4x2);
-    add_intrinsic2(ctx, fn, f2x3, f2x4, f4x3);
-    add_intrinsic2(ctx, fn, f2x4, f2x4, f4x4);
-    add_intrinsic2(ctx, fn, f3x1, f3x1, f1x1);
-    add_intrinsic2(ctx, fn, f3x2, f3x1, f1x2);
-    add_intrinsic2(ctx, fn, f3x3, f3x1, f1x3);
-    add_intrinsic2(ctx, fn, f3x4, f3x1, f1x4);
-    add_intrinsic2(ctx, fn, f3x1, f3x2, f2x1);
-    add_intrinsic2(ctx, fn, f3x2, f3x2, f2x2);
-    add_intrinsic2(ctx, fn, f3x3, f3x2, f2x3);
-    add_intrinsic2(ctx, fn, f3x4, f3x2, f2x4);
-    add_intrinsic2(ctx, fn, f3x1, f3x3, f3x1);
-    add_intrinsic2(ctx, fn, f3x2, f3x3, f3x2);
-    add_intrinsic2(ctx, fn, f3x3, f3x3, f3x3);
-    add_intrinsic2(ctx, fn, f3x4, f3x3, f3x4);
-    add_intrinsic2(ctx, fn, f3x1, f3x4, f4x1);
-    add_intrinsic2(ctx, fn, f3x2, f3x4, f4x2);
-    add_intrinsic2(ctx, fn, f3x3, f3x4, f4x3);
-    add_intrinsic2(ctx, fn, f3x4, f3x4, f4x4);
-    add_intrinsic2(ctx, fn, f4x1, f4x1, f1x1);
-    add_intrinsic2(ctx, fn, f4x2, f4x1, f1x2);
-    add_intrinsic2(ctx, fn, f4x3, f4x1, f1x3);
-    add_intrinsic2(ctx, fn, f4x4, f4x1, f1x4);
-    add_intrinsic2(ctx, fn, f4x1, f4x2, f2x1);
-    add_intrinsic2(ctx, fn, f4x2, f4x2, f2x2);
-    add_intrinsic2(ctx, fn, f4x3, f4x2, f2x3);
-    add_intrinsic2(ctx, fn, f4x4, f4x2, f2x4);
-    add_intrinsic2(ctx, fn, f4x1, f4x3, f3x1);
-    add_intrinsic2(ctx, fn, f4x2, f4x3, f3x2);
-    add_intrinsic2(ctx, fn, f4x3, f4x3, f3x3);
-    add_intrinsic2(ctx, fn, f4x4, f4x3, f3x4);
-    add_intrinsic2(ctx, fn, f4x1, f4x4, f4x1);
-    add_intrinsic2(ctx, fn, f4x2, f4x4, f4x2);
-    add_intrinsic2(ctx, fn, f4x3, f4x4, f4x3);
-    add_intrinsic2(ctx, fn, f4x4, f4x4, f4x4);
+    add_intrinsic2(fn, i1x1, i1x1, i1x1);
+    add_intrinsic2(fn, i1x2, i1x1, i1x2);
+    add_intrinsic2(fn, i1x3, i1x1, i1x3);
+    add_intrinsic2(fn, i1x4, i1x1, i1x4);
+    add_intrinsic2(fn, i1x1, i1x2, i2x1);
+    add_intrinsic2(fn, i1x2, i1x2, i2x2);
+    add_intrinsic2(fn, i1x3, i1x2, i2x3);
+    add_intrinsic2(fn, i1x4, i1x2, i2x4);
+    add_intrinsic2(fn, i1x1, i1x3, i3x1);
+    add_intrinsic2(fn, i1x2, i1x3, i3x2);
+    add_intrinsic2(fn, i1x3, i1x3, i3x3);
+    add_intrinsic2(fn, i1x4, i1x3, i3x4);
+    add_intrinsic2(fn, i1x1, i1x4, i4x1);
+    add_intrinsic2(fn, i1x2, i1x4, i4x2);
+    add_intrinsic2(fn, i1x3, i1x4, i4x3);
+    add_intrinsic2(fn, i1x4, i1x4, i4x4);
+    add_intrinsic2(fn, i2x1, i2x1, i1x1);
+    add_intrinsic2(fn, i2x2, i2x1, i1x2);
+    add_intrinsic2(fn, i2x3, i2x1, i1x3);
+    add_intrinsic2(fn, i2x4, i2x1, i1x4);
+    add_intrinsic2(fn, i2x1, i2x2, i2x1);
+    add_intrinsic2(fn, i2x2, i2x2, i2x2);
+    add_intrinsic2(fn, i2x3, i2x2, i2x3);
+    add_intrinsic2(fn, i2x4, i2x2, i2x4);
+    add_intrinsic2(fn, i2x1, i2x3, i3x1);
+    add_intrinsic2(fn, i2x2, i2x3, i3x2);
+    add_intrinsic2(fn, i2x3, i2x3, i3x3);
+    add_intrinsic2(fn, i2x4, i2x3, i3x4);
+    add_intrinsic2(fn, i2x1, i2x4, i4x1);
+    add_intrinsic2(fn, i2x2, i2x4, i4x2);
+    add_intrinsic2(fn, i2x3, i2x4, i4x3);
+    add_intrinsic2(fn, i2x4, i2x4, i4x4);
+    add_intrinsic2(fn, i3x1, i3x1, i1x1);
+    add_intrinsic2(fn, i3x2, i3x1, i1x2);
+    add_intrinsic2(fn, i3x3, i3x1, i1x3);
+    add_intrinsic2(fn, i3x4, i3x1, i1x4);
+    add_intrinsic2(fn, i3x1, i3x2, i2x1);
+    add_intrinsic2(fn, i3x2, i3x2, i2x2);
+    add_intrinsic2(fn, i3x3, i3x2, i2x3);
+    add_intrinsic2(fn, i3x4, i3x2, i2x4);
+    add_intrinsic2(fn, i3x1, i3x3, i3x1);
+    add_intrinsic2(fn, i3x2, i3x3, i3x2);
+    add_intrinsic2(fn, i3x3, i3x3, i3x3);
+    add_intrinsic2(fn, i3x4, i3x3, i3x4);
+    add_intrinsic2(fn, i3x1, i3x4, i4x1);
+    add_intrinsic2(fn, i3x2, i3x4, i4x2);
+    add_intrinsic2(fn, i3x3, i3x4, i4x3);
+    add_intrinsic2(fn, i3x4, i3x4, i4x4);
+    add_intrinsic2(fn, i4x1, i4x1, i1x1);
+    add_intrinsic2(fn, i4x2, i4x1, i1x2);
+    add_intrinsic2(fn, i4x3, i4x1, i1x3);
+    add_intrinsic2(fn, i4x4, i4x1, i1x4);
+    add_intrinsic2(fn, i4x1, i4x2, i2x1);
+    add_intrinsic2(fn, i4x2, i4x2, i2x2);
+    add_intrinsic2(fn, i4x3, i4x2, i2x3);
+    add_intrinsic2(fn, i4x4, i4x2, i2x4);
+    add_intrinsic2(fn, i4x1, i4x3, i3x1);
+    add_intrinsic2(fn, i4x2, i4x3, i3x2);
+    add_intrinsic2(fn, i4x3, i4x3, i3x3);
+    add_intrinsic2(fn, i4x4, i4x3, i3x4);
+    add_intrinsic2(fn, i4x1, i4x4, i4x1);
+    add_intrinsic2(fn, i4x2, i4x4, i4x2);
+    add_intrinsic2(fn, i4x3, i4x4, i4x3);
+    add_intrinsic2(fn, i4x4, i4x4, i4x4);
+    add_intrinsic2(fn, f1x1, f1x1, f1x1);
+    add_intrinsic2(fn, f1x2, f1x1, f1x2);
+    add_intrinsic2(fn, f1x3, f1x1, f1x3);
+    add_intrinsic2(fn, f1x4, f1x1, f1x4);
+    add_intrinsic2(fn, f1x1, f1x2, f2x1);
+    add_intrinsic2(fn, f1x2, f1x2, f2x2);
+    add_intrinsic2(fn, f1x3, f1x2, f2x3);
+    add_intrinsic2(fn, f1x4, f1x2, f2x4);
+    add_intrinsic2(fn, f1x1, f1x3, f3x1);
+    add_intrinsic2(fn, f1x2, f1x3, f3x2);
+    add_intrinsic2(fn, f1x3, f1x3, f3x3);
+    add_intrinsic2(fn, f1x4, f1x3, f3x4);
+    add_intrinsic2(fn, f1x1, f1x4, f4x1);
+    add_intrinsic2(fn, f1x2, f1x4, f4x2);
+    add_intrinsic2(fn, f1x3, f1x4, f4x3);
+    add_intrinsic2(fn, f1x4, f1x4, f4x4);
+    add_intrinsic2(fn, f2x1, f2x1, f1x1);
+    add_intrinsic2(fn, f2x2, f2x1, f1x2);
+    add_intrinsic2(fn, f2x3, f2x1, f1x3);
+    add_intrinsic2(fn, f2x4, f2x1, f1x4);
+    add_intrinsic2(fn, f2x1, f2x2, f2x1);
+    add_intrinsic2(fn, f2x2, f2x2, f2x2);
+    add_intrinsic2(fn, f2x3, f2x2, f2x3);
+    add_intrinsic2(fn, f2x4, f2x2, f2x4);
+    add_intrinsic2(fn, f2x1, f2x3, f3x1);
+    add_intrinsic2(fn, f2x2, f2x3, f3x2);
+    add_intrinsic2(fn, f2x3, f2x3, f3x3);
+    add_intrinsic2(fn, f2x4, f2x3, f3x4);
+    add_intrinsic2(fn, f2x1, f2x4, f4x1);
+    add_intrinsic2(fn, f2x2, f2x4, f4x2);
+    add_intrinsic2(fn, f2x3, f2x4, f4x3);
+    add_intrinsic2(fn, f2x4, f2x4, f4x4);
+    add_intrinsic2(fn, f3x1, f3x1, f1x1);
+    add_intrinsic2(fn, f3x2, f3x1, f1x2);
+    add_intrinsic2(fn, f3x3, f3x1, f1x3);
+    add_intrinsic2(fn, f3x4, f3x1, f1x4);
+    add_intrinsic2(fn, f3x1, f3x2, f2x1);
+    add_intrinsic2(fn, f3x2, f3x2, f2x2);
+    add_intrinsic2(fn, f3x3, f3x2, f2x3);
+    add_intrinsic2(fn, f3x4, f3x2, f2x4);
+    add_intrinsic2(fn, f3x1, f3x3, f3x1);
+    add_intrinsic2(fn, f3x2, f3x3, f3x2);
+    add_intrinsic2(fn, f3x3, f3x3, f3x3);
+    add_intrinsic2(fn, f3x4, f3x3, f3x4);
+    add_intrinsic2(fn, f3x1, f3x4, f4x1);
+    add_intrinsic2(fn, f3x2, f3x4, f4x2);
+    add_intrinsic2(fn, f3x3, f3x4, f4x3);
+    add_intrinsic2(fn, f3x4, f3x4, f4x4);
+    add_intrinsic2(fn, f4x1, f4x1, f1x1);
+    add_intrinsic2(fn, f4x2, f4x1, f1x2);
+    add_intrinsic2(fn, f4x3, f4x1, f1x3);
+    add_intrinsic2(fn, f4x4, f4x1, f1x4);
+    add_intrinsic2(fn, f4x1, f4x2, f2x1);
+    add_intrinsic2(fn, f4x2, f4x2, f2x2);
+    add_intrinsic2(fn, f4x3, f4x2, f2x3);
+    add_intrinsic2(fn, f4x4, f4x2, f2x4);
+    add_intrinsic2(fn, f4x1, f4x3, f3x1);
+    add_intrinsic2(fn, f4x2, f4x3, f3x2);
+    add_intrinsic2(fn, f4x3, f4x3, f3x3);
+    add_intrinsic2(fn, f4x4, f4x3, f3x4);
+    add_intrinsic2(fn, f4x1, f4x4, f4x1);
+    add_intrinsic2(fn, f4x2, f4x4, f4x2);
+    add_intrinsic2(fn, f4x3, f4x4, f4x3);
+    add_intrinsic2(fn, f4x4, f4x4, f4x4);
 } // add_intrinsic_mul
 
-static void init_builtins(Context *ctx)
-{
+static int cmp_by_arity(const void *_a, const void *_b)
+{
+    const Intrinsic *a = *((const Intrinsic **) _a);
+    const Intrinsic *b = *((const Intrinsic **) _b);
+    const int retval = cmp_overload_key(a, b->name,
+                                        b->datatype.function.num_params, -1);
+    return (retval != 0) ? retval : (a->index - b->index);  // newest first.
+} // cmp_by_arity
+
+static int cmp_by_lead(const void *_a, const void *_b)
+{
+    const Intrinsic *a = *((const Intrinsic **) _a);
+    const Intrinsic *b = *((const Intrinsic **) _b);
+    const int retval = cmp_overload_key(a, b->name,
+                                        b->datatype.function.num_params,
+                                        b->lead);
+    return (retval != 0) ? retval : (a->index - b->index);  // newest first.
+} // cmp_by_lead
+
+static void init_builtin_usertype(MOJOSHADER_astDataType *userdt,
+                                  const char *name,
+                                  const MOJOSHADER_astDataType *dt)
+{
+    userdt->type = MOJOSHADER_AST_DATATYPE_USER;
+    userdt->user.details = dt;
+    userdt->user.name = name;
+} // init_builtin_usertype
+
+static int build_builtins(void)
+{
+    builtins.dt_none.type = MOJOSHADER_AST_DATATYPE_NONE;
+    builtins.dt_bool.type = MOJOSHADER_AST_DATATYPE_BOOL;
+    builtins.dt_int.type = MOJOSHADER_AST_DATATYPE_INT;
+    builtins.dt_uint.type = MOJOSHADER_AST_DATATYPE_UINT;
+    builtins.dt_float.type = MOJOSHADER_AST_DATATYPE_FLOAT;
+    builtins.dt_float_snorm.type = MOJOSHADER_AST_DATATYPE_FLOAT_SNORM;
+    builtins.dt_float_unorm.type = MOJOSHADER_AST_DATATYPE_FLOAT_UNORM;
+    builtins.dt_half.type = MOJOSHADER_AST_DATATYPE_HALF;
+    builtins.dt_double.type = MOJOSHADER_AST_DATATYPE_DOUBLE;
+    builtins.dt_string.type = MOJOSHADER_AST_DATATYPE_STRING;
+    builtins.dt_sampler1d.type = MOJOSHADER_AST_DATATYPE_SAMPLER_1D;
+    builtins.dt_sampler2d.type = MOJOSHADER_AST_DATATYPE_SAMPLER_2D;
+    builtins.dt_sampler3d.type = MOJOSHADER_AST_DATATYPE_SAMPLER_3D;
+    builtins.dt_samplercube.type = MOJOSHADER_AST_DATATYPE_SAMPLER_CUBE;
+    builtins.dt_samplerstate.type = MOJOSHADER_AST_DATATYPE_SAMPLER_STATE;
+    builtins.dt_samplercompstate.type = MOJOSHADER_AST_DATATYPE_SAMPLER_COMPARISON_STATE;
+
+    #define INIT_DT_BUFFER(t) \
+        builtins.dt_buf_##t.type = MOJOSHADER_AST_DATATYPE_BUFFER; \
+        builtins.dt_buf_##t.buffer.base = &builtins.dt_##t;
+    INIT_DT_BUFFER(bool);
+    INIT_DT_BUFFER(int);
+    INIT_DT_BUFFER(uint);
+    INIT_DT_BUFFER(half);
+    INIT_DT_BUFFER(float);
+    INIT_DT_BUFFER(double);
+    INIT_DT_BUFFER(float_snorm);
+    INIT_DT_BUFFER(float_unorm);
+    #undef INIT_DT_BUFFER
+
     // add in standard typedefs...
-    const struct
-    {
-        const char *str;
-        const MOJOSHADER_astDataType *datatype;
-    } types[] = {
-        { "bool", &ctx->dt_bool },
-        { "int", &ctx->dt_int },
-        { "uint", &ctx->dt_uint },
-        { "half", &ctx->dt_half },
-        { "float", &ctx->dt_float },
-        { "double", &ctx->dt_double },
+    const MOJOSHADER_astDataType *scalars[] = {  // same order as the names.
+        &builtins.dt_bool, &builtins.dt_int, &builtins.dt_uint,
+        &builtins.dt_half, &builtins.dt_float, &builtins.dt_double
     };
 
     int i, j, k;
-    for (i = 0; i < STATICARRAYLEN(types); i++)
+    for (i = 0; i < (int) STATICARRAYLEN(scalars); i++)
     {
-        char buf[32];
-        int len;
-        const MOJOSHADER_astDataType *dt;
-
-        for (j = 1; j <= 4; j++)
+        const char *str = builtin_scalar_names[i];
+        for (j = 0; j < 4; j++)
         {
             // "float2"
-            dt = new_datatype_vector(ctx, types[i].datatype, j);
-            len = snprintf(buf, sizeof (buf), "%s%d", types[i].str, j);
-            push_usertype(ctx, stringcache_len(ctx->strcache, buf, len), dt);
-            for (k = 1; k <= 4; k++)
+            MOJOSHADER_astDataType *dt = &builtins.vectors[i][j];
+            char *name = builtins.usertype_names[i][j];
+            dt->type = MOJOSHADER_AST_DATATYPE_VECTOR;
+            dt->vector.base = scalars[i];
+            dt->vector.elements = j + 1;
+            snprintf(name, sizeof (builtins.usertype_names[i][j]), "%s%d",
+                     str, j + 1);
+            init_builtin_usertype(&builtins.usertypes[i][j], name, dt);
+            for (k = 0; k < 4; k++)
             {
                 // "float2x2"
-                dt = new_datatype_matrix(ctx, types[i].datatype, j, k);
-                len = snprintf(buf, sizeof (buf), "%s%dx%d", types[i].str,j,k);
-                push_usertype(ctx, stringcache_len(ctx->strcache,buf,len), dt);
+                const int idx = 4 + (j * 4) + k;
+                dt = &builtins.matrices[i][j][k];
+                name = builtins.usertype_names[i][idx];
+                dt->type = MOJOSHADER_AST_DATATYPE_MATRIX;
+                dt->matrix.base = scalars[i];
+                dt->matrix.rows = j + 1;
+                dt->matrix.columns = k + 1;
+                snprintf(name, sizeof (builtins.usertype_names[i][idx]),
+                         "%s%dx%d", str, j + 1, k + 1);
+                init_builtin_usertype(&builtins.usertypes[i][idx], name, dt);
             } // for
         } // for
     } // for
@@ -4284,101 +4317,119 @@ static void init_builtins(Context *ctx)
     const int shader_model = 3;
     if (shader_model >= 1)
     {
-        add_intrinsic_SAME1_ANYfi(ctx, stringcache(ctx->strcache, "abs"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "acos"));
-        add_intrinsic_BOOL_ANYfib(ctx, stringcache(ctx->strcache, "all"));
-        add_intrinsic_BOOL_ANYfib(ctx, stringcache(ctx->strcache, "any"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "asin"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "atan"));
-        add_intrinsic_SAME1_ANYf_SAME1(ctx, stringcache(ctx->strcache, "atan2"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "ceil"));
-        add_intrinsic_SAME1_ANYfi_SAME1_SAME1(ctx, stringcache(ctx->strcache, "clamp"));
-        add_intrinsic_VOID_ANYf(ctx, stringcache(ctx->strcache, "clip"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "cos"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "cosh"));
-        add_intrinsic_3f_3f_3f(ctx, stringcache(ctx->strcache, "cross"));
-        add_intrinsic_4i_4f(ctx, stringcache(ctx->strcache, "D3DCOLORtoUBYTE4"));
-        add_intrinsic_f_Vf_SAME1(ctx, stringcache(ctx->strcache, "distance"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "degrees"));
-        add_intrinsic_f_SQUAREMATRIXf(ctx, stringcache(ctx->strcache, "determinant"));
-        add_intrinsic_fi_Vfi_SAME1(ctx, stringcache(ctx->strcache, "dot"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "exp"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "exp2"));
-        add_intrinsic_SAME1_Vf_SAME1_SAME1(ctx, stringcache(ctx->strcache, "faceforward"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "floor"));
-        add_intrinsic_SAME1_ANYf_SAME1(ctx, stringcache(ctx->strcache, "fmod"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "frac"));
-        add_intrinsic_BOOL_ANYf(ctx, stringcache(ctx->strcache, "isfinite"));
-        add_intrinsic_BOOL_ANYf(ctx, stringcache(ctx->strcache, "isinf"));
-        add_intrinsic_BOOL_ANYf(ctx, stringcache(ctx->strcache, "isnan"));
-        add_intrinsic_SAME1_ANYf_SAME1(ctx, stringcache(ctx->strcache, "ldexp"));
-        add_intrinsic_f_Vf(ctx, stringcache(ctx->strcache, "length"));
-        add_intrinsic_SAME1_ANYf_SAME1_SAME1(ctx, stringcache(ctx->strcache, "lerp"));
-        add_intrinsic_4f_f_f_f(ctx, stringcache(ctx->strcache, "lit"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "log"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "log10"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "log2"));
-        add_intrinsic_SAME1_ANYfi_SAME1(ctx, stringcache(ctx->strcache, "max"));
-        add_intrinsic_SAME1_ANYfi_SAME1(ctx, stringcache(ctx->strcache, "min"));
-        add_intrinsic_SAME1_ANYfi_SAME1(ctx, stringcache(ctx->strcache, "modf"));  // !!! FIXME: out var?
-        add_intrinsic_mul(ctx, stringcache(ctx->strcache, "mul"));
-        add_intrinsic_f_Vf(ctx, stringcache(ctx->strcache, "noise"));
-        add_intrinsic_SAME1_Vf(ctx, stringcache(ctx->strcache, "normalize"));
-        add_intrinsic_SAME1_ANYf_SAME1(ctx, stringcache(ctx->strcache, "pow"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "radians"));
-        add_intrinsic_SAME1_ANYfi_SAME1(ctx, stringcache(ctx->strcache, "reflect"));
-        add_intrinsic_SAME1_Vf_SAME1_f(ctx, stringcache(ctx->strcache, "refract"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "round"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "rsqrt"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "saturate"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "sign"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "sin"));
-        add_intrinsic_VOID_ANYf_SAME1_SAME1(ctx, stringcache(ctx->strcache, "sincos"));  // !!! FIXME: out var?
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "sinh"));
-        add_intrinsic_SAME1_ANYf_SAME1_SAME1(ctx, stringcache(ctx->strcache, "smoothstep"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "sqrt"));
-        add_intrinsic_SAME1_ANYf_SAME1(ctx, stringcache(ctx->strcache, "step"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "tan"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "tanh"));
-        add_intrinsic_4f_s1_f(ctx, stringcache(ctx->strcache, "tex1D"));
-        add_intrinsic_4f_s2_2f(ctx, stringcache(ctx->strcache, "tex2D"));
-        add_intrinsic_4f_s3_3f(ctx, stringcache(ctx->strcache, "tex3D"));
-        add_intrinsic_4f_sc_3f(ctx, stringcache(ctx->strcache, "texCUBE"));
-        add_intrinsic_SAME1_Mfib(ctx, stringcache(ctx->strcache, "transpose"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "trunc"));
+        add_intrinsic_SAME1_ANYfi("abs");
+        add_intrinsic_SAME1_ANYf("acos");
+        add_intrinsic_BOOL_ANYfib("all");
+        add_intrinsic_BOOL_ANYfib("any");
+        add_intrinsic_SAME1_ANYf("asin");
+        add_intrinsic_SAME1_ANYf("atan");
+        add_intrinsic_SAME1_ANYf_SAME1("atan2");
+        add_intrinsic_SAME1_ANYf("ceil");
+        add_intrinsic_SAME1_ANYfi_SAME1_SAME1("clamp");
+        add_intrinsic_VOID_ANYf("clip");
+        add_intrinsic_SAME1_ANYf("cos");
+        add_intrinsic_SAME1_ANYf("cosh");
+        add_intrinsic_3f_3f_3f("cross");
+        add_intrinsic_4i_4f("D3DCOLORtoUBYTE4");
+        add_intrinsic_f_Vf_SAME1("distance");
+        add_intrinsic_SAME1_ANYf("degrees");
+        add_intrinsic_f_SQUAREMATRIXf("determinant");
+        add_intrinsic_fi_Vfi_SAME1("dot");
+        add_intrinsic_SAME1_ANYf("exp");
+        add_intrinsic_SAME1_ANYf("exp2");
+        add_intrinsic_SAME1_Vf_SAME1_SAME1("faceforward");
+        add_intrinsic_SAME1_ANYf("floor");
+        add_intrinsic_SAME1_ANYf_SAME1("fmod");
+        add_intrinsic_SAME1_ANYf("frac");
+        add_intrinsic_BOOL_ANYf("isfinite");
+        add_intrinsic_BOOL_ANYf("isinf");
+        add_intrinsic_BOOL_ANYf("isnan");
+        add_intrinsic_SAME1_ANYf_SAME1("ldexp");
+        add_intrinsic_f_Vf("length");
+        add_intrinsic_SAME1_ANYf_SAME1_SAME1("lerp");
+        add_intrinsic_4f_f_f_f("lit");
+        add_intrinsic_SAME1_ANYf("log");
+        add_intrinsic_SAME1_ANYf("log10");
+        add_intrinsic_SAME1_ANYf("log2");
+        add_intrinsic_SAME1_ANYfi_SAME1("max");
+        add_intrinsic_SAME1_ANYfi_SAME1("min");
+        add_intrinsic_SAME1_ANYfi_SAME1("modf");  // !!! FIXME: out var?
+        add_intrinsic_mul("mul");
+        add_intrinsic_f_Vf("noise");
+        add_intrinsic_SAME1_Vf("normalize");
+        add_intrinsic_SAME1_ANYf_SAME1("pow");
+        add_intrinsic_SAME1_ANYf("radians");
+        add_intrinsic_SAME1_ANYfi_SAME1("reflect");
+        add_intrinsic_SAME1_Vf_SAME1_f("refract");
+        add_intrinsic_SAME1_ANYf("round");
+        add_intrinsic_SAME1_ANYf("rsqrt");
+        add_intrinsic_SAME1_ANYf("saturate");
+        add_intrinsic_SAME1_ANYf("sign");
+        add_intrinsic_SAME1_ANYf("sin");
+        add_intrinsic_VOID_ANYf_SAME1_SAME1("sincos");  // !!! FIXME: out var?
+        add_intrinsic_SAME1_ANYf("sinh");
+        add_intrinsic_SAME1_ANYf_SAME1_SAME1("smoothstep");
+        add_intrinsic_SAME1_ANYf("sqrt");
+        add_intrinsic_SAME1_ANYf_SAME1("step");
+        add_intrinsic_SAME1_ANYf("tan");
+        add_intrinsic_SAME1_ANYf("tanh");
+        add_intrinsic_4f_s1_f("tex1D");
+        add_intrinsic_4f_s2_2f("tex2D");
+        add_intrinsic_4f_s3_3f("tex3D");
+        add_intrinsic_4f_sc_3f("texCUBE");
+        add_intrinsic_SAME1_Mfib("transpose");
+        add_intrinsic_SAME1_ANYf("trunc");
     } // if
 
     if (shader_model >= 2)
     {
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "ddx"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "ddy"));
-        add_intrinsic_SAME1_ANYf_SAME1(ctx, stringcache(ctx->strcache, "frexp"));
-        add_intrinsic_SAME1_ANYf(ctx, stringcache(ctx->strcache, "fwidth"));
-        add_intrinsic_4f_s1_f_f_f(ctx, stringcache(ctx->strcache, "tex1D"));
-        add_intrinsic_4f_s1_4f(ctx, stringcache(ctx->strcache, "tex1Dbias"));
-        add_intrinsic_4f_s1_f_f_f(ctx, stringcache(ctx->strcache, "tex1Dgrad"));
-        add_intrinsic_4f_s1_4f(ctx, stringcache(ctx->strcache, "tex1Dproj"));
-        add_intrinsic_4f_s2_2f_2f_2f(ctx, stringcache(ctx->strcache, "tex2D"));
-        add_intrinsic_4f_s2_4f(ctx, stringcache(ctx->strcache, "tex2Dbias"));
-        add_intrinsic_4f_s2_2f_2f_2f(ctx, stringcache(ctx->strcache, "tex2Dgrad"));
-        add_intrinsic_4f_s2_4f(ctx, stringcache(ctx->strcache, "tex2Dproj"));
-        add_intrinsic_4f_s3_3f_3f_3f(ctx, stringcache(ctx->strcache, "tex3D"));
-        add_intrinsic_4f_s3_4f(ctx, stringcache(ctx->strcache, "tex3Dbias"));
-        add_intrinsic_4f_s3_3f_3f_3f(ctx, stringcache(ctx->strcache, "tex3Dgrad"));
-        add_intrinsic_4f_s3_4f(ctx, stringcache(ctx->strcache, "tex3Dproj"));
-        add_intrinsic_4f_sc_3f_3f_3f(ctx, stringcache(ctx->strcache, "texCUBE"));
-        add_intrinsic_4f_sc_4f(ctx, stringcache(ctx->strcache, "texCUBEbias"));
-        add_intrinsic_4f_sc_3f_3f_3f(ctx, stringcache(ctx->strcache, "texCUBEgrad"));
-        add_intrinsic_4f_sc_4f(ctx, stringcache(ctx->strcache, "texCUBEproj"));
+        add_intrinsic_SAME1_ANYf("ddx");
+        add_intrinsic_SAME1_ANYf("ddy");
+        add_intrinsic_SAME1_ANYf_SAME1("frexp");
+        add_intrinsic_SAME1_ANYf("fwidth");
+        add_intrinsic_4f_s1_f_f_f("tex1D");
+        add_intrinsic_4f_s1_4f("tex1Dbias");
+        add_intrinsic_4f_s1_f_f_f("tex1Dgrad");
+        add_intrinsic_4f_s1_4f("tex1Dproj");
+        add_intrinsic_4f_s2_2f_2f_2f("tex2D");
+        add_intrinsic_4f_s2_4f("tex2Dbias");
+        add_intrinsic_4f_s2_2f_2f_2f("tex2Dgrad");
+        add_intrinsic_4f_s2_4f("tex2Dproj");
+        add_intrinsic_4f_s3_3f_3f_3f("tex3D");
+        add_intrinsic_4f_s3_4f("tex3Dbias");
+        add_intrinsic_4f_s3_3f_3f_3f("tex3Dgrad");
+        add_intrinsic_4f_s3_4f("tex3Dproj");
+        add_intrinsic_4f_sc_3f_3f_3f("texCUBE");
+        add_intrinsic_4f_sc_4f("texCUBEbias");
+        add_intrinsic_4f_sc_3f_3f_3f("texCUBEgrad");
+        add_intrinsic_4f_sc_4f("texCUBEproj");
     } // if
 
     if (shader_model >= 3)
     {
-        add_intrinsic_4f_s1_4f(ctx, stringcache(ctx->strcache, "tex1Dlod"));
-        add_intrinsic_4f_s2_4f(ctx, stringcache(ctx->strcache, "tex2Dlod"));
-        add_intrinsic_4f_s3_4f(ctx, stringcache(ctx->strcache, "tex3Dlod"));
-        add_intrinsic_4f_sc_4f(ctx, stringcache(ctx->strcache, "texCUBElod"));
+        add_intrinsic_4f_s1_4f("tex1Dlod");
+        add_intrinsic_4f_s2_4f("tex2Dlod");
+        add_intrinsic_4f_s3_4f("tex3Dlod");
+        add_intrinsic_4f_sc_4f("texCUBElod");
     } // if
+
+    // sort so lookups can binary search for the overloads they want.
+    for (i = 0; i < builtins.intrinsic_count; i++)
+        builtins.by_arity[i] = builtins.by_lead[i] = &builtins.intrinsics[i];
+    qsort(builtins.by_arity, builtins.intrinsic_count,
+          sizeof (builtins.by_arity[0]), cmp_by_arity);
+    qsort(builtins.by_lead, builtins.intrinsic_count,
+          sizeof (builtins.by_lead[0]), cmp_by_lead);
+
+    return 1;
+} // build_builtins
+
+static void init_builtins(void)
+{
+    // C++ guarantees this only runs once, even if two threads get here at
+    //  the same time, and that the other thread waits until it's done.
+    static const int built = build_builtins();
+    (void) built;
 } // init_builtins
 
 
@@ -4388,7 +4439,8 @@ static void parse_source(Context *ctx, const char *filename,
                          const MOJOSHADER_preprocessorDefine *defines,
                          unsigned int define_count,
                          MOJOSHADER_includeOpen include_open,
-                         MOJOSHADER_includeClose include_close)
+                         MOJOSHADER_includeClose include_close,
+                         MOJOSHADER_includeCache *include_cache)
 {
     TokenData data;
     unsigned int tokenlen;
@@ -4403,8 +4455,8 @@ static void parse_source(Context *ctx, const char *filename,
     if (!include_close) include_close = MOJOSHADER_internal_include_close;
 
     pp = preprocessor_start(filename, source, sourcelen, include_open,
-                            include_close, defines, define_count, 0,
-                            MallocBridge, FreeBridge, ctx);
+                            include_close, include_cache, defines,
+                            define_count, 0, MallocBridge, FreeBridge, ctx);
     if (pp == NULL)
     {
         assert(ctx->out_of_memory);  // shouldn't fail for any other reason.
@@ -4421,9 +4473,10 @@ static void parse_source(Context *ctx, const char *filename,
 
     // !!! FIXME: check if (parser == NULL)...
 
-    init_builtins(ctx);
+    init_builtins();
 
-    SymbolScope *start_scope = ctx->usertypes.scope;
+    const int start_symbols = ctx->usertypes.symbol_count;
+    const int start_scopes = ctx->usertypes.scope_count;
 
     #if DEBUG_COMPILER_PARSER
     ParseHLSLTrace(stdout, "COMPILER: ");
@@ -4516,8 +4569,8 @@ static void parse_source(Context *ctx, const char *filename,
     } while (tokenval != TOKEN_EOI);
 
     // Clean out extra usertypes; they are dummies until semantic analysis.
-    while (ctx->usertypes.scope != start_scope)
-        pop_symbol(ctx, &ctx->usertypes);
+    pop_symbols(&ctx->usertypes, start_symbols);
+    ctx->usertypes.scope_count = start_scopes;
 
     ParseHLSLFree(parser, ctx->free, ctx->malloc_data);
     preprocessor_end(pp);
@@ -4563,7 +4616,7 @@ static void pop_ir_loop(Context *ctx)
 
 
 #define NEW_IR_NODE(retval, cls, typ) \
-    cls *retval = (cls *) Malloc(ctx, sizeof (cls)); \
+    cls *retval = (cls *) ArenaMalloc(ctx, ctx->ir_arena, sizeof (cls)); \
     do { \
         if (retval == NULL) { return NULL; } \
         retval->ir.type = typ; \
@@ -4572,7 +4625,7 @@ static void pop_ir_loop(Context *ctx)
     } while (0)
 
 #define NEW_IR_EXPR(retval, cls, typ, dt, numelems) \
-    cls *retval = (cls *) Malloc(ctx, sizeof (cls)); \
+    cls *retval = (cls *) ArenaMalloc(ctx, ctx->ir_arena, sizeof (cls)); \
     do { \
         if (retval == NULL) { return NULL; } \
         retval->info.ir.type = typ; \
@@ -4668,7 +4721,7 @@ static MOJOSHADER_irExpression *new_ir_constfloat(Context *ctx, const float val)
 
 static MOJOSHADER_irExpression *new_ir_constbool(Context *ctx, const int val)
 {
-    // !!! FIXME: cache true and false in (ctx), ignore in delete_ir().
+    // !!! FIXME: cache true and false in (ctx).
     NEW_IR_EXPR(retval, MOJOSHADER_irConstant, MOJOSHADER_IR_CONSTANT, MOJOSHADER_AST_DATATYPE_BOOL, 1);
     retval->value.ival[0] = val;
     return (MOJOSHADER_irExpression *) retval;
@@ -4976,10 +5029,180 @@ static MOJOSHADER_irStatement *build_ir_ifstmt(Context *ctx,
 } // build_ir_ifstmt
 
 
+// How many trips we're willing to unroll for a loop's [unroll]/[loop]
+//  attribute (see for_intro in the grammar).
+static int max_unroll_trips(const int unroll)
+{
+    if (unroll == 0)  // [loop]
+        return 0;
+    else if (unroll > 0)  // [unroll(x)]
+        return unroll;
+    else if (unroll == -1)  // [unroll]
+        return 256;
+    return 4;  // no attribute, so it's up to us. Only do tiny loops.
+} // max_unroll_trips
+
+// Returns (expr) if it's a plain scalar int variable, NULL otherwise.
+static const MOJOSHADER_astExpressionIdentifier *loop_counter_ident(Context *ctx,
+                                        const MOJOSHADER_astExpression *expr)
+{
+    if ((expr == NULL) || (expr->ast.type != MOJOSHADER_AST_OP_IDENTIFIER))
+        return NULL;
+    const MOJOSHADER_astDataType *dt = reduce_datatype(ctx, expr->datatype);
+    if ((dt == NULL) || (dt->type != MOJOSHADER_AST_DATATYPE_INT))
+        return NULL;
+    return (const MOJOSHADER_astExpressionIdentifier *) expr;
+} // loop_counter_ident
+
+static inline int is_int_literal(const MOJOSHADER_astExpression *expr)
+{
+    return ((expr != NULL) && (expr->ast.type == MOJOSHADER_AST_OP_INT_LITERAL));
+} // is_int_literal
+
+// Note a for-loop that runs a fixed number of times, so we can unroll it
+//  once the whole function is built: an int counter that starts at a
+//  literal, gets compared to a literal, and steps by a literal. Anything
+//  fancier just stays a loop.
+static void note_ir_loop(Context *ctx, const MOJOSHADER_astForStatement *ast,
+                         MOJOSHADER_irStatement *loop, const int test,
+                         const int body, const int increment, const int join)
+{
+    const int maxtrips = max_unroll_trips(ast->unroll);
+    const MOJOSHADER_astNode *looptest = (const MOJOSHADER_astNode *) ast->looptest;
+    const MOJOSHADER_astNode *counter = (const MOJOSHADER_astNode *) ast->counter;
+    const MOJOSHADER_astExpressionIdentifier *ident = NULL;
+    int keep_counter = 0;
+    int64 start = 0;
+    int64 step = 0;
+
+    if ((loop == NULL) || (maxtrips == 0) || (looptest == NULL) || (counter == NULL))
+        return;
+
+    switch (looptest->ast.type)
+    {
+        case MOJOSHADER_AST_OP_LESSTHAN:
+        case MOJOSHADER_AST_OP_GREATERTHAN:
+        case MOJOSHADER_AST_OP_LESSTHANOREQUAL:
+        case MOJOSHADER_AST_OP_GREATERTHANOREQUAL:
+        case MOJOSHADER_AST_OP_NOTEQUAL:
+            ident = loop_counter_ident(ctx, looptest->binary.left);
+            if ((ident == NULL) || (!is_int_literal(looptest->binary.right)))
+                return;
+            break;
+        default:
+            return;
+    } // switch
+
+    // "for (int i = 0; ...)" or "for (i = 0; ...)"
+    if (ast->var_decl != NULL)
+    {
+        const MOJOSHADER_astVariableDeclaration *decl = ast->var_decl;
+        if ( (decl->next != NULL) || (decl->details->isarray) ||
+             (decl->details->identifier != ident->identifier) ||
+             (!is_int_literal(decl->initializer)) )
+            return;
+        start = ((const MOJOSHADER_astNode *) decl->initializer)->intliteral.value;
+    } // if
+    else
+    {
+        const MOJOSHADER_astNode *init = (const MOJOSHADER_astNode *) ast->initializer;
+        const MOJOSHADER_astExpressionIdentifier *initident = NULL;
+        if ((init == NULL) || (init->ast.type != MOJOSHADER_AST_OP_ASSIGN))
+            return;
+        initident = loop_counter_ident(ctx, init->binary.left);
+        if ( (initident == NULL) || (initident->index != ident->index) ||
+             (!is_int_literal(init->binary.right)) )
+            return;
+        start = ((const MOJOSHADER_astNode *) init->binary.right)->intliteral.value;
+        keep_counter = 1;  // still in scope after the loop.
+    } // else
+
+    switch (counter->ast.type)
+    {
+        case MOJOSHADER_AST_OP_PREINCREMENT:
+        case MOJOSHADER_AST_OP_POSTINCREMENT:
+        case MOJOSHADER_AST_OP_PREDECREMENT:
+        case MOJOSHADER_AST_OP_POSTDECREMENT:
+        {
+            const MOJOSHADER_astExpressionIdentifier *cident = loop_counter_ident(ctx, counter->unary.operand);
+            if ((cident == NULL) || (cident->index != ident->index))
+                return;
+            const int isinc = ( (counter->ast.type == MOJOSHADER_AST_OP_PREINCREMENT) ||
+                                (counter->ast.type == MOJOSHADER_AST_OP_POSTINCREMENT) );
+            step = isinc ? 1 : -1;
+            break;
+        } // case
+
+        case MOJOSHADER_AST_OP_ADDASSIGN:
+        case MOJOSHADER_AST_OP_SUBASSIGN:
+        {
+            const MOJOSHADER_astExpressionIdentifier *cident = loop_counter_ident(ctx, counter->binary.left);
+            if ((cident == NULL) || (cident->index != ident->index))
+                return;
+            else if (!is_int_literal(counter->binary.right))
+                return;
+            step = ((const MOJOSHADER_astNode *) counter->binary.right)->intliteral.value;
+            if (counter->ast.type == MOJOSHADER_AST_OP_SUBASSIGN)
+                step = -step;
+            break;
+        } // case
+
+        default:
+            return;
+    } // switch
+
+    if (step == 0)
+        return;
+
+    // Just run the loop to count the trips; this is cheap with the cap.
+    const int64 limit = ((const MOJOSHADER_astNode *) looptest->binary.right)->intliteral.value;
+    int64 val = start;
+    int trips = 0;
+    while (1)
+    {
+        int keepgoing = 0;
+        switch (looptest->ast.type)
+        {
+            case MOJOSHADER_AST_OP_LESSTHAN: keepgoing = (val < limit); break;
+            case MOJOSHADER_AST_OP_GREATERTHAN: keepgoing = (val > limit); break;
+            case MOJOSHADER_AST_OP_LESSTHANOREQUAL: keepgoing = (val <= limit); break;
+            case MOJOSHADER_AST_OP_GREATERTHANOREQUAL: keepgoing = (val >= limit); break;
+            case MOJOSHADER_AST_OP_NOTEQUAL: keepgoing = (val != limit); break;
+            default: assert(0 && "unexpected loop test"); return;
+        } // switch
+
+        if (!keepgoing)
+            break;
+        else if (++trips > maxtrips)
+            return;  // too many trips (or infinite), leave it alone.
+
+        val += step;
+        if ((val < -((int64) 0x7FFFFFFF) - 1) || (val > (int64) 0x7FFFFFFF))
+            return;  // overflow; don't guess what the hardware does.
+    } // while
+
+    IrLoop *item = (IrLoop *) ArenaMalloc(ctx, ctx->ir_arena, sizeof (IrLoop));
+    if (item == NULL)
+        return;
+
+    item->loop = loop;
+    item->test = test;
+    item->body = body;
+    item->increment = increment;
+    item->join = join;
+    item->var = ident->index;
+    item->start = (int) start;
+    item->step = (int) step;
+    item->trips = trips;
+    item->keep_counter = keep_counter;
+    item->next = ctx->ir_loops;
+    ctx->ir_loops = item;
+} // note_ir_loop
+
 static MOJOSHADER_irStatement *build_ir_forstmt(Context *ctx,
                                        const MOJOSHADER_astForStatement *ast)
 {
-    // !!! FIXME: ast->unroll
+    // ast->unroll is handled after the fact, by unroll_ir_loops().
 
     assert(ast->looptest->datatype->type == MOJOSHADER_AST_DATATYPE_BOOL);
 
@@ -5033,6 +5256,7 @@ static MOJOSHADER_irStatement *build_ir_forstmt(Context *ctx,
         new_ir_seq(ctx, new_ir_jump(ctx, test),
                         new_ir_label(ctx, join)))))))));
 
+    note_ir_loop(ctx, ast, retval, test, loop, increment, join);
     pop_ir_loop(ctx);
 
     return new_ir_seq(ctx, retval, build_ir_stmt(ctx, ast->next));
@@ -5713,7 +5937,7 @@ static void print_ir(FILE *io, unsigned int depth, void *_ir)
 
         case MOJOSHADER_IR_SWIZZLE:
             fprintf(io, "SWIZZLE");
-            for (i = 0; i < ir->expr.swizzle.info.elements-1; i++)
+            for (i = 0; i < ir->expr.swizzle.info.elements; i++)
                 fprintf(io, " %d", (int) ir->expr.swizzle.channels[i]);
             fprintf(io, " ]\n");
             print_ir(io, depth, ir->expr.swizzle.expr);
@@ -5766,6 +5990,7 @@ static void print_ir(FILE *io, unsigned int depth, void *_ir)
         case MOJOSHADER_IR_ESEQ:
             fprintf(io, "ESEQ ]\n");
             print_ir(io, depth, ir->expr.eseq.stmt);
+            print_ir(io, depth, ir->expr.eseq.expr);
             break;
 
         case MOJOSHADER_IR_ARRAY:
@@ -5833,142 +6058,1744 @@ static void print_whole_ir(Context *ctx, FILE *io)
         int i;
         for (i = 0; i <= ctx->user_func_index; i++)
         {
-            printf("[FUNCTION %d ]\n", i);
+            fprintf(io, "[FUNCTION %d ]\n", i);
             print_ir(io, 1, ctx->ir[i]);
         } // for
     } // if
 } // print_whole_ir
 
-static void delete_ir(Context *ctx, void *_ir)
+
+static void intermediate_representation(Context *ctx)
 {
-    MOJOSHADER_irNode *ir = (MOJOSHADER_irNode *) _ir;
-    if (ir == NULL)
-        return;
+    const MOJOSHADER_astCompilationUnit *ast = NULL;
+    const MOJOSHADER_astCompilationUnitFunction *astfn = NULL;
+    const size_t arraylen = (ctx->user_func_index+1) * sizeof (MOJOSHADER_irStatement *);
+    int i;
 
-    switch (ir->ir.type)
-    {
-        case MOJOSHADER_IR_JUMP:
-        case MOJOSHADER_IR_LABEL:
-        case MOJOSHADER_IR_CONSTANT:
-        case MOJOSHADER_IR_TEMP:
-        case MOJOSHADER_IR_DISCARD:
-        case MOJOSHADER_IR_MEMORY:
-            break;  // nothing extra to free here.
+    ctx->ir = (MOJOSHADER_irStatement **) Malloc(ctx, arraylen);
+    if (ctx->ir == NULL)
+        return;
+    memset(ctx->ir, '\0', arraylen);
 
-        case MOJOSHADER_IR_BINOP:
-            delete_ir(ctx, ir->expr.binop.left);
-            delete_ir(ctx, ir->expr.binop.right);
-            break;
+    ctx->ir_rets = (int *) Malloc(ctx, sizeof (int) * (ctx->user_func_index+1));
+    if (ctx->ir_rets == NULL)
+        return;
+    for (i = 0; i <= ctx->user_func_index; i++)
+        ctx->ir_rets[i] = -1;
 
-        case MOJOSHADER_IR_CALL:
-            delete_ir(ctx, ir->expr.call.args);
-            break;
+    ctx->ir_end = -1;
+    ctx->ir_ret = -1;
 
-        case MOJOSHADER_IR_ESEQ:
-            delete_ir(ctx, ir->expr.eseq.stmt);
-            delete_ir(ctx, ir->expr.eseq.expr);
-            break;
+    for (ast = &ctx->ast->compunit; ast != NULL; ast = ast->next)
+    {
+        assert(ast->ast.type > MOJOSHADER_AST_COMPUNIT_START_RANGE);
+        assert(ast->ast.type < MOJOSHADER_AST_COMPUNIT_END_RANGE);
+        if (ast->ast.type != MOJOSHADER_AST_COMPUNIT_FUNCTION)
+            continue;  // only care about functions right now.
 
-        case MOJOSHADER_IR_ARRAY:
-            delete_ir(ctx, ir->expr.array.array);
-            delete_ir(ctx, ir->expr.array.element);
-            break;
+        astfn = (MOJOSHADER_astCompilationUnitFunction *) ast;
+        if (astfn->definition == NULL)  // just a predeclare; skip.
+            continue;
 
-        case MOJOSHADER_IR_MOVE:
-            delete_ir(ctx, ir->stmt.move.dst);
-            delete_ir(ctx, ir->stmt.move.src);
-            break;
+        assert(ctx->ir_loop == NULL);  // parser should have caught this!
+        assert(ctx->ir_end < 0);  // parser should have caught this!
+        assert(ctx->ir_ret < 0);  // parser should have caught this!
+        const int start = generate_ir_label(ctx);  // !!! FIXME: store somewhere.
+        const int end = generate_ir_label(ctx);
+        ctx->ir_end = end;
 
+        if (astfn->declaration->datatype != NULL)
+            ctx->ir_ret = generate_ir_temp(ctx);
+        ctx->ir_rets[astfn->index] = ctx->ir_ret;
+
+        MOJOSHADER_irStatement *funcseq = new_ir_seq(ctx, new_ir_label(ctx, start), build_ir_stmt(ctx, astfn->definition));
+        funcseq = new_ir_seq(ctx, funcseq, new_ir_label(ctx, end));
+        assert(ctx->ir_loop == NULL);  // parser should have caught this!
+        ctx->ir_end = -1;
+        ctx->ir_ret = -1;
+
+        assert(astfn->index <= ctx->user_func_index);
+        assert(ctx->ir[astfn->index] == NULL);
+        ctx->ir[astfn->index] = funcseq;
+    } // for
+
+    // note_ir_loop() prepends, but unroll_ir_loops() wants inner loops first.
+    REVERSE_LINKED_LIST(IrLoop, ctx->ir_loops);
+
+    // done with the AST, nuke it.
+    // !!! FIXME: we're going to need CTAB data from this at some point.
+    arena_destroy(ctx->ast_arena);
+    ctx->ast_arena = NULL;
+    ctx->ast = NULL;
+} // intermediate_representation
+
+
+// IR optimization passes. These run per function, on the trees that
+//  intermediate_representation() built, in the order optimize_ir() lists
+//  them. Nothing here knows about registers yet, so it's all the
+//  target-independent stuff: unrolling loops with a known trip count,
+//  constant folding, common subexpression elimination, and throwing away
+//  temps, labels and code that nothing uses.
+
+// New nodes get the error position of whatever they're replacing.
+static inline void ir_position(Context *ctx, const void *_ir)
+{
+    const MOJOSHADER_irGeneric *ir = (const MOJOSHADER_irGeneric *) _ir;
+    ctx->sourcefile = ir->ir.filename;
+    ctx->sourceline = ir->ir.line;
+} // ir_position
+
+// Scalar types, which is what every vector and matrix breaks down to.
+//  Structs and such show up in the IR as their own types, and we leave
+//  those alone.
+static int ir_simple_type(const MOJOSHADER_astDataTypeType type)
+{
+    switch (type)
+    {
+        case MOJOSHADER_AST_DATATYPE_BOOL:
+        case MOJOSHADER_AST_DATATYPE_INT:
+        case MOJOSHADER_AST_DATATYPE_UINT:
+        case MOJOSHADER_AST_DATATYPE_FLOAT:
+        case MOJOSHADER_AST_DATATYPE_FLOAT_SNORM:
+        case MOJOSHADER_AST_DATATYPE_FLOAT_UNORM:
+        case MOJOSHADER_AST_DATATYPE_HALF:
+        case MOJOSHADER_AST_DATATYPE_DOUBLE:
+            return 1;
+        default:
+            return 0;
+    } // switch
+} // ir_simple_type
+
+static int ir_float_type(const MOJOSHADER_astDataTypeType type)
+{
+    switch (type)
+    {
+        case MOJOSHADER_AST_DATATYPE_FLOAT:
+        case MOJOSHADER_AST_DATATYPE_FLOAT_SNORM:
+        case MOJOSHADER_AST_DATATYPE_FLOAT_UNORM:
+        case MOJOSHADER_AST_DATATYPE_HALF:
+        case MOJOSHADER_AST_DATATYPE_DOUBLE:
+            return 1;
+        default:
+            return 0;
+    } // switch
+} // ir_float_type
+
+// Non-zero if evaluating (expr) can't change anything, so it's safe to
+//  drop, duplicate or reorder. Calls are never pure (user functions can
+//  write globals, intrinsics can have out params), and neither is an ESEQ,
+//  since there's a statement in there.
+static int ir_expr_is_pure(const MOJOSHADER_irExpression *expr)
+{
+    const MOJOSHADER_irExprList *args = NULL;
+
+    if (expr == NULL)
+        return 1;
+
+    switch (expr->ir.type)
+    {
+        case MOJOSHADER_IR_CONSTANT:
+        case MOJOSHADER_IR_TEMP:
+        case MOJOSHADER_IR_MEMORY:
+            return 1;
+        case MOJOSHADER_IR_BINOP:
+            return ( ir_expr_is_pure(expr->binop.left) &&
+                     ir_expr_is_pure(expr->binop.right) );
+        case MOJOSHADER_IR_ARRAY:
+            return ( ir_expr_is_pure(expr->array.array) &&
+                     ir_expr_is_pure(expr->array.element) );
+        case MOJOSHADER_IR_CONVERT:
+            return ir_expr_is_pure(expr->convert.expr);
+        case MOJOSHADER_IR_SWIZZLE:
+            return ir_expr_is_pure(expr->swizzle.expr);
+        case MOJOSHADER_IR_CONSTRUCT:
+            for (args = expr->construct.args; args != NULL; args = args->next)
+            {
+                if (!ir_expr_is_pure(args->expr))
+                    return 0;
+            } // for
+            return 1;
+        default:
+            return 0;
+    } // switch
+} // ir_expr_is_pure
+
+
+// Calls (visitor) for every node in (_ir), parents before children.
+typedef void (*IrVisitor)(MOJOSHADER_irNode *ir, void *data);
+
+static void visit_ir(void *_ir, IrVisitor visitor, void *data)
+{
+    MOJOSHADER_irNode *ir = (MOJOSHADER_irNode *) _ir;
+    while (ir != NULL)
+    {
+        visitor(ir, data);
+        switch (ir->ir.type)
+        {
+            case MOJOSHADER_IR_BINOP:
+                visit_ir(ir->expr.binop.left, visitor, data);
+                ir = (MOJOSHADER_irNode *) ir->expr.binop.right;
+                break;
+            case MOJOSHADER_IR_CALL:
+                ir = (MOJOSHADER_irNode *) ir->expr.call.args;
+                break;
+            case MOJOSHADER_IR_ESEQ:
+                visit_ir(ir->expr.eseq.stmt, visitor, data);
+                ir = (MOJOSHADER_irNode *) ir->expr.eseq.expr;
+                break;
+            case MOJOSHADER_IR_ARRAY:
+                visit_ir(ir->expr.array.array, visitor, data);
+                ir = (MOJOSHADER_irNode *) ir->expr.array.element;
+                break;
+            case MOJOSHADER_IR_CONVERT:
+                ir = (MOJOSHADER_irNode *) ir->expr.convert.expr;
+                break;
+            case MOJOSHADER_IR_SWIZZLE:
+                ir = (MOJOSHADER_irNode *) ir->expr.swizzle.expr;
+                break;
+            case MOJOSHADER_IR_CONSTRUCT:
+                ir = (MOJOSHADER_irNode *) ir->expr.construct.args;
+                break;
+            case MOJOSHADER_IR_MOVE:
+                visit_ir(ir->stmt.move.dst, visitor, data);
+                ir = (MOJOSHADER_irNode *) ir->stmt.move.src;
+                break;
+            case MOJOSHADER_IR_EXPR_STMT:
+                ir = (MOJOSHADER_irNode *) ir->stmt.expr.expr;
+                break;
+            case MOJOSHADER_IR_CJUMP:
+                visit_ir(ir->stmt.cjump.left, visitor, data);
+                ir = (MOJOSHADER_irNode *) ir->stmt.cjump.right;
+                break;
+            case MOJOSHADER_IR_SEQ:
+                visit_ir(ir->stmt.seq.first, visitor, data);
+                ir = (MOJOSHADER_irNode *) ir->stmt.seq.next;
+                break;
+            case MOJOSHADER_IR_EXPRLIST:
+                visit_ir(ir->misc.exprlist.expr, visitor, data);
+                ir = (MOJOSHADER_irNode *) ir->misc.exprlist.next;
+                break;
+            default:  // CONSTANT, TEMP, MEMORY, JUMP, LABEL, DISCARD.
+                ir = NULL;
+                break;
+        } // switch
+    } // while
+} // visit_ir
+
+static void find_ir_label(MOJOSHADER_irNode *ir, void *data)
+{
+    if (ir->ir.type == MOJOSHADER_IR_LABEL)
+        *((int *) data) = 1;
+} // find_ir_label
+
+static int ir_has_label(void *ir)
+{
+    int retval = 0;
+    visit_ir(ir, find_ir_label, &retval);
+    return retval;
+} // ir_has_label
+
+
+// A function's statements, flattened out of their SEQs.
+typedef struct IrStmtList
+{
+    MOJOSHADER_irStatement **stmts;
+    int count;
+    int alloc;
+} IrStmtList;
+
+static int add_ir_stmt(Context *ctx, IrStmtList *list,
+                       MOJOSHADER_irStatement *stmt)
+{
+    if (!grow_array(ctx, (void **) &list->stmts, &list->alloc, list->count,
+                    sizeof (MOJOSHADER_irStatement *)))
+        return 0;
+    list->stmts[list->count++] = stmt;
+    return 1;
+} // add_ir_stmt
+
+// Appends (stmt) to (list) in execution order, without its SEQs. This also
+//  pulls the statements out of an ESEQ that gets evaluated before anything
+//  else in a statement (an EXPRSTMT, a MOVE's source, a CJUMP's left side),
+//  since that's where the lowering for assignments, ++ and comparisons
+//  hides most of the code, and the passes can't see into them otherwise.
+static int flatten_ir_stmts(Context *ctx, IrStmtList *list,
+                            MOJOSHADER_irStatement *stmt)
+{
+    while (stmt != NULL)
+    {
+        MOJOSHADER_irExpression **lead = NULL;
+
+        if (stmt->ir.type == MOJOSHADER_IR_SEQ)
+        {
+            if (!flatten_ir_stmts(ctx, list, stmt->seq.first))
+                return 0;
+            stmt = stmt->seq.next;
+            continue;
+        } // if
+
+        else if (stmt->ir.type == MOJOSHADER_IR_EXPR_STMT)
+            lead = &stmt->expr.expr;
+        else if (stmt->ir.type == MOJOSHADER_IR_CJUMP)
+            lead = &stmt->cjump.left;
+        else if (stmt->ir.type == MOJOSHADER_IR_MOVE)
+        {
+            const MOJOSHADER_irNodeType dsttype = stmt->move.dst->ir.type;
+            if ((dsttype == MOJOSHADER_IR_TEMP) || (dsttype == MOJOSHADER_IR_MEMORY))
+                lead = &stmt->move.src;
+        } // else if
+
+        while ((lead != NULL) && ((*lead)->ir.type == MOJOSHADER_IR_ESEQ))
+        {
+            const MOJOSHADER_irESeq *eseq = &(*lead)->eseq;
+            if (!flatten_ir_stmts(ctx, list, eseq->stmt))
+                return 0;
+
+            // build_ir_derefstruct() retypes the ESEQ, not what's in it.
+            MOJOSHADER_irExpression *expr = eseq->expr;
+            expr->info.type = eseq->info.type;
+            expr->info.elements = eseq->info.elements;
+            *lead = expr;
+        } // while
+
+        return add_ir_stmt(ctx, list, stmt);
+    } // while
+
+    return 1;
+} // flatten_ir_stmts
+
+// Chains (count) statements back together with SEQs. NULL if (count) is 0.
+static MOJOSHADER_irStatement *seq_ir_stmts(Context *ctx,
+                                            MOJOSHADER_irStatement **stmts,
+                                            const int count)
+{
+    MOJOSHADER_irStatement *retval = (count > 0) ? stmts[count-1] : NULL;
+    int i;
+    for (i = count - 2; i >= 0; i--)
+    {
+        ir_position(ctx, stmts[i]);
+        retval = new_ir_seq(ctx, stmts[i], retval);
+    } // for
+    return retval;
+} // seq_ir_stmts
+
+
+// Loop unrolling...
+
+typedef struct IrLabelMap
+{
+    int *labels;  // new index for each label, -1 to leave it alone.
+    int count;
+} IrLabelMap;
+
+static inline int map_ir_label(const IrLabelMap *map, const int label)
+{
+    if ((label < map->count) && (map->labels[label] >= 0))
+        return map->labels[label];
+    return label;
+} // map_ir_label
+
+static size_t ir_node_size(const MOJOSHADER_irNodeType type)
+{
+    switch (type)
+    {
+        case MOJOSHADER_IR_CONSTANT: return sizeof (MOJOSHADER_irConstant);
+        case MOJOSHADER_IR_TEMP: return sizeof (MOJOSHADER_irTemp);
+        case MOJOSHADER_IR_BINOP: return sizeof (MOJOSHADER_irBinOp);
+        case MOJOSHADER_IR_MEMORY: return sizeof (MOJOSHADER_irMemory);
+        case MOJOSHADER_IR_CALL: return sizeof (MOJOSHADER_irCall);
+        case MOJOSHADER_IR_ESEQ: return sizeof (MOJOSHADER_irESeq);
+        case MOJOSHADER_IR_ARRAY: return sizeof (MOJOSHADER_irArray);
+        case MOJOSHADER_IR_CONVERT: return sizeof (MOJOSHADER_irConvert);
+        case MOJOSHADER_IR_SWIZZLE: return sizeof (MOJOSHADER_irSwizzle);
+        case MOJOSHADER_IR_CONSTRUCT: return sizeof (MOJOSHADER_irConstruct);
+        case MOJOSHADER_IR_MOVE: return sizeof (MOJOSHADER_irMove);
+        case MOJOSHADER_IR_EXPR_STMT: return sizeof (MOJOSHADER_irExprStmt);
+        case MOJOSHADER_IR_JUMP: return sizeof (MOJOSHADER_irJump);
+        case MOJOSHADER_IR_CJUMP: return sizeof (MOJOSHADER_irCJump);
+        case MOJOSHADER_IR_SEQ: return sizeof (MOJOSHADER_irSeq);
+        case MOJOSHADER_IR_LABEL: return sizeof (MOJOSHADER_irLabel);
+        case MOJOSHADER_IR_DISCARD: return sizeof (MOJOSHADER_irDiscard);
+        case MOJOSHADER_IR_EXPRLIST: return sizeof (MOJOSHADER_irExprList);
+        default: assert(0 && "unexpected IR node"); return 0;
+    } // switch
+} // ir_node_size
+
+// Deep copy of (_ir), with every label renamed through (map).
+static void *clone_ir(Context *ctx, const void *_ir, const IrLabelMap *map)
+{
+    const MOJOSHADER_irNode *ir = (const MOJOSHADER_irNode *) _ir;
+    if ((ir == NULL) || (ctx->out_of_memory))
+        return NULL;
+
+    const size_t len = ir_node_size(ir->ir.type);
+    MOJOSHADER_irNode *retval = (MOJOSHADER_irNode *) ArenaMalloc(ctx, ctx->ir_arena, len);
+    if (retval == NULL)
+        return NULL;
+    memcpy(retval, ir, len);
+
+    #define CLONE_IR(typ, field) \
+        retval->field = (typ *) clone_ir(ctx, ir->field, map)
+    switch (ir->ir.type)
+    {
+        case MOJOSHADER_IR_BINOP:
+            CLONE_IR(MOJOSHADER_irExpression, expr.binop.left);
+            CLONE_IR(MOJOSHADER_irExpression, expr.binop.right);
+            break;
+        case MOJOSHADER_IR_CALL:
+            CLONE_IR(MOJOSHADER_irExprList, expr.call.args);
+            break;
+        case MOJOSHADER_IR_ESEQ:
+            CLONE_IR(MOJOSHADER_irStatement, expr.eseq.stmt);
+            CLONE_IR(MOJOSHADER_irExpression, expr.eseq.expr);
+            break;
+        case MOJOSHADER_IR_ARRAY:
+            CLONE_IR(MOJOSHADER_irExpression, expr.array.array);
+            CLONE_IR(MOJOSHADER_irExpression, expr.array.element);
+            break;
+        case MOJOSHADER_IR_CONVERT:
+            CLONE_IR(MOJOSHADER_irExpression, expr.convert.expr);
+            break;
+        case MOJOSHADER_IR_SWIZZLE:
+            CLONE_IR(MOJOSHADER_irExpression, expr.swizzle.expr);
+            break;
+        case MOJOSHADER_IR_CONSTRUCT:
+            CLONE_IR(MOJOSHADER_irExprList, expr.construct.args);
+            break;
+        case MOJOSHADER_IR_MOVE:
+            CLONE_IR(MOJOSHADER_irExpression, stmt.move.dst);
+            CLONE_IR(MOJOSHADER_irExpression, stmt.move.src);
+            break;
         case MOJOSHADER_IR_EXPR_STMT:
-            delete_ir(ctx, ir->stmt.expr.expr);
+            CLONE_IR(MOJOSHADER_irExpression, stmt.expr.expr);
+            break;
+        case MOJOSHADER_IR_JUMP:
+            retval->stmt.jump.label = map_ir_label(map, ir->stmt.jump.label);
+            break;
+        case MOJOSHADER_IR_CJUMP:
+            CLONE_IR(MOJOSHADER_irExpression, stmt.cjump.left);
+            CLONE_IR(MOJOSHADER_irExpression, stmt.cjump.right);
+            retval->stmt.cjump.iftrue = map_ir_label(map, ir->stmt.cjump.iftrue);
+            retval->stmt.cjump.iffalse = map_ir_label(map, ir->stmt.cjump.iffalse);
+            break;
+        case MOJOSHADER_IR_SEQ:  // !!! FIXME: don't recurse?
+            CLONE_IR(MOJOSHADER_irStatement, stmt.seq.first);
+            CLONE_IR(MOJOSHADER_irStatement, stmt.seq.next);
+            break;
+        case MOJOSHADER_IR_LABEL:
+            retval->stmt.label.index = map_ir_label(map, ir->stmt.label.index);
+            break;
+        case MOJOSHADER_IR_EXPRLIST:  // !!! FIXME: don't recurse?
+            CLONE_IR(MOJOSHADER_irExpression, misc.exprlist.expr);
+            CLONE_IR(MOJOSHADER_irExprList, misc.exprlist.next);
+            break;
+        default:  // CONSTANT, TEMP, MEMORY, DISCARD: nothing else to copy.
+            break;
+    } // switch
+    #undef CLONE_IR
+
+    return retval;
+} // clone_ir
+
+typedef struct IrLoopBody
+{
+    const IrLoop *loop;
+    int writes_counter;  // non-zero if we can't unroll this.
+    int *labels;  // labels the body defines (they get renamed per trip).
+    int label_count;
+    int label_alloc;
+    Context *ctx;
+} IrLoopBody;
+
+static void scan_ir_loop_body(MOJOSHADER_irNode *ir, void *data)
+{
+    IrLoopBody *body = (IrLoopBody *) data;
+    const int var = body->loop->var;
+    const MOJOSHADER_irExprList *args = NULL;
+    const MOJOSHADER_irExpression *dst = NULL;
+
+    switch (ir->ir.type)
+    {
+        case MOJOSHADER_IR_LABEL:
+            if (grow_array(body->ctx, (void **) &body->labels,
+                           &body->label_alloc, body->label_count, sizeof (int)))
+                body->labels[body->label_count++] = ir->stmt.label.index;
             break;
 
-        case MOJOSHADER_IR_CJUMP:
-            delete_ir(ctx, ir->stmt.cjump.left);
-            delete_ir(ctx, ir->stmt.cjump.right);
-            break;
+        case MOJOSHADER_IR_MOVE:
+            dst = ir->stmt.move.dst;
+            while (dst->ir.type == MOJOSHADER_IR_ESEQ)
+                dst = dst->eseq.expr;
+            if ((dst->ir.type == MOJOSHADER_IR_MEMORY) && (dst->memory.index == var))
+                body->writes_counter = 1;
+            break;
+
+        case MOJOSHADER_IR_CALL:
+            // user functions can change globals (which have negative indices).
+            if ((var < 0) && (ir->expr.call.index >= 0))
+                body->writes_counter = 1;
+            for (args = ir->expr.call.args; args != NULL; args = args->next)
+            {
+                // might be an out param.
+                dst = args->expr;
+                if ((dst->ir.type == MOJOSHADER_IR_MEMORY) && (dst->memory.index == var))
+                    body->writes_counter = 1;
+            } // for
+            break;
+
+        default: break;
+    } // switch
+} // scan_ir_loop_body
+
+// Takes the top SEQ off of (*stmt). Returns NULL if there's nothing left.
+static MOJOSHADER_irStatement *ir_seq_pop(MOJOSHADER_irStatement **stmt)
+{
+    MOJOSHADER_irStatement *retval = *stmt;
+    if ((retval != NULL) && (retval->ir.type == MOJOSHADER_IR_SEQ))
+    {
+        *stmt = retval->seq.next;
+        return retval->seq.first;
+    } // if
+    *stmt = NULL;
+    return retval;
+} // ir_seq_pop
+
+static inline int is_ir_label(const MOJOSHADER_irStatement *stmt, const int label)
+{
+    return ( (stmt != NULL) && (stmt->ir.type == MOJOSHADER_IR_LABEL) &&
+             (stmt->label.index == label) );
+} // is_ir_label
+
+// Replaces a loop from build_ir_forstmt() with (loop->trips) copies of its
+//  body, each preceded by a move of that trip's counter value into the
+//  counter. "continue" in a copy goes to the end of that copy, and "break"
+//  still goes to the join label, which is the last thing we emit.
+static void unroll_ir_loop(Context *ctx, const IrLoop *loop)
+{
+    MOJOSHADER_irStatement *root = loop->loop;
+    MOJOSHADER_irStatement *stmts = root;
+    MOJOSHADER_irStatement *body = NULL;
+    MOJOSHADER_irStatement *item = NULL;
+    MOJOSHADER_irStatement *join = NULL;
+    IrStmtList list;
+    IrLoopBody scan;
+    IrLabelMap map;
+    int i, j;
+
+    assert(root->ir.type == MOJOSHADER_IR_SEQ);
+
+    // make sure this is still exactly what build_ir_forstmt() made.
+    if (!is_ir_label(ir_seq_pop(&stmts), loop->test))
+        return;
+    item = ir_seq_pop(&stmts);
+    if ((item == NULL) || (item->ir.type != MOJOSHADER_IR_CJUMP))
+        return;
+    if (!is_ir_label(ir_seq_pop(&stmts), loop->body))
+        return;
+    item = ir_seq_pop(&stmts);
+    if (!is_ir_label(item, loop->increment))  // empty bodies are allowed.
+    {
+        body = item;
+        if (!is_ir_label(ir_seq_pop(&stmts), loop->increment))
+            return;
+    } // if
+    item = ir_seq_pop(&stmts);
+    if ((item == NULL) || (item->ir.type != MOJOSHADER_IR_EXPR_STMT))
+        return;
+    item = ir_seq_pop(&stmts);
+    if ((item == NULL) || (item->ir.type != MOJOSHADER_IR_JUMP) || (item->jump.label != loop->test))
+        return;
+    join = ir_seq_pop(&stmts);
+    if ((!is_ir_label(join, loop->join)) || (stmts != NULL))
+        return;
+
+    memset(&scan, '\0', sizeof (scan));
+    scan.loop = loop;
+    scan.ctx = ctx;
+    visit_ir(body, scan_ir_loop_body, &scan);
+    if ((scan.writes_counter) || (ctx->out_of_memory))
+    {
+        if (scan.labels != NULL)
+            Free(ctx, scan.labels);
+        return;
+    } // if
+
+    map.count = ctx->ir_label_count;
+    map.labels = (int *) Malloc(ctx, sizeof (int) * map.count);
+    if (map.labels == NULL)
+    {
+        if (scan.labels != NULL)
+            Free(ctx, scan.labels);
+        return;
+    } // if
+    for (i = 0; i < map.count; i++)
+        map.labels[i] = -1;
+
+    memset(&list, '\0', sizeof (list));
+    ir_position(ctx, root);
+    for (i = 0; i < loop->trips; i++)
+    {
+        const int val = loop->start + (i * loop->step);
+        const int cont = generate_ir_label(ctx);
+        for (j = 0; j < scan.label_count; j++)
+            map.labels[scan.labels[j]] = generate_ir_label(ctx);
+        map.labels[loop->increment] = cont;
+
+        add_ir_stmt(ctx, &list, new_ir_move(ctx,
+                        new_ir_memory(ctx, loop->var, MOJOSHADER_AST_DATATYPE_INT, 1),
+                        new_ir_constint(ctx, val), -1));
+        if (body != NULL)
+            add_ir_stmt(ctx, &list, (MOJOSHADER_irStatement *) clone_ir(ctx, body, &map));
+        add_ir_stmt(ctx, &list, new_ir_label(ctx, cont));
+        ir_position(ctx, root);
+    } // for
+
+    if (loop->keep_counter)
+    {
+        const int val = loop->start + (loop->trips * loop->step);
+        add_ir_stmt(ctx, &list, new_ir_move(ctx,
+                        new_ir_memory(ctx, loop->var, MOJOSHADER_AST_DATATYPE_INT, 1),
+                        new_ir_constint(ctx, val), -1));
+    } // if
+
+    add_ir_stmt(ctx, &list, join);
+
+    if (!ctx->out_of_memory)
+    {
+        // root is somebody's child, so rewrite it in place.
+        MOJOSHADER_irStatement *unrolled = seq_ir_stmts(ctx, list.stmts, list.count);
+        if (unrolled->ir.type == MOJOSHADER_IR_SEQ)
+        {
+            root->seq.first = unrolled->seq.first;
+            root->seq.next = unrolled->seq.next;
+        } // if
+        else
+        {
+            root->seq.first = unrolled;
+            root->seq.next = NULL;
+        } // else
+    } // if
+
+    if (list.stmts != NULL)
+        Free(ctx, list.stmts);
+    if (scan.labels != NULL)
+        Free(ctx, scan.labels);
+    Free(ctx, map.labels);
+} // unroll_ir_loop
+
+static void unroll_ir_loops(Context *ctx)
+{
+    const IrLoop *loop;
+    for (loop = ctx->ir_loops; loop != NULL; loop = loop->next)
+        unroll_ir_loop(ctx, loop);
+} // unroll_ir_loops
+
+
+// Constant folding...
+
+// Does the math for a BINOP with two constant operands. Returns NULL if it
+//  can't or shouldn't happen at compile time (like division by zero), in
+//  which case the BINOP stays where it is.
+static MOJOSHADER_irExpression *fold_ir_binop(Context *ctx,
+                                              const MOJOSHADER_irBinOp *binop)
+{
+    const MOJOSHADER_irConstant *l = &binop->left->constant;
+    const MOJOSHADER_irConstant *r = &binop->right->constant;
+    const MOJOSHADER_astDataTypeType type = binop->info.type;
+    const int elems = binop->info.elements;
+    MOJOSHADER_irConstant folded;
+    int i;
+
+    if ( (!ir_simple_type(type)) || (l->info.type != type) ||
+         (r->info.type != type) || (l->info.elements != elems) ||
+         (r->info.elements != elems) )
+        return NULL;
+
+    for (i = 0; i < elems; i++)
+    {
+        if (ir_float_type(type))
+        {
+            const float a = l->value.fval[i];
+            const float b = r->value.fval[i];
+            float val = 0.0f;
+            switch (binop->op)
+            {
+                case MOJOSHADER_IR_BINOP_ADD: val = a + b; break;
+                case MOJOSHADER_IR_BINOP_SUBTRACT: val = a - b; break;
+                case MOJOSHADER_IR_BINOP_MULTIPLY: val = a * b; break;
+                case MOJOSHADER_IR_BINOP_DIVIDE:
+                    if (b == 0.0f)
+                        return NULL;
+                    val = a / b;
+                    break;
+                case MOJOSHADER_IR_BINOP_MODULO:
+                    if (b == 0.0f)
+                        return NULL;
+                    val = fmodf(a, b);
+                    break;
+                default: return NULL;  // bitwise ops on floats? Leave it.
+            } // switch
+            folded.value.fval[i] = val;
+        } // if
+
+        else if (type == MOJOSHADER_AST_DATATYPE_BOOL)
+        {
+            const int a = l->value.ival[i];
+            const int b = r->value.ival[i];
+            switch (binop->op)
+            {
+                case MOJOSHADER_IR_BINOP_AND: folded.value.ival[i] = a & b; break;
+                case MOJOSHADER_IR_BINOP_OR: folded.value.ival[i] = a | b; break;
+                case MOJOSHADER_IR_BINOP_XOR: folded.value.ival[i] = a ^ b; break;
+                default: return NULL;
+            } // switch
+        } // else if
+
+        else  // int or uint. Do it unsigned, so overflow wraps like the GPU.
+        {
+            const int issigned = (type == MOJOSHADER_AST_DATATYPE_INT);
+            const uint32 a = (uint32) l->value.ival[i];
+            const uint32 b = (uint32) r->value.ival[i];
+            uint32 val = 0;
+            switch (binop->op)
+            {
+                case MOJOSHADER_IR_BINOP_ADD: val = a + b; break;
+                case MOJOSHADER_IR_BINOP_SUBTRACT: val = a - b; break;
+                case MOJOSHADER_IR_BINOP_MULTIPLY: val = a * b; break;
+                case MOJOSHADER_IR_BINOP_AND: val = a & b; break;
+                case MOJOSHADER_IR_BINOP_OR: val = a | b; break;
+                case MOJOSHADER_IR_BINOP_XOR: val = a ^ b; break;
+
+                case MOJOSHADER_IR_BINOP_DIVIDE:
+                case MOJOSHADER_IR_BINOP_MODULO:
+                    if (b == 0)
+                        return NULL;
+                    else if (!issigned)
+                        val = (binop->op == MOJOSHADER_IR_BINOP_DIVIDE) ? (a / b) : (a % b);
+                    else if ((a == 0x80000000) && (b == 0xFFFFFFFF))
+                        return NULL;  // INT_MIN / -1 overflows.
+                    else if (binop->op == MOJOSHADER_IR_BINOP_DIVIDE)
+                        val = (uint32) (((int32) a) / ((int32) b));
+                    else
+                        val = (uint32) (((int32) a) % ((int32) b));
+                    break;
+
+                case MOJOSHADER_IR_BINOP_LSHIFT:
+                case MOJOSHADER_IR_BINOP_RSHIFT:
+                    if (b > 31)
+                        return NULL;  // undefined, let the hardware decide.
+                    else if (binop->op == MOJOSHADER_IR_BINOP_LSHIFT)
+                        val = a << b;
+                    else if (issigned)
+                        val = (uint32) (((int32) a) >> b);
+                    else
+                        val = a >> b;
+                    break;
+
+                default: return NULL;
+            } // switch
+            folded.value.ival[i] = (int) val;
+        } // else
+    } // for
+
+    ir_position(ctx, binop);
+    MOJOSHADER_irExpression *retval = new_ir_constant(ctx, type, elems);
+    if (retval != NULL)
+        retval->constant.value = folded.value;
+    return retval;
+} // fold_ir_binop
+
+static MOJOSHADER_irExpression *fold_ir_convert(Context *ctx,
+                                                const MOJOSHADER_irConvert *convert)
+{
+    const MOJOSHADER_irConstant *src = &convert->expr->constant;
+    const MOJOSHADER_astDataTypeType srctype = src->info.type;
+    const MOJOSHADER_astDataTypeType type = convert->info.type;
+    const int srcelems = src->info.elements;
+    const int elems = convert->info.elements;
+    MOJOSHADER_irConstant folded;
+    int i;
+
+    if ((!ir_simple_type(srctype)) || (!ir_simple_type(type)))
+        return NULL;
+    else if ((srcelems != 1) && (srcelems < elems))
+        return NULL;  // only splats and truncations.
+
+    for (i = 0; i < elems; i++)
+    {
+        const int idx = (srcelems == 1) ? 0 : i;  // scalars get splatted.
+        if (ir_float_type(srctype))
+        {
+            const float f = src->value.fval[idx];
+            if (ir_float_type(type))
+                folded.value.fval[i] = f;
+            else if (type == MOJOSHADER_AST_DATATYPE_BOOL)
+                folded.value.ival[i] = (f != 0.0f) ? 1 : 0;
+            else if (type == MOJOSHADER_AST_DATATYPE_UINT)
+            {
+                if (!((f > -1.0f) && (f < 4294967296.0f)))
+                    return NULL;  // out of range (or NaN).
+                folded.value.ival[i] = (int) ((uint32) f);
+            } // else if
+            else
+            {
+                if (!((f >= -2147483648.0f) && (f < 2147483648.0f)))
+                    return NULL;  // out of range (or NaN).
+                folded.value.ival[i] = (int) f;
+            } // else
+        } // if
+        else
+        {
+            const int val = src->value.ival[idx];
+            if (!ir_float_type(type))
+                folded.value.ival[i] = (type == MOJOSHADER_AST_DATATYPE_BOOL) ? (val != 0) : val;
+            else if (srctype == MOJOSHADER_AST_DATATYPE_UINT)
+                folded.value.fval[i] = (float) ((uint32) val);
+            else
+                folded.value.fval[i] = (float) val;
+        } // else
+    } // for
+
+    ir_position(ctx, convert);
+    MOJOSHADER_irExpression *retval = new_ir_constant(ctx, type, elems);
+    if (retval != NULL)
+        retval->constant.value = folded.value;
+    return retval;
+} // fold_ir_convert
+
+static MOJOSHADER_irExpression *fold_ir_swizzle(Context *ctx,
+                                                const MOJOSHADER_irSwizzle *swizzle)
+{
+    const MOJOSHADER_irConstant *src = &swizzle->expr->constant;
+    const int elems = swizzle->info.elements;
+    int i;
+
+    if ((src->info.type != swizzle->info.type) || (elems > 4))
+        return NULL;
+
+    for (i = 0; i < elems; i++)
+    {
+        if (swizzle->channels[i] >= src->info.elements)
+            return NULL;
+    } // for
+
+    ir_position(ctx, swizzle);
+    MOJOSHADER_irExpression *retval = new_ir_constant(ctx, swizzle->info.type, elems);
+    if (retval != NULL)
+    {
+        for (i = 0; i < elems; i++)  // ival copies float bits, too.
+            retval->constant.value.ival[i] = src->value.ival[(int) swizzle->channels[i]];
+    } // if
+    return retval;
+} // fold_ir_swizzle
+
+static MOJOSHADER_irExpression *fold_ir_construct(Context *ctx,
+                                                  const MOJOSHADER_irConstruct *construct)
+{
+    const MOJOSHADER_irExprList *args = NULL;
+    const int elems = construct->info.elements;
+    MOJOSHADER_irConstant folded;
+    int total = 0;
+    int i;
+
+    for (args = construct->args; args != NULL; args = args->next)
+    {
+        const MOJOSHADER_irExpression *arg = args->expr;
+        if ( (arg->ir.type != MOJOSHADER_IR_CONSTANT) ||
+             (arg->info.type != construct->info.type) ||
+             ((total + arg->info.elements) > elems) )
+            return NULL;
+
+        for (i = 0; i < arg->info.elements; i++)  // ival copies float bits, too.
+            folded.value.ival[total++] = arg->constant.value.ival[i];
+    } // for
+
+    if (total != elems)
+        return NULL;
+
+    ir_position(ctx, construct);
+    MOJOSHADER_irExpression *retval = new_ir_constant(ctx, construct->info.type, elems);
+    if (retval != NULL)
+        retval->constant.value = folded.value;
+    return retval;
+} // fold_ir_construct
+
+// Returns 1 if the condition is true, 0 if false, -1 if we can't tell.
+static int fold_ir_condition(const MOJOSHADER_irCJump *cjump)
+{
+    const MOJOSHADER_irExpression *left = cjump->left;
+    const MOJOSHADER_irExpression *right = cjump->right;
+    const MOJOSHADER_astDataTypeType type = left->info.type;
+    int cmp = 0;
+
+    if ( (left->ir.type != MOJOSHADER_IR_CONSTANT) ||
+         (right->ir.type != MOJOSHADER_IR_CONSTANT) ||
+         (right->info.type != type) || (!ir_simple_type(type)) ||
+         (left->info.elements != 1) || (right->info.elements != 1) )
+        return -1;
+
+    if (ir_float_type(type))
+    {
+        const float a = left->constant.value.fval[0];
+        const float b = right->constant.value.fval[0];
+        if ((a != a) || (b != b))
+            return -1;  // NaN; let the hardware sort it out.
+        cmp = (a < b) ? -1 : ((a > b) ? 1 : 0);
+    } // if
+    else if (type == MOJOSHADER_AST_DATATYPE_UINT)
+    {
+        const uint32 a = (uint32) left->constant.value.ival[0];
+        const uint32 b = (uint32) right->constant.value.ival[0];
+        cmp = (a < b) ? -1 : ((a > b) ? 1 : 0);
+    } // else if
+    else
+    {
+        const int a = left->constant.value.ival[0];
+        const int b = right->constant.value.ival[0];
+        cmp = (a < b) ? -1 : ((a > b) ? 1 : 0);
+    } // else
+
+    switch (cjump->cond)
+    {
+        case MOJOSHADER_IR_COND_EQL: return (cmp == 0);
+        case MOJOSHADER_IR_COND_NEQ: return (cmp != 0);
+        case MOJOSHADER_IR_COND_LT: return (cmp < 0);
+        case MOJOSHADER_IR_COND_GT: return (cmp > 0);
+        case MOJOSHADER_IR_COND_LEQ: return (cmp <= 0);
+        case MOJOSHADER_IR_COND_GEQ: return (cmp >= 0);
+        default: return -1;
+    } // switch
+} // fold_ir_condition
+
+// The IR version of expr_is_constant(): after we fold an expression's
+//  children, it's constant if they all turned into CONSTANT nodes.
+static inline int ir_expr_is_constant(const MOJOSHADER_irExpression *expr)
+{
+    return ((expr != NULL) && (expr->ir.type == MOJOSHADER_IR_CONSTANT));
+} // ir_expr_is_constant
+
+// Folds everything under (_ir), bottom up, and returns what should replace
+//  it: the same node, or a new CONSTANT (or JUMP, for a CJUMP we can
+//  decide now). If (temps) isn't NULL, reads of any temp with a non-NULL
+//  entry in it get replaced with that entry first.
+static void *fold_ir(Context *ctx, void *_ir, MOJOSHADER_irExpression **temps)
+{
+    MOJOSHADER_irNode *ir = (MOJOSHADER_irNode *) _ir;
+    MOJOSHADER_irNode *retval = ir;
+    MOJOSHADER_irExpression *folded = NULL;
+    MOJOSHADER_irExprList *args = NULL;
+    int allconst = 1;
+
+    if ((ir == NULL) || (ctx->out_of_memory))
+        return ir;
+
+    #define FOLD_IR(typ, field) ir->field = (typ *) fold_ir(ctx, ir->field, temps)
+    switch (ir->ir.type)
+    {
+        case MOJOSHADER_IR_BINOP:
+            FOLD_IR(MOJOSHADER_irExpression, expr.binop.left);
+            FOLD_IR(MOJOSHADER_irExpression, expr.binop.right);
+            if ( (ir_expr_is_constant(ir->expr.binop.left)) &&
+                 (ir_expr_is_constant(ir->expr.binop.right)) )
+                folded = fold_ir_binop(ctx, &ir->expr.binop);
+            break;
+
+        case MOJOSHADER_IR_CONVERT:
+            FOLD_IR(MOJOSHADER_irExpression, expr.convert.expr);
+            if (ir_expr_is_constant(ir->expr.convert.expr))
+                folded = fold_ir_convert(ctx, &ir->expr.convert);
+            break;
+
+        case MOJOSHADER_IR_SWIZZLE:
+            FOLD_IR(MOJOSHADER_irExpression, expr.swizzle.expr);
+            if (ir_expr_is_constant(ir->expr.swizzle.expr))
+                folded = fold_ir_swizzle(ctx, &ir->expr.swizzle);
+            break;
+
+        case MOJOSHADER_IR_CONSTRUCT:
+            for (args = ir->expr.construct.args; args != NULL; args = args->next)
+            {
+                args->expr = (MOJOSHADER_irExpression *) fold_ir(ctx, args->expr, temps);
+                allconst = allconst && ir_expr_is_constant(args->expr);
+            } // for
+            if (allconst)
+                folded = fold_ir_construct(ctx, &ir->expr.construct);
+            break;
+
+        case MOJOSHADER_IR_CALL:
+            for (args = ir->expr.call.args; args != NULL; args = args->next)
+                args->expr = (MOJOSHADER_irExpression *) fold_ir(ctx, args->expr, temps);
+            break;
+
+        case MOJOSHADER_IR_ESEQ:
+            FOLD_IR(MOJOSHADER_irStatement, expr.eseq.stmt);
+            FOLD_IR(MOJOSHADER_irExpression, expr.eseq.expr);
+            if (ir->expr.eseq.stmt == NULL)  // nothing to do first? Just the value, then.
+            {
+                folded = ir->expr.eseq.expr;
+                folded->info.type = ir->expr.eseq.info.type;
+                folded->info.elements = ir->expr.eseq.info.elements;
+            } // if
+            break;
+
+        case MOJOSHADER_IR_ARRAY:
+            FOLD_IR(MOJOSHADER_irExpression, expr.array.array);
+            FOLD_IR(MOJOSHADER_irExpression, expr.array.element);
+            break;
+
+        case MOJOSHADER_IR_TEMP:
+            if (temps != NULL)
+            {
+                MOJOSHADER_irExpression *val = temps[ir->expr.temp.index];
+                if ( (val != NULL) && (val->info.type == ir->expr.info.type) &&
+                     (val->info.elements == ir->expr.info.elements) )
+                    retval = (MOJOSHADER_irNode *) val;
+            } // if
+            break;
+
+        case MOJOSHADER_IR_MOVE:
+            // dst is an lvalue; only an array index in there can change.
+            if (ir->stmt.move.dst->ir.type == MOJOSHADER_IR_ARRAY)
+                FOLD_IR(MOJOSHADER_irExpression, stmt.move.dst->array.element);
+            FOLD_IR(MOJOSHADER_irExpression, stmt.move.src);
+            break;
+
+        case MOJOSHADER_IR_EXPR_STMT:
+            FOLD_IR(MOJOSHADER_irExpression, stmt.expr.expr);
+            break;
+
+        case MOJOSHADER_IR_CJUMP:
+        {
+            FOLD_IR(MOJOSHADER_irExpression, stmt.cjump.left);
+            FOLD_IR(MOJOSHADER_irExpression, stmt.cjump.right);
+            const int cond = fold_ir_condition(&ir->stmt.cjump);
+            if (cond >= 0)
+            {
+                ir_position(ctx, ir);
+                retval = (MOJOSHADER_irNode *) new_ir_jump(ctx,
+                        cond ? ir->stmt.cjump.iftrue : ir->stmt.cjump.iffalse);
+                if (retval == NULL)
+                    retval = ir;  // out of memory, leave it.
+            } // if
+            break;
+        } // case
+
+        case MOJOSHADER_IR_SEQ:
+            // SEQs chain a whole function together, so don't recurse on next.
+            while (1)
+            {
+                MOJOSHADER_irStatement *next = ir->stmt.seq.next;
+                FOLD_IR(MOJOSHADER_irStatement, stmt.seq.first);
+                if ((next == NULL) || (next->ir.type != MOJOSHADER_IR_SEQ))
+                {
+                    FOLD_IR(MOJOSHADER_irStatement, stmt.seq.next);
+                    break;
+                } // if
+                ir = (MOJOSHADER_irNode *) next;
+            } // while
+            break;
+
+        default:  // CONSTANT, MEMORY, JUMP, LABEL, DISCARD.
+            break;
+    } // switch
+    #undef FOLD_IR
+
+    if (folded != NULL)
+        retval = (MOJOSHADER_irNode *) folded;
+    return retval;
+} // fold_ir
+
+static void fold_ir_constants(Context *ctx)
+{
+    int i;
+    for (i = 0; i <= ctx->user_func_index; i++)
+        ctx->ir[i] = (MOJOSHADER_irStatement *) fold_ir(ctx, ctx->ir[i], NULL);
+} // fold_ir_constants
+
+
+// Common subexpression elimination...
+//
+// This works on straight-line code: we walk a function's statements in
+//  order, remembering the pure expressions we've seen, and when one shows
+//  up again before anything it reads changes, we reuse the earlier value
+//  instead. If the earlier value was the whole source of a move to a temp,
+//  we just read that temp. Otherwise we hoist the earlier expression into a
+//  new temp right before the statement it was in. Labels, jumps, calls and
+//  anything with an ESEQ in it end the run, since we don't track what
+//  happens across them.
+
+#define MAX_CSE_EXPRS 64
+
+typedef struct CseExpr
+{
+    MOJOSHADER_irExpression *expr;
+    MOJOSHADER_irExpression **slot;  // where (expr) lives, if not in a temp.
+    int stmt;  // index (in the output list) of the statement with (slot).
+    int temp;  // temp that holds (expr)'s value, or -1.
+} CseExpr;
+
+typedef struct CseState
+{
+    IrStmtList *list;
+    CseExpr exprs[MAX_CSE_EXPRS];
+    int count;
+} CseState;
+
+static int ir_exprs_match(const MOJOSHADER_irExpression *a,
+                          const MOJOSHADER_irExpression *b)
+{
+    const MOJOSHADER_irExprList *aargs = NULL;
+    const MOJOSHADER_irExprList *bargs = NULL;
+
+    if ( (a->ir.type != b->ir.type) || (a->info.type != b->info.type) ||
+         (a->info.elements != b->info.elements) )
+        return 0;
+
+    switch (a->ir.type)
+    {
+        case MOJOSHADER_IR_CONSTANT:  // ival compares float bits, too.
+            return (memcmp(a->constant.value.ival, b->constant.value.ival,
+                           sizeof (int) * a->info.elements) == 0);
+        case MOJOSHADER_IR_TEMP:
+            return (a->temp.index == b->temp.index);
+        case MOJOSHADER_IR_MEMORY:
+            return (a->memory.index == b->memory.index);
+        case MOJOSHADER_IR_BINOP:
+            return ( (a->binop.op == b->binop.op) &&
+                     (ir_exprs_match(a->binop.left, b->binop.left)) &&
+                     (ir_exprs_match(a->binop.right, b->binop.right)) );
+        case MOJOSHADER_IR_CONVERT:
+            return ir_exprs_match(a->convert.expr, b->convert.expr);
+        case MOJOSHADER_IR_SWIZZLE:
+            return ( (memcmp(a->swizzle.channels, b->swizzle.channels,
+                             a->info.elements) == 0) &&
+                     (ir_exprs_match(a->swizzle.expr, b->swizzle.expr)) );
+        case MOJOSHADER_IR_CONSTRUCT:
+            aargs = a->construct.args;
+            bargs = b->construct.args;
+            while ((aargs != NULL) && (bargs != NULL))
+            {
+                if (!ir_exprs_match(aargs->expr, bargs->expr))
+                    return 0;
+                aargs = aargs->next;
+                bargs = bargs->next;
+            } // while
+            return ((aargs == NULL) && (bargs == NULL));
+        default:
+            return 0;
+    } // switch
+} // ir_exprs_match
+
+// Non-zero if (expr) is worth remembering: a computation (not just a
+//  constant or a load) made of nothing but pure operators over scalar,
+//  vector and matrix values.
+static int ir_cse_candidate(const MOJOSHADER_irExpression *expr, const int top)
+{
+    const MOJOSHADER_irExprList *args = NULL;
+
+    if (!ir_simple_type(expr->info.type))
+        return 0;
+
+    switch (expr->ir.type)
+    {
+        case MOJOSHADER_IR_CONSTANT:
+        case MOJOSHADER_IR_TEMP:
+        case MOJOSHADER_IR_MEMORY:
+            return !top;
+        case MOJOSHADER_IR_BINOP:
+            return ( ir_cse_candidate(expr->binop.left, 0) &&
+                     ir_cse_candidate(expr->binop.right, 0) );
+        case MOJOSHADER_IR_CONVERT:
+            return ir_cse_candidate(expr->convert.expr, 0);
+        case MOJOSHADER_IR_SWIZZLE:
+            return ir_cse_candidate(expr->swizzle.expr, 0);
+        case MOJOSHADER_IR_CONSTRUCT:
+            for (args = expr->construct.args; args != NULL; args = args->next)
+            {
+                if (!ir_cse_candidate(args->expr, 0))
+                    return 0;
+            } // for
+            return 1;
+        default:
+            return 0;
+    } // switch
+} // ir_cse_candidate
+
+// Non-zero if (expr) reads a TEMP or MEMORY node (type) with (index).
+static int ir_expr_reads(const MOJOSHADER_irExpression *expr,
+                         const MOJOSHADER_irNodeType type, const int index)
+{
+    const MOJOSHADER_irExprList *args = NULL;
+
+    switch (expr->ir.type)
+    {
+        case MOJOSHADER_IR_TEMP:
+            return ((type == MOJOSHADER_IR_TEMP) && (expr->temp.index == index));
+        case MOJOSHADER_IR_MEMORY:
+            return ((type == MOJOSHADER_IR_MEMORY) && (expr->memory.index == index));
+        case MOJOSHADER_IR_BINOP:
+            return ( ir_expr_reads(expr->binop.left, type, index) ||
+                     ir_expr_reads(expr->binop.right, type, index) );
+        case MOJOSHADER_IR_CONVERT:
+            return ir_expr_reads(expr->convert.expr, type, index);
+        case MOJOSHADER_IR_SWIZZLE:
+            return ir_expr_reads(expr->swizzle.expr, type, index);
+        case MOJOSHADER_IR_CONSTRUCT:
+            for (args = expr->construct.args; args != NULL; args = args->next)
+            {
+                if (ir_expr_reads(args->expr, type, index))
+                    return 1;
+            } // for
+            return 0;
+        default:
+            return 0;
+    } // switch
+} // ir_expr_reads
+
+// Non-zero if (slot) is one of the child pointers somewhere inside (expr).
+static int ir_expr_has_slot(MOJOSHADER_irExpression *expr,
+                            MOJOSHADER_irExpression **slot)
+{
+    MOJOSHADER_irExprList *args = NULL;
+
+    switch (expr->ir.type)
+    {
+        case MOJOSHADER_IR_BINOP:
+            return ( (slot == &expr->binop.left) || (slot == &expr->binop.right) ||
+                     ir_expr_has_slot(expr->binop.left, slot) ||
+                     ir_expr_has_slot(expr->binop.right, slot) );
+        case MOJOSHADER_IR_CONVERT:
+            return ( (slot == &expr->convert.expr) ||
+                     ir_expr_has_slot(expr->convert.expr, slot) );
+        case MOJOSHADER_IR_SWIZZLE:
+            return ( (slot == &expr->swizzle.expr) ||
+                     ir_expr_has_slot(expr->swizzle.expr, slot) );
+        case MOJOSHADER_IR_CONSTRUCT:
+            for (args = expr->construct.args; args != NULL; args = args->next)
+            {
+                if ((slot == &args->expr) || ir_expr_has_slot(args->expr, slot))
+                    return 1;
+            } // for
+            return 0;
+        default:
+            return 0;
+    } // switch
+} // ir_expr_has_slot
+
+static inline void cse_forget(CseState *cse, const int idx)
+{
+    cse->exprs[idx] = cse->exprs[--cse->count];
+} // cse_forget
 
-        case MOJOSHADER_IR_SEQ:
-            delete_ir(ctx, ir->stmt.seq.first);
-            delete_ir(ctx, ir->stmt.seq.next);  // !!! FIXME: don't recurse?
+// A write to TEMP or MEMORY (index) invalidates everything that reads it.
+static void cse_kill(CseState *cse, const MOJOSHADER_irNodeType type,
+                     const int index)
+{
+    int i = 0;
+    while (i < cse->count)
+    {
+        const CseExpr *item = &cse->exprs[i];
+        if ( ((type == MOJOSHADER_IR_TEMP) && (item->temp == index)) ||
+             (ir_expr_reads(item->expr, type, index)) )
+            cse_forget(cse, i);
+        else
+            i++;
+    } // while
+} // cse_kill
+
+// Moves (item)'s expression into a new temp, set right before the statement
+//  it came from, so (item) can be reused from there on.
+static int cse_hoist(Context *ctx, CseState *cse, CseExpr *item)
+{
+    IrStmtList *list = cse->list;
+    MOJOSHADER_irExpression *expr = item->expr;
+    const int temp = generate_ir_temp(ctx);
+    const int pos = item->stmt;
+    int i;
+
+    ir_position(ctx, expr);
+    MOJOSHADER_irExpression *dst = new_ir_temp(ctx, temp, expr->info.type, expr->info.elements);
+    MOJOSHADER_irExpression *src = new_ir_temp(ctx, temp, expr->info.type, expr->info.elements);
+    MOJOSHADER_irStatement *move = new_ir_move(ctx, dst, expr, -1);
+    if ((src == NULL) || (move == NULL))
+        return 0;
+    else if (!add_ir_stmt(ctx, list, NULL))  // make room.
+        return 0;
+
+    memmove(&list->stmts[pos+1], &list->stmts[pos],
+            sizeof (MOJOSHADER_irStatement *) * (list->count - (pos+1)));
+    list->stmts[pos] = move;
+    *item->slot = src;
+    item->slot = NULL;
+    item->temp = temp;
+
+    // Everything from the old statement on moved down a slot, and anything
+    //  we remembered from inside (expr) is in the new move now. Just forget
+    //  those; they'd have matched before (expr) did.
+    i = 0;
+    while (i < cse->count)
+    {
+        CseExpr *other = &cse->exprs[i];
+        if ((other->slot != NULL) && (ir_expr_has_slot(expr, other->slot)))
+            cse_forget(cse, i);
+        else
+        {
+            if ((other->slot != NULL) && (other->stmt >= pos))
+                other->stmt++;
+            i++;
+        } // else
+    } // while
+
+    return 1;
+} // cse_hoist
+
+// Walks (*slot) bottom up, replacing anything we've seen before with a
+//  temp, and remembering anything we haven't. The statement this is in
+//  has to be the last one in the output list.
+static void cse_expr(Context *ctx, CseState *cse, MOJOSHADER_irExpression **slot)
+{
+    MOJOSHADER_irExpression *expr = *slot;
+    MOJOSHADER_irExprList *args = NULL;
+    int i;
+
+    switch (expr->ir.type)
+    {
+        case MOJOSHADER_IR_BINOP:
+            cse_expr(ctx, cse, &expr->binop.left);
+            cse_expr(ctx, cse, &expr->binop.right);
             break;
+        case MOJOSHADER_IR_CONVERT:
+            cse_expr(ctx, cse, &expr->convert.expr);
+            break;
+        case MOJOSHADER_IR_SWIZZLE:
+            cse_expr(ctx, cse, &expr->swizzle.expr);
+            break;
+        case MOJOSHADER_IR_CONSTRUCT:
+            for (args = expr->construct.args; args != NULL; args = args->next)
+                cse_expr(ctx, cse, &args->expr);
+            break;
+        case MOJOSHADER_IR_ARRAY:
+            cse_expr(ctx, cse, &expr->array.array);
+            cse_expr(ctx, cse, &expr->array.element);
+            return;  // not a candidate itself, array elements change a lot.
+        default:
+            return;  // leaves (or things we don't touch).
+    } // switch
 
-        case MOJOSHADER_IR_EXPRLIST:
-            delete_ir(ctx, ir->misc.exprlist.expr);
-            delete_ir(ctx, ir->misc.exprlist.next);  // !!! FIXME: don't recurse?
+    if (!ir_cse_candidate(expr, 1))
+        return;
+
+    for (i = 0; i < cse->count; i++)
+    {
+        CseExpr *item = &cse->exprs[i];
+        if (ir_exprs_match(item->expr, expr))
+        {
+            if ((item->temp < 0) && (!cse_hoist(ctx, cse, item)))
+                return;  // out of memory.
+            ir_position(ctx, expr);
+            MOJOSHADER_irExpression *temp = new_ir_temp(ctx, item->temp, expr->info.type, expr->info.elements);
+            if (temp != NULL)
+                *slot = temp;
+            return;
+        } // if
+    } // for
+
+    if (cse->count < MAX_CSE_EXPRS)
+    {
+        CseExpr *item = &cse->exprs[cse->count++];
+        item->expr = expr;
+        item->slot = slot;
+        item->stmt = cse->list->count - 1;
+        item->temp = -1;
+    } // if
+} // cse_expr
+
+static void cse_stmt(Context *ctx, CseState *cse, MOJOSHADER_irStatement *stmt)
+{
+    MOJOSHADER_irExpression *dst = NULL;
+    int i;
+
+    switch (stmt->ir.type)
+    {
+        case MOJOSHADER_IR_MOVE:
+            dst = stmt->move.dst;
+            if ((!ir_expr_is_pure(dst)) || (!ir_expr_is_pure(stmt->move.src)))
+            {
+                cse->count = 0;
+                return;
+            } // if
+
+            if (dst->ir.type == MOJOSHADER_IR_ARRAY)
+                cse_expr(ctx, cse, &dst->array.element);
+            cse_expr(ctx, cse, &stmt->move.src);
+
+            if (!ir_simple_type(dst->info.type))
+                cse->count = 0;  // might be a struct, with members we track.
+            else if (dst->ir.type == MOJOSHADER_IR_MEMORY)
+                cse_kill(cse, MOJOSHADER_IR_MEMORY, dst->memory.index);
+            else if (dst->ir.type == MOJOSHADER_IR_TEMP)
+            {
+                cse_kill(cse, MOJOSHADER_IR_TEMP, dst->temp.index);
+                if (stmt->move.writemask != -1)
+                    break;
+
+                // if we're still remembering the source, it's in this temp now.
+                for (i = 0; i < cse->count; i++)
+                {
+                    CseExpr *item = &cse->exprs[i];
+                    if (item->slot == &stmt->move.src)
+                    {
+                        item->slot = NULL;
+                        item->temp = dst->temp.index;
+                        break;
+                    } // if
+                } // for
+            } // else if
+            else
+                cse->count = 0;  // array element (or worse), give up.
             break;
 
-        case MOJOSHADER_IR_SWIZZLE:
-            delete_ir(ctx, ir->expr.swizzle.expr);
+        case MOJOSHADER_IR_EXPR_STMT:
+            if (ir_expr_is_pure(stmt->expr.expr))
+                cse_expr(ctx, cse, &stmt->expr.expr);
+            else
+                cse->count = 0;
             break;
 
-        case MOJOSHADER_IR_CONSTRUCT:
-            delete_ir(ctx, ir->expr.construct.args);
+        case MOJOSHADER_IR_CJUMP:
+            if ( (ir_expr_is_pure(stmt->cjump.left)) &&
+                 (ir_expr_is_pure(stmt->cjump.right)) )
+            {
+                cse_expr(ctx, cse, &stmt->cjump.left);
+                cse_expr(ctx, cse, &stmt->cjump.right);
+            } // if
+            cse->count = 0;  // leaving straight-line code.
             break;
 
-        case MOJOSHADER_IR_CONVERT:
-            delete_ir(ctx, ir->expr.convert.expr);
+        case MOJOSHADER_IR_DISCARD:
             break;
 
-        default: assert(0 && "unexpected IR node"); break;
+        default:  // LABEL, JUMP
+            cse->count = 0;
+            break;
     } // switch
+} // cse_stmt
 
-    Free(ctx, ir);
-} // delete_ir
-
-static void intermediate_representation(Context *ctx)
+static void eliminate_ir_subexpressions(Context *ctx)
 {
-    const MOJOSHADER_astCompilationUnit *ast = NULL;
-    const MOJOSHADER_astCompilationUnitFunction *astfn = NULL;
-    const size_t arraylen = (ctx->user_func_index+1) * sizeof (MOJOSHADER_irStatement *);
+    IrStmtList input;
+    IrStmtList output;
+    CseState cse;
+    int i, j;
 
-    ctx->ir = Malloc(ctx, arraylen);
-    if (ctx->ir == NULL)
-        return;
-    memset(ctx->ir, '\0', arraylen);
+    memset(&input, '\0', sizeof (input));
+    memset(&output, '\0', sizeof (output));
+    for (i = 0; i <= ctx->user_func_index; i++)
+    {
+        input.count = output.count = 0;
+        if ((ctx->ir[i] == NULL) || (!flatten_ir_stmts(ctx, &input, ctx->ir[i])))
+            continue;
 
-    ctx->ir_end = -1;
-    ctx->ir_ret = -1;
+        cse.list = &output;
+        cse.count = 0;
+        for (j = 0; j < input.count; j++)
+        {
+            if (!add_ir_stmt(ctx, &output, input.stmts[j]))
+                break;
+            cse_stmt(ctx, &cse, input.stmts[j]);
+        } // for
 
-    for (ast = &ctx->ast->compunit; ast != NULL; ast = ast->next)
+        if (!ctx->out_of_memory)
+            ctx->ir[i] = seq_ir_stmts(ctx, output.stmts, output.count);
+    } // for
+
+    if (input.stmts != NULL)
+        Free(ctx, input.stmts);
+    if (output.stmts != NULL)
+        Free(ctx, output.stmts);
+} // eliminate_ir_subexpressions
+
+
+// Dead code elimination...
+
+typedef struct IrUsage
+{
+    int *temp_reads;  // how many times each temp is read.
+    int *temp_writes;  // how many times each temp is written.
+    MOJOSHADER_irExpression **temp_values;  // a temp's CONSTANT or TEMP source.
+    int *label_refs;  // how many jumps go to each label.
+    int complex_temps;  // non-zero if there are temps of struct type.
+} IrUsage;
+
+static void count_ir_usage(MOJOSHADER_irNode *ir, void *data)
+{
+    IrUsage *usage = (IrUsage *) data;
+    const MOJOSHADER_irExprList *args = NULL;
+    switch (ir->ir.type)
     {
-        assert(ast->ast.type > MOJOSHADER_AST_COMPUNIT_START_RANGE);
-        assert(ast->ast.type < MOJOSHADER_AST_COMPUNIT_END_RANGE);
-        if (ast->ast.type != MOJOSHADER_AST_COMPUNIT_FUNCTION)
-            continue;  // only care about functions right now.
+        case MOJOSHADER_IR_TEMP:
+            usage->temp_reads[ir->expr.temp.index]++;
+            if (!ir_simple_type(ir->expr.temp.info.type))
+                usage->complex_temps = 1;
+            break;
+        case MOJOSHADER_IR_MOVE:  // writing a temp isn't reading it.
+            if (ir->stmt.move.dst->ir.type == MOJOSHADER_IR_TEMP)
+            {
+                const int idx = ir->stmt.move.dst->temp.index;
+                const MOJOSHADER_irNodeType srctype = ir->stmt.move.src->ir.type;
+                usage->temp_reads[idx]--;
+                usage->temp_writes[idx]++;
+                if ( (ir->stmt.move.writemask == -1) &&
+                     ((srctype == MOJOSHADER_IR_CONSTANT) || (srctype == MOJOSHADER_IR_TEMP)) )
+                    usage->temp_values[idx] = ir->stmt.move.src;
+            } // if
+            break;
+        case MOJOSHADER_IR_CALL:  // might be an out param, call it a write.
+            for (args = ir->expr.call.args; args != NULL; args = args->next)
+            {
+                if (args->expr->ir.type == MOJOSHADER_IR_TEMP)
+                    usage->temp_writes[args->expr->temp.index]++;
+            } // for
+            break;
+        case MOJOSHADER_IR_JUMP:
+            usage->label_refs[ir->stmt.jump.label]++;
+            break;
+        case MOJOSHADER_IR_CJUMP:
+            usage->label_refs[ir->stmt.cjump.iftrue]++;
+            usage->label_refs[ir->stmt.cjump.iffalse]++;
+            break;
+        default: break;
+    } // switch
+} // count_ir_usage
 
-        astfn = (MOJOSHADER_astCompilationUnitFunction *) ast;
-        if (astfn->definition == NULL)  // just a predeclare; skip.
+static void count_ir_uses(Context *ctx, const IrStmtList *list, const int ret,
+                          IrUsage *usage)
+{
+    int i;
+    memset(usage->temp_reads, '\0', sizeof (int) * ctx->ir_temp_count);
+    memset(usage->temp_writes, '\0', sizeof (int) * ctx->ir_temp_count);
+    memset(usage->temp_values, '\0', sizeof (MOJOSHADER_irExpression *) * ctx->ir_temp_count);
+    memset(usage->label_refs, '\0', sizeof (int) * ctx->ir_label_count);
+    usage->complex_temps = 0;
+    for (i = 0; i < list->count; i++)
+        visit_ir(list->stmts[i], count_ir_usage, usage);
+    if (ret >= 0)
+        usage->temp_reads[ret]++;  // the caller reads this.
+} // count_ir_uses
+
+// A temp that's only ever set once, to a constant or another temp that's
+//  only set once, can be replaced by that value everywhere it's read. Temps
+//  are never read before they're written (except the return value, which
+//  the caller reads), so this is safe without any real flow analysis. It's
+//  mostly here to clean up after comparisons whose result we folded: the
+//  lowering puts the answer in a temp that the branch then tests.
+//  Returns non-zero if anything changed.
+static int propagate_ir_temps(Context *ctx, IrStmtList *list, const int ret,
+                              IrUsage *usage)
+{
+    MOJOSHADER_irExpression **values = usage->temp_values;
+    int changed = 0;
+    int i;
+
+    count_ir_uses(ctx, list, ret, usage);
+    if (usage->complex_temps)
+        return 0;  // struct copies write temps we can't see; don't risk it.
+
+    for (i = 0; i < ctx->ir_temp_count; i++)
+    {
+        const MOJOSHADER_irExpression *val = values[i];
+        if (val == NULL)
             continue;
+        else if ((usage->temp_writes[i] != 1) || (i == ret))
+            values[i] = NULL;
+        else if ( (val->ir.type == MOJOSHADER_IR_TEMP) &&
+                  ((usage->temp_writes[val->temp.index] != 1) || (val->temp.index == i)) )
+            values[i] = NULL;
+        else if (usage->temp_reads[i] > 0)
+            changed = 1;
+    } // for
 
-        assert(ctx->ir_loop == NULL);  // parser should have caught this!
-        assert(ctx->ir_end < 0);  // parser should have caught this!
-        assert(ctx->ir_ret < 0);  // parser should have caught this!
-        const int start = generate_ir_label(ctx);  // !!! FIXME: store somewhere.
-        const int end = generate_ir_label(ctx);
-        ctx->ir_end = end;
+    if (changed)
+    {
+        for (i = 0; i < list->count; i++)
+            list->stmts[i] = (MOJOSHADER_irStatement *) fold_ir(ctx, list->stmts[i], values);
+    } // if
 
-        if (astfn->declaration->datatype != NULL)
-            ctx->ir_ret = generate_ir_temp(ctx);
+    return changed;
+} // propagate_ir_temps
 
-        MOJOSHADER_irStatement *funcseq = new_ir_seq(ctx, new_ir_label(ctx, start), build_ir_stmt(ctx, astfn->definition));
-        funcseq = new_ir_seq(ctx, funcseq, new_ir_label(ctx, end));
-        assert(ctx->ir_loop == NULL);  // parser should have caught this!
-        ctx->ir_end = -1;
-        ctx->ir_ret = -1;
+// One trip through a function's statements, dropping what we can. Returns
+//  non-zero if anything changed.
+static int eliminate_dead_ir(Context *ctx, IrStmtList *list, const int ret,
+                             IrUsage *usage)
+{
+    int changed = 0;
+    int unreachable = 0;
+    int count = 0;
+    int i;
 
-        assert(astfn->index <= ctx->user_func_index);
-        assert(ctx->ir[astfn->index] == NULL);
-        ctx->ir[astfn->index] = funcseq;
+    count_ir_uses(ctx, list, ret, usage);
+
+    for (i = 0; i < list->count; i++)
+    {
+        MOJOSHADER_irStatement *stmt = list->stmts[i];
+        const MOJOSHADER_irExpression *dst = NULL;
+        const MOJOSHADER_irExpression *src = NULL;
+
+        if (stmt->ir.type == MOJOSHADER_IR_LABEL)
+        {
+            const int label = stmt->label.index;
+            unreachable = 0;  // somebody might jump here.
+
+            // "jump x; x:" is just "x:"
+            MOJOSHADER_irStatement *prev = (count > 0) ? list->stmts[count-1] : NULL;
+            if ( (prev != NULL) && (prev->ir.type == MOJOSHADER_IR_JUMP) &&
+                 (prev->jump.label == label) )
+            {
+                count--;
+                usage->label_refs[label]--;
+                changed = 1;
+            } // if
+
+            if (usage->label_refs[label] == 0)
+            {
+                changed = 1;
+                continue;  // nothing jumps here, drop it.
+            } // if
+        } // if
+
+        else if ((unreachable) && (!ir_has_label(stmt)))
+        {
+            changed = 1;
+            continue;  // can't get here.
+        } // else if
+
+        else if (stmt->ir.type == MOJOSHADER_IR_MOVE)
+        {
+            dst = stmt->move.dst;
+            src = stmt->move.src;
+            if ( (dst->ir.type == MOJOSHADER_IR_TEMP) && (!usage->complex_temps) &&
+                 (usage->temp_reads[dst->temp.index] == 0) )
+            {
+                changed = 1;
+                if (ir_expr_is_pure(src))
+                    continue;  // nobody reads this temp, drop it.
+                ir_position(ctx, stmt);  // keep the side effects.
+                stmt = new_ir_expr_stmt(ctx, stmt->move.src);
+                if (stmt == NULL)
+                    stmt = list->stmts[i];  // out of memory, leave it.
+            } // if
+
+            else if ( (stmt->move.writemask == -1) && (dst->ir.type == src->ir.type) &&
+                      ((dst->ir.type == MOJOSHADER_IR_TEMP) || (dst->ir.type == MOJOSHADER_IR_MEMORY)) &&
+                      (ir_exprs_match(dst, src)) )
+            {
+                changed = 1;
+                continue;  // moving something to itself.
+            } // else if
+        } // else if
+
+        else if (stmt->ir.type == MOJOSHADER_IR_EXPR_STMT)
+        {
+            if (ir_expr_is_pure(stmt->expr.expr))
+            {
+                changed = 1;
+                continue;  // result is thrown away and nothing else happens.
+            } // if
+        } // else if
+
+        if ((stmt->ir.type == MOJOSHADER_IR_JUMP) || (stmt->ir.type == MOJOSHADER_IR_CJUMP))
+            unreachable = 1;  // until the next label.
+
+        list->stmts[count++] = stmt;
     } // for
 
-    print_whole_ir(ctx, stdout);
+    list->count = count;
+    return changed;
+} // eliminate_dead_ir
 
-    // done with the AST, nuke it.
-    // !!! FIXME: we're going to need CTAB data from this at some point.
-    delete_compilation_unit(ctx, (MOJOSHADER_astCompilationUnit *) ctx->ast);
-    ctx->ast = NULL;
-} // intermediate_representation
+static void eliminate_dead_ir_code(Context *ctx)
+{
+    const int temps = ctx->ir_temp_count + 1;
+    IrStmtList list;
+    IrUsage usage;
+    int i, j;
+
+    memset(&list, '\0', sizeof (list));
+    usage.temp_reads = (int *) Malloc(ctx, sizeof (int) * temps);
+    usage.temp_writes = (int *) Malloc(ctx, sizeof (int) * temps);
+    usage.temp_values = (MOJOSHADER_irExpression **) Malloc(ctx, sizeof (MOJOSHADER_irExpression *) * temps);
+    usage.label_refs = (int *) Malloc(ctx, sizeof (int) * (ctx->ir_label_count + 1));
+    if ( (usage.temp_reads != NULL) && (usage.temp_writes != NULL) &&
+         (usage.temp_values != NULL) && (usage.label_refs != NULL) )
+    {
+        for (i = 0; i <= ctx->user_func_index; i++)
+        {
+            // each trip can expose more (a dropped jump orphans its label,
+            //  etc), so go until it settles, within reason.
+            for (j = 0; (j < 16) && (ctx->ir[i] != NULL); j++)
+            {
+                const int ret = ctx->ir_rets[i];
+                list.count = 0;
+                if (!flatten_ir_stmts(ctx, &list, ctx->ir[i]))
+                    break;
+                int changed = propagate_ir_temps(ctx, &list, ret, &usage);
+                changed |= eliminate_dead_ir(ctx, &list, ret, &usage);
+                ctx->ir[i] = seq_ir_stmts(ctx, list.stmts, list.count);
+                if ((!changed) || (ctx->out_of_memory))
+                    break;
+            } // for
+        } // for
+    } // if
+
+    if (list.stmts != NULL)
+        Free(ctx, list.stmts);
+    if (usage.temp_reads != NULL)
+        Free(ctx, usage.temp_reads);
+    if (usage.temp_writes != NULL)
+        Free(ctx, usage.temp_writes);
+    if (usage.temp_values != NULL)
+        Free(ctx, usage.temp_values);
+    if (usage.label_refs != NULL)
+        Free(ctx, usage.label_refs);
+} // eliminate_dead_ir_code
+
+
+static void optimize_ir(Context *ctx)
+{
+    static const struct
+    {
+        const char *name;
+        void (*pass)(Context *ctx);
+    } passes[] = {
+        { "unroll", unroll_ir_loops },
+        { "fold", fold_ir_constants },
+        { "cse", eliminate_ir_subexpressions },
+        { "dce", eliminate_dead_ir_code },
+    };
+    size_t i;
+
+    if ((ctx->ir == NULL) || (ctx->ir_rets == NULL))
+        return;  // out of memory.
+
+    if (ctx->ir_trace != NULL)
+    {
+        fprintf(ctx->ir_trace, "# before optimization\n");
+        print_whole_ir(ctx, ctx->ir_trace);
+    } // if
+
+    for (i = 0; i < STATICARRAYLEN(passes); i++)
+    {
+        passes[i].pass(ctx);
+        if (ctx->out_of_memory)
+            return;
+        else if (ctx->ir_trace != NULL)
+        {
+            fprintf(ctx->ir_trace, "# after %s\n", passes[i].name);
+            print_whole_ir(ctx, ctx->ir_trace);
+        } // else if
+    } // for
+} // optimize_ir
 
 
 
@@ -6170,7 +7997,7 @@ const MOJOSHADER_astData *MOJOSHADER_parseAst(const char *srcprofile,
     if (!isfail(ctx))
     {
         parse_source(ctx, filename, source, sourcelen, defs, define_count,
-                     include_open, include_close);
+                     include_open, include_close, NULL);
     } // if
 
     if (!isfail(ctx))
@@ -6213,7 +8040,9 @@ void MOJOSHADER_freeAstData(const MOJOSHADER_astData *_data)
 } // MOJOSHADER_freeAstData
 
 
-const MOJOSHADER_compileData *MOJOSHADER_compile(const char *srcprofile,
+static const MOJOSHADER_compileData *compile(FILE *ir_trace,
+                                    MOJOSHADER_includeCache *cache,
+                                    const char *srcprofile,
                                     const char *filename, const char *source,
                                     unsigned int sourcelen,
                                     const MOJOSHADER_preprocessorDefine *defs,
@@ -6234,12 +8063,13 @@ const MOJOSHADER_compileData *MOJOSHADER_compile(const char *srcprofile,
     if (ctx == NULL)
         return &MOJOSHADER_out_of_mem_compile_data;
 
+    ctx->ir_trace = ir_trace;
     choose_src_profile(ctx, srcprofile);
 
     if (!isfail(ctx))
     {
         parse_source(ctx, filename, source, sourcelen, defs, define_count,
-                     include_open, include_close);
+                     include_open, include_close, cache);
     } // if
 
     if (!isfail(ctx))
@@ -6248,6 +8078,9 @@ const MOJOSHADER_compileData *MOJOSHADER_compile(const char *srcprofile,
     if (!isfail(ctx))
         intermediate_representation(ctx);
 
+    if (!isfail(ctx))
+        optimize_ir(ctx);
+
     if (isfail(ctx))
         retval = (MOJOSHADER_compileData *) build_failed_compile(ctx);
     else
@@ -6255,6 +8088,55 @@ const MOJOSHADER_compileData *MOJOSHADER_compile(const char *srcprofile,
 
     destroy_context(ctx);
     return retval;
+} // compile
+
+
+const MOJOSHADER_compileData *MOJOSHADER_compileWithCache(
+                                    MOJOSHADER_includeCache *cache,
+                                    const char *srcprofile,
+                                    const char *filename, const char *source,
+                                    unsigned int sourcelen,
+                                    const MOJOSHADER_preprocessorDefine *defs,
+                                    unsigned int define_count,
+                                    MOJOSHADER_includeOpen include_open,
+                                    MOJOSHADER_includeClose include_close,
+                                    MOJOSHADER_malloc m, MOJOSHADER_free f,
+                                    void *d)
+{
+    return compile(NULL, cache, srcprofile, filename, source, sourcelen, defs,
+                   define_count, include_open, include_close, m, f, d);
+} // MOJOSHADER_compileWithCache
+
+
+const MOJOSHADER_compileData *compiler_trace_ir(FILE *io,
+                                    const char *srcprofile,
+                                    const char *filename, const char *source,
+                                    unsigned int sourcelen,
+                                    const MOJOSHADER_preprocessorDefine *defs,
+                                    unsigned int define_count,
+                                    MOJOSHADER_includeOpen include_open,
+                                    MOJOSHADER_includeClose include_close,
+                                    MOJOSHADER_malloc m, MOJOSHADER_free f,
+                                    void *d)
+{
+    return compile(io, NULL, srcprofile, filename, source, sourcelen, defs,
+                   define_count, include_open, include_close, m, f, d);
+} // compiler_trace_ir
+
+
+const MOJOSHADER_compileData *MOJOSHADER_compile(const char *srcprofile,
+                                    const char *filename, const char *source,
+                                    unsigned int sourcelen,
+                                    const MOJOSHADER_preprocessorDefine *defs,
+                                    unsigned int define_count,
+                                    MOJOSHADER_includeOpen include_open,
+                                    MOJOSHADER_includeClose include_close,
+                                    MOJOSHADER_malloc m, MOJOSHADER_free f,
+                                    void *d)
+{
+    return MOJOSHADER_compileWithCache(NULL, srcprofile, filename, source,
+                                       sourcelen, defs, define_count,
+                                       include_open, include_close, m, f, d);
 } // MOJOSHADER_compile
 
 
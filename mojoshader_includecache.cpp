@@ -0,0 +1,204 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+#define __MOJOSHADER_INTERNAL__ 1
+#include "mojoshader_internal.h"
+
+#include <new>
+#include <mutex>
+
+// The include cache keeps its own copy of every header it has seen, keyed
+//  on the include type and the name from the #include line. The copies are
+//  never modified or moved once they're in the table, so the preprocessor
+//  can lex straight out of them without holding the lock.
+
+typedef struct IncludeEntry
+{
+    MOJOSHADER_includeType inctype;
+    uint32 hash;
+    unsigned int namelen;
+    const char *name;
+    const char *data;
+    unsigned int datalen;
+} IncludeEntry;
+
+struct MOJOSHADER_includeCache
+{
+    HashTable *entries;  // IncludeEntry -> IncludeEntry, owns entries.
+    std::mutex lock;
+    MOJOSHADER_malloc m;
+    MOJOSHADER_free f;
+    void *d;
+};
+
+
+static uint32 hash_hash_include(const void *key, void *data)
+{
+    (void) data;
+    return ((const IncludeEntry *) key)->hash;
+} // hash_hash_include
+
+static int hash_keymatch_include(const void *a, const void *b, void *data)
+{
+    (void) data;
+    const IncludeEntry *x = (const IncludeEntry *) a;
+    const IncludeEntry *y = (const IncludeEntry *) b;
+    return ( (x->inctype == y->inctype) && (x->namelen == y->namelen) &&
+             (memcmp(x->name, y->name, x->namelen) == 0) );
+} // hash_keymatch_include
+
+static void nuke_include(const void *ctx, const void *key,
+                         const void *value, void *data)
+{
+    MOJOSHADER_includeCache *cache = (MOJOSHADER_includeCache *) data;
+    IncludeEntry *entry = (IncludeEntry *) value;
+    cache->f((void *) entry->data, cache->d);
+    cache->f(entry, cache->d);
+} // nuke_include
+
+
+int includecache_open(MOJOSHADER_includeCache *cache,
+                      MOJOSHADER_includeType inctype, const char *fname,
+                      const char *parent, MOJOSHADER_includeOpen open_callback,
+                      MOJOSHADER_includeClose close_callback,
+                      const char **outdata, unsigned int *outbytes,
+                      MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
+{
+    const unsigned int namelen = (unsigned int) strlen(fname);
+    IncludeEntry key;
+    key.inctype = inctype;
+    key.hash = hash_string(fname, namelen) ^ ((uint32) inctype);
+    key.namelen = namelen;
+    key.name = fname;
+
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        const void *value = NULL;
+        if (hash_find(cache->entries, &key, &value))
+        {
+            const IncludeEntry *entry = (const IncludeEntry *) value;
+            *outdata = entry->data;
+            *outbytes = entry->datalen;
+            return 1;
+        } // if
+    } // guard
+
+    // Not cached yet. Open it without the lock held, since this is probably
+    //  file i/o, and copy it into the cache's own memory.
+    const char *newdata = NULL;
+    unsigned int newbytes = 0;
+    if (!open_callback(inctype, fname, parent, &newdata, &newbytes, m, f, d))
+        return 0;
+
+    // the name goes right after the data, in the same allocation.
+    IncludeEntry *entry = (IncludeEntry *) cache->m(sizeof (IncludeEntry), cache->d);
+    char *copy = (char *) cache->m((int) (newbytes + namelen + 1), cache->d);
+    if ((entry == NULL) || (copy == NULL))
+    {
+        close_callback(newdata, m, f, d);
+        if (entry != NULL)
+            cache->f(entry, cache->d);
+        if (copy != NULL)
+            cache->f(copy, cache->d);
+        return 0;
+    } // if
+
+    memcpy(copy, newdata, newbytes);
+    memcpy(copy + newbytes, fname, namelen + 1);
+    close_callback(newdata, m, f, d);
+
+    memcpy(entry, &key, sizeof (IncludeEntry));
+    entry->name = copy + newbytes;
+    entry->data = copy;
+    entry->datalen = newbytes;
+
+    std::lock_guard<std::mutex> guard(cache->lock);
+    const void *value = NULL;
+    if (hash_find(cache->entries, &key, &value))
+    {
+        // another thread beat us to it; use theirs.
+        nuke_include(NULL, entry, entry, cache);
+        entry = (IncludeEntry *) value;
+    } // if
+    else if (hash_insert(cache->entries, entry, entry) != 1)
+    {
+        nuke_include(NULL, entry, entry, cache);
+        return 0;
+    } // else if
+
+    *outdata = entry->data;
+    *outbytes = entry->datalen;
+    return 1;
+} // includecache_open
+
+
+MOJOSHADER_includeCache *MOJOSHADER_createIncludeCache(MOJOSHADER_malloc m,
+                                                       MOJOSHADER_free f,
+                                                       void *d)
+{
+    if ( ((m == NULL) && (f != NULL)) || ((m != NULL) && (f == NULL)) )
+        return NULL;  // supply both or neither.
+
+    if (m == NULL) m = MOJOSHADER_internal_malloc;
+    if (f == NULL) f = MOJOSHADER_internal_free;
+
+    MOJOSHADER_includeCache *cache = (MOJOSHADER_includeCache *)
+                                        m(sizeof (MOJOSHADER_includeCache), d);
+    if (cache == NULL)
+        return NULL;
+
+    memset((void *) cache, '\0', sizeof (MOJOSHADER_includeCache));
+    new (&cache->lock) std::mutex();
+    cache->m = m;
+    cache->f = f;
+    cache->d = d;
+
+    cache->entries = hash_create(cache, hash_hash_include,
+                                 hash_keymatch_include, nuke_include, 0,
+                                 m, f, d);
+    if (cache->entries == NULL)
+    {
+        MOJOSHADER_destroyIncludeCache(cache);
+        return NULL;
+    } // if
+
+    return cache;
+} // MOJOSHADER_createIncludeCache
+
+
+void MOJOSHADER_purgeIncludeCache(MOJOSHADER_includeCache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    std::lock_guard<std::mutex> guard(cache->lock);
+    HashTable *entries = hash_create(cache, hash_hash_include,
+                                     hash_keymatch_include, nuke_include, 0,
+                                     cache->m, cache->f, cache->d);
+    if (entries != NULL)  // if we're out of memory, just keep what we have.
+    {
+        hash_destroy(cache->entries, NULL);
+        cache->entries = entries;
+    } // if
+} // MOJOSHADER_purgeIncludeCache
+
+
+void MOJOSHADER_destroyIncludeCache(MOJOSHADER_includeCache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    MOJOSHADER_free f = cache->f;
+    void *d = cache->d;
+
+    if (cache->entries != NULL)
+        hash_destroy(cache->entries, NULL);
+    cache->lock.~mutex();
+    f(cache, d);
+} // MOJOSHADER_destroyIncludeCache
+
+// end of mojoshader_includecache.c ...
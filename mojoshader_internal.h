@@ -227,7 +227,8 @@ void MOJOSHADER_runPreshader(const MOJOSHADER_preshader*, float*);
 
 typedef unsigned int uint;  // this is a printf() helper. don't use for code.
 
-// Locale-independent float printing replacement for snprintf
+// Locale-independent float printing replacement for snprintf. Prints the
+//  shortest decimal that reads back as exactly (arg), always with a '.'.
 size_t MOJOSHADER_printFloat(char *text, size_t maxlen, float arg);
 
 #ifdef _MSC_VER
@@ -334,9 +335,15 @@ void hash_destroy(HashTable *table, const void *ctx);
 int hash_insert(HashTable *table, const void *key, const void *value);
 int hash_remove(HashTable *table, const void *key, const void *ctx);
 int hash_find(const HashTable *table, const void *key, const void **_value);
+// Same as hash_find(), but for callers that already know (key)'s hash, like
+//  the preprocessor, which hashes identifiers once as it lexes them. (hash)
+//  must be what the table's hash function would return for (key).
+int hash_find_hashed(const HashTable *table, const void *key,
+                     const uint32 hash, const void **_value);
 int hash_iter(const HashTable *table, const void *key, const void **_value, void **iter);
 int hash_iter_keys(const HashTable *table, const void **_key, void **iter);
 
+uint32 hash_string(const char *str, size_t len);
 uint32 hash_hash_string(const void *sym, void *unused);
 int hash_keymatch_string(const void *a, const void *b, void *unused);
 
@@ -402,15 +409,47 @@ char *buffer_reserve(Buffer *buffer, const size_t len);
 int buffer_append(Buffer *buffer, const void *_data, size_t len);
 int buffer_append_fmt(Buffer *buffer, const char *fmt, ...) ISPRINTF(2,3);
 int buffer_append_va(Buffer *buffer, const char *fmt, va_list va);
+int buffer_append_str(Buffer *buffer, const char *str);
+int buffer_append_char(Buffer *buffer, const char ch);
+int buffer_append_uint(Buffer *buffer, const unsigned int val);
+int buffer_append_int(Buffer *buffer, const int val);
+int buffer_append_float(Buffer *buffer, const float f);
 size_t buffer_size(Buffer *buffer);
 void buffer_empty(Buffer *buffer);
 char *buffer_flatten(Buffer *buffer);
 char *buffer_merge(Buffer **buffers, const size_t n, size_t *_len);
+void buffer_merge_into(Buffer **buffers, const size_t n, char *dst);
+BufferBlock *buffer_detach(Buffer **buffers, const size_t n, int *_count);
+void buffer_free_blocks(BufferBlock *item, MOJOSHADER_free f, void *d);
 void buffer_destroy(Buffer *buffer);
 void buffer_patch(Buffer *buffer, const size_t start,
                   const void *data, const size_t len);
 
 
+// Memory arenas...
+//  These hand out pieces of big chunks, and everything goes away at once in
+//  arena_destroy(). Good for piles of small allocations that all share a
+//  lifetime, like parsing state. arena_free() only gives memory back if the
+//  block is the most recent allocation; anything else stays allocated until
+//  the arena is destroyed.
+
+typedef struct MemoryArena MemoryArena;
+MemoryArena *arena_create(size_t chunksz, MOJOSHADER_malloc m,
+                          MOJOSHADER_free f, void *d);
+void *arena_alloc(MemoryArena *arena, size_t len);
+void arena_free(MemoryArena *arena, void *ptr);
+void arena_destroy(MemoryArena *arena);
+
+
+// Parse stats...
+//  Only built with MOJOSHADER_PARSE_STATS defined. Otherwise the macros that
+//  collect them (in mojoshader_profile.h) compile to nothing.
+
+#ifdef MOJOSHADER_PARSE_STATS
+uint64 stats_clock(void);  // nanoseconds, from an arbitrary starting point.
+#endif
+
+
 
 // This is the ID for a D3DXSHADER_CONSTANTTABLE in the bytecode comments.
 #define CTAB_ID 0x42415443  // 0x42415443 == 'CTAB'
@@ -426,13 +465,21 @@ void buffer_patch(Buffer *buffer, const size_t start,
 #define FXLC_ID 0x434C5846  // 0x434C5846 == 'FXLC'
 
 // we need to reference these by explicit value occasionally...
+#define OPCODE_NOP 0
+#define OPCODE_MOV 1
 #define OPCODE_RCP 6
 #define OPCODE_RSQ 7
+#define OPCODE_M4X4 20
+#define OPCODE_M4X3 21
+#define OPCODE_M3X4 22
+#define OPCODE_M3X3 23
+#define OPCODE_M3X2 24
 #define OPCODE_RET 28
 #define OPCODE_IF 40
 #define OPCODE_IFC 41
 #define OPCODE_BREAK 44
 #define OPCODE_BREAKC 45
+#define OPCODE_TEXKILL 65
 #define OPCODE_TEXLD 66
 #define OPCODE_SETP 94
 
@@ -688,13 +735,27 @@ typedef struct Conditional
     struct Conditional *next;
 } Conditional;
 
+// A token the preprocessor lexed once and can hand out again without running
+//  the lexer over the same text. (offset) is from the start of the source.
+typedef struct PreToken
+{
+    Token tokenval;
+    unsigned int offset;
+    unsigned int len;
+    uint32 hash;  // hash_string() of token, for TOKEN_IDENTIFIER only.
+} PreToken;
+
 typedef struct Define
 {
     const char *identifier;
+    unsigned int identifier_len;
+    uint32 hash;  // hash_string() of identifier.
     const char *definition;
     const char *original;
     const char **parameters;
     int paramcount;
+    int prelexed;  // nonzero if we tried to fill in (pretokens).
+    PreToken *pretokens;  // (definition), lexed. NULL if it can't be.
     struct Define *next;
 } Define;
 
@@ -705,7 +766,9 @@ typedef struct IncludeState
     const char *source;
     const char *token;
     unsigned int tokenlen;
+    uint32 tokenhash;  // hash_string() of token, for TOKEN_IDENTIFIER only.
     Token tokenval;
+    const PreToken *pretoken;  // next token to replay, NULL to really lex.
     int pushedback;
     const unsigned char *lexer_marker;
     int report_whitespace;
@@ -716,17 +779,22 @@ typedef struct IncludeState
     unsigned int line;
     Conditional *conditional_stack;
     MOJOSHADER_includeClose close_callback;
+    struct IncludeGuard *guard;  // NULL unless this came from an #include.
+    int guard_state;  // how far we are into spotting an include guard.
+    const char *guard_macro;  // points into source.
+    unsigned int guard_macro_len;
     struct IncludeState *next;
 } IncludeState;
 
 Token preprocessor_lexer(IncludeState *s);
 
 // This will only fail if the allocator fails, so it doesn't return any
-//  error code...NULL on failure.
+//  error code...NULL on failure. (include_cache) can be NULL.
 Preprocessor *preprocessor_start(const char *fname, const char *source,
                             unsigned int sourcelen,
                             MOJOSHADER_includeOpen open_callback,
                             MOJOSHADER_includeClose close_callback,
+                            MOJOSHADER_includeCache *include_cache,
                             const MOJOSHADER_preprocessorDefine *defines,
                             unsigned int define_count, int asm_comments,
                             MOJOSHADER_malloc m, MOJOSHADER_free f, void *d);
@@ -737,6 +805,36 @@ const char *preprocessor_nexttoken(Preprocessor *_ctx,
                                    unsigned int *_len, Token *_token);
 const char *preprocessor_sourcepos(Preprocessor *pp, unsigned int *pos);
 
+// Files that #include opened, once each, in the order they were opened. The
+//  names belong to the preprocessor. Returns NULL when (idx) is past the end.
+const char *preprocessor_include(Preprocessor *pp, unsigned int idx,
+                                 MOJOSHADER_includeType *inctype);
+
+// Works like an includeOpen callback, but hands back the cache's copy of the
+//  file, opening it with (open_callback) and closing it with
+//  (close_callback) first if this is the first time the cache has seen it.
+//  The data stays valid until the cache is purged or destroyed, so there's
+//  nothing to close afterwards.
+int includecache_open(MOJOSHADER_includeCache *cache,
+                      MOJOSHADER_includeType inctype, const char *fname,
+                      const char *parent, MOJOSHADER_includeOpen open_callback,
+                      MOJOSHADER_includeClose close_callback,
+                      const char **outdata, unsigned int *outbytes,
+                      MOJOSHADER_malloc m, MOJOSHADER_free f, void *d);
+
+// MOJOSHADER_compile(), but prints each function's IR to (io) before and
+//  after every optimization pass. This is for tests and debugging.
+const MOJOSHADER_compileData *compiler_trace_ir(FILE *io,
+                                    const char *srcprofile,
+                                    const char *filename, const char *source,
+                                    unsigned int sourcelen,
+                                    const MOJOSHADER_preprocessorDefine *defs,
+                                    unsigned int define_count,
+                                    MOJOSHADER_includeOpen include_open,
+                                    MOJOSHADER_includeClose include_close,
+                                    MOJOSHADER_malloc m, MOJOSHADER_free f,
+                                    void *d);
+
 
 void MOJOSHADER_print_debug_token(const char *subsystem, const char *token,
                                   const unsigned int tokenlen,
@@ -669,13 +669,33 @@ static void impl_SPIRV_FinalInitProgram(MOJOSHADER_glProgram *program)
 static int impl_GLSL_CompileShader(const MOJOSHADER_parseData *pd, GLuint *s)
 {
     GLint ok = 0;
-    const GLint codelen = (GLint) pd->output_len;
     const GLenum shader_type = glsl_shader_type(pd->shader_type);
 
+    // GL takes the source in pieces, so hand it over however the parse
+    //  left it (MOJOSHADER_parseChunked() results are several pieces).
+    const char *stack_strings[16];
+    int stack_lengths[16];
+    const char **strings = stack_strings;
+    int *lengths = stack_lengths;
+    const int count = MOJOSHADER_getOutputChunks(pd, NULL, NULL, 0);
+    if (count > (int) STATICARRAYLEN(stack_strings))
+    {
+        strings = (const char **) Malloc(sizeof (const char *) * count);
+        lengths = (int *) Malloc(sizeof (int) * count);
+        if ((strings == NULL) || (lengths == NULL))
+        {
+            Free(strings);
+            Free(lengths);
+            return 0;
+        } // if
+    } // if
+    MOJOSHADER_getOutputChunks(pd, strings, lengths, count);
+
     if (ctx->have_opengl_2)
     {
         const GLuint shader = ctx->glCreateShader(shader_type);
-        ctx->glShaderSource(shader, 1, (const GLchar**) &pd->output, &codelen);
+        ctx->glShaderSource(shader, count, (const GLchar**) strings,
+                            (const GLint *) lengths);
         ctx->glCompileShader(shader);
         ctx->glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
         if (!ok)
@@ -685,17 +705,18 @@ static int impl_GLSL_CompileShader(const MOJOSHADER_parseData *pd, GLuint *s)
                                  (GLchar *) error_buffer);
             ctx->glDeleteShader(shader);
             *s = 0;
-            return 0;
         } // if
-
-        *s = shader;
+        else
+        {
+            *s = shader;
+        } // else
     } // if
     else
     {
         const GLhandleARB shader = ctx->glCreateShaderObjectARB(shader_type);
         assert(sizeof (shader) == sizeof (*s));  // not always true on OS X!
-        ctx->glShaderSourceARB(shader, 1,
-                              (const GLcharARB **) &pd->output, &codelen);
+        ctx->glShaderSourceARB(shader, count, (const GLcharARB **) strings,
+                               (const GLint *) lengths);
         ctx->glCompileShaderARB(shader);
         ctx->glGetObjectParameterivARB(shader,GL_OBJECT_COMPILE_STATUS_ARB,&ok);
         if (!ok)
@@ -705,13 +726,20 @@ static int impl_GLSL_CompileShader(const MOJOSHADER_parseData *pd, GLuint *s)
                                  (GLcharARB *) error_buffer);
             ctx->glDeleteObjectARB(shader);
             *s = 0;
-            return 0;
         } // if
-
-        *s = (GLuint) shader;
+        else
+        {
+            *s = (GLuint) shader;
+        } // else
     } // else
 
-    return 1;
+    if (strings != stack_strings)
+    {
+        Free(strings);
+        Free(lengths);
+    } // if
+
+    return ok ? 1 : 0;
 } // impl_GLSL_CompileShader
 #endif // SUPPORT_PROFILE_GLSL
 
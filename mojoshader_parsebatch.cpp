@@ -0,0 +1,141 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+#define __MOJOSHADER_INTERNAL__ 1
+#include "mojoshader_internal.h"
+
+#include <new>
+#include <atomic>
+#include <thread>
+#include <system_error>
+
+// Batches are split up one shader at a time: each worker grabs the next
+//  unclaimed job and writes its result to that job's slot, so results come
+//  back in input order without any further bookkeeping, and one huge shader
+//  doesn't hold up a whole stripe of small ones.
+//
+// MOJOSHADER_parse() is safe to run on several threads at once: everything
+//  it touches hangs off its own Context (including the arena its scratch
+//  memory comes from), and the only global state it reads is const tables
+//  (the profile list, opcode table, etc). The allocator is the caller's
+//  problem, as documented in mojoshader.h.
+
+typedef struct BatchState
+{
+    const MOJOSHADER_parseJob *jobs;
+    unsigned int jobcount;
+    const MOJOSHADER_parseData **results;
+    MOJOSHADER_parseCache *cache;
+    MOJOSHADER_malloc m;
+    MOJOSHADER_free f;
+    void *d;
+    std::atomic<unsigned int> next;
+} BatchState;
+
+static void batch_worker(BatchState *state)
+{
+    while (1)
+    {
+        const unsigned int i = state->next.fetch_add(1);
+        if (i >= state->jobcount)
+            break;
+
+        const MOJOSHADER_parseJob *job = &state->jobs[i];
+        if (state->cache != NULL)
+        {
+            state->results[i] = MOJOSHADER_parseCached(state->cache,
+                                    job->profile, job->mainfn,
+                                    job->tokenbuf, job->bufsize,
+                                    job->swiz, job->swizcount,
+                                    job->smap, job->smapcount);
+        } // if
+        else
+        {
+            state->results[i] = MOJOSHADER_parse(job->profile, job->mainfn,
+                                    job->tokenbuf, job->bufsize,
+                                    job->swiz, job->swizcount,
+                                    job->smap, job->smapcount,
+                                    state->m, state->f, state->d);
+        } // else
+    } // while
+} // batch_worker
+
+
+int MOJOSHADER_parseBatch(const MOJOSHADER_parseJob *jobs,
+                          const unsigned int jobcount,
+                          const MOJOSHADER_parseData **results,
+                          int threadcount,
+                          MOJOSHADER_parseCache *cache,
+                          MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
+{
+    if ( ((m == NULL) && (f != NULL)) || ((m != NULL) && (f == NULL)) )
+        return -1;  // supply both or neither.
+    else if ((jobcount > 0) && ((jobs == NULL) || (results == NULL)))
+        return -1;
+
+    if (threadcount <= 0)
+    {
+        threadcount = (int) std::thread::hardware_concurrency();
+        if (threadcount <= 0)
+            threadcount = 1;  // couldn't tell; just do it ourselves.
+    } // if
+
+    // no sense in spinning up threads that won't get any work.
+    if (((unsigned int) threadcount) > jobcount)
+        threadcount = (int) jobcount;
+
+    BatchState state;
+    state.jobs = jobs;
+    state.jobcount = jobcount;
+    state.results = results;
+    state.cache = cache;
+    state.m = m;
+    state.f = f;
+    state.d = d;
+    state.next.store(0);
+
+    // The calling thread counts as one of the workers.
+    std::thread *threads = NULL;
+    int started = 0;
+    if (threadcount > 1)
+    {
+        threads = new (std::nothrow) std::thread[threadcount - 1];
+        if (threads != NULL)
+        {
+            for (started = 0; started < threadcount - 1; started++)
+            {
+                // if we can't start a thread, the ones we have (and this
+                //  one) will pick up the slack.
+                try
+                {
+                    threads[started] = std::thread(batch_worker, &state);
+                } // try
+                catch (const std::system_error &)
+                {
+                    break;
+                } // catch
+            } // for
+        } // if
+    } // if
+
+    batch_worker(&state);
+
+    for (int i = 0; i < started; i++)
+        threads[i].join();
+    delete[] threads;
+
+    int retval = 0;
+    for (unsigned int i = 0; i < jobcount; i++)
+    {
+        if ((results[i] != NULL) && (results[i]->error_count == 0))
+            retval++;
+    } // for
+
+    return retval;
+} // MOJOSHADER_parseBatch
+
+// end of mojoshader_parsebatch.c ...
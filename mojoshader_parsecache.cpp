@@ -0,0 +1,987 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+#define __MOJOSHADER_INTERNAL__ 1
+#include "mojoshader_internal.h"
+
+#include <new>
+#include <mutex>
+
+// The parse cache keys every result on a flat blob of everything that
+//  affects translation, so lookups compare the actual bytes and a hash
+//  collision can never hand back the wrong shader. The same blob is stored
+//  at the front of each persisted file for the same reason.
+
+#define CACHEFILE_MAGIC 0x43534A4D  // "MJSC", little endian.
+#define CACHEFILE_VERSION 1
+#define CACHEFILE_EXT ".mojoshader"
+
+typedef struct CacheEntry
+{
+    uint64 hash;
+    uint32 keylen;
+    uint8 *key;  // NULL if this result isn't kept (errors, unknown size...)
+    const MOJOSHADER_parseData *data;
+    int refcount;
+} CacheEntry;
+
+struct MOJOSHADER_parseCache
+{
+    char *cachedir;
+    HashTable *bykey;   // CacheEntry -> CacheEntry, for kept results.
+    HashTable *bydata;  // MOJOSHADER_parseData -> CacheEntry, owns entries.
+    std::mutex lock;
+    MOJOSHADER_malloc m;
+    MOJOSHADER_free f;
+    void *d;
+};
+
+
+// this is FNV-1a, 64-bit.
+static uint64 hash_bytes(uint64 hash, const void *_data, size_t len)
+{
+    const uint8 *data = (const uint8 *) _data;
+    while (len--)
+    {
+        hash ^= *(data++);
+        hash *= 0x100000001B3ULL;
+    } // while
+    return hash;
+} // hash_bytes
+
+static inline uint64 hash_start(void)
+{
+    return 0xCBF29CE484222325ULL;
+} // hash_start
+
+
+static uint32 hash_hash_entry(const void *key, void *data)
+{
+    (void) data;
+    const uint64 hash = ((const CacheEntry *) key)->hash;
+    return (uint32) (hash ^ (hash >> 32));
+} // hash_hash_entry
+
+static int hash_keymatch_entry(const void *a, const void *b, void *data)
+{
+    (void) data;
+    const CacheEntry *x = (const CacheEntry *) a;
+    const CacheEntry *y = (const CacheEntry *) b;
+    return ( (x->hash == y->hash) && (x->keylen == y->keylen) &&
+             (memcmp(x->key, y->key, x->keylen) == 0) );
+} // hash_keymatch_entry
+
+static uint32 hash_hash_pointer(const void *key, void *data)
+{
+    (void) data;
+    const size_t val = (size_t) key;
+    return (uint32) ((val >> 4) ^ (val >> 20));  // allocations are aligned.
+} // hash_hash_pointer
+
+static int hash_keymatch_pointer(const void *a, const void *b, void *data)
+{
+    (void) data;
+    return (a == b);
+} // hash_keymatch_pointer
+
+static void nuke_noop(const void *ctx, const void *key,
+                      const void *value, void *data)
+{
+} // nuke_noop
+
+static void nuke_entry(const void *ctx, const void *key,
+                       const void *value, void *data)
+{
+    MOJOSHADER_parseCache *cache = (MOJOSHADER_parseCache *) data;
+    CacheEntry *entry = (CacheEntry *) value;
+    delete entry->data;
+    cache->f(entry->key, cache->d);
+    cache->f(entry, cache->d);
+} // nuke_entry
+
+
+// Serialization of keys and results...
+
+typedef struct CacheWriter
+{
+    Buffer *buffer;
+    int failed;
+} CacheWriter;
+
+static void write_bytes(CacheWriter *w, const void *data, const size_t len)
+{
+    if (!w->failed)
+        w->failed = !buffer_append(w->buffer, data, len);
+} // write_bytes
+
+static inline void write_ui32(CacheWriter *w, const uint32 val)
+{
+    write_bytes(w, &val, sizeof (val));
+} // write_ui32
+
+static void write_string(CacheWriter *w, const char *str, const size_t len)
+{
+    write_ui32(w, (uint32) len);
+    write_bytes(w, str, len);
+} // write_string
+
+static inline void write_stdstring(CacheWriter *w, const std::string &str)
+{
+    write_string(w, str.data(), str.size());
+} // write_stdstring
+
+static void write_typeinfo(CacheWriter *w, const MOJOSHADER_symbolTypeInfo *info)
+{
+    unsigned int i;
+    write_ui32(w, (uint32) info->parameter_class);
+    write_ui32(w, (uint32) info->parameter_type);
+    write_ui32(w, info->rows);
+    write_ui32(w, info->columns);
+    write_ui32(w, info->elements);
+    write_ui32(w, info->member_count);
+    for (i = 0; i < info->member_count; i++)
+    {
+        const char *name = info->members[i].name;
+        write_string(w, name, name ? strlen(name) : 0);
+        write_typeinfo(w, &info->members[i].info);
+    } // for
+} // write_typeinfo
+
+static void write_symbols(CacheWriter *w, const MOJOSHADER_symbol *syms,
+                          const unsigned int count)
+{
+    unsigned int i;
+    write_ui32(w, count);
+    for (i = 0; i < count; i++)
+    {
+        write_stdstring(w, syms[i].name);
+        write_ui32(w, (uint32) syms[i].register_set);
+        write_ui32(w, syms[i].register_index);
+        write_ui32(w, syms[i].register_count);
+        write_typeinfo(w, &syms[i].info);
+    } // for
+} // write_symbols
+
+static void write_attributes(CacheWriter *w, const MOJOSHADER_attribute *attrs,
+                             const int count)
+{
+    int i;
+    for (i = 0; i < count; i++)
+    {
+        write_ui32(w, (uint32) attrs[i].usage);
+        write_ui32(w, (uint32) attrs[i].index);
+        write_stdstring(w, attrs[i].name);
+    } // for
+} // write_attributes
+
+static void write_preshader(CacheWriter *w, const MOJOSHADER_preshader *pre)
+{
+    unsigned int i, j;
+
+    write_ui32(w, pre != NULL);
+    if (pre == NULL)
+        return;
+
+    write_ui32(w, pre->literal_count);
+    write_bytes(w, pre->literals, sizeof (double) * pre->literal_count);
+    write_ui32(w, pre->temp_count);
+    write_symbols(w, pre->symbols, pre->symbol_count);
+    write_ui32(w, pre->instruction_count);
+    for (i = 0; i < pre->instruction_count; i++)
+    {
+        const MOJOSHADER_preshaderInstruction *inst = &pre->instructions[i];
+        write_ui32(w, (uint32) inst->opcode);
+        write_ui32(w, inst->element_count);
+        write_ui32(w, inst->operand_count);
+        for (j = 0; j < inst->operand_count; j++)
+        {
+            const MOJOSHADER_preshaderOperand *op = &inst->operands[j];
+            write_ui32(w, (uint32) op->type);
+            write_ui32(w, op->index);
+            write_ui32(w, op->array_register_count);
+            write_bytes(w, op->array_registers,
+                        sizeof (uint32) * op->array_register_count);
+        } // for
+    } // for
+    write_ui32(w, pre->register_count);
+    write_bytes(w, pre->registers, sizeof (float) * 4 * pre->register_count);
+} // write_preshader
+
+static void write_parsedata(CacheWriter *w, const MOJOSHADER_parseData *pd)
+{
+    int i;
+
+    write_stdstring(w, pd->profile);
+    write_ui32(w, (uint32) pd->output_len);
+    write_stdstring(w, pd->output);
+    write_ui32(w, (uint32) pd->instruction_count);
+    write_ui32(w, (uint32) pd->shader_type);
+    write_ui32(w, (uint32) pd->major_ver);
+    write_ui32(w, (uint32) pd->minor_ver);
+    write_stdstring(w, pd->mainfn);
+
+    write_ui32(w, (uint32) pd->uniform_count);
+    for (i = 0; i < pd->uniform_count; i++)
+    {
+        const MOJOSHADER_uniform *u = &pd->uniforms[i];
+        write_ui32(w, (uint32) u->type);
+        write_ui32(w, (uint32) u->index);
+        write_ui32(w, (uint32) u->array_count);
+        write_ui32(w, (uint32) u->constant);
+        write_stdstring(w, u->name);
+    } // for
+
+    write_ui32(w, (uint32) pd->constant_count);
+    for (i = 0; i < pd->constant_count; i++)
+    {
+        const MOJOSHADER_constant *c = &pd->constants[i];
+        write_ui32(w, (uint32) c->type);
+        write_ui32(w, (uint32) c->index);
+        write_bytes(w, &c->value, sizeof (c->value));
+    } // for
+
+    write_ui32(w, (uint32) pd->sampler_count);
+    for (i = 0; i < pd->sampler_count; i++)
+    {
+        const MOJOSHADER_sampler *s = &pd->samplers[i];
+        write_ui32(w, (uint32) s->type);
+        write_ui32(w, (uint32) s->index);
+        write_stdstring(w, s->name);
+        write_ui32(w, (uint32) s->texbem);
+    } // for
+
+    write_ui32(w, (uint32) pd->input_count);
+    write_attributes(w, pd->inputs, pd->input_count);
+    write_ui32(w, (uint32) pd->output_count);
+    write_attributes(w, pd->outputs, pd->output_count);
+
+    write_ui32(w, (uint32) pd->swizzle_count);
+    write_bytes(w, pd->swizzles, sizeof (MOJOSHADER_swizzle) * pd->swizzle_count);
+
+    write_symbols(w, pd->symbols, pd->symbol_count);
+    write_preshader(w, pd->preshader);
+} // write_parsedata
+
+
+typedef struct CacheReader
+{
+    const uint8 *ptr;
+    size_t avail;
+    int failed;
+    MOJOSHADER_malloc m;
+    MOJOSHADER_free f;
+    void *d;
+} CacheReader;
+
+static const uint8 *read_bytes(CacheReader *r, const size_t len)
+{
+    if ((r->failed) || (len > r->avail))
+    {
+        r->failed = 1;
+        return NULL;
+    } // if
+
+    const uint8 *retval = r->ptr;
+    r->ptr += len;
+    r->avail -= len;
+    return retval;
+} // read_bytes
+
+static uint32 read_ui32(CacheReader *r)
+{
+    uint32 retval = 0;
+    const uint8 *ptr = read_bytes(r, sizeof (retval));
+    if (ptr != NULL)
+        memcpy(&retval, ptr, sizeof (retval));
+    return retval;
+} // read_ui32
+
+// reads a count of items that each take at least (minsize) bytes, so a
+//  corrupt count can't make us allocate something enormous.
+static uint32 read_count(CacheReader *r, const size_t minsize)
+{
+    const uint32 retval = read_ui32(r);
+    if ((r->failed) || (((size_t) retval) > (r->avail / minsize)))
+    {
+        r->failed = 1;
+        return 0;
+    } // if
+    return retval;
+} // read_count
+
+static std::string read_stdstring(CacheReader *r)
+{
+    const uint32 len = read_ui32(r);
+    const uint8 *ptr = read_bytes(r, len);
+    return (ptr != NULL) ? std::string((const char *) ptr, len) : std::string();
+} // read_stdstring
+
+// arrays of structs with std::string members still need each element
+//  constructed in place by the caller before use.
+static void *read_array(CacheReader *r, const uint32 count, const size_t size)
+{
+    if ((r->failed) || (count == 0))
+        return NULL;
+
+    const size_t len = size * count;
+    void *retval = r->m((int) len, r->d);
+    if (retval == NULL)
+        r->failed = 1;
+    else
+        memset(retval, '\0', len);
+    return retval;
+} // read_array
+
+static void *read_blob(CacheReader *r, const uint32 count, const size_t size)
+{
+    const uint8 *ptr = read_bytes(r, size * count);
+    void *retval = read_array(r, count, size);
+    if (retval != NULL)
+        memcpy(retval, ptr, size * count);
+    return retval;
+} // read_blob
+
+static void read_typeinfo(CacheReader *r, MOJOSHADER_symbolTypeInfo *info)
+{
+    uint32 i;
+    info->parameter_class = (MOJOSHADER_symbolClass) read_ui32(r);
+    info->parameter_type = (MOJOSHADER_symbolType) read_ui32(r);
+    info->rows = read_ui32(r);
+    info->columns = read_ui32(r);
+    info->elements = read_ui32(r);
+    const uint32 count = read_count(r, 7 * sizeof (uint32));
+    info->members = (MOJOSHADER_symbolStructMember *)
+        read_array(r, count, sizeof (MOJOSHADER_symbolStructMember));
+    if (info->members == NULL)
+        return;
+
+    // only claim as many members as we've allocated, so cleanup works.
+    for (i = 0; (i < count) && (!r->failed); i++)
+    {
+        MOJOSHADER_symbolStructMember *mbr = &info->members[i];
+        info->member_count = i + 1;
+        const uint32 len = read_ui32(r);
+        const uint8 *ptr = read_bytes(r, len);
+        char *name = (char *) ((ptr != NULL) ? r->m(len + 1, r->d) : NULL);
+        if (name == NULL)
+        {
+            r->failed = 1;
+            break;
+        } // if
+        memcpy(name, ptr, len);
+        name[len] = '\0';
+        mbr->name = name;
+        read_typeinfo(r, &mbr->info);
+    } // for
+} // read_typeinfo
+
+static MOJOSHADER_symbol *read_symbols(CacheReader *r, int *_count)
+{
+    uint32 i;
+    const uint32 count = read_count(r, 10 * sizeof (uint32));
+    MOJOSHADER_symbol *retval = (MOJOSHADER_symbol *)
+        read_array(r, count, sizeof (MOJOSHADER_symbol));
+    *_count = (retval != NULL) ? (int) count : 0;
+    for (i = 0; (retval != NULL) && (i < count); i++)
+    {
+        MOJOSHADER_symbol *sym = new (&retval[i]) MOJOSHADER_symbol();
+        sym->name = read_stdstring(r);
+        sym->register_set = (MOJOSHADER_symbolRegisterSet) read_ui32(r);
+        sym->register_index = read_ui32(r);
+        sym->register_count = read_ui32(r);
+        read_typeinfo(r, &sym->info);
+    } // for
+    return retval;
+} // read_symbols
+
+static MOJOSHADER_attribute *read_attributes(CacheReader *r, int *_count)
+{
+    uint32 i;
+    const uint32 count = read_count(r, 3 * sizeof (uint32));
+    MOJOSHADER_attribute *retval = (MOJOSHADER_attribute *)
+        read_array(r, count, sizeof (MOJOSHADER_attribute));
+    *_count = (retval != NULL) ? (int) count : 0;
+    for (i = 0; (retval != NULL) && (i < count); i++)
+    {
+        new (&retval[i]) MOJOSHADER_attribute();
+        retval[i].usage = (MOJOSHADER_usage) read_ui32(r);
+        retval[i].index = (int) read_ui32(r);
+        retval[i].name = read_stdstring(r);
+    } // for
+    return retval;
+} // read_attributes
+
+static MOJOSHADER_preshader *read_preshader(CacheReader *r)
+{
+    uint32 i, j;
+
+    if (!read_ui32(r))
+        return NULL;
+
+    MOJOSHADER_preshader *retval = (MOJOSHADER_preshader *)
+        read_array(r, 1, sizeof (MOJOSHADER_preshader));
+    if (retval == NULL)
+        return NULL;
+
+    retval->malloc = r->m;
+    retval->free = r->f;
+    retval->malloc_data = r->d;
+
+    const uint32 literal_count = read_count(r, sizeof (double));
+    retval->literals = (double *) read_blob(r, literal_count, sizeof (double));
+    retval->literal_count = (retval->literals != NULL) ? literal_count : 0;
+    retval->temp_count = read_ui32(r);
+
+    int symbol_count = 0;
+    retval->symbols = read_symbols(r, &symbol_count);
+    retval->symbol_count = (unsigned int) symbol_count;
+
+    const uint32 inst_count = read_count(r, 3 * sizeof (uint32));
+    retval->instructions = (MOJOSHADER_preshaderInstruction *)
+        read_array(r, inst_count, sizeof (MOJOSHADER_preshaderInstruction));
+    if (retval->instructions != NULL)
+        retval->instruction_count = inst_count;
+
+    for (i = 0; (retval->instructions != NULL) && (i < inst_count); i++)
+    {
+        MOJOSHADER_preshaderInstruction *inst = &retval->instructions[i];
+        inst->opcode = (MOJOSHADER_preshaderOpcode) read_ui32(r);
+        inst->element_count = read_ui32(r);
+        const uint32 operand_count = read_ui32(r);
+        if (operand_count > STATICARRAYLEN(inst->operands))
+            r->failed = 1;
+        for (j = 0; (!r->failed) && (j < operand_count); j++)
+        {
+            MOJOSHADER_preshaderOperand *op = &inst->operands[j];
+            inst->operand_count = j + 1;
+            op->type = (MOJOSHADER_preshaderOperandType) read_ui32(r);
+            op->index = read_ui32(r);
+            const uint32 count = read_count(r, sizeof (uint32));
+            op->array_registers = (unsigned int *) read_blob(r, count, sizeof (uint32));
+            op->array_register_count = (op->array_registers != NULL) ? count : 0;
+        } // for
+    } // for
+
+    const uint32 register_count = read_count(r, sizeof (float) * 4);
+    retval->registers = (float *) read_blob(r, register_count, sizeof (float) * 4);
+    retval->register_count = (retval->registers != NULL) ? register_count : 0;
+    return retval;
+} // read_preshader
+
+static MOJOSHADER_parseData *read_parsedata(CacheReader *r)
+{
+    MOJOSHADER_parseData *retval = new MOJOSHADER_parseData();
+    uint32 i;
+
+    // everything the destructor looks at has to be sane before we bail.
+    retval->error_count = 0;
+    retval->errors = NULL;
+    retval->uniform_count = retval->constant_count = retval->sampler_count = 0;
+    retval->input_count = retval->output_count = 0;
+    retval->swizzle_count = retval->symbol_count = 0;
+    retval->uniforms = NULL;
+    retval->constants = NULL;
+    retval->samplers = NULL;
+    retval->inputs = NULL;
+    retval->outputs = NULL;
+    retval->swizzles = NULL;
+    retval->symbols = NULL;
+    retval->preshader = NULL;
+    retval->malloc = (r->m == MOJOSHADER_internal_malloc) ? NULL : r->m;
+    retval->free = (r->f == MOJOSHADER_internal_free) ? NULL : r->f;
+    retval->malloc_data = r->d;
+
+    retval->profile = read_stdstring(r);
+    retval->output_len = (int) read_ui32(r);
+    retval->output = read_stdstring(r);
+    retval->instruction_count = (int) read_ui32(r);
+    retval->shader_type = (MOJOSHADER_shaderType) read_ui32(r);
+    retval->major_ver = (int) read_ui32(r);
+    retval->minor_ver = (int) read_ui32(r);
+    retval->mainfn = read_stdstring(r);
+
+    uint32 count = read_count(r, 5 * sizeof (uint32));
+    retval->uniforms = (MOJOSHADER_uniform *)
+        read_array(r, count, sizeof (MOJOSHADER_uniform));
+    for (i = 0; (retval->uniforms != NULL) && (i < count); i++)
+    {
+        MOJOSHADER_uniform *u = new (&retval->uniforms[i]) MOJOSHADER_uniform();
+        u->type = (MOJOSHADER_uniformType) read_ui32(r);
+        u->index = (int) read_ui32(r);
+        u->array_count = (int) read_ui32(r);
+        u->constant = (int) read_ui32(r);
+        u->name = read_stdstring(r);
+    } // for
+    if (retval->uniforms != NULL)
+        retval->uniform_count = (int) count;
+
+    count = read_count(r, 2 * sizeof (uint32));
+    retval->constants = (MOJOSHADER_constant *)
+        read_array(r, count, sizeof (MOJOSHADER_constant));
+    for (i = 0; (retval->constants != NULL) && (i < count); i++)
+    {
+        MOJOSHADER_constant *c = &retval->constants[i];
+        c->type = (MOJOSHADER_uniformType) read_ui32(r);
+        c->index = (int) read_ui32(r);
+        const uint8 *value = read_bytes(r, sizeof (c->value));
+        if (value != NULL)
+            memcpy(&c->value, value, sizeof (c->value));
+    } // for
+    if (retval->constants != NULL)
+        retval->constant_count = (int) count;
+
+    count = read_count(r, 4 * sizeof (uint32));
+    retval->samplers = (MOJOSHADER_sampler *)
+        read_array(r, count, sizeof (MOJOSHADER_sampler));
+    for (i = 0; (retval->samplers != NULL) && (i < count); i++)
+    {
+        MOJOSHADER_sampler *s = new (&retval->samplers[i]) MOJOSHADER_sampler();
+        s->type = (MOJOSHADER_samplerType) read_ui32(r);
+        s->index = (int) read_ui32(r);
+        s->name = read_stdstring(r);
+        s->texbem = (int) read_ui32(r);
+    } // for
+    if (retval->samplers != NULL)
+        retval->sampler_count = (int) count;
+
+    retval->inputs = read_attributes(r, &retval->input_count);
+    retval->outputs = read_attributes(r, &retval->output_count);
+
+    count = read_count(r, sizeof (MOJOSHADER_swizzle));
+    retval->swizzles = (MOJOSHADER_swizzle *)
+        read_blob(r, count, sizeof (MOJOSHADER_swizzle));
+    if (retval->swizzles != NULL)
+        retval->swizzle_count = (int) count;
+
+    retval->symbols = read_symbols(r, &retval->symbol_count);
+    retval->preshader = read_preshader(r);
+
+    if ((r->failed) || (r->avail != 0))
+    {
+        delete retval;
+        return NULL;
+    } // if
+
+    return retval;
+} // read_parsedata
+
+
+static uint8 *build_key(MOJOSHADER_parseCache *cache, const char *profile,
+                        const char *mainfn, const unsigned char *tokenbuf,
+                        const unsigned int bufsize,
+                        const MOJOSHADER_swizzle *swiz,
+                        const unsigned int swizcount,
+                        const MOJOSHADER_samplerMap *smap,
+                        const unsigned int smapcount, uint32 *_len)
+{
+    CacheWriter writer = { NULL, 0 };
+    unsigned int i;
+
+    writer.buffer = buffer_create(256, cache->m, cache->f, cache->d);
+    if (writer.buffer == NULL)
+        return NULL;
+
+    // a different build of MojoShader might translate differently.
+    write_string(&writer, MOJOSHADER_CHANGESET, strlen(MOJOSHADER_CHANGESET));
+    write_string(&writer, profile, strlen(profile));
+    if (mainfn == NULL)
+        mainfn = "main";  // this is what MOJOSHADER_parse() would pick.
+    write_string(&writer, mainfn, strlen(mainfn));
+    write_string(&writer, (const char *) tokenbuf, bufsize);
+
+    // swizzles and sampler maps are written field by field, so struct
+    //  padding can't sneak uninitialized bytes into the key.
+    write_ui32(&writer, swizcount);
+    for (i = 0; i < swizcount; i++)
+    {
+        write_ui32(&writer, (uint32) swiz[i].usage);
+        write_ui32(&writer, swiz[i].index);
+        write_bytes(&writer, swiz[i].swizzles, sizeof (swiz[i].swizzles));
+    } // for
+
+    write_ui32(&writer, smapcount);
+    for (i = 0; i < smapcount; i++)
+    {
+        write_ui32(&writer, (uint32) smap[i].index);
+        write_ui32(&writer, (uint32) smap[i].type);
+    } // for
+
+    uint8 *retval = NULL;
+    *_len = (uint32) buffer_size(writer.buffer);
+    if (!writer.failed)
+        retval = (uint8 *) buffer_flatten(writer.buffer);
+    buffer_destroy(writer.buffer);
+    return retval;
+} // build_key
+
+
+// Persisted results...
+//  Files are the magic, version, key length and key, the serialized
+//  MOJOSHADER_parseData, and then a hash of everything before it to catch
+//  partial writes. Everything is in native byte order; these are caches,
+//  not interchange files.
+
+#ifndef MOJOSHADER_USE_SDL_STDLIB
+static char *cachefile_path(MOJOSHADER_parseCache *cache, const uint64 hash,
+                            const char *ext)
+{
+    const size_t len = strlen(cache->cachedir) + 1 + 16 + strlen(ext) + 1;
+    char *retval = (char *) cache->m((int) len, cache->d);
+    if (retval != NULL)
+    {
+        snprintf(retval, len, "%s/%08X%08X%s", cache->cachedir,
+                 (uint) (hash >> 32), (uint) (hash & 0xFFFFFFFF), ext);
+    } // if
+    return retval;
+} // cachefile_path
+
+static const MOJOSHADER_parseData *cachefile_load(MOJOSHADER_parseCache *cache,
+                                                  const CacheEntry *key)
+{
+    MOJOSHADER_parseData *retval = NULL;
+    char *path = cachefile_path(cache, key->hash, CACHEFILE_EXT);
+    if (path == NULL)
+        return NULL;
+
+    FILE *io = fopen(path, "rb");
+    cache->f(path, cache->d);
+    if (io == NULL)
+        return NULL;
+
+    uint8 *buf = NULL;
+    long len = 0;
+    if ((fseek(io, 0, SEEK_END) == 0) && ((len = ftell(io)) > 0) &&
+        (fseek(io, 0, SEEK_SET) == 0))
+    {
+        buf = (uint8 *) cache->m((int) len, cache->d);
+        if ((buf != NULL) && (fread(buf, len, 1, io) != 1))
+        {
+            cache->f(buf, cache->d);
+            buf = NULL;
+        } // if
+    } // if
+    fclose(io);
+
+    if (buf == NULL)
+        return NULL;
+
+    const size_t hashlen = sizeof (uint64);
+    if (((size_t) len) > hashlen)
+    {
+        const size_t datalen = ((size_t) len) - hashlen;
+        uint64 filehash = 0;
+        memcpy(&filehash, buf + datalen, hashlen);
+        if (filehash == hash_bytes(hash_start(), buf, datalen))
+        {
+            CacheReader reader = { buf, datalen, 0, cache->m, cache->f, cache->d };
+            const int okay = ( (read_ui32(&reader) == CACHEFILE_MAGIC) &&
+                               (read_ui32(&reader) == CACHEFILE_VERSION) &&
+                               (read_ui32(&reader) == key->keylen) );
+            const uint8 *filekey = read_bytes(&reader, key->keylen);
+            if ( (okay) && (filekey != NULL) &&
+                 (memcmp(filekey, key->key, key->keylen) == 0) )
+                retval = read_parsedata(&reader);
+        } // if
+    } // if
+
+    cache->f(buf, cache->d);
+    return retval;
+} // cachefile_load
+
+static void cachefile_save(MOJOSHADER_parseCache *cache, const CacheEntry *key,
+                           const MOJOSHADER_parseData *pd)
+{
+    CacheWriter writer = { NULL, 0 };
+    writer.buffer = buffer_create(4096, cache->m, cache->f, cache->d);
+    if (writer.buffer == NULL)
+        return;
+
+    write_ui32(&writer, CACHEFILE_MAGIC);
+    write_ui32(&writer, CACHEFILE_VERSION);
+    write_ui32(&writer, key->keylen);
+    write_bytes(&writer, key->key, key->keylen);
+    write_parsedata(&writer, pd);
+
+    const size_t len = buffer_size(writer.buffer);
+    char *buf = writer.failed ? NULL : buffer_flatten(writer.buffer);
+    buffer_destroy(writer.buffer);
+    if (buf == NULL)
+        return;
+
+    const uint64 hash = hash_bytes(hash_start(), buf, len);
+
+    // write to a temp file and rename it into place, so other processes
+    //  sharing this directory never see a half-written file.
+    char ext[64];
+    snprintf(ext, sizeof (ext), "%s.%p.tmp", CACHEFILE_EXT, (void *) pd);
+    char *tmppath = cachefile_path(cache, key->hash, ext);
+    char *path = cachefile_path(cache, key->hash, CACHEFILE_EXT);
+    if ((tmppath != NULL) && (path != NULL))
+    {
+        FILE *io = fopen(tmppath, "wb");
+        if (io != NULL)
+        {
+            int okay = (fwrite(buf, len, 1, io) == 1);
+            okay = (fwrite(&hash, sizeof (hash), 1, io) == 1) && okay;
+            okay = (fclose(io) == 0) && okay;
+            if ((okay) && (rename(tmppath, path) != 0))
+            {
+                remove(path);  // Windows won't rename over an existing file.
+                okay = (rename(tmppath, path) == 0);
+            } // if
+            if (!okay)
+                remove(tmppath);
+        } // if
+    } // if
+
+    cache->f(path, cache->d);
+    cache->f(tmppath, cache->d);
+    cache->f(buf, cache->d);
+} // cachefile_save
+#endif
+
+
+// API entry points...
+
+MOJOSHADER_parseCache *MOJOSHADER_createParseCache(const char *cachedir,
+                                                   MOJOSHADER_malloc m,
+                                                   MOJOSHADER_free f,
+                                                   void *d)
+{
+    if ( ((m == NULL) && (f != NULL)) || ((m != NULL) && (f == NULL)) )
+        return NULL;  // supply both or neither.
+
+    if (m == NULL) m = MOJOSHADER_internal_malloc;
+    if (f == NULL) f = MOJOSHADER_internal_free;
+
+    MOJOSHADER_parseCache *cache = (MOJOSHADER_parseCache *)
+                                        m(sizeof (MOJOSHADER_parseCache), d);
+    if (cache == NULL)
+        return NULL;
+
+    memset((void *) cache, '\0', sizeof (MOJOSHADER_parseCache));
+    new (&cache->lock) std::mutex();
+    cache->m = m;
+    cache->f = f;
+    cache->d = d;
+
+#ifndef MOJOSHADER_USE_SDL_STDLIB
+    if (cachedir != NULL)
+    {
+        size_t len = strlen(cachedir);
+        while ((len > 1) && ((cachedir[len-1] == '/') || (cachedir[len-1] == '\\')))
+            len--;  // we add our own separator.
+        cache->cachedir = (char *) m((int) len + 1, d);
+        if (cache->cachedir == NULL)
+            goto create_failed;
+        memcpy(cache->cachedir, cachedir, len);
+        cache->cachedir[len] = '\0';
+    } // if
+#endif
+
+    cache->bykey = hash_create(cache, hash_hash_entry, hash_keymatch_entry,
+                               nuke_noop, 0, m, f, d);
+    if (cache->bykey == NULL)
+        goto create_failed;
+
+    cache->bydata = hash_create(cache, hash_hash_pointer, hash_keymatch_pointer,
+                                nuke_entry, 0, m, f, d);
+    if (cache->bydata == NULL)
+        goto create_failed;
+
+    return cache;
+
+create_failed:
+    MOJOSHADER_destroyParseCache(cache);
+    return NULL;
+} // MOJOSHADER_createParseCache
+
+
+// Takes ownership of (key) and (data), and hands back the result the caller
+//  should actually use, which is an existing one if another thread beat us.
+static const MOJOSHADER_parseData *add_entry(MOJOSHADER_parseCache *cache,
+                                             CacheEntry *key,
+                                             const MOJOSHADER_parseData *data)
+{
+    std::lock_guard<std::mutex> guard(cache->lock);
+    const void *value = NULL;
+
+    if ((key->key != NULL) && (hash_find(cache->bykey, key, &value)))
+    {
+        CacheEntry *entry = (CacheEntry *) value;
+        entry->refcount++;
+        delete data;
+        cache->f(key->key, cache->d);
+        return entry->data;
+    } // if
+
+    CacheEntry *entry = (CacheEntry *) cache->m(sizeof (CacheEntry), cache->d);
+    if (entry == NULL)
+    {
+        delete data;
+        cache->f(key->key, cache->d);
+        return NULL;
+    } // if
+
+    memcpy(entry, key, sizeof (CacheEntry));
+    entry->data = data;
+    entry->refcount = 1;
+
+    if (hash_insert(cache->bydata, data, entry) != 1)
+    {
+        delete data;
+        cache->f(entry->key, cache->d);
+        cache->f(entry, cache->d);
+        return NULL;
+    } // if
+
+    // if we can't remember it by key, that's okay; it just won't be kept.
+    if ((entry->key != NULL) && (hash_insert(cache->bykey, entry, entry) != 1))
+    {
+        cache->f(entry->key, cache->d);
+        entry->key = NULL;
+    } // if
+
+    return data;
+} // add_entry
+
+
+const MOJOSHADER_parseData *MOJOSHADER_parseCached(MOJOSHADER_parseCache *cache,
+                                                   const char *profile,
+                                                   const char *mainfn,
+                                                   const unsigned char *tokenbuf,
+                                                   const unsigned int bufsize,
+                                                   const MOJOSHADER_swizzle *swiz,
+                                                   const unsigned int swizcount,
+                                                   const MOJOSHADER_samplerMap *smap,
+                                                   const unsigned int smapcount)
+{
+    const MOJOSHADER_parseData *retval = NULL;
+    CacheEntry key;
+
+    if (cache == NULL)
+        return NULL;
+
+    memset(&key, '\0', sizeof (key));
+    if ((profile != NULL) && (bufsize > 0))
+    {
+        key.key = build_key(cache, profile, mainfn, tokenbuf, bufsize,
+                            swiz, swizcount, smap, smapcount, &key.keylen);
+        if (key.key == NULL)
+            return NULL;  // out of memory.
+        key.hash = hash_bytes(hash_start(), key.key, key.keylen);
+
+        std::lock_guard<std::mutex> guard(cache->lock);
+        const void *value = NULL;
+        if (hash_find(cache->bykey, &key, &value))
+        {
+            CacheEntry *entry = (CacheEntry *) value;
+            entry->refcount++;
+            cache->f(key.key, cache->d);
+            return entry->data;
+        } // if
+    } // if
+
+#ifndef MOJOSHADER_USE_SDL_STDLIB
+    if ((key.key != NULL) && (cache->cachedir != NULL))
+        retval = cachefile_load(cache, &key);
+#endif
+
+    if (retval == NULL)
+    {
+        retval = MOJOSHADER_parse(profile, mainfn, tokenbuf, bufsize,
+                                  swiz, swizcount, smap, smapcount,
+                                  cache->m, cache->f, cache->d);
+        if (retval == NULL)
+        {
+            cache->f(key.key, cache->d);
+            return NULL;
+        } // if
+
+        if (retval->error_count > 0)
+        {
+            cache->f(key.key, cache->d);
+            key.key = NULL;  // don't keep failures around.
+        } // if
+
+#ifndef MOJOSHADER_USE_SDL_STDLIB
+        else if ((key.key != NULL) && (cache->cachedir != NULL))
+            cachefile_save(cache, &key, retval);
+#endif
+    } // if
+
+    return add_entry(cache, &key, retval);
+} // MOJOSHADER_parseCached
+
+
+void MOJOSHADER_releaseCachedParseData(MOJOSHADER_parseCache *cache,
+                                       const MOJOSHADER_parseData *data)
+{
+    if ((cache == NULL) || (data == NULL))
+        return;
+
+    std::lock_guard<std::mutex> guard(cache->lock);
+    const void *value = NULL;
+    if (!hash_find(cache->bydata, data, &value))
+        return;  // not ours?!
+
+    CacheEntry *entry = (CacheEntry *) value;
+    assert(entry->refcount > 0);
+    entry->refcount--;
+
+    // results we aren't keeping go away as soon as nobody needs them.
+    if ((entry->refcount == 0) && (entry->key == NULL))
+        hash_remove(cache->bydata, data, NULL);
+} // MOJOSHADER_releaseCachedParseData
+
+
+void MOJOSHADER_purgeParseCache(MOJOSHADER_parseCache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    std::lock_guard<std::mutex> guard(cache->lock);
+    const void *key = NULL;
+    void *iter = NULL;
+    int more = hash_iter_keys(cache->bydata, &key, &iter);
+
+    while (more)
+    {
+        // step past this item before we (maybe) remove it.
+        const void *data = key;
+        const void *value = NULL;
+        more = hash_iter_keys(cache->bydata, &key, &iter);
+        hash_find(cache->bydata, data, &value);
+
+        const CacheEntry *entry = (const CacheEntry *) value;
+        if ((entry->refcount == 0) && (entry->key != NULL))
+        {
+            hash_remove(cache->bykey, entry, NULL);
+            hash_remove(cache->bydata, data, NULL);
+        } // if
+    } // while
+} // MOJOSHADER_purgeParseCache
+
+
+void MOJOSHADER_destroyParseCache(MOJOSHADER_parseCache *cache)
+{
+    if (cache == NULL)
+        return;
+
+    MOJOSHADER_free f = cache->f;
+    void *d = cache->d;
+
+    if (cache->bykey != NULL)
+        hash_destroy(cache->bykey, NULL);
+    if (cache->bydata != NULL)
+        hash_destroy(cache->bydata, NULL);
+    f(cache->cachedir, d);
+    cache->lock.~mutex();
+    f(cache, d);
+} // MOJOSHADER_destroyParseCache
+
+// end of mojoshader_parsecache.c ...
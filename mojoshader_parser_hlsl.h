@@ -0,0 +1,5126 @@
+/* This file is automatically generated by Lemon from input grammar
+** source file "/root/repo/mojoshader_parser_hlsl.lemon". */
+/*
+ * My changes over the original lempar.c from SQLite are encased in
+ *  #if __MOJOSHADER__ blocks.  --ryan.
+ */
+#ifndef __MOJOSHADER__
+#define __MOJOSHADER__ 1
+#endif
+
+#if !__MOJOSHADER__
+#define LEMON_SUPPORT_TRACING (!defined(NDEBUG))
+#endif
+
+#if __MOJOSHADER__
+/* Driver template for the LEMON parser generator.
+** The original author(s) of lempar.c disclaim copyright to this source code.
+** However, changes made for MojoShader fall under the same license as the
+** rest of MojoShader. Please see the file LICENSE.txt in the source's root
+** directory.
+*/
+#endif
+
+/*
+** 2000-05-29
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+** Driver template for the LEMON parser generator.
+**
+** The "lemon" program processes an LALR(1) input grammar file, then uses
+** this template to construct a parser.  The "lemon" program inserts text
+** at each "%%" line.  Also, any "P-a-r-s-e" identifer prefix (without the
+** interstitial "-" characters) contained in this template is changed into
+** the value of the %name directive from the grammar.  Otherwise, the content
+** of this template is copied straight through into the generate parser
+** source file.
+**
+** The following is the concatenation of all %include directives from the
+** input grammar file:
+*/
+/************ Begin %include sections from the grammar ************************/
+#line 36 "/root/repo/mojoshader_parser_hlsl.lemon"
+
+#ifndef __MOJOSHADER_HLSL_COMPILER__
+#error Do not compile this file directly.
+#endif
+#line 55 "/root/repo/mojoshader_parser_hlsl.h"
+/**************** End of %include directives **********************************/
+/* These constants specify the various numeric values for terminal symbols.
+***************** Begin token definitions *************************************/
+#define TOKEN_HLSL_COMMA                           1
+#define TOKEN_HLSL_ASSIGN                          2
+#define TOKEN_HLSL_ADDASSIGN                       3
+#define TOKEN_HLSL_SUBASSIGN                       4
+#define TOKEN_HLSL_MULASSIGN                       5
+#define TOKEN_HLSL_DIVASSIGN                       6
+#define TOKEN_HLSL_MODASSIGN                       7
+#define TOKEN_HLSL_LSHIFTASSIGN                    8
+#define TOKEN_HLSL_RSHIFTASSIGN                    9
+#define TOKEN_HLSL_ANDASSIGN                      10
+#define TOKEN_HLSL_ORASSIGN                       11
+#define TOKEN_HLSL_XORASSIGN                      12
+#define TOKEN_HLSL_QUESTION                       13
+#define TOKEN_HLSL_OROR                           14
+#define TOKEN_HLSL_ANDAND                         15
+#define TOKEN_HLSL_OR                             16
+#define TOKEN_HLSL_XOR                            17
+#define TOKEN_HLSL_AND                            18
+#define TOKEN_HLSL_EQL                            19
+#define TOKEN_HLSL_NEQ                            20
+#define TOKEN_HLSL_LT                             21
+#define TOKEN_HLSL_LEQ                            22
+#define TOKEN_HLSL_GT                             23
+#define TOKEN_HLSL_GEQ                            24
+#define TOKEN_HLSL_LSHIFT                         25
+#define TOKEN_HLSL_RSHIFT                         26
+#define TOKEN_HLSL_PLUS                           27
+#define TOKEN_HLSL_MINUS                          28
+#define TOKEN_HLSL_STAR                           29
+#define TOKEN_HLSL_SLASH                          30
+#define TOKEN_HLSL_PERCENT                        31
+#define TOKEN_HLSL_TYPECAST                       32
+#define TOKEN_HLSL_EXCLAMATION                    33
+#define TOKEN_HLSL_COMPLEMENT                     34
+#define TOKEN_HLSL_MINUSMINUS                     35
+#define TOKEN_HLSL_PLUSPLUS                       36
+#define TOKEN_HLSL_DOT                            37
+#define TOKEN_HLSL_LBRACKET                       38
+#define TOKEN_HLSL_RBRACKET                       39
+#define TOKEN_HLSL_LPAREN                         40
+#define TOKEN_HLSL_RPAREN                         41
+#define TOKEN_HLSL_ELSE                           42
+#define TOKEN_HLSL_SEMICOLON                      43
+#define TOKEN_HLSL_TYPEDEF                        44
+#define TOKEN_HLSL_CONST                          45
+#define TOKEN_HLSL_IDENTIFIER                     46
+#define TOKEN_HLSL_VOID                           47
+#define TOKEN_HLSL_INLINE                         48
+#define TOKEN_HLSL_IN                             49
+#define TOKEN_HLSL_INOUT                          50
+#define TOKEN_HLSL_OUT                            51
+#define TOKEN_HLSL_UNIFORM                        52
+#define TOKEN_HLSL_COLON                          53
+#define TOKEN_HLSL_LINEAR                         54
+#define TOKEN_HLSL_CENTROID                       55
+#define TOKEN_HLSL_NOINTERPOLATION                56
+#define TOKEN_HLSL_NOPERSPECTIVE                  57
+#define TOKEN_HLSL_SAMPLE                         58
+#define TOKEN_HLSL_EXTERN                         59
+#define TOKEN_HLSL_SHARED                         60
+#define TOKEN_HLSL_STATIC                         61
+#define TOKEN_HLSL_VOLATILE                       62
+#define TOKEN_HLSL_ROWMAJOR                       63
+#define TOKEN_HLSL_COLUMNMAJOR                    64
+#define TOKEN_HLSL_LBRACE                         65
+#define TOKEN_HLSL_RBRACE                         66
+#define TOKEN_HLSL_STRUCT                         67
+#define TOKEN_HLSL_PACKOFFSET                     68
+#define TOKEN_HLSL_REGISTER                       69
+#define TOKEN_HLSL_USERTYPE                       70
+#define TOKEN_HLSL_SAMPLER                        71
+#define TOKEN_HLSL_SAMPLER1D                      72
+#define TOKEN_HLSL_SAMPLER2D                      73
+#define TOKEN_HLSL_SAMPLER3D                      74
+#define TOKEN_HLSL_SAMPLERCUBE                    75
+#define TOKEN_HLSL_SAMPLER_STATE                  76
+#define TOKEN_HLSL_SAMPLERSTATE                   77
+#define TOKEN_HLSL_SAMPLERCOMPARISONSTATE         78
+#define TOKEN_HLSL_BOOL                           79
+#define TOKEN_HLSL_INT                            80
+#define TOKEN_HLSL_UINT                           81
+#define TOKEN_HLSL_HALF                           82
+#define TOKEN_HLSL_FLOAT                          83
+#define TOKEN_HLSL_DOUBLE                         84
+#define TOKEN_HLSL_STRING                         85
+#define TOKEN_HLSL_SNORM                          86
+#define TOKEN_HLSL_UNORM                          87
+#define TOKEN_HLSL_BUFFER                         88
+#define TOKEN_HLSL_VECTOR                         89
+#define TOKEN_HLSL_INT_CONSTANT                   90
+#define TOKEN_HLSL_MATRIX                         91
+#define TOKEN_HLSL_ISOLATE                        92
+#define TOKEN_HLSL_MAXINSTRUCTIONCOUNT            93
+#define TOKEN_HLSL_NOEXPRESSIONOPTIMIZATIONS      94
+#define TOKEN_HLSL_REMOVEUNUSEDINPUTS             95
+#define TOKEN_HLSL_UNUSED                         96
+#define TOKEN_HLSL_XPS                            97
+#define TOKEN_HLSL_BREAK                          98
+#define TOKEN_HLSL_CONTINUE                       99
+#define TOKEN_HLSL_DISCARD                        100
+#define TOKEN_HLSL_DO                             101
+#define TOKEN_HLSL_WHILE                          102
+#define TOKEN_HLSL_RETURN                         103
+#define TOKEN_HLSL_UNROLL                         104
+#define TOKEN_HLSL_LOOP                           105
+#define TOKEN_HLSL_FOR                            106
+#define TOKEN_HLSL_BRANCH                         107
+#define TOKEN_HLSL_IF                             108
+#define TOKEN_HLSL_FLATTEN                        109
+#define TOKEN_HLSL_IFALL                          110
+#define TOKEN_HLSL_IFANY                          111
+#define TOKEN_HLSL_PREDICATE                      112
+#define TOKEN_HLSL_PREDICATEBLOCK                 113
+#define TOKEN_HLSL_SWITCH                         114
+#define TOKEN_HLSL_FORCECASE                      115
+#define TOKEN_HLSL_CALL                           116
+#define TOKEN_HLSL_CASE                           117
+#define TOKEN_HLSL_DEFAULT                        118
+#define TOKEN_HLSL_FLOAT_CONSTANT                 119
+#define TOKEN_HLSL_STRING_LITERAL                 120
+#define TOKEN_HLSL_TRUE                           121
+#define TOKEN_HLSL_FALSE                          122
+/**************** End token definitions ***************************************/
+
+/* The next sections is a series of control #defines.
+** various aspects of the generated parser.
+**    YYCODETYPE         is the data type used to store the integer codes
+**                       that represent terminal and non-terminal symbols.
+**                       "unsigned char" is used if there are fewer than
+**                       256 symbols.  Larger types otherwise.
+**    YYNOCODE           is a number of type YYCODETYPE that is not used for
+**                       any terminal or nonterminal symbol.
+**    YYFALLBACK         If defined, this indicates that one or more tokens
+**                       (also known as: "terminal symbols") have fall-back
+**                       values which should be used if the original symbol
+**                       would not parse.  This permits keywords to sometimes
+**                       be used as identifiers, for example.
+**    YYACTIONTYPE       is the data type used for "action codes" - numbers
+**                       that indicate what to do in response to the next
+**                       token.
+**    ParseHLSLTOKENTYPE     is the data type used for minor type for terminal
+**                       symbols.  Background: A "minor type" is a semantic
+**                       value associated with a terminal or non-terminal
+**                       symbols.  For example, for an "ID" terminal symbol,
+**                       the minor type might be the name of the identifier.
+**                       Each non-terminal can have a different minor type.
+**                       Terminal symbols all have the same minor type, though.
+**                       This macros defines the minor type for terminal 
+**                       symbols.
+**    YYMINORTYPE        is the data type used for all minor types.
+**                       This is typically a union of many types, one of
+**                       which is ParseHLSLTOKENTYPE.  The entry in the union
+**                       for terminal symbols is called "yy0".
+**    YYSTACKDEPTH       is the maximum depth of the parser's stack.  If
+**                       zero the stack is dynamically sized using realloc()
+**    ParseHLSLARG_SDECL     A static variable declaration for the %extra_argument
+**    ParseHLSLARG_PDECL     A parameter declaration for the %extra_argument
+**    ParseHLSLARG_PARAM     Code to pass %extra_argument as a subroutine parameter
+**    ParseHLSLARG_STORE     Code to store %extra_argument into yypParser
+**    ParseHLSLARG_FETCH     Code to extract %extra_argument from yypParser
+**    ParseHLSLCTX_*         As ParseHLSLARG_ except for %extra_context
+**    YYERRORSYMBOL      is the code number of the error symbol.  If not
+**                       defined, then do no error processing.
+**    YYNSTATE           the combined number of states.
+**    YYNRULE            the number of rules in the grammar
+**    YYNTOKEN           Number of terminal symbols
+**    YY_MAX_SHIFT       Maximum value for shift actions
+**    YY_MIN_SHIFTREDUCE Minimum value for shift-reduce actions
+**    YY_MAX_SHIFTREDUCE Maximum value for shift-reduce actions
+**    YY_ERROR_ACTION    The yy_action[] code for syntax error
+**    YY_ACCEPT_ACTION   The yy_action[] code for accept
+**    YY_NO_ACTION       The yy_action[] code for no-op
+**    YY_MIN_REDUCE      Minimum value for reduce actions
+**    YY_MAX_REDUCE      Maximum value for reduce actions
+*/
+#ifndef INTERFACE
+# define INTERFACE 1
+#endif
+/************* Begin control #defines *****************************************/
+#define YYCODETYPE unsigned char
+#define YYNOCODE 196
+#define YYACTIONTYPE unsigned short int
+#define ParseHLSLTOKENTYPE  TokenData 
+typedef union {
+  int yyinit;
+  ParseHLSLTOKENTYPE yy0;
+  MOJOSHADER_astPackOffset * yy8;
+  MOJOSHADER_astTypedef * yy23;
+  MOJOSHADER_astInputModifier yy51;
+  MOJOSHADER_astStructMembers * yy74;
+  MOJOSHADER_astFunctionSignature * yy82;
+  MOJOSHADER_astVariableLowLevel * yy110;
+  MOJOSHADER_astVariableDeclaration * yy114;
+  const MOJOSHADER_astDataType * yy189;
+  MOJOSHADER_astExpression * yy206;
+  int yy228;
+  MOJOSHADER_astSwitchCases * yy247;
+  MOJOSHADER_astAnnotations * yy260;
+  MOJOSHADER_astStructDeclaration * yy265;
+  MOJOSHADER_astFunctionStorageClass yy285;
+  MOJOSHADER_astStatement * yy307;
+  MOJOSHADER_astArguments * yy320;
+  MOJOSHADER_astCompilationUnit * yy321;
+  MOJOSHADER_astInterpolationModifier yy343;
+  MOJOSHADER_astFunctionParameters * yy344;
+  const char * yy364;
+  MOJOSHADER_astScalarOrArray * yy392;
+} YYMINORTYPE;
+#ifndef YYSTACKDEPTH
+#define YYSTACKDEPTH 100
+#endif
+#define ParseHLSLARG_SDECL  Context *ctx ;
+#define ParseHLSLARG_PDECL , Context *ctx 
+#define ParseHLSLARG_PARAM ,ctx 
+#define ParseHLSLARG_FETCH  Context *ctx =yypParser->ctx ;
+#define ParseHLSLARG_STORE yypParser->ctx =ctx ;
+#define ParseHLSLCTX_SDECL
+#define ParseHLSLCTX_PDECL
+#define ParseHLSLCTX_PARAM
+#define ParseHLSLCTX_FETCH
+#define ParseHLSLCTX_STORE
+#define YYNSTATE             297
+#define YYNRULE              288
+#define YYNRULE_WITH_ACTION  288
+#define YYNTOKEN             123
+#define YY_MAX_SHIFT         296
+#define YY_MIN_SHIFTREDUCE   525
+#define YY_MAX_SHIFTREDUCE   812
+#define YY_ERROR_ACTION      813
+#define YY_ACCEPT_ACTION     814
+#define YY_NO_ACTION         815
+#define YY_MIN_REDUCE        816
+#define YY_MAX_REDUCE        1103
+/************* End control #defines *******************************************/
+#define YY_NLOOKAHEAD ((int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])))
+
+/* Define the yytestcase() macro to be a no-op if is not already defined
+** otherwise.
+**
+** Applications can choose to define yytestcase() in the %include section
+** to a macro that can assist in verifying code coverage.  For production
+** code the yytestcase() macro should be turned off.  But it is useful
+** for testing.
+*/
+#ifndef yytestcase
+# define yytestcase(X)
+#endif
+
+
+/* Next are the tables used to determine what action to take based on the
+** current state and lookahead token.  These tables are used to implement
+** functions that take a state number and lookahead value and return an
+** action integer.  
+**
+** Suppose the action integer is N.  Then the action is determined as
+** follows
+**
+**   0 <= N <= YY_MAX_SHIFT             Shift N.  That is, push the lookahead
+**                                      token onto the stack and goto state N.
+**
+**   N between YY_MIN_SHIFTREDUCE       Shift to an arbitrary state then
+**     and YY_MAX_SHIFTREDUCE           reduce by rule N-YY_MIN_SHIFTREDUCE.
+**
+**   N == YY_ERROR_ACTION               A syntax error has occurred.
+**
+**   N == YY_ACCEPT_ACTION              The parser accepts its input.
+**
+**   N == YY_NO_ACTION                  No such action.  Denotes unused
+**                                      slots in the yy_action[] table.
+**
+**   N between YY_MIN_REDUCE            Reduce by rule N-YY_MIN_REDUCE
+**     and YY_MAX_REDUCE
+**
+** The action table is constructed as a single large table named yy_action[].
+** Given state S and lookahead X, the action is computed as either:
+**
+**    (A)   N = yy_action[ yy_shift_ofst[S] + X ]
+**    (B)   N = yy_default[S]
+**
+** The (A) formula is preferred.  The B formula is used instead if
+** yy_lookahead[yy_shift_ofst[S]+X] is not equal to X.
+**
+** The formulas above are for computing the action when the lookahead is
+** a terminal symbol.  If the lookahead is a non-terminal (as occurs after
+** a reduce action) then the yy_reduce_ofst[] array is used in place of
+** the yy_shift_ofst[] array.
+**
+** The following are the tables generated in this section:
+**
+**  yy_action[]        A single table containing all actions.
+**  yy_lookahead[]     A table containing the lookahead for each entry in
+**                     yy_action.  Used to detect hash collisions.
+**  yy_shift_ofst[]    For each state, the offset into yy_action for
+**                     shifting terminals.
+**  yy_reduce_ofst[]   For each state, the offset into yy_action for
+**                     shifting non-terminals after a reduce.
+**  yy_default[]       Default action for each state.
+**
+*********** Begin parsing tables **********************************************/
+#define YY_ACTTAB_COUNT (5868)
+static const YYACTIONTYPE yy_action[] = {
+ /*     0 */   101,  126,  114,  242,  113, 1027,  112,  104,  888,  100,
+ /*    10 */   892,  103,  896,  277,  140,  139,  140,  139,  140,  139,
+ /*    20 */   181, 1028,  880,  117,  919,  138,  100,   86,   85,   74,
+ /*    30 */    72,   73,   71,   83,   84,   90,   91,  180,  123,  880,
+ /*    40 */    47,   27,  115,  693,   97,  586,  143,   38,  884,   82,
+ /*    50 */    81,   80,  584,  296,  140,  139,  581, 1043,  158,  580,
+ /*    60 */   582,  583,  585,  587,  588,    1,  671,  249,  920,  138,
+ /*    70 */   643,  644,  645,  646,  647,  648,  649,  650,  651,  652,
+ /*    80 */   653,  654,  655,  656,  657,  658,  295,  294,  293,  282,
+ /*    90 */   743,  278,  250,  570,  571,  572,  573,  574,  248,  247,
+ /*   100 */   246,  723,  702,   37,  131,  848,  707,  691,  730,  755,
+ /*   110 */   754,  264,   46,  296,  735,  184,  100,   86,   85,  744,
+ /*   120 */   745,  746,  747,   83,   84,   90,   91,  181,  123,  880,
+ /*   130 */    47,   27,  118,  693,   97,  586,  143,  130,  852,  722,
+ /*   140 */   701,  894,  584,   27,  706,  281,  581,  140,  139,  580,
+ /*   150 */   582,  583,  585,  587,  588,    1,  672,  249,   40,  214,
+ /*   160 */   643,  644,  645,  646,  647,  648,  649,  650,  651,  652,
+ /*   170 */   653,  654,  655,  656,  657,  658,  295,  294,  293,  282,
+ /*   180 */   743,  278, 1043,  570,  571,  572,  573,  574,  248,  247,
+ /*   190 */   246,  723,  702,   37,  184,  119,  707,  137,  730,  821,
+ /*   200 */   132,  844,  532,  686,  735,  296,  296,   86,   85,  744,
+ /*   210 */   745,  746,  747,   83,   84,   90,   91,  179,  123,   39,
+ /*   220 */    47,   88,  890,  693,   97,  586,  143,  886,  140,  139,
+ /*   230 */    60,  882,  584,  140,  139,  100,  581,  140,  139,  580,
+ /*   240 */   582,  583,  585,  587,  588,    1,  186,  249,  880,   60,
+ /*   250 */   643,  644,  645,  646,  647,  648,  649,  650,  651,  652,
+ /*   260 */   653,  654,  655,  656,  657,  658,  295,  294,  293,  282,
+ /*   270 */   743,  278,   29,   27,   27,  133,  840,  250,  248,  247,
+ /*   280 */   246,  723,  702,   37,  828,  569,  707,  213,  730,  529,
+ /*   290 */   134,   31,  105,  105,  735,   40,  214,   86,   85,  744,
+ /*   300 */   745,  746,  747,   83,   84,   90,   91,  263,  259,   24,
+ /*   310 */    47,    1,   27,   33,  930,  586,  143,  933,  928,  929,
+ /*   320 */   931,  932,  584,  100,  154,  184,  581,   38,   79,  580,
+ /*   330 */   582,  583,  585,  587,  588,   60,  881,  249,   60,   60,
+ /*   340 */   643,  644,  645,  646,  647,  648,  649,  650,  651,  652,
+ /*   350 */   653,  654,  655,  656,  657,  658,  295,  294,  293,  282,
+ /*   360 */   743,  278,  721,  700,  152,  241,  976,  705,  988,  983,
+ /*   370 */   109,  102,  850,   60,  634,  720,  699,   60,    6,    9,
+ /*   380 */   704,   60,   94,  846,  869,  842,   24,    3,  252,  744,
+ /*   390 */   745,  746,  747,  261,   60,  170,   60,  625,  930,  263,
+ /*   400 */   259,  933,  928,  929,  931,  932,    4,  964,   60,  223,
+ /*   410 */   219,  218,  216,   10,  989,  135,   60,   12, 1040,  150,
+ /*   420 */    60,   14, 1102,  145, 1060,  157,  199,  198,  149,  191,
+ /*   430 */   272,  271,  269,  267,  189, 1090,   35,  976,   36,  988,
+ /*   440 */   983,  109,  102,  725,   60,  251,   62,   63,   17,  731,
+ /*   450 */   724,  632,  826,   94,  838,  869,  732,   23,  696,  252,
+ /*   460 */    70,   69,  694,   76,   75,  994,  170,    1,   60,  930,
+ /*   470 */    60,  975,  933,  928,  929,  931,  932,    5,  964,   60,
+ /*   480 */   223,  219,  218,  216,  215,  989,  135,  613,  142, 1040,
+ /*   490 */   150,  122,   60, 1102,  145, 1060,  157,  199,  198,  149,
+ /*   500 */   191,  272,  271,  269,  267,  189, 1090,  253,   20,  976,
+ /*   510 */    21,  988,  983,  109,  102,  930,   48,  750,  933,  928,
+ /*   520 */   929,  931,  932,  906,   63,   94,   60,  869,   78,   77,
+ /*   530 */   255,  252,  220,  577,  909, 1040,  150,  122,  170,  122,
+ /*   540 */  1053,  930,  256,  908,  933,  928,  929,  931,  932,   18,
+ /*   550 */   964,   38,  223,  219,  218,  216,  757,  989,  135,  142,
+ /*   560 */    60, 1040,  150,   61,  622, 1102,  145, 1060,  157,  199,
+ /*   570 */   198,  149,  191,  272,  271,  269,  267,  189, 1090,  576,
+ /*   580 */   976,  575,  988,  983,  109,  102,  930,  825, 1042,  933,
+ /*   590 */   928,  929,  931,  932,  824,  540,   94,   87,  869,  204,
+ /*   600 */   748,  567,  252,   93,  106,   88, 1040,  150,  539,  170,
+ /*   610 */   107, 1052,  930,  566,  212,  933,  928,  929,  931,  932,
+ /*   620 */   120,  965,    2,  223,  219,  218,  216,   41,  989,  135,
+ /*   630 */    19,   42, 1040,  150,   43,  687, 1102,  145, 1060,  157,
+ /*   640 */   199,  198,  149,  191,  272,  271,  269,  267,  189, 1090,
+ /*   650 */    44,  221,  976,  734,  988,  983,  109,  102,  652,  653,
+ /*   660 */   654,  655,  656,  657,  658,  295,  294,   22,   94,  224,
+ /*   670 */   869,  226,  228,  627,  252,  733,  230,  232,  729,  728,
+ /*   680 */   727,  170,  726,  234,  930,  176,  177,  933,  928,  929,
+ /*   690 */   931,  932,  151, 1009,  153,  223,  219,  218,  216,  239,
+ /*   700 */   989,  135,  240,  136, 1040,  150,  676,  243, 1102,  145,
+ /*   710 */  1060,  157,  199,  198,  149,  191,  272,  271,  269,  267,
+ /*   720 */   189, 1090,  244,  976,  683,  988,  983,  109,  102,  652,
+ /*   730 */   653,  654,  655,  656,  657,  658,  295,  294,  682,   94,
+ /*   740 */   681,  869,  608,   89,  569,  252,  292,  291,  290,  289,
+ /*   750 */   288,  287,  170,  286,  284,  930,  616,   60,  933,  928,
+ /*   760 */   929,  931,  932,  630, 1008,  626,  223,  219,  218,  216,
+ /*   770 */   263,  989,  135,  259,  121, 1040,  150,  257,  258, 1102,
+ /*   780 */   145, 1060,  157,  199,  198,  149,  191,  272,  271,  269,
+ /*   790 */   267,  189, 1090,  624,  902,  976,  260,  988,  983,  109,
+ /*   800 */   102,  930,  262,  185,  933,  928,  929,  931,  932,  753,
+ /*   810 */    64,   94,   65,  869,   67,  670,   68,  252,  273,  274,
+ /*   820 */   275,  276,  124,  669,  170,  279,  280,  930,  125,  668,
+ /*   830 */   933,  928,  929,  931,  932,  146, 1010,  283,  223,  219,
+ /*   840 */   218,  216,  667,  989,  135,  141,  666, 1040,  150,  285,
+ /*   850 */   665, 1102,  145, 1060,  157,  199,  198,  149,  191,  272,
+ /*   860 */   271,  269,  267,  189, 1090,  664,  976,  663,  988,  983,
+ /*   870 */   109,  102,  930,  662,  661,  933,  928,  929,  931,  932,
+ /*   880 */   815,   39,   94,  815,  869,  660,  659,  815,  252,  815,
+ /*   890 */   815,  815,  815,  815,  815,  170,  815,  815,  930,  815,
+ /*   900 */   815,  933,  928,  929,  931,  932,  815, 1007,  815,  223,
+ /*   910 */   219,  218,  216,  815,  989,  135,  815,  209, 1040,  150,
+ /*   920 */   815,  815, 1102,  145, 1060,  157,  199,  198,  149,  191,
+ /*   930 */   272,  271,  269,  267,  189, 1090,  815,  815,  976,  815,
+ /*   940 */   988,  983,  109,  102,  930,  815,  815,  933,  928,  929,
+ /*   950 */   931,  932,  815,  815,   94,  815,  869,  815,  815,  815,
+ /*   960 */   252,  815,  815,  815,  815,  815,  815,  170,  815,  815,
+ /*   970 */   930,  815,  815,  933,  928,  929,  931,  932,  815, 1003,
+ /*   980 */   815,  223,  219,  218,  216,  815,  989,  135,  144,  815,
+ /*   990 */  1040,  150,  815,  815, 1102,  145, 1060,  157,  199,  198,
+ /*  1000 */   149,  191,  272,  271,  269,  267,  189, 1090,  815,  976,
+ /*  1010 */   815,  988,  983,  109,  102,  930,  815,  815,  933,  928,
+ /*  1020 */   929,  931,  932,  815,  815,   94,  815,  869,  815,  815,
+ /*  1030 */   815,  252,  815,  815,  815,  815,  815,  815,  170,  815,
+ /*  1040 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  1050 */  1002,  815,  223,  219,  218,  216,  815,  989,  135,  815,
+ /*  1060 */   815, 1040,  150,  815,  815, 1102,  145, 1060,  157,  199,
+ /*  1070 */   198,  149,  191,  272,  271,  269,  267,  189, 1090,  815,
+ /*  1080 */   815,  976,  815,  988,  983,  109,  102,  815,  815,  815,
+ /*  1090 */   815,  815,  815,  815,  815,  815,  815,   94,  815,  869,
+ /*  1100 */   815,  815,  815,  252,  815,  815,  815,  815,  815,  815,
+ /*  1110 */   170,  815,  815,  930,  815,  815,  933,  928,  929,  931,
+ /*  1120 */   932,  815, 1001,  815,  223,  219,  218,  216,  815,  989,
+ /*  1130 */   135,  815,  815, 1040,  150,  815,  815, 1102,  145, 1060,
+ /*  1140 */   157,  199,  198,  149,  191,  272,  271,  269,  267,  189,
+ /*  1150 */  1090,  815,  976,  815,  988,  983,  109,  102,  815,  815,
+ /*  1160 */   815,  815,  815,  815,  815,  815,  815,  815,   94,  815,
+ /*  1170 */   869,  815,  815,  815,  252,  815,  815,  815,  815,  815,
+ /*  1180 */   815,  170,  815,  815,  930,  815,  815,  933,  928,  929,
+ /*  1190 */   931,  932,  815, 1000,  815,  223,  219,  218,  216,  815,
+ /*  1200 */   989,  135,  815,  815, 1040,  150,  815,  815, 1102,  145,
+ /*  1210 */  1060,  157,  199,  198,  149,  191,  272,  271,  269,  267,
+ /*  1220 */   189, 1090,  815,  815,  976,  815,  988,  983,  109,  102,
+ /*  1230 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  1240 */    94,  815,  869,  815,  815,  815,  252,  815,  815,  815,
+ /*  1250 */   815,  815,  815,  170,  815,  815,  930,  815,  815,  933,
+ /*  1260 */   928,  929,  931,  932,  815, 1005,  815,  223,  219,  218,
+ /*  1270 */   216,  815,  989,  135,  815,  815, 1040,  150,  815,  815,
+ /*  1280 */  1102,  145, 1060,  157,  199,  198,  149,  191,  272,  271,
+ /*  1290 */   269,  267,  189, 1090,  815,  976,  815,  988,  983,  109,
+ /*  1300 */   102,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  1310 */   815,   94,  815,  869,  815,  815,  815,  252,  815,  815,
+ /*  1320 */   815,  815,  815,  815,  170,  815,  815,  930,  815,  815,
+ /*  1330 */   933,  928,  929,  931,  932,  815, 1004,  815,  223,  219,
+ /*  1340 */   218,  216,  815,  989,  135,  815,  815, 1040,  150,  815,
+ /*  1350 */   815, 1102,  145, 1060,  157,  199,  198,  149,  191,  272,
+ /*  1360 */   271,  269,  267,  189, 1090,  815,  815,  976,  815,  988,
+ /*  1370 */   983,  109,  102,  815,  815,  815,  815,  815,  815,  815,
+ /*  1380 */   815,  815,  815,   94,  815,  869,  815,  815,  815,  252,
+ /*  1390 */   815,  815,  815,  815,  815,  815,  170,  815,  815,  930,
+ /*  1400 */   815,  815,  933,  928,  929,  931,  932,  815, 1006,  815,
+ /*  1410 */   223,  219,  218,  216,  815,  989,  135,  815,  815, 1040,
+ /*  1420 */   150,  815,  815, 1102,  145, 1060,  157,  199,  198,  149,
+ /*  1430 */   191,  272,  271,  269,  267,  189, 1090,  815,  976,  815,
+ /*  1440 */   988,  983,  109,  102,  815,  815,  815,  815,  815,  815,
+ /*  1450 */   815,  815,  815,  815,   94,  815,  869,  815,  815,  815,
+ /*  1460 */   252,  815,  815,  815,  815,  815,  815,  170,  815,  815,
+ /*  1470 */   930,  815,  815,  933,  928,  929,  931,  932,  815,  999,
+ /*  1480 */   815,  223,  219,  218,  216,  815,  989,  135,  815,  815,
+ /*  1490 */  1040,  150,  815,  815, 1102,  145, 1060,  157,  199,  198,
+ /*  1500 */   149,  191,  272,  271,  269,  267,  189, 1090,  815,  815,
+ /*  1510 */   976,  815,  988,  983,  109,  102,  815,  815,  815,  815,
+ /*  1520 */   815,  815,  815,  815,  815,  815,   94,  815,  869,  815,
+ /*  1530 */   815,  815,  252,  815,  815,  815,  815,  815,  815,  170,
+ /*  1540 */   815,  815,  930,  815,  815,  933,  928,  929,  931,  932,
+ /*  1550 */   815,  981,  815,  223,  219,  218,  216,  815,  989,  135,
+ /*  1560 */   815,  815, 1040,  150,  815,  815, 1102,  145, 1060,  157,
+ /*  1570 */   199,  198,  149,  191,  272,  271,  269,  267,  189, 1090,
+ /*  1580 */   815,  976,  815,  988,  983,  109,  102,  815,  815,  815,
+ /*  1590 */   815,  815,  815,  815,  815,  815,  815,   94,  815,  869,
+ /*  1600 */   815,  815,  815,  252,  815,  815,  815,  815,  815,  815,
+ /*  1610 */   170,  815,  815,  930,  815,  815,  933,  928,  929,  931,
+ /*  1620 */   932,  815,  217,  815,  223,  219,  218,  216,  815,  989,
+ /*  1630 */   135,  815,  815, 1040,  150,  815,  815, 1102,  145, 1060,
+ /*  1640 */   157,  199,  198,  149,  191,  272,  271,  269,  267,  189,
+ /*  1650 */  1090,  815,  815,  976,  815,  988,  983,  109,  102,  815,
+ /*  1660 */   815,  815,  815,  815,  815,  815,  815,  815,  815,   94,
+ /*  1670 */   815,  869,  815,  815,  815,  252,  815,  815,  815,  815,
+ /*  1680 */   815,  815,  170,  815,  815,  930,  815,  815,  933,  928,
+ /*  1690 */   929,  931,  932,  815,  979,  815,  223,  219,  218,  216,
+ /*  1700 */   815,  989,  135,  815,  815, 1040,  150,  815,  815, 1102,
+ /*  1710 */   145, 1060,  157,  199,  198,  149,  191,  272,  271,  269,
+ /*  1720 */   267,  189, 1090,  815,  976,  815,  988,  983,  109,  102,
+ /*  1730 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  1740 */    94,  815,  869,  815,  815,  815,  252,  815,  815,  815,
+ /*  1750 */   815,  815,  815,  170,  815,  815,  930,  815,  815,  933,
+ /*  1760 */   928,  929,  931,  932,  815,  222,  815,  223,  219,  218,
+ /*  1770 */   216,  815,  989,  135,  815,  815, 1040,  150,  815,  142,
+ /*  1780 */  1102,  145, 1060,  157,  199,  198,  149,  191,  272,  271,
+ /*  1790 */   269,  267,  189, 1090,  815,   86,   85,  815,  815,  815,
+ /*  1800 */   815,   83,   84,   90,   91,  815,  930,  815,   47,  933,
+ /*  1810 */   928,  929,  931,  932,  143,   59,   55,   54,   58,   57,
+ /*  1820 */    56,   53,   52,   51,   49,   50, 1040,  150,  815,  815,
+ /*  1830 */   815, 1058, 1059,   25,  815,  815,  815,  815,  643,  644,
+ /*  1840 */   645,  646,  647,  648,  649,  650,  651,  652,  653,  654,
+ /*  1850 */   655,  656,  657,  658,  295,  294,  293,  282,  743,  278,
+ /*  1860 */   815,   86,   85,  815,  815,  815,  815,   83,   84,   90,
+ /*  1870 */    91,  815,  815,  815,   47,  815,  815,  815,  815,  815,
+ /*  1880 */   143,  815,  815,  815,  815,  815,  815,  744,  745,  746,
+ /*  1890 */   747,  815,  815,  815,  815,  815,  815,  815,  815,   26,
+ /*  1900 */   815,  815,  815,  815,  643,  644,  645,  646,  647,  648,
+ /*  1910 */   649,  650,  651,  652,  653,  654,  655,  656,  657,  658,
+ /*  1920 */   295,  294,  293,  282,  743,  278,  815,   86,   85,  815,
+ /*  1930 */   815,  815,  815,   83,   84,   90,   91,  815,  815,  815,
+ /*  1940 */    47,    7,  815,  815,  815,  815,  143,  815,  815,  815,
+ /*  1950 */   815,  815,  815,  744,  745,  746,  747,  815,  815,  815,
+ /*  1960 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  1970 */   643,  644,  645,  646,  647,  648,  649,  650,  651,  652,
+ /*  1980 */   653,  654,  655,  656,  657,  658,  295,  294,  293,  282,
+ /*  1990 */   743,  278,  815,  815,  815,  815,  815,  815,   86,   85,
+ /*  2000 */   815,  208,  815,  815,   83,   84,   90,   91,  837,   98,
+ /*  2010 */   815,   47,    8,  815,  815,  815,  815,  143,  815,  744,
+ /*  2020 */   745,  746,  747,  815,  815,  815,  815,  815,  930,  815,
+ /*  2030 */   815,  933,  928,  929,  931,  932,  815,  815,  815,  815,
+ /*  2040 */   815,  643,  644,  645,  646,  647,  648,  649,  650,  651,
+ /*  2050 */   652,  653,  654,  655,  656,  657,  658,  295,  294,  293,
+ /*  2060 */   282,  743,  278,  815,  815,  815,  815,  116,  815,   86,
+ /*  2070 */    85,  815,  815,  815,  815,   83,   84,   90,   91,  815,
+ /*  2080 */   870,  815,   47,  815,  815,   28,  815,  815,  143,  815,
+ /*  2090 */   744,  745,  746,  747,  930,  815,  815,  933,  928,  929,
+ /*  2100 */   931,  932,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2110 */   815,  815,  643,  644,  645,  646,  647,  648,  649,  650,
+ /*  2120 */   651,  652,  653,  654,  655,  656,  657,  658,  295,  294,
+ /*  2130 */   293,  282,  743,  278,  815,  815,  815,  815,  815,  815,
+ /*  2140 */    86,   85,  815,  815,  815,  815,   83,   84,   90,   91,
+ /*  2150 */   815,  815,  815,   47,   11,  815,  815,  815,  815,  143,
+ /*  2160 */   815,  744,  745,  746,  747,  815,  815,  815,  815,  815,
+ /*  2170 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2180 */   815,  815,  815,  643,  644,  645,  646,  647,  648,  649,
+ /*  2190 */   650,  651,  652,  653,  654,  655,  656,  657,  658,  295,
+ /*  2200 */   294,  293,  282,  743,  278,  815,  815,  815,  815,  815,
+ /*  2210 */   815,   86,   85,  815,  815,  815,  815,   83,   84,   90,
+ /*  2220 */    91,  815,  815,  815,   47,   13,  815,  815,  815,  815,
+ /*  2230 */   143,  815,  744,  745,  746,  747,  815,  815,  815,  815,
+ /*  2240 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2250 */   815,  815,  815,  815,  643,  644,  645,  646,  647,  648,
+ /*  2260 */   649,  650,  651,  652,  653,  654,  655,  656,  657,  658,
+ /*  2270 */   295,  294,  293,  282,  743,  278,  815,  815,  815,  815,
+ /*  2280 */   815,  815,   86,   85,  815,  815,  815,  815,   83,   84,
+ /*  2290 */    90,   91,  815,  815,  815,   47,  815,  815,   32,  815,
+ /*  2300 */   815,  143,  815,  744,  745,  746,  747,  815,  815,  815,
+ /*  2310 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2320 */   815,  815,  815,  815,  815,  643,  644,  645,  646,  647,
+ /*  2330 */   648,  649,  650,  651,  652,  653,  654,  655,  656,  657,
+ /*  2340 */   658,  295,  294,  293,  282,  743,  278,  815,  815,  815,
+ /*  2350 */   815,  815,  815,   86,   85,  815,  815,  815,  815,   83,
+ /*  2360 */    84,   90,   91,  815,  815,  815,   47,   15,  815,  815,
+ /*  2370 */   815,  815,  143,  815,  744,  745,  746,  747,  815,  815,
+ /*  2380 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2390 */   815,  815,  815,  815,  815,  815,  643,  644,  645,  646,
+ /*  2400 */   647,  648,  649,  650,  651,  652,  653,  654,  655,  656,
+ /*  2410 */   657,  658,  295,  294,  293,  282,  743,  278,  815,  815,
+ /*  2420 */   815,  815,  815,  815,   86,   85,  815,  815,  815,  815,
+ /*  2430 */    83,   84,   90,   91,  815,  815,  815,   47,   16,  815,
+ /*  2440 */   815,  815,  815,  143,  815,  744,  745,  746,  747,  815,
+ /*  2450 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2460 */   815,  815,  815,  815,  815,  815,  815,  643,  644,  645,
+ /*  2470 */   646,  647,  648,  649,  650,  651,  652,  653,  654,  655,
+ /*  2480 */   656,  657,  658,  295,  294,  293,  282,  743,  278,  815,
+ /*  2490 */   815,  815,  815,  815,  815,   86,   85,  815,  815,  815,
+ /*  2500 */   815,   83,   84,   90,   91,  815,  815,  815,   47,  815,
+ /*  2510 */   815,   34,  815,  815,  143,  815,  744,  745,  746,  747,
+ /*  2520 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2530 */   815,  815,  815,  815,  815,  815,  815,  815,  643,  644,
+ /*  2540 */   645,  646,  647,  648,  649,  650,  651,  652,  653,  654,
+ /*  2550 */   655,  656,  657,  658,  295,  294,  293,  282,  743,  278,
+ /*  2560 */   815,  815,  815,  815,  815,  815,   86,   85,  815,  815,
+ /*  2570 */   815,  815,   83,   84,   90,   91,  815,  815,  815,   47,
+ /*  2580 */   815,  815,  695,  815,  815,  143,  815,  744,  745,  746,
+ /*  2590 */   747,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2600 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  643,
+ /*  2610 */   644,  645,  646,  647,  648,  649,  650,  651,  652,  653,
+ /*  2620 */   654,  655,  656,  657,  658,  295,  294,  293,  282,  743,
+ /*  2630 */   278,  815,  815,  815,  815,  815,  815,   86,   85,  815,
+ /*  2640 */   815,  815,  815,   83,   84,   90,   91,  815,  815,  815,
+ /*  2650 */    47,  756,  815,  815,  815,  815,  143,  815,  744,  745,
+ /*  2660 */   746,  747,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2670 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2680 */   643,  644,  645,  646,  647,  648,  649,  650,  651,  652,
+ /*  2690 */   653,  654,  655,  656,  657,  658,  295,  294,  293,  282,
+ /*  2700 */   743,  278,  815,  815,  815,  815,  815,  815,   86,   85,
+ /*  2710 */   815,  815,  815,  815,   83,   84,   90,   91,  815,  815,
+ /*  2720 */   621,   47,  815,  815,  815,  815,  815,  143,  815,  744,
+ /*  2730 */   745,  746,  747,  815,  815,  815,  815,  815,  815,  815,
+ /*  2740 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  2750 */   815,  643,  644,  645,  646,  647,  648,  649,  650,  651,
+ /*  2760 */   652,  653,  654,  655,  656,  657,  658,  295,  294,  293,
+ /*  2770 */   282,  743,  278,  816,  814,   66,  817,  819,  128,  815,
+ /*  2780 */   822,  108,  110,  815,   95,  129,  815,  815,  815,  815,
+ /*  2790 */   815,  815,  815,   94,  815,  869,  815,  815,  815,  252,
+ /*  2800 */   744,  745,  746,  747,  815,  815,  815,  815,  815,  930,
+ /*  2810 */   815,  815,  933,  928,  929,  931,  932,   97,  586,  815,
+ /*  2820 */   205,  541,  815,  815,  815,  584,  815,  815,  815,  581,
+ /*  2830 */   815,  815,  580,  582,  583,  585,  587,  588,  815,  815,
+ /*  2840 */   249,  815,  815,  643,  644,  645,  646,  647,  648,  649,
+ /*  2850 */   650,  651,  652,  653,  654,  655,  656,  657,  658,  295,
+ /*  2860 */   294,  293,  282,  815,  278,   97,  586,  815,  205,  541,
+ /*  2870 */   815,  815,  815,  584,  815,  815,  815,  581,  815,  815,
+ /*  2880 */   580,  582,  583,  585,  587,  588,  815,  815,  249,  815,
+ /*  2890 */   815,  643,  644,  645,  646,  647,  648,  649,  650,  651,
+ /*  2900 */   652,  653,  654,  655,  656,  657,  658,  295,  294,  293,
+ /*  2910 */   282,  815,  278,   86,   85,  815,  815,  815,  815,   83,
+ /*  2920 */    84,   90,   91,  815,  815,  815,   47,  815,  815,  815,
+ /*  2930 */   815,  815,  143,  815,  815,   86,   85,  815,  815,  815,
+ /*  2940 */   815,   83,   84,   90,   91,  815,  815,  815,   45,  815,
+ /*  2950 */   815,  815,  815,  815,  143,  815,  643,  644,  645,  646,
+ /*  2960 */   647,  648,  649,  650,  651,  652,  653,  654,  655,  656,
+ /*  2970 */   657,  658,  295,  294,  293,  282,  743,  278,  643,  644,
+ /*  2980 */   645,  646,  647,  648,  649,  650,  651,  652,  653,  654,
+ /*  2990 */   655,  656,  657,  658,  295,  294,  293,  282,  743,  278,
+ /*  3000 */   815,  815,  815,  815,  815,  744,  745,  746,  747,  815,
+ /*  3010 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3020 */   815,  815,  815,  815,  586,  815,  815,  744,  745,  746,
+ /*  3030 */   747,  584,  815,  815,  815,  581,  815,  815,  580,  582,
+ /*  3040 */   583,  585,  587,  588,  815,  815,  815,  815,  815,  643,
+ /*  3050 */   644,  645,  646,  647,  648,  649,  650,  651,  652,  653,
+ /*  3060 */   654,  655,  656,  657,  658,  295,  294,  293,  282,   30,
+ /*  3070 */   278,  815,  815,  111,  102,  815,  815,  815,  815,  815,
+ /*  3080 */   815,  815,  815,  815,  815,   94,  815,  869,  815,  815,
+ /*  3090 */   815,  252,  815,  815,  815,  815,  815,  815,  168,  815,
+ /*  3100 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  3110 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3120 */   815, 1040,  150,  815,  815, 1102,  145, 1060,  157,  199,
+ /*  3130 */   198,  149,  191,  272,  271,  269,  267,  189, 1090,  815,
+ /*  3140 */   570,  571,  572,  573,  574,  815,  815,  815,  815,  815,
+ /*  3150 */   815,  815,  607,  815,  815,  815,  643,  644,  645,  646,
+ /*  3160 */   647,  648,  649,  650,  651,  652,  653,  654,  655,  656,
+ /*  3170 */   657,  658,  295,  294,  293,  282,  542,  278,  207,  564,
+ /*  3180 */   206,  568,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3190 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  643,
+ /*  3200 */   644,  645,  646,  647,  648,  649,  650,  651,  652,  653,
+ /*  3210 */   654,  655,  656,  657,  658,  295,  294,  293,  282,  815,
+ /*  3220 */   278,  570,  571,  572,  573,  574,  815,  815,  815,  815,
+ /*  3230 */   815,  815,  815,  142,  815,  815,  815,  643,  644,  645,
+ /*  3240 */   646,  647,  648,  649,  650,  651,  652,  653,  654,  655,
+ /*  3250 */   656,  657,  658,  295,  294,  293,  282,  254,  278,  815,
+ /*  3260 */   930,  924,  815,  933,  928,  929,  931,  932,  815,  815,
+ /*  3270 */   815,  815,  815,  815,  142,  815,  815,  815,  815,  815,
+ /*  3280 */  1040,  150,  815,  815, 1102,  145, 1060,  157,  199,  198,
+ /*  3290 */   149,  191,  272,  271,  269,  267,  189, 1090,  254,  815,
+ /*  3300 */   815,  930,  183,  815,  933,  928,  929,  931,  932,  815,
+ /*  3310 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3320 */   815, 1040,  150,  815,  815, 1102,  145, 1060,  157,  199,
+ /*  3330 */   198,  149,  191,  272,  271,  269,  267,  189, 1090,  142,
+ /*  3340 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3350 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3360 */   815,  815,  815,  254,  815,  815,  930,  182,  815,  933,
+ /*  3370 */   928,  929,  931,  932,  815,  815,  815,  815,  815,  815,
+ /*  3380 */   142,  815,  815,  815,  815,  815, 1040,  150,  815,  815,
+ /*  3390 */  1102,  145, 1060,  157,  199,  198,  149,  191,  272,  271,
+ /*  3400 */   269,  267,  189, 1090,  927,  815,  815,  930,  815,  926,
+ /*  3410 */   933,  928,  929,  931,  932,  815,  815,  815,  815,  815,
+ /*  3420 */   815,  815,  815,  815,  815,  815,  815, 1040,  150,  815,
+ /*  3430 */   815, 1102,  145, 1060,  157,  199,  198,  149,  191,  272,
+ /*  3440 */   271,  269,  267,  189, 1090,  207,  564,  206,  568,  815,
+ /*  3450 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3460 */   815,  815,  142,  815,  815,  815,  643,  644,  645,  646,
+ /*  3470 */   647,  648,  649,  650,  651,  652,  653,  654,  655,  656,
+ /*  3480 */   657,  658,  295,  294,  293,  282,  159,  278,  815,  930,
+ /*  3490 */   815,  815,  933,  928,  929,  931,  932,  815,  815,  815,
+ /*  3500 */   815,  815,  815,  142,  815,  815,  815,  815,  815, 1040,
+ /*  3510 */   150,  815,  815, 1102,  145, 1060,  157,  199,  198,  149,
+ /*  3520 */   191,  272,  271,  269,  267,  189, 1090,  160,  815,  815,
+ /*  3530 */   930,  815,  815,  933,  928,  929,  931,  932,  815,  815,
+ /*  3540 */   815,  815,  815,  815,  142,  815,  815,  815,  815,  815,
+ /*  3550 */  1040,  150,  815,  815, 1102,  145, 1060,  157,  199,  198,
+ /*  3560 */   149,  191,  272,  271,  269,  267,  189, 1090,  161,  815,
+ /*  3570 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  3580 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3590 */   815, 1040,  150,  815,  142, 1102,  145, 1060,  157,  199,
+ /*  3600 */   198,  149,  191,  272,  271,  269,  267,  189, 1090,  815,
+ /*  3610 */   815,  815,  815,  815,  815,  815,  815,  815,  162,  815,
+ /*  3620 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  3630 */   815,  815,  815,  815,  815,  142,  815,  815,  815,  815,
+ /*  3640 */   815, 1040,  150,  815,  815, 1102,  145, 1060,  157,  199,
+ /*  3650 */   198,  149,  191,  272,  271,  269,  267,  189, 1090,  164,
+ /*  3660 */   815,  815,  930,  815,  815,  933,  928,  929,  931,  932,
+ /*  3670 */   815,  815,  815,  815,  815,  815,  142,  815,  815,  815,
+ /*  3680 */   815,  815, 1040,  150,  815,  815, 1102,  145, 1060,  157,
+ /*  3690 */   199,  198,  149,  191,  272,  271,  269,  267,  189, 1090,
+ /*  3700 */   163,  815,  815,  930,  815,  815,  933,  928,  929,  931,
+ /*  3710 */   932,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3720 */   815,  815,  815, 1040,  150,  815,  142, 1102,  145, 1060,
+ /*  3730 */   157,  199,  198,  149,  191,  272,  271,  269,  267,  189,
+ /*  3740 */  1090,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  3750 */   165,  815,  815,  930,  815,  815,  933,  928,  929,  931,
+ /*  3760 */   932,  815,  815,  815,  815,  815,  815,  142,  815,  815,
+ /*  3770 */   815,  815,  815, 1040,  150,  815,  815, 1102,  145, 1060,
+ /*  3780 */   157,  199,  198,  149,  191,  272,  271,  269,  267,  189,
+ /*  3790 */  1090,  166,  815,  815,  930,  815,  815,  933,  928,  929,
+ /*  3800 */   931,  932,  815,  815,  815,  815,  815,  815,  142,  815,
+ /*  3810 */   815,  815,  815,  815, 1040,  150,  815,  815, 1102,  145,
+ /*  3820 */  1060,  157,  199,  198,  149,  191,  272,  271,  269,  267,
+ /*  3830 */   189, 1090,  167,  815,  815,  930,  815,  815,  933,  928,
+ /*  3840 */   929,  931,  932,  815,  815,  815,  815,  815,  815,  815,
+ /*  3850 */   815,  815,  815,  815,  815, 1040,  150,  815,  142, 1102,
+ /*  3860 */   145, 1060,  157,  199,  198,  149,  191,  272,  271,  269,
+ /*  3870 */   267,  189, 1090,  815,  815,  815,  815,  815,  815,  815,
+ /*  3880 */   815,  815,  169,  815,  815,  930,  815,  815,  933,  928,
+ /*  3890 */   929,  931,  932,  815,  815,  815,  815,  815,  815,  142,
+ /*  3900 */   815,  815,  815,  815,  815, 1040,  150,  815,  815, 1102,
+ /*  3910 */   145, 1060,  157,  199,  198,  149,  191,  272,  271,  269,
+ /*  3920 */   267,  189, 1090,  815,  815,  815,  930,  815,  815,  933,
+ /*  3930 */   928,  929,  931,  932,  815,  815,  815,  815,  815,  815,
+ /*  3940 */   142,  815,  815,  815,  815,  815, 1040,  150,  815,  187,
+ /*  3950 */  1049,  145, 1060,  157,  199,  198,  149,  191,  272,  271,
+ /*  3960 */   269,  267,  189, 1090,  202,  815,  815,  930,  815,  815,
+ /*  3970 */   933,  928,  929,  931,  932,  815,  815,  815,  815,  815,
+ /*  3980 */   815,  815,  815,  815,  815,  815,  815, 1040,  150,  815,
+ /*  3990 */   142, 1102,  145, 1060,  157,  199,  198,  149,  191,  272,
+ /*  4000 */   271,  269,  267,  189, 1090,  815,  815,  815,  815,  815,
+ /*  4010 */   815,  815,  815,  815,  171,  815,  815,  930,  815,  815,
+ /*  4020 */   933,  928,  929,  931,  932,  815,  815,  815,  815,  815,
+ /*  4030 */   815,  142,  815,  815,  815,  815,  815, 1040,  150,  815,
+ /*  4040 */   815, 1102,  145, 1060,  157,  199,  198,  149,  191,  272,
+ /*  4050 */   271,  269,  267,  189, 1090,  172,  815,  815,  930,  815,
+ /*  4060 */   815,  933,  928,  929,  931,  932,  815,  815,  815,  815,
+ /*  4070 */   815,  815,  142,  815,  815,  815,  815,  815, 1040,  150,
+ /*  4080 */   815,  815, 1102,  145, 1060,  157,  199,  198,  149,  191,
+ /*  4090 */   272,  271,  269,  267,  189, 1090,  173,  815,  815,  930,
+ /*  4100 */   815,  815,  933,  928,  929,  931,  932,  815,  815,  815,
+ /*  4110 */   815,  815,  815,  815,  815,  815,  815,  815,  815, 1040,
+ /*  4120 */   150,  815,  142, 1102,  145, 1060,  157,  199,  198,  149,
+ /*  4130 */   191,  272,  271,  269,  267,  189, 1090,  815,  815,  815,
+ /*  4140 */   815,  815,  815,  815,  815,  815,  174,  815,  815,  930,
+ /*  4150 */   815,  815,  933,  928,  929,  931,  932,  815,  815,  815,
+ /*  4160 */   815,  815,  815,  142,  815,  815,  815,  815,  815, 1040,
+ /*  4170 */   150,  815,  815, 1102,  145, 1060,  157,  199,  198,  149,
+ /*  4180 */   191,  272,  271,  269,  267,  189, 1090,  175,  815,  815,
+ /*  4190 */   930,  815,  815,  933,  928,  929,  931,  932,  815,  815,
+ /*  4200 */   815,  815,  815,  815,  142,  815,  815,  815,  815,  815,
+ /*  4210 */  1040,  150,  815,  815, 1102,  145, 1060,  157,  199,  198,
+ /*  4220 */   149,  191,  272,  271,  269,  267,  189, 1090,  201,  815,
+ /*  4230 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  4240 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  4250 */   815, 1040,  150,  815,  142, 1102,  145, 1060,  157,  199,
+ /*  4260 */   198,  149,  191,  272,  271,  269,  267,  189, 1090,  815,
+ /*  4270 */   815,  815,  815,  815,  815,  815,  815,  815,  200,  815,
+ /*  4280 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  4290 */   815,  815,  815,  815,  815,  127,  815,  815,  815,  815,
+ /*  4300 */   815, 1040,  150,  815,  815, 1102,  145, 1060,  157,  199,
+ /*  4310 */   198,  149,  191,  272,  271,  269,  267,  189, 1090,  201,
+ /*  4320 */   815,  815,  930,  815,  815,  933,  928,  929,  931,  932,
+ /*  4330 */   815,  815,  815,  815,  815,  815,  142,  815,  815,  815,
+ /*  4340 */   815,  815, 1040,  150,  815,  815, 1102,  145, 1060,  157,
+ /*  4350 */   199,  198,  149,  191,  272,  271,  269,  267,  189, 1090,
+ /*  4360 */   815,  815,  815,  930,  815,  815,  933,  928,  929,  931,
+ /*  4370 */   932,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  4380 */   815,  815,  815, 1040,  150,  815,  142, 1050,  145, 1060,
+ /*  4390 */   157,  199,  198,  149,  191,  272,  271,  269,  267,  189,
+ /*  4400 */  1090,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  4410 */   815,  815,  815,  930,  815,  815,  933,  928,  929,  931,
+ /*  4420 */   932,  815,  815,  815,  815,  815,  815,  142,  815,  815,
+ /*  4430 */   815,  815,  815, 1040,  150,  815,  815, 1101,  145, 1060,
+ /*  4440 */   157,  199,  198,  149,  191,  272,  271,  269,  267,  189,
+ /*  4450 */  1090,  815,  815,  815,  930,  815,  815,  933,  928,  929,
+ /*  4460 */   931,  932,  815,  815,  815,  815,  815,  815,  142,  815,
+ /*  4470 */   815,  815,  815,  815, 1040,  150,  815,  815, 1100,  145,
+ /*  4480 */  1060,  157,  199,  198,  149,  191,  272,  271,  269,  267,
+ /*  4490 */   189, 1090,  815,  815,  815,  930,  815,  815,  933,  928,
+ /*  4500 */   929,  931,  932,  815,  815,  815,  815,  815,  815,  815,
+ /*  4510 */   815,  815,  815,  815,  815, 1040,  150,  815,  142, 1099,
+ /*  4520 */   145, 1060,  157,  199,  198,  149,  191,  272,  271,  269,
+ /*  4530 */   267,  189, 1090,  815,  815,  815,  815,  815,  815,  815,
+ /*  4540 */   815,  815,  815,  815,  815,  930,  815,  815,  933,  928,
+ /*  4550 */   929,  931,  932,  815,  815,  815,  815,  815,  815,  142,
+ /*  4560 */   815,  815,  815,  815,  815, 1040,  150,  815,  815, 1098,
+ /*  4570 */   145, 1060,  157,  199,  198,  149,  191,  272,  271,  269,
+ /*  4580 */   267,  189, 1090,  815,  815,  815,  930,  815,  815,  933,
+ /*  4590 */   928,  929,  931,  932,  815,  815,  815,  815,  815,  815,
+ /*  4600 */   142,  815,  815,  815,  815,  815, 1040,  150,  815,  815,
+ /*  4610 */  1097,  145, 1060,  157,  199,  198,  149,  191,  272,  271,
+ /*  4620 */   269,  267,  189, 1090,  815,  815,  815,  930,  815,  815,
+ /*  4630 */   933,  928,  929,  931,  932,  815,  815,  815,  815,  815,
+ /*  4640 */   815,  815,  815,  815,  815,  815,  815, 1040,  150,  815,
+ /*  4650 */   142, 1096,  145, 1060,  157,  199,  198,  149,  191,  272,
+ /*  4660 */   271,  269,  267,  189, 1090,  815,  815,  815,  815,  815,
+ /*  4670 */   815,  815,  815,  815,  815,  815,  815,  930,  815,  815,
+ /*  4680 */   933,  928,  929,  931,  932,  815,  815,  815,  815,  815,
+ /*  4690 */   815,  142,  815,  815,  815,  815,  815, 1040,  150,  815,
+ /*  4700 */   815, 1095,  145, 1060,  157,  199,  198,  149,  191,  272,
+ /*  4710 */   271,  269,  267,  189, 1090,  815,  815,  815,  930,  815,
+ /*  4720 */   815,  933,  928,  929,  931,  932,  815,  815,  815,  815,
+ /*  4730 */   815,  815,  142,  815,  815,  815,  815,  815, 1040,  150,
+ /*  4740 */   815,  815, 1094,  145, 1060,  157,  199,  198,  149,  191,
+ /*  4750 */   272,  271,  269,  267,  189, 1090,  815,  815,  815,  930,
+ /*  4760 */   815,  815,  933,  928,  929,  931,  932,  815,  815,  815,
+ /*  4770 */   815,  815,  815,  815,  815,  815,  815,  815,  815, 1040,
+ /*  4780 */   150,  815,  142, 1093,  145, 1060,  157,  199,  198,  149,
+ /*  4790 */   191,  272,  271,  269,  267,  189, 1090,  815,  815,  815,
+ /*  4800 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  930,
+ /*  4810 */   815,  815,  933,  928,  929,  931,  932,  815,  815,  815,
+ /*  4820 */   815,  815,  815,  142,  815,  815,  815,  815,  815, 1040,
+ /*  4830 */   150,  815,  815, 1092,  145, 1060,  157,  199,  198,  149,
+ /*  4840 */   191,  272,  271,  269,  267,  189, 1090,  815,  815,  815,
+ /*  4850 */   930,  815,  815,  933,  928,  929,  931,  932,  815,  815,
+ /*  4860 */   815,  815,  815,  815,  142,  815,  815,  815,  815,  815,
+ /*  4870 */  1040,  150,  815,  815, 1091,  145, 1060,  157,  199,  198,
+ /*  4880 */   149,  191,  272,  271,  269,  267,  189, 1090,  815,  815,
+ /*  4890 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  4900 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  4910 */   815, 1040,  150,  815,  142, 1103,  145, 1060,  157,  199,
+ /*  4920 */   198,  149,  191,  272,  271,  269,  267,  189, 1090,  815,
+ /*  4930 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  4940 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  4950 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  205,
+ /*  4960 */   815, 1040,  150,  815,  815,  815, 1058, 1060,  157,  199,
+ /*  4970 */   198,  149,  191,  272,  271,  269,  267,  189, 1089,  815,
+ /*  4980 */   815,  815,  643,  644,  645,  646,  647,  648,  649,  650,
+ /*  4990 */   651,  652,  653,  654,  655,  656,  657,  658,  295,  294,
+ /*  5000 */   293,  282,  815,  278,  815,   99,  815,  815,  815,  815,
+ /*  5010 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  5020 */   815,  815,  815,  142,  815,  815,  815,  815,  815,  815,
+ /*  5030 */   643,  644,  645,  646,  647,  648,  649,  650,  651,  652,
+ /*  5040 */   653,  654,  655,  656,  657,  658,  295,  294,  293,  282,
+ /*  5050 */   930,  278,  815,  933,  928,  929,  931,  932,  815,  815,
+ /*  5060 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  5070 */  1040,  150,  815,  815,  815, 1058, 1060,  157,  199,  198,
+ /*  5080 */   149,  191,  272,  271,  269,  267,  188,  815,  815,  815,
+ /*  5090 */   815,  815,  815,  142,  643,  644,  645,  646,  647,  648,
+ /*  5100 */   649,  650,  651,  652,  653,  654,  655,  656,  657,  658,
+ /*  5110 */   295,  294,  293,  282,  815,  278,  815,  815,  815,  815,
+ /*  5120 */   930,  815,  815,  933,  928,  929,  931,  932,  815,  142,
+ /*  5130 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  5140 */  1040,  150,  815,  815,  815, 1058, 1060,  157,  199,  198,
+ /*  5150 */   149,  191,  272,  271,  269,  265,  930,  815,  815,  933,
+ /*  5160 */   928,  929,  931,  932,  142,  815,  815,  815,  815,  815,
+ /*  5170 */   815,  815,  815,  815,  815,  815, 1040,  150,  815,  815,
+ /*  5180 */   815, 1058, 1060,  157,  199,  198,  149,  191,  272,  271,
+ /*  5190 */   266,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  5200 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  5210 */   815, 1040,  150,  815,  815,  815, 1058, 1060,  157,  199,
+ /*  5220 */   198,  149,  191,  272,  268,  818,  819,  128,  815,  822,
+ /*  5230 */   108,  110,  815,   95,  129,  815,  815,  815,  815,  142,
+ /*  5240 */   815,  815,   94,  815,  869,  815,  815,  815,  252,  815,
+ /*  5250 */   815,  815,  815,  815,  815,  815,  815,  815,  930,  815,
+ /*  5260 */   815,  933,  928,  929,  931,  932,  930,  815,  815,  933,
+ /*  5270 */   928,  929,  931,  932,  815,  815,  815,  142,  815,  815,
+ /*  5280 */   815,  815,  815,  815,  815,  815, 1040,  150,  815,  815,
+ /*  5290 */   815, 1058, 1060,  157,  199,  198,  149,  191,  270,  815,
+ /*  5300 */   815,  815,  815,  815,  930,  815,  815,  933,  928,  929,
+ /*  5310 */   931,  932,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  5320 */   815,  815,  815,  815, 1040,  150,  815,  815,  815, 1058,
+ /*  5330 */  1060,  157,  199,  198,  149,  190,  815,  675,  245,  677,
+ /*  5340 */   678,  679,  680,  142,  815,  815,  815,  815,  815,  178,
+ /*  5350 */   238,  815,  237,  815,  236,  235,  233,  231,  229,  815,
+ /*  5360 */   227,  225,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  5370 */   930,  815,  815,  933,  928,  929,  931,  932,  815,  815,
+ /*  5380 */   142,  815,  815,  815,  815,  815,  815,  815,  815,  815,
+ /*  5390 */  1040,  150,  815,  815,  815, 1058, 1060,  157,  199,  198,
+ /*  5400 */   147,  815,  815,  815,  815,  815,  815,  930,  815,  815,
+ /*  5410 */   933,  928,  929,  931,  932,  815,  815,  815,  142,  815,
+ /*  5420 */   815,  815,  815,  815,  815,  815,  815, 1040,  150,  142,
+ /*  5430 */   815,  815, 1058, 1060,  157,  199,  198,  148,  815,  815,
+ /*  5440 */   815,  815,  815,  815,  815,  930,  815,  815,  933,  928,
+ /*  5450 */   929,  931,  932,  815,  815,  815,  930,  815,  815,  933,
+ /*  5460 */   928,  929,  931,  932,  142, 1040,  150,  815,  815,  815,
+ /*  5470 */  1058, 1060,  157,  199,  192,  142, 1040,  150,  815,  815,
+ /*  5480 */   815, 1058, 1060,  157,  199,  193,  815,  815,  815,  815,
+ /*  5490 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  815,
+ /*  5500 */   815,  815,  930,  815,  815,  933,  928,  929,  931,  932,
+ /*  5510 */   815, 1040,  150,  815,  815,  815, 1058, 1060,  157,  199,
+ /*  5520 */   194,  815, 1040,  150,  815,  815,  815, 1058, 1060,  157,
+ /*  5530 */   199,  195,  142,  815,  815,  815,  815,  815,  815,  815,
+ /*  5540 */   815,  815,  142,  815,  815,  815,  815,  815,  815,  815,
+ /*  5550 */   815,  815,  815,  815,  815,  815,  815,  815,  815,  930,
+ /*  5560 */   815,  815,  933,  928,  929,  931,  932,  815,  815,  930,
+ /*  5570 */   815,  815,  933,  928,  929,  931,  932,  142,  815, 1040,
+ /*  5580 */   150,  815,  815,  815, 1058, 1060,  157,  196,  142, 1040,
+ /*  5590 */   150,  815,  815,  815, 1058, 1060,  157,  197,  815,  815,
+ /*  5600 */   815,  815,  815,  815,  930,  815,  815,  933,  928,  929,
+ /*  5610 */   931,  932,  815,  815,  815,  930,  142,  815,  933,  928,
+ /*  5620 */   929,  931,  932,  815, 1040,  150,  142,  815,  815, 1058,
+ /*  5630 */  1060,  155,  815,  815,  815, 1040,  150,  815,  815,  815,
+ /*  5640 */  1058, 1060,  156,  930,  815,  815,  933,  928,  929,  931,
+ /*  5650 */   932,  815,  815,  930,  142,  815,  933,  928,  929,  931,
+ /*  5660 */   932,  815,  142, 1040,  150,  815,  815,  815, 1058, 1063,
+ /*  5670 */   815,  815,  815, 1040,  150,  815,  815,  815, 1058, 1062,
+ /*  5680 */   815,  930,  815,  815,  933,  928,  929,  931,  932,  930,
+ /*  5690 */   815,  142,  933,  928,  929,  931,  932,  815,  815,  815,
+ /*  5700 */   815, 1040,  150,  815,  815,  815, 1058, 1061,  815, 1040,
+ /*  5710 */   150,  815,  815,  815, 1058, 1057,  815,  815,  930,  142,
+ /*  5720 */   815,  933,  928,  929,  931,  932,  815,  142,  815,  815,
+ /*  5730 */   815,  815,  815,  815,  815,  815,  815,  815, 1040,  150,
+ /*  5740 */   815,  815,  815, 1058, 1056,  815,  930,  815,  815,  933,
+ /*  5750 */   928,  929,  931,  932,  930,  815,  815,  933,  928,  929,
+ /*  5760 */   931,  932,  815,  815,  815,  815, 1040,  150,  815,  815,
+ /*  5770 */   815, 1058, 1055,  815, 1040,  150,  815,  815,  208, 1058,
+ /*  5780 */  1054,  815,  815,  203,  210,  836,   98,  815,  208,  815,
+ /*  5790 */   815,  815,  815,  211,  210,  836,   98,  815,  815,  815,
+ /*  5800 */   815,  815,  815,  815,  815,  930,  815,  815,  933,  928,
+ /*  5810 */   929,  931,  932,  815,  815,  930,  121,  815,  933,  928,
+ /*  5820 */   929,  931,  932,  815,  815,   96,  815,  815,  815,  815,
+ /*  5830 */   815,  815,  815,  121,   92,  900,  903,  815,  815,  815,
+ /*  5840 */   815,  815,   96,  930,  815,  815,  933,  928,  929,  931,
+ /*  5850 */   932,  815,  901,  903,  815,  815,  815,  815,  815,  815,
+ /*  5860 */   930,  815,  815,  933,  928,  929,  931,  932,
+};
+static const YYCODETYPE yy_lookahead[] = {
+ /*     0 */   135,  173,  141,  168,  141,  177,  141,  146,  147,  132,
+ /*    10 */   147,  146,  147,  158,  153,  154,  153,  154,  153,  154,
+ /*    20 */   143,  177,  145,  156,  157,  158,  132,   27,   28,   21,
+ /*    30 */    22,   23,   24,   33,   34,   35,   36,  143,   38,  145,
+ /*    40 */    40,    2,  141,   43,   44,   45,   46,   40,  147,   29,
+ /*    50 */    30,   31,   52,   46,  153,  154,   56,  180,   46,   59,
+ /*    60 */    60,   61,   62,   63,   64,   65,   66,   67,  157,  158,
+ /*    70 */    70,   71,   72,   73,   74,   75,   76,   77,   78,   79,
+ /*    80 */    80,   81,   82,   83,   84,   85,   86,   87,   88,   89,
+ /*    90 */    90,   91,   53,   54,   55,   56,   57,   58,   98,   99,
+ /*   100 */   100,  101,  102,  103,  140,  141,  106,   66,  108,   35,
+ /*   110 */    36,   37,   38,   46,  114,   53,  132,   27,   28,  119,
+ /*   120 */   120,  121,  122,   33,   34,   35,   36,  143,   38,  145,
+ /*   130 */    40,    2,  135,   43,   44,   45,   46,  140,  141,  101,
+ /*   140 */   102,  147,   52,    2,  106,  158,   56,  153,  154,   59,
+ /*   150 */    60,   61,   62,   63,   64,   65,   66,   67,  117,  118,
+ /*   160 */    70,   71,   72,   73,   74,   75,   76,   77,   78,   79,
+ /*   170 */    80,   81,   82,   83,   84,   85,   86,   87,   88,   89,
+ /*   180 */    90,   91,  180,   54,   55,   56,   57,   58,   98,   99,
+ /*   190 */   100,  101,  102,  103,   53,  135,  106,  132,  108,  128,
+ /*   200 */   140,  141,   43,   43,  114,   46,   46,   27,   28,  119,
+ /*   210 */   120,  121,  122,   33,   34,   35,   36,  152,   38,   38,
+ /*   220 */    40,   40,  147,   43,   44,   45,   46,  147,  153,  154,
+ /*   230 */     1,  147,   52,  153,  154,  132,   56,  153,  154,   59,
+ /*   240 */    60,   61,   62,   63,   64,   65,  143,   67,  145,    1,
+ /*   250 */    70,   71,   72,   73,   74,   75,   76,   77,   78,   79,
+ /*   260 */    80,   81,   82,   83,   84,   85,   86,   87,   88,   89,
+ /*   270 */    90,   91,   43,    2,    2,  140,  141,   53,   98,   99,
+ /*   280 */   100,  101,  102,  103,  135,   46,  106,  131,  108,   43,
+ /*   290 */   134,   43,   21,   21,  114,  117,  118,   27,   28,  119,
+ /*   300 */   120,  121,  122,   33,   34,   35,   36,   68,   69,    1,
+ /*   310 */    40,   65,    2,   43,  158,   45,   46,  161,  162,  163,
+ /*   320 */   164,  165,   52,  132,   53,   53,   56,   40,   41,   59,
+ /*   330 */    60,   61,   62,   63,   64,    1,  145,   67,    1,    1,
+ /*   340 */    70,   71,   72,   73,   74,   75,   76,   77,   78,   79,
+ /*   350 */    80,   81,   82,   83,   84,   85,   86,   87,   88,   89,
+ /*   360 */    90,   91,  101,  102,   39,   40,  126,  106,  128,  129,
+ /*   370 */   130,  131,  141,    1,   66,  101,  102,    1,   41,   41,
+ /*   380 */   106,    1,  142,  141,  144,  141,    1,   53,  148,  119,
+ /*   390 */   120,  121,  122,   37,    1,  155,    1,   41,  158,   68,
+ /*   400 */    69,  161,  162,  163,  164,  165,  166,  167,    1,  169,
+ /*   410 */   170,  171,  172,   41,  174,  175,    1,   41,  178,  179,
+ /*   420 */     1,   41,  182,  183,  184,  185,  186,  187,  188,  189,
+ /*   430 */   190,  191,  192,  193,  194,  195,   43,  126,   43,  128,
+ /*   440 */   129,  130,  131,  108,    1,    1,   13,   14,   41,  114,
+ /*   450 */   108,   66,  135,  142,  141,  144,  114,   40,   43,  148,
+ /*   460 */    19,   20,   43,   25,   26,  176,  155,   65,    1,  158,
+ /*   470 */     1,  128,  161,  162,  163,  164,  165,  166,  167,    1,
+ /*   480 */   169,  170,  171,  172,   41,  174,  175,   43,  131,  178,
+ /*   490 */   179,    1,    1,  182,  183,  184,  185,  186,  187,  188,
+ /*   500 */   189,  190,  191,  192,  193,  194,  195,  141,   41,  126,
+ /*   510 */    41,  128,  129,  130,  131,  158,    1,   39,  161,  162,
+ /*   520 */   163,  164,  165,  135,   14,  142,    1,  144,   27,   28,
+ /*   530 */    53,  148,   41,   43,  153,  178,  179,    1,  155,    1,
+ /*   540 */   183,  158,   53,  154,  161,  162,  163,  164,  165,  166,
+ /*   550 */   167,   40,  169,  170,  171,  172,   41,  174,  175,  131,
+ /*   560 */     1,  178,  179,   53,   39,  182,  183,  184,  185,  186,
+ /*   570 */   187,  188,  189,  190,  191,  192,  193,  194,  195,   43,
+ /*   580 */   126,   43,  128,  129,  130,  131,  158,  132,  180,  161,
+ /*   590 */   162,  163,  164,  165,  132,   41,  142,   40,  144,   46,
+ /*   600 */    41,   49,  148,    1,   46,   40,  178,  179,   41,  155,
+ /*   610 */    46,  183,  158,   51,   46,  161,  162,  163,  164,  165,
+ /*   620 */    65,  167,   53,  169,  170,  171,  172,   40,  174,  175,
+ /*   630 */    42,   40,  178,  179,   40,   43,  182,  183,  184,  185,
+ /*   640 */   186,  187,  188,  189,  190,  191,  192,  193,  194,  195,
+ /*   650 */    40,  102,  126,  114,  128,  129,  130,  131,   79,   80,
+ /*   660 */    81,   82,   83,   84,   85,   86,   87,  101,  142,   39,
+ /*   670 */   144,   39,   39,   23,  148,  114,   39,   39,  108,  108,
+ /*   680 */   108,  155,  108,   39,  158,   39,   39,  161,  162,  163,
+ /*   690 */   164,  165,   39,  167,   39,  169,  170,  171,  172,   41,
+ /*   700 */   174,  175,   90,   39,  178,  179,   41,   90,  182,  183,
+ /*   710 */   184,  185,  186,  187,  188,  189,  190,  191,  192,  193,
+ /*   720 */   194,  195,   40,  126,   43,  128,  129,  130,  131,   79,
+ /*   730 */    80,   81,   82,   83,   84,   85,   86,   87,   43,  142,
+ /*   740 */    43,  144,   46,   65,   46,  148,   79,   80,   81,   82,
+ /*   750 */    83,   84,  155,   86,   87,  158,   46,    1,  161,  162,
+ /*   760 */   163,  164,  165,   43,  167,   41,  169,  170,  171,  172,
+ /*   770 */    68,  174,  175,   69,  131,  178,  179,   46,   40,  182,
+ /*   780 */   183,  184,  185,  186,  187,  188,  189,  190,  191,  192,
+ /*   790 */   193,  194,  195,   41,  151,  126,   46,  128,  129,  130,
+ /*   800 */   131,  158,   40,   46,  161,  162,  163,  164,  165,   46,
+ /*   810 */    15,  142,   16,  144,   17,   23,   18,  148,   90,    1,
+ /*   820 */    90,    1,   21,   23,  155,   90,    1,  158,   21,   23,
+ /*   830 */   161,  162,  163,  164,  165,   21,  167,   83,  169,  170,
+ /*   840 */   171,  172,   23,  174,  175,  131,   23,  178,  179,   83,
+ /*   850 */    23,  182,  183,  184,  185,  186,  187,  188,  189,  190,
+ /*   860 */   191,  192,  193,  194,  195,   23,  126,   23,  128,  129,
+ /*   870 */   130,  131,  158,   23,   23,  161,  162,  163,  164,  165,
+ /*   880 */   196,   38,  142,  196,  144,   83,   83,  196,  148,  196,
+ /*   890 */   196,  196,  196,  196,  196,  155,  196,  196,  158,  196,
+ /*   900 */   196,  161,  162,  163,  164,  165,  196,  167,  196,  169,
+ /*   910 */   170,  171,  172,  196,  174,  175,  196,  131,  178,  179,
+ /*   920 */   196,  196,  182,  183,  184,  185,  186,  187,  188,  189,
+ /*   930 */   190,  191,  192,  193,  194,  195,  196,  196,  126,  196,
+ /*   940 */   128,  129,  130,  131,  158,  196,  196,  161,  162,  163,
+ /*   950 */   164,  165,  196,  196,  142,  196,  144,  196,  196,  196,
+ /*   960 */   148,  196,  196,  196,  196,  196,  196,  155,  196,  196,
+ /*   970 */   158,  196,  196,  161,  162,  163,  164,  165,  196,  167,
+ /*   980 */   196,  169,  170,  171,  172,  196,  174,  175,  131,  196,
+ /*   990 */   178,  179,  196,  196,  182,  183,  184,  185,  186,  187,
+ /*  1000 */   188,  189,  190,  191,  192,  193,  194,  195,  196,  126,
+ /*  1010 */   196,  128,  129,  130,  131,  158,  196,  196,  161,  162,
+ /*  1020 */   163,  164,  165,  196,  196,  142,  196,  144,  196,  196,
+ /*  1030 */   196,  148,  196,  196,  196,  196,  196,  196,  155,  196,
+ /*  1040 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  1050 */   167,  196,  169,  170,  171,  172,  196,  174,  175,  196,
+ /*  1060 */   196,  178,  179,  196,  196,  182,  183,  184,  185,  186,
+ /*  1070 */   187,  188,  189,  190,  191,  192,  193,  194,  195,  196,
+ /*  1080 */   196,  126,  196,  128,  129,  130,  131,  196,  196,  196,
+ /*  1090 */   196,  196,  196,  196,  196,  196,  196,  142,  196,  144,
+ /*  1100 */   196,  196,  196,  148,  196,  196,  196,  196,  196,  196,
+ /*  1110 */   155,  196,  196,  158,  196,  196,  161,  162,  163,  164,
+ /*  1120 */   165,  196,  167,  196,  169,  170,  171,  172,  196,  174,
+ /*  1130 */   175,  196,  196,  178,  179,  196,  196,  182,  183,  184,
+ /*  1140 */   185,  186,  187,  188,  189,  190,  191,  192,  193,  194,
+ /*  1150 */   195,  196,  126,  196,  128,  129,  130,  131,  196,  196,
+ /*  1160 */   196,  196,  196,  196,  196,  196,  196,  196,  142,  196,
+ /*  1170 */   144,  196,  196,  196,  148,  196,  196,  196,  196,  196,
+ /*  1180 */   196,  155,  196,  196,  158,  196,  196,  161,  162,  163,
+ /*  1190 */   164,  165,  196,  167,  196,  169,  170,  171,  172,  196,
+ /*  1200 */   174,  175,  196,  196,  178,  179,  196,  196,  182,  183,
+ /*  1210 */   184,  185,  186,  187,  188,  189,  190,  191,  192,  193,
+ /*  1220 */   194,  195,  196,  196,  126,  196,  128,  129,  130,  131,
+ /*  1230 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  1240 */   142,  196,  144,  196,  196,  196,  148,  196,  196,  196,
+ /*  1250 */   196,  196,  196,  155,  196,  196,  158,  196,  196,  161,
+ /*  1260 */   162,  163,  164,  165,  196,  167,  196,  169,  170,  171,
+ /*  1270 */   172,  196,  174,  175,  196,  196,  178,  179,  196,  196,
+ /*  1280 */   182,  183,  184,  185,  186,  187,  188,  189,  190,  191,
+ /*  1290 */   192,  193,  194,  195,  196,  126,  196,  128,  129,  130,
+ /*  1300 */   131,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  1310 */   196,  142,  196,  144,  196,  196,  196,  148,  196,  196,
+ /*  1320 */   196,  196,  196,  196,  155,  196,  196,  158,  196,  196,
+ /*  1330 */   161,  162,  163,  164,  165,  196,  167,  196,  169,  170,
+ /*  1340 */   171,  172,  196,  174,  175,  196,  196,  178,  179,  196,
+ /*  1350 */   196,  182,  183,  184,  185,  186,  187,  188,  189,  190,
+ /*  1360 */   191,  192,  193,  194,  195,  196,  196,  126,  196,  128,
+ /*  1370 */   129,  130,  131,  196,  196,  196,  196,  196,  196,  196,
+ /*  1380 */   196,  196,  196,  142,  196,  144,  196,  196,  196,  148,
+ /*  1390 */   196,  196,  196,  196,  196,  196,  155,  196,  196,  158,
+ /*  1400 */   196,  196,  161,  162,  163,  164,  165,  196,  167,  196,
+ /*  1410 */   169,  170,  171,  172,  196,  174,  175,  196,  196,  178,
+ /*  1420 */   179,  196,  196,  182,  183,  184,  185,  186,  187,  188,
+ /*  1430 */   189,  190,  191,  192,  193,  194,  195,  196,  126,  196,
+ /*  1440 */   128,  129,  130,  131,  196,  196,  196,  196,  196,  196,
+ /*  1450 */   196,  196,  196,  196,  142,  196,  144,  196,  196,  196,
+ /*  1460 */   148,  196,  196,  196,  196,  196,  196,  155,  196,  196,
+ /*  1470 */   158,  196,  196,  161,  162,  163,  164,  165,  196,  167,
+ /*  1480 */   196,  169,  170,  171,  172,  196,  174,  175,  196,  196,
+ /*  1490 */   178,  179,  196,  196,  182,  183,  184,  185,  186,  187,
+ /*  1500 */   188,  189,  190,  191,  192,  193,  194,  195,  196,  196,
+ /*  1510 */   126,  196,  128,  129,  130,  131,  196,  196,  196,  196,
+ /*  1520 */   196,  196,  196,  196,  196,  196,  142,  196,  144,  196,
+ /*  1530 */   196,  196,  148,  196,  196,  196,  196,  196,  196,  155,
+ /*  1540 */   196,  196,  158,  196,  196,  161,  162,  163,  164,  165,
+ /*  1550 */   196,  167,  196,  169,  170,  171,  172,  196,  174,  175,
+ /*  1560 */   196,  196,  178,  179,  196,  196,  182,  183,  184,  185,
+ /*  1570 */   186,  187,  188,  189,  190,  191,  192,  193,  194,  195,
+ /*  1580 */   196,  126,  196,  128,  129,  130,  131,  196,  196,  196,
+ /*  1590 */   196,  196,  196,  196,  196,  196,  196,  142,  196,  144,
+ /*  1600 */   196,  196,  196,  148,  196,  196,  196,  196,  196,  196,
+ /*  1610 */   155,  196,  196,  158,  196,  196,  161,  162,  163,  164,
+ /*  1620 */   165,  196,  167,  196,  169,  170,  171,  172,  196,  174,
+ /*  1630 */   175,  196,  196,  178,  179,  196,  196,  182,  183,  184,
+ /*  1640 */   185,  186,  187,  188,  189,  190,  191,  192,  193,  194,
+ /*  1650 */   195,  196,  196,  126,  196,  128,  129,  130,  131,  196,
+ /*  1660 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  142,
+ /*  1670 */   196,  144,  196,  196,  196,  148,  196,  196,  196,  196,
+ /*  1680 */   196,  196,  155,  196,  196,  158,  196,  196,  161,  162,
+ /*  1690 */   163,  164,  165,  196,  167,  196,  169,  170,  171,  172,
+ /*  1700 */   196,  174,  175,  196,  196,  178,  179,  196,  196,  182,
+ /*  1710 */   183,  184,  185,  186,  187,  188,  189,  190,  191,  192,
+ /*  1720 */   193,  194,  195,  196,  126,  196,  128,  129,  130,  131,
+ /*  1730 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  1740 */   142,  196,  144,  196,  196,  196,  148,  196,  196,  196,
+ /*  1750 */   196,  196,  196,  155,  196,  196,  158,  196,  196,  161,
+ /*  1760 */   162,  163,  164,  165,  196,  167,  196,  169,  170,  171,
+ /*  1770 */   172,  196,  174,  175,  196,  196,  178,  179,  196,  131,
+ /*  1780 */   182,  183,  184,  185,  186,  187,  188,  189,  190,  191,
+ /*  1790 */   192,  193,  194,  195,  196,   27,   28,  196,  196,  196,
+ /*  1800 */   196,   33,   34,   35,   36,  196,  158,  196,   40,  161,
+ /*  1810 */   162,  163,  164,  165,   46,    2,    3,    4,    5,    6,
+ /*  1820 */     7,    8,    9,   10,   11,   12,  178,  179,  196,  196,
+ /*  1830 */   196,  183,  184,   65,  196,  196,  196,  196,   70,   71,
+ /*  1840 */    72,   73,   74,   75,   76,   77,   78,   79,   80,   81,
+ /*  1850 */    82,   83,   84,   85,   86,   87,   88,   89,   90,   91,
+ /*  1860 */   196,   27,   28,  196,  196,  196,  196,   33,   34,   35,
+ /*  1870 */    36,  196,  196,  196,   40,  196,  196,  196,  196,  196,
+ /*  1880 */    46,  196,  196,  196,  196,  196,  196,  119,  120,  121,
+ /*  1890 */   122,  196,  196,  196,  196,  196,  196,  196,  196,   65,
+ /*  1900 */   196,  196,  196,  196,   70,   71,   72,   73,   74,   75,
+ /*  1910 */    76,   77,   78,   79,   80,   81,   82,   83,   84,   85,
+ /*  1920 */    86,   87,   88,   89,   90,   91,  196,   27,   28,  196,
+ /*  1930 */   196,  196,  196,   33,   34,   35,   36,  196,  196,  196,
+ /*  1940 */    40,   41,  196,  196,  196,  196,   46,  196,  196,  196,
+ /*  1950 */   196,  196,  196,  119,  120,  121,  122,  196,  196,  196,
+ /*  1960 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  1970 */    70,   71,   72,   73,   74,   75,   76,   77,   78,   79,
+ /*  1980 */    80,   81,   82,   83,   84,   85,   86,   87,   88,   89,
+ /*  1990 */    90,   91,  196,  196,  196,  196,  196,  196,   27,   28,
+ /*  2000 */   196,  131,  196,  196,   33,   34,   35,   36,  138,  139,
+ /*  2010 */   196,   40,   41,  196,  196,  196,  196,   46,  196,  119,
+ /*  2020 */   120,  121,  122,  196,  196,  196,  196,  196,  158,  196,
+ /*  2030 */   196,  161,  162,  163,  164,  165,  196,  196,  196,  196,
+ /*  2040 */   196,   70,   71,   72,   73,   74,   75,   76,   77,   78,
+ /*  2050 */    79,   80,   81,   82,   83,   84,   85,   86,   87,   88,
+ /*  2060 */    89,   90,   91,  196,  196,  196,  196,  131,  196,   27,
+ /*  2070 */    28,  196,  196,  196,  196,   33,   34,   35,   36,  196,
+ /*  2080 */   144,  196,   40,  196,  196,   43,  196,  196,   46,  196,
+ /*  2090 */   119,  120,  121,  122,  158,  196,  196,  161,  162,  163,
+ /*  2100 */   164,  165,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2110 */   196,  196,   70,   71,   72,   73,   74,   75,   76,   77,
+ /*  2120 */    78,   79,   80,   81,   82,   83,   84,   85,   86,   87,
+ /*  2130 */    88,   89,   90,   91,  196,  196,  196,  196,  196,  196,
+ /*  2140 */    27,   28,  196,  196,  196,  196,   33,   34,   35,   36,
+ /*  2150 */   196,  196,  196,   40,   41,  196,  196,  196,  196,   46,
+ /*  2160 */   196,  119,  120,  121,  122,  196,  196,  196,  196,  196,
+ /*  2170 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2180 */   196,  196,  196,   70,   71,   72,   73,   74,   75,   76,
+ /*  2190 */    77,   78,   79,   80,   81,   82,   83,   84,   85,   86,
+ /*  2200 */    87,   88,   89,   90,   91,  196,  196,  196,  196,  196,
+ /*  2210 */   196,   27,   28,  196,  196,  196,  196,   33,   34,   35,
+ /*  2220 */    36,  196,  196,  196,   40,   41,  196,  196,  196,  196,
+ /*  2230 */    46,  196,  119,  120,  121,  122,  196,  196,  196,  196,
+ /*  2240 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2250 */   196,  196,  196,  196,   70,   71,   72,   73,   74,   75,
+ /*  2260 */    76,   77,   78,   79,   80,   81,   82,   83,   84,   85,
+ /*  2270 */    86,   87,   88,   89,   90,   91,  196,  196,  196,  196,
+ /*  2280 */   196,  196,   27,   28,  196,  196,  196,  196,   33,   34,
+ /*  2290 */    35,   36,  196,  196,  196,   40,  196,  196,   43,  196,
+ /*  2300 */   196,   46,  196,  119,  120,  121,  122,  196,  196,  196,
+ /*  2310 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2320 */   196,  196,  196,  196,  196,   70,   71,   72,   73,   74,
+ /*  2330 */    75,   76,   77,   78,   79,   80,   81,   82,   83,   84,
+ /*  2340 */    85,   86,   87,   88,   89,   90,   91,  196,  196,  196,
+ /*  2350 */   196,  196,  196,   27,   28,  196,  196,  196,  196,   33,
+ /*  2360 */    34,   35,   36,  196,  196,  196,   40,   41,  196,  196,
+ /*  2370 */   196,  196,   46,  196,  119,  120,  121,  122,  196,  196,
+ /*  2380 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2390 */   196,  196,  196,  196,  196,  196,   70,   71,   72,   73,
+ /*  2400 */    74,   75,   76,   77,   78,   79,   80,   81,   82,   83,
+ /*  2410 */    84,   85,   86,   87,   88,   89,   90,   91,  196,  196,
+ /*  2420 */   196,  196,  196,  196,   27,   28,  196,  196,  196,  196,
+ /*  2430 */    33,   34,   35,   36,  196,  196,  196,   40,   41,  196,
+ /*  2440 */   196,  196,  196,   46,  196,  119,  120,  121,  122,  196,
+ /*  2450 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2460 */   196,  196,  196,  196,  196,  196,  196,   70,   71,   72,
+ /*  2470 */    73,   74,   75,   76,   77,   78,   79,   80,   81,   82,
+ /*  2480 */    83,   84,   85,   86,   87,   88,   89,   90,   91,  196,
+ /*  2490 */   196,  196,  196,  196,  196,   27,   28,  196,  196,  196,
+ /*  2500 */   196,   33,   34,   35,   36,  196,  196,  196,   40,  196,
+ /*  2510 */   196,   43,  196,  196,   46,  196,  119,  120,  121,  122,
+ /*  2520 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2530 */   196,  196,  196,  196,  196,  196,  196,  196,   70,   71,
+ /*  2540 */    72,   73,   74,   75,   76,   77,   78,   79,   80,   81,
+ /*  2550 */    82,   83,   84,   85,   86,   87,   88,   89,   90,   91,
+ /*  2560 */   196,  196,  196,  196,  196,  196,   27,   28,  196,  196,
+ /*  2570 */   196,  196,   33,   34,   35,   36,  196,  196,  196,   40,
+ /*  2580 */   196,  196,   43,  196,  196,   46,  196,  119,  120,  121,
+ /*  2590 */   122,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2600 */   196,  196,  196,  196,  196,  196,  196,  196,  196,   70,
+ /*  2610 */    71,   72,   73,   74,   75,   76,   77,   78,   79,   80,
+ /*  2620 */    81,   82,   83,   84,   85,   86,   87,   88,   89,   90,
+ /*  2630 */    91,  196,  196,  196,  196,  196,  196,   27,   28,  196,
+ /*  2640 */   196,  196,  196,   33,   34,   35,   36,  196,  196,  196,
+ /*  2650 */    40,   41,  196,  196,  196,  196,   46,  196,  119,  120,
+ /*  2660 */   121,  122,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2670 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2680 */    70,   71,   72,   73,   74,   75,   76,   77,   78,   79,
+ /*  2690 */    80,   81,   82,   83,   84,   85,   86,   87,   88,   89,
+ /*  2700 */    90,   91,  196,  196,  196,  196,  196,  196,   27,   28,
+ /*  2710 */   196,  196,  196,  196,   33,   34,   35,   36,  196,  196,
+ /*  2720 */    39,   40,  196,  196,  196,  196,  196,   46,  196,  119,
+ /*  2730 */   120,  121,  122,  196,  196,  196,  196,  196,  196,  196,
+ /*  2740 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  2750 */   196,   70,   71,   72,   73,   74,   75,   76,   77,   78,
+ /*  2760 */    79,   80,   81,   82,   83,   84,   85,   86,   87,   88,
+ /*  2770 */    89,   90,   91,    0,  123,  124,  125,  126,  127,  196,
+ /*  2780 */   129,  130,  131,  196,  133,  134,  196,  196,  196,  196,
+ /*  2790 */   196,  196,  196,  142,  196,  144,  196,  196,  196,  148,
+ /*  2800 */   119,  120,  121,  122,  196,  196,  196,  196,  196,  158,
+ /*  2810 */   196,  196,  161,  162,  163,  164,  165,   44,   45,  196,
+ /*  2820 */    47,   48,  196,  196,  196,   52,  196,  196,  196,   56,
+ /*  2830 */   196,  196,   59,   60,   61,   62,   63,   64,  196,  196,
+ /*  2840 */    67,  196,  196,   70,   71,   72,   73,   74,   75,   76,
+ /*  2850 */    77,   78,   79,   80,   81,   82,   83,   84,   85,   86,
+ /*  2860 */    87,   88,   89,  196,   91,   44,   45,  196,   47,   48,
+ /*  2870 */   196,  196,  196,   52,  196,  196,  196,   56,  196,  196,
+ /*  2880 */    59,   60,   61,   62,   63,   64,  196,  196,   67,  196,
+ /*  2890 */   196,   70,   71,   72,   73,   74,   75,   76,   77,   78,
+ /*  2900 */    79,   80,   81,   82,   83,   84,   85,   86,   87,   88,
+ /*  2910 */    89,  196,   91,   27,   28,  196,  196,  196,  196,   33,
+ /*  2920 */    34,   35,   36,  196,  196,  196,   40,  196,  196,  196,
+ /*  2930 */   196,  196,   46,  196,  196,   27,   28,  196,  196,  196,
+ /*  2940 */   196,   33,   34,   35,   36,  196,  196,  196,   40,  196,
+ /*  2950 */   196,  196,  196,  196,   46,  196,   70,   71,   72,   73,
+ /*  2960 */    74,   75,   76,   77,   78,   79,   80,   81,   82,   83,
+ /*  2970 */    84,   85,   86,   87,   88,   89,   90,   91,   70,   71,
+ /*  2980 */    72,   73,   74,   75,   76,   77,   78,   79,   80,   81,
+ /*  2990 */    82,   83,   84,   85,   86,   87,   88,   89,   90,   91,
+ /*  3000 */   196,  196,  196,  196,  196,  119,  120,  121,  122,  196,
+ /*  3010 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3020 */   196,  196,  196,  196,   45,  196,  196,  119,  120,  121,
+ /*  3030 */   122,   52,  196,  196,  196,   56,  196,  196,   59,   60,
+ /*  3040 */    61,   62,   63,   64,  196,  196,  196,  196,  196,   70,
+ /*  3050 */    71,   72,   73,   74,   75,   76,   77,   78,   79,   80,
+ /*  3060 */    81,   82,   83,   84,   85,   86,   87,   88,   89,  126,
+ /*  3070 */    91,  196,  196,  130,  131,  196,  196,  196,  196,  196,
+ /*  3080 */   196,  196,  196,  196,  196,  142,  196,  144,  196,  196,
+ /*  3090 */   196,  148,  196,  196,  196,  196,  196,  196,  155,  196,
+ /*  3100 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  3110 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3120 */   196,  178,  179,  196,  196,  182,  183,  184,  185,  186,
+ /*  3130 */   187,  188,  189,  190,  191,  192,  193,  194,  195,  196,
+ /*  3140 */    54,   55,   56,   57,   58,  196,  196,  196,  196,  196,
+ /*  3150 */   196,  196,   66,  196,  196,  196,   70,   71,   72,   73,
+ /*  3160 */    74,   75,   76,   77,   78,   79,   80,   81,   82,   83,
+ /*  3170 */    84,   85,   86,   87,   88,   89,   47,   91,   49,   50,
+ /*  3180 */    51,   52,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3190 */   196,  196,  196,  196,  196,  196,  196,  196,  196,   70,
+ /*  3200 */    71,   72,   73,   74,   75,   76,   77,   78,   79,   80,
+ /*  3210 */    81,   82,   83,   84,   85,   86,   87,   88,   89,  196,
+ /*  3220 */    91,   54,   55,   56,   57,   58,  196,  196,  196,  196,
+ /*  3230 */   196,  196,  196,  131,  196,  196,  196,   70,   71,   72,
+ /*  3240 */    73,   74,   75,   76,   77,   78,   79,   80,   81,   82,
+ /*  3250 */    83,   84,   85,   86,   87,   88,   89,  155,   91,  196,
+ /*  3260 */   158,  159,  196,  161,  162,  163,  164,  165,  196,  196,
+ /*  3270 */   196,  196,  196,  196,  131,  196,  196,  196,  196,  196,
+ /*  3280 */   178,  179,  196,  196,  182,  183,  184,  185,  186,  187,
+ /*  3290 */   188,  189,  190,  191,  192,  193,  194,  195,  155,  196,
+ /*  3300 */   196,  158,  159,  196,  161,  162,  163,  164,  165,  196,
+ /*  3310 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3320 */   196,  178,  179,  196,  196,  182,  183,  184,  185,  186,
+ /*  3330 */   187,  188,  189,  190,  191,  192,  193,  194,  195,  131,
+ /*  3340 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3350 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3360 */   196,  196,  196,  155,  196,  196,  158,  159,  196,  161,
+ /*  3370 */   162,  163,  164,  165,  196,  196,  196,  196,  196,  196,
+ /*  3380 */   131,  196,  196,  196,  196,  196,  178,  179,  196,  196,
+ /*  3390 */   182,  183,  184,  185,  186,  187,  188,  189,  190,  191,
+ /*  3400 */   192,  193,  194,  195,  155,  196,  196,  158,  196,  160,
+ /*  3410 */   161,  162,  163,  164,  165,  196,  196,  196,  196,  196,
+ /*  3420 */   196,  196,  196,  196,  196,  196,  196,  178,  179,  196,
+ /*  3430 */   196,  182,  183,  184,  185,  186,  187,  188,  189,  190,
+ /*  3440 */   191,  192,  193,  194,  195,   49,   50,   51,   52,  196,
+ /*  3450 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3460 */   196,  196,  131,  196,  196,  196,   70,   71,   72,   73,
+ /*  3470 */    74,   75,   76,   77,   78,   79,   80,   81,   82,   83,
+ /*  3480 */    84,   85,   86,   87,   88,   89,  155,   91,  196,  158,
+ /*  3490 */   196,  196,  161,  162,  163,  164,  165,  196,  196,  196,
+ /*  3500 */   196,  196,  196,  131,  196,  196,  196,  196,  196,  178,
+ /*  3510 */   179,  196,  196,  182,  183,  184,  185,  186,  187,  188,
+ /*  3520 */   189,  190,  191,  192,  193,  194,  195,  155,  196,  196,
+ /*  3530 */   158,  196,  196,  161,  162,  163,  164,  165,  196,  196,
+ /*  3540 */   196,  196,  196,  196,  131,  196,  196,  196,  196,  196,
+ /*  3550 */   178,  179,  196,  196,  182,  183,  184,  185,  186,  187,
+ /*  3560 */   188,  189,  190,  191,  192,  193,  194,  195,  155,  196,
+ /*  3570 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  3580 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3590 */   196,  178,  179,  196,  131,  182,  183,  184,  185,  186,
+ /*  3600 */   187,  188,  189,  190,  191,  192,  193,  194,  195,  196,
+ /*  3610 */   196,  196,  196,  196,  196,  196,  196,  196,  155,  196,
+ /*  3620 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  3630 */   196,  196,  196,  196,  196,  131,  196,  196,  196,  196,
+ /*  3640 */   196,  178,  179,  196,  196,  182,  183,  184,  185,  186,
+ /*  3650 */   187,  188,  189,  190,  191,  192,  193,  194,  195,  155,
+ /*  3660 */   196,  196,  158,  196,  196,  161,  162,  163,  164,  165,
+ /*  3670 */   196,  196,  196,  196,  196,  196,  131,  196,  196,  196,
+ /*  3680 */   196,  196,  178,  179,  196,  196,  182,  183,  184,  185,
+ /*  3690 */   186,  187,  188,  189,  190,  191,  192,  193,  194,  195,
+ /*  3700 */   155,  196,  196,  158,  196,  196,  161,  162,  163,  164,
+ /*  3710 */   165,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3720 */   196,  196,  196,  178,  179,  196,  131,  182,  183,  184,
+ /*  3730 */   185,  186,  187,  188,  189,  190,  191,  192,  193,  194,
+ /*  3740 */   195,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  3750 */   155,  196,  196,  158,  196,  196,  161,  162,  163,  164,
+ /*  3760 */   165,  196,  196,  196,  196,  196,  196,  131,  196,  196,
+ /*  3770 */   196,  196,  196,  178,  179,  196,  196,  182,  183,  184,
+ /*  3780 */   185,  186,  187,  188,  189,  190,  191,  192,  193,  194,
+ /*  3790 */   195,  155,  196,  196,  158,  196,  196,  161,  162,  163,
+ /*  3800 */   164,  165,  196,  196,  196,  196,  196,  196,  131,  196,
+ /*  3810 */   196,  196,  196,  196,  178,  179,  196,  196,  182,  183,
+ /*  3820 */   184,  185,  186,  187,  188,  189,  190,  191,  192,  193,
+ /*  3830 */   194,  195,  155,  196,  196,  158,  196,  196,  161,  162,
+ /*  3840 */   163,  164,  165,  196,  196,  196,  196,  196,  196,  196,
+ /*  3850 */   196,  196,  196,  196,  196,  178,  179,  196,  131,  182,
+ /*  3860 */   183,  184,  185,  186,  187,  188,  189,  190,  191,  192,
+ /*  3870 */   193,  194,  195,  196,  196,  196,  196,  196,  196,  196,
+ /*  3880 */   196,  196,  155,  196,  196,  158,  196,  196,  161,  162,
+ /*  3890 */   163,  164,  165,  196,  196,  196,  196,  196,  196,  131,
+ /*  3900 */   196,  196,  196,  196,  196,  178,  179,  196,  196,  182,
+ /*  3910 */   183,  184,  185,  186,  187,  188,  189,  190,  191,  192,
+ /*  3920 */   193,  194,  195,  196,  196,  196,  158,  196,  196,  161,
+ /*  3930 */   162,  163,  164,  165,  196,  196,  196,  196,  196,  196,
+ /*  3940 */   131,  196,  196,  196,  196,  196,  178,  179,  196,  181,
+ /*  3950 */   182,  183,  184,  185,  186,  187,  188,  189,  190,  191,
+ /*  3960 */   192,  193,  194,  195,  155,  196,  196,  158,  196,  196,
+ /*  3970 */   161,  162,  163,  164,  165,  196,  196,  196,  196,  196,
+ /*  3980 */   196,  196,  196,  196,  196,  196,  196,  178,  179,  196,
+ /*  3990 */   131,  182,  183,  184,  185,  186,  187,  188,  189,  190,
+ /*  4000 */   191,  192,  193,  194,  195,  196,  196,  196,  196,  196,
+ /*  4010 */   196,  196,  196,  196,  155,  196,  196,  158,  196,  196,
+ /*  4020 */   161,  162,  163,  164,  165,  196,  196,  196,  196,  196,
+ /*  4030 */   196,  131,  196,  196,  196,  196,  196,  178,  179,  196,
+ /*  4040 */   196,  182,  183,  184,  185,  186,  187,  188,  189,  190,
+ /*  4050 */   191,  192,  193,  194,  195,  155,  196,  196,  158,  196,
+ /*  4060 */   196,  161,  162,  163,  164,  165,  196,  196,  196,  196,
+ /*  4070 */   196,  196,  131,  196,  196,  196,  196,  196,  178,  179,
+ /*  4080 */   196,  196,  182,  183,  184,  185,  186,  187,  188,  189,
+ /*  4090 */   190,  191,  192,  193,  194,  195,  155,  196,  196,  158,
+ /*  4100 */   196,  196,  161,  162,  163,  164,  165,  196,  196,  196,
+ /*  4110 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  178,
+ /*  4120 */   179,  196,  131,  182,  183,  184,  185,  186,  187,  188,
+ /*  4130 */   189,  190,  191,  192,  193,  194,  195,  196,  196,  196,
+ /*  4140 */   196,  196,  196,  196,  196,  196,  155,  196,  196,  158,
+ /*  4150 */   196,  196,  161,  162,  163,  164,  165,  196,  196,  196,
+ /*  4160 */   196,  196,  196,  131,  196,  196,  196,  196,  196,  178,
+ /*  4170 */   179,  196,  196,  182,  183,  184,  185,  186,  187,  188,
+ /*  4180 */   189,  190,  191,  192,  193,  194,  195,  155,  196,  196,
+ /*  4190 */   158,  196,  196,  161,  162,  163,  164,  165,  196,  196,
+ /*  4200 */   196,  196,  196,  196,  131,  196,  196,  196,  196,  196,
+ /*  4210 */   178,  179,  196,  196,  182,  183,  184,  185,  186,  187,
+ /*  4220 */   188,  189,  190,  191,  192,  193,  194,  195,  155,  196,
+ /*  4230 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  4240 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  4250 */   196,  178,  179,  196,  131,  182,  183,  184,  185,  186,
+ /*  4260 */   187,  188,  189,  190,  191,  192,  193,  194,  195,  196,
+ /*  4270 */   196,  196,  196,  196,  196,  196,  196,  196,  155,  196,
+ /*  4280 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  4290 */   196,  196,  196,  196,  196,  131,  196,  196,  196,  196,
+ /*  4300 */   196,  178,  179,  196,  196,  182,  183,  184,  185,  186,
+ /*  4310 */   187,  188,  189,  190,  191,  192,  193,  194,  195,  155,
+ /*  4320 */   196,  196,  158,  196,  196,  161,  162,  163,  164,  165,
+ /*  4330 */   196,  196,  196,  196,  196,  196,  131,  196,  196,  196,
+ /*  4340 */   196,  196,  178,  179,  196,  196,  182,  183,  184,  185,
+ /*  4350 */   186,  187,  188,  189,  190,  191,  192,  193,  194,  195,
+ /*  4360 */   196,  196,  196,  158,  196,  196,  161,  162,  163,  164,
+ /*  4370 */   165,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  4380 */   196,  196,  196,  178,  179,  196,  131,  182,  183,  184,
+ /*  4390 */   185,  186,  187,  188,  189,  190,  191,  192,  193,  194,
+ /*  4400 */   195,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  4410 */   196,  196,  196,  158,  196,  196,  161,  162,  163,  164,
+ /*  4420 */   165,  196,  196,  196,  196,  196,  196,  131,  196,  196,
+ /*  4430 */   196,  196,  196,  178,  179,  196,  196,  182,  183,  184,
+ /*  4440 */   185,  186,  187,  188,  189,  190,  191,  192,  193,  194,
+ /*  4450 */   195,  196,  196,  196,  158,  196,  196,  161,  162,  163,
+ /*  4460 */   164,  165,  196,  196,  196,  196,  196,  196,  131,  196,
+ /*  4470 */   196,  196,  196,  196,  178,  179,  196,  196,  182,  183,
+ /*  4480 */   184,  185,  186,  187,  188,  189,  190,  191,  192,  193,
+ /*  4490 */   194,  195,  196,  196,  196,  158,  196,  196,  161,  162,
+ /*  4500 */   163,  164,  165,  196,  196,  196,  196,  196,  196,  196,
+ /*  4510 */   196,  196,  196,  196,  196,  178,  179,  196,  131,  182,
+ /*  4520 */   183,  184,  185,  186,  187,  188,  189,  190,  191,  192,
+ /*  4530 */   193,  194,  195,  196,  196,  196,  196,  196,  196,  196,
+ /*  4540 */   196,  196,  196,  196,  196,  158,  196,  196,  161,  162,
+ /*  4550 */   163,  164,  165,  196,  196,  196,  196,  196,  196,  131,
+ /*  4560 */   196,  196,  196,  196,  196,  178,  179,  196,  196,  182,
+ /*  4570 */   183,  184,  185,  186,  187,  188,  189,  190,  191,  192,
+ /*  4580 */   193,  194,  195,  196,  196,  196,  158,  196,  196,  161,
+ /*  4590 */   162,  163,  164,  165,  196,  196,  196,  196,  196,  196,
+ /*  4600 */   131,  196,  196,  196,  196,  196,  178,  179,  196,  196,
+ /*  4610 */   182,  183,  184,  185,  186,  187,  188,  189,  190,  191,
+ /*  4620 */   192,  193,  194,  195,  196,  196,  196,  158,  196,  196,
+ /*  4630 */   161,  162,  163,  164,  165,  196,  196,  196,  196,  196,
+ /*  4640 */   196,  196,  196,  196,  196,  196,  196,  178,  179,  196,
+ /*  4650 */   131,  182,  183,  184,  185,  186,  187,  188,  189,  190,
+ /*  4660 */   191,  192,  193,  194,  195,  196,  196,  196,  196,  196,
+ /*  4670 */   196,  196,  196,  196,  196,  196,  196,  158,  196,  196,
+ /*  4680 */   161,  162,  163,  164,  165,  196,  196,  196,  196,  196,
+ /*  4690 */   196,  131,  196,  196,  196,  196,  196,  178,  179,  196,
+ /*  4700 */   196,  182,  183,  184,  185,  186,  187,  188,  189,  190,
+ /*  4710 */   191,  192,  193,  194,  195,  196,  196,  196,  158,  196,
+ /*  4720 */   196,  161,  162,  163,  164,  165,  196,  196,  196,  196,
+ /*  4730 */   196,  196,  131,  196,  196,  196,  196,  196,  178,  179,
+ /*  4740 */   196,  196,  182,  183,  184,  185,  186,  187,  188,  189,
+ /*  4750 */   190,  191,  192,  193,  194,  195,  196,  196,  196,  158,
+ /*  4760 */   196,  196,  161,  162,  163,  164,  165,  196,  196,  196,
+ /*  4770 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  178,
+ /*  4780 */   179,  196,  131,  182,  183,  184,  185,  186,  187,  188,
+ /*  4790 */   189,  190,  191,  192,  193,  194,  195,  196,  196,  196,
+ /*  4800 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  158,
+ /*  4810 */   196,  196,  161,  162,  163,  164,  165,  196,  196,  196,
+ /*  4820 */   196,  196,  196,  131,  196,  196,  196,  196,  196,  178,
+ /*  4830 */   179,  196,  196,  182,  183,  184,  185,  186,  187,  188,
+ /*  4840 */   189,  190,  191,  192,  193,  194,  195,  196,  196,  196,
+ /*  4850 */   158,  196,  196,  161,  162,  163,  164,  165,  196,  196,
+ /*  4860 */   196,  196,  196,  196,  131,  196,  196,  196,  196,  196,
+ /*  4870 */   178,  179,  196,  196,  182,  183,  184,  185,  186,  187,
+ /*  4880 */   188,  189,  190,  191,  192,  193,  194,  195,  196,  196,
+ /*  4890 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  4900 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  4910 */   196,  178,  179,  196,  131,  182,  183,  184,  185,  186,
+ /*  4920 */   187,  188,  189,  190,  191,  192,  193,  194,  195,  196,
+ /*  4930 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  4940 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  4950 */   196,  196,  196,  196,  196,  196,  196,  196,  196,   47,
+ /*  4960 */   196,  178,  179,  196,  196,  196,  183,  184,  185,  186,
+ /*  4970 */   187,  188,  189,  190,  191,  192,  193,  194,  195,  196,
+ /*  4980 */   196,  196,   70,   71,   72,   73,   74,   75,   76,   77,
+ /*  4990 */    78,   79,   80,   81,   82,   83,   84,   85,   86,   87,
+ /*  5000 */    88,   89,  196,   91,  196,   45,  196,  196,  196,  196,
+ /*  5010 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  5020 */   196,  196,  196,  131,  196,  196,  196,  196,  196,  196,
+ /*  5030 */    70,   71,   72,   73,   74,   75,   76,   77,   78,   79,
+ /*  5040 */    80,   81,   82,   83,   84,   85,   86,   87,   88,   89,
+ /*  5050 */   158,   91,  196,  161,  162,  163,  164,  165,  196,  196,
+ /*  5060 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  5070 */   178,  179,  196,  196,  196,  183,  184,  185,  186,  187,
+ /*  5080 */   188,  189,  190,  191,  192,  193,  194,  196,  196,  196,
+ /*  5090 */   196,  196,  196,  131,   70,   71,   72,   73,   74,   75,
+ /*  5100 */    76,   77,   78,   79,   80,   81,   82,   83,   84,   85,
+ /*  5110 */    86,   87,   88,   89,  196,   91,  196,  196,  196,  196,
+ /*  5120 */   158,  196,  196,  161,  162,  163,  164,  165,  196,  131,
+ /*  5130 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  5140 */   178,  179,  196,  196,  196,  183,  184,  185,  186,  187,
+ /*  5150 */   188,  189,  190,  191,  192,  193,  158,  196,  196,  161,
+ /*  5160 */   162,  163,  164,  165,  131,  196,  196,  196,  196,  196,
+ /*  5170 */   196,  196,  196,  196,  196,  196,  178,  179,  196,  196,
+ /*  5180 */   196,  183,  184,  185,  186,  187,  188,  189,  190,  191,
+ /*  5190 */   192,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  5200 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  5210 */   196,  178,  179,  196,  196,  196,  183,  184,  185,  186,
+ /*  5220 */   187,  188,  189,  190,  191,  125,  126,  127,  196,  129,
+ /*  5230 */   130,  131,  196,  133,  134,  196,  196,  196,  196,  131,
+ /*  5240 */   196,  196,  142,  196,  144,  196,  196,  196,  148,  196,
+ /*  5250 */   196,  196,  196,  196,  196,  196,  196,  196,  158,  196,
+ /*  5260 */   196,  161,  162,  163,  164,  165,  158,  196,  196,  161,
+ /*  5270 */   162,  163,  164,  165,  196,  196,  196,  131,  196,  196,
+ /*  5280 */   196,  196,  196,  196,  196,  196,  178,  179,  196,  196,
+ /*  5290 */   196,  183,  184,  185,  186,  187,  188,  189,  190,  196,
+ /*  5300 */   196,  196,  196,  196,  158,  196,  196,  161,  162,  163,
+ /*  5310 */   164,  165,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  5320 */   196,  196,  196,  196,  178,  179,  196,  196,  196,  183,
+ /*  5330 */   184,  185,  186,  187,  188,  189,  196,   92,   93,   94,
+ /*  5340 */    95,   96,   97,  131,  196,  196,  196,  196,  196,  104,
+ /*  5350 */   105,  196,  107,  196,  109,  110,  111,  112,  113,  196,
+ /*  5360 */   115,  116,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  5370 */   158,  196,  196,  161,  162,  163,  164,  165,  196,  196,
+ /*  5380 */   131,  196,  196,  196,  196,  196,  196,  196,  196,  196,
+ /*  5390 */   178,  179,  196,  196,  196,  183,  184,  185,  186,  187,
+ /*  5400 */   188,  196,  196,  196,  196,  196,  196,  158,  196,  196,
+ /*  5410 */   161,  162,  163,  164,  165,  196,  196,  196,  131,  196,
+ /*  5420 */   196,  196,  196,  196,  196,  196,  196,  178,  179,  131,
+ /*  5430 */   196,  196,  183,  184,  185,  186,  187,  188,  196,  196,
+ /*  5440 */   196,  196,  196,  196,  196,  158,  196,  196,  161,  162,
+ /*  5450 */   163,  164,  165,  196,  196,  196,  158,  196,  196,  161,
+ /*  5460 */   162,  163,  164,  165,  131,  178,  179,  196,  196,  196,
+ /*  5470 */   183,  184,  185,  186,  187,  131,  178,  179,  196,  196,
+ /*  5480 */   196,  183,  184,  185,  186,  187,  196,  196,  196,  196,
+ /*  5490 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  196,
+ /*  5500 */   196,  196,  158,  196,  196,  161,  162,  163,  164,  165,
+ /*  5510 */   196,  178,  179,  196,  196,  196,  183,  184,  185,  186,
+ /*  5520 */   187,  196,  178,  179,  196,  196,  196,  183,  184,  185,
+ /*  5530 */   186,  187,  131,  196,  196,  196,  196,  196,  196,  196,
+ /*  5540 */   196,  196,  131,  196,  196,  196,  196,  196,  196,  196,
+ /*  5550 */   196,  196,  196,  196,  196,  196,  196,  196,  196,  158,
+ /*  5560 */   196,  196,  161,  162,  163,  164,  165,  196,  196,  158,
+ /*  5570 */   196,  196,  161,  162,  163,  164,  165,  131,  196,  178,
+ /*  5580 */   179,  196,  196,  196,  183,  184,  185,  186,  131,  178,
+ /*  5590 */   179,  196,  196,  196,  183,  184,  185,  186,  196,  196,
+ /*  5600 */   196,  196,  196,  196,  158,  196,  196,  161,  162,  163,
+ /*  5610 */   164,  165,  196,  196,  196,  158,  131,  196,  161,  162,
+ /*  5620 */   163,  164,  165,  196,  178,  179,  131,  196,  196,  183,
+ /*  5630 */   184,  185,  196,  196,  196,  178,  179,  196,  196,  196,
+ /*  5640 */   183,  184,  185,  158,  196,  196,  161,  162,  163,  164,
+ /*  5650 */   165,  196,  196,  158,  131,  196,  161,  162,  163,  164,
+ /*  5660 */   165,  196,  131,  178,  179,  196,  196,  196,  183,  184,
+ /*  5670 */   196,  196,  196,  178,  179,  196,  196,  196,  183,  184,
+ /*  5680 */   196,  158,  196,  196,  161,  162,  163,  164,  165,  158,
+ /*  5690 */   196,  131,  161,  162,  163,  164,  165,  196,  196,  196,
+ /*  5700 */   196,  178,  179,  196,  196,  196,  183,  184,  196,  178,
+ /*  5710 */   179,  196,  196,  196,  183,  184,  196,  196,  158,  131,
+ /*  5720 */   196,  161,  162,  163,  164,  165,  196,  131,  196,  196,
+ /*  5730 */   196,  196,  196,  196,  196,  196,  196,  196,  178,  179,
+ /*  5740 */   196,  196,  196,  183,  184,  196,  158,  196,  196,  161,
+ /*  5750 */   162,  163,  164,  165,  158,  196,  196,  161,  162,  163,
+ /*  5760 */   164,  165,  196,  196,  196,  196,  178,  179,  196,  196,
+ /*  5770 */   196,  183,  184,  196,  178,  179,  196,  196,  131,  183,
+ /*  5780 */   184,  196,  196,  136,  137,  138,  139,  196,  131,  196,
+ /*  5790 */   196,  196,  196,  136,  137,  138,  139,  196,  196,  196,
+ /*  5800 */   196,  196,  196,  196,  196,  158,  196,  196,  161,  162,
+ /*  5810 */   163,  164,  165,  196,  196,  158,  131,  196,  161,  162,
+ /*  5820 */   163,  164,  165,  196,  196,  140,  196,  196,  196,  196,
+ /*  5830 */   196,  196,  196,  131,  149,  150,  151,  196,  196,  196,
+ /*  5840 */   196,  196,  140,  158,  196,  196,  161,  162,  163,  164,
+ /*  5850 */   165,  196,  150,  151,  196,  196,  196,  196,  196,  196,
+ /*  5860 */   158,  196,  196,  161,  162,  163,  164,  165,  123,  123,
+ /*  5870 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5880 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5890 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5900 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5910 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5920 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5930 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5940 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5950 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5960 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5970 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5980 */   123,  123,  123,  123,  123,  123,  123,  123,  123,  123,
+ /*  5990 */   123,
+};
+#define YY_SHIFT_COUNT    (296)
+#define YY_SHIFT_MIN      (0)
+#define YY_SHIFT_MAX      (5245)
+static const unsigned short int yy_shift_ofst[] = {
+ /*     0 */  2821,    0,  180,  180,   90,  180,  180,  180,  180,  180,
+ /*    10 */   180,  180,  180,  180,  180,  180,  180,  180,  180,  180,
+ /*    20 */   180,  180,  180,  270, 1768, 1768, 1768, 1834, 1900, 1971,
+ /*    30 */  2042, 2113, 2184, 2255, 2326, 2397, 2468, 2539, 2610, 2681,
+ /*    40 */  2886, 2886, 2886, 2886, 2886, 2886, 2886, 2886, 2886, 2886,
+ /*    50 */  2886, 2886, 2886, 2886, 2886, 2886, 2886, 2886, 2886, 2886,
+ /*    60 */  2886, 2886, 2886, 2886, 2886, 2886, 2773, 2886, 2886, 2886,
+ /*    70 */  2886, 2886, 2886, 2886, 2886, 2886, 2886, 2886, 2886, 2886,
+ /*    80 */  2886, 2886, 2886, 2886, 2886, 2886, 2886, 3129, 3129, 3167,
+ /*    90 */  2908, 2908, 3086, 3396, 2979, 4912, 5024, 4960, 5024, 5024,
+ /*   100 */   271,  272,    7,  141,  141,  579,   39,   39,  159,  160,
+ /*   110 */    12,   67,   62,   62,   62,   62,   67,  650,  129,  129,
+ /*   120 */   178,   67,   67, 5245,  579,  579,   41,  287,  246,  224,
+ /*   130 */   310,  310,  310,  310,  224,  417,  402,  224,  310,  477,
+ /*   140 */   489,   67,  511,  511,   67, 1813,  667,    8,    8,    8,
+ /*   150 */    74,   38,  261,  274,  239,   20,   20,   20,  181,  337,
+ /*   160 */   338,  229,  372,  248,  376,  380,  407,  393,  395,  415,
+ /*   170 */   419,  334,  443,  467,  469,  491,  335,  342,  325,  444,
+ /*   180 */   490,  536,  308,  385,  331,  356,  538,  515,  510,  433,
+ /*   190 */   441,  441,  438,  438,  438,  438,  501,  501,  438,  501,
+ /*   200 */   478,  559,  525,  554,  557,  553,  552,  562,  558,  564,
+ /*   210 */   602,  567,  565,  568,  569,  555,  587,  588,  591,  594,
+ /*   220 */   592,  610,  549,  566,  539,  630,  561,  632,  570,  633,
+ /*   230 */   571,  637,  572,  638,  574,  644,  646,  647,  653,  655,
+ /*   240 */   658,  612,  664,  665,  617,  682,  681,  695,  697,  696,
+ /*   250 */   698,  710,  678,  720,  756,  702,  704,  724,  731,  738,
+ /*   260 */   752,  750,  757,  762,  763,  795,  796,  795,  797,  796,
+ /*   270 */   798,  797,  798,  792,  728,  818,  730,  820,  801,  800,
+ /*   280 */   735,  825,  807,  806,  754,  819,  766,  823,  827,  842,
+ /*   290 */   844,  850,  851,  814,  802,  803,  843,
+};
+#define YY_REDUCE_COUNT (144)
+#define YY_REDUCE_MIN   (-172)
+#define YY_REDUCE_MAX   (5702)
+static const short yy_reduce_ofst[] = {
+ /*     0 */  2651,  240,  311,  383,  454,  454,  526,  597,  669,  740,
+ /*    10 */   812,  883,  955, 1026, 1098, 1169, 1241, 1312,  454, 1384,
+ /*    20 */  1455, 1527, 1598, 2943, 3102, 3143, 3208, 3249, 3331, 3372,
+ /*    30 */  3413, 3463, 3504, 3545, 3595, 3636, 3677, 3727, 3768, 3809,
+ /*    40 */  3859, 3900, 3941, 3991, 4032, 4073, 4123, 4164, 4205, 4255,
+ /*    50 */  4296, 4337, 4387, 4428, 4469, 4519, 4560, 4601, 4651, 4692,
+ /*    60 */  4733, 4783, 4892, 4962, 4998, 5033, 5100, 5108, 5146, 5212,
+ /*    70 */  5249, 5287, 5298, 5333, 5344, 5401, 5411, 5446, 5457, 1648,
+ /*    80 */  5485, 5495, 5523, 5531, 5560, 5588, 5596, 5647, 5657, 5685,
+ /*    90 */   357,  428, 5702, 1870, 1936,  156,  643,  714,  786,  857,
+ /*   100 */  -135, -139, -123, -137,  -99, -133,   -3,   60, -106, -106,
+ /*   110 */   -16, -106,   -6,   75,   80,   84,  103,  -89,  -36,  135,
+ /*   120 */  -172,   65,  191, -165, -145,  -13, -156,    2,   71,  149,
+ /*   130 */   231,  242,  244,  313,  317,  289,  343,  388,  366,  381,
+ /*   140 */   389,  455,    2,  408,  462,
+};
+static const YYACTIONTYPE yy_default[] = {
+ /*     0 */   813,  813, 1032, 1030,  813, 1031,  813,  813,  813,  813,
+ /*    10 */   813,  813,  813,  813,  813,  813,  813,  813, 1029,  813,
+ /*    20 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*    30 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*    40 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*    50 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*    60 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*    70 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*    80 */   813,  813,  813,  813,  813,  813,  813,  835,  835,  813,
+ /*    90 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*   100 */   897,  889,  813,  893,  885,  813,  853,  845,  813,  813,
+ /*   110 */   813,  813,  895,  891,  887,  883,  813,  813,  849,  841,
+ /*   120 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  829,
+ /*   130 */   851,  847,  843,  839,  827,  813,  813,  905,  813,  911,
+ /*   140 */   910,  813,  813, 1033,  813, 1058,  813, 1077, 1076, 1075,
+ /*   150 */  1051,  813,  813,  813,  813, 1066, 1065, 1064,  914,  813,
+ /*   160 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*   170 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*   180 */   813,  813,  813,  813,  813,  813,  813,  813,  813, 1088,
+ /*   190 */  1079, 1078, 1074, 1073, 1072, 1071, 1069, 1068, 1070, 1067,
+ /*   200 */   813,  813,  813,  813,  813,  813,  856,  854,  813,  813,
+ /*   210 */   834,  813,  813,  813,  813,  813,  813,  980,  813,  813,
+ /*   220 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*   230 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*   240 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*   250 */   813,  813,  813,  813,  922,  813,  813,  813,  813,  813,
+ /*   260 */   813,  813,  813,  813,  813, 1087, 1085, 1086, 1083, 1084,
+ /*   270 */  1081, 1082, 1080,  813,  813,  813,  813,  813,  813,  813,
+ /*   280 */   813,  813,  813,  813,  813,  813,  813,  813,  813,  813,
+ /*   290 */   813,  813,  813,  813,  813,  813,  914,
+};
+/********** End of lemon-generated parsing tables *****************************/
+
+/* The next table maps tokens (terminal symbols) into fallback tokens.  
+** If a construct like the following:
+** 
+**      %fallback ID X Y Z.
+**
+** appears in the grammar, then ID becomes a fallback token for X, Y,
+** and Z.  Whenever one of the tokens X, Y, or Z is input to the parser
+** but it does not parse, the type of the token is changed to ID and
+** the parse is retried before an error is thrown.
+**
+** This feature can be used, for example, to cause some keywords in a language
+** to revert to identifiers if they keyword does not apply in the context where
+** it appears.
+*/
+#ifdef YYFALLBACK
+static const YYCODETYPE yyFallback[] = {
+};
+#endif /* YYFALLBACK */
+
+/* The following structure represents a single element of the
+** parser's stack.  Information stored includes:
+**
+**   +  The state number for the parser at this level of the stack.
+**
+**   +  The value of the token stored at this level of the stack.
+**      (In other words, the "major" token.)
+**
+**   +  The semantic value stored at this level of the stack.  This is
+**      the information used by the action routines in the grammar.
+**      It is sometimes called the "minor" token.
+**
+** After the "shift" half of a SHIFTREDUCE action, the stateno field
+** actually contains the reduce action for the second half of the
+** SHIFTREDUCE.
+*/
+struct yyStackEntry {
+  YYACTIONTYPE stateno;  /* The state-number, or reduce action in SHIFTREDUCE */
+  YYCODETYPE major;      /* The major token value.  This is the code
+                         ** number for the token at this stack level */
+  YYMINORTYPE minor;     /* The user-supplied minor token value.  This
+                         ** is the value of the token  */
+};
+typedef struct yyStackEntry yyStackEntry;
+
+/* The state of the parser is completely contained in an instance of
+** the following structure */
+struct yyParser {
+  yyStackEntry *yytos;          /* Pointer to top element of the stack */
+#ifdef YYTRACKMAXSTACKDEPTH
+  int yyhwm;                    /* High-water mark of the stack */
+#endif
+#ifndef YYNOERRORRECOVERY
+  int yyerrcnt;                 /* Shifts left before out of the error */
+#endif
+  ParseHLSLARG_SDECL                /* A place to hold %extra_argument */
+  ParseHLSLCTX_SDECL                /* A place to hold %extra_context */
+#if YYSTACKDEPTH<=0
+  int yystksz;                  /* Current side of the stack */
+  yyStackEntry *yystack;        /* The parser's stack */
+  yyStackEntry yystk0;          /* First stack entry */
+#else
+  yyStackEntry yystack[YYSTACKDEPTH];  /* The parser's stack */
+  yyStackEntry *yystackEnd;            /* Last entry in the stack */
+#endif
+};
+typedef struct yyParser yyParser;
+
+#include <assert.h>
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+#include <stdio.h>
+static FILE *yyTraceFILE = 0;
+static char *yyTracePrompt = 0;
+#endif /* NDEBUG */
+
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+/*
+** Turn parser tracing on by giving a stream to which to write the trace
+** and a prompt to preface each trace message.  Tracing is turned off
+** by making either argument NULL 
+**
+** Inputs:
+** <ul>
+** <li> A FILE* to which trace output should be written.
+**      If NULL, then tracing is turned off.
+** <li> A prefix string written at the beginning of every
+**      line of trace output.  If NULL, then tracing is
+**      turned off.
+** </ul>
+**
+** Outputs:
+** None.
+*/
+#if __MOJOSHADER__
+static
+#endif
+void ParseHLSLTrace(FILE *TraceFILE, char *zTracePrompt){
+  yyTraceFILE = TraceFILE;
+  yyTracePrompt = zTracePrompt;
+  if( yyTraceFILE==0 ) yyTracePrompt = 0;
+  else if( yyTracePrompt==0 ) yyTraceFILE = 0;
+}
+#endif /* NDEBUG */
+
+#if defined(YYCOVERAGE) || LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+/* For tracing shifts, the names of all terminals and nonterminals
+** are required.  The following table supplies these names */
+static const char *const yyTokenName[] = { 
+  /*    0 */ "$",
+  /*    1 */ "COMMA",
+  /*    2 */ "ASSIGN",
+  /*    3 */ "ADDASSIGN",
+  /*    4 */ "SUBASSIGN",
+  /*    5 */ "MULASSIGN",
+  /*    6 */ "DIVASSIGN",
+  /*    7 */ "MODASSIGN",
+  /*    8 */ "LSHIFTASSIGN",
+  /*    9 */ "RSHIFTASSIGN",
+  /*   10 */ "ANDASSIGN",
+  /*   11 */ "ORASSIGN",
+  /*   12 */ "XORASSIGN",
+  /*   13 */ "QUESTION",
+  /*   14 */ "OROR",
+  /*   15 */ "ANDAND",
+  /*   16 */ "OR",
+  /*   17 */ "XOR",
+  /*   18 */ "AND",
+  /*   19 */ "EQL",
+  /*   20 */ "NEQ",
+  /*   21 */ "LT",
+  /*   22 */ "LEQ",
+  /*   23 */ "GT",
+  /*   24 */ "GEQ",
+  /*   25 */ "LSHIFT",
+  /*   26 */ "RSHIFT",
+  /*   27 */ "PLUS",
+  /*   28 */ "MINUS",
+  /*   29 */ "STAR",
+  /*   30 */ "SLASH",
+  /*   31 */ "PERCENT",
+  /*   32 */ "TYPECAST",
+  /*   33 */ "EXCLAMATION",
+  /*   34 */ "COMPLEMENT",
+  /*   35 */ "MINUSMINUS",
+  /*   36 */ "PLUSPLUS",
+  /*   37 */ "DOT",
+  /*   38 */ "LBRACKET",
+  /*   39 */ "RBRACKET",
+  /*   40 */ "LPAREN",
+  /*   41 */ "RPAREN",
+  /*   42 */ "ELSE",
+  /*   43 */ "SEMICOLON",
+  /*   44 */ "TYPEDEF",
+  /*   45 */ "CONST",
+  /*   46 */ "IDENTIFIER",
+  /*   47 */ "VOID",
+  /*   48 */ "INLINE",
+  /*   49 */ "IN",
+  /*   50 */ "INOUT",
+  /*   51 */ "OUT",
+  /*   52 */ "UNIFORM",
+  /*   53 */ "COLON",
+  /*   54 */ "LINEAR",
+  /*   55 */ "CENTROID",
+  /*   56 */ "NOINTERPOLATION",
+  /*   57 */ "NOPERSPECTIVE",
+  /*   58 */ "SAMPLE",
+  /*   59 */ "EXTERN",
+  /*   60 */ "SHARED",
+  /*   61 */ "STATIC",
+  /*   62 */ "VOLATILE",
+  /*   63 */ "ROWMAJOR",
+  /*   64 */ "COLUMNMAJOR",
+  /*   65 */ "LBRACE",
+  /*   66 */ "RBRACE",
+  /*   67 */ "STRUCT",
+  /*   68 */ "PACKOFFSET",
+  /*   69 */ "REGISTER",
+  /*   70 */ "USERTYPE",
+  /*   71 */ "SAMPLER",
+  /*   72 */ "SAMPLER1D",
+  /*   73 */ "SAMPLER2D",
+  /*   74 */ "SAMPLER3D",
+  /*   75 */ "SAMPLERCUBE",
+  /*   76 */ "SAMPLER_STATE",
+  /*   77 */ "SAMPLERSTATE",
+  /*   78 */ "SAMPLERCOMPARISONSTATE",
+  /*   79 */ "BOOL",
+  /*   80 */ "INT",
+  /*   81 */ "UINT",
+  /*   82 */ "HALF",
+  /*   83 */ "FLOAT",
+  /*   84 */ "DOUBLE",
+  /*   85 */ "STRING",
+  /*   86 */ "SNORM",
+  /*   87 */ "UNORM",
+  /*   88 */ "BUFFER",
+  /*   89 */ "VECTOR",
+  /*   90 */ "INT_CONSTANT",
+  /*   91 */ "MATRIX",
+  /*   92 */ "ISOLATE",
+  /*   93 */ "MAXINSTRUCTIONCOUNT",
+  /*   94 */ "NOEXPRESSIONOPTIMIZATIONS",
+  /*   95 */ "REMOVEUNUSEDINPUTS",
+  /*   96 */ "UNUSED",
+  /*   97 */ "XPS",
+  /*   98 */ "BREAK",
+  /*   99 */ "CONTINUE",
+  /*  100 */ "DISCARD",
+  /*  101 */ "DO",
+  /*  102 */ "WHILE",
+  /*  103 */ "RETURN",
+  /*  104 */ "UNROLL",
+  /*  105 */ "LOOP",
+  /*  106 */ "FOR",
+  /*  107 */ "BRANCH",
+  /*  108 */ "IF",
+  /*  109 */ "FLATTEN",
+  /*  110 */ "IFALL",
+  /*  111 */ "IFANY",
+  /*  112 */ "PREDICATE",
+  /*  113 */ "PREDICATEBLOCK",
+  /*  114 */ "SWITCH",
+  /*  115 */ "FORCECASE",
+  /*  116 */ "CALL",
+  /*  117 */ "CASE",
+  /*  118 */ "DEFAULT",
+  /*  119 */ "FLOAT_CONSTANT",
+  /*  120 */ "STRING_LITERAL",
+  /*  121 */ "TRUE",
+  /*  122 */ "FALSE",
+  /*  123 */ "shader",
+  /*  124 */ "compilation_units",
+  /*  125 */ "compilation_unit",
+  /*  126 */ "variable_declaration",
+  /*  127 */ "function_signature",
+  /*  128 */ "statement_block",
+  /*  129 */ "typedef",
+  /*  130 */ "struct_declaration",
+  /*  131 */ "datatype",
+  /*  132 */ "scalar_or_array",
+  /*  133 */ "function_storageclass",
+  /*  134 */ "function_details",
+  /*  135 */ "semantic",
+  /*  136 */ "function_parameters",
+  /*  137 */ "function_parameter_list",
+  /*  138 */ "function_parameter",
+  /*  139 */ "input_modifier",
+  /*  140 */ "interpolation_mod",
+  /*  141 */ "initializer",
+  /*  142 */ "variable_attribute_list",
+  /*  143 */ "variable_declaration_details_list",
+  /*  144 */ "variable_attribute",
+  /*  145 */ "variable_declaration_details",
+  /*  146 */ "annotations",
+  /*  147 */ "variable_lowlevel",
+  /*  148 */ "struct_intro",
+  /*  149 */ "struct_member_list",
+  /*  150 */ "struct_member",
+  /*  151 */ "struct_member_details",
+  /*  152 */ "struct_member_item_list",
+  /*  153 */ "packoffset",
+  /*  154 */ "register",
+  /*  155 */ "expression",
+  /*  156 */ "annotation_list",
+  /*  157 */ "annotation",
+  /*  158 */ "datatype_scalar",
+  /*  159 */ "initializer_block_list",
+  /*  160 */ "initializer_block",
+  /*  161 */ "intrinsic_datatype",
+  /*  162 */ "datatype_vector",
+  /*  163 */ "datatype_matrix",
+  /*  164 */ "datatype_sampler",
+  /*  165 */ "datatype_buffer",
+  /*  166 */ "statement_list",
+  /*  167 */ "statement",
+  /*  168 */ "statement_attribute",
+  /*  169 */ "do_intro",
+  /*  170 */ "while_intro",
+  /*  171 */ "if_intro",
+  /*  172 */ "switch_intro",
+  /*  173 */ "switch_case_list",
+  /*  174 */ "for_statement",
+  /*  175 */ "for_intro",
+  /*  176 */ "for_details",
+  /*  177 */ "switch_case",
+  /*  178 */ "primary_expr",
+  /*  179 */ "postfix_expr",
+  /*  180 */ "arguments",
+  /*  181 */ "argument_list",
+  /*  182 */ "assignment_expr",
+  /*  183 */ "unary_expr",
+  /*  184 */ "cast_expr",
+  /*  185 */ "multiplicative_expr",
+  /*  186 */ "additive_expr",
+  /*  187 */ "shift_expr",
+  /*  188 */ "relational_expr",
+  /*  189 */ "equality_expr",
+  /*  190 */ "and_expr",
+  /*  191 */ "exclusive_or_expr",
+  /*  192 */ "inclusive_or_expr",
+  /*  193 */ "logical_and_expr",
+  /*  194 */ "logical_or_expr",
+  /*  195 */ "conditional_expr",
+};
+#endif /* defined(YYCOVERAGE) || !defined(NDEBUG) */
+
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+/* For tracing reduce actions, the names of all rules are required.
+*/
+static const char *const yyRuleName[] = {
+ /*   0 */ "shader ::= compilation_units",
+ /*   1 */ "compilation_units ::= compilation_unit",
+ /*   2 */ "compilation_units ::= compilation_units compilation_unit",
+ /*   3 */ "compilation_unit ::= variable_declaration",
+ /*   4 */ "compilation_unit ::= function_signature SEMICOLON",
+ /*   5 */ "compilation_unit ::= function_signature statement_block",
+ /*   6 */ "compilation_unit ::= typedef",
+ /*   7 */ "compilation_unit ::= struct_declaration SEMICOLON",
+ /*   8 */ "typedef ::= TYPEDEF CONST datatype scalar_or_array",
+ /*   9 */ "typedef ::= TYPEDEF datatype scalar_or_array",
+ /*  10 */ "function_signature ::= function_storageclass function_details semantic",
+ /*  11 */ "function_signature ::= function_storageclass function_details",
+ /*  12 */ "function_signature ::= function_details semantic",
+ /*  13 */ "function_signature ::= function_details",
+ /*  14 */ "function_details ::= datatype IDENTIFIER LPAREN function_parameters RPAREN",
+ /*  15 */ "function_details ::= VOID IDENTIFIER LPAREN function_parameters RPAREN",
+ /*  16 */ "function_storageclass ::= INLINE",
+ /*  17 */ "function_parameters ::= VOID",
+ /*  18 */ "function_parameters ::= function_parameter_list",
+ /*  19 */ "function_parameters ::=",
+ /*  20 */ "function_parameter_list ::= function_parameter",
+ /*  21 */ "function_parameter_list ::= function_parameter_list COMMA function_parameter",
+ /*  22 */ "function_parameter ::= input_modifier datatype IDENTIFIER semantic interpolation_mod initializer",
+ /*  23 */ "function_parameter ::= input_modifier datatype IDENTIFIER semantic interpolation_mod",
+ /*  24 */ "function_parameter ::= input_modifier datatype IDENTIFIER semantic initializer",
+ /*  25 */ "function_parameter ::= input_modifier datatype IDENTIFIER semantic",
+ /*  26 */ "function_parameter ::= input_modifier datatype IDENTIFIER interpolation_mod initializer",
+ /*  27 */ "function_parameter ::= input_modifier datatype IDENTIFIER interpolation_mod",
+ /*  28 */ "function_parameter ::= input_modifier datatype IDENTIFIER initializer",
+ /*  29 */ "function_parameter ::= input_modifier datatype IDENTIFIER",
+ /*  30 */ "function_parameter ::= datatype IDENTIFIER semantic interpolation_mod initializer",
+ /*  31 */ "function_parameter ::= datatype IDENTIFIER semantic interpolation_mod",
+ /*  32 */ "function_parameter ::= datatype IDENTIFIER semantic initializer",
+ /*  33 */ "function_parameter ::= datatype IDENTIFIER semantic",
+ /*  34 */ "function_parameter ::= datatype IDENTIFIER interpolation_mod initializer",
+ /*  35 */ "function_parameter ::= datatype IDENTIFIER interpolation_mod",
+ /*  36 */ "function_parameter ::= datatype IDENTIFIER initializer",
+ /*  37 */ "function_parameter ::= datatype IDENTIFIER",
+ /*  38 */ "input_modifier ::= IN",
+ /*  39 */ "input_modifier ::= INOUT",
+ /*  40 */ "input_modifier ::= OUT",
+ /*  41 */ "input_modifier ::= IN OUT",
+ /*  42 */ "input_modifier ::= OUT IN",
+ /*  43 */ "input_modifier ::= UNIFORM",
+ /*  44 */ "semantic ::= COLON IDENTIFIER",
+ /*  45 */ "interpolation_mod ::= LINEAR",
+ /*  46 */ "interpolation_mod ::= CENTROID",
+ /*  47 */ "interpolation_mod ::= NOINTERPOLATION",
+ /*  48 */ "interpolation_mod ::= NOPERSPECTIVE",
+ /*  49 */ "interpolation_mod ::= SAMPLE",
+ /*  50 */ "variable_declaration ::= variable_attribute_list datatype variable_declaration_details_list SEMICOLON",
+ /*  51 */ "variable_declaration ::= datatype variable_declaration_details_list SEMICOLON",
+ /*  52 */ "variable_declaration ::= struct_declaration variable_declaration_details_list SEMICOLON",
+ /*  53 */ "variable_attribute_list ::= variable_attribute",
+ /*  54 */ "variable_attribute_list ::= variable_attribute_list variable_attribute",
+ /*  55 */ "variable_attribute ::= EXTERN",
+ /*  56 */ "variable_attribute ::= NOINTERPOLATION",
+ /*  57 */ "variable_attribute ::= SHARED",
+ /*  58 */ "variable_attribute ::= STATIC",
+ /*  59 */ "variable_attribute ::= UNIFORM",
+ /*  60 */ "variable_attribute ::= VOLATILE",
+ /*  61 */ "variable_attribute ::= CONST",
+ /*  62 */ "variable_attribute ::= ROWMAJOR",
+ /*  63 */ "variable_attribute ::= COLUMNMAJOR",
+ /*  64 */ "variable_declaration_details_list ::= variable_declaration_details",
+ /*  65 */ "variable_declaration_details_list ::= variable_declaration_details_list COMMA variable_declaration_details",
+ /*  66 */ "variable_declaration_details ::= scalar_or_array semantic annotations initializer variable_lowlevel",
+ /*  67 */ "variable_declaration_details ::= scalar_or_array semantic annotations initializer",
+ /*  68 */ "variable_declaration_details ::= scalar_or_array semantic annotations variable_lowlevel",
+ /*  69 */ "variable_declaration_details ::= scalar_or_array semantic annotations",
+ /*  70 */ "variable_declaration_details ::= scalar_or_array semantic initializer variable_lowlevel",
+ /*  71 */ "variable_declaration_details ::= scalar_or_array semantic initializer",
+ /*  72 */ "variable_declaration_details ::= scalar_or_array semantic variable_lowlevel",
+ /*  73 */ "variable_declaration_details ::= scalar_or_array semantic",
+ /*  74 */ "variable_declaration_details ::= scalar_or_array annotations initializer variable_lowlevel",
+ /*  75 */ "variable_declaration_details ::= scalar_or_array annotations initializer",
+ /*  76 */ "variable_declaration_details ::= scalar_or_array annotations variable_lowlevel",
+ /*  77 */ "variable_declaration_details ::= scalar_or_array annotations",
+ /*  78 */ "variable_declaration_details ::= scalar_or_array initializer variable_lowlevel",
+ /*  79 */ "variable_declaration_details ::= scalar_or_array initializer",
+ /*  80 */ "variable_declaration_details ::= scalar_or_array variable_lowlevel",
+ /*  81 */ "variable_declaration_details ::= scalar_or_array",
+ /*  82 */ "struct_declaration ::= struct_intro LBRACE struct_member_list RBRACE",
+ /*  83 */ "struct_intro ::= STRUCT IDENTIFIER",
+ /*  84 */ "struct_member_list ::= struct_member",
+ /*  85 */ "struct_member_list ::= struct_member_list struct_member",
+ /*  86 */ "struct_member ::= interpolation_mod struct_member_details",
+ /*  87 */ "struct_member ::= struct_member_details",
+ /*  88 */ "struct_member_details ::= datatype struct_member_item_list SEMICOLON",
+ /*  89 */ "struct_member_item_list ::= scalar_or_array",
+ /*  90 */ "struct_member_item_list ::= scalar_or_array semantic",
+ /*  91 */ "struct_member_item_list ::= struct_member_item_list COMMA IDENTIFIER",
+ /*  92 */ "variable_lowlevel ::= packoffset register",
+ /*  93 */ "variable_lowlevel ::= register packoffset",
+ /*  94 */ "variable_lowlevel ::= packoffset",
+ /*  95 */ "variable_lowlevel ::= register",
+ /*  96 */ "scalar_or_array ::= IDENTIFIER LBRACKET RBRACKET",
+ /*  97 */ "scalar_or_array ::= IDENTIFIER LBRACKET expression RBRACKET",
+ /*  98 */ "scalar_or_array ::= IDENTIFIER",
+ /*  99 */ "packoffset ::= COLON PACKOFFSET LPAREN IDENTIFIER DOT IDENTIFIER RPAREN",
+ /* 100 */ "packoffset ::= COLON PACKOFFSET LPAREN IDENTIFIER RPAREN",
+ /* 101 */ "register ::= COLON REGISTER LPAREN IDENTIFIER RPAREN",
+ /* 102 */ "annotations ::= LT annotation_list GT",
+ /* 103 */ "annotation_list ::= annotation",
+ /* 104 */ "annotation_list ::= annotation_list annotation",
+ /* 105 */ "annotation ::= datatype_scalar initializer SEMICOLON",
+ /* 106 */ "initializer_block_list ::= expression",
+ /* 107 */ "initializer_block_list ::= LBRACE initializer_block_list RBRACE",
+ /* 108 */ "initializer_block_list ::= initializer_block_list COMMA initializer_block_list",
+ /* 109 */ "initializer_block ::= LBRACE initializer_block_list RBRACE",
+ /* 110 */ "initializer ::= ASSIGN initializer_block",
+ /* 111 */ "initializer ::= ASSIGN expression",
+ /* 112 */ "intrinsic_datatype ::= datatype_vector",
+ /* 113 */ "intrinsic_datatype ::= datatype_matrix",
+ /* 114 */ "intrinsic_datatype ::= datatype_scalar",
+ /* 115 */ "intrinsic_datatype ::= datatype_sampler",
+ /* 116 */ "intrinsic_datatype ::= datatype_buffer",
+ /* 117 */ "datatype ::= intrinsic_datatype",
+ /* 118 */ "datatype ::= USERTYPE",
+ /* 119 */ "datatype_sampler ::= SAMPLER",
+ /* 120 */ "datatype_sampler ::= SAMPLER1D",
+ /* 121 */ "datatype_sampler ::= SAMPLER2D",
+ /* 122 */ "datatype_sampler ::= SAMPLER3D",
+ /* 123 */ "datatype_sampler ::= SAMPLERCUBE",
+ /* 124 */ "datatype_sampler ::= SAMPLER_STATE",
+ /* 125 */ "datatype_sampler ::= SAMPLERSTATE",
+ /* 126 */ "datatype_sampler ::= SAMPLERCOMPARISONSTATE",
+ /* 127 */ "datatype_scalar ::= BOOL",
+ /* 128 */ "datatype_scalar ::= INT",
+ /* 129 */ "datatype_scalar ::= UINT",
+ /* 130 */ "datatype_scalar ::= HALF",
+ /* 131 */ "datatype_scalar ::= FLOAT",
+ /* 132 */ "datatype_scalar ::= DOUBLE",
+ /* 133 */ "datatype_scalar ::= STRING",
+ /* 134 */ "datatype_scalar ::= SNORM FLOAT",
+ /* 135 */ "datatype_scalar ::= UNORM FLOAT",
+ /* 136 */ "datatype_buffer ::= BUFFER LT BOOL GT",
+ /* 137 */ "datatype_buffer ::= BUFFER LT INT GT",
+ /* 138 */ "datatype_buffer ::= BUFFER LT UINT GT",
+ /* 139 */ "datatype_buffer ::= BUFFER LT HALF GT",
+ /* 140 */ "datatype_buffer ::= BUFFER LT FLOAT GT",
+ /* 141 */ "datatype_buffer ::= BUFFER LT DOUBLE GT",
+ /* 142 */ "datatype_buffer ::= BUFFER LT SNORM FLOAT GT",
+ /* 143 */ "datatype_buffer ::= BUFFER LT UNORM FLOAT GT",
+ /* 144 */ "datatype_vector ::= VECTOR LT datatype_scalar COMMA INT_CONSTANT GT",
+ /* 145 */ "datatype_matrix ::= MATRIX LT datatype_scalar COMMA INT_CONSTANT COMMA INT_CONSTANT GT",
+ /* 146 */ "statement_block ::= LBRACE RBRACE",
+ /* 147 */ "statement_block ::= LBRACE statement_list RBRACE",
+ /* 148 */ "statement_list ::= statement",
+ /* 149 */ "statement_list ::= statement_list statement",
+ /* 150 */ "statement_attribute ::= ISOLATE",
+ /* 151 */ "statement_attribute ::= MAXINSTRUCTIONCOUNT LPAREN INT_CONSTANT RPAREN",
+ /* 152 */ "statement_attribute ::= NOEXPRESSIONOPTIMIZATIONS",
+ /* 153 */ "statement_attribute ::= REMOVEUNUSEDINPUTS",
+ /* 154 */ "statement_attribute ::= UNUSED",
+ /* 155 */ "statement_attribute ::= XPS",
+ /* 156 */ "statement ::= BREAK SEMICOLON",
+ /* 157 */ "statement ::= CONTINUE SEMICOLON",
+ /* 158 */ "statement ::= DISCARD SEMICOLON",
+ /* 159 */ "statement ::= LBRACKET statement_attribute RBRACKET statement_block",
+ /* 160 */ "statement ::= variable_declaration",
+ /* 161 */ "statement ::= struct_declaration SEMICOLON",
+ /* 162 */ "statement ::= do_intro DO statement WHILE LPAREN expression RPAREN SEMICOLON",
+ /* 163 */ "statement ::= while_intro LPAREN expression RPAREN statement",
+ /* 164 */ "statement ::= if_intro LPAREN expression RPAREN statement",
+ /* 165 */ "statement ::= if_intro LPAREN expression RPAREN statement ELSE statement",
+ /* 166 */ "statement ::= switch_intro LPAREN expression RPAREN LBRACE switch_case_list RBRACE",
+ /* 167 */ "statement ::= typedef",
+ /* 168 */ "statement ::= SEMICOLON",
+ /* 169 */ "statement ::= expression SEMICOLON",
+ /* 170 */ "statement ::= RETURN SEMICOLON",
+ /* 171 */ "statement ::= RETURN expression SEMICOLON",
+ /* 172 */ "statement ::= statement_block",
+ /* 173 */ "statement ::= for_statement",
+ /* 174 */ "while_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET WHILE",
+ /* 175 */ "while_intro ::= LBRACKET UNROLL RBRACKET WHILE",
+ /* 176 */ "while_intro ::= LBRACKET LOOP RBRACKET WHILE",
+ /* 177 */ "while_intro ::= WHILE",
+ /* 178 */ "for_statement ::= for_intro for_details",
+ /* 179 */ "for_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET FOR",
+ /* 180 */ "for_intro ::= LBRACKET UNROLL RBRACKET FOR",
+ /* 181 */ "for_intro ::= LBRACKET LOOP RBRACKET FOR",
+ /* 182 */ "for_intro ::= FOR",
+ /* 183 */ "for_details ::= LPAREN expression SEMICOLON expression SEMICOLON expression RPAREN statement",
+ /* 184 */ "for_details ::= LPAREN SEMICOLON SEMICOLON RPAREN statement",
+ /* 185 */ "for_details ::= LPAREN SEMICOLON SEMICOLON expression RPAREN statement",
+ /* 186 */ "for_details ::= LPAREN SEMICOLON expression SEMICOLON RPAREN statement",
+ /* 187 */ "for_details ::= LPAREN SEMICOLON expression SEMICOLON expression RPAREN statement",
+ /* 188 */ "for_details ::= LPAREN expression SEMICOLON SEMICOLON RPAREN statement",
+ /* 189 */ "for_details ::= LPAREN expression SEMICOLON SEMICOLON expression RPAREN statement",
+ /* 190 */ "for_details ::= LPAREN expression SEMICOLON expression SEMICOLON RPAREN statement",
+ /* 191 */ "for_details ::= LPAREN variable_declaration expression SEMICOLON expression RPAREN statement",
+ /* 192 */ "for_details ::= LPAREN variable_declaration SEMICOLON RPAREN statement",
+ /* 193 */ "for_details ::= LPAREN variable_declaration SEMICOLON expression RPAREN statement",
+ /* 194 */ "for_details ::= LPAREN variable_declaration expression SEMICOLON RPAREN statement",
+ /* 195 */ "do_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET DO",
+ /* 196 */ "do_intro ::= LBRACKET UNROLL RBRACKET DO",
+ /* 197 */ "do_intro ::= LBRACKET LOOP RBRACKET DO",
+ /* 198 */ "do_intro ::= DO",
+ /* 199 */ "if_intro ::= LBRACKET BRANCH RBRACKET IF",
+ /* 200 */ "if_intro ::= LBRACKET FLATTEN RBRACKET IF",
+ /* 201 */ "if_intro ::= LBRACKET IFALL RBRACKET IF",
+ /* 202 */ "if_intro ::= LBRACKET IFANY RBRACKET IF",
+ /* 203 */ "if_intro ::= LBRACKET PREDICATE RBRACKET IF",
+ /* 204 */ "if_intro ::= LBRACKET PREDICATEBLOCK RBRACKET IF",
+ /* 205 */ "if_intro ::= IF",
+ /* 206 */ "switch_intro ::= LBRACKET FLATTEN RBRACKET SWITCH",
+ /* 207 */ "switch_intro ::= LBRACKET BRANCH RBRACKET SWITCH",
+ /* 208 */ "switch_intro ::= LBRACKET FORCECASE RBRACKET SWITCH",
+ /* 209 */ "switch_intro ::= LBRACKET CALL RBRACKET SWITCH",
+ /* 210 */ "switch_intro ::= SWITCH",
+ /* 211 */ "switch_case_list ::= switch_case",
+ /* 212 */ "switch_case_list ::= switch_case_list switch_case",
+ /* 213 */ "switch_case ::= CASE expression COLON statement_list",
+ /* 214 */ "switch_case ::= CASE expression COLON",
+ /* 215 */ "switch_case ::= DEFAULT COLON statement_list",
+ /* 216 */ "switch_case ::= DEFAULT COLON",
+ /* 217 */ "primary_expr ::= IDENTIFIER",
+ /* 218 */ "primary_expr ::= INT_CONSTANT",
+ /* 219 */ "primary_expr ::= FLOAT_CONSTANT",
+ /* 220 */ "primary_expr ::= STRING_LITERAL",
+ /* 221 */ "primary_expr ::= TRUE",
+ /* 222 */ "primary_expr ::= FALSE",
+ /* 223 */ "primary_expr ::= LPAREN expression RPAREN",
+ /* 224 */ "postfix_expr ::= primary_expr",
+ /* 225 */ "postfix_expr ::= postfix_expr LBRACKET expression RBRACKET",
+ /* 226 */ "postfix_expr ::= IDENTIFIER arguments",
+ /* 227 */ "postfix_expr ::= datatype arguments",
+ /* 228 */ "postfix_expr ::= postfix_expr DOT IDENTIFIER",
+ /* 229 */ "postfix_expr ::= postfix_expr PLUSPLUS",
+ /* 230 */ "postfix_expr ::= postfix_expr MINUSMINUS",
+ /* 231 */ "arguments ::= LPAREN RPAREN",
+ /* 232 */ "arguments ::= LPAREN argument_list RPAREN",
+ /* 233 */ "argument_list ::= assignment_expr",
+ /* 234 */ "argument_list ::= argument_list COMMA assignment_expr",
+ /* 235 */ "unary_expr ::= postfix_expr",
+ /* 236 */ "unary_expr ::= PLUSPLUS unary_expr",
+ /* 237 */ "unary_expr ::= MINUSMINUS unary_expr",
+ /* 238 */ "unary_expr ::= PLUS cast_expr",
+ /* 239 */ "unary_expr ::= MINUS cast_expr",
+ /* 240 */ "unary_expr ::= COMPLEMENT cast_expr",
+ /* 241 */ "unary_expr ::= EXCLAMATION cast_expr",
+ /* 242 */ "cast_expr ::= unary_expr",
+ /* 243 */ "cast_expr ::= LPAREN datatype RPAREN cast_expr",
+ /* 244 */ "multiplicative_expr ::= cast_expr",
+ /* 245 */ "multiplicative_expr ::= multiplicative_expr STAR cast_expr",
+ /* 246 */ "multiplicative_expr ::= multiplicative_expr SLASH cast_expr",
+ /* 247 */ "multiplicative_expr ::= multiplicative_expr PERCENT cast_expr",
+ /* 248 */ "additive_expr ::= multiplicative_expr",
+ /* 249 */ "additive_expr ::= additive_expr PLUS multiplicative_expr",
+ /* 250 */ "additive_expr ::= additive_expr MINUS multiplicative_expr",
+ /* 251 */ "shift_expr ::= additive_expr",
+ /* 252 */ "shift_expr ::= shift_expr LSHIFT additive_expr",
+ /* 253 */ "shift_expr ::= shift_expr RSHIFT additive_expr",
+ /* 254 */ "relational_expr ::= shift_expr",
+ /* 255 */ "relational_expr ::= relational_expr LT shift_expr",
+ /* 256 */ "relational_expr ::= relational_expr GT shift_expr",
+ /* 257 */ "relational_expr ::= relational_expr LEQ shift_expr",
+ /* 258 */ "relational_expr ::= relational_expr GEQ shift_expr",
+ /* 259 */ "equality_expr ::= relational_expr",
+ /* 260 */ "equality_expr ::= equality_expr EQL relational_expr",
+ /* 261 */ "equality_expr ::= equality_expr NEQ relational_expr",
+ /* 262 */ "and_expr ::= equality_expr",
+ /* 263 */ "and_expr ::= and_expr AND equality_expr",
+ /* 264 */ "exclusive_or_expr ::= and_expr",
+ /* 265 */ "exclusive_or_expr ::= exclusive_or_expr XOR and_expr",
+ /* 266 */ "inclusive_or_expr ::= exclusive_or_expr",
+ /* 267 */ "inclusive_or_expr ::= inclusive_or_expr OR exclusive_or_expr",
+ /* 268 */ "logical_and_expr ::= inclusive_or_expr",
+ /* 269 */ "logical_and_expr ::= logical_and_expr ANDAND inclusive_or_expr",
+ /* 270 */ "logical_or_expr ::= logical_and_expr",
+ /* 271 */ "logical_or_expr ::= logical_or_expr OROR logical_and_expr",
+ /* 272 */ "conditional_expr ::= logical_or_expr",
+ /* 273 */ "conditional_expr ::= logical_or_expr QUESTION logical_or_expr COLON conditional_expr",
+ /* 274 */ "assignment_expr ::= conditional_expr",
+ /* 275 */ "assignment_expr ::= unary_expr ASSIGN assignment_expr",
+ /* 276 */ "assignment_expr ::= unary_expr MULASSIGN assignment_expr",
+ /* 277 */ "assignment_expr ::= unary_expr DIVASSIGN assignment_expr",
+ /* 278 */ "assignment_expr ::= unary_expr MODASSIGN assignment_expr",
+ /* 279 */ "assignment_expr ::= unary_expr ADDASSIGN assignment_expr",
+ /* 280 */ "assignment_expr ::= unary_expr SUBASSIGN assignment_expr",
+ /* 281 */ "assignment_expr ::= unary_expr LSHIFTASSIGN assignment_expr",
+ /* 282 */ "assignment_expr ::= unary_expr RSHIFTASSIGN assignment_expr",
+ /* 283 */ "assignment_expr ::= unary_expr ANDASSIGN assignment_expr",
+ /* 284 */ "assignment_expr ::= unary_expr XORASSIGN assignment_expr",
+ /* 285 */ "assignment_expr ::= unary_expr ORASSIGN assignment_expr",
+ /* 286 */ "expression ::= assignment_expr",
+ /* 287 */ "expression ::= expression COMMA assignment_expr",
+};
+#endif /* NDEBUG */
+
+
+#if YYSTACKDEPTH<=0
+/*
+** Try to increase the size of the parser stack.  Return the number
+** of errors.  Return 0 on success.
+*/
+static int yyGrowStack(yyParser *p){
+  int newSize;
+  int idx;
+  yyStackEntry *pNew;
+
+  newSize = p->yystksz*2 + 100;
+  idx = p->yytos ? (int)(p->yytos - p->yystack) : 0;
+  if( p->yystack==&p->yystk0 ){
+    pNew = malloc(newSize*sizeof(pNew[0]));
+    if( pNew ) pNew[0] = p->yystk0;
+  }else{
+    pNew = realloc(p->yystack, newSize*sizeof(pNew[0]));
+  }
+  if( pNew ){
+    p->yystack = pNew;
+    p->yytos = &p->yystack[idx];
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+    if( yyTraceFILE ){
+      fprintf(yyTraceFILE,"%sStack grows from %d to %d entries.\n",
+              yyTracePrompt, p->yystksz, newSize);
+    }
+#endif
+    p->yystksz = newSize;
+  }
+  return pNew==0; 
+}
+#endif
+
+/* Datatype of the argument to the memory allocated passed as the
+** second argument to ParseHLSLAlloc() below.  This can be changed by
+** putting an appropriate #define in the %include section of the input
+** grammar.
+*/
+#ifndef YYMALLOCARGTYPE
+# define YYMALLOCARGTYPE size_t
+#endif
+
+/* Initialize a new parser that has already been allocated.
+*/
+void ParseHLSLInit(void *yypRawParser ParseHLSLCTX_PDECL){
+  yyParser *yypParser = (yyParser*)yypRawParser;
+  ParseHLSLCTX_STORE
+#ifdef YYTRACKMAXSTACKDEPTH
+  yypParser->yyhwm = 0;
+#endif
+#if YYSTACKDEPTH<=0
+  yypParser->yytos = NULL;
+  yypParser->yystack = NULL;
+  yypParser->yystksz = 0;
+  if( yyGrowStack(yypParser) ){
+    yypParser->yystack = &yypParser->yystk0;
+    yypParser->yystksz = 1;
+  }
+#endif
+#ifndef YYNOERRORRECOVERY
+  yypParser->yyerrcnt = -1;
+#endif
+  yypParser->yytos = yypParser->yystack;
+  yypParser->yystack[0].stateno = 0;
+  yypParser->yystack[0].major = 0;
+#if YYSTACKDEPTH>0
+  yypParser->yystackEnd = &yypParser->yystack[YYSTACKDEPTH-1];
+#endif
+}
+
+#ifndef ParseHLSL_ENGINEALWAYSONSTACK
+/* 
+** This function allocates a new parser.
+** The only argument is a pointer to a function which works like
+** malloc.
+**
+** Inputs:
+** A pointer to the function used to allocate memory.
+**
+** Outputs:
+** A pointer to a parser.  This pointer is used in subsequent calls
+** to ParseHLSL and ParseHLSLFree.
+*/
+#if __MOJOSHADER__
+static void *ParseHLSLAlloc(void *(*mallocProc)(int,void *), void *malloc_data ParseHLSLCTX_PDECL){
+  yyParser *yypParser;
+  yypParser = (yyParser*)(*mallocProc)( (YYMALLOCARGTYPE)sizeof(yyParser), malloc_data );
+  if( yypParser ){
+    ParseHLSLCTX_STORE
+    ParseHLSLInit(yypParser ParseHLSLCTX_PARAM);
+  }
+  return (void*)yypParser;
+}
+#else
+void *ParseHLSLAlloc(void *(*mallocProc)(YYMALLOCARGTYPE) ParseHLSLCTX_PDECL){
+  yyParser *yypParser;
+  yypParser = (yyParser*)(*mallocProc)( (YYMALLOCARGTYPE)sizeof(yyParser) );
+  if( yypParser ){
+    ParseHLSLCTX_STORE
+    ParseHLSLInit(yypParser ParseHLSLCTX_PARAM);
+  }
+  return (void*)yypParser;
+}
+#endif
+#endif /* ParseHLSL_ENGINEALWAYSONSTACK */
+
+
+/* The following function deletes the "minor type" or semantic value
+** associated with a symbol.  The symbol can be either a terminal
+** or nonterminal. "yymajor" is the symbol code, and "yypminor" is
+** a pointer to the value to be deleted.  The code used to do the 
+** deletions is derived from the %destructor and/or %token_destructor
+** directives of the input grammar.
+*/
+static void yy_destructor(
+  yyParser *yypParser,    /* The parser */
+  YYCODETYPE yymajor,     /* Type code for object to destroy */
+  YYMINORTYPE *yypminor   /* The object to be destroyed */
+){
+  ParseHLSLARG_FETCH
+  ParseHLSLCTX_FETCH
+  switch( yymajor ){
+    /* Here is inserted the actions which take place when a
+    ** terminal or non-terminal is destroyed.  This can happen
+    ** when the symbol is popped from the stack during a
+    ** reduce or during error processing or when a parser is 
+    ** being destroyed before it is finished parsing.
+    **
+    ** Note: during a reduce, the only symbols destroyed are those
+    ** which appear on the RHS of the rule, but which are *not* used
+    ** inside the C code.
+    */
+/********* Begin destructor definitions ***************************************/
+      /* Default NON-TERMINAL Destructor */
+    case 123: /* shader */
+    case 124: /* compilation_units */
+    case 125: /* compilation_unit */
+    case 126: /* variable_declaration */
+    case 127: /* function_signature */
+    case 128: /* statement_block */
+    case 129: /* typedef */
+    case 130: /* struct_declaration */
+    case 131: /* datatype */
+    case 132: /* scalar_or_array */
+    case 133: /* function_storageclass */
+    case 134: /* function_details */
+    case 135: /* semantic */
+    case 136: /* function_parameters */
+    case 137: /* function_parameter_list */
+    case 138: /* function_parameter */
+    case 139: /* input_modifier */
+    case 140: /* interpolation_mod */
+    case 141: /* initializer */
+    case 142: /* variable_attribute_list */
+    case 143: /* variable_declaration_details_list */
+    case 144: /* variable_attribute */
+    case 145: /* variable_declaration_details */
+    case 146: /* annotations */
+    case 147: /* variable_lowlevel */
+    case 148: /* struct_intro */
+    case 149: /* struct_member_list */
+    case 150: /* struct_member */
+    case 151: /* struct_member_details */
+    case 152: /* struct_member_item_list */
+    case 153: /* packoffset */
+    case 154: /* register */
+    case 155: /* expression */
+    case 156: /* annotation_list */
+    case 157: /* annotation */
+    case 158: /* datatype_scalar */
+    case 159: /* initializer_block_list */
+    case 160: /* initializer_block */
+    case 161: /* intrinsic_datatype */
+    case 162: /* datatype_vector */
+    case 163: /* datatype_matrix */
+    case 164: /* datatype_sampler */
+    case 165: /* datatype_buffer */
+    case 166: /* statement_list */
+    case 167: /* statement */
+    case 168: /* statement_attribute */
+    case 169: /* do_intro */
+    case 170: /* while_intro */
+    case 171: /* if_intro */
+    case 172: /* switch_intro */
+    case 173: /* switch_case_list */
+    case 174: /* for_statement */
+    case 175: /* for_intro */
+    case 176: /* for_details */
+    case 177: /* switch_case */
+    case 178: /* primary_expr */
+    case 179: /* postfix_expr */
+    case 180: /* arguments */
+    case 181: /* argument_list */
+    case 182: /* assignment_expr */
+    case 183: /* unary_expr */
+    case 184: /* cast_expr */
+    case 185: /* multiplicative_expr */
+    case 186: /* additive_expr */
+    case 187: /* shift_expr */
+    case 188: /* relational_expr */
+    case 189: /* equality_expr */
+    case 190: /* and_expr */
+    case 191: /* exclusive_or_expr */
+    case 192: /* inclusive_or_expr */
+    case 193: /* logical_and_expr */
+    case 194: /* logical_or_expr */
+    case 195: /* conditional_expr */
+{
+#line 34 "/root/repo/mojoshader_parser_hlsl.lemon"
+ (void) ctx; 
+#line 2451 "/root/repo/mojoshader_parser_hlsl.h"
+}
+      break;
+/********* End destructor definitions *****************************************/
+    default:  break;   /* If no destructor action specified: do nothing */
+  }
+}
+
+/*
+** Pop the parser's stack once.
+**
+** If there is a destructor routine associated with the token which
+** is popped from the stack, then call it.
+*/
+static void yy_pop_parser_stack(yyParser *pParser){
+  yyStackEntry *yytos;
+  assert( pParser->yytos!=0 );
+  assert( pParser->yytos > pParser->yystack );
+  yytos = pParser->yytos--;
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sPopping %s\n",
+      yyTracePrompt,
+      yyTokenName[yytos->major]);
+  }
+#endif
+  yy_destructor(pParser, yytos->major, &yytos->minor);
+}
+
+/*
+** Clear all secondary memory allocations from the parser
+*/
+void ParseHLSLFinalize(void *p){
+  yyParser *pParser = (yyParser*)p;
+  while( pParser->yytos>pParser->yystack ) yy_pop_parser_stack(pParser);
+#if YYSTACKDEPTH<=0
+  if( pParser->yystack!=&pParser->yystk0 ) free(pParser->yystack);
+#endif
+}
+
+#ifndef ParseHLSL_ENGINEALWAYSONSTACK
+/* 
+** Deallocate and destroy a parser.  Destructors are called for
+** all stack elements before shutting the parser down.
+**
+** If the YYPARSEFREENEVERNULL macro exists (for example because it
+** is defined in a %include section of the input grammar) then it is
+** assumed that the input pointer is never NULL.
+*/
+#if __MOJOSHADER__
+static void ParseHLSLFree(
+  void *p,                    /* The parser to be deleted */
+  void (*freeProc)(void*,void*),     /* Function used to reclaim memory */
+  void *malloc_data
+){
+#ifndef YYPARSEFREENEVERNULL
+  if( p==0 ) return;
+#endif
+  ParseHLSLFinalize(p);
+  (*freeProc)(p,malloc_data);
+}
+#else
+void ParseHLSLFree(
+  void *p,                    /* The parser to be deleted */
+  void (*freeProc)(void*)     /* Function used to reclaim memory */
+){
+#ifndef YYPARSEFREENEVERNULL
+  if( p==0 ) return;
+#endif
+  ParseHLSLFinalize(p);
+  (*freeProc)(p);
+}
+#endif
+#endif /* ParseHLSL_ENGINEALWAYSONSTACK */
+
+/*
+** Return the peak depth of the stack for a parser.
+*/
+#ifdef YYTRACKMAXSTACKDEPTH
+int ParseHLSLStackPeak(void *p){
+  yyParser *pParser = (yyParser*)p;
+  return pParser->yyhwm;
+}
+#endif
+
+/* This array of booleans keeps track of the parser statement
+** coverage.  The element yycoverage[X][Y] is set when the parser
+** is in state X and has a lookahead token Y.  In a well-tested
+** systems, every element of this matrix should end up being set.
+*/
+#if defined(YYCOVERAGE)
+static unsigned char yycoverage[YYNSTATE][YYNTOKEN];
+#endif
+
+/*
+** Write into out a description of every state/lookahead combination that
+**
+**   (1)  has not been used by the parser, and
+**   (2)  is not a syntax error.
+**
+** Return the number of missed state/lookahead combinations.
+*/
+#if defined(YYCOVERAGE)
+int ParseHLSLCoverage(FILE *out){
+  int stateno, iLookAhead, i;
+  int nMissed = 0;
+  for(stateno=0; stateno<YYNSTATE; stateno++){
+    i = yy_shift_ofst[stateno];
+    for(iLookAhead=0; iLookAhead<YYNTOKEN; iLookAhead++){
+      if( yy_lookahead[i+iLookAhead]!=iLookAhead ) continue;
+      if( yycoverage[stateno][iLookAhead]==0 ) nMissed++;
+      if( out ){
+        fprintf(out,"State %d lookahead %s %s\n", stateno,
+                yyTokenName[iLookAhead],
+                yycoverage[stateno][iLookAhead] ? "ok" : "missed");
+      }
+    }
+  }
+  return nMissed;
+}
+#endif
+
+/*
+** Find the appropriate action for a parser given the terminal
+** look-ahead token iLookAhead.
+*/
+static YYACTIONTYPE yy_find_shift_action(
+  YYCODETYPE iLookAhead,    /* The look-ahead token */
+  YYACTIONTYPE stateno      /* Current state number */
+){
+  int i;
+
+  if( stateno>YY_MAX_SHIFT ) return stateno;
+  assert( stateno <= YY_SHIFT_COUNT );
+#if defined(YYCOVERAGE)
+  yycoverage[stateno][iLookAhead] = 1;
+#endif
+  do{
+    i = yy_shift_ofst[stateno];
+    assert( i>=0 );
+    assert( i<=YY_ACTTAB_COUNT );
+    assert( i+YYNTOKEN<=(int)YY_NLOOKAHEAD );
+    assert( iLookAhead!=YYNOCODE );
+    assert( iLookAhead < YYNTOKEN );
+    i += iLookAhead;
+    assert( i<(int)YY_NLOOKAHEAD );
+    if( yy_lookahead[i]!=iLookAhead ){
+#ifdef YYFALLBACK
+      YYCODETYPE iFallback;            /* Fallback token */
+      assert( iLookAhead<sizeof(yyFallback)/sizeof(yyFallback[0]) );
+      iFallback = yyFallback[iLookAhead];
+      if( iFallback!=0 ){
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+        if( yyTraceFILE ){
+          fprintf(yyTraceFILE, "%sFALLBACK %s => %s\n",
+             yyTracePrompt, yyTokenName[iLookAhead], yyTokenName[iFallback]);
+        }
+#endif
+        assert( yyFallback[iFallback]==0 ); /* Fallback loop must terminate */
+        iLookAhead = iFallback;
+        continue;
+      }
+#endif
+#ifdef YYWILDCARD
+      {
+        int j = i - iLookAhead + YYWILDCARD;
+        assert( j<(int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])) );
+        if( yy_lookahead[j]==YYWILDCARD && iLookAhead>0 ){
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+          if( yyTraceFILE ){
+            fprintf(yyTraceFILE, "%sWILDCARD %s => %s\n",
+               yyTracePrompt, yyTokenName[iLookAhead],
+               yyTokenName[YYWILDCARD]);
+          }
+#endif /* NDEBUG */
+          return yy_action[j];
+        }
+      }
+#endif /* YYWILDCARD */
+      return yy_default[stateno];
+    }else{
+      assert( i>=0 && i<(int)(sizeof(yy_action)/sizeof(yy_action[0])) );
+      return yy_action[i];
+    }
+  }while(1);
+}
+
+/*
+** Find the appropriate action for a parser given the non-terminal
+** look-ahead token iLookAhead.
+*/
+static YYACTIONTYPE yy_find_reduce_action(
+  YYACTIONTYPE stateno,     /* Current state number */
+  YYCODETYPE iLookAhead     /* The look-ahead token */
+){
+  int i;
+#ifdef YYERRORSYMBOL
+  if( stateno>YY_REDUCE_COUNT ){
+    return yy_default[stateno];
+  }
+#else
+  assert( stateno<=YY_REDUCE_COUNT );
+#endif
+  i = yy_reduce_ofst[stateno];
+  assert( iLookAhead!=YYNOCODE );
+  i += iLookAhead;
+#ifdef YYERRORSYMBOL
+  if( i<0 || i>=YY_ACTTAB_COUNT || yy_lookahead[i]!=iLookAhead ){
+    return yy_default[stateno];
+  }
+#else
+  assert( i>=0 && i<YY_ACTTAB_COUNT );
+  assert( yy_lookahead[i]==iLookAhead );
+#endif
+  return yy_action[i];
+}
+
+/*
+** The following routine is called if the stack overflows.
+*/
+static void yyStackOverflow(yyParser *yypParser){
+   ParseHLSLARG_FETCH
+   ParseHLSLCTX_FETCH
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+   if( yyTraceFILE ){
+     fprintf(yyTraceFILE,"%sStack Overflow!\n",yyTracePrompt);
+   }
+#endif
+   while( yypParser->yytos>yypParser->yystack ) yy_pop_parser_stack(yypParser);
+   /* Here code is inserted which will execute if the parser
+   ** stack every overflows */
+/******** Begin %stack_overflow code ******************************************/
+#line 52 "/root/repo/mojoshader_parser_hlsl.lemon"
+
+    // !!! FIXME: make this a proper fail() function.
+    fail(ctx, "Giving up. Parser stack overflow");
+#line 2687 "/root/repo/mojoshader_parser_hlsl.h"
+/******** End %stack_overflow code ********************************************/
+   ParseHLSLARG_STORE /* Suppress warning about unused %extra_argument var */
+   ParseHLSLCTX_STORE
+}
+
+/*
+** Print tracing information for a SHIFT action
+*/
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+static void yyTraceShift(yyParser *yypParser, int yyNewState, const char *zTag){
+  if( yyTraceFILE ){
+    if( yyNewState<YYNSTATE ){
+      fprintf(yyTraceFILE,"%s%s '%s', go to state %d\n",
+         yyTracePrompt, zTag, yyTokenName[yypParser->yytos->major],
+         yyNewState);
+    }else{
+      fprintf(yyTraceFILE,"%s%s '%s', pending reduce %d\n",
+         yyTracePrompt, zTag, yyTokenName[yypParser->yytos->major],
+         yyNewState - YY_MIN_REDUCE);
+    }
+  }
+}
+#else
+# define yyTraceShift(X,Y,Z)
+#endif
+
+/*
+** Perform a shift action.
+*/
+static void yy_shift(
+  yyParser *yypParser,          /* The parser to be shifted */
+  YYACTIONTYPE yyNewState,      /* The new state to shift in */
+  YYCODETYPE yyMajor,           /* The major token to shift in */
+  ParseHLSLTOKENTYPE yyMinor        /* The minor token to shift in */
+){
+  yyStackEntry *yytos;
+  yypParser->yytos++;
+#ifdef YYTRACKMAXSTACKDEPTH
+  if( (int)(yypParser->yytos - yypParser->yystack)>yypParser->yyhwm ){
+    yypParser->yyhwm++;
+    assert( yypParser->yyhwm == (int)(yypParser->yytos - yypParser->yystack) );
+  }
+#endif
+#if YYSTACKDEPTH>0 
+  if( yypParser->yytos>yypParser->yystackEnd ){
+    yypParser->yytos--;
+    yyStackOverflow(yypParser);
+    return;
+  }
+#else
+  if( yypParser->yytos>=&yypParser->yystack[yypParser->yystksz] ){
+    if( yyGrowStack(yypParser) ){
+      yypParser->yytos--;
+      yyStackOverflow(yypParser);
+      return;
+    }
+  }
+#endif
+  if( yyNewState > YY_MAX_SHIFT ){
+    yyNewState += YY_MIN_REDUCE - YY_MIN_SHIFTREDUCE;
+  }
+  yytos = yypParser->yytos;
+  yytos->stateno = yyNewState;
+  yytos->major = yyMajor;
+  yytos->minor.yy0 = yyMinor;
+  yyTraceShift(yypParser, yyNewState, "Shift");
+}
+
+/* For rule J, yyRuleInfoLhs[J] contains the symbol on the left-hand side
+** of that rule */
+static const YYCODETYPE yyRuleInfoLhs[] = {
+   123,  /* (0) shader ::= compilation_units */
+   124,  /* (1) compilation_units ::= compilation_unit */
+   124,  /* (2) compilation_units ::= compilation_units compilation_unit */
+   125,  /* (3) compilation_unit ::= variable_declaration */
+   125,  /* (4) compilation_unit ::= function_signature SEMICOLON */
+   125,  /* (5) compilation_unit ::= function_signature statement_block */
+   125,  /* (6) compilation_unit ::= typedef */
+   125,  /* (7) compilation_unit ::= struct_declaration SEMICOLON */
+   129,  /* (8) typedef ::= TYPEDEF CONST datatype scalar_or_array */
+   129,  /* (9) typedef ::= TYPEDEF datatype scalar_or_array */
+   127,  /* (10) function_signature ::= function_storageclass function_details semantic */
+   127,  /* (11) function_signature ::= function_storageclass function_details */
+   127,  /* (12) function_signature ::= function_details semantic */
+   127,  /* (13) function_signature ::= function_details */
+   134,  /* (14) function_details ::= datatype IDENTIFIER LPAREN function_parameters RPAREN */
+   134,  /* (15) function_details ::= VOID IDENTIFIER LPAREN function_parameters RPAREN */
+   133,  /* (16) function_storageclass ::= INLINE */
+   136,  /* (17) function_parameters ::= VOID */
+   136,  /* (18) function_parameters ::= function_parameter_list */
+   136,  /* (19) function_parameters ::= */
+   137,  /* (20) function_parameter_list ::= function_parameter */
+   137,  /* (21) function_parameter_list ::= function_parameter_list COMMA function_parameter */
+   138,  /* (22) function_parameter ::= input_modifier datatype IDENTIFIER semantic interpolation_mod initializer */
+   138,  /* (23) function_parameter ::= input_modifier datatype IDENTIFIER semantic interpolation_mod */
+   138,  /* (24) function_parameter ::= input_modifier datatype IDENTIFIER semantic initializer */
+   138,  /* (25) function_parameter ::= input_modifier datatype IDENTIFIER semantic */
+   138,  /* (26) function_parameter ::= input_modifier datatype IDENTIFIER interpolation_mod initializer */
+   138,  /* (27) function_parameter ::= input_modifier datatype IDENTIFIER interpolation_mod */
+   138,  /* (28) function_parameter ::= input_modifier datatype IDENTIFIER initializer */
+   138,  /* (29) function_parameter ::= input_modifier datatype IDENTIFIER */
+   138,  /* (30) function_parameter ::= datatype IDENTIFIER semantic interpolation_mod initializer */
+   138,  /* (31) function_parameter ::= datatype IDENTIFIER semantic interpolation_mod */
+   138,  /* (32) function_parameter ::= datatype IDENTIFIER semantic initializer */
+   138,  /* (33) function_parameter ::= datatype IDENTIFIER semantic */
+   138,  /* (34) function_parameter ::= datatype IDENTIFIER interpolation_mod initializer */
+   138,  /* (35) function_parameter ::= datatype IDENTIFIER interpolation_mod */
+   138,  /* (36) function_parameter ::= datatype IDENTIFIER initializer */
+   138,  /* (37) function_parameter ::= datatype IDENTIFIER */
+   139,  /* (38) input_modifier ::= IN */
+   139,  /* (39) input_modifier ::= INOUT */
+   139,  /* (40) input_modifier ::= OUT */
+   139,  /* (41) input_modifier ::= IN OUT */
+   139,  /* (42) input_modifier ::= OUT IN */
+   139,  /* (43) input_modifier ::= UNIFORM */
+   135,  /* (44) semantic ::= COLON IDENTIFIER */
+   140,  /* (45) interpolation_mod ::= LINEAR */
+   140,  /* (46) interpolation_mod ::= CENTROID */
+   140,  /* (47) interpolation_mod ::= NOINTERPOLATION */
+   140,  /* (48) interpolation_mod ::= NOPERSPECTIVE */
+   140,  /* (49) interpolation_mod ::= SAMPLE */
+   126,  /* (50) variable_declaration ::= variable_attribute_list datatype variable_declaration_details_list SEMICOLON */
+   126,  /* (51) variable_declaration ::= datatype variable_declaration_details_list SEMICOLON */
+   126,  /* (52) variable_declaration ::= struct_declaration variable_declaration_details_list SEMICOLON */
+   142,  /* (53) variable_attribute_list ::= variable_attribute */
+   142,  /* (54) variable_attribute_list ::= variable_attribute_list variable_attribute */
+   144,  /* (55) variable_attribute ::= EXTERN */
+   144,  /* (56) variable_attribute ::= NOINTERPOLATION */
+   144,  /* (57) variable_attribute ::= SHARED */
+   144,  /* (58) variable_attribute ::= STATIC */
+   144,  /* (59) variable_attribute ::= UNIFORM */
+   144,  /* (60) variable_attribute ::= VOLATILE */
+   144,  /* (61) variable_attribute ::= CONST */
+   144,  /* (62) variable_attribute ::= ROWMAJOR */
+   144,  /* (63) variable_attribute ::= COLUMNMAJOR */
+   143,  /* (64) variable_declaration_details_list ::= variable_declaration_details */
+   143,  /* (65) variable_declaration_details_list ::= variable_declaration_details_list COMMA variable_declaration_details */
+   145,  /* (66) variable_declaration_details ::= scalar_or_array semantic annotations initializer variable_lowlevel */
+   145,  /* (67) variable_declaration_details ::= scalar_or_array semantic annotations initializer */
+   145,  /* (68) variable_declaration_details ::= scalar_or_array semantic annotations variable_lowlevel */
+   145,  /* (69) variable_declaration_details ::= scalar_or_array semantic annotations */
+   145,  /* (70) variable_declaration_details ::= scalar_or_array semantic initializer variable_lowlevel */
+   145,  /* (71) variable_declaration_details ::= scalar_or_array semantic initializer */
+   145,  /* (72) variable_declaration_details ::= scalar_or_array semantic variable_lowlevel */
+   145,  /* (73) variable_declaration_details ::= scalar_or_array semantic */
+   145,  /* (74) variable_declaration_details ::= scalar_or_array annotations initializer variable_lowlevel */
+   145,  /* (75) variable_declaration_details ::= scalar_or_array annotations initializer */
+   145,  /* (76) variable_declaration_details ::= scalar_or_array annotations variable_lowlevel */
+   145,  /* (77) variable_declaration_details ::= scalar_or_array annotations */
+   145,  /* (78) variable_declaration_details ::= scalar_or_array initializer variable_lowlevel */
+   145,  /* (79) variable_declaration_details ::= scalar_or_array initializer */
+   145,  /* (80) variable_declaration_details ::= scalar_or_array variable_lowlevel */
+   145,  /* (81) variable_declaration_details ::= scalar_or_array */
+   130,  /* (82) struct_declaration ::= struct_intro LBRACE struct_member_list RBRACE */
+   148,  /* (83) struct_intro ::= STRUCT IDENTIFIER */
+   149,  /* (84) struct_member_list ::= struct_member */
+   149,  /* (85) struct_member_list ::= struct_member_list struct_member */
+   150,  /* (86) struct_member ::= interpolation_mod struct_member_details */
+   150,  /* (87) struct_member ::= struct_member_details */
+   151,  /* (88) struct_member_details ::= datatype struct_member_item_list SEMICOLON */
+   152,  /* (89) struct_member_item_list ::= scalar_or_array */
+   152,  /* (90) struct_member_item_list ::= scalar_or_array semantic */
+   152,  /* (91) struct_member_item_list ::= struct_member_item_list COMMA IDENTIFIER */
+   147,  /* (92) variable_lowlevel ::= packoffset register */
+   147,  /* (93) variable_lowlevel ::= register packoffset */
+   147,  /* (94) variable_lowlevel ::= packoffset */
+   147,  /* (95) variable_lowlevel ::= register */
+   132,  /* (96) scalar_or_array ::= IDENTIFIER LBRACKET RBRACKET */
+   132,  /* (97) scalar_or_array ::= IDENTIFIER LBRACKET expression RBRACKET */
+   132,  /* (98) scalar_or_array ::= IDENTIFIER */
+   153,  /* (99) packoffset ::= COLON PACKOFFSET LPAREN IDENTIFIER DOT IDENTIFIER RPAREN */
+   153,  /* (100) packoffset ::= COLON PACKOFFSET LPAREN IDENTIFIER RPAREN */
+   154,  /* (101) register ::= COLON REGISTER LPAREN IDENTIFIER RPAREN */
+   146,  /* (102) annotations ::= LT annotation_list GT */
+   156,  /* (103) annotation_list ::= annotation */
+   156,  /* (104) annotation_list ::= annotation_list annotation */
+   157,  /* (105) annotation ::= datatype_scalar initializer SEMICOLON */
+   159,  /* (106) initializer_block_list ::= expression */
+   159,  /* (107) initializer_block_list ::= LBRACE initializer_block_list RBRACE */
+   159,  /* (108) initializer_block_list ::= initializer_block_list COMMA initializer_block_list */
+   160,  /* (109) initializer_block ::= LBRACE initializer_block_list RBRACE */
+   141,  /* (110) initializer ::= ASSIGN initializer_block */
+   141,  /* (111) initializer ::= ASSIGN expression */
+   161,  /* (112) intrinsic_datatype ::= datatype_vector */
+   161,  /* (113) intrinsic_datatype ::= datatype_matrix */
+   161,  /* (114) intrinsic_datatype ::= datatype_scalar */
+   161,  /* (115) intrinsic_datatype ::= datatype_sampler */
+   161,  /* (116) intrinsic_datatype ::= datatype_buffer */
+   131,  /* (117) datatype ::= intrinsic_datatype */
+   131,  /* (118) datatype ::= USERTYPE */
+   164,  /* (119) datatype_sampler ::= SAMPLER */
+   164,  /* (120) datatype_sampler ::= SAMPLER1D */
+   164,  /* (121) datatype_sampler ::= SAMPLER2D */
+   164,  /* (122) datatype_sampler ::= SAMPLER3D */
+   164,  /* (123) datatype_sampler ::= SAMPLERCUBE */
+   164,  /* (124) datatype_sampler ::= SAMPLER_STATE */
+   164,  /* (125) datatype_sampler ::= SAMPLERSTATE */
+   164,  /* (126) datatype_sampler ::= SAMPLERCOMPARISONSTATE */
+   158,  /* (127) datatype_scalar ::= BOOL */
+   158,  /* (128) datatype_scalar ::= INT */
+   158,  /* (129) datatype_scalar ::= UINT */
+   158,  /* (130) datatype_scalar ::= HALF */
+   158,  /* (131) datatype_scalar ::= FLOAT */
+   158,  /* (132) datatype_scalar ::= DOUBLE */
+   158,  /* (133) datatype_scalar ::= STRING */
+   158,  /* (134) datatype_scalar ::= SNORM FLOAT */
+   158,  /* (135) datatype_scalar ::= UNORM FLOAT */
+   165,  /* (136) datatype_buffer ::= BUFFER LT BOOL GT */
+   165,  /* (137) datatype_buffer ::= BUFFER LT INT GT */
+   165,  /* (138) datatype_buffer ::= BUFFER LT UINT GT */
+   165,  /* (139) datatype_buffer ::= BUFFER LT HALF GT */
+   165,  /* (140) datatype_buffer ::= BUFFER LT FLOAT GT */
+   165,  /* (141) datatype_buffer ::= BUFFER LT DOUBLE GT */
+   165,  /* (142) datatype_buffer ::= BUFFER LT SNORM FLOAT GT */
+   165,  /* (143) datatype_buffer ::= BUFFER LT UNORM FLOAT GT */
+   162,  /* (144) datatype_vector ::= VECTOR LT datatype_scalar COMMA INT_CONSTANT GT */
+   163,  /* (145) datatype_matrix ::= MATRIX LT datatype_scalar COMMA INT_CONSTANT COMMA INT_CONSTANT GT */
+   128,  /* (146) statement_block ::= LBRACE RBRACE */
+   128,  /* (147) statement_block ::= LBRACE statement_list RBRACE */
+   166,  /* (148) statement_list ::= statement */
+   166,  /* (149) statement_list ::= statement_list statement */
+   168,  /* (150) statement_attribute ::= ISOLATE */
+   168,  /* (151) statement_attribute ::= MAXINSTRUCTIONCOUNT LPAREN INT_CONSTANT RPAREN */
+   168,  /* (152) statement_attribute ::= NOEXPRESSIONOPTIMIZATIONS */
+   168,  /* (153) statement_attribute ::= REMOVEUNUSEDINPUTS */
+   168,  /* (154) statement_attribute ::= UNUSED */
+   168,  /* (155) statement_attribute ::= XPS */
+   167,  /* (156) statement ::= BREAK SEMICOLON */
+   167,  /* (157) statement ::= CONTINUE SEMICOLON */
+   167,  /* (158) statement ::= DISCARD SEMICOLON */
+   167,  /* (159) statement ::= LBRACKET statement_attribute RBRACKET statement_block */
+   167,  /* (160) statement ::= variable_declaration */
+   167,  /* (161) statement ::= struct_declaration SEMICOLON */
+   167,  /* (162) statement ::= do_intro DO statement WHILE LPAREN expression RPAREN SEMICOLON */
+   167,  /* (163) statement ::= while_intro LPAREN expression RPAREN statement */
+   167,  /* (164) statement ::= if_intro LPAREN expression RPAREN statement */
+   167,  /* (165) statement ::= if_intro LPAREN expression RPAREN statement ELSE statement */
+   167,  /* (166) statement ::= switch_intro LPAREN expression RPAREN LBRACE switch_case_list RBRACE */
+   167,  /* (167) statement ::= typedef */
+   167,  /* (168) statement ::= SEMICOLON */
+   167,  /* (169) statement ::= expression SEMICOLON */
+   167,  /* (170) statement ::= RETURN SEMICOLON */
+   167,  /* (171) statement ::= RETURN expression SEMICOLON */
+   167,  /* (172) statement ::= statement_block */
+   167,  /* (173) statement ::= for_statement */
+   170,  /* (174) while_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET WHILE */
+   170,  /* (175) while_intro ::= LBRACKET UNROLL RBRACKET WHILE */
+   170,  /* (176) while_intro ::= LBRACKET LOOP RBRACKET WHILE */
+   170,  /* (177) while_intro ::= WHILE */
+   174,  /* (178) for_statement ::= for_intro for_details */
+   175,  /* (179) for_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET FOR */
+   175,  /* (180) for_intro ::= LBRACKET UNROLL RBRACKET FOR */
+   175,  /* (181) for_intro ::= LBRACKET LOOP RBRACKET FOR */
+   175,  /* (182) for_intro ::= FOR */
+   176,  /* (183) for_details ::= LPAREN expression SEMICOLON expression SEMICOLON expression RPAREN statement */
+   176,  /* (184) for_details ::= LPAREN SEMICOLON SEMICOLON RPAREN statement */
+   176,  /* (185) for_details ::= LPAREN SEMICOLON SEMICOLON expression RPAREN statement */
+   176,  /* (186) for_details ::= LPAREN SEMICOLON expression SEMICOLON RPAREN statement */
+   176,  /* (187) for_details ::= LPAREN SEMICOLON expression SEMICOLON expression RPAREN statement */
+   176,  /* (188) for_details ::= LPAREN expression SEMICOLON SEMICOLON RPAREN statement */
+   176,  /* (189) for_details ::= LPAREN expression SEMICOLON SEMICOLON expression RPAREN statement */
+   176,  /* (190) for_details ::= LPAREN expression SEMICOLON expression SEMICOLON RPAREN statement */
+   176,  /* (191) for_details ::= LPAREN variable_declaration expression SEMICOLON expression RPAREN statement */
+   176,  /* (192) for_details ::= LPAREN variable_declaration SEMICOLON RPAREN statement */
+   176,  /* (193) for_details ::= LPAREN variable_declaration SEMICOLON expression RPAREN statement */
+   176,  /* (194) for_details ::= LPAREN variable_declaration expression SEMICOLON RPAREN statement */
+   169,  /* (195) do_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET DO */
+   169,  /* (196) do_intro ::= LBRACKET UNROLL RBRACKET DO */
+   169,  /* (197) do_intro ::= LBRACKET LOOP RBRACKET DO */
+   169,  /* (198) do_intro ::= DO */
+   171,  /* (199) if_intro ::= LBRACKET BRANCH RBRACKET IF */
+   171,  /* (200) if_intro ::= LBRACKET FLATTEN RBRACKET IF */
+   171,  /* (201) if_intro ::= LBRACKET IFALL RBRACKET IF */
+   171,  /* (202) if_intro ::= LBRACKET IFANY RBRACKET IF */
+   171,  /* (203) if_intro ::= LBRACKET PREDICATE RBRACKET IF */
+   171,  /* (204) if_intro ::= LBRACKET PREDICATEBLOCK RBRACKET IF */
+   171,  /* (205) if_intro ::= IF */
+   172,  /* (206) switch_intro ::= LBRACKET FLATTEN RBRACKET SWITCH */
+   172,  /* (207) switch_intro ::= LBRACKET BRANCH RBRACKET SWITCH */
+   172,  /* (208) switch_intro ::= LBRACKET FORCECASE RBRACKET SWITCH */
+   172,  /* (209) switch_intro ::= LBRACKET CALL RBRACKET SWITCH */
+   172,  /* (210) switch_intro ::= SWITCH */
+   173,  /* (211) switch_case_list ::= switch_case */
+   173,  /* (212) switch_case_list ::= switch_case_list switch_case */
+   177,  /* (213) switch_case ::= CASE expression COLON statement_list */
+   177,  /* (214) switch_case ::= CASE expression COLON */
+   177,  /* (215) switch_case ::= DEFAULT COLON statement_list */
+   177,  /* (216) switch_case ::= DEFAULT COLON */
+   178,  /* (217) primary_expr ::= IDENTIFIER */
+   178,  /* (218) primary_expr ::= INT_CONSTANT */
+   178,  /* (219) primary_expr ::= FLOAT_CONSTANT */
+   178,  /* (220) primary_expr ::= STRING_LITERAL */
+   178,  /* (221) primary_expr ::= TRUE */
+   178,  /* (222) primary_expr ::= FALSE */
+   178,  /* (223) primary_expr ::= LPAREN expression RPAREN */
+   179,  /* (224) postfix_expr ::= primary_expr */
+   179,  /* (225) postfix_expr ::= postfix_expr LBRACKET expression RBRACKET */
+   179,  /* (226) postfix_expr ::= IDENTIFIER arguments */
+   179,  /* (227) postfix_expr ::= datatype arguments */
+   179,  /* (228) postfix_expr ::= postfix_expr DOT IDENTIFIER */
+   179,  /* (229) postfix_expr ::= postfix_expr PLUSPLUS */
+   179,  /* (230) postfix_expr ::= postfix_expr MINUSMINUS */
+   180,  /* (231) arguments ::= LPAREN RPAREN */
+   180,  /* (232) arguments ::= LPAREN argument_list RPAREN */
+   181,  /* (233) argument_list ::= assignment_expr */
+   181,  /* (234) argument_list ::= argument_list COMMA assignment_expr */
+   183,  /* (235) unary_expr ::= postfix_expr */
+   183,  /* (236) unary_expr ::= PLUSPLUS unary_expr */
+   183,  /* (237) unary_expr ::= MINUSMINUS unary_expr */
+   183,  /* (238) unary_expr ::= PLUS cast_expr */
+   183,  /* (239) unary_expr ::= MINUS cast_expr */
+   183,  /* (240) unary_expr ::= COMPLEMENT cast_expr */
+   183,  /* (241) unary_expr ::= EXCLAMATION cast_expr */
+   184,  /* (242) cast_expr ::= unary_expr */
+   184,  /* (243) cast_expr ::= LPAREN datatype RPAREN cast_expr */
+   185,  /* (244) multiplicative_expr ::= cast_expr */
+   185,  /* (245) multiplicative_expr ::= multiplicative_expr STAR cast_expr */
+   185,  /* (246) multiplicative_expr ::= multiplicative_expr SLASH cast_expr */
+   185,  /* (247) multiplicative_expr ::= multiplicative_expr PERCENT cast_expr */
+   186,  /* (248) additive_expr ::= multiplicative_expr */
+   186,  /* (249) additive_expr ::= additive_expr PLUS multiplicative_expr */
+   186,  /* (250) additive_expr ::= additive_expr MINUS multiplicative_expr */
+   187,  /* (251) shift_expr ::= additive_expr */
+   187,  /* (252) shift_expr ::= shift_expr LSHIFT additive_expr */
+   187,  /* (253) shift_expr ::= shift_expr RSHIFT additive_expr */
+   188,  /* (254) relational_expr ::= shift_expr */
+   188,  /* (255) relational_expr ::= relational_expr LT shift_expr */
+   188,  /* (256) relational_expr ::= relational_expr GT shift_expr */
+   188,  /* (257) relational_expr ::= relational_expr LEQ shift_expr */
+   188,  /* (258) relational_expr ::= relational_expr GEQ shift_expr */
+   189,  /* (259) equality_expr ::= relational_expr */
+   189,  /* (260) equality_expr ::= equality_expr EQL relational_expr */
+   189,  /* (261) equality_expr ::= equality_expr NEQ relational_expr */
+   190,  /* (262) and_expr ::= equality_expr */
+   190,  /* (263) and_expr ::= and_expr AND equality_expr */
+   191,  /* (264) exclusive_or_expr ::= and_expr */
+   191,  /* (265) exclusive_or_expr ::= exclusive_or_expr XOR and_expr */
+   192,  /* (266) inclusive_or_expr ::= exclusive_or_expr */
+   192,  /* (267) inclusive_or_expr ::= inclusive_or_expr OR exclusive_or_expr */
+   193,  /* (268) logical_and_expr ::= inclusive_or_expr */
+   193,  /* (269) logical_and_expr ::= logical_and_expr ANDAND inclusive_or_expr */
+   194,  /* (270) logical_or_expr ::= logical_and_expr */
+   194,  /* (271) logical_or_expr ::= logical_or_expr OROR logical_and_expr */
+   195,  /* (272) conditional_expr ::= logical_or_expr */
+   195,  /* (273) conditional_expr ::= logical_or_expr QUESTION logical_or_expr COLON conditional_expr */
+   182,  /* (274) assignment_expr ::= conditional_expr */
+   182,  /* (275) assignment_expr ::= unary_expr ASSIGN assignment_expr */
+   182,  /* (276) assignment_expr ::= unary_expr MULASSIGN assignment_expr */
+   182,  /* (277) assignment_expr ::= unary_expr DIVASSIGN assignment_expr */
+   182,  /* (278) assignment_expr ::= unary_expr MODASSIGN assignment_expr */
+   182,  /* (279) assignment_expr ::= unary_expr ADDASSIGN assignment_expr */
+   182,  /* (280) assignment_expr ::= unary_expr SUBASSIGN assignment_expr */
+   182,  /* (281) assignment_expr ::= unary_expr LSHIFTASSIGN assignment_expr */
+   182,  /* (282) assignment_expr ::= unary_expr RSHIFTASSIGN assignment_expr */
+   182,  /* (283) assignment_expr ::= unary_expr ANDASSIGN assignment_expr */
+   182,  /* (284) assignment_expr ::= unary_expr XORASSIGN assignment_expr */
+   182,  /* (285) assignment_expr ::= unary_expr ORASSIGN assignment_expr */
+   155,  /* (286) expression ::= assignment_expr */
+   155,  /* (287) expression ::= expression COMMA assignment_expr */
+};
+
+/* For rule J, yyRuleInfoNRhs[J] contains the negative of the number
+** of symbols on the right-hand side of that rule. */
+static const signed char yyRuleInfoNRhs[] = {
+   -1,  /* (0) shader ::= compilation_units */
+   -1,  /* (1) compilation_units ::= compilation_unit */
+   -2,  /* (2) compilation_units ::= compilation_units compilation_unit */
+   -1,  /* (3) compilation_unit ::= variable_declaration */
+   -2,  /* (4) compilation_unit ::= function_signature SEMICOLON */
+   -2,  /* (5) compilation_unit ::= function_signature statement_block */
+   -1,  /* (6) compilation_unit ::= typedef */
+   -2,  /* (7) compilation_unit ::= struct_declaration SEMICOLON */
+   -4,  /* (8) typedef ::= TYPEDEF CONST datatype scalar_or_array */
+   -3,  /* (9) typedef ::= TYPEDEF datatype scalar_or_array */
+   -3,  /* (10) function_signature ::= function_storageclass function_details semantic */
+   -2,  /* (11) function_signature ::= function_storageclass function_details */
+   -2,  /* (12) function_signature ::= function_details semantic */
+   -1,  /* (13) function_signature ::= function_details */
+   -5,  /* (14) function_details ::= datatype IDENTIFIER LPAREN function_parameters RPAREN */
+   -5,  /* (15) function_details ::= VOID IDENTIFIER LPAREN function_parameters RPAREN */
+   -1,  /* (16) function_storageclass ::= INLINE */
+   -1,  /* (17) function_parameters ::= VOID */
+   -1,  /* (18) function_parameters ::= function_parameter_list */
+    0,  /* (19) function_parameters ::= */
+   -1,  /* (20) function_parameter_list ::= function_parameter */
+   -3,  /* (21) function_parameter_list ::= function_parameter_list COMMA function_parameter */
+   -6,  /* (22) function_parameter ::= input_modifier datatype IDENTIFIER semantic interpolation_mod initializer */
+   -5,  /* (23) function_parameter ::= input_modifier datatype IDENTIFIER semantic interpolation_mod */
+   -5,  /* (24) function_parameter ::= input_modifier datatype IDENTIFIER semantic initializer */
+   -4,  /* (25) function_parameter ::= input_modifier datatype IDENTIFIER semantic */
+   -5,  /* (26) function_parameter ::= input_modifier datatype IDENTIFIER interpolation_mod initializer */
+   -4,  /* (27) function_parameter ::= input_modifier datatype IDENTIFIER interpolation_mod */
+   -4,  /* (28) function_parameter ::= input_modifier datatype IDENTIFIER initializer */
+   -3,  /* (29) function_parameter ::= input_modifier datatype IDENTIFIER */
+   -5,  /* (30) function_parameter ::= datatype IDENTIFIER semantic interpolation_mod initializer */
+   -4,  /* (31) function_parameter ::= datatype IDENTIFIER semantic interpolation_mod */
+   -4,  /* (32) function_parameter ::= datatype IDENTIFIER semantic initializer */
+   -3,  /* (33) function_parameter ::= datatype IDENTIFIER semantic */
+   -4,  /* (34) function_parameter ::= datatype IDENTIFIER interpolation_mod initializer */
+   -3,  /* (35) function_parameter ::= datatype IDENTIFIER interpolation_mod */
+   -3,  /* (36) function_parameter ::= datatype IDENTIFIER initializer */
+   -2,  /* (37) function_parameter ::= datatype IDENTIFIER */
+   -1,  /* (38) input_modifier ::= IN */
+   -1,  /* (39) input_modifier ::= INOUT */
+   -1,  /* (40) input_modifier ::= OUT */
+   -2,  /* (41) input_modifier ::= IN OUT */
+   -2,  /* (42) input_modifier ::= OUT IN */
+   -1,  /* (43) input_modifier ::= UNIFORM */
+   -2,  /* (44) semantic ::= COLON IDENTIFIER */
+   -1,  /* (45) interpolation_mod ::= LINEAR */
+   -1,  /* (46) interpolation_mod ::= CENTROID */
+   -1,  /* (47) interpolation_mod ::= NOINTERPOLATION */
+   -1,  /* (48) interpolation_mod ::= NOPERSPECTIVE */
+   -1,  /* (49) interpolation_mod ::= SAMPLE */
+   -4,  /* (50) variable_declaration ::= variable_attribute_list datatype variable_declaration_details_list SEMICOLON */
+   -3,  /* (51) variable_declaration ::= datatype variable_declaration_details_list SEMICOLON */
+   -3,  /* (52) variable_declaration ::= struct_declaration variable_declaration_details_list SEMICOLON */
+   -1,  /* (53) variable_attribute_list ::= variable_attribute */
+   -2,  /* (54) variable_attribute_list ::= variable_attribute_list variable_attribute */
+   -1,  /* (55) variable_attribute ::= EXTERN */
+   -1,  /* (56) variable_attribute ::= NOINTERPOLATION */
+   -1,  /* (57) variable_attribute ::= SHARED */
+   -1,  /* (58) variable_attribute ::= STATIC */
+   -1,  /* (59) variable_attribute ::= UNIFORM */
+   -1,  /* (60) variable_attribute ::= VOLATILE */
+   -1,  /* (61) variable_attribute ::= CONST */
+   -1,  /* (62) variable_attribute ::= ROWMAJOR */
+   -1,  /* (63) variable_attribute ::= COLUMNMAJOR */
+   -1,  /* (64) variable_declaration_details_list ::= variable_declaration_details */
+   -3,  /* (65) variable_declaration_details_list ::= variable_declaration_details_list COMMA variable_declaration_details */
+   -5,  /* (66) variable_declaration_details ::= scalar_or_array semantic annotations initializer variable_lowlevel */
+   -4,  /* (67) variable_declaration_details ::= scalar_or_array semantic annotations initializer */
+   -4,  /* (68) variable_declaration_details ::= scalar_or_array semantic annotations variable_lowlevel */
+   -3,  /* (69) variable_declaration_details ::= scalar_or_array semantic annotations */
+   -4,  /* (70) variable_declaration_details ::= scalar_or_array semantic initializer variable_lowlevel */
+   -3,  /* (71) variable_declaration_details ::= scalar_or_array semantic initializer */
+   -3,  /* (72) variable_declaration_details ::= scalar_or_array semantic variable_lowlevel */
+   -2,  /* (73) variable_declaration_details ::= scalar_or_array semantic */
+   -4,  /* (74) variable_declaration_details ::= scalar_or_array annotations initializer variable_lowlevel */
+   -3,  /* (75) variable_declaration_details ::= scalar_or_array annotations initializer */
+   -3,  /* (76) variable_declaration_details ::= scalar_or_array annotations variable_lowlevel */
+   -2,  /* (77) variable_declaration_details ::= scalar_or_array annotations */
+   -3,  /* (78) variable_declaration_details ::= scalar_or_array initializer variable_lowlevel */
+   -2,  /* (79) variable_declaration_details ::= scalar_or_array initializer */
+   -2,  /* (80) variable_declaration_details ::= scalar_or_array variable_lowlevel */
+   -1,  /* (81) variable_declaration_details ::= scalar_or_array */
+   -4,  /* (82) struct_declaration ::= struct_intro LBRACE struct_member_list RBRACE */
+   -2,  /* (83) struct_intro ::= STRUCT IDENTIFIER */
+   -1,  /* (84) struct_member_list ::= struct_member */
+   -2,  /* (85) struct_member_list ::= struct_member_list struct_member */
+   -2,  /* (86) struct_member ::= interpolation_mod struct_member_details */
+   -1,  /* (87) struct_member ::= struct_member_details */
+   -3,  /* (88) struct_member_details ::= datatype struct_member_item_list SEMICOLON */
+   -1,  /* (89) struct_member_item_list ::= scalar_or_array */
+   -2,  /* (90) struct_member_item_list ::= scalar_or_array semantic */
+   -3,  /* (91) struct_member_item_list ::= struct_member_item_list COMMA IDENTIFIER */
+   -2,  /* (92) variable_lowlevel ::= packoffset register */
+   -2,  /* (93) variable_lowlevel ::= register packoffset */
+   -1,  /* (94) variable_lowlevel ::= packoffset */
+   -1,  /* (95) variable_lowlevel ::= register */
+   -3,  /* (96) scalar_or_array ::= IDENTIFIER LBRACKET RBRACKET */
+   -4,  /* (97) scalar_or_array ::= IDENTIFIER LBRACKET expression RBRACKET */
+   -1,  /* (98) scalar_or_array ::= IDENTIFIER */
+   -7,  /* (99) packoffset ::= COLON PACKOFFSET LPAREN IDENTIFIER DOT IDENTIFIER RPAREN */
+   -5,  /* (100) packoffset ::= COLON PACKOFFSET LPAREN IDENTIFIER RPAREN */
+   -5,  /* (101) register ::= COLON REGISTER LPAREN IDENTIFIER RPAREN */
+   -3,  /* (102) annotations ::= LT annotation_list GT */
+   -1,  /* (103) annotation_list ::= annotation */
+   -2,  /* (104) annotation_list ::= annotation_list annotation */
+   -3,  /* (105) annotation ::= datatype_scalar initializer SEMICOLON */
+   -1,  /* (106) initializer_block_list ::= expression */
+   -3,  /* (107) initializer_block_list ::= LBRACE initializer_block_list RBRACE */
+   -3,  /* (108) initializer_block_list ::= initializer_block_list COMMA initializer_block_list */
+   -3,  /* (109) initializer_block ::= LBRACE initializer_block_list RBRACE */
+   -2,  /* (110) initializer ::= ASSIGN initializer_block */
+   -2,  /* (111) initializer ::= ASSIGN expression */
+   -1,  /* (112) intrinsic_datatype ::= datatype_vector */
+   -1,  /* (113) intrinsic_datatype ::= datatype_matrix */
+   -1,  /* (114) intrinsic_datatype ::= datatype_scalar */
+   -1,  /* (115) intrinsic_datatype ::= datatype_sampler */
+   -1,  /* (116) intrinsic_datatype ::= datatype_buffer */
+   -1,  /* (117) datatype ::= intrinsic_datatype */
+   -1,  /* (118) datatype ::= USERTYPE */
+   -1,  /* (119) datatype_sampler ::= SAMPLER */
+   -1,  /* (120) datatype_sampler ::= SAMPLER1D */
+   -1,  /* (121) datatype_sampler ::= SAMPLER2D */
+   -1,  /* (122) datatype_sampler ::= SAMPLER3D */
+   -1,  /* (123) datatype_sampler ::= SAMPLERCUBE */
+   -1,  /* (124) datatype_sampler ::= SAMPLER_STATE */
+   -1,  /* (125) datatype_sampler ::= SAMPLERSTATE */
+   -1,  /* (126) datatype_sampler ::= SAMPLERCOMPARISONSTATE */
+   -1,  /* (127) datatype_scalar ::= BOOL */
+   -1,  /* (128) datatype_scalar ::= INT */
+   -1,  /* (129) datatype_scalar ::= UINT */
+   -1,  /* (130) datatype_scalar ::= HALF */
+   -1,  /* (131) datatype_scalar ::= FLOAT */
+   -1,  /* (132) datatype_scalar ::= DOUBLE */
+   -1,  /* (133) datatype_scalar ::= STRING */
+   -2,  /* (134) datatype_scalar ::= SNORM FLOAT */
+   -2,  /* (135) datatype_scalar ::= UNORM FLOAT */
+   -4,  /* (136) datatype_buffer ::= BUFFER LT BOOL GT */
+   -4,  /* (137) datatype_buffer ::= BUFFER LT INT GT */
+   -4,  /* (138) datatype_buffer ::= BUFFER LT UINT GT */
+   -4,  /* (139) datatype_buffer ::= BUFFER LT HALF GT */
+   -4,  /* (140) datatype_buffer ::= BUFFER LT FLOAT GT */
+   -4,  /* (141) datatype_buffer ::= BUFFER LT DOUBLE GT */
+   -5,  /* (142) datatype_buffer ::= BUFFER LT SNORM FLOAT GT */
+   -5,  /* (143) datatype_buffer ::= BUFFER LT UNORM FLOAT GT */
+   -6,  /* (144) datatype_vector ::= VECTOR LT datatype_scalar COMMA INT_CONSTANT GT */
+   -8,  /* (145) datatype_matrix ::= MATRIX LT datatype_scalar COMMA INT_CONSTANT COMMA INT_CONSTANT GT */
+   -2,  /* (146) statement_block ::= LBRACE RBRACE */
+   -3,  /* (147) statement_block ::= LBRACE statement_list RBRACE */
+   -1,  /* (148) statement_list ::= statement */
+   -2,  /* (149) statement_list ::= statement_list statement */
+   -1,  /* (150) statement_attribute ::= ISOLATE */
+   -4,  /* (151) statement_attribute ::= MAXINSTRUCTIONCOUNT LPAREN INT_CONSTANT RPAREN */
+   -1,  /* (152) statement_attribute ::= NOEXPRESSIONOPTIMIZATIONS */
+   -1,  /* (153) statement_attribute ::= REMOVEUNUSEDINPUTS */
+   -1,  /* (154) statement_attribute ::= UNUSED */
+   -1,  /* (155) statement_attribute ::= XPS */
+   -2,  /* (156) statement ::= BREAK SEMICOLON */
+   -2,  /* (157) statement ::= CONTINUE SEMICOLON */
+   -2,  /* (158) statement ::= DISCARD SEMICOLON */
+   -4,  /* (159) statement ::= LBRACKET statement_attribute RBRACKET statement_block */
+   -1,  /* (160) statement ::= variable_declaration */
+   -2,  /* (161) statement ::= struct_declaration SEMICOLON */
+   -8,  /* (162) statement ::= do_intro DO statement WHILE LPAREN expression RPAREN SEMICOLON */
+   -5,  /* (163) statement ::= while_intro LPAREN expression RPAREN statement */
+   -5,  /* (164) statement ::= if_intro LPAREN expression RPAREN statement */
+   -7,  /* (165) statement ::= if_intro LPAREN expression RPAREN statement ELSE statement */
+   -7,  /* (166) statement ::= switch_intro LPAREN expression RPAREN LBRACE switch_case_list RBRACE */
+   -1,  /* (167) statement ::= typedef */
+   -1,  /* (168) statement ::= SEMICOLON */
+   -2,  /* (169) statement ::= expression SEMICOLON */
+   -2,  /* (170) statement ::= RETURN SEMICOLON */
+   -3,  /* (171) statement ::= RETURN expression SEMICOLON */
+   -1,  /* (172) statement ::= statement_block */
+   -1,  /* (173) statement ::= for_statement */
+   -7,  /* (174) while_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET WHILE */
+   -4,  /* (175) while_intro ::= LBRACKET UNROLL RBRACKET WHILE */
+   -4,  /* (176) while_intro ::= LBRACKET LOOP RBRACKET WHILE */
+   -1,  /* (177) while_intro ::= WHILE */
+   -2,  /* (178) for_statement ::= for_intro for_details */
+   -7,  /* (179) for_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET FOR */
+   -4,  /* (180) for_intro ::= LBRACKET UNROLL RBRACKET FOR */
+   -4,  /* (181) for_intro ::= LBRACKET LOOP RBRACKET FOR */
+   -1,  /* (182) for_intro ::= FOR */
+   -8,  /* (183) for_details ::= LPAREN expression SEMICOLON expression SEMICOLON expression RPAREN statement */
+   -5,  /* (184) for_details ::= LPAREN SEMICOLON SEMICOLON RPAREN statement */
+   -6,  /* (185) for_details ::= LPAREN SEMICOLON SEMICOLON expression RPAREN statement */
+   -6,  /* (186) for_details ::= LPAREN SEMICOLON expression SEMICOLON RPAREN statement */
+   -7,  /* (187) for_details ::= LPAREN SEMICOLON expression SEMICOLON expression RPAREN statement */
+   -6,  /* (188) for_details ::= LPAREN expression SEMICOLON SEMICOLON RPAREN statement */
+   -7,  /* (189) for_details ::= LPAREN expression SEMICOLON SEMICOLON expression RPAREN statement */
+   -7,  /* (190) for_details ::= LPAREN expression SEMICOLON expression SEMICOLON RPAREN statement */
+   -7,  /* (191) for_details ::= LPAREN variable_declaration expression SEMICOLON expression RPAREN statement */
+   -5,  /* (192) for_details ::= LPAREN variable_declaration SEMICOLON RPAREN statement */
+   -6,  /* (193) for_details ::= LPAREN variable_declaration SEMICOLON expression RPAREN statement */
+   -6,  /* (194) for_details ::= LPAREN variable_declaration expression SEMICOLON RPAREN statement */
+   -7,  /* (195) do_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET DO */
+   -4,  /* (196) do_intro ::= LBRACKET UNROLL RBRACKET DO */
+   -4,  /* (197) do_intro ::= LBRACKET LOOP RBRACKET DO */
+   -1,  /* (198) do_intro ::= DO */
+   -4,  /* (199) if_intro ::= LBRACKET BRANCH RBRACKET IF */
+   -4,  /* (200) if_intro ::= LBRACKET FLATTEN RBRACKET IF */
+   -4,  /* (201) if_intro ::= LBRACKET IFALL RBRACKET IF */
+   -4,  /* (202) if_intro ::= LBRACKET IFANY RBRACKET IF */
+   -4,  /* (203) if_intro ::= LBRACKET PREDICATE RBRACKET IF */
+   -4,  /* (204) if_intro ::= LBRACKET PREDICATEBLOCK RBRACKET IF */
+   -1,  /* (205) if_intro ::= IF */
+   -4,  /* (206) switch_intro ::= LBRACKET FLATTEN RBRACKET SWITCH */
+   -4,  /* (207) switch_intro ::= LBRACKET BRANCH RBRACKET SWITCH */
+   -4,  /* (208) switch_intro ::= LBRACKET FORCECASE RBRACKET SWITCH */
+   -4,  /* (209) switch_intro ::= LBRACKET CALL RBRACKET SWITCH */
+   -1,  /* (210) switch_intro ::= SWITCH */
+   -1,  /* (211) switch_case_list ::= switch_case */
+   -2,  /* (212) switch_case_list ::= switch_case_list switch_case */
+   -4,  /* (213) switch_case ::= CASE expression COLON statement_list */
+   -3,  /* (214) switch_case ::= CASE expression COLON */
+   -3,  /* (215) switch_case ::= DEFAULT COLON statement_list */
+   -2,  /* (216) switch_case ::= DEFAULT COLON */
+   -1,  /* (217) primary_expr ::= IDENTIFIER */
+   -1,  /* (218) primary_expr ::= INT_CONSTANT */
+   -1,  /* (219) primary_expr ::= FLOAT_CONSTANT */
+   -1,  /* (220) primary_expr ::= STRING_LITERAL */
+   -1,  /* (221) primary_expr ::= TRUE */
+   -1,  /* (222) primary_expr ::= FALSE */
+   -3,  /* (223) primary_expr ::= LPAREN expression RPAREN */
+   -1,  /* (224) postfix_expr ::= primary_expr */
+   -4,  /* (225) postfix_expr ::= postfix_expr LBRACKET expression RBRACKET */
+   -2,  /* (226) postfix_expr ::= IDENTIFIER arguments */
+   -2,  /* (227) postfix_expr ::= datatype arguments */
+   -3,  /* (228) postfix_expr ::= postfix_expr DOT IDENTIFIER */
+   -2,  /* (229) postfix_expr ::= postfix_expr PLUSPLUS */
+   -2,  /* (230) postfix_expr ::= postfix_expr MINUSMINUS */
+   -2,  /* (231) arguments ::= LPAREN RPAREN */
+   -3,  /* (232) arguments ::= LPAREN argument_list RPAREN */
+   -1,  /* (233) argument_list ::= assignment_expr */
+   -3,  /* (234) argument_list ::= argument_list COMMA assignment_expr */
+   -1,  /* (235) unary_expr ::= postfix_expr */
+   -2,  /* (236) unary_expr ::= PLUSPLUS unary_expr */
+   -2,  /* (237) unary_expr ::= MINUSMINUS unary_expr */
+   -2,  /* (238) unary_expr ::= PLUS cast_expr */
+   -2,  /* (239) unary_expr ::= MINUS cast_expr */
+   -2,  /* (240) unary_expr ::= COMPLEMENT cast_expr */
+   -2,  /* (241) unary_expr ::= EXCLAMATION cast_expr */
+   -1,  /* (242) cast_expr ::= unary_expr */
+   -4,  /* (243) cast_expr ::= LPAREN datatype RPAREN cast_expr */
+   -1,  /* (244) multiplicative_expr ::= cast_expr */
+   -3,  /* (245) multiplicative_expr ::= multiplicative_expr STAR cast_expr */
+   -3,  /* (246) multiplicative_expr ::= multiplicative_expr SLASH cast_expr */
+   -3,  /* (247) multiplicative_expr ::= multiplicative_expr PERCENT cast_expr */
+   -1,  /* (248) additive_expr ::= multiplicative_expr */
+   -3,  /* (249) additive_expr ::= additive_expr PLUS multiplicative_expr */
+   -3,  /* (250) additive_expr ::= additive_expr MINUS multiplicative_expr */
+   -1,  /* (251) shift_expr ::= additive_expr */
+   -3,  /* (252) shift_expr ::= shift_expr LSHIFT additive_expr */
+   -3,  /* (253) shift_expr ::= shift_expr RSHIFT additive_expr */
+   -1,  /* (254) relational_expr ::= shift_expr */
+   -3,  /* (255) relational_expr ::= relational_expr LT shift_expr */
+   -3,  /* (256) relational_expr ::= relational_expr GT shift_expr */
+   -3,  /* (257) relational_expr ::= relational_expr LEQ shift_expr */
+   -3,  /* (258) relational_expr ::= relational_expr GEQ shift_expr */
+   -1,  /* (259) equality_expr ::= relational_expr */
+   -3,  /* (260) equality_expr ::= equality_expr EQL relational_expr */
+   -3,  /* (261) equality_expr ::= equality_expr NEQ relational_expr */
+   -1,  /* (262) and_expr ::= equality_expr */
+   -3,  /* (263) and_expr ::= and_expr AND equality_expr */
+   -1,  /* (264) exclusive_or_expr ::= and_expr */
+   -3,  /* (265) exclusive_or_expr ::= exclusive_or_expr XOR and_expr */
+   -1,  /* (266) inclusive_or_expr ::= exclusive_or_expr */
+   -3,  /* (267) inclusive_or_expr ::= inclusive_or_expr OR exclusive_or_expr */
+   -1,  /* (268) logical_and_expr ::= inclusive_or_expr */
+   -3,  /* (269) logical_and_expr ::= logical_and_expr ANDAND inclusive_or_expr */
+   -1,  /* (270) logical_or_expr ::= logical_and_expr */
+   -3,  /* (271) logical_or_expr ::= logical_or_expr OROR logical_and_expr */
+   -1,  /* (272) conditional_expr ::= logical_or_expr */
+   -5,  /* (273) conditional_expr ::= logical_or_expr QUESTION logical_or_expr COLON conditional_expr */
+   -1,  /* (274) assignment_expr ::= conditional_expr */
+   -3,  /* (275) assignment_expr ::= unary_expr ASSIGN assignment_expr */
+   -3,  /* (276) assignment_expr ::= unary_expr MULASSIGN assignment_expr */
+   -3,  /* (277) assignment_expr ::= unary_expr DIVASSIGN assignment_expr */
+   -3,  /* (278) assignment_expr ::= unary_expr MODASSIGN assignment_expr */
+   -3,  /* (279) assignment_expr ::= unary_expr ADDASSIGN assignment_expr */
+   -3,  /* (280) assignment_expr ::= unary_expr SUBASSIGN assignment_expr */
+   -3,  /* (281) assignment_expr ::= unary_expr LSHIFTASSIGN assignment_expr */
+   -3,  /* (282) assignment_expr ::= unary_expr RSHIFTASSIGN assignment_expr */
+   -3,  /* (283) assignment_expr ::= unary_expr ANDASSIGN assignment_expr */
+   -3,  /* (284) assignment_expr ::= unary_expr XORASSIGN assignment_expr */
+   -3,  /* (285) assignment_expr ::= unary_expr ORASSIGN assignment_expr */
+   -1,  /* (286) expression ::= assignment_expr */
+   -3,  /* (287) expression ::= expression COMMA assignment_expr */
+};
+
+static void yy_accept(yyParser*);  /* Forward Declaration */
+
+/*
+** Perform a reduce action and the shift that must immediately
+** follow the reduce.
+**
+** The yyLookahead and yyLookaheadToken parameters provide reduce actions
+** access to the lookahead token (if any).  The yyLookahead will be YYNOCODE
+** if the lookahead token has already been consumed.  As this procedure is
+** only called from one place, optimizing compilers will in-line it, which
+** means that the extra parameters have no performance impact.
+*/
+static YYACTIONTYPE yy_reduce(
+  yyParser *yypParser,         /* The parser */
+  unsigned int yyruleno,       /* Number of the rule by which to reduce */
+  int yyLookahead,             /* Lookahead token, or YYNOCODE if none */
+  ParseHLSLTOKENTYPE yyLookaheadToken  /* Value of the lookahead token */
+  ParseHLSLCTX_PDECL                   /* %extra_context */
+){
+  int yygoto;                     /* The next state */
+  YYACTIONTYPE yyact;             /* The next action */
+  yyStackEntry *yymsp;            /* The top of the parser's stack */
+  int yysize;                     /* Amount to pop the stack */
+  ParseHLSLARG_FETCH
+  (void)yyLookahead;
+  (void)yyLookaheadToken;
+  yymsp = yypParser->yytos;
+
+  switch( yyruleno ){
+  /* Beginning here are the reduction cases.  A typical example
+  ** follows:
+  **   case 0:
+  **  #line <lineno> <grammarfile>
+  **     { ... }           // User supplied code
+  **  #line <lineno> <thisfile>
+  **     break;
+  */
+/********** Begin reduce actions **********************************************/
+        YYMINORTYPE yylhsminor;
+      case 0: /* shader ::= compilation_units */
+#line 83 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ assert(ctx->ast == NULL); REVERSE_LINKED_LIST(MOJOSHADER_astCompilationUnit, yymsp[0].minor.yy321); ctx->ast = (MOJOSHADER_astNode *) yymsp[0].minor.yy321; }
+#line 3384 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 1: /* compilation_units ::= compilation_unit */
+#line 86 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy321 = yymsp[0].minor.yy321; }
+#line 3389 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy321 = yylhsminor.yy321;
+        break;
+      case 2: /* compilation_units ::= compilation_units compilation_unit */
+#line 87 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ if (yymsp[0].minor.yy321) { yymsp[0].minor.yy321->next = yymsp[-1].minor.yy321; yylhsminor.yy321 = yymsp[0].minor.yy321; } }
+#line 3395 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy321 = yylhsminor.yy321;
+        break;
+      case 3: /* compilation_unit ::= variable_declaration */
+#line 91 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy321 = new_global_variable(ctx, yymsp[0].minor.yy114); }
+#line 3401 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy321 = yylhsminor.yy321;
+        break;
+      case 4: /* compilation_unit ::= function_signature SEMICOLON */
+#line 92 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy321 = new_function(ctx, yymsp[-1].minor.yy82, NULL); }
+#line 3407 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy321 = yylhsminor.yy321;
+        break;
+      case 5: /* compilation_unit ::= function_signature statement_block */
+#line 93 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy321 = new_function(ctx, yymsp[-1].minor.yy82, yymsp[0].minor.yy307); }
+#line 3413 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy321 = yylhsminor.yy321;
+        break;
+      case 6: /* compilation_unit ::= typedef */
+#line 94 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy321 = new_global_typedef(ctx, yymsp[0].minor.yy23); }
+#line 3419 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy321 = yylhsminor.yy321;
+        break;
+      case 7: /* compilation_unit ::= struct_declaration SEMICOLON */
+#line 95 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy321 = new_global_struct(ctx, yymsp[-1].minor.yy265); }
+#line 3425 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy321 = yylhsminor.yy321;
+        break;
+      case 8: /* typedef ::= TYPEDEF CONST datatype scalar_or_array */
+#line 100 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy23 = new_typedef(ctx, 1, yymsp[-1].minor.yy189, yymsp[0].minor.yy392); push_usertype(ctx, yymsp[0].minor.yy392->identifier, yymsp[-3].minor.yy23->datatype); }
+#line 3431 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 9: /* typedef ::= TYPEDEF datatype scalar_or_array */
+#line 101 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-2].minor.yy23 = new_typedef(ctx, 0, yymsp[-1].minor.yy189, yymsp[0].minor.yy392); push_usertype(ctx, yymsp[0].minor.yy392->identifier, yymsp[-2].minor.yy23->datatype); }
+#line 3436 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 10: /* function_signature ::= function_storageclass function_details semantic */
+#line 104 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy82 = yymsp[-1].minor.yy82; yylhsminor.yy82->storage_class = yymsp[-2].minor.yy285; yylhsminor.yy82->semantic = yymsp[0].minor.yy364; }
+#line 3441 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy82 = yylhsminor.yy82;
+        break;
+      case 11: /* function_signature ::= function_storageclass function_details */
+#line 105 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy82 = yymsp[0].minor.yy82; yylhsminor.yy82->storage_class = yymsp[-1].minor.yy285; }
+#line 3447 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy82 = yylhsminor.yy82;
+        break;
+      case 12: /* function_signature ::= function_details semantic */
+#line 106 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy82 = yymsp[-1].minor.yy82; yylhsminor.yy82->semantic = yymsp[0].minor.yy364; }
+#line 3453 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy82 = yylhsminor.yy82;
+        break;
+      case 13: /* function_signature ::= function_details */
+#line 107 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy82 = yymsp[0].minor.yy82; }
+#line 3459 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy82 = yylhsminor.yy82;
+        break;
+      case 14: /* function_details ::= datatype IDENTIFIER LPAREN function_parameters RPAREN */
+#line 110 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy82 = new_function_signature(ctx, yymsp[-4].minor.yy189, yymsp[-3].minor.yy0.string, yymsp[-1].minor.yy344); }
+#line 3465 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-4].minor.yy82 = yylhsminor.yy82;
+        break;
+      case 15: /* function_details ::= VOID IDENTIFIER LPAREN function_parameters RPAREN */
+#line 111 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-4].minor.yy82 = new_function_signature(ctx, NULL, yymsp[-3].minor.yy0.string, yymsp[-1].minor.yy344); }
+#line 3471 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 16: /* function_storageclass ::= INLINE */
+#line 121 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy285 = MOJOSHADER_AST_FNSTORECLS_INLINE; }
+#line 3476 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 17: /* function_parameters ::= VOID */
+#line 124 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy344 = NULL; }
+#line 3481 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 18: /* function_parameters ::= function_parameter_list */
+#line 125 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astFunctionParameters, yymsp[0].minor.yy344); yylhsminor.yy344 = yymsp[0].minor.yy344; }
+#line 3486 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 19: /* function_parameters ::= */
+#line 126 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[1].minor.yy344 = NULL; }
+#line 3492 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 20: /* function_parameter_list ::= function_parameter */
+#line 129 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = yymsp[0].minor.yy344; }
+#line 3497 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 21: /* function_parameter_list ::= function_parameter_list COMMA function_parameter */
+#line 130 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy344->next = yymsp[-2].minor.yy344; yylhsminor.yy344 = yymsp[0].minor.yy344; }
+#line 3503 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 22: /* function_parameter ::= input_modifier datatype IDENTIFIER semantic interpolation_mod initializer */
+#line 135 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, yymsp[-5].minor.yy51, yymsp[-4].minor.yy189, yymsp[-3].minor.yy0.string, yymsp[-2].minor.yy364, yymsp[-1].minor.yy343, yymsp[0].minor.yy206); }
+#line 3509 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-5].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 23: /* function_parameter ::= input_modifier datatype IDENTIFIER semantic interpolation_mod */
+#line 136 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, yymsp[-4].minor.yy51, yymsp[-3].minor.yy189, yymsp[-2].minor.yy0.string, yymsp[-1].minor.yy364, yymsp[0].minor.yy343, NULL); }
+#line 3515 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-4].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 24: /* function_parameter ::= input_modifier datatype IDENTIFIER semantic initializer */
+#line 137 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, yymsp[-4].minor.yy51, yymsp[-3].minor.yy189, yymsp[-2].minor.yy0.string, yymsp[-1].minor.yy364, MOJOSHADER_AST_INTERPMOD_NONE, yymsp[0].minor.yy206); }
+#line 3521 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-4].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 25: /* function_parameter ::= input_modifier datatype IDENTIFIER semantic */
+#line 138 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, yymsp[-3].minor.yy51, yymsp[-2].minor.yy189, yymsp[-1].minor.yy0.string, yymsp[0].minor.yy364, MOJOSHADER_AST_INTERPMOD_NONE, NULL); }
+#line 3527 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 26: /* function_parameter ::= input_modifier datatype IDENTIFIER interpolation_mod initializer */
+#line 139 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, yymsp[-4].minor.yy51, yymsp[-3].minor.yy189, yymsp[-2].minor.yy0.string, NULL, yymsp[-1].minor.yy343, yymsp[0].minor.yy206); }
+#line 3533 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-4].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 27: /* function_parameter ::= input_modifier datatype IDENTIFIER interpolation_mod */
+#line 140 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, yymsp[-3].minor.yy51, yymsp[-2].minor.yy189, yymsp[-1].minor.yy0.string, NULL, yymsp[0].minor.yy343, NULL); }
+#line 3539 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 28: /* function_parameter ::= input_modifier datatype IDENTIFIER initializer */
+#line 141 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, yymsp[-3].minor.yy51, yymsp[-2].minor.yy189, yymsp[-1].minor.yy0.string, NULL, MOJOSHADER_AST_INTERPMOD_NONE, yymsp[0].minor.yy206); }
+#line 3545 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 29: /* function_parameter ::= input_modifier datatype IDENTIFIER */
+#line 142 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, yymsp[-2].minor.yy51, yymsp[-1].minor.yy189, yymsp[0].minor.yy0.string, NULL, MOJOSHADER_AST_INTERPMOD_NONE, NULL); }
+#line 3551 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 30: /* function_parameter ::= datatype IDENTIFIER semantic interpolation_mod initializer */
+#line 143 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, MOJOSHADER_AST_INPUTMOD_NONE, yymsp[-4].minor.yy189, yymsp[-3].minor.yy0.string, yymsp[-2].minor.yy364, yymsp[-1].minor.yy343, yymsp[0].minor.yy206); }
+#line 3557 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-4].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 31: /* function_parameter ::= datatype IDENTIFIER semantic interpolation_mod */
+#line 144 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, MOJOSHADER_AST_INPUTMOD_NONE, yymsp[-3].minor.yy189, yymsp[-2].minor.yy0.string, yymsp[-1].minor.yy364, yymsp[0].minor.yy343, NULL); }
+#line 3563 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 32: /* function_parameter ::= datatype IDENTIFIER semantic initializer */
+#line 145 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, MOJOSHADER_AST_INPUTMOD_NONE, yymsp[-3].minor.yy189, yymsp[-2].minor.yy0.string, yymsp[-1].minor.yy364, MOJOSHADER_AST_INTERPMOD_NONE, yymsp[0].minor.yy206); }
+#line 3569 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 33: /* function_parameter ::= datatype IDENTIFIER semantic */
+#line 146 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, MOJOSHADER_AST_INPUTMOD_NONE, yymsp[-2].minor.yy189, yymsp[-1].minor.yy0.string, yymsp[0].minor.yy364, MOJOSHADER_AST_INTERPMOD_NONE, NULL); }
+#line 3575 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 34: /* function_parameter ::= datatype IDENTIFIER interpolation_mod initializer */
+#line 147 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, MOJOSHADER_AST_INPUTMOD_NONE, yymsp[-3].minor.yy189, yymsp[-2].minor.yy0.string, NULL, yymsp[-1].minor.yy343, yymsp[0].minor.yy206); }
+#line 3581 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 35: /* function_parameter ::= datatype IDENTIFIER interpolation_mod */
+#line 148 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, MOJOSHADER_AST_INPUTMOD_NONE, yymsp[-2].minor.yy189, yymsp[-1].minor.yy0.string, NULL, yymsp[0].minor.yy343, NULL); }
+#line 3587 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 36: /* function_parameter ::= datatype IDENTIFIER initializer */
+#line 149 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, MOJOSHADER_AST_INPUTMOD_NONE, yymsp[-2].minor.yy189, yymsp[-1].minor.yy0.string, NULL, MOJOSHADER_AST_INTERPMOD_NONE, yymsp[0].minor.yy206); }
+#line 3593 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 37: /* function_parameter ::= datatype IDENTIFIER */
+#line 150 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy344 = new_function_param(ctx, MOJOSHADER_AST_INPUTMOD_NONE, yymsp[-1].minor.yy189, yymsp[0].minor.yy0.string, NULL, MOJOSHADER_AST_INTERPMOD_NONE, NULL); }
+#line 3599 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy344 = yylhsminor.yy344;
+        break;
+      case 38: /* input_modifier ::= IN */
+#line 153 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy51 = MOJOSHADER_AST_INPUTMOD_IN; }
+#line 3605 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 39: /* input_modifier ::= INOUT */
+#line 154 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy51 = MOJOSHADER_AST_INPUTMOD_INOUT; }
+#line 3610 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 40: /* input_modifier ::= OUT */
+#line 155 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy51 = MOJOSHADER_AST_INPUTMOD_OUT; }
+#line 3615 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 41: /* input_modifier ::= IN OUT */
+      case 42: /* input_modifier ::= OUT IN */ yytestcase(yyruleno==42);
+#line 156 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy51 = MOJOSHADER_AST_INPUTMOD_INOUT; }
+#line 3621 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 43: /* input_modifier ::= UNIFORM */
+#line 158 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy51 = MOJOSHADER_AST_INPUTMOD_UNIFORM; }
+#line 3626 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 44: /* semantic ::= COLON IDENTIFIER */
+#line 161 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy364 = yymsp[0].minor.yy0.string; }
+#line 3631 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 45: /* interpolation_mod ::= LINEAR */
+#line 165 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy343 = MOJOSHADER_AST_INTERPMOD_LINEAR; }
+#line 3636 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 46: /* interpolation_mod ::= CENTROID */
+#line 166 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy343 = MOJOSHADER_AST_INTERPMOD_CENTROID; }
+#line 3641 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 47: /* interpolation_mod ::= NOINTERPOLATION */
+#line 167 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy343 = MOJOSHADER_AST_INTERPMOD_NOINTERPOLATION; }
+#line 3646 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 48: /* interpolation_mod ::= NOPERSPECTIVE */
+#line 168 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy343 = MOJOSHADER_AST_INTERPMOD_NOPERSPECTIVE; }
+#line 3651 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 49: /* interpolation_mod ::= SAMPLE */
+#line 169 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy343 = MOJOSHADER_AST_INTERPMOD_SAMPLE; }
+#line 3656 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 50: /* variable_declaration ::= variable_attribute_list datatype variable_declaration_details_list SEMICOLON */
+#line 172 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astVariableDeclaration, yymsp[-1].minor.yy114); yylhsminor.yy114 = yymsp[-1].minor.yy114; yylhsminor.yy114->attributes = yymsp[-3].minor.yy228; yylhsminor.yy114->datatype = yymsp[-2].minor.yy189; }
+#line 3661 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 51: /* variable_declaration ::= datatype variable_declaration_details_list SEMICOLON */
+#line 173 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astVariableDeclaration, yymsp[-1].minor.yy114); yylhsminor.yy114 = yymsp[-1].minor.yy114; yylhsminor.yy114->datatype = yymsp[-2].minor.yy189; }
+#line 3667 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 52: /* variable_declaration ::= struct_declaration variable_declaration_details_list SEMICOLON */
+#line 175 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astVariableDeclaration, yymsp[-1].minor.yy114); yylhsminor.yy114 = yymsp[-1].minor.yy114; yylhsminor.yy114->anonymous_datatype = yymsp[-2].minor.yy265; }
+#line 3673 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 53: /* variable_attribute_list ::= variable_attribute */
+#line 178 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy228 = yymsp[0].minor.yy228; }
+#line 3679 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy228 = yylhsminor.yy228;
+        break;
+      case 54: /* variable_attribute_list ::= variable_attribute_list variable_attribute */
+#line 179 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy228 = yymsp[-1].minor.yy228 | yymsp[0].minor.yy228; }
+#line 3685 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy228 = yylhsminor.yy228;
+        break;
+      case 55: /* variable_attribute ::= EXTERN */
+#line 182 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_VARATTR_EXTERN; }
+#line 3691 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 56: /* variable_attribute ::= NOINTERPOLATION */
+#line 183 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_VARATTR_NOINTERPOLATION; }
+#line 3696 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 57: /* variable_attribute ::= SHARED */
+#line 184 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_VARATTR_SHARED; }
+#line 3701 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 58: /* variable_attribute ::= STATIC */
+#line 185 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_VARATTR_STATIC; }
+#line 3706 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 59: /* variable_attribute ::= UNIFORM */
+#line 186 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_VARATTR_UNIFORM; }
+#line 3711 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 60: /* variable_attribute ::= VOLATILE */
+#line 187 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_VARATTR_VOLATILE; }
+#line 3716 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 61: /* variable_attribute ::= CONST */
+#line 188 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_VARATTR_CONST; }
+#line 3721 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 62: /* variable_attribute ::= ROWMAJOR */
+#line 189 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_VARATTR_ROWMAJOR; }
+#line 3726 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 63: /* variable_attribute ::= COLUMNMAJOR */
+#line 190 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_VARATTR_COLUMNMAJOR; }
+#line 3731 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 64: /* variable_declaration_details_list ::= variable_declaration_details */
+#line 193 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = yymsp[0].minor.yy114; }
+#line 3736 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 65: /* variable_declaration_details_list ::= variable_declaration_details_list COMMA variable_declaration_details */
+#line 194 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = yymsp[0].minor.yy114; yylhsminor.yy114->next = yymsp[-2].minor.yy114; }
+#line 3742 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 66: /* variable_declaration_details ::= scalar_or_array semantic annotations initializer variable_lowlevel */
+#line 197 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-4].minor.yy392, yymsp[-3].minor.yy364, yymsp[-2].minor.yy260, yymsp[-1].minor.yy206, yymsp[0].minor.yy110); }
+#line 3748 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-4].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 67: /* variable_declaration_details ::= scalar_or_array semantic annotations initializer */
+#line 198 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-3].minor.yy392, yymsp[-2].minor.yy364, yymsp[-1].minor.yy260, yymsp[0].minor.yy206, NULL); }
+#line 3754 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 68: /* variable_declaration_details ::= scalar_or_array semantic annotations variable_lowlevel */
+#line 199 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-3].minor.yy392, yymsp[-2].minor.yy364, yymsp[-1].minor.yy260, NULL, yymsp[0].minor.yy110); }
+#line 3760 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 69: /* variable_declaration_details ::= scalar_or_array semantic annotations */
+#line 200 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-2].minor.yy392, yymsp[-1].minor.yy364, yymsp[0].minor.yy260, NULL, NULL); }
+#line 3766 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 70: /* variable_declaration_details ::= scalar_or_array semantic initializer variable_lowlevel */
+#line 201 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-3].minor.yy392, yymsp[-2].minor.yy364, NULL, yymsp[-1].minor.yy206, yymsp[0].minor.yy110); }
+#line 3772 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 71: /* variable_declaration_details ::= scalar_or_array semantic initializer */
+#line 202 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-2].minor.yy392, yymsp[-1].minor.yy364, NULL, yymsp[0].minor.yy206, NULL); }
+#line 3778 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 72: /* variable_declaration_details ::= scalar_or_array semantic variable_lowlevel */
+#line 203 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-2].minor.yy392, yymsp[-1].minor.yy364, NULL, NULL, yymsp[0].minor.yy110); }
+#line 3784 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 73: /* variable_declaration_details ::= scalar_or_array semantic */
+#line 204 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-1].minor.yy392, yymsp[0].minor.yy364, NULL, NULL, NULL); }
+#line 3790 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 74: /* variable_declaration_details ::= scalar_or_array annotations initializer variable_lowlevel */
+#line 205 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-3].minor.yy392, NULL, yymsp[-2].minor.yy260, yymsp[-1].minor.yy206, yymsp[0].minor.yy110); }
+#line 3796 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 75: /* variable_declaration_details ::= scalar_or_array annotations initializer */
+#line 206 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-2].minor.yy392, NULL, yymsp[-1].minor.yy260, yymsp[0].minor.yy206, NULL); }
+#line 3802 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 76: /* variable_declaration_details ::= scalar_or_array annotations variable_lowlevel */
+#line 207 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-2].minor.yy392, NULL, yymsp[-1].minor.yy260, NULL, yymsp[0].minor.yy110); }
+#line 3808 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 77: /* variable_declaration_details ::= scalar_or_array annotations */
+#line 208 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-1].minor.yy392, NULL, yymsp[0].minor.yy260, NULL, NULL); }
+#line 3814 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 78: /* variable_declaration_details ::= scalar_or_array initializer variable_lowlevel */
+#line 209 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-2].minor.yy392, NULL, NULL, yymsp[-1].minor.yy206, yymsp[0].minor.yy110); }
+#line 3820 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 79: /* variable_declaration_details ::= scalar_or_array initializer */
+#line 210 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-1].minor.yy392, NULL, NULL, yymsp[0].minor.yy206, NULL); }
+#line 3826 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 80: /* variable_declaration_details ::= scalar_or_array variable_lowlevel */
+#line 211 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[-1].minor.yy392, NULL, NULL, NULL, yymsp[0].minor.yy110); }
+#line 3832 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 81: /* variable_declaration_details ::= scalar_or_array */
+#line 212 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy114 = new_variable_declaration(ctx, yymsp[0].minor.yy392, NULL, NULL, NULL, NULL); }
+#line 3838 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy114 = yylhsminor.yy114;
+        break;
+      case 82: /* struct_declaration ::= struct_intro LBRACE struct_member_list RBRACE */
+#line 218 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astStructMembers, yymsp[-1].minor.yy74); yylhsminor.yy265 = new_struct_declaration(ctx, yymsp[-3].minor.yy364, yymsp[-1].minor.yy74); }
+#line 3844 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy265 = yylhsminor.yy265;
+        break;
+      case 83: /* struct_intro ::= STRUCT IDENTIFIER */
+#line 222 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy364 = yymsp[0].minor.yy0.string; push_usertype(ctx, yymsp[-1].minor.yy364, &builtins.dt_none); }
+#line 3850 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 84: /* struct_member_list ::= struct_member */
+      case 87: /* struct_member ::= struct_member_details */ yytestcase(yyruleno==87);
+#line 225 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy74 = yymsp[0].minor.yy74; }
+#line 3856 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy74 = yylhsminor.yy74;
+        break;
+      case 85: /* struct_member_list ::= struct_member_list struct_member */
+#line 226 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy74 = yymsp[0].minor.yy74; MOJOSHADER_astStructMembers *i = yylhsminor.yy74; while (i->next) { i = i->next; } i->next = yymsp[-1].minor.yy74; }
+#line 3862 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy74 = yylhsminor.yy74;
+        break;
+      case 86: /* struct_member ::= interpolation_mod struct_member_details */
+#line 229 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ MOJOSHADER_astStructMembers *i = yymsp[0].minor.yy74; yylhsminor.yy74 = yymsp[0].minor.yy74; while (i) { i->interpolation_mod = yymsp[-1].minor.yy343; i = i->next; } }
+#line 3868 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy74 = yylhsminor.yy74;
+        break;
+      case 88: /* struct_member_details ::= datatype struct_member_item_list SEMICOLON */
+#line 233 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ MOJOSHADER_astStructMembers *i = yymsp[-1].minor.yy74; yylhsminor.yy74 = yymsp[-1].minor.yy74; while (i) { i->datatype = yymsp[-2].minor.yy189; i = i->next; } }
+#line 3874 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy74 = yylhsminor.yy74;
+        break;
+      case 89: /* struct_member_item_list ::= scalar_or_array */
+#line 236 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy74 = new_struct_member(ctx, yymsp[0].minor.yy392, NULL); }
+#line 3880 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy74 = yylhsminor.yy74;
+        break;
+      case 90: /* struct_member_item_list ::= scalar_or_array semantic */
+#line 237 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy74 = new_struct_member(ctx, yymsp[-1].minor.yy392, yymsp[0].minor.yy364); }
+#line 3886 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy74 = yylhsminor.yy74;
+        break;
+      case 91: /* struct_member_item_list ::= struct_member_item_list COMMA IDENTIFIER */
+#line 238 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy74 = new_struct_member(ctx, new_scalar_or_array(ctx, yymsp[0].minor.yy0.string, 0, NULL), NULL); yylhsminor.yy74->next = yymsp[-2].minor.yy74; yylhsminor.yy74->semantic = yymsp[-2].minor.yy74->semantic; }
+#line 3892 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy74 = yylhsminor.yy74;
+        break;
+      case 92: /* variable_lowlevel ::= packoffset register */
+#line 241 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy110 = new_variable_lowlevel(ctx, yymsp[-1].minor.yy8, yymsp[0].minor.yy364); }
+#line 3898 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy110 = yylhsminor.yy110;
+        break;
+      case 93: /* variable_lowlevel ::= register packoffset */
+#line 242 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy110 = new_variable_lowlevel(ctx, yymsp[0].minor.yy8, yymsp[-1].minor.yy364); }
+#line 3904 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy110 = yylhsminor.yy110;
+        break;
+      case 94: /* variable_lowlevel ::= packoffset */
+#line 243 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy110 = new_variable_lowlevel(ctx, yymsp[0].minor.yy8, NULL); }
+#line 3910 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy110 = yylhsminor.yy110;
+        break;
+      case 95: /* variable_lowlevel ::= register */
+#line 244 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy110 = new_variable_lowlevel(ctx, NULL, yymsp[0].minor.yy364); }
+#line 3916 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy110 = yylhsminor.yy110;
+        break;
+      case 96: /* scalar_or_array ::= IDENTIFIER LBRACKET RBRACKET */
+#line 248 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy392 = new_scalar_or_array(ctx, yymsp[-2].minor.yy0.string, 1, NULL); }
+#line 3922 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy392 = yylhsminor.yy392;
+        break;
+      case 97: /* scalar_or_array ::= IDENTIFIER LBRACKET expression RBRACKET */
+#line 249 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy392 = new_scalar_or_array(ctx, yymsp[-3].minor.yy0.string, 1, yymsp[-1].minor.yy206); }
+#line 3928 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy392 = yylhsminor.yy392;
+        break;
+      case 98: /* scalar_or_array ::= IDENTIFIER */
+#line 250 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy392 = new_scalar_or_array(ctx, yymsp[0].minor.yy0.string, 0, NULL); }
+#line 3934 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy392 = yylhsminor.yy392;
+        break;
+      case 99: /* packoffset ::= COLON PACKOFFSET LPAREN IDENTIFIER DOT IDENTIFIER RPAREN */
+#line 253 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-6].minor.yy8 = new_pack_offset(ctx, yymsp[-3].minor.yy0.string, yymsp[-1].minor.yy0.string); }
+#line 3940 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 100: /* packoffset ::= COLON PACKOFFSET LPAREN IDENTIFIER RPAREN */
+#line 254 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-4].minor.yy8 = new_pack_offset(ctx, yymsp[-1].minor.yy0.string, NULL); }
+#line 3945 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 101: /* register ::= COLON REGISTER LPAREN IDENTIFIER RPAREN */
+#line 260 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-4].minor.yy364 = yymsp[-1].minor.yy0.string; }
+#line 3950 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 102: /* annotations ::= LT annotation_list GT */
+#line 263 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astAnnotations, yymsp[-1].minor.yy260); yymsp[-2].minor.yy260 = yymsp[-1].minor.yy260; }
+#line 3955 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 103: /* annotation_list ::= annotation */
+#line 266 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy260 = yymsp[0].minor.yy260; }
+#line 3960 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy260 = yylhsminor.yy260;
+        break;
+      case 104: /* annotation_list ::= annotation_list annotation */
+#line 267 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy260 = yymsp[0].minor.yy260; yylhsminor.yy260->next = yymsp[-1].minor.yy260; }
+#line 3966 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy260 = yylhsminor.yy260;
+        break;
+      case 105: /* annotation ::= datatype_scalar initializer SEMICOLON */
+#line 271 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy260 = new_annotation(ctx, yymsp[-2].minor.yy189, yymsp[-1].minor.yy206); }
+#line 3972 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy260 = yylhsminor.yy260;
+        break;
+      case 106: /* initializer_block_list ::= expression */
+      case 224: /* postfix_expr ::= primary_expr */ yytestcase(yyruleno==224);
+      case 235: /* unary_expr ::= postfix_expr */ yytestcase(yyruleno==235);
+      case 242: /* cast_expr ::= unary_expr */ yytestcase(yyruleno==242);
+      case 244: /* multiplicative_expr ::= cast_expr */ yytestcase(yyruleno==244);
+      case 248: /* additive_expr ::= multiplicative_expr */ yytestcase(yyruleno==248);
+      case 251: /* shift_expr ::= additive_expr */ yytestcase(yyruleno==251);
+      case 254: /* relational_expr ::= shift_expr */ yytestcase(yyruleno==254);
+      case 259: /* equality_expr ::= relational_expr */ yytestcase(yyruleno==259);
+      case 262: /* and_expr ::= equality_expr */ yytestcase(yyruleno==262);
+      case 264: /* exclusive_or_expr ::= and_expr */ yytestcase(yyruleno==264);
+      case 266: /* inclusive_or_expr ::= exclusive_or_expr */ yytestcase(yyruleno==266);
+      case 268: /* logical_and_expr ::= inclusive_or_expr */ yytestcase(yyruleno==268);
+      case 270: /* logical_or_expr ::= logical_and_expr */ yytestcase(yyruleno==270);
+      case 272: /* conditional_expr ::= logical_or_expr */ yytestcase(yyruleno==272);
+      case 274: /* assignment_expr ::= conditional_expr */ yytestcase(yyruleno==274);
+      case 286: /* expression ::= assignment_expr */ yytestcase(yyruleno==286);
+#line 274 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = yymsp[0].minor.yy206; }
+#line 3994 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 107: /* initializer_block_list ::= LBRACE initializer_block_list RBRACE */
+      case 109: /* initializer_block ::= LBRACE initializer_block_list RBRACE */ yytestcase(yyruleno==109);
+      case 223: /* primary_expr ::= LPAREN expression RPAREN */ yytestcase(yyruleno==223);
+#line 275 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-2].minor.yy206 = yymsp[-1].minor.yy206; }
+#line 4002 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 108: /* initializer_block_list ::= initializer_block_list COMMA initializer_block_list */
+      case 287: /* expression ::= expression COMMA assignment_expr */ yytestcase(yyruleno==287);
+#line 276 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_COMMA, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4008 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 110: /* initializer ::= ASSIGN initializer_block */
+      case 111: /* initializer ::= ASSIGN expression */ yytestcase(yyruleno==111);
+      case 238: /* unary_expr ::= PLUS cast_expr */ yytestcase(yyruleno==238);
+#line 282 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy206 = yymsp[0].minor.yy206; }
+#line 4016 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 112: /* intrinsic_datatype ::= datatype_vector */
+      case 113: /* intrinsic_datatype ::= datatype_matrix */ yytestcase(yyruleno==113);
+      case 114: /* intrinsic_datatype ::= datatype_scalar */ yytestcase(yyruleno==114);
+      case 115: /* intrinsic_datatype ::= datatype_sampler */ yytestcase(yyruleno==115);
+      case 116: /* intrinsic_datatype ::= datatype_buffer */ yytestcase(yyruleno==116);
+      case 117: /* datatype ::= intrinsic_datatype */ yytestcase(yyruleno==117);
+#line 286 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy189 = yymsp[0].minor.yy189; }
+#line 4026 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy189 = yylhsminor.yy189;
+        break;
+      case 118: /* datatype ::= USERTYPE */
+#line 294 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy189 = yymsp[0].minor.yy0.datatype; }
+#line 4032 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy189 = yylhsminor.yy189;
+        break;
+      case 119: /* datatype_sampler ::= SAMPLER */
+      case 121: /* datatype_sampler ::= SAMPLER2D */ yytestcase(yyruleno==121);
+#line 297 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_sampler2d; }
+#line 4039 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 120: /* datatype_sampler ::= SAMPLER1D */
+#line 298 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_sampler1d; }
+#line 4044 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 122: /* datatype_sampler ::= SAMPLER3D */
+#line 300 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_sampler3d; }
+#line 4049 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 123: /* datatype_sampler ::= SAMPLERCUBE */
+#line 301 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_samplercube; }
+#line 4054 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 124: /* datatype_sampler ::= SAMPLER_STATE */
+      case 125: /* datatype_sampler ::= SAMPLERSTATE */ yytestcase(yyruleno==125);
+#line 302 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_samplerstate; }
+#line 4060 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 126: /* datatype_sampler ::= SAMPLERCOMPARISONSTATE */
+#line 304 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_samplercompstate; }
+#line 4065 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 127: /* datatype_scalar ::= BOOL */
+#line 307 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_bool; }
+#line 4070 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 128: /* datatype_scalar ::= INT */
+#line 308 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_int; }
+#line 4075 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 129: /* datatype_scalar ::= UINT */
+#line 309 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_uint; }
+#line 4080 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 130: /* datatype_scalar ::= HALF */
+#line 310 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_half; }
+#line 4085 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 131: /* datatype_scalar ::= FLOAT */
+#line 311 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_float; }
+#line 4090 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 132: /* datatype_scalar ::= DOUBLE */
+#line 312 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_double; }
+#line 4095 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 133: /* datatype_scalar ::= STRING */
+#line 313 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy189 = &builtins.dt_string; }
+#line 4100 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 134: /* datatype_scalar ::= SNORM FLOAT */
+#line 314 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy189 = &builtins.dt_float_snorm; }
+#line 4105 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 135: /* datatype_scalar ::= UNORM FLOAT */
+#line 315 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy189 = &builtins.dt_float_unorm; }
+#line 4110 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 136: /* datatype_buffer ::= BUFFER LT BOOL GT */
+#line 318 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy189 = &builtins.dt_buf_bool; }
+#line 4115 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 137: /* datatype_buffer ::= BUFFER LT INT GT */
+#line 319 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy189 = &builtins.dt_buf_int; }
+#line 4120 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 138: /* datatype_buffer ::= BUFFER LT UINT GT */
+#line 320 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy189 = &builtins.dt_buf_uint; }
+#line 4125 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 139: /* datatype_buffer ::= BUFFER LT HALF GT */
+#line 321 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy189 = &builtins.dt_buf_half; }
+#line 4130 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 140: /* datatype_buffer ::= BUFFER LT FLOAT GT */
+#line 322 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy189 = &builtins.dt_buf_float; }
+#line 4135 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 141: /* datatype_buffer ::= BUFFER LT DOUBLE GT */
+#line 323 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy189 = &builtins.dt_buf_double; }
+#line 4140 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 142: /* datatype_buffer ::= BUFFER LT SNORM FLOAT GT */
+#line 324 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-4].minor.yy189 = &builtins.dt_buf_float_snorm; }
+#line 4145 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 143: /* datatype_buffer ::= BUFFER LT UNORM FLOAT GT */
+#line 325 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-4].minor.yy189 = &builtins.dt_buf_float_unorm; }
+#line 4150 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 144: /* datatype_vector ::= VECTOR LT datatype_scalar COMMA INT_CONSTANT GT */
+#line 328 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-5].minor.yy189 = new_datatype_vector(ctx, yymsp[-3].minor.yy189, (int) yymsp[-1].minor.yy0.i64); }
+#line 4155 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 145: /* datatype_matrix ::= MATRIX LT datatype_scalar COMMA INT_CONSTANT COMMA INT_CONSTANT GT */
+#line 331 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-7].minor.yy189 = new_datatype_matrix(ctx, yymsp[-5].minor.yy189, (int) yymsp[-3].minor.yy0.i64, (int) yymsp[-1].minor.yy0.i64); }
+#line 4160 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 146: /* statement_block ::= LBRACE RBRACE */
+#line 334 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy307 = new_block_statement(ctx, NULL); }
+#line 4165 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 147: /* statement_block ::= LBRACE statement_list RBRACE */
+#line 335 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astStatement, yymsp[-1].minor.yy307); yymsp[-2].minor.yy307 = new_block_statement(ctx, yymsp[-1].minor.yy307); }
+#line 4170 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 148: /* statement_list ::= statement */
+      case 172: /* statement ::= statement_block */ yytestcase(yyruleno==172);
+      case 173: /* statement ::= for_statement */ yytestcase(yyruleno==173);
+#line 338 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = yymsp[0].minor.yy307; }
+#line 4177 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 149: /* statement_list ::= statement_list statement */
+#line 339 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = yymsp[0].minor.yy307; yylhsminor.yy307->next = yymsp[-1].minor.yy307; }
+#line 4183 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 150: /* statement_attribute ::= ISOLATE */
+      case 152: /* statement_attribute ::= NOEXPRESSIONOPTIMIZATIONS */ yytestcase(yyruleno==152);
+      case 153: /* statement_attribute ::= REMOVEUNUSEDINPUTS */ yytestcase(yyruleno==153);
+      case 154: /* statement_attribute ::= UNUSED */ yytestcase(yyruleno==154);
+      case 155: /* statement_attribute ::= XPS */ yytestcase(yyruleno==155);
+#line 345 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = 0; }
+#line 4193 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 151: /* statement_attribute ::= MAXINSTRUCTIONCOUNT LPAREN INT_CONSTANT RPAREN */
+      case 176: /* while_intro ::= LBRACKET LOOP RBRACKET WHILE */ yytestcase(yyruleno==176);
+      case 181: /* for_intro ::= LBRACKET LOOP RBRACKET FOR */ yytestcase(yyruleno==181);
+      case 197: /* do_intro ::= LBRACKET LOOP RBRACKET DO */ yytestcase(yyruleno==197);
+#line 346 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = 0; }
+#line 4201 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 156: /* statement ::= BREAK SEMICOLON */
+#line 353 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy307 = new_break_statement(ctx); }
+#line 4206 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 157: /* statement ::= CONTINUE SEMICOLON */
+#line 354 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy307 = new_continue_statement(ctx); }
+#line 4211 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 158: /* statement ::= DISCARD SEMICOLON */
+#line 355 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy307 = new_discard_statement(ctx); }
+#line 4216 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 159: /* statement ::= LBRACKET statement_attribute RBRACKET statement_block */
+#line 356 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy307 = yymsp[0].minor.yy307; /* !!! FIXME: yymsp[-3].minor.yy307->attributes = yymsp[-2].minor.yy228;*/ yymsp[-2].minor.yy228 = 0; }
+#line 4221 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 160: /* statement ::= variable_declaration */
+#line 357 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = new_vardecl_statement(ctx, yymsp[0].minor.yy114); }
+#line 4226 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 161: /* statement ::= struct_declaration SEMICOLON */
+#line 358 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = new_struct_statement(ctx, yymsp[-1].minor.yy265); }
+#line 4232 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 162: /* statement ::= do_intro DO statement WHILE LPAREN expression RPAREN SEMICOLON */
+#line 359 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = new_do_statement(ctx, yymsp[-7].minor.yy228, yymsp[-5].minor.yy307, yymsp[-2].minor.yy206); }
+#line 4238 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-7].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 163: /* statement ::= while_intro LPAREN expression RPAREN statement */
+#line 360 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = new_while_statement(ctx, yymsp[-4].minor.yy228, yymsp[-2].minor.yy206, yymsp[0].minor.yy307); }
+#line 4244 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-4].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 164: /* statement ::= if_intro LPAREN expression RPAREN statement */
+#line 361 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = new_if_statement(ctx, yymsp[-4].minor.yy228, yymsp[-2].minor.yy206, yymsp[0].minor.yy307, NULL); }
+#line 4250 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-4].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 165: /* statement ::= if_intro LPAREN expression RPAREN statement ELSE statement */
+#line 362 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = new_if_statement(ctx, yymsp[-6].minor.yy228, yymsp[-4].minor.yy206, yymsp[-2].minor.yy307, yymsp[0].minor.yy307); }
+#line 4256 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-6].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 166: /* statement ::= switch_intro LPAREN expression RPAREN LBRACE switch_case_list RBRACE */
+#line 363 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astSwitchCases, yymsp[-1].minor.yy247); yylhsminor.yy307 = new_switch_statement(ctx, yymsp[-6].minor.yy228, yymsp[-4].minor.yy206, yymsp[-1].minor.yy247); }
+#line 4262 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-6].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 167: /* statement ::= typedef */
+#line 364 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = new_typedef_statement(ctx, yymsp[0].minor.yy23); }
+#line 4268 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 168: /* statement ::= SEMICOLON */
+#line 365 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy307 = new_empty_statement(ctx); }
+#line 4274 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 169: /* statement ::= expression SEMICOLON */
+#line 366 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = new_expr_statement(ctx, yymsp[-1].minor.yy206); }
+#line 4279 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 170: /* statement ::= RETURN SEMICOLON */
+#line 367 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy307 = new_return_statement(ctx, NULL); }
+#line 4285 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 171: /* statement ::= RETURN expression SEMICOLON */
+#line 368 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-2].minor.yy307 = new_return_statement(ctx, yymsp[-1].minor.yy206); }
+#line 4290 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 174: /* while_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET WHILE */
+      case 179: /* for_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET FOR */ yytestcase(yyruleno==179);
+#line 374 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-6].minor.yy228 = (yymsp[-3].minor.yy0.i64 < 0) ? 0 : yymsp[-3].minor.yy0.i64; }
+#line 4296 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 175: /* while_intro ::= LBRACKET UNROLL RBRACKET WHILE */
+      case 180: /* for_intro ::= LBRACKET UNROLL RBRACKET FOR */ yytestcase(yyruleno==180);
+      case 196: /* do_intro ::= LBRACKET UNROLL RBRACKET DO */ yytestcase(yyruleno==196);
+#line 375 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = -1; }
+#line 4303 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 177: /* while_intro ::= WHILE */
+      case 182: /* for_intro ::= FOR */ yytestcase(yyruleno==182);
+      case 198: /* do_intro ::= DO */ yytestcase(yyruleno==198);
+#line 377 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = -2; }
+#line 4310 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 178: /* for_statement ::= for_intro for_details */
+#line 380 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy307 = yymsp[0].minor.yy307; ((MOJOSHADER_astForStatement *) yylhsminor.yy307)->unroll = yymsp[-1].minor.yy228; }
+#line 4315 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy307 = yylhsminor.yy307;
+        break;
+      case 183: /* for_details ::= LPAREN expression SEMICOLON expression SEMICOLON expression RPAREN statement */
+#line 389 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-7].minor.yy307 = new_for_statement(ctx, NULL, yymsp[-6].minor.yy206, yymsp[-4].minor.yy206, yymsp[-2].minor.yy206, yymsp[0].minor.yy307); }
+#line 4321 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 184: /* for_details ::= LPAREN SEMICOLON SEMICOLON RPAREN statement */
+#line 390 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-4].minor.yy307 = new_for_statement(ctx, NULL, NULL, NULL, NULL, yymsp[0].minor.yy307); }
+#line 4326 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 185: /* for_details ::= LPAREN SEMICOLON SEMICOLON expression RPAREN statement */
+#line 391 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-5].minor.yy307 = new_for_statement(ctx, NULL, NULL, NULL, yymsp[-2].minor.yy206, yymsp[0].minor.yy307); }
+#line 4331 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 186: /* for_details ::= LPAREN SEMICOLON expression SEMICOLON RPAREN statement */
+#line 392 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-5].minor.yy307 = new_for_statement(ctx, NULL, NULL, yymsp[-3].minor.yy206, NULL, yymsp[0].minor.yy307); }
+#line 4336 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 187: /* for_details ::= LPAREN SEMICOLON expression SEMICOLON expression RPAREN statement */
+#line 393 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-6].minor.yy307 = new_for_statement(ctx, NULL, NULL, yymsp[-4].minor.yy206, yymsp[-2].minor.yy206, yymsp[0].minor.yy307); }
+#line 4341 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 188: /* for_details ::= LPAREN expression SEMICOLON SEMICOLON RPAREN statement */
+#line 394 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-5].minor.yy307 = new_for_statement(ctx, NULL, yymsp[-4].minor.yy206, NULL, NULL, yymsp[0].minor.yy307); }
+#line 4346 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 189: /* for_details ::= LPAREN expression SEMICOLON SEMICOLON expression RPAREN statement */
+#line 395 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-6].minor.yy307 = new_for_statement(ctx, NULL, yymsp[-5].minor.yy206, NULL, yymsp[-2].minor.yy206, yymsp[0].minor.yy307); }
+#line 4351 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 190: /* for_details ::= LPAREN expression SEMICOLON expression SEMICOLON RPAREN statement */
+#line 396 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-6].minor.yy307 = new_for_statement(ctx, NULL, yymsp[-5].minor.yy206, yymsp[-3].minor.yy206, NULL, yymsp[0].minor.yy307); }
+#line 4356 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 191: /* for_details ::= LPAREN variable_declaration expression SEMICOLON expression RPAREN statement */
+#line 397 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-6].minor.yy307 = new_for_statement(ctx, yymsp[-5].minor.yy114, NULL, yymsp[-4].minor.yy206, yymsp[-2].minor.yy206, yymsp[0].minor.yy307); }
+#line 4361 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 192: /* for_details ::= LPAREN variable_declaration SEMICOLON RPAREN statement */
+#line 398 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-4].minor.yy307 = new_for_statement(ctx, yymsp[-3].minor.yy114, NULL, NULL, NULL, yymsp[0].minor.yy307); }
+#line 4366 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 193: /* for_details ::= LPAREN variable_declaration SEMICOLON expression RPAREN statement */
+#line 399 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-5].minor.yy307 = new_for_statement(ctx, yymsp[-4].minor.yy114, NULL, yymsp[-2].minor.yy206, NULL, yymsp[0].minor.yy307); }
+#line 4371 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 194: /* for_details ::= LPAREN variable_declaration expression SEMICOLON RPAREN statement */
+#line 400 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-5].minor.yy307 = new_for_statement(ctx, yymsp[-4].minor.yy114, NULL, yymsp[-3].minor.yy206, NULL, yymsp[0].minor.yy307); }
+#line 4376 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 195: /* do_intro ::= LBRACKET UNROLL LPAREN INT_CONSTANT RPAREN RBRACKET DO */
+#line 403 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-6].minor.yy228 = (yymsp[-3].minor.yy0.i64 < 0) ? 0 : (int) yymsp[-3].minor.yy0.i64; }
+#line 4381 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 199: /* if_intro ::= LBRACKET BRANCH RBRACKET IF */
+#line 409 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_IFATTR_BRANCH; }
+#line 4386 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 200: /* if_intro ::= LBRACKET FLATTEN RBRACKET IF */
+#line 410 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_IFATTR_FLATTEN; }
+#line 4391 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 201: /* if_intro ::= LBRACKET IFALL RBRACKET IF */
+#line 411 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_IFATTR_IFALL; }
+#line 4396 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 202: /* if_intro ::= LBRACKET IFANY RBRACKET IF */
+#line 412 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_IFATTR_IFANY; }
+#line 4401 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 203: /* if_intro ::= LBRACKET PREDICATE RBRACKET IF */
+#line 413 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_IFATTR_PREDICATE; }
+#line 4406 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 204: /* if_intro ::= LBRACKET PREDICATEBLOCK RBRACKET IF */
+#line 414 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_IFATTR_PREDICATEBLOCK; }
+#line 4411 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 205: /* if_intro ::= IF */
+#line 415 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_IFATTR_NONE; }
+#line 4416 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 206: /* switch_intro ::= LBRACKET FLATTEN RBRACKET SWITCH */
+#line 418 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_SWITCHATTR_FLATTEN; }
+#line 4421 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 207: /* switch_intro ::= LBRACKET BRANCH RBRACKET SWITCH */
+#line 419 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_SWITCHATTR_BRANCH; }
+#line 4426 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 208: /* switch_intro ::= LBRACKET FORCECASE RBRACKET SWITCH */
+#line 420 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_SWITCHATTR_FORCECASE; }
+#line 4431 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 209: /* switch_intro ::= LBRACKET CALL RBRACKET SWITCH */
+#line 421 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy228 = MOJOSHADER_AST_SWITCHATTR_CALL; }
+#line 4436 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 210: /* switch_intro ::= SWITCH */
+#line 422 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy228 = MOJOSHADER_AST_SWITCHATTR_NONE; }
+#line 4441 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 211: /* switch_case_list ::= switch_case */
+#line 425 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy247 = yymsp[0].minor.yy247; }
+#line 4446 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy247 = yylhsminor.yy247;
+        break;
+      case 212: /* switch_case_list ::= switch_case_list switch_case */
+#line 426 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy247 = yymsp[0].minor.yy247; yylhsminor.yy247->next = yymsp[-1].minor.yy247; }
+#line 4452 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy247 = yylhsminor.yy247;
+        break;
+      case 213: /* switch_case ::= CASE expression COLON statement_list */
+#line 431 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astStatement, yymsp[0].minor.yy307); yymsp[-3].minor.yy247 = new_switch_case(ctx, yymsp[-2].minor.yy206, yymsp[0].minor.yy307); }
+#line 4458 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 214: /* switch_case ::= CASE expression COLON */
+#line 432 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-2].minor.yy247 = new_switch_case(ctx, yymsp[-1].minor.yy206, NULL); }
+#line 4463 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 215: /* switch_case ::= DEFAULT COLON statement_list */
+#line 433 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astStatement, yymsp[0].minor.yy307); yymsp[-2].minor.yy247 = new_switch_case(ctx, NULL, yymsp[0].minor.yy307); }
+#line 4468 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 216: /* switch_case ::= DEFAULT COLON */
+#line 434 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy247 = new_switch_case(ctx, NULL, NULL); }
+#line 4473 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 217: /* primary_expr ::= IDENTIFIER */
+#line 438 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_identifier_expr(ctx, yymsp[0].minor.yy0.string); }
+#line 4478 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 218: /* primary_expr ::= INT_CONSTANT */
+#line 439 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_literal_int_expr(ctx, yymsp[0].minor.yy0.i64); }
+#line 4484 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 219: /* primary_expr ::= FLOAT_CONSTANT */
+#line 440 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_literal_float_expr(ctx, yymsp[0].minor.yy0.dbl); }
+#line 4490 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 220: /* primary_expr ::= STRING_LITERAL */
+#line 441 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_literal_string_expr(ctx, yymsp[0].minor.yy0.string); }
+#line 4496 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 221: /* primary_expr ::= TRUE */
+#line 442 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy206 = new_literal_boolean_expr(ctx, 1); }
+#line 4502 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 222: /* primary_expr ::= FALSE */
+#line 443 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[0].minor.yy206 = new_literal_boolean_expr(ctx, 0); }
+#line 4507 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 225: /* postfix_expr ::= postfix_expr LBRACKET expression RBRACKET */
+#line 448 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_DEREF_ARRAY, yymsp[-3].minor.yy206, yymsp[-1].minor.yy206); }
+#line 4512 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-3].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 226: /* postfix_expr ::= IDENTIFIER arguments */
+#line 449 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_callfunc_expr(ctx, yymsp[-1].minor.yy0.string, yymsp[0].minor.yy320); }
+#line 4518 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 227: /* postfix_expr ::= datatype arguments */
+#line 450 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_constructor_expr(ctx, yymsp[-1].minor.yy189, yymsp[0].minor.yy320); }
+#line 4524 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 228: /* postfix_expr ::= postfix_expr DOT IDENTIFIER */
+#line 451 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_deref_struct_expr(ctx, yymsp[-2].minor.yy206, yymsp[0].minor.yy0.string); }
+#line 4530 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 229: /* postfix_expr ::= postfix_expr PLUSPLUS */
+#line 452 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_unary_expr(ctx, MOJOSHADER_AST_OP_POSTINCREMENT, yymsp[-1].minor.yy206); }
+#line 4536 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 230: /* postfix_expr ::= postfix_expr MINUSMINUS */
+#line 453 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_unary_expr(ctx, MOJOSHADER_AST_OP_POSTDECREMENT, yymsp[-1].minor.yy206); }
+#line 4542 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-1].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 231: /* arguments ::= LPAREN RPAREN */
+#line 456 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy320 = NULL; }
+#line 4548 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 232: /* arguments ::= LPAREN argument_list RPAREN */
+#line 457 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ REVERSE_LINKED_LIST(MOJOSHADER_astArguments, yymsp[-1].minor.yy320); yymsp[-2].minor.yy320 = yymsp[-1].minor.yy320; }
+#line 4553 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 233: /* argument_list ::= assignment_expr */
+#line 460 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy320 = new_argument(ctx, yymsp[0].minor.yy206); }
+#line 4558 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[0].minor.yy320 = yylhsminor.yy320;
+        break;
+      case 234: /* argument_list ::= argument_list COMMA assignment_expr */
+#line 461 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy320 = new_argument(ctx, yymsp[0].minor.yy206); yylhsminor.yy320->next = yymsp[-2].minor.yy320; }
+#line 4564 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy320 = yylhsminor.yy320;
+        break;
+      case 236: /* unary_expr ::= PLUSPLUS unary_expr */
+#line 465 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy206 = new_unary_expr(ctx, MOJOSHADER_AST_OP_PREINCREMENT, yymsp[0].minor.yy206); }
+#line 4570 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 237: /* unary_expr ::= MINUSMINUS unary_expr */
+#line 466 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy206 = new_unary_expr(ctx, MOJOSHADER_AST_OP_PREDECREMENT, yymsp[0].minor.yy206); }
+#line 4575 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 239: /* unary_expr ::= MINUS cast_expr */
+#line 468 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy206 = new_unary_expr(ctx, MOJOSHADER_AST_OP_NEGATE, yymsp[0].minor.yy206); }
+#line 4580 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 240: /* unary_expr ::= COMPLEMENT cast_expr */
+#line 469 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy206 = new_unary_expr(ctx, MOJOSHADER_AST_OP_COMPLEMENT, yymsp[0].minor.yy206); }
+#line 4585 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 241: /* unary_expr ::= EXCLAMATION cast_expr */
+#line 470 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-1].minor.yy206 = new_unary_expr(ctx, MOJOSHADER_AST_OP_NOT, yymsp[0].minor.yy206); }
+#line 4590 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 243: /* cast_expr ::= LPAREN datatype RPAREN cast_expr */
+#line 474 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yymsp[-3].minor.yy206 = new_cast_expr(ctx, yymsp[-2].minor.yy189, yymsp[0].minor.yy206); }
+#line 4595 "/root/repo/mojoshader_parser_hlsl.h"
+        break;
+      case 245: /* multiplicative_expr ::= multiplicative_expr STAR cast_expr */
+#line 478 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_MULTIPLY, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4600 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 246: /* multiplicative_expr ::= multiplicative_expr SLASH cast_expr */
+#line 479 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_DIVIDE, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4606 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 247: /* multiplicative_expr ::= multiplicative_expr PERCENT cast_expr */
+#line 480 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_MODULO, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4612 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 249: /* additive_expr ::= additive_expr PLUS multiplicative_expr */
+#line 484 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_ADD, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4618 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 250: /* additive_expr ::= additive_expr MINUS multiplicative_expr */
+#line 485 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_SUBTRACT, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4624 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 252: /* shift_expr ::= shift_expr LSHIFT additive_expr */
+#line 489 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_LSHIFT, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4630 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 253: /* shift_expr ::= shift_expr RSHIFT additive_expr */
+#line 490 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_RSHIFT, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4636 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 255: /* relational_expr ::= relational_expr LT shift_expr */
+#line 494 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_LESSTHAN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4642 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 256: /* relational_expr ::= relational_expr GT shift_expr */
+#line 495 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_GREATERTHAN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4648 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 257: /* relational_expr ::= relational_expr LEQ shift_expr */
+#line 496 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_LESSTHANOREQUAL, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4654 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 258: /* relational_expr ::= relational_expr GEQ shift_expr */
+#line 497 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_GREATERTHANOREQUAL, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4660 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 260: /* equality_expr ::= equality_expr EQL relational_expr */
+#line 501 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_EQUAL, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4666 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 261: /* equality_expr ::= equality_expr NEQ relational_expr */
+#line 502 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_NOTEQUAL, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4672 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 263: /* and_expr ::= and_expr AND equality_expr */
+#line 506 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_BINARYAND, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4678 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 265: /* exclusive_or_expr ::= exclusive_or_expr XOR and_expr */
+#line 510 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_BINARYXOR, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4684 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 267: /* inclusive_or_expr ::= inclusive_or_expr OR exclusive_or_expr */
+#line 514 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_BINARYOR, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4690 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 269: /* logical_and_expr ::= logical_and_expr ANDAND inclusive_or_expr */
+#line 518 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_LOGICALAND, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4696 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 271: /* logical_or_expr ::= logical_or_expr OROR logical_and_expr */
+#line 522 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_LOGICALOR, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4702 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 273: /* conditional_expr ::= logical_or_expr QUESTION logical_or_expr COLON conditional_expr */
+#line 526 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_ternary_expr(ctx, MOJOSHADER_AST_OP_CONDITIONAL, yymsp[-4].minor.yy206, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4708 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-4].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 275: /* assignment_expr ::= unary_expr ASSIGN assignment_expr */
+#line 530 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_ASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4714 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 276: /* assignment_expr ::= unary_expr MULASSIGN assignment_expr */
+#line 531 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_MULASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4720 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 277: /* assignment_expr ::= unary_expr DIVASSIGN assignment_expr */
+#line 532 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_DIVASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4726 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 278: /* assignment_expr ::= unary_expr MODASSIGN assignment_expr */
+#line 533 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_MODASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4732 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 279: /* assignment_expr ::= unary_expr ADDASSIGN assignment_expr */
+#line 534 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_ADDASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4738 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 280: /* assignment_expr ::= unary_expr SUBASSIGN assignment_expr */
+#line 535 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_SUBASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4744 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 281: /* assignment_expr ::= unary_expr LSHIFTASSIGN assignment_expr */
+#line 536 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_LSHIFTASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4750 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 282: /* assignment_expr ::= unary_expr RSHIFTASSIGN assignment_expr */
+#line 537 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_RSHIFTASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4756 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 283: /* assignment_expr ::= unary_expr ANDASSIGN assignment_expr */
+#line 538 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_ANDASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4762 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 284: /* assignment_expr ::= unary_expr XORASSIGN assignment_expr */
+#line 539 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_XORASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4768 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      case 285: /* assignment_expr ::= unary_expr ORASSIGN assignment_expr */
+#line 540 "/root/repo/mojoshader_parser_hlsl.lemon"
+{ yylhsminor.yy206 = new_binary_expr(ctx, MOJOSHADER_AST_OP_ORASSIGN, yymsp[-2].minor.yy206, yymsp[0].minor.yy206); }
+#line 4774 "/root/repo/mojoshader_parser_hlsl.h"
+  yymsp[-2].minor.yy206 = yylhsminor.yy206;
+        break;
+      default:
+        break;
+/********** End reduce actions ************************************************/
+  };
+  assert( yyruleno<sizeof(yyRuleInfoLhs)/sizeof(yyRuleInfoLhs[0]) );
+  yygoto = yyRuleInfoLhs[yyruleno];
+  yysize = yyRuleInfoNRhs[yyruleno];
+  yyact = yy_find_reduce_action(yymsp[yysize].stateno,(YYCODETYPE)yygoto);
+
+  /* There are no SHIFTREDUCE actions on nonterminals because the table
+  ** generator has simplified them to pure REDUCE actions. */
+  assert( !(yyact>YY_MAX_SHIFT && yyact<=YY_MAX_SHIFTREDUCE) );
+
+  /* It is not possible for a REDUCE to be followed by an error */
+  assert( yyact!=YY_ERROR_ACTION );
+
+  yymsp += yysize+1;
+  yypParser->yytos = yymsp;
+  yymsp->stateno = (YYACTIONTYPE)yyact;
+  yymsp->major = (YYCODETYPE)yygoto;
+  yyTraceShift(yypParser, yyact, "... then shift");
+  return yyact;
+}
+
+/*
+** The following code executes when the parse fails
+*/
+#ifndef YYNOERRORRECOVERY
+static void yy_parse_failed(
+  yyParser *yypParser           /* The parser */
+){
+  ParseHLSLARG_FETCH
+  ParseHLSLCTX_FETCH
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sFail!\n",yyTracePrompt);
+  }
+#endif
+  while( yypParser->yytos>yypParser->yystack ) yy_pop_parser_stack(yypParser);
+  /* Here code is inserted which will be executed whenever the
+  ** parser fails */
+/************ Begin %parse_failure code ***************************************/
+#line 47 "/root/repo/mojoshader_parser_hlsl.lemon"
+
+    // !!! FIXME: make this a proper fail() function.
+    fail(ctx, "Giving up. Parser is hopelessly lost...");
+#line 4823 "/root/repo/mojoshader_parser_hlsl.h"
+/************ End %parse_failure code *****************************************/
+  ParseHLSLARG_STORE /* Suppress warning about unused %extra_argument variable */
+  ParseHLSLCTX_STORE
+}
+#endif /* YYNOERRORRECOVERY */
+
+/*
+** The following code executes when a syntax error first occurs.
+*/
+static void yy_syntax_error(
+  yyParser *yypParser,           /* The parser */
+  int yymajor,                   /* The major type of the error token */
+  ParseHLSLTOKENTYPE yyminor         /* The minor type of the error token */
+){
+  ParseHLSLARG_FETCH
+  ParseHLSLCTX_FETCH
+#define TOKEN yyminor
+/************ Begin %syntax_error code ****************************************/
+#line 42 "/root/repo/mojoshader_parser_hlsl.lemon"
+
+    // !!! FIXME: make this a proper fail() function.
+    fail(ctx, "Syntax error");
+#line 4846 "/root/repo/mojoshader_parser_hlsl.h"
+/************ End %syntax_error code ******************************************/
+  ParseHLSLARG_STORE /* Suppress warning about unused %extra_argument variable */
+  ParseHLSLCTX_STORE
+}
+
+/*
+** The following is executed when the parser accepts
+*/
+static void yy_accept(
+  yyParser *yypParser           /* The parser */
+){
+  ParseHLSLARG_FETCH
+  ParseHLSLCTX_FETCH
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+  if( yyTraceFILE ){
+    fprintf(yyTraceFILE,"%sAccept!\n",yyTracePrompt);
+  }
+#endif
+#ifndef YYNOERRORRECOVERY
+  yypParser->yyerrcnt = -1;
+#endif
+  assert( yypParser->yytos==yypParser->yystack );
+  /* Here code is inserted which will be executed whenever the
+  ** parser accepts */
+/*********** Begin %parse_accept code *****************************************/
+/*********** End %parse_accept code *******************************************/
+  ParseHLSLARG_STORE /* Suppress warning about unused %extra_argument variable */
+  ParseHLSLCTX_STORE
+}
+
+/* The main parser program.
+** The first argument is a pointer to a structure obtained from
+** "ParseHLSLAlloc" which describes the current state of the parser.
+** The second argument is the major token number.  The third is
+** the minor token.  The fourth optional argument is whatever the
+** user wants (and specified in the grammar) and is available for
+** use by the action routines.
+**
+** Inputs:
+** <ul>
+** <li> A pointer to the parser (an opaque structure.)
+** <li> The major token number.
+** <li> The minor token number.
+** <li> An option argument of a grammar-specified type.
+** </ul>
+**
+** Outputs:
+** None.
+*/
+#if __MOJOSHADER__
+static
+#endif
+void ParseHLSL(
+  void *yyp,                   /* The parser */
+  int yymajor,                 /* The major token code number */
+  ParseHLSLTOKENTYPE yyminor       /* The value for the token */
+  ParseHLSLARG_PDECL               /* Optional %extra_argument parameter */
+){
+  YYMINORTYPE yyminorunion;
+  YYACTIONTYPE yyact;   /* The parser action. */
+#if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
+  int yyendofinput;     /* True if we are at the end of input */
+#endif
+#ifdef YYERRORSYMBOL
+  int yyerrorhit = 0;   /* True if yymajor has invoked an error */
+#endif
+  yyParser *yypParser = (yyParser*)yyp;  /* The parser */
+  ParseHLSLCTX_FETCH
+  ParseHLSLARG_STORE
+
+  assert( yypParser->yytos!=0 );
+#if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
+  yyendofinput = (yymajor==0);
+#endif
+
+  yyact = yypParser->yytos->stateno;
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+  if( yyTraceFILE ){
+    if( yyact < YY_MIN_REDUCE ){
+      fprintf(yyTraceFILE,"%sInput '%s' in state %d\n",
+              yyTracePrompt,yyTokenName[yymajor],yyact);
+    }else{
+      fprintf(yyTraceFILE,"%sInput '%s' with pending reduce %d\n",
+              yyTracePrompt,yyTokenName[yymajor],yyact-YY_MIN_REDUCE);
+    }
+  }
+#endif
+
+  while(1){ /* Exit by "break" */
+    assert( yypParser->yytos>=yypParser->yystack );
+    assert( yyact==yypParser->yytos->stateno );
+    yyact = yy_find_shift_action((YYCODETYPE)yymajor,yyact);
+    if( yyact >= YY_MIN_REDUCE ){
+      unsigned int yyruleno = yyact - YY_MIN_REDUCE; /* Reduce by this rule */
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+      assert( yyruleno<(int)(sizeof(yyRuleName)/sizeof(yyRuleName[0])) );
+      if( yyTraceFILE ){
+        int yysize = yyRuleInfoNRhs[yyruleno];
+        if( yysize ){
+          fprintf(yyTraceFILE, "%sReduce %d [%s]%s, pop back to state %d.\n",
+            yyTracePrompt,
+            yyruleno, yyRuleName[yyruleno],
+            yyruleno<YYNRULE_WITH_ACTION ? "" : " without external action",
+            yypParser->yytos[yysize].stateno);
+        }else{
+          fprintf(yyTraceFILE, "%sReduce %d [%s]%s.\n",
+            yyTracePrompt, yyruleno, yyRuleName[yyruleno],
+            yyruleno<YYNRULE_WITH_ACTION ? "" : " without external action");
+        }
+      }
+#endif /* NDEBUG */
+
+      /* Check that the stack is large enough to grow by a single entry
+      ** if the RHS of the rule is empty.  This ensures that there is room
+      ** enough on the stack to push the LHS value */
+      if( yyRuleInfoNRhs[yyruleno]==0 ){
+#ifdef YYTRACKMAXSTACKDEPTH
+        if( (int)(yypParser->yytos - yypParser->yystack)>yypParser->yyhwm ){
+          yypParser->yyhwm++;
+          assert( yypParser->yyhwm ==
+                  (int)(yypParser->yytos - yypParser->yystack));
+        }
+#endif
+#if YYSTACKDEPTH>0 
+        if( yypParser->yytos>=yypParser->yystackEnd ){
+          yyStackOverflow(yypParser);
+          break;
+        }
+#else
+        if( yypParser->yytos>=&yypParser->yystack[yypParser->yystksz-1] ){
+          if( yyGrowStack(yypParser) ){
+            yyStackOverflow(yypParser);
+            break;
+          }
+        }
+#endif
+      }
+      yyact = yy_reduce(yypParser,yyruleno,yymajor,yyminor ParseHLSLCTX_PARAM);
+    }else if( yyact <= YY_MAX_SHIFTREDUCE ){
+      yy_shift(yypParser,yyact,(YYCODETYPE)yymajor,yyminor);
+#ifndef YYNOERRORRECOVERY
+      yypParser->yyerrcnt--;
+#endif
+      break;
+    }else if( yyact==YY_ACCEPT_ACTION ){
+      yypParser->yytos--;
+      yy_accept(yypParser);
+      return;
+    }else{
+      assert( yyact == YY_ERROR_ACTION );
+      yyminorunion.yy0 = yyminor;
+#ifdef YYERRORSYMBOL
+      int yymx;
+#endif
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+      if( yyTraceFILE ){
+        fprintf(yyTraceFILE,"%sSyntax Error!\n",yyTracePrompt);
+      }
+#endif
+#ifdef YYERRORSYMBOL
+      /* A syntax error has occurred.
+      ** The response to an error depends upon whether or not the
+      ** grammar defines an error token "ERROR".  
+      **
+      ** This is what we do if the grammar does define ERROR:
+      **
+      **  * Call the %syntax_error function.
+      **
+      **  * Begin popping the stack until we enter a state where
+      **    it is legal to shift the error symbol, then shift
+      **    the error symbol.
+      **
+      **  * Set the error count to three.
+      **
+      **  * Begin accepting and shifting new tokens.  No new error
+      **    processing will occur until three tokens have been
+      **    shifted successfully.
+      **
+      */
+      if( yypParser->yyerrcnt<0 ){
+        yy_syntax_error(yypParser,yymajor,yyminor);
+      }
+      yymx = yypParser->yytos->major;
+      if( yymx==YYERRORSYMBOL || yyerrorhit ){
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+        if( yyTraceFILE ){
+          fprintf(yyTraceFILE,"%sDiscard input token %s\n",
+             yyTracePrompt,yyTokenName[yymajor]);
+        }
+#endif
+        yy_destructor(yypParser, (YYCODETYPE)yymajor, &yyminorunion);
+        yymajor = YYNOCODE;
+      }else{
+        while( yypParser->yytos > yypParser->yystack ){
+          yyact = yy_find_reduce_action(yypParser->yytos->stateno,
+                                        YYERRORSYMBOL);
+          if( yyact<=YY_MAX_SHIFTREDUCE ) break;
+          yy_pop_parser_stack(yypParser);
+        }
+        if( yypParser->yytos <= yypParser->yystack || yymajor==0 ){
+          yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
+          yy_parse_failed(yypParser);
+#ifndef YYNOERRORRECOVERY
+          yypParser->yyerrcnt = -1;
+#endif
+          yymajor = YYNOCODE;
+        }else if( yymx!=YYERRORSYMBOL ){
+          yy_shift(yypParser,yyact,YYERRORSYMBOL,yyminor);
+        }
+      }
+      yypParser->yyerrcnt = 3;
+      yyerrorhit = 1;
+      if( yymajor==YYNOCODE ) break;
+      yyact = yypParser->yytos->stateno;
+#elif defined(YYNOERRORRECOVERY)
+      /* If the YYNOERRORRECOVERY macro is defined, then do not attempt to
+      ** do any kind of error recovery.  Instead, simply invoke the syntax
+      ** error routine and continue going as if nothing had happened.
+      **
+      ** Applications can set this macro (for example inside %include) if
+      ** they intend to abandon the parse upon the first syntax error seen.
+      */
+      yy_syntax_error(yypParser,yymajor, yyminor);
+      yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
+      break;
+#else  /* YYERRORSYMBOL is not defined */
+      /* This is what we do if the grammar does not define ERROR:
+      **
+      **  * Report an error message, and throw away the input token.
+      **
+      **  * If the input token is $, then fail the parse.
+      **
+      ** As before, subsequent error messages are suppressed until
+      ** three input tokens have been successfully shifted.
+      */
+      if( yypParser->yyerrcnt<=0 ){
+        yy_syntax_error(yypParser,yymajor, yyminor);
+      }
+      yypParser->yyerrcnt = 3;
+      yy_destructor(yypParser,(YYCODETYPE)yymajor,&yyminorunion);
+      if( yyendofinput ){
+        yy_parse_failed(yypParser);
+#ifndef YYNOERRORRECOVERY
+        yypParser->yyerrcnt = -1;
+#endif
+      }
+      break;
+#endif
+    }
+  }
+#if LEMON_SUPPORT_TRACING   /* __MOJOSHADER__ */
+  if( yyTraceFILE ){
+    yyStackEntry *i;
+    char cDiv = '[';
+    fprintf(yyTraceFILE,"%sReturn. Stack=",yyTracePrompt);
+    for(i=&yypParser->yystack[1]; i<=yypParser->yytos; i++){
+      fprintf(yyTraceFILE,"%c%s", cDiv, yyTokenName[i->major]);
+      cDiv = ' ';
+    }
+    fprintf(yyTraceFILE,"]\n");
+  }
+#endif
+  return;
+}
+
+/*
+** Return the fallback token corresponding to canonical token iToken, or
+** 0 if iToken has no fallback.
+*/
+#if __MOJOSHADER__
+static
+#endif
+int ParseHLSLFallback(int iToken){
+#ifdef YYFALLBACK
+  assert( iToken<(int)(sizeof(yyFallback)/sizeof(yyFallback[0])) );
+  return yyFallback[iToken];
+#else
+  (void)iToken;
+  return 0;
+#endif
+}
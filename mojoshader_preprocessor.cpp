@@ -37,6 +37,13 @@ static void print_debug_lexing_position(IncludeState *s)
 #define print_debug_lexing_position(s)
 #endif
 
+typedef struct PreTokenList
+{
+    PreToken *tokens;
+    unsigned int count;
+    unsigned int allocated;
+} PreTokenList;
+
 typedef struct Context
 {
     int isfail;
@@ -48,13 +55,20 @@ typedef struct Context
     Conditional *conditional_pool;
     IncludeState *include_stack;
     IncludeState *include_pool;
-    Define *define_hashtable[256];
+    HashTable *define_table;
     Define *define_pool;
     Define *file_macro;
     Define *line_macro;
     StringCache *filename_cache;
+    HashTable *include_guards;  // #include name -> IncludeGuard.
+    const char **includes;  // every #include we opened, as include_guards keys.
+    unsigned int include_count;
+    unsigned int include_alloc;
+    PreTokenList macro_tokens;  // scratch space for replace_and_push_macro().
+    PreTokenList scratch_tokens;  // scratch space for everything else.
     MOJOSHADER_includeOpen open_callback;
     MOJOSHADER_includeClose close_callback;
+    MOJOSHADER_includeCache *include_cache;
     MOJOSHADER_malloc malloc;
     MOJOSHADER_free free;
     void *malloc_data;
@@ -340,52 +354,39 @@ IMPLEMENT_POOL(Define, define)
 
 // Preprocessor define hashtable stuff...
 
-// !!! FIXME: why isn't this using mojoshader_common.c's code?
+// Defines are their own keys, so lookups can use a Define on the stack that
+//  points right into the source, with the hash that lexer() already worked
+//  out for the token. Nothing has to be copied or NUL-terminated to look up
+//  an identifier.
 
-// this is djb's xor hashing function.
-static inline uint32 hash_string_djbxor(const char *sym)
+static uint32 hash_define(const void *key, void *data)
 {
-    register uint32 hash = 5381;
-    while (*sym)
-        hash = ((hash << 5) + hash) ^ *(sym++);
-    return hash;
-} // hash_string_djbxor
-
-static inline uint8 hash_define(const char *sym)
-{
-    return (uint8) hash_string_djbxor(sym);
+    (void) data;
+    return ((const Define *) key)->hash;
 } // hash_define
 
-
-static int add_define(Context *ctx, const char *sym, const char *val,
-                      char **parameters, int paramcount)
+static inline int define_matches(const Define *def, const char *sym,
+                                 const unsigned int symlen, const uint32 hash)
 {
-    const uint8 hash = hash_define(sym);
-    Define *bucket = ctx->define_hashtable[hash];
-    while (bucket)
-    {
-        if (strcmp(bucket->identifier, sym) == 0)
-        {
-            failf(ctx, "'%s' already defined", sym); // !!! FIXME: warning?
-            // !!! FIXME: gcc reports the location of previous #define here.
-            return 0;
-        } // if
-        bucket = bucket->next;
-    } // while
-
-    bucket = get_define(ctx);
-    if (bucket == NULL)
-        return 0;
+    return ( (def->hash == hash) && (def->identifier_len == symlen) &&
+             (memcmp(def->identifier, sym, symlen) == 0) );
+} // define_matches
 
-    bucket->definition = val;
-    bucket->original = NULL;
-    bucket->identifier = sym;
-    bucket->parameters = (const char **) parameters;
-    bucket->paramcount = paramcount;
-    bucket->next = ctx->define_hashtable[hash];
-    ctx->define_hashtable[hash] = bucket;
-    return 1;
-} // add_define
+static int keymatch_define(const void *a, const void *b, void *data)
+{
+    const Define *def = (const Define *) b;
+    (void) data;
+    return define_matches((const Define *) a, def->identifier,
+                          def->identifier_len, def->hash);
+} // keymatch_define
+
+static inline void set_define_identifier(Define *def, const char *sym,
+                                         const unsigned int symlen)
+{
+    def->identifier = sym;
+    def->identifier_len = symlen;
+    def->hash = hash_string(sym, symlen);
+} // set_define_identifier
 
 
 static void free_define(Context *ctx, Define *def)
@@ -399,71 +400,53 @@ static void free_define(Context *ctx, Define *def)
         Free(ctx, (void *) def->identifier);
         Free(ctx, (void *) def->definition);
         Free(ctx, (void *) def->original);
+        Free(ctx, def->pretokens);
         put_define(ctx, def);
     } // if
 } // free_define
 
-
-static int remove_define(Context *ctx, const char *sym)
+static void nuke_define(const void *ctx, const void *key,
+                        const void *value, void *data)
 {
-    const uint8 hash = hash_define(sym);
-    Define *bucket = ctx->define_hashtable[hash];
-    Define *prev = NULL;
-    while (bucket)
-    {
-        if (strcmp(bucket->identifier, sym) == 0)
-        {
-            if (prev == NULL)
-                ctx->define_hashtable[hash] = bucket->next;
-            else
-                prev->next = bucket->next;
-            free_define(ctx, bucket);
-            return 1;
-        } // if
-        prev = bucket;
-        bucket = bucket->next;
-    } // while
+    free_define((Context *) data, (Define *) value);
+} // nuke_define
 
-    return 0;
-} // remove_define
 
-
-static const Define *find_define(Context *ctx, const char *sym)
+static const Define *find_define(Context *ctx, const char *sym,
+                                 const unsigned int symlen, const uint32 hash)
 {
-    const uint8 hash = hash_define(sym);
-    Define *bucket = ctx->define_hashtable[hash];
-    while (bucket)
-    {
-        if (strcmp(bucket->identifier, sym) == 0)
-            return bucket;
-        bucket = bucket->next;
-    } // while
+    Define key;
+    key.identifier = sym;
+    key.identifier_len = symlen;
+    key.hash = hash;
 
-    const uint8 filestrhash = 67;
-    assert(hash_define("__FILE__") == filestrhash);
+    const void *value = NULL;
+    if (hash_find_hashed(ctx->define_table, &key, hash, &value))
+        return (const Define *) value;
 
-    const uint8 linestrhash = 75;
-    assert(hash_define("__LINE__") == linestrhash);
+    Define *file_macro = ctx->file_macro;
+    Define *line_macro = ctx->line_macro;
 
-    if ( (hash == filestrhash) && (ctx->file_macro) && (strcmp(sym, "__FILE__") == 0) )
+    if ( (file_macro) && (define_matches(file_macro, sym, symlen, hash)) )
     {
-        Free(ctx, (char *) ctx->file_macro->definition);
+        Free(ctx, (char *) file_macro->definition);
         const IncludeState *state = ctx->include_stack;
         const char *fname = state ? state->filename : "";
         const size_t len = strlen(fname) + 2;
-        char *str = (char *) Malloc(ctx, len);
+        char *str = (char *) Malloc(ctx, len + 1);
         if (!str)
             return NULL;
         str[0] = '\"';
         memcpy(str + 1, fname, len - 2);
         str[len - 1] = '\"';
-        ctx->file_macro->definition = str;
-        return ctx->file_macro;
+        str[len] = '\0';  // callers strlen() this.
+        file_macro->definition = str;
+        return file_macro;
     } // if
 
-    else if ( (hash == linestrhash) && (ctx->line_macro) && (strcmp(sym, "__LINE__") == 0) )
+    else if ( (line_macro) && (define_matches(line_macro, sym, symlen, hash)) )
     {
-        Free(ctx, (char *) ctx->line_macro->definition);
+        Free(ctx, (char *) line_macro->definition);
         const IncludeState *state = ctx->include_stack;
         const size_t bufsize = 32;
         char *str = (char *) Malloc(ctx, bufsize);
@@ -472,8 +455,8 @@ static const Define *find_define(Context *ctx, const char *sym)
 
         const size_t len = snprintf(str, bufsize, "%u", state->line);
         assert(len < bufsize); (void) len;
-        ctx->line_macro->definition = str;
-        return ctx->line_macro;
+        line_macro->definition = str;
+        return line_macro;
     } // else
 
     return NULL;
@@ -484,26 +467,71 @@ static const Define *find_define_by_token(Context *ctx)
 {
     IncludeState *state = ctx->include_stack;
     assert(state->tokenval == TOKEN_IDENTIFIER);
-    char *sym = (char *) alloca(state->tokenlen+1);
-    memcpy(sym, state->token, state->tokenlen);
-    sym[state->tokenlen] = '\0';
-    return find_define(ctx, sym);
+    return find_define(ctx, state->token, state->tokenlen, state->tokenhash);
 } // find_define_by_token
 
 
+static int add_define(Context *ctx, const char *sym, const char *val,
+                      char **parameters, int paramcount)
+{
+    const unsigned int symlen = (unsigned int) strlen(sym);
+    const uint32 hash = hash_string(sym, symlen);
+    Define key;
+    key.identifier = sym;
+    key.identifier_len = symlen;
+    key.hash = hash;
+
+    if (hash_find_hashed(ctx->define_table, &key, hash, NULL))
+    {
+        failf(ctx, "'%s' already defined", sym); // !!! FIXME: warning?
+        // !!! FIXME: gcc reports the location of previous #define here.
+        return 0;
+    } // if
+
+    Define *def = get_define(ctx);
+    if (def == NULL)
+        return 0;
+
+    def->definition = val;
+    def->original = NULL;
+    def->identifier = sym;
+    def->identifier_len = symlen;
+    def->hash = hash;
+    def->parameters = (const char **) parameters;
+    def->paramcount = paramcount;
+
+    if (hash_insert(ctx->define_table, def, def) != 1)
+    {
+        // the caller still owns the strings, so only give back the Define.
+        put_define(ctx, def);
+        out_of_memory(ctx);
+        return 0;
+    } // if
+
+    return 1;
+} // add_define
+
+
+static int remove_define(Context *ctx, const char *sym,
+                         const unsigned int symlen, const uint32 hash)
+{
+    Define key;
+    key.identifier = sym;
+    key.identifier_len = symlen;
+    key.hash = hash;
+    return hash_remove(ctx->define_table, &key, ctx);
+} // remove_define
+
+
 static const Define *find_macro_arg(const IncludeState *state,
                                     const Define *defines)
 {
     const Define *def = NULL;
-    char *sym = (char *) alloca(state->tokenlen + 1);
-    memcpy(sym, state->token, state->tokenlen);
-    sym[state->tokenlen] = '\0';
-
     for (def = defines; def != NULL; def = def->next)
     {
         assert(def->parameters == NULL);  // args can't have args!
         assert(def->paramcount == 0);  // args can't have args!
-        if (strcmp(def->identifier, sym) == 0)
+        if (define_matches(def, state->token, state->tokenlen, state->tokenhash))
             break;
     } // while
 
@@ -511,23 +539,6 @@ static const Define *find_macro_arg(const IncludeState *state,
 } // find_macro_arg
 
 
-static void put_all_defines(Context *ctx)
-{
-    size_t i;
-    for (i = 0; i < STATICARRAYLEN(ctx->define_hashtable); i++)
-    {
-        Define *bucket = ctx->define_hashtable[i];
-        ctx->define_hashtable[i] = NULL;
-        while (bucket)
-        {
-            Define *next = bucket->next;
-            free_define(ctx, bucket);
-            bucket = next;
-        } // while
-    } // for
-} // put_all_defines
-
-
 static int push_source(Context *ctx, const char *fname, const char *source,
                        unsigned int srclen, unsigned int linenum,
                        MOJOSHADER_includeClose close_callback)
@@ -536,7 +547,12 @@ static int push_source(Context *ctx, const char *fname, const char *source,
     if (state == NULL)
         return 0;
 
-    if (fname != NULL)
+    // every macro expansion pushes a source with its parent's filename, which
+    //  is already in the cache, so don't bother hashing it again.
+    const IncludeState *parent = ctx->include_stack;
+    if ((parent != NULL) && (fname == parent->filename))
+        state->filename = fname;
+    else if (fname != NULL)
     {
         state->filename = stringcache(ctx->filename_cache, fname);
         if (state->filename == NULL)
@@ -603,10 +619,111 @@ static void close_define_include(const char *data, MOJOSHADER_malloc m,
 } // close_define_include
 
 
+// Include guards...
+
+// If an #included file is one big #ifndef/#endif block, with nothing but
+//  whitespace and comments outside of it, then including it again while
+//  that macro is defined can't do anything, so we don't even open it. Files
+//  that say "#pragma once" never get included twice. Files are known by
+//  their #include type and name, same as the include cache does it.
+
+typedef enum
+{
+    GUARD_NONE,  // not an #include, or we know it isn't guarded.
+    GUARD_START,  // haven't seen anything but whitespace yet.
+    GUARD_INSIDE,  // inside the first #ifndef.
+    GUARD_CLOSED  // hit the matching #endif.
+} GuardState;
+
+typedef struct IncludeGuard
+{
+    int opened;  // it's in ctx->includes.
+    int once;  // saw "#pragma once".
+    char *macro;  // whole file is inside "#ifndef macro", or NULL.
+    unsigned int macro_len;
+    uint32 macro_hash;
+} IncludeGuard;
+
+static void nuke_include_guard(const void *ctx, const void *key,
+                               const void *value, void *data)
+{
+    IncludeGuard *guard = (IncludeGuard *) value;
+    Free((Context *) data, guard->macro);
+    Free((Context *) data, guard);
+} // nuke_include_guard
+
+// called with every token the top of the include stack hands out.
+static void watch_include_guard(IncludeState *state, const Token token)
+{
+    const Conditional *cond = state->conditional_stack;
+    const int blank = ( (token == ((Token) '\n')) || (token == ((Token) ' ')) ||
+                        (token == TOKEN_SINGLE_COMMENT) ||
+                        (token == TOKEN_MULTI_COMMENT) );
+
+    switch ((GuardState) state->guard_state)
+    {
+        case GUARD_NONE:
+            return;
+
+        case GUARD_START:
+            if (blank)
+                return;
+            else if (token == TOKEN_PP_IFNDEF)
+            {
+                state->guard_state = GUARD_INSIDE;  // _handle_pp_ifdef() does the rest.
+                return;
+            } // else if
+            break;
+
+        case GUARD_INSIDE:
+            if (cond == NULL)
+                break;  // the #ifndef itself failed.
+            else if (cond->next != NULL)
+                return;  // nested conditionals don't matter.
+            else if (token == TOKEN_PP_ENDIF)
+            {
+                state->guard_state = GUARD_CLOSED;
+                return;
+            } // else if
+            else if ((token == TOKEN_PP_ELSE) || (token == TOKEN_PP_ELIF))
+                break;
+            return;
+
+        case GUARD_CLOSED:
+            if ((blank) || (token == TOKEN_EOI))
+                return;
+            break;
+    } // switch
+
+    state->guard_state = GUARD_NONE;
+} // watch_include_guard
+
+// called when an #included file hits EOI with its conditionals all closed.
+static void remember_include_guard(Context *ctx, const IncludeState *state)
+{
+    IncludeGuard *guard = state->guard;
+    if ((state->guard_state != GUARD_CLOSED) || (state->guard_macro == NULL))
+        return;
+    else if (guard->macro != NULL)
+        return;  // already knew about it.
+
+    const unsigned int len = state->guard_macro_len;
+    guard->macro = (char *) Malloc(ctx, len + 1);
+    if (guard->macro != NULL)
+    {
+        memcpy(guard->macro, state->guard_macro, len);
+        guard->macro[len] = '\0';
+        guard->macro_len = len;
+        guard->macro_hash = hash_string(guard->macro, len);
+    } // if
+} // remember_include_guard
+
+
 Preprocessor *preprocessor_start(const char *fname, const char *source,
                             unsigned int sourcelen,
                             MOJOSHADER_includeOpen open_callback,
                             MOJOSHADER_includeClose close_callback,
+                            MOJOSHADER_includeCache *include_cache,
                             const MOJOSHADER_preprocessorDefine *defines,
                             unsigned int define_count, int asm_comments,
                             MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
@@ -628,20 +745,34 @@ Preprocessor *preprocessor_start(const char *fname, const char *source,
     ctx->malloc_data = d;
     ctx->open_callback = open_callback;
     ctx->close_callback = close_callback;
+    ctx->include_cache = include_cache;
     ctx->asm_comments = asm_comments;
 
     ctx->filename_cache = stringcache_create(MallocBridge, FreeBridge, ctx);
     okay = ((okay) && (ctx->filename_cache != NULL));
 
+    ctx->define_table = hash_create(ctx, hash_define, keymatch_define,
+                                    nuke_define, 0, MallocBridge, FreeBridge, ctx);
+    okay = ((okay) && (ctx->define_table != NULL));
+
+    ctx->include_guards = hash_create(ctx, hash_hash_string,
+                                      hash_keymatch_string, nuke_include_guard,
+                                      0, MallocBridge, FreeBridge, ctx);
+    okay = ((okay) && (ctx->include_guards != NULL));
+
     ctx->file_macro = get_define(ctx);
     okay = ((okay) && (ctx->file_macro != NULL));
     if ((okay) && (ctx->file_macro))
         okay = ((ctx->file_macro->identifier = StrDup(ctx, "__FILE__")) != 0);
+    if (okay)
+        set_define_identifier(ctx->file_macro, ctx->file_macro->identifier, 8);
 
     ctx->line_macro = get_define(ctx);
     okay = ((okay) && (ctx->line_macro != NULL));
     if ((okay) && (ctx->line_macro))
         okay = ((ctx->line_macro->identifier = StrDup(ctx, "__LINE__")) != 0);
+    if (okay)
+        set_define_identifier(ctx->line_macro, ctx->line_macro->identifier, 8);
 
     // let the usual preprocessor parser sort these out.
     char *define_include = NULL;
@@ -694,13 +825,20 @@ void preprocessor_end(Preprocessor *_ctx)
     while (ctx->include_stack != NULL)
         pop_source(ctx);
 
-    put_all_defines(ctx);
+    if (ctx->define_table != NULL)
+        hash_destroy(ctx->define_table, ctx);
+
+    if (ctx->include_guards != NULL)
+        hash_destroy(ctx->include_guards, ctx);
 
     if (ctx->filename_cache != NULL)
         stringcache_destroy(ctx->filename_cache);
 
     free_define(ctx, ctx->file_macro);
     free_define(ctx, ctx->line_macro);
+    Free(ctx, ctx->macro_tokens.tokens);
+    Free(ctx, ctx->scratch_tokens.tokens);
+    Free(ctx, ctx->includes);
     free_define_pool(ctx);
     free_conditional_pool(ctx);
     free_include_pool(ctx);
@@ -726,15 +864,192 @@ static inline void pushback(IncludeState *state)
 } // pushback
 
 
-static Token lexer(IncludeState *state)
+// Hand out the next token from (state->pretoken) as if the lexer had just
+//  found it in the source. The list always ends with a TOKEN_EOI, which we
+//  keep returning, just like the real lexer does.
+static Token replay_pretoken(IncludeState *state)
 {
-    if (!state->pushedback)
-        return preprocessor_lexer(state);
-    state->pushedback = 0;
+    const PreToken *pretoken = state->pretoken;
+
+    // whitespace never follows whitespace in these lists, so one skip is it.
+    if ((pretoken->tokenval == ((Token) ' ')) && (!state->report_whitespace))
+        pretoken++;
+
+    if (pretoken->tokenval == ((Token) '\n'))
+        state->line++;
+
+    const unsigned int end = pretoken->offset + pretoken->len;
+    state->token = state->source_base + pretoken->offset;
+    state->tokenlen = pretoken->len;
+    state->tokenhash = pretoken->hash;
+    state->tokenval = pretoken->tokenval;
+    state->source = state->source_base + end;
+    state->bytes_left = state->orig_length - end;
+    state->pretoken = (pretoken->tokenval == TOKEN_EOI) ? pretoken : pretoken+1;
     return state->tokenval;
+} // replay_pretoken
+
+
+static Token lexer(IncludeState *state)
+{
+    if (state->pushedback)
+    {
+        state->pushedback = 0;
+        return state->tokenval;
+    } // if
+
+    if (state->pretoken != NULL)
+        return replay_pretoken(state);
+
+    // hash identifiers once, here, so looking them up later is cheap.
+    const Token retval = preprocessor_lexer(state);
+    if (retval == TOKEN_IDENTIFIER)
+        state->tokenhash = hash_string(state->token, state->tokenlen);
+    return retval;
 } // lexer
 
 
+// Macros get expanded over and over, so we lex their text once and replay the
+//  tokens after that, instead of running the lexer over the same text every
+//  time. These lists are built with whitespace reported, since replaying can
+//  drop it but can't put it back.
+
+static int grow_pretokens(Context *ctx, PreTokenList *list,
+                          const unsigned int count)
+{
+    unsigned int allocated = list->allocated ? list->allocated * 2 : 16;
+    while (allocated < (list->count + count))
+        allocated *= 2;
+    PreToken *tokens = (PreToken *) Malloc(ctx, sizeof (PreToken) * allocated);
+    if (tokens == NULL)
+        return 0;
+    if (list->count > 0)
+        memcpy(tokens, list->tokens, sizeof (PreToken) * list->count);
+    Free(ctx, list->tokens);
+    list->tokens = tokens;
+    list->allocated = allocated;
+    return 1;
+} // grow_pretokens
+
+// Makes room for (count) more tokens at the end of (list), and returns them.
+static inline PreToken *reserve_pretokens(Context *ctx, PreTokenList *list,
+                                          const unsigned int count)
+{
+    if ((list->count + count) > list->allocated)
+    {
+        if (!grow_pretokens(ctx, list, count))
+            return NULL;
+    } // if
+
+    PreToken *retval = &list->tokens[list->count];
+    list->count += count;
+    return retval;
+} // reserve_pretokens
+
+static inline int add_pretoken(Context *ctx, PreTokenList *list,
+                               const Token tokenval, const unsigned int offset,
+                               const unsigned int len, const uint32 hash)
+{
+    // the lexer reports a run of whitespace as one token, so we do, too.
+    if ((tokenval == ((Token) ' ')) && (list->count > 0))
+    {
+        PreToken *prev = &list->tokens[list->count - 1];
+        if ((prev->tokenval == tokenval) && (prev->offset + prev->len == offset))
+        {
+            prev->len += len;
+            return 1;
+        } // if
+    } // if
+
+    PreToken *pretoken = reserve_pretokens(ctx, list, 1);
+    if (pretoken == NULL)
+        return 0;
+
+    pretoken->tokenval = tokenval;
+    pretoken->offset = offset;
+    pretoken->len = len;
+    pretoken->hash = hash;
+    return 1;
+} // add_pretoken
+
+// A copy of (list) that's just big enough, so the list can be reused.
+static PreToken *copy_pretokens(Context *ctx, const PreTokenList *list)
+{
+    const size_t len = sizeof (PreToken) * list->count;
+    PreToken *retval = (PreToken *) Malloc(ctx, len);
+    if (retval != NULL)
+        memcpy(retval, list->tokens, len);
+    return retval;
+} // copy_pretokens
+
+// Returns NULL if (source) has anything we can't replay exactly: directives,
+//  comments, line continuations, bogus chars. Those just get lexed the
+//  old-fashioned way.
+static PreToken *prelex(Context *ctx, const char *source,
+                        const unsigned int srclen, const Token starttoken)
+{
+    PreTokenList *list = &ctx->scratch_tokens;
+    list->count = 0;
+
+    IncludeState s;
+    memset(&s, '\0', sizeof (IncludeState));
+    s.source_base = s.source = s.token = source;
+    s.tokenval = starttoken;
+    s.orig_length = s.bytes_left = srclen;
+    s.report_whitespace = 1;
+    s.asm_comments = ctx->asm_comments;
+
+    while (1)
+    {
+        const unsigned int line = s.line;
+        const Token token = preprocessor_lexer(&s);
+        const unsigned int newlines = (token == ((Token) '\n')) ? 1 : 0;
+
+        if ((token >= TOKEN_MULTI_COMMENT) && (token != TOKEN_EOI))
+            break;  // comments, directives, bogus chars.
+        else if ((s.line - line) != newlines)
+            break;  // a line continuation or something.
+        else if ((s.tokenlen > 0) && ((s.token[0] == '/') || (s.token[0] == ';')))
+        {
+            // comments come back as whitespace or newlines.
+            if ((token == ((Token) ' ')) || (token == ((Token) '\n')))
+                break;
+        } // else if
+
+        const uint32 hash = (token == TOKEN_IDENTIFIER) ?
+                                hash_string(s.token, s.tokenlen) : 0;
+        if (!add_pretoken(ctx, list, token, (unsigned int) (s.token - source),
+                          s.tokenlen, hash))
+            break;
+        else if (token == TOKEN_EOI)
+            return copy_pretokens(ctx, list);
+    } // while
+
+    return NULL;
+} // prelex
+
+// Body tokens for a #define, lexed the first time anyone asks. Macro args
+//  always land after a space, so they get lexed like that.
+static const PreToken *define_pretokens(Context *ctx, const Define *_def,
+                                        const Token starttoken)
+{
+    // __FILE__ and __LINE__ change every time they're used.
+    if ((_def == ctx->file_macro) || (_def == ctx->line_macro))
+        return NULL;
+
+    Define *def = (Define *) _def;  // this is just a cache, so it's okay.
+    if (!def->prelexed)
+    {
+        def->prelexed = 1;
+        def->pretokens = prelex(ctx, def->definition,
+                                (unsigned int) strlen(def->definition),
+                                starttoken);
+    } // if
+
+    return def->pretokens;
+} // define_pretokens
+
+
 // !!! FIXME: parsing fails on preprocessor directives should skip rest of line.
 static int require_newline(IncludeState *state)
 {
@@ -755,6 +1070,22 @@ static int token_to_int(IncludeState *state)
 } // token_to_int
 
 
+// just peeks, the tokens still go to the caller like any other #pragma.
+static void check_pragma_once(IncludeState *state)
+{
+    IncludeState saved;
+    memcpy(&saved, state, sizeof (IncludeState));
+    if ( (lexer(state) == TOKEN_IDENTIFIER) && (state->tokenlen == 4) &&
+         (memcmp(state->token, "once", 4) == 0) )
+    {
+        const Token token = lexer(state);
+        if ((token == ((Token) '\n')) || (token == TOKEN_EOI))
+            state->guard->once = 1;
+    } // if
+    memcpy(state, &saved, sizeof (IncludeState));
+} // check_pragma_once
+
+
 static void handle_pp_include(Context *ctx)
 {
     IncludeState *state = ctx->include_stack;
@@ -815,20 +1146,95 @@ static void handle_pp_include(Context *ctx)
         return;
     } // if
 
-    if (!ctx->open_callback(incltype, filename, state->source_base,
-                            &newdata, &newbytes, ctx->malloc,
-                            ctx->free, ctx->malloc_data))
+    // have we seen this one before, and can we skip it?
+    const char *guardkey = stringcache_fmt(ctx->filename_cache, "%c%s",
+                (incltype == MOJOSHADER_INCLUDETYPE_LOCAL) ? '\"' : '<', filename);
+    if (guardkey == NULL)
+        return;
+
+    const void *value = NULL;
+    IncludeGuard *guard = NULL;
+    if (hash_find(ctx->include_guards, guardkey, &value))
+    {
+        guard = (IncludeGuard *) value;
+        if (guard->once)
+            return;
+        else if ( (guard->macro != NULL) &&
+                  (find_define(ctx, guard->macro, guard->macro_len,
+                               guard->macro_hash) != NULL) )
+            return;
+    } // if
+    else
+    {
+        guard = (IncludeGuard *) Malloc(ctx, sizeof (IncludeGuard));
+        if (guard == NULL)
+            return;
+        memset(guard, '\0', sizeof (IncludeGuard));
+        if (hash_insert(ctx->include_guards, guardkey, guard) != 1)
+        {
+            Free(ctx, guard);
+            out_of_memory(ctx);
+            return;
+        } // if
+    } // else
+
+    // the cache owns what it hands back, so there's nothing to close later.
+    MOJOSHADER_includeClose callback = ctx->close_callback;
+    int opened = 0;
+    if (ctx->include_cache != NULL)
+    {
+        callback = NULL;
+        opened = includecache_open(ctx->include_cache, incltype, filename,
+                                   state->source_base, ctx->open_callback,
+                                   ctx->close_callback, &newdata, &newbytes,
+                                   ctx->malloc, ctx->free, ctx->malloc_data);
+    } // if
+    else
+    {
+        opened = ctx->open_callback(incltype, filename, state->source_base,
+                                    &newdata, &newbytes, ctx->malloc,
+                                    ctx->free, ctx->malloc_data);
+    } // else
+
+    if (!opened)
     {
         fail(ctx, "Include callback failed");  // !!! FIXME: better error
         return;
     } // if
 
-    MOJOSHADER_includeClose callback = ctx->close_callback;
+    if (!guard->opened)
+    {
+        if (ctx->include_count >= ctx->include_alloc)
+        {
+            const unsigned int alloc = ctx->include_alloc ? ctx->include_alloc * 2 : 16;
+            const char **ptr = (const char **) Malloc(ctx, sizeof (char *) * alloc);
+            if (ptr == NULL)
+            {
+                if (callback != NULL)
+                    callback(newdata, ctx->malloc, ctx->free, ctx->malloc_data);
+                return;
+            } // if
+            if (ctx->include_count > 0)
+                memcpy(ptr, ctx->includes, sizeof (char *) * ctx->include_count);
+            Free(ctx, ctx->includes);
+            ctx->includes = ptr;
+            ctx->include_alloc = alloc;
+        } // if
+
+        ctx->includes[ctx->include_count++] = guardkey;
+        guard->opened = 1;
+    } // if
+
     if (!push_source(ctx, filename, newdata, newbytes, 1, callback))
     {
         assert(ctx->out_of_memory);
-        ctx->close_callback(newdata, ctx->malloc, ctx->free, ctx->malloc_data);
+        if (callback != NULL)
+            callback(newdata, ctx->malloc, ctx->free, ctx->malloc_data);
+        return;
     } // if
+
+    ctx->include_stack->guard = guard;
+    ctx->include_stack->guard_state = GUARD_START;
 } // handle_pp_include
 
 
@@ -1146,9 +1552,10 @@ static void handle_pp_undef(Context *ctx)
         return;
     } // if
 
-    char *sym = (char *) alloca(state->tokenlen+1);
-    memcpy(sym, state->token, state->tokenlen);
-    sym[state->tokenlen] = '\0';
+    // these point into the source, so they survive require_newline().
+    const char *sym = state->token;
+    const unsigned int symlen = state->tokenlen;
+    const uint32 hash = state->tokenhash;
 
     if (!require_newline(state))
     {
@@ -1156,26 +1563,20 @@ static void handle_pp_undef(Context *ctx)
         return;
     } // if
 
-    if (strcmp(sym, "__FILE__") == 0)
+    if ((ctx->file_macro) && (define_matches(ctx->file_macro, sym, symlen, hash)))
     {
-        if (ctx->file_macro)
-        {
-            failf(ctx, "undefining \"%s\"", sym);  // !!! FIXME: should be warning.
-            free_define(ctx, ctx->file_macro);
-            ctx->file_macro = NULL;
-        } // if
+        fail(ctx, "undefining \"__FILE__\"");  // !!! FIXME: should be warning.
+        free_define(ctx, ctx->file_macro);
+        ctx->file_macro = NULL;
     } // if
-    else if (strcmp(sym, "__LINE__") == 0)
+    else if ((ctx->line_macro) && (define_matches(ctx->line_macro, sym, symlen, hash)))
     {
-        if (ctx->line_macro)
-        {
-            failf(ctx, "undefining \"%s\"", sym);  // !!! FIXME: should be warning.
-            free_define(ctx, ctx->line_macro);
-            ctx->line_macro = NULL;
-        } // if
-    } // if
+        fail(ctx, "undefining \"__LINE__\"");  // !!! FIXME: should be warning.
+        free_define(ctx, ctx->line_macro);
+        ctx->line_macro = NULL;
+    } // else if
 
-    remove_define(ctx, sym);
+    remove_define(ctx, sym, symlen, hash);
 } // handle_pp_undef
 
 
@@ -1191,9 +1592,10 @@ static Conditional *_handle_pp_ifdef(Context *ctx, const Token type)
         return NULL;
     } // if
 
-    char *sym = (char *) alloca(state->tokenlen+1);
-    memcpy(sym, state->token, state->tokenlen);
-    sym[state->tokenlen] = '\0';
+    // these point into the source, so they survive require_newline().
+    const char *sym = state->token;
+    const unsigned int symlen = state->tokenlen;
+    const uint32 hash = state->tokenhash;
 
     if (!require_newline(state))
     {
@@ -1210,7 +1612,13 @@ static Conditional *_handle_pp_ifdef(Context *ctx, const Token type)
         return NULL;
 
     Conditional *parent = state->conditional_stack;
-    const int found = (find_define(ctx, sym) != NULL);
+    if ((state->guard_state == GUARD_INSIDE) && (parent == NULL))
+    {
+        state->guard_macro = sym;
+        state->guard_macro_len = symlen;
+    } // if
+
+    const int found = (find_define(ctx, sym, symlen, hash) != NULL);
     const int chosen = (type == TOKEN_PP_IFDEF) ? found : !found;
     const int skipping = ( (((parent) && (parent->skipping))) || (!chosen) );
 
@@ -1240,9 +1648,16 @@ static int replace_and_push_macro(Context *ctx, const Define *def,
                                   const Define *params)
 {
     char *final = NULL;
+    unsigned int finallen = 0;
+    size_t tokenpos = 0;
+    PreTokenList *tokens = &ctx->macro_tokens;
+    tokens->count = 0;
 
     // We push the #define and lex it, building a buffer with argument
-    //  replacement, stringification, and concatenation.
+    //  replacement, stringification, and concatenation. Unless there's
+    //  concatenation (or something else we can't be sure of), we also build
+    //  the tokens that lexing that buffer would produce, so it doesn't have
+    //  to be lexed again.
     Buffer *buffer = buffer_create(128, MallocBridge, FreeBridge, ctx);
     if (buffer == NULL)
         return 0;
@@ -1256,6 +1671,9 @@ static int replace_and_push_macro(Context *ctx, const Define *def,
     } // if
 
     state = ctx->include_stack;
+    state->pretoken = define_pretokens(ctx, def, (Token) '\n');
+    int replayable = (state->pretoken != NULL);
+
     while (lexer(state) != TOKEN_EOI)
     {
         int wantorig = 0;
@@ -1265,6 +1683,7 @@ static int replace_and_push_macro(Context *ctx, const Define *def,
         if (state->tokenval == TOKEN_HASHHASH)  // concatenate?
         {
             wantorig = 1;
+            replayable = 0;  // pasted tokens have to be lexed again.
             lexer(state);
             assert(state->tokenval != TOKEN_EOI);
         } // if
@@ -1274,9 +1693,13 @@ static int replace_and_push_macro(Context *ctx, const Define *def,
             {
                 if (!buffer_append(buffer, " ", 1))
                     goto replace_and_push_macro_failed;
+                else if ( (replayable) && (!add_pretoken(ctx, tokens, (Token) ' ',
+                                        (unsigned int) buffer_size(buffer) - 1, 1, 0)) )
+                    goto replace_and_push_macro_failed;
             } // if
         } // else
 
+        const unsigned int offset = (unsigned int) buffer_size(buffer);
         const char *data = state->token;
         unsigned int len = state->tokenlen;
 
@@ -1304,6 +1727,22 @@ static int replace_and_push_macro(Context *ctx, const Define *def,
             if (!buffer_append(buffer, "\"", 1))
                 goto replace_and_push_macro_failed;
 
+            if (replayable)
+            {
+                // it's only one string literal if nothing in it is special.
+                unsigned int i;
+                for (i = 0; (replayable) && (i < len); i++)
+                {
+                    const char ch = data[i];
+                    if ((ch == '\"') || (ch == '\\') || (ch == '\r') || (ch == '\n'))
+                        replayable = 0;
+                } // for
+
+                if ( (replayable) && (!add_pretoken(ctx, tokens,
+                            TOKEN_STRING_LITERAL, offset, len + 2, 0)) )
+                    goto replace_and_push_macro_failed;
+            } // if
+
             continue;
         } // if
 
@@ -1319,27 +1758,96 @@ static int replace_and_push_macro(Context *ctx, const Define *def,
                 } // if
                 data = wantorig ? arg->original : arg->definition;
                 len = strlen(data);
+                if (wantorig)
+                    replayable = 0;
             } // if
         } // if
 
         if (!buffer_append(buffer, data, len))
             goto replace_and_push_macro_failed;
+
+        if (!replayable)
+            continue;
+        else if (arg == NULL)
+        {
+            if (!add_pretoken(ctx, tokens, state->tokenval, offset, len,
+                              state->tokenhash))
+                goto replace_and_push_macro_failed;
+        } // else if
+        else
+        {
+            const PreToken *argtokens = define_pretokens(ctx, arg, (Token) ' ');
+            unsigned int count = 0;
+            if (argtokens == NULL)
+                replayable = 0;
+            else
+            {
+                for (; argtokens[count].tokenval != TOKEN_EOI; count++)
+                {
+                    // a '#' might turn into a directive after a newline.
+                    const Token t = argtokens[count].tokenval;
+                    if ((t == TOKEN_HASH) || (t == TOKEN_HASHHASH))
+                        replayable = 0;
+                } // for
+            } // else
+
+            if ((!replayable) || (count == 0))
+                continue;
+
+            // the first one might be whitespace that runs into the last
+            //  one, the rest just get copied over.
+            if (!add_pretoken(ctx, tokens, argtokens->tokenval,
+                              offset + argtokens->offset, argtokens->len,
+                              argtokens->hash))
+                goto replace_and_push_macro_failed;
+
+            PreToken *dst = reserve_pretokens(ctx, tokens, count - 1);
+            if (dst == NULL)
+                goto replace_and_push_macro_failed;
+
+            unsigned int i;
+            for (i = 1; i < count; i++, dst++)
+            {
+                memcpy(dst, &argtokens[i], sizeof (PreToken));
+                dst->offset += offset;
+            } // for
+        } // else
     } // while
 
-    final = buffer_flatten(buffer);
+    // the tokens go after the text (and its null terminator), in the same
+    //  allocation, so close_define_include() frees them, too.
+    finallen = (unsigned int) buffer_size(buffer);
+    if (!replayable)
+        final = buffer_flatten(buffer);
+    else if (add_pretoken(ctx, tokens, TOKEN_EOI, finallen, 0, 0))
+    {
+        tokenpos = ((finallen / sizeof (PreToken)) + 1) * sizeof (PreToken);
+        const size_t tokenbytes = sizeof (PreToken) * tokens->count;
+        final = (char *) Malloc(ctx, tokenpos + tokenbytes);
+        if (final != NULL)
+        {
+            buffer_merge_into(&buffer, 1, final);
+            memset(final + finallen, '\0', tokenpos - finallen);
+            memcpy(final + tokenpos, tokens->tokens, tokenbytes);
+        } // if
+    } // else if
+
     if (!final)
         goto replace_and_push_macro_failed;
 
     buffer_destroy(buffer);
     pop_source(ctx);  // ditch the macro.
     state = ctx->include_stack;
-    if (!push_source(ctx, state->filename, final, strlen(final), state->line,
+    if (!push_source(ctx, state->filename, final, finallen, state->line,
                      close_define_include))
     {
         Free(ctx, final);
         return 0;
     } // if
 
+    if (replayable)
+        ctx->include_stack->pretoken = (const PreToken *) (final + tokenpos);
+
     return 1;
 
 replace_and_push_macro_failed:
@@ -1349,13 +1857,14 @@ replace_and_push_macro_failed:
 } // replace_and_push_macro
 
 
-static int handle_macro_args(Context *ctx, const char *sym, const Define *def)
+static int handle_macro_args(Context *ctx, const Define *def)
 {
     int retval = 0;
     IncludeState *state = ctx->include_stack;
     Define *params = NULL;
     const int expected = (def->paramcount < 0) ? 0 : def->paramcount;
     int saw_params = 0;
+    PreTokenList *argtokens = &ctx->scratch_tokens;
     IncludeState saved;  // can't pushback, we need the original token.
     memcpy(&saved, state, sizeof (IncludeState));
     if (lexer(state) != ((Token) '('))
@@ -1375,6 +1884,12 @@ static int handle_macro_args(Context *ctx, const char *sym, const Define *def)
 
         Token t = lexer(state);
 
+        // we already lexed the arg once, to get here, so save those tokens
+        //  unless a macro got replaced into it; a replacement might lex
+        //  differently when it's up against its neighbors.
+        int replayable = 1;
+        argtokens->count = 0;
+
         assert(!void_call);
 
         while (1)
@@ -1429,6 +1944,16 @@ static int handle_macro_args(Context *ctx, const char *sym, const Define *def)
 
             assert(expr != NULL);
 
+            if (replayable)
+            {
+                if ((expr != origexpr) || (t >= TOKEN_MULTI_COMMENT))
+                    replayable = 0;
+                else if ( (exprlen > 0) && (!add_pretoken(ctx, argtokens, t,
+                                             (unsigned int) buffer_size(buffer),
+                                             exprlen, state->tokenhash)) )
+                    goto handle_macro_args_failed;
+            } // if
+
             if (!buffer_append(buffer, expr, exprlen))
                 goto handle_macro_args_failed;
 
@@ -1476,9 +2001,25 @@ static int handle_macro_args(Context *ctx, const char *sym, const Define *def)
                     break;
             } // for
 
-            p->identifier = def->parameters[saw_params];
+            // ...and the whitespace tokens we just trimmed off.
+            while ( (argtokens->count > 0) &&
+                    (argtokens->tokens[argtokens->count-1].tokenval == ((Token) ' ')) )
+                argtokens->count--;
+
+            PreToken *pretokens = NULL;
+            if (replayable)
+            {
+                const unsigned int len = (unsigned int) strlen(definition);
+                if (add_pretoken(ctx, argtokens, TOKEN_EOI, len, 0, 0))
+                    pretokens = copy_pretokens(ctx, argtokens);
+            } // if
+
+            const char *param = def->parameters[saw_params];
+            set_define_identifier(p, param, (unsigned int) strlen(param));
             p->definition = definition;
             p->original = origdefinition;
+            p->prelexed = (pretokens != NULL);
+            p->pretokens = pretokens;
             p->next = params;
             params = p;
         } // if
@@ -1500,7 +2041,7 @@ static int handle_macro_args(Context *ctx, const char *sym, const Define *def)
     if (saw_params != expected)
     {
         failf(ctx, "macro '%s' passed %d arguments, but requires %d",
-              sym, saw_params, expected);
+              def->identifier, saw_params, expected);
         goto handle_macro_args_failed;
     } // if
 
@@ -1532,19 +2073,20 @@ static int handle_pp_identifier(Context *ctx)
     IncludeState *state = ctx->include_stack;
     const char *fname = state->filename;
     const unsigned int line = state->line;
-    char *sym = (char *) alloca(state->tokenlen+1);
-    memcpy(sym, state->token, state->tokenlen);
-    sym[state->tokenlen] = '\0';
 
     // Is this identifier #defined?
-    const Define *def = find_define(ctx, sym);
+    const Define *def = find_define_by_token(ctx);
     if (def == NULL)
         return 0;   // just send the token through unchanged.
     else if (def->paramcount != 0)
-        return handle_macro_args(ctx, sym, def);
+        return handle_macro_args(ctx, def);
 
     const size_t deflen = strlen(def->definition);
-    return push_source(ctx, fname, def->definition, deflen, line, NULL);
+    if (!push_source(ctx, fname, def->definition, deflen, line, NULL))
+        return 0;
+
+    ctx->include_stack->pretoken = define_pretokens(ctx, def, (Token) '\n');
+    return 1;
 } // handle_pp_identifier
 
 
@@ -2030,6 +2572,9 @@ static inline const char *_preprocessor_nexttoken(Preprocessor *_ctx,
         state->report_comments = 0;
         #endif
 
+        if (state->guard_state != GUARD_NONE)
+            watch_include_guard(state, token);
+
         if (token != TOKEN_IDENTIFIER)
             ctx->recursion_count = 0;
 
@@ -2042,6 +2587,9 @@ static inline const char *_preprocessor_nexttoken(Preprocessor *_ctx,
                 continue;  // returns an error.
             } // if
 
+            if (state->guard != NULL)
+                remember_include_guard(ctx, state);
+
             pop_source(ctx);
             continue;  // pick up again after parent's #include line.
         } // if
@@ -2125,6 +2673,8 @@ static inline const char *_preprocessor_nexttoken(Preprocessor *_ctx,
         else if (token == TOKEN_PP_PRAGMA)
         {
             ctx->parsing_pragma = 1;
+            if (state->guard != NULL)
+                check_pragma_once(state);
         } // else if
 
         if (token == TOKEN_IDENTIFIER)
@@ -2175,6 +2725,21 @@ const char *preprocessor_nexttoken(Preprocessor *ctx, unsigned int *len,
 } // preprocessor_nexttoken
 
 
+const char *preprocessor_include(Preprocessor *_ctx, unsigned int idx,
+                                 MOJOSHADER_includeType *inctype)
+{
+    Context *ctx = (Context *) _ctx;
+    if (idx >= ctx->include_count)
+        return NULL;
+
+    // the include_guards keys are the #include type's quote char, then name.
+    const char *key = ctx->includes[idx];
+    *inctype = (key[0] == '<') ? MOJOSHADER_INCLUDETYPE_SYSTEM :
+                                 MOJOSHADER_INCLUDETYPE_LOCAL;
+    return key + 1;
+} // preprocessor_include
+
+
 const char *preprocessor_sourcepos(Preprocessor *_ctx, unsigned int *pos)
 {
     Context *ctx = (Context *) _ctx;
@@ -2211,13 +2776,15 @@ static void indent_buffer(Buffer *buffer, int n, const int newline)
 
 
 static const MOJOSHADER_preprocessData out_of_mem_data_preprocessor = {
-    1, &MOJOSHADER_out_of_mem_error, 0, 0, 0, 0, 0
+    1, &MOJOSHADER_out_of_mem_error, 0, 0, 0, 0, 0, 0, 0
 };
 
 
 // public API...
 
-const MOJOSHADER_preprocessData *MOJOSHADER_preprocess(const char *filename,
+const MOJOSHADER_preprocessData *MOJOSHADER_preprocessWithCache(
+                             MOJOSHADER_includeCache *cache,
+                             const char *filename,
                              const char *source, unsigned int sourcelen,
                              const MOJOSHADER_preprocessorDefine *defines,
                              unsigned int define_count,
@@ -2237,6 +2804,9 @@ const MOJOSHADER_preprocessData *MOJOSHADER_preprocess(const char *filename,
     char *output = NULL;
     int errcount = 0;
     size_t total_bytes = 0;
+    unsigned int include_count = 0;
+    unsigned int i = 0;
+    MOJOSHADER_includeType inctype;
 
     // !!! FIXME: what's wrong with ENDLINE_STR?
     #ifdef _WINDOWS
@@ -2251,7 +2821,7 @@ const MOJOSHADER_preprocessData *MOJOSHADER_preprocess(const char *filename,
     if (!include_close) include_close = MOJOSHADER_internal_include_close;
 
     pp = preprocessor_start(filename, source, sourcelen,
-                            include_open, include_close,
+                            include_open, include_close, cache,
                             defines, define_count, 0, m, f, d);
     if (pp == NULL)
         goto preprocess_out_of_mem;
@@ -2353,19 +2923,63 @@ const MOJOSHADER_preprocessData *MOJOSHADER_preprocess(const char *filename,
     retval->free = f;
     retval->malloc_data = d;
 
+    // copy these out, since the preprocessor owns the names.
+    while (preprocessor_include(pp, include_count, &inctype) != NULL)
+        include_count++;
+
+    if (include_count > 0)
+    {
+        const size_t len = sizeof (MOJOSHADER_preprocessInclude) * include_count;
+        retval->includes = (MOJOSHADER_preprocessInclude *) m((int) len, d);
+        if (retval->includes == NULL)
+            goto preprocess_out_of_mem;
+        memset(retval->includes, '\0', len);
+
+        for (i = 0; i < include_count; i++)
+        {
+            const char *name = preprocessor_include(pp, i, &inctype);
+            char *str = (char *) m((int) strlen(name) + 1, d);
+            if (str == NULL)
+                goto preprocess_out_of_mem;
+            strcpy(str, name);
+            retval->includes[i].type = inctype;
+            retval->includes[i].filename = str;
+            retval->include_count++;
+        } // for
+    } // if
+
     errorlist_destroy(errors);
     preprocessor_end(pp);
     return retval;
 
 preprocess_out_of_mem:
     if (retval != NULL)
+    {
         f(retval->errors, d);
+        for (i = 0; i < (unsigned int) retval->include_count; i++)
+            f((void *) retval->includes[i].filename, d);
+        f(retval->includes, d);
+    } // if
     f(retval, d);
     f(output, d);
     buffer_destroy(buffer);
     errorlist_destroy(errors);
     preprocessor_end(pp);
     return &out_of_mem_data_preprocessor;
+} // MOJOSHADER_preprocessWithCache
+
+
+const MOJOSHADER_preprocessData *MOJOSHADER_preprocess(const char *filename,
+                             const char *source, unsigned int sourcelen,
+                             const MOJOSHADER_preprocessorDefine *defines,
+                             unsigned int define_count,
+                             MOJOSHADER_includeOpen include_open,
+                             MOJOSHADER_includeClose include_close,
+                             MOJOSHADER_malloc m, MOJOSHADER_free f, void *d)
+{
+    return MOJOSHADER_preprocessWithCache(NULL, filename, source, sourcelen,
+                                          defines, define_count, include_open,
+                                          include_close, m, f, d);
 } // MOJOSHADER_preprocess
 
 
@@ -2388,6 +3002,10 @@ void MOJOSHADER_freePreprocessData(const MOJOSHADER_preprocessData *_data)
     } // for
     f(data->errors, d);
 
+    for (i = 0; i < data->include_count; i++)
+        f((void *) data->includes[i].filename, d);
+    f(data->includes, d);
+
     f(data, d);
 } // MOJOSHADER_freePreprocessData
 
@@ -0,0 +1,7 @@
+/* This file was autogenerated. Do not edit! */
+#ifndef _INCL_MOJOSHADER_VERSION_H_
+#define _INCL_MOJOSHADER_VERSION_H_
+#define MOJOSHADER_VERSION -1
+#define MOJOSHADER_CHANGESET "git-e7c222058f32f75f69491d8a4ccd1536b96f863a"
+#endif
+
@@ -52,6 +52,21 @@ typedef struct RegisterList
     struct RegisterList *next;
 } RegisterList;
 
+// A set of registers, keyed on (regtype, regnum). Items live on a singly
+//  linked list (head.next is the first real item) that is appended to in
+//  whatever order registers show up, plus a dense per-regtype array indexed
+//  by regnum so lookups don't have to walk the list. reglist_first() sorts
+//  the list, if needed, before anyone iterates it, so emitters still see
+//  registers ordered by type, then number.
+typedef struct RegisterTable
+{
+    RegisterList head;
+    RegisterList *tail;  // NULL means "&head".
+    int unsorted;
+    RegisterList **index[REG_TYPE_MAX + 1];
+    int index_len[REG_TYPE_MAX + 1];
+} RegisterTable;
+
 typedef struct
 {
     const uint32 *token;   // this is the unmolested token in the stream.
@@ -87,6 +102,7 @@ typedef struct Context
     MOJOSHADER_malloc malloc;
     MOJOSHADER_free free;
     void *malloc_data;
+    MemoryArena *arena;
     int current_position;
     const uint32 *orig_tokens;
     const uint32 *tokens;
@@ -142,8 +158,8 @@ typedef struct Context
     int assigned_branch_labels;
     int assigned_vertex_attributes;
     int last_address_reg_component;
-    RegisterList used_registers;
-    RegisterList defined_registers;
+    RegisterTable used_registers;
+    RegisterTable defined_registers;
     ErrorList *errors;
     int constant_count;
     ConstantsList *constants;
@@ -151,11 +167,11 @@ typedef struct Context
     int uniform_float4_count;
     int uniform_int4_count;
     int uniform_bool_count;
-    RegisterList uniforms;
+    RegisterTable uniforms;
     int attribute_count;
-    RegisterList attributes;
+    RegisterTable attributes;
     int sampler_count;
-    RegisterList samplers;
+    RegisterTable samplers;
     VariableList *variables;  // variables to register mapping.
     int centroid_allowed;
     CtabData ctab;
@@ -184,6 +200,13 @@ typedef struct Context
     int texm3x3pad_dst1;
     int texm3x3pad_src1;
     MOJOSHADER_preshader *preshader;
+    struct MOJOSHADER_decodedShader *decoding;  // set inside MOJOSHADER_decode().
+    int reflect_only;  // set inside MOJOSHADER_reflect().
+    int chunked_output;  // set inside MOJOSHADER_parseChunked().
+#ifdef MOJOSHADER_PARSE_STATS
+    MOJOSHADER_parseStats stats;
+    uint64 stats_start;  // when build_context() was called.
+#endif
 
 #if SUPPORT_PROFILE_ARB1_NV
     int profile_supports_nv2;
@@ -321,14 +344,34 @@ typedef struct Profile
     const_array_varname_function get_const_array_varname;
 } Profile;
 
+// Parse stats...
+//  STATS_TIMER(x) starts a timer named x, and STATS_TIME(ctx, field, x) adds
+//  the time since then to ctx->stats.field. These all vanish unless we're
+//  built with MOJOSHADER_PARSE_STATS.
+
+#ifdef MOJOSHADER_PARSE_STATS
+#define STATS_TIMER(var) const uint64 var = stats_clock()
+#define STATS_TIME(ctx, field, var) (ctx)->stats.field += stats_clock() - (var)
+#define STATS_COUNT(ctx, field, val) (ctx)->stats.field += (val)
+#else
+#define STATS_TIMER(var)
+#define STATS_TIME(ctx, field, var)
+#define STATS_COUNT(ctx, field, val)
+#endif
+
 // Common utilities...
 
 void out_of_memory(Context *ctx);
 void *Malloc(Context *ctx, const size_t len);
 char *StrDup(Context *ctx, const char *str);
 void Free(Context *ctx, void *ptr);
+void *UserMalloc(Context *ctx, const size_t len);
+char *UserStrDup(Context *ctx, const char *str);
+void UserFree(Context *ctx, void *ptr);
 void * MOJOSHADERCALL MallocBridge(int bytes, void *data);
 void MOJOSHADERCALL FreeBridge(void *ptr, void *data);
+void * MOJOSHADERCALL UserMallocBridge(int bytes, void *data);
+void MOJOSHADERCALL UserFreeBridge(void *ptr, void *data);
 
 int set_output(Context *ctx, Buffer **section);
 void push_output(Context *ctx, Buffer **section);
@@ -349,16 +392,28 @@ void fail(Context *ctx, const char *reason);
 
 void output_line(Context *ctx, const char *fmt, ...);
 void output_blank_line(Context *ctx);
+int output_line_begin(Context *ctx);
+void output_line_end(Context *ctx);
+void output_str(Context *ctx, const char *str);
+void output_char(Context *ctx, const char ch);
+void output_int(Context *ctx, const int val);
+void output_float(Context *ctx, const float f, const int leavedecimal);
+void output_register(Context *ctx, const RegisterType regtype,
+                     const int regnum);
+void output_swizzle(Context *ctx, const int swizzle, const int writemask);
 
 void floatstr(Context *ctx, char *buf, size_t bufsize, float f,
               int leavedecimal);
 
-RegisterList *reglist_insert(Context *ctx, RegisterList *prev,
+RegisterList *reglist_insert(Context *ctx, RegisterTable *table,
                              const RegisterType regtype,
                              const int regnum);
-RegisterList *reglist_find(const RegisterList *prev,
+RegisterList *reglist_find(const RegisterTable *table,
                            const RegisterType rtype,
                            const int regnum);
+RegisterList *reglist_first(RegisterTable *table);
+void reglist_move(Context *ctx, RegisterTable *from, RegisterList *prev,
+                  RegisterTable *to);
 RegisterList *set_used_register(Context *ctx,
                                 const RegisterType regtype,
                                 const int regnum,
@@ -381,6 +436,9 @@ int isscalar(Context *ctx, const MOJOSHADER_shaderType shader_type,
 
 static const char swizzle_channels[] = { 'x', 'y', 'z', 'w' };
 
+const char *get_D3D_register_prefix(Context *ctx,
+                                    const RegisterType regtype,
+                                    const int regnum, int *_has_number);
 const char *get_D3D_register_string(Context *ctx,
                                     RegisterType regtype,
                                     int regnum, char *regnum_str,
@@ -19,9 +19,18 @@ void out_of_memory(Context *ctx)
     ctx->isfail = ctx->out_of_memory = 1;
 } // out_of_memory
 
+// Malloc/StrDup/Free are for parsing state that dies with the Context.
+//  These come out of the Context's arena, and it all goes away in one shot
+//  when the Context is destroyed. Free() only reclaims the block if it was
+//  the arena's most recent allocation; otherwise the memory stays allocated
+//  until then. Anything that ends up in the MOJOSHADER_parseData we return
+//  must use UserMalloc() instead.
+
 void *Malloc(Context *ctx, const size_t len)
 {
-    void *retval = ctx->malloc((int) len, ctx->malloc_data);
+    STATS_COUNT(ctx, arena_allocations, 1);
+    STATS_COUNT(ctx, arena_bytes, len);
+    void *retval = arena_alloc(ctx->arena, len);
     if (retval == NULL)
         out_of_memory(ctx);
     return retval;
@@ -37,9 +46,32 @@ char *StrDup(Context *ctx, const char *str)
 
 void Free(Context *ctx, void *ptr)
 {
-    ctx->free(ptr, ctx->malloc_data);
+    arena_free(ctx->arena, ptr);
 } // Free
 
+void *UserMalloc(Context *ctx, const size_t len)
+{
+    STATS_COUNT(ctx, app_allocations, 1);
+    STATS_COUNT(ctx, app_bytes, len);
+    void *retval = ctx->malloc((int) len, ctx->malloc_data);
+    if (retval == NULL)
+        out_of_memory(ctx);
+    return retval;
+} // UserMalloc
+
+char *UserStrDup(Context *ctx, const char *str)
+{
+    char *retval = (char *) UserMalloc(ctx, strlen(str) + 1);
+    if (retval != NULL)
+        strcpy(retval, str);
+    return retval;
+} // UserStrDup
+
+void UserFree(Context *ctx, void *ptr)
+{
+    ctx->free(ptr, ctx->malloc_data);
+} // UserFree
+
 void * MOJOSHADERCALL MallocBridge(int bytes, void *data)
 {
     return Malloc((Context *) data, (size_t) bytes);
@@ -50,6 +82,16 @@ void MOJOSHADERCALL FreeBridge(void *ptr, void *data)
     Free((Context *) data, ptr);
 } // FreeBridge
 
+void * MOJOSHADERCALL UserMallocBridge(int bytes, void *data)
+{
+    return UserMalloc((Context *) data, (size_t) bytes);
+} // UserMallocBridge
+
+void MOJOSHADERCALL UserFreeBridge(void *ptr, void *data)
+{
+    UserFree((Context *) data, ptr);
+} // UserFreeBridge
+
 // Jump between output sections in the context...
 
 int set_output(Context *ctx, Buffer **section)
@@ -57,7 +99,12 @@ int set_output(Context *ctx, Buffer **section)
     // only create output sections on first use.
     if (*section == NULL)
     {
-        *section = buffer_create(256, MallocBridge, FreeBridge, ctx);
+        // chunked output hands the blocks to the app when we're done, so
+        //  they can't live in the arena. Bigger blocks mean fewer pieces.
+        if (ctx->chunked_output)
+            *section = buffer_create(1024, UserMallocBridge, UserFreeBridge, ctx);
+        else
+            *section = buffer_create(256, MallocBridge, FreeBridge, ctx);
         if (*section == NULL)
             return 0;
     } // if
@@ -147,6 +194,20 @@ void fail(Context *ctx, const char *reason)
 
 // Output Lines...
 
+static const char output_tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+
+static void output_indent(Context *ctx)
+{
+    int indent = ctx->indent;
+    while (indent > 0)
+    {
+        const int len = (indent < (int) (sizeof (output_tabs) - 1)) ?
+                                indent : (int) (sizeof (output_tabs) - 1);
+        buffer_append(ctx->output, output_tabs, len);
+        indent -= len;
+    } // while
+} // output_indent
+
 void output_line(Context *ctx, const char *fmt, ...) ISPRINTF(2,3);
 void output_line(Context *ctx, const char *fmt, ...)
 {
@@ -154,13 +215,7 @@ void output_line(Context *ctx, const char *fmt, ...)
     if (isfail(ctx))
         return;  // we failed previously, don't go on...
 
-    const int indent = ctx->indent;
-    if (indent > 0)
-    {
-        char *indentbuf = (char *) alloca(indent);
-        memset(indentbuf, '\t', indent);
-        buffer_append(ctx->output, indentbuf, indent);
-    } // if
+    output_indent(ctx);
 
     va_list ap;
     va_start(ap, fmt);
@@ -177,36 +232,101 @@ void output_blank_line(Context *ctx)
         buffer_append(ctx->output, ctx->endline, ctx->endline_len);
 } // output_blank_line
 
-// !!! FIXME: this is sort of nasty.
+// Building an output line a piece at a time, without printf. Call
+//  output_line_begin(), and if it returns non-zero, append pieces with the
+//  rest of these and finish with output_line_end(). If something fails
+//  halfway through a line, the output gets thrown away anyhow, so the
+//  pieces don't check for it.
+
+int output_line_begin(Context *ctx)
+{
+    assert(ctx->output != NULL);
+    if (isfail(ctx))
+        return 0;  // we failed previously, don't go on...
+    output_indent(ctx);
+    return 1;
+} // output_line_begin
+
+void output_line_end(Context *ctx)
+{
+    buffer_append(ctx->output, ctx->endline, ctx->endline_len);
+} // output_line_end
+
+void output_str(Context *ctx, const char *str)
+{
+    buffer_append_str(ctx->output, str);
+} // output_str
+
+void output_char(Context *ctx, const char ch)
+{
+    buffer_append_char(ctx->output, ch);
+} // output_char
+
+void output_int(Context *ctx, const int val)
+{
+    buffer_append_int(ctx->output, val);
+} // output_int
+
+void output_float(Context *ctx, const float f, const int leavedecimal)
+{
+    char buf[64];
+    floatstr(ctx, buf, sizeof (buf), f, leavedecimal);
+    buffer_append_str(ctx->output, buf);
+} // output_float
+
+void output_register(Context *ctx, const RegisterType regtype,
+                     const int regnum)
+{
+    int has_number = 1;
+    const char *regtype_str = get_D3D_register_prefix(ctx, regtype, regnum,
+                                                      &has_number);
+    if (regtype_str == NULL)
+    {
+        fail(ctx, "unknown register type");
+        return;
+    } // if
+
+    buffer_append_str(ctx->output, regtype_str);
+    if (has_number)
+        buffer_append_uint(ctx->output, (uint) regnum);
+} // output_register
+
+void output_swizzle(Context *ctx, const int swizzle, const int writemask)
+{
+    if ( (!no_swizzle(swizzle)) || (!writemask_xyzw(writemask)) )
+    {
+        char swiz_str[5];
+        size_t i = 0;
+        swiz_str[i++] = '.';
+        if (writemask & 0x1) swiz_str[i++] = swizzle_channels[(swizzle >> 0) & 0x3];
+        if (writemask & 0x2) swiz_str[i++] = swizzle_channels[(swizzle >> 2) & 0x3];
+        if (writemask & 0x4) swiz_str[i++] = swizzle_channels[(swizzle >> 4) & 0x3];
+        if (writemask & 0x8) swiz_str[i++] = swizzle_channels[(swizzle >> 6) & 0x3];
+        buffer_append(ctx->output, swiz_str, i);
+    } // if
+} // output_swizzle
+
+// MOJOSHADER_printFloat() gives the shortest string that reads back as the
+//  same float, so there aren't any extra zeros to chop off, but it always has
+//  a decimal point in it ("1.0", "1.0e20"). Without (leavedecimal), a
+//  whole number loses the ".0".
 void floatstr(Context *ctx, char *buf, size_t bufsize, float f,
               int leavedecimal)
 {
     const size_t len = MOJOSHADER_printFloat(buf, bufsize, f);
     if ((len+2) >= bufsize)
         fail(ctx, "BUG: internal buffer is too small");
-    else
+    else if (strchr(buf, '.') == NULL)  // NaN or inf.
     {
-        char *end = buf + len;
-        char *ptr = strchr(buf, '.');
-        if (ptr == NULL)
-        {
-            if (leavedecimal)
-                strcat(buf, ".0");
-            return;  // done.
-        } // if
-
-        while (--end != ptr)
-        {
-            if (*end != '0')
-            {
-                end++;
-                break;
-            } // if
-        } // while
-        if ((leavedecimal) && (end == ptr))
-            end += 2;
-        *end = '\0';  // chop extra '0' or all decimal places off.
-    } // else
+        if (leavedecimal)
+            strcat(buf, ".0");
+    } // else if
+    else if (!leavedecimal)
+    {
+        char *ptr = strstr(buf, ".0");
+        if ((ptr != NULL) && ((ptr[2] == '\0') || (ptr[2] == 'e')))
+            memmove(ptr, ptr + 2, strlen(ptr + 2) + 1);
+    } // else if
 } // floatstr
 
 // Deal with register lists...
@@ -216,29 +336,81 @@ static inline uint32 reg_to_ui32(const RegisterType regtype, const int regnum)
     return ( ((uint32) regnum) | (((uint32) regtype) << 16) );
 } // reg_to_uint32
 
-// !!! FIXME: ditch this for a hash table.
-RegisterList *reglist_insert(Context *ctx, RegisterList *prev,
+static inline int reglist_indexable(const RegisterType regtype,
+                                     const int regnum)
+{
+    // reg_to_ui32() only has 16 bits for regnum, so that's our limit, too.
+    return ( (((unsigned int) regtype) <= REG_TYPE_MAX) &&
+             (regnum >= 0) && (regnum <= 0xFFFF) );
+} // reglist_indexable
+
+static RegisterList **reglist_slot(Context *ctx, RegisterTable *table,
+                                   const RegisterType regtype,
+                                   const int regnum)
+{
+    RegisterList **index = table->index[regtype];
+    const int len = table->index_len[regtype];
+    if (regnum < len)
+        return &index[regnum];
+    else if (ctx == NULL)
+        return NULL;  // just a lookup, don't grow.
+
+    // Most shaders use a handful of registers per type, but constants can
+    //  go well into the hundreds, so grow by doubling.
+    int newlen = (len > 0) ? len : 8;
+    while (newlen <= regnum)
+        newlen *= 2;
+
+    RegisterList **newindex = (RegisterList **)
+                        Malloc(ctx, sizeof (RegisterList *) * newlen);
+    if (newindex == NULL)
+        return NULL;
+
+    if (len > 0)
+        memcpy(newindex, index, sizeof (RegisterList *) * len);
+    memset(newindex + len, '\0', sizeof (RegisterList *) * (newlen - len));
+    Free(ctx, index);
+    table->index[regtype] = newindex;
+    table->index_len[regtype] = newlen;
+    return &newindex[regnum];
+} // reglist_slot
+
+static void reglist_append(RegisterTable *table, RegisterList *item)
+{
+    RegisterList *tail = table->tail ? table->tail : &table->head;
+    if ( (tail != &table->head) &&
+         (reg_to_ui32(item->regtype, item->regnum) <
+          reg_to_ui32(tail->regtype, tail->regnum)) )
+        table->unsorted = 1;
+
+    item->next = NULL;
+    tail->next = item;
+    table->tail = item;
+} // reglist_append
+
+RegisterList *reglist_insert(Context *ctx, RegisterTable *table,
                              const RegisterType regtype,
                              const int regnum)
 {
-    const uint32 newval = reg_to_ui32(regtype, regnum);
-    RegisterList *item = prev->next;
-    while (item != NULL)
+    RegisterList **slot = NULL;
+    RegisterList *item = NULL;
+
+    if (reglist_indexable(regtype, regnum))
     {
-        const uint32 val = reg_to_ui32(item->regtype, item->regnum);
-        if (newval == val)
-            return item;  // already set, so we're done.
-        else if (newval < val)  // insert it here.
-            break;
-        else // if (newval > val)
-        {
-            // keep going, we're not to the insertion point yet.
-            prev = item;
-            item = item->next;
-        } // else
-    } // while
+        slot = reglist_slot(ctx, table, regtype, regnum);
+        if (slot == NULL)
+            return NULL;  // out of memory.
+        else if (*slot != NULL)
+            return *slot;  // already set, so we're done.
+    } // if
+    else
+    {
+        // Bogus register from a malformed shader; just search the list.
+        item = reglist_find(table, regtype, regnum);
+        if (item != NULL)
+            return item;
+    } // else
 
-    // we need to insert an entry after (prev).
     item = (RegisterList *) Malloc(ctx, sizeof (RegisterList));
     if (item != NULL)
     {
@@ -254,33 +426,118 @@ RegisterList *reglist_insert(Context *ctx, RegisterList *prev,
         item->spirv.is_ssa = 0;
 #endif
         item->array = NULL;
-        item->next = prev->next;
-        prev->next = item;
+        reglist_append(table, item);
+        if (slot != NULL)
+            *slot = item;
     } // if
 
     return item;
 } // reglist_insert
 
-RegisterList *reglist_find(const RegisterList *prev,
+RegisterList *reglist_find(const RegisterTable *table,
                            const RegisterType rtype,
                            const int regnum)
 {
-    const uint32 newval = reg_to_ui32(rtype, regnum);
-    RegisterList *item = prev->next;
-    while (item != NULL)
+    if (reglist_indexable(rtype, regnum))
     {
-        const uint32 val = reg_to_ui32(item->regtype, item->regnum);
-        if (newval == val)
-            return item;  // here it is.
-        else if (newval < val)  // should have been here if it existed.
+        if (regnum >= table->index_len[rtype])
             return NULL;
-        else // if (newval > val)
-            item = item->next;
-    } // while
+        return table->index[rtype][regnum];
+    } // if
+
+    RegisterList *item;
+    for (item = table->head.next; item != NULL; item = item->next)
+    {
+        if ((item->regtype == rtype) && (item->regnum == regnum))
+            return item;
+    } // for
 
     return NULL;  // wasn't in the list.
 } // reglist_find
 
+static RegisterList *reglist_sort(RegisterList *list)
+{
+    // Plain merge sort on the linked list. These lists are short and
+    //  almost always nearly in order, so this is cheap.
+    if ((list == NULL) || (list->next == NULL))
+        return list;
+
+    RegisterList *slow = list;
+    RegisterList *fast = list->next;
+    while ((fast != NULL) && (fast->next != NULL))
+    {
+        slow = slow->next;
+        fast = fast->next->next;
+    } // while
+
+    RegisterList *right = reglist_sort(slow->next);
+    slow->next = NULL;
+    RegisterList *left = reglist_sort(list);
+
+    RegisterList head;
+    RegisterList *tail = &head;
+    while ((left != NULL) && (right != NULL))
+    {
+        if (reg_to_ui32(right->regtype, right->regnum) <
+            reg_to_ui32(left->regtype, left->regnum))
+        {
+            tail->next = right;
+            right = right->next;
+        } // if
+        else
+        {
+            tail->next = left;
+            left = left->next;
+        } // else
+        tail = tail->next;
+    } // while
+
+    tail->next = (left != NULL) ? left : right;
+    return head.next;
+} // reglist_sort
+
+RegisterList *reglist_first(RegisterTable *table)
+{
+    if (table->unsorted)
+    {
+        RegisterList *item = reglist_sort(table->head.next);
+        table->head.next = item;
+        table->tail = NULL;
+        while (item != NULL)
+        {
+            table->tail = item;
+            item = item->next;
+        } // while
+        table->unsorted = 0;
+    } // if
+
+    return table->head.next;
+} // reglist_first
+
+void reglist_move(Context *ctx, RegisterTable *from, RegisterList *prev,
+                  RegisterTable *to)
+{
+    RegisterList *item = prev->next;
+    const RegisterType regtype = item->regtype;
+    const int regnum = item->regnum;
+
+    prev->next = item->next;
+    if (from->tail == item)
+        from->tail = (prev == &from->head) ? NULL : prev;
+
+    if (reglist_indexable(regtype, regnum))
+    {
+        RegisterList **slot = reglist_slot(NULL, from, regtype, regnum);
+        if (slot != NULL)
+            *slot = NULL;
+        slot = reglist_slot(ctx, to, regtype, regnum);
+        if (slot != NULL)
+            *slot = item;
+    } // if
+
+    reglist_append(to, item);
+} // reglist_move
+
 RegisterList *set_used_register(Context *ctx,
                                 const RegisterType regtype,
                                 const int regnum,
@@ -376,10 +633,9 @@ int isscalar(Context *ctx, const MOJOSHADER_shaderType shader_type,
     return scalar_register(shader_type, rtype, rnum);
 } // isscalar
 
-const char *get_D3D_register_string(Context *ctx,
-                                    RegisterType regtype,
-                                    int regnum, char *regnum_str,
-                                    size_t regnum_size)
+const char *get_D3D_register_prefix(Context *ctx,
+                                    const RegisterType regtype,
+                                    const int regnum, int *_has_number)
 {
     const char *retval = NULL;
     int has_number = 1;
@@ -474,6 +730,18 @@ const char *get_D3D_register_string(Context *ctx,
             break;
     } // switch
 
+    *_has_number = has_number;
+    return retval;
+} // get_D3D_register_prefix
+
+const char *get_D3D_register_string(Context *ctx,
+                                    RegisterType regtype,
+                                    int regnum, char *regnum_str,
+                                    size_t regnum_size)
+{
+    int has_number = 1;
+    const char *retval = get_D3D_register_prefix(ctx, regtype, regnum,
+                                                 &has_number);
     if (has_number)
         snprintf(regnum_str, regnum_size, "%u", (uint) regnum);
     else
@@ -116,6 +116,21 @@ const char *get_GLSL_srcarg_varname(Context *ctx, const size_t idx,
 } // get_GLSL_srcarg_varname
 
 
+static const char *get_GLSL_result_shift_string(const DestArgInfo *arg)
+{
+    switch (arg->result_shift)
+    {
+        case 0x1: return " * 2.0";
+        case 0x2: return " * 4.0";
+        case 0x3: return " * 8.0";
+        case 0xD: return " / 8.0";
+        case 0xE: return " / 4.0";
+        case 0xF: return " / 2.0";
+    } // switch
+    return "";
+} // get_GLSL_result_shift_string
+
+
 const char *make_GLSL_destarg_assign(Context *, char *, const size_t,
                                      const char *, ...) ISPRINTF(4,5);
 
@@ -173,16 +188,7 @@ const char *make_GLSL_destarg_assign(Context *ctx, char *buf,
         return buf;
     } // if
 
-    const char *result_shift_str = "";
-    switch (arg->result_shift)
-    {
-        case 0x1: result_shift_str = " * 2.0"; break;
-        case 0x2: result_shift_str = " * 4.0"; break;
-        case 0x3: result_shift_str = " * 8.0"; break;
-        case 0xD: result_shift_str = " / 8.0"; break;
-        case 0xE: result_shift_str = " / 4.0"; break;
-        case 0xF: result_shift_str = " / 2.0"; break;
-    } // switch
+    const char *result_shift_str = get_GLSL_result_shift_string(arg);
     need_parens |= (result_shift_str[0] != '\0');
 
     char regnum_str[16];
@@ -243,23 +249,13 @@ char *make_GLSL_swizzle_string(char *swiz_str, const size_t strsize,
 } // make_GLSL_swizzle_string
 
 
-const char *make_GLSL_srcarg_string(Context *ctx, const size_t idx,
-                                    const int writemask, char *buf,
-                                    const size_t buflen)
+// returns zero (and fails) if GLSL can't do this source modifier.
+static int get_GLSL_srcmod_strings(Context *ctx, const SourceMod src_mod,
+                                   const char **_premod, const char **_postmod)
 {
-    *buf = '\0';
-
-    if (idx >= STATICARRAYLEN(ctx->source_args))
-    {
-        fail(ctx, "Too many source args");
-        return buf;
-    } // if
-
-    const SourceArgInfo *arg = &ctx->source_args[idx];
-
     const char *premod_str = "";
     const char *postmod_str = "";
-    switch (arg->src_mod)
+    switch (src_mod)
     {
         case SRCMOD_NEGATE:
             premod_str = "-";
@@ -301,12 +297,12 @@ const char *make_GLSL_srcarg_string(Context *ctx, const size_t idx,
             break;
 
         case SRCMOD_DZ:
-            fail(ctx, "SRCMOD_DZ unsupported"); return buf; // !!! FIXME
+            fail(ctx, "SRCMOD_DZ unsupported"); return 0; // !!! FIXME
             postmod_str = "_dz";
             break;
 
         case SRCMOD_DW:
-            fail(ctx, "SRCMOD_DW unsupported"); return buf; // !!! FIXME
+            fail(ctx, "SRCMOD_DW unsupported"); return 0; // !!! FIXME
             postmod_str = "_dw";
             break;
 
@@ -329,6 +325,31 @@ const char *make_GLSL_srcarg_string(Context *ctx, const size_t idx,
              break;  // stop compiler whining.
     } // switch
 
+    *_premod = premod_str;
+    *_postmod = postmod_str;
+    return 1;
+} // get_GLSL_srcmod_strings
+
+
+const char *make_GLSL_srcarg_string(Context *ctx, const size_t idx,
+                                    const int writemask, char *buf,
+                                    const size_t buflen)
+{
+    *buf = '\0';
+
+    if (idx >= STATICARRAYLEN(ctx->source_args))
+    {
+        fail(ctx, "Too many source args");
+        return buf;
+    } // if
+
+    const SourceArgInfo *arg = &ctx->source_args[idx];
+
+    const char *premod_str = "";
+    const char *postmod_str = "";
+    if (!get_GLSL_srcmod_strings(ctx, arg->src_mod, &premod_str, &postmod_str))
+        return buf;
+
     const char *regtype_str = NULL;
 
     if (!arg->relative)
@@ -437,6 +458,167 @@ MAKE_GLSL_SRCARG_STRING_(vec3, 0x7)
 MAKE_GLSL_SRCARG_STRING_(vec2, 0x3)
 #undef MAKE_GLSL_SRCARG_STRING_
 
+// These write straight to ctx->output instead of snprintf()ing into scratch
+//  buffers first, for the opcodes that make up most of a typical shader.
+
+static inline void output_GLSL_varname(Context *ctx, const RegisterType rt,
+                                       const int regnum)
+{
+    output_str(ctx, ctx->shader_type_str);
+    output_char(ctx, '_');
+    output_register(ctx, rt, regnum);
+} // output_GLSL_varname
+
+static void output_GLSL_srcarg(Context *ctx, const size_t idx,
+                               const int writemask)
+{
+    if (idx >= STATICARRAYLEN(ctx->source_args))
+    {
+        fail(ctx, "Too many source args");
+        return;
+    } // if
+
+    const SourceArgInfo *arg = &ctx->source_args[idx];
+    if (arg->relative)  // rare enough that it can take the slow path.
+    {
+        char buf[64];
+        make_GLSL_srcarg_string(ctx, idx, writemask, buf, sizeof (buf));
+        output_str(ctx, buf);
+        return;
+    } // if
+
+    const char *premod_str = "";
+    const char *postmod_str = "";
+    if (!get_GLSL_srcmod_strings(ctx, arg->src_mod, &premod_str, &postmod_str))
+        return;
+
+    output_str(ctx, premod_str);
+    output_GLSL_varname(ctx, arg->regtype, arg->regnum);
+    if (!isscalar(ctx, ctx->shader_type, arg->regtype, arg->regnum))
+        output_swizzle(ctx, arg->swizzle, writemask);
+    output_str(ctx, postmod_str);
+} // output_GLSL_srcarg
+
+// generate some convenience functions.
+#define OUTPUT_GLSL_SRCARG_(mask, bitmask) \
+    static inline void output_GLSL_srcarg_##mask(Context *ctx, \
+                                                 const size_t idx) { \
+        output_GLSL_srcarg(ctx, idx, bitmask); \
+    }
+OUTPUT_GLSL_SRCARG_(scalar, (1 << 0))
+OUTPUT_GLSL_SRCARG_(masked, ctx->dest_arg.writemask)
+#undef OUTPUT_GLSL_SRCARG_
+
+// Starts a "dest = operation;" line, same as make_GLSL_destarg_assign().
+//  If this returns non-zero, output the operation, then call
+//  output_GLSL_assign_end().
+static int output_GLSL_assign_begin(Context *ctx)
+{
+    const DestArgInfo *arg = &ctx->dest_arg;
+
+    // CENTROID only allowed in DCL opcodes, which shouldn't come through here.
+    assert((arg->result_mod & MOD_CENTROID) == 0);
+
+    if ((arg->writemask != 0) && (ctx->predicated))
+        fail(ctx, "predicated destinations unsupported");  // !!! FIXME
+
+    if (!output_line_begin(ctx))
+        return 0;
+    else if (arg->writemask == 0)
+    {
+        output_line_end(ctx);  // no writemask? It's a no-op.
+        return 0;
+    } // else if
+
+    output_GLSL_varname(ctx, arg->regtype, arg->regnum);
+    if (!isscalar(ctx, ctx->shader_type, arg->regtype, arg->regnum))
+        output_swizzle(ctx, 0xE4, arg->writemask);  // 0xE4 == .xyzw
+    output_str(ctx, " = ");
+    if (arg->result_mod & MOD_SATURATE)
+        output_str(ctx, "clamp(");
+    if (*get_GLSL_result_shift_string(arg) != '\0')
+        output_char(ctx, '(');
+    return 1;
+} // output_GLSL_assign_begin
+
+static void output_GLSL_assign_end(Context *ctx)
+{
+    const DestArgInfo *arg = &ctx->dest_arg;
+    const char *result_shift_str = get_GLSL_result_shift_string(arg);
+    if (*result_shift_str != '\0')
+    {
+        output_char(ctx, ')');
+        output_str(ctx, result_shift_str);
+    } // if
+
+    // MSDN says MOD_PP is a hint and many implementations ignore it. So do we.
+    if (arg->result_mod & MOD_SATURATE)
+    {
+        const int vecsize = vecsize_from_writemask(arg->writemask);
+        if (vecsize == 1)
+            output_str(ctx, ", 0.0, 1.0)");
+        else
+        {
+            output_str(ctx, ", vec");
+            output_int(ctx, vecsize);
+            output_str(ctx, "(0.0), vec");
+            output_int(ctx, vecsize);
+            output_str(ctx, "(1.0))");
+        } // else
+    } // if
+
+    output_char(ctx, ';');
+    output_line_end(ctx);
+} // output_GLSL_assign_end
+
+// outputs "vecN" if the destination isn't a scalar.
+static void output_GLSL_vecsize_cast(Context *ctx)
+{
+    const int vecsize = vecsize_from_writemask(ctx->dest_arg.writemask);
+    if (vecsize != 1)
+    {
+        output_str(ctx, "vec");
+        output_int(ctx, vecsize);
+    } // if
+} // output_GLSL_vecsize_cast
+
+static void output_GLSL_binary_op(Context *ctx, const char *op)
+{
+    if (output_GLSL_assign_begin(ctx))
+    {
+        output_GLSL_srcarg_masked(ctx, 0);
+        output_str(ctx, op);
+        output_GLSL_srcarg_masked(ctx, 1);
+        output_GLSL_assign_end(ctx);
+    } // if
+} // output_GLSL_binary_op
+
+static void output_GLSL_unary_func(Context *ctx, const char *fn)
+{
+    if (output_GLSL_assign_begin(ctx))
+    {
+        output_str(ctx, fn);
+        output_char(ctx, '(');
+        output_GLSL_srcarg_masked(ctx, 0);
+        output_char(ctx, ')');
+        output_GLSL_assign_end(ctx);
+    } // if
+} // output_GLSL_unary_func
+
+static void output_GLSL_binary_func(Context *ctx, const char *fn)
+{
+    if (output_GLSL_assign_begin(ctx))
+    {
+        output_str(ctx, fn);
+        output_char(ctx, '(');
+        output_GLSL_srcarg_masked(ctx, 0);
+        output_str(ctx, ", ");
+        output_GLSL_srcarg_masked(ctx, 1);
+        output_char(ctx, ')');
+        output_GLSL_assign_end(ctx);
+    } // if
+} // output_GLSL_binary_func
+
 // special cases for comparison opcodes...
 
 const char *get_GLSL_comparison_string_scalar(Context *ctx)
@@ -1232,74 +1414,70 @@ void emit_GLSL_NOP(Context *ctx)
 
 void emit_GLSL_MOV(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char code[128];
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "%s", src0);
-    output_line(ctx, "%s", code);
+    if (output_GLSL_assign_begin(ctx))
+    {
+        output_GLSL_srcarg_masked(ctx, 0);
+        output_GLSL_assign_end(ctx);
+    } // if
 } // emit_GLSL_MOV
 
 void emit_GLSL_ADD(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_masked(ctx, 1, src1, sizeof (src1));
-    char code[128];
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "%s + %s", src0, src1);
-    output_line(ctx, "%s", code);
+    output_GLSL_binary_op(ctx, " + ");
 } // emit_GLSL_ADD
 
 void emit_GLSL_SUB(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_masked(ctx, 1, src1, sizeof (src1));
-    char code[128];
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "%s - %s", src0, src1);
-    output_line(ctx, "%s", code);
+    output_GLSL_binary_op(ctx, " - ");
 } // emit_GLSL_SUB
 
 void emit_GLSL_MAD(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_masked(ctx, 1, src1, sizeof (src1));
-    char src2[64]; make_GLSL_srcarg_string_masked(ctx, 2, src2, sizeof (src2));
-    char code[128];
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "(%s * %s) + %s", src0, src1, src2);
-    output_line(ctx, "%s", code);
+    if (output_GLSL_assign_begin(ctx))
+    {
+        output_char(ctx, '(');
+        output_GLSL_srcarg_masked(ctx, 0);
+        output_str(ctx, " * ");
+        output_GLSL_srcarg_masked(ctx, 1);
+        output_str(ctx, ") + ");
+        output_GLSL_srcarg_masked(ctx, 2);
+        output_GLSL_assign_end(ctx);
+    } // if
 } // emit_GLSL_MAD
 
 void emit_GLSL_MUL(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_masked(ctx, 1, src1, sizeof (src1));
-    char code[128];
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "%s * %s", src0, src1);
-    output_line(ctx, "%s", code);
+    output_GLSL_binary_op(ctx, " * ");
 } // emit_GLSL_MUL
 
 void emit_GLSL_RCP(Context *ctx)
 {
-    const int vecsize = vecsize_from_writemask(ctx->dest_arg.writemask);
-    char cast[16] = { '\0' };
-    if (vecsize != 1)
-        snprintf(cast, sizeof (cast), "vec%d", vecsize);
-    char src0[64]; make_GLSL_srcarg_string_scalar(ctx, 0, src0, sizeof (src0));
-    char code[128];
     ctx->need_max_float = 1;
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "%s((%s == 0.0) ? FLT_MAX : 1.0 / %s)", cast, src0, src0);
-    output_line(ctx, "%s", code);
+    if (output_GLSL_assign_begin(ctx))
+    {
+        output_GLSL_vecsize_cast(ctx);
+        output_str(ctx, "((");
+        output_GLSL_srcarg_scalar(ctx, 0);
+        output_str(ctx, " == 0.0) ? FLT_MAX : 1.0 / ");
+        output_GLSL_srcarg_scalar(ctx, 0);
+        output_char(ctx, ')');
+        output_GLSL_assign_end(ctx);
+    } // if
 } // emit_GLSL_RCP
 
 void emit_GLSL_RSQ(Context *ctx)
 {
-    const int vecsize = vecsize_from_writemask(ctx->dest_arg.writemask);
-    char cast[16] = { '\0' };
-    if (vecsize != 1)
-        snprintf(cast, sizeof (cast), "vec%d", vecsize);
-
-    char src0[64]; make_GLSL_srcarg_string_scalar(ctx, 0, src0, sizeof (src0));
-    char code[128];
     ctx->need_max_float = 1;
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "%s((%s == 0.0) ? FLT_MAX : inversesqrt(abs(%s)))", cast, src0, src0);
-    output_line(ctx, "%s", code);
+    if (output_GLSL_assign_begin(ctx))
+    {
+        output_GLSL_vecsize_cast(ctx);
+        output_str(ctx, "((");
+        output_GLSL_srcarg_scalar(ctx, 0);
+        output_str(ctx, " == 0.0) ? FLT_MAX : inversesqrt(abs(");
+        output_GLSL_srcarg_scalar(ctx, 0);
+        output_str(ctx, ")))");
+        output_GLSL_assign_end(ctx);
+    } // if
 } // emit_GLSL_RSQ
 
 void emit_GLSL_dotprod(Context *ctx, const char *src0, const char *src1,
@@ -1320,93 +1498,96 @@ void emit_GLSL_dotprod(Context *ctx, const char *src0, const char *src1,
     output_line(ctx, "%s", code);
 } // emit_GLSL_dotprod
 
+static void output_GLSL_dotprod(Context *ctx, const int srcmask)
+{
+    if (output_GLSL_assign_begin(ctx))
+    {
+        const int vecsize = vecsize_from_writemask(ctx->dest_arg.writemask);
+        if (vecsize != 1)
+        {
+            output_GLSL_vecsize_cast(ctx);
+            output_char(ctx, '(');
+        } // if
+        output_str(ctx, "dot(");
+        output_GLSL_srcarg(ctx, 0, srcmask);
+        output_str(ctx, ", ");
+        output_GLSL_srcarg(ctx, 1, srcmask);
+        output_char(ctx, ')');
+        if (vecsize != 1)
+            output_char(ctx, ')');
+        output_GLSL_assign_end(ctx);
+    } // if
+} // output_GLSL_dotprod
+
 void emit_GLSL_DP3(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_vec3(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_vec3(ctx, 1, src1, sizeof (src1));
-    emit_GLSL_dotprod(ctx, src0, src1, "");
+    output_GLSL_dotprod(ctx, 0x7);
 } // emit_GLSL_DP3
 
 void emit_GLSL_DP4(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_full(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_full(ctx, 1, src1, sizeof (src1));
-    emit_GLSL_dotprod(ctx, src0, src1, "");
+    output_GLSL_dotprod(ctx, 0xF);
 } // emit_GLSL_DP4
 
 void emit_GLSL_MIN(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_masked(ctx, 1, src1, sizeof (src1));
-    char code[128];
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "min(%s, %s)", src0, src1);
-    output_line(ctx, "%s", code);
+    output_GLSL_binary_func(ctx, "min");
 } // emit_GLSL_MIN
 
 void emit_GLSL_MAX(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_masked(ctx, 1, src1, sizeof (src1));
-    char code[128];
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "max(%s, %s)", src0, src1);
-    output_line(ctx, "%s", code);
+    output_GLSL_binary_func(ctx, "max");
 } // emit_GLSL_MAX
 
-void emit_GLSL_SLT(Context *ctx)
+static void output_GLSL_comparison(Context *ctx, const char *op,
+                                   const char *vecfn)
 {
-    const int vecsize = vecsize_from_writemask(ctx->dest_arg.writemask);
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_masked(ctx, 1, src1, sizeof (src1));
-    char code[128];
+    if (output_GLSL_assign_begin(ctx))
+    {
+        const int vecsize = vecsize_from_writemask(ctx->dest_arg.writemask);
+        if (vecsize == 1)
+        {
+            output_str(ctx, "float(");
+            output_GLSL_srcarg_masked(ctx, 0);
+            output_str(ctx, op);
+            output_GLSL_srcarg_masked(ctx, 1);
+            output_char(ctx, ')');
+        } // if
+        else
+        {
+            output_GLSL_vecsize_cast(ctx);
+            output_char(ctx, '(');
+            output_str(ctx, vecfn);
+            output_char(ctx, '(');
+            output_GLSL_srcarg_masked(ctx, 0);
+            output_str(ctx, ", ");
+            output_GLSL_srcarg_masked(ctx, 1);
+            output_str(ctx, "))");
+        } // else
+        output_GLSL_assign_end(ctx);
+    } // if
+} // output_GLSL_comparison
 
+void emit_GLSL_SLT(Context *ctx)
+{
     // float(bool) or vec(bvec) results in 0.0 or 1.0, like SLT wants.
-    if (vecsize == 1)
-        make_GLSL_destarg_assign(ctx, code, sizeof (code), "float(%s < %s)", src0, src1);
-    else
-    {
-        make_GLSL_destarg_assign(ctx, code, sizeof (code),
-                                 "vec%d(lessThan(%s, %s))",
-                                 vecsize, src0, src1);
-    } // else
-    output_line(ctx, "%s", code);
+    output_GLSL_comparison(ctx, " < ", "lessThan");
 } // emit_GLSL_SLT
 
 void emit_GLSL_SGE(Context *ctx)
 {
-    const int vecsize = vecsize_from_writemask(ctx->dest_arg.writemask);
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char src1[64]; make_GLSL_srcarg_string_masked(ctx, 1, src1, sizeof (src1));
-    char code[128];
-
     // float(bool) or vec(bvec) results in 0.0 or 1.0, like SGE wants.
-    if (vecsize == 1)
-    {
-        make_GLSL_destarg_assign(ctx, code, sizeof (code),
-                                 "float(%s >= %s)", src0, src1);
-    } // if
-    else
-    {
-        make_GLSL_destarg_assign(ctx, code, sizeof (code),
-                                 "vec%d(greaterThanEqual(%s, %s))",
-                                 vecsize, src0, src1);
-    } // else
-    output_line(ctx, "%s", code);
+    output_GLSL_comparison(ctx, " >= ", "greaterThanEqual");
 } // emit_GLSL_SGE
 
 void emit_GLSL_EXP(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char code[128];
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "exp2(%s)", src0);
-    output_line(ctx, "%s", code);
+    output_GLSL_unary_func(ctx, "exp2");
 } // emit_GLSL_EXP
 
 void emit_GLSL_LOG(Context *ctx)
 {
-    char src0[64]; make_GLSL_srcarg_string_masked(ctx, 0, src0, sizeof (src0));
-    char code[128];
-    make_GLSL_destarg_assign(ctx, code, sizeof (code), "log2(%s)", src0);
-    output_line(ctx, "%s", code);
+    output_GLSL_unary_func(ctx, "log2");
 } // emit_GLSL_LOG
 
 void emit_GLSL_LIT_helper(Context *ctx)
@@ -1341,7 +1341,7 @@ static void spv_emit_vs_main_end(Context* ctx)
     spv_emit(ctx, 2, SpvOpLabel, id_label);
 
     RegisterList *reg;
-    for (reg = ctx->used_registers.next; reg != NULL; reg = reg->next)
+    for (reg = reglist_first(&ctx->used_registers); reg != NULL; reg = reg->next)
     {
         if (reg->usage == MOJOSHADER_USAGE_POSITION &&
             (reg->regtype == REG_TYPE_RASTOUT || reg->regtype == REG_TYPE_OUTPUT))
@@ -2559,9 +2559,7 @@ void emit_SPIRV_finalize(Context *ctx)
     );
     spv_emit_str(ctx, ctx->mainfn);
 
-    RegisterList *p = &ctx->attributes, *r = NULL;
-    // !!! FIXME: The first element of the list is always empty and I don't know why!
-    p = p->next;
+    RegisterList *p = reglist_first(&ctx->attributes), *r = NULL;
     while (p)
     {
         r = spv_getreg(ctx, p->regtype, p->regnum);
@@ -0,0 +1,11 @@
+float4 main(float4 a : COLOR0, float4 b : COLOR1) : COLOR0
+{
+    float4 x;
+    float4 y;
+    float4 z;
+    x = a * b + 1.0;
+    y = a * b + 1.0;
+    a = a * b;
+    z = a * b;
+    return x + y + z;
+}
@@ -0,0 +1,12 @@
+float f(float x)
+{
+    return x * 2.0;
+    x = x + 1.0;
+}
+
+float4 main(float4 c : COLOR0) : COLOR0
+{
+    float t = 3.0;
+    c.x + 1.0;
+    return c + f(c.x);
+}
@@ -0,0 +1,12 @@
+float4 main(float4 c : COLOR0) : COLOR0
+{
+    int a;
+    int b;
+    float f;
+    a = (7 * 6) - (10 / 3) + (1 << 4);
+    b = 5 / 0;
+    f = (1.5 + 2.5) * 0.5;
+    if (2 > 1)
+        a = a + 1;
+    return c * f + a + b;
+}
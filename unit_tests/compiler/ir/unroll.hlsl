@@ -0,0 +1,10 @@
+float4 main(float4 c : COLOR0) : COLOR0
+{
+    float4 sum = c;
+    int i;
+    [unroll] for (i = 0; i < 3; i++)
+        sum = sum * 2.0;
+    [loop] for (int j = 0; j < 2; j++)
+        sum = sum + 1.0;
+    return sum + i;
+}
@@ -0,0 +1,4 @@
+#ifndef UNDEF_H
+#define UNDEF_H
+undef_body
+#endif
@@ -0,0 +1,11 @@
+// a classic include guard.
+#ifndef GUARDED_H
+#define GUARDED_H
+
+#ifdef ALREADY
+guarded_nested
+#else
+guarded_body
+#endif
+
+#endif  /* GUARDED_H */
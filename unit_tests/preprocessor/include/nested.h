@@ -0,0 +1,4 @@
+// includes other headers, one of them guarded.
+nested_body
+#include "preprocessor/include/guarded.h"
+#include "preprocessor/include/pragma-once.h"
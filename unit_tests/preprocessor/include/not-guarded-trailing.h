@@ -0,0 +1,5 @@
+#ifndef TRAILING_H
+#define TRAILING_H
+trailing_inside
+#endif
+trailing_outside
@@ -51,26 +51,81 @@ sub compare_files {
 
 my %tests = ();
 
-$tests{'output'} = sub {
-    my ($module, $fname) = @_;
+# Tests that run a program to write an output file, then compare that file
+#  against the .correct one. Keyed by test type: the module the tests live
+#  in, the command line (given the input and output filenames), and what to
+#  report if the program fails.
+my %outputtests = (
+    'output' => [
+        'preprocessor',
+        sub { "$binpath/mojoshader-compiler -P '$_[0]' -o '$_[1]'" },
+        "External program reported error"
+    ],
+    'includecache' => [
+        'preprocessor',
+        sub { "$binpath/testincludecache -o '$_[1]' '$_[0]'" },
+        "Cached includes don't match MOJOSHADER_preprocess"
+    ],
+    'deps' => [
+        'preprocessor',
+        sub { "$binpath/mojoshader-compiler -P '$_[0]' -o /dev/null -MF '$_[1]' -MT target" },
+        "External program reported error"
+    ],
+    'optimize' => [
+        'parser',
+        sub { "$binpath/testoptimize -d '$_[1]' '$_[0]'" },
+        "Optimized parse doesn't match the original"
+    ],
+    'cache' => [
+        'parser',
+        sub { "$binpath/testparsecache -c unittest_tempcache -o '$_[1]' '$_[0]'" },
+        "Cached parse doesn't match the original"
+    ],
+    'batch' => [
+        'parser',
+        sub { "$binpath/testparsebatch -o '$_[1]' '$_[0]'" },
+        "Batch parse doesn't match the serial one"
+    ],
+    'emit' => [
+        'parser',
+        sub { "$binpath/testemit -o '$_[1]' '$_[0]'" },
+        "Emitted output doesn't match the parse"
+    ],
+    'reflect' => [
+        'parser',
+        sub { "$binpath/testreflect -o '$_[1]' '$_[0]'" },
+        "Reflection doesn't match the parse"
+    ],
+    'chunks' => [
+        'parser',
+        sub { "$binpath/testchunks -o '$_[1]' '$_[0]'" },
+        "Output chunks don't match the parse"
+    ],
+    'ir' => [
+        'compiler',
+        sub { "$binpath/testirpasses -o '$_[1]' '$_[0]'" },
+        "External program reported error"
+    ],
+);
+
+sub run_output_test {
+    my ($testtype, $module, $fname) = @_;
+    my ($wantmodule, $mkcmd, $failmsg) = @{$outputtests{$testtype}};
     my $output = 'unittest_tempoutput';
     my $desired = $fname . '.correct';
-    my $cmd = undef;
     my $endlines = 1;
 
-    # !!! FIXME: this should go elsewhere.
-    if ($module eq 'preprocessor') {
-        $cmd = "$binpath/mojoshader-compiler -P '$fname' -o '$output'";
-    } else {
+    if ($module ne $wantmodule) {
         return (0, "Don't know how to do this module type");
     }
-    $cmd .= ' 2>/dev/null 1>/dev/null';
+
+    my $cmd = &$mkcmd($fname, $output) . ' 2>/dev/null 1>/dev/null';
 
     print("$cmd\n") if ($GPrintCmds);
 
     if (system($cmd) != 0) {
         unlink($output) if (-f $output);
-        return (0, "External program reported error");
+        return (0, $failmsg);
     }
 
     if (not -f $output) { return (0, "Didn't get any output file"); }
@@ -78,7 +133,12 @@ $tests{'output'} = sub {
     my @retval = compare_files($desired, $output, $endlines);
     unlink($output);
     return @retval;
-};
+}
+
+foreach (keys %outputtests) {
+    my $testtype = $_;
+    $tests{$testtype} = sub { return run_output_test($testtype, @_); };
+}
 
 $tests{'errors'} = sub {
     my ($module, $fname) = @_;
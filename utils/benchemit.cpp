@@ -0,0 +1,181 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Parses shaders over and over and reports how many lines of output the
+//  text profiles produce per second. This is meant for comparing changes to
+//  the emitters, so the numbers are only interesting relative to each other
+//  on the same machine.
+//
+// If MojoShader was built with PARSE_STATS, this also reports lines per
+//  second for just the emitters, without the decoding and bookkeeping that
+//  every MOJOSHADER_parse() call pays for.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include "../mojoshader.h"
+
+static const char *default_profiles[] =
+{
+    MOJOSHADER_PROFILE_D3D,
+    MOJOSHADER_PROFILE_GLSL,
+    MOJOSHADER_PROFILE_GLSL120,
+    MOJOSHADER_PROFILE_GLSLES,
+    MOJOSHADER_PROFILE_ARB1,
+    MOJOSHADER_PROFILE_NV4,
+};
+
+typedef struct Shader
+{
+    const char *fname;
+    unsigned char *buf;
+    int len;
+} Shader;
+
+static unsigned long long count_lines(const MOJOSHADER_parseData *pd)
+{
+    unsigned long long retval = 0;
+    const char *ptr = pd->output.data();
+    const char *end = ptr + pd->output_len;
+    while ((ptr = (const char *) memchr(ptr, '\n', end - ptr)) != NULL)
+    {
+        retval++;
+        ptr++;
+    } // while
+    return retval;
+} // count_lines
+
+static unsigned long long now_ns(void)
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return (unsigned long long)
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+} // now_ns
+
+static double per_second(const unsigned long long count,
+                         const unsigned long long ns)
+{
+    return (ns == 0) ? 0.0 : (((double) count) * 1000000000.0) / ((double) ns);
+} // per_second
+
+static int bench_profile(const char *prof, const Shader *shaders,
+                         const int shadercount, const int iterations)
+{
+    unsigned long long lines = 0;
+    unsigned long long emit_ns = 0;
+    int have_stats = 0;
+    int failures = 0;
+    int i, j;
+
+    const unsigned long long start = now_ns();
+    for (i = 0; i < iterations; i++)
+    {
+        for (j = 0; j < shadercount; j++)
+        {
+            const Shader *shader = &shaders[j];
+            const MOJOSHADER_parseData *pd;
+            pd = MOJOSHADER_parse(prof, NULL, shader->buf, shader->len,
+                                  NULL, 0, NULL, 0, NULL, NULL, NULL);
+            if (pd->error_count > 0)
+            {
+                if (i == 0)
+                {
+                    printf("  %s: %s: %s\n", prof, shader->fname,
+                           pd->errors[0].error.c_str());
+                    failures++;
+                } // if
+            } // if
+            else
+            {
+                lines += count_lines(pd);
+                if (pd->stats != NULL)
+                {
+                    have_stats = 1;
+                    emit_ns += pd->stats->emit_ns;
+                } // if
+            } // else
+            delete pd;
+        } // for
+    } // for
+    const unsigned long long total_ns = now_ns() - start;
+
+    printf("%-10s %10llu lines %10.2f ms %14.0f lines/sec",
+           prof, lines, ((double) total_ns) / 1000000.0,
+           per_second(lines, total_ns));
+    if (have_stats)
+        printf("  (emitters: %.0f lines/sec)", per_second(lines, emit_ns));
+    printf("\n");
+
+    return (failures == 0);
+} // bench_profile
+
+int main(int argc, char **argv)
+{
+    const char *profile = NULL;
+    int iterations = 1000;
+    int retval = 0;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-n") == 0) && (i < argc - 1))
+            iterations = atoi(argv[++i]);
+        else if ((strcmp(argv[i], "-p") == 0) && (i < argc - 1))
+            profile = argv[++i];
+        else
+            break;
+    } // for
+
+    if ((i >= argc) || (iterations <= 0))
+    {
+        printf("\n\nUSAGE: %s [-n iterations] [-p profile] [file1] ... [fileN]\n\n", argv[0]);
+        return 1;
+    } // if
+
+    const int shadercount = argc - i;
+    Shader *shaders = (Shader *) calloc(shadercount, sizeof (Shader));
+    for (int j = 0; j < shadercount; j++)
+    {
+        Shader *shader = &shaders[j];
+        shader->fname = argv[i + j];
+        FILE *io = fopen(shader->fname, "rb");
+        if (io == NULL)
+        {
+            printf(" ... fopen('%s') failed.\n", shader->fname);
+            retval = 1;
+            continue;
+        } // if
+        shader->buf = (unsigned char *) malloc(1000000);
+        shader->len = (int) fread(shader->buf, 1, 1000000, io);
+        fclose(io);
+    } // for
+
+    if (retval == 0)
+    {
+        printf("%d shader(s), %d iteration(s)\n", shadercount, iterations);
+        if (profile != NULL)
+            retval = !bench_profile(profile, shaders, shadercount, iterations);
+        else
+        {
+            const size_t count = sizeof (default_profiles) / sizeof (default_profiles[0]);
+            for (size_t p = 0; p < count; p++)
+            {
+                if (!bench_profile(default_profiles[p], shaders, shadercount, iterations))
+                    retval = 1;
+            } // for
+        } // else
+    } // if
+
+    for (int j = 0; j < shadercount; j++)
+        free(shaders[j].buf);
+    free(shaders);
+
+    return retval;
+} // main
+
+// end of benchemit.c ...
@@ -0,0 +1,162 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Runs the lexer over HLSL or assembly source over and over and reports how
+//  many megabytes (and tokens) it gets through per second. This only
+//  measures the lexer itself: no preprocessing, no #includes, no parsing,
+//  so point it at a pile of real shaders and compare builds on the same
+//  machine. Build MojoShader with -DLEXER_SIMD=0 to get the plain C numbers.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#define __MOJOSHADER_INTERNAL__ 1
+#include "../mojoshader_internal.h"
+
+typedef struct Source
+{
+    const char *fname;
+    char *buf;
+    unsigned int len;
+} Source;
+
+static unsigned long long now_ns(void)
+{
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return (unsigned long long)
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now).count();
+} // now_ns
+
+static double per_second(const double count, const unsigned long long ns)
+{
+    return (ns == 0) ? 0.0 : (count * 1000000000.0) / ((double) ns);
+} // per_second
+
+// lex all of (src) the way the preprocessor would, returns the token count.
+static unsigned long long lex_source(const Source *src, const int whitespace,
+                                     const int asm_comments)
+{
+    unsigned long long retval = 0;
+    IncludeState state;
+    memset(&state, '\0', sizeof (state));
+    state.filename = src->fname;
+    state.source_base = src->buf;
+    state.source = src->buf;
+    state.token = src->buf;
+    state.tokenval = ((Token) '\n');
+    state.orig_length = src->len;
+    state.bytes_left = src->len;
+    state.line = 1;
+    state.report_whitespace = whitespace;
+    state.report_comments = whitespace;
+    state.asm_comments = asm_comments;
+
+    while (preprocessor_lexer(&state) != TOKEN_EOI)
+        retval++;
+
+    return retval;
+} // lex_source
+
+int main(int argc, char **argv)
+{
+    int iterations = 100;
+    int whitespace = 0;
+    int asm_comments = 0;
+    int retval = 0;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-n") == 0) && (i < argc - 1))
+            iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-w") == 0)
+            whitespace = 1;
+        else if (strcmp(argv[i], "-asm") == 0)
+            asm_comments = 1;
+        else
+            break;
+    } // for
+
+    if ((i >= argc) || (iterations <= 0))
+    {
+        printf("\n\nUSAGE: %s [-n iterations] [-w] [-asm] [file1] ... [fileN]\n\n", argv[0]);
+        printf("  -w reports whitespace and comments as tokens.\n");
+        printf("  -asm treats ';' as a comment, like assembly source.\n\n");
+        return 1;
+    } // if
+
+    const int sourcecount = argc - i;
+    Source *sources = (Source *) calloc(sourcecount, sizeof (Source));
+    for (int j = 0; j < sourcecount; j++)
+    {
+        Source *src = &sources[j];
+        src->fname = argv[i + j];
+        FILE *io = fopen(src->fname, "rb");
+        if (io == NULL)
+        {
+            printf(" ... fopen('%s') failed.\n", src->fname);
+            retval = 1;
+            continue;
+        } // if
+
+        long fsize = -1;
+        if (fseek(io, 0, SEEK_END) != -1)
+            fsize = ftell(io);
+        if ((fsize == -1) || (fseek(io, 0, SEEK_SET) == -1))
+        {
+            printf(" ... seek('%s') failed.\n", src->fname);
+            fclose(io);
+            retval = 1;
+            continue;
+        } // if
+
+        src->buf = (char *) malloc(fsize + 1);
+        src->len = (unsigned int) fread(src->buf, 1, fsize, io);
+        src->buf[src->len] = '\0';
+        fclose(io);
+    } // for
+
+    if (retval == 0)
+    {
+        unsigned long long bytes = 0;
+        unsigned long long tokens = 0;
+        unsigned long long total_ns = 0;
+
+        printf("%d file(s), %d iteration(s)\n", sourcecount, iterations);
+        for (int j = 0; j < sourcecount; j++)
+        {
+            const Source *src = &sources[j];
+            unsigned long long count = 0;
+            const unsigned long long start = now_ns();
+            for (int k = 0; k < iterations; k++)
+                count += lex_source(src, whitespace, asm_comments);
+            const unsigned long long ns = now_ns() - start;
+            const double mb = (((double) src->len) * iterations) / (1024.0 * 1024.0);
+
+            printf("%-40s %10u bytes %10llu tokens %10.2f MB/sec\n",
+                   src->fname, src->len, count / iterations,
+                   per_second(mb, ns));
+
+            bytes += ((unsigned long long) src->len) * iterations;
+            tokens += count;
+            total_ns += ns;
+        } // for
+
+        printf("total: %.2f MB/sec, %.0f tokens/sec\n",
+               per_second(((double) bytes) / (1024.0 * 1024.0), total_ns),
+               per_second((double) tokens, total_ns));
+    } // if
+
+    for (int j = 0; j < sourcecount; j++)
+        free(sources[j].buf);
+    free(sources);
+
+    return retval;
+} // main
+
+// end of benchlexer.c ...
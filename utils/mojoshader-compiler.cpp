@@ -20,6 +20,10 @@
 
 static const char **include_paths = NULL;
 static unsigned int include_path_count = 0;
+static char **dependencies = NULL;
+static int dependency_count = 0;
+static int deps_from_preprocess = 0;  // -MF with -P: use pd->includes.
+static int deps_from_open = 0;  // -MF otherwise: open_include keeps track.
 
 #define MOJOSHADER_DEBUG_MALLOC 0
 
@@ -733,57 +737,106 @@ static void print_ast(FILE *io, const int substmt, const void *_ast)
 } // print_ast
 
 
-static int open_include(MOJOSHADER_includeType inctype, const char *fname,
-                        const char *parent, const char **outdata,
-                        unsigned int *outbytes, MOJOSHADER_malloc m,
-                        MOJOSHADER_free f, void *d)
+// Looks for (fname) in each include path, in order. The caller gets the
+//  open file and the path it was found at, which they must free().
+static FILE *find_include(const char *fname, char **_path)
 {
     int i;
     for (i = 0; i < include_path_count; i++)
     {
         const char *path = include_paths[i];
         const size_t len = strlen(path) + strlen(fname) + 2;
-        char *buf = (char *) m(len, d);
+        char *buf = (char *) malloc(len);
         if (buf == NULL)
-            return 0;
+            return NULL;
 
         snprintf(buf, len, "%s/%s", path, fname);
         FILE *io = fopen(buf, "rb");
-        f(buf, d);
-        if (io == NULL)
-            continue;
-
-        if (fseek(io, 0, SEEK_END) != -1)
+        if (io != NULL)
         {
-            const long fsize = ftell(io);
-            if ((fsize == -1) || (fseek(io, 0, SEEK_SET) == -1))
-            {
-                fclose(io);
-                return 0;
-            } // if
+            *_path = buf;
+            return io;
+        } // if
+        free(buf);
+    } // for
 
-            char *data = (char *) m(fsize, d);
-            if (data == NULL)
-            {
-                fclose(io);
-                return 0;
-            } // if
+    return NULL;
+} // find_include
 
-            if (fread(data, fsize, 1, io) != 1)
-            {
-                f(data, d);
-                fclose(io);
-                return 0;
-            } // if
 
-            fclose(io);
-            *outdata = data;
-            *outbytes = (unsigned int) fsize;
-            return 1;
+// Remembers the path a header was found at, for -MF. Takes ownership of
+//  (path). A header that gets #included again is only listed once.
+static void add_dependency(char *path)
+{
+    int i;
+    for (i = 0; i < dependency_count; i++)
+    {
+        if (strcmp(dependencies[i], path) == 0)
+        {
+            free(path);
+            return;
         } // if
     } // for
 
-    return 0;
+    char **ptr = (char **) realloc(dependencies,
+                            (dependency_count+1) * sizeof (char *));
+    if (ptr == NULL)
+    {
+        free(path);
+        return;
+    } // if
+
+    dependencies = ptr;
+    dependencies[dependency_count++] = path;
+} // add_dependency
+
+
+static int open_include(MOJOSHADER_includeType inctype, const char *fname,
+                        const char *parent, const char **outdata,
+                        unsigned int *outbytes, MOJOSHADER_malloc m,
+                        MOJOSHADER_free f, void *d)
+{
+    char *path = NULL;
+    FILE *io = find_include(fname, &path);
+    if (io == NULL)
+        return 0;
+
+    if (deps_from_open)
+        add_dependency(path);
+    else
+        free(path);
+
+    if (fseek(io, 0, SEEK_END) == -1)
+    {
+        fclose(io);
+        return 0;
+    } // if
+
+    const long fsize = ftell(io);
+    if ((fsize == -1) || (fseek(io, 0, SEEK_SET) == -1))
+    {
+        fclose(io);
+        return 0;
+    } // if
+
+    char *data = (char *) m(fsize, d);
+    if (data == NULL)
+    {
+        fclose(io);
+        return 0;
+    } // if
+
+    if (fread(data, fsize, 1, io) != 1)
+    {
+        f(data, d);
+        fclose(io);
+        return 0;
+    } // if
+
+    fclose(io);
+    *outdata = data;
+    *outbytes = (unsigned int) fsize;
+    return 1;
 } // open_include
 
 
@@ -794,6 +847,25 @@ static void close_include(const char *data, MOJOSHADER_malloc m,
 } // close_include
 
 
+// MOJOSHADER_preprocess() hands back the name of every file it #included,
+//  so -P gets its -MF dependencies from there. The names get mapped back to
+//  paths the same way open_include found them.
+static void add_preprocess_dependencies(const MOJOSHADER_preprocessData *pd)
+{
+    int i;
+    for (i = 0; i < pd->include_count; i++)
+    {
+        char *path = NULL;
+        FILE *io = find_include(pd->includes[i].filename, &path);
+        if (io != NULL)
+        {
+            fclose(io);
+            add_dependency(path);
+        } // if
+    } // for
+} // add_preprocess_dependencies
+
+
 static int preprocess(const char *fname, const char *buf, int len,
                       const char *outfile,
                       const MOJOSHADER_preprocessorDefine *defs,
@@ -818,6 +890,9 @@ static int preprocess(const char *fname, const char *buf, int len,
     } // if
     else
     {
+        if (deps_from_preprocess)
+            add_preprocess_dependencies(pd);
+
         if (pd->output != NULL)
         {
             const int len = pd->output_len;
@@ -927,6 +1002,65 @@ static int compile(const char *fname, const char *buf, int len,
     return 1;
 } // compile
 
+// Make wants spaces and '#' escaped with a backslash, and '$' doubled.
+static void write_make_filename(FILE *io, const char *fname)
+{
+    const char *ptr;
+    for (ptr = fname; *ptr; ptr++)
+    {
+        if ((*ptr == ' ') || (*ptr == '#'))
+            fputc('\\', io);
+        else if (*ptr == '$')
+            fputc('$', io);
+        fputc(*ptr, io);
+    } // for
+} // write_make_filename
+
+
+// Writes a Make-style dependency file, like gcc's "-MD -MP": (target)
+//  depends on the source file and every file it #includes, and each of
+//  those headers gets an empty rule of its own, so make doesn't fail when
+//  one of them is deleted. The headers were collected while the action ran
+//  (see deps_from_preprocess), so this doesn't have to preprocess again.
+static int write_dependencies(const char *fname, const char *target,
+                              const char *depfile)
+{
+    int i;
+
+    FILE *io = fopen(depfile, "wb");
+    if (io == NULL)
+    {
+        printf(" ... fopen('%s') failed.\n", depfile);
+        return 0;
+    } // if
+
+    write_make_filename(io, target);
+    fputs(": ", io);
+    write_make_filename(io, fname);
+    for (i = 0; i < dependency_count; i++)
+    {
+        fputs(" \\\n ", io);
+        write_make_filename(io, dependencies[i]);
+    } // for
+    fputs("\n", io);
+
+    for (i = 0; i < dependency_count; i++)
+    {
+        fputs("\n", io);
+        write_make_filename(io, dependencies[i]);
+        fputs(":\n", io);
+    } // for
+
+    if (fclose(io) == EOF)
+    {
+        printf(" ... fclose('%s') failed.\n", depfile);
+        return 0;
+    } // if
+
+    return 1;
+} // write_dependencies
+
+
 typedef enum
 {
     ACTION_UNKNOWN,
@@ -944,6 +1078,8 @@ int main(int argc, char **argv)
     int retval = 1;
     const char *infile = NULL;
     const char *outfile = NULL;
+    const char *depfile = NULL;
+    const char *deptarget = NULL;
     int i;
 
     MOJOSHADER_preprocessorDefine *defs = NULL;
@@ -1004,6 +1140,28 @@ int main(int argc, char **argv)
             outfile = arg;
         } // if
 
+        else if (strcmp(arg, "-MF") == 0)
+        {
+            if (depfile != NULL)
+                fail("multiple dependency files specified");
+
+            arg = argv[++i];
+            if (arg == NULL)
+                fail("no filename after '-MF'");
+            depfile = arg;
+        } // else if
+
+        else if (strcmp(arg, "-MT") == 0)
+        {
+            if (deptarget != NULL)
+                fail("multiple dependency targets specified");
+
+            arg = argv[++i];
+            if (arg == NULL)
+                fail("no target after '-MT'");
+            deptarget = arg;
+        } // else if
+
         else if (strcmp(arg, "-I") == 0)
         {
             arg = argv[++i];
@@ -1074,6 +1232,12 @@ int main(int argc, char **argv)
     if (outio == NULL)
         fail("failed to open output file");
 
+    // The assembler and compiler don't report what they #included, so
+    //  open_include has to keep track for them.
+    if ((depfile != NULL) && (action == ACTION_PREPROCESS))
+        deps_from_preprocess = 1;
+    else if (depfile != NULL)
+        deps_from_open = 1;
 
     if (action == ACTION_PREPROCESS)
         retval = (!preprocess(infile, buf, rc, outfile, defs, defcount, outio));
@@ -1084,6 +1248,13 @@ int main(int argc, char **argv)
     else if (action == ACTION_COMPILE)
         retval = (!compile(infile, buf, rc, outfile, defs, defcount, outio));
 
+    if ((retval == 0) && (depfile != NULL))
+    {
+        if (deptarget == NULL)
+            deptarget = outfile ? outfile : infile;
+        retval = (!write_dependencies(infile, deptarget, depfile));
+    } // if
+
     if ((retval != 0) && (outfile != NULL))
         remove(outfile);
 
@@ -1095,6 +1266,10 @@ int main(int argc, char **argv)
 
     free(include_paths);
 
+    for (i = 0; i < dependency_count; i++)
+        free(dependencies[i]);
+    free(dependencies);
+
     return retval;
 } // main
 
@@ -0,0 +1,322 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Translates each shader under every profile with MOJOSHADER_parseChunked(),
+//  and makes sure the pieces MOJOSHADER_getOutputChunks() hands back add up
+//  to exactly what MOJOSHADER_parse() gives for the same profile, byte for
+//  byte, and that everything else in the results matches. It also makes
+//  sure getOutputChunks() never writes past (max), whatever (max) is, and
+//  always returns the total. A line per profile goes to the report file, so
+//  unit_tests can compare it. Exits non-zero on a mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mojoshader.h"
+
+static const char *profiles[] =
+{
+    MOJOSHADER_PROFILE_D3D,
+    MOJOSHADER_PROFILE_BYTECODE,
+    MOJOSHADER_PROFILE_GLSL,
+    MOJOSHADER_PROFILE_GLSL120,
+    MOJOSHADER_PROFILE_ARB1,
+    MOJOSHADER_PROFILE_NV4,
+};
+
+#define PROFILE_COUNT ((int) (sizeof (profiles) / sizeof (profiles[0])))
+
+static const char *compare_reflection(const MOJOSHADER_parseData *a,
+                                      const MOJOSHADER_parseData *b)
+{
+    int i;
+
+    if (a->error_count != b->error_count)
+        return "error count";
+    for (i = 0; i < a->error_count; i++)
+    {
+        if ( (a->errors[i].error != b->errors[i].error) ||
+             (a->errors[i].filename != b->errors[i].filename) ||
+             (a->errors[i].error_position != b->errors[i].error_position) )
+            return "errors";
+    } // for
+
+    if (a->profile != b->profile)
+        return "profile";
+    else if (a->mainfn != b->mainfn)
+        return "main function";
+    else if (a->instruction_count != b->instruction_count)
+        return "instruction count";
+    else if (a->shader_type != b->shader_type)
+        return "shader type";
+    else if ((a->major_ver != b->major_ver) || (a->minor_ver != b->minor_ver))
+        return "shader version";
+
+    if (a->uniform_count != b->uniform_count)
+        return "uniform count";
+    for (i = 0; i < a->uniform_count; i++)
+    {
+        const MOJOSHADER_uniform *x = &a->uniforms[i];
+        const MOJOSHADER_uniform *y = &b->uniforms[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->array_count != y->array_count) ||
+             (x->constant != y->constant) || (x->name != y->name) )
+            return "uniforms";
+    } // for
+
+    if (a->constant_count != b->constant_count)
+        return "constant count";
+    for (i = 0; i < a->constant_count; i++)
+    {
+        const MOJOSHADER_constant *x = &a->constants[i];
+        const MOJOSHADER_constant *y = &b->constants[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (memcmp(&x->value, &y->value, sizeof (x->value)) != 0) )
+            return "constants";
+    } // for
+
+    if (a->sampler_count != b->sampler_count)
+        return "sampler count";
+    for (i = 0; i < a->sampler_count; i++)
+    {
+        const MOJOSHADER_sampler *x = &a->samplers[i];
+        const MOJOSHADER_sampler *y = &b->samplers[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->name != y->name) || (x->texbem != y->texbem) )
+            return "samplers";
+    } // for
+
+    if (a->input_count != b->input_count)
+        return "input count";
+    for (i = 0; i < a->input_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->inputs[i];
+        const MOJOSHADER_attribute *y = &b->inputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "inputs";
+    } // for
+
+    if (a->output_count != b->output_count)
+        return "output count";
+    for (i = 0; i < a->output_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->outputs[i];
+        const MOJOSHADER_attribute *y = &b->outputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "outputs";
+    } // for
+
+    if (a->swizzle_count != b->swizzle_count)
+        return "swizzle count";
+
+    if (a->symbol_count != b->symbol_count)
+        return "symbol count";
+    for (i = 0; i < a->symbol_count; i++)
+    {
+        const MOJOSHADER_symbol *x = &a->symbols[i];
+        const MOJOSHADER_symbol *y = &b->symbols[i];
+        if ( (x->name != y->name) || (x->register_set != y->register_set) ||
+             (x->register_index != y->register_index) ||
+             (x->register_count != y->register_count) )
+            return "symbols";
+    } // for
+
+    if ((a->preshader == NULL) != (b->preshader == NULL))
+        return "preshader";
+
+    return NULL;
+} // compare_reflection
+
+
+// Ask for the pieces of (pd) with every (max) up to a few past the total,
+//  and make sure nothing past (max) gets touched. Returns the total, or -1.
+static int check_chunk_counts(const MOJOSHADER_parseData *pd)
+{
+    const char *untouched = "untouched";
+    const int total = MOJOSHADER_getOutputChunks(pd, NULL, NULL, 0);
+    const int size = total + 3;
+    const char **strings = NULL;
+    int *lengths = NULL;
+    int retval = total;
+    int max;
+    int i;
+
+    if (total < 0)
+        return -1;
+
+    strings = (const char **) malloc(sizeof (const char *) * size);
+    lengths = (int *) malloc(sizeof (int) * size);
+
+    for (max = 0; (retval >= 0) && (max <= size); max++)
+    {
+        for (i = 0; i < size; i++)
+        {
+            strings[i] = untouched;
+            lengths[i] = -1;
+        } // for
+
+        if (MOJOSHADER_getOutputChunks(pd, strings, lengths, max) != total)
+            retval = -1;
+        else if (MOJOSHADER_getOutputChunks(pd, strings, NULL, max) != total)
+            retval = -1;
+        else if (MOJOSHADER_getOutputChunks(pd, NULL, lengths, max) != total)
+            retval = -1;
+
+        for (i = 0; i < size; i++)
+        {
+            const int wrote = ((i < max) && (i < total));
+            if ((strings[i] != untouched) != wrote)
+                retval = -1;
+            else if ((lengths[i] != -1) != wrote)
+                retval = -1;
+        } // for
+    } // for
+
+    free(strings);
+    free(lengths);
+    return retval;
+} // check_chunk_counts
+
+
+// Make sure (b), from parseChunked, has the same output as (a), from a
+//  regular parse, once its pieces are put back together.
+static const char *compare_chunks(const MOJOSHADER_parseData *a,
+                                  const MOJOSHADER_parseData *b,
+                                  int *has_zeroes)
+{
+    const char *retval = NULL;
+    const char **strings = NULL;
+    int *lengths = NULL;
+    std::string joined;
+    int total;
+    int i;
+
+    if (a->output_len != b->output_len)
+        return "output length";
+    else if (!b->output.empty())
+        return "chunked output was joined";
+    else if (check_chunk_counts(a) != ((a->output_len > 0) ? 1 : 0))
+        return "chunks of a regular parse";
+
+    total = check_chunk_counts(b);
+    if (total < 0)
+        return "chunk count";
+    else if ((total == 0) != (b->output_len == 0))
+        return "no chunks";
+    else if (total == 0)
+        return NULL;
+
+    strings = (const char **) malloc(sizeof (const char *) * total);
+    lengths = (int *) malloc(sizeof (int) * total);
+    MOJOSHADER_getOutputChunks(b, strings, lengths, total);
+    for (i = 0; i < total; i++)
+        joined.append(strings[i], lengths[i]);
+    free(strings);
+    free(lengths);
+
+    if (joined != a->output)
+        retval = "output";
+    else if (memchr(joined.data(), '\0', joined.size()) != NULL)
+        *has_zeroes = 1;
+
+    return retval;
+} // compare_chunks
+
+
+static int do_file(FILE *report, const unsigned char *buf, const int len)
+{
+    int retval = 1;
+    int i;
+
+    for (i = 0; i < PROFILE_COUNT; i++)
+    {
+        const char *profile = profiles[i];
+        const char *problem = NULL;
+        const MOJOSHADER_parseData *a;
+        const MOJOSHADER_parseData *b;
+        int has_zeroes = 0;
+
+        a = MOJOSHADER_parse(profile, NULL, buf, len, NULL, 0, NULL, 0,
+                             NULL, NULL, NULL);
+        b = MOJOSHADER_parseChunked(profile, NULL, buf, len, NULL, 0, NULL, 0,
+                                    NULL, NULL, NULL);
+
+        if ((a == NULL) || (b == NULL))
+            problem = "no result";
+        else if ((problem = compare_reflection(a, b)) == NULL)
+            problem = compare_chunks(a, b, &has_zeroes);
+
+        if (problem != NULL)
+            retval = 0;
+
+        fprintf(report, "%s %s: %s%s%s%s\n",
+                problem ? "FAIL" : "PASS", profile,
+                ((a != NULL) && (a->error_count == 0)) ? "translated" : "failed to parse",
+                has_zeroes ? ", with zero bytes" : "",
+                problem ? ", chunks don't match parse: " : "",
+                problem ? problem : "");
+
+        delete a;
+        delete b;
+    } // for
+
+    return retval;
+} // do_file
+
+
+int main(int argc, char **argv)
+{
+    const char *outfile = NULL;
+    int retval = 0;
+    int first = 1;
+
+    if ((argc > 2) && (strcmp(argv[1], "-o") == 0))
+    {
+        outfile = argv[2];
+        first = 3;
+    } // if
+
+    if (argc <= first)
+    {
+        printf("\n\nUSAGE: %s [-o outfile] [file1] ... [fileN]\n\n", argv[0]);
+        return 1;
+    } // if
+
+    FILE *report = (outfile == NULL) ? stdout : fopen(outfile, "wb");
+    if (report == NULL)
+    {
+        printf(" ... fopen('%s') failed.\n", outfile);
+        return 1;
+    } // if
+
+    int i;
+    for (i = first; i < argc; i++)
+    {
+        FILE *io = fopen(argv[i], "rb");
+        if (io == NULL)
+        {
+            printf(" ... fopen('%s') failed.\n", argv[i]);
+            retval = 1;
+        } // if
+        else
+        {
+            unsigned char *buf = (unsigned char *) malloc(1000000);
+            int rc = fread(buf, 1, 1000000, io);
+            fclose(io);
+            if (!do_file(report, buf, rc))
+                retval = 1;
+            free(buf);
+        } // else
+    } // for
+
+    if (report != stdout)
+        fclose(report);
+    return retval;
+} // main
+
+// end of testchunks.c ...
+
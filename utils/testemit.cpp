@@ -0,0 +1,274 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Decodes each shader once with MOJOSHADER_decode(), emits it under every
+//  profile with MOJOSHADER_emit(), and makes sure each result matches what
+//  MOJOSHADER_parse() gives for the same profile. A copy of the shader that
+//  was cut in half (so it fails to parse) goes through the same checks, to
+//  make sure errors come back from emit the way parse reports them. If
+//  MojoShader was built with PARSE_STATS, this also checks that emit doesn't
+//  report any of the decode's work as its own. A line per profile goes to
+//  the report file, so unit_tests can compare it. Exits non-zero on a
+//  mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mojoshader.h"
+
+static const char *profiles[] =
+{
+    MOJOSHADER_PROFILE_D3D,
+    MOJOSHADER_PROFILE_BYTECODE,
+    MOJOSHADER_PROFILE_GLSL,
+    MOJOSHADER_PROFILE_GLSL120,
+    MOJOSHADER_PROFILE_ARB1,
+    MOJOSHADER_PROFILE_NV4,
+};
+
+#define PROFILE_COUNT ((int) (sizeof (profiles) / sizeof (profiles[0])))
+
+static const char *compare_reflection(const MOJOSHADER_parseData *a,
+                                      const MOJOSHADER_parseData *b)
+{
+    int i;
+
+    if (a->error_count != b->error_count)
+        return "error count";
+    for (i = 0; i < a->error_count; i++)
+    {
+        if ( (a->errors[i].error != b->errors[i].error) ||
+             (a->errors[i].filename != b->errors[i].filename) ||
+             (a->errors[i].error_position != b->errors[i].error_position) )
+            return "errors";
+    } // for
+
+    if (a->profile != b->profile)
+        return "profile";
+    else if (a->mainfn != b->mainfn)
+        return "main function";
+    else if (a->instruction_count != b->instruction_count)
+        return "instruction count";
+    else if (a->shader_type != b->shader_type)
+        return "shader type";
+    else if ((a->major_ver != b->major_ver) || (a->minor_ver != b->minor_ver))
+        return "shader version";
+
+    if (a->uniform_count != b->uniform_count)
+        return "uniform count";
+    for (i = 0; i < a->uniform_count; i++)
+    {
+        const MOJOSHADER_uniform *x = &a->uniforms[i];
+        const MOJOSHADER_uniform *y = &b->uniforms[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->array_count != y->array_count) ||
+             (x->constant != y->constant) || (x->name != y->name) )
+            return "uniforms";
+    } // for
+
+    if (a->constant_count != b->constant_count)
+        return "constant count";
+    for (i = 0; i < a->constant_count; i++)
+    {
+        const MOJOSHADER_constant *x = &a->constants[i];
+        const MOJOSHADER_constant *y = &b->constants[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (memcmp(&x->value, &y->value, sizeof (x->value)) != 0) )
+            return "constants";
+    } // for
+
+    if (a->sampler_count != b->sampler_count)
+        return "sampler count";
+    for (i = 0; i < a->sampler_count; i++)
+    {
+        const MOJOSHADER_sampler *x = &a->samplers[i];
+        const MOJOSHADER_sampler *y = &b->samplers[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->name != y->name) || (x->texbem != y->texbem) )
+            return "samplers";
+    } // for
+
+    if (a->input_count != b->input_count)
+        return "input count";
+    for (i = 0; i < a->input_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->inputs[i];
+        const MOJOSHADER_attribute *y = &b->inputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "inputs";
+    } // for
+
+    if (a->output_count != b->output_count)
+        return "output count";
+    for (i = 0; i < a->output_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->outputs[i];
+        const MOJOSHADER_attribute *y = &b->outputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "outputs";
+    } // for
+
+    if (a->swizzle_count != b->swizzle_count)
+        return "swizzle count";
+
+    if (a->symbol_count != b->symbol_count)
+        return "symbol count";
+    for (i = 0; i < a->symbol_count; i++)
+    {
+        const MOJOSHADER_symbol *x = &a->symbols[i];
+        const MOJOSHADER_symbol *y = &b->symbols[i];
+        if ( (x->name != y->name) || (x->register_set != y->register_set) ||
+             (x->register_index != y->register_index) ||
+             (x->register_count != y->register_count) )
+            return "symbols";
+    } // for
+
+    if ((a->preshader == NULL) != (b->preshader == NULL))
+        return "preshader";
+
+    return NULL;
+} // compare_reflection
+
+
+// MOJOSHADER_emit() doesn't decode anything, so those phases should be zero.
+//  (stats) is NULL unless MojoShader was built with PARSE_STATS.
+static const char *compare_stats(const MOJOSHADER_parseData *b)
+{
+    const MOJOSHADER_parseStats *stats = b->stats;
+    if (stats == NULL)
+        return NULL;
+    else if ((stats->version_ns != 0) || (stats->tokens_ns != 0) ||
+             (stats->preshader_ns != 0) || (stats->optimize_ns != 0))
+        return "decode time in emit stats";
+    else if ((stats->token_count != 0) || (stats->instruction_count != 0) ||
+             (stats->comment_count != 0))
+        return "decoded tokens in emit stats";
+    else if (stats->total_ns < stats->emit_ns + stats->definitions_ns +
+                               stats->finalize_ns + stats->parsedata_ns)
+        return "emit stats total";
+    return NULL;
+} // compare_stats
+
+
+// Decodes (len) bytes of (buf) and checks every profile's emit against a
+//  plain parse.
+static int do_decoded(FILE *report, const char *what,
+                      const unsigned char *buf, const int len)
+{
+    const MOJOSHADER_decodedShader *decoded;
+    int retval = 1;
+    int i;
+
+    decoded = MOJOSHADER_decode(buf, len, NULL, 0, NULL, 0, NULL, NULL, NULL);
+    if (decoded == NULL)
+    {
+        fprintf(report, "FAIL %s: couldn't decode\n", what);
+        return 0;
+    } // if
+
+    for (i = 0; i < PROFILE_COUNT; i++)
+    {
+        const char *profile = profiles[i];
+        const char *problem = NULL;
+        const MOJOSHADER_parseData *a;
+        const MOJOSHADER_parseData *b;
+
+        a = MOJOSHADER_parse(profile, NULL, buf, len, NULL, 0, NULL, 0,
+                             NULL, NULL, NULL);
+        b = MOJOSHADER_emit(decoded, profile, NULL);
+
+        if ((a == NULL) || (b == NULL))
+            problem = "no result";
+        else if ((problem = compare_reflection(a, b)) == NULL)
+        {
+            if ((a->output_len != b->output_len) || (a->output != b->output))
+                problem = "output";
+            else
+                problem = compare_stats(b);
+        } // else if
+
+        if (problem != NULL)
+            retval = 0;
+
+        fprintf(report, "%s %s %s: %s%s%s\n",
+                problem ? "FAIL" : "PASS", what, profile,
+                ((a != NULL) && (a->error_count == 0)) ? "translated" : "failed to parse",
+                problem ? ", emit doesn't match parse: " : "",
+                problem ? problem : "");
+
+        delete a;
+        delete b;
+    } // for
+
+    MOJOSHADER_freeDecodedShader(decoded);
+    return retval;
+} // do_decoded
+
+
+static int do_file(FILE *report, const unsigned char *buf, const int len)
+{
+    int retval = 1;
+    if (!do_decoded(report, "emit", buf, len))
+        retval = 0;
+    if (!do_decoded(report, "broken emit", buf, len / 2))  // cut off mid-shader.
+        retval = 0;
+    return retval;
+} // do_file
+
+
+int main(int argc, char **argv)
+{
+    const char *outfile = NULL;
+    int retval = 0;
+    int first = 1;
+
+    if ((argc > 2) && (strcmp(argv[1], "-o") == 0))
+    {
+        outfile = argv[2];
+        first = 3;
+    } // if
+
+    if (argc <= first)
+    {
+        printf("\n\nUSAGE: %s [-o outfile] [file1] ... [fileN]\n\n", argv[0]);
+        return 1;
+    } // if
+
+    FILE *report = (outfile == NULL) ? stdout : fopen(outfile, "wb");
+    if (report == NULL)
+    {
+        printf(" ... fopen('%s') failed.\n", outfile);
+        return 1;
+    } // if
+
+    int i;
+    for (i = first; i < argc; i++)
+    {
+        FILE *io = fopen(argv[i], "rb");
+        if (io == NULL)
+        {
+            printf(" ... fopen('%s') failed.\n", argv[i]);
+            retval = 1;
+        } // if
+        else
+        {
+            unsigned char *buf = (unsigned char *) malloc(1000000);
+            int rc = fread(buf, 1, 1000000, io);
+            fclose(io);
+            if (!do_file(report, buf, rc))
+                retval = 1;
+            free(buf);
+        } // else
+    } // for
+
+    if (report != stdout)
+        fclose(report);
+    return retval;
+} // main
+
+// end of testemit.c ...
+
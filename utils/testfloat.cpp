@@ -0,0 +1,166 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Makes sure MOJOSHADER_printFloat() output reads back as exactly the same
+//  float, bit for bit, and that it's as short as it can be. By default this
+//  checks every float from 1/16 to 256 (where nearly every shader constant
+//  lives), the edges of every binade, and a sampling of everything else.
+//  "-all" checks all four billion floats, which takes a while. Exits
+//  non-zero on any failure.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#define __MOJOSHADER_INTERNAL__ 1
+#include "../mojoshader_internal.h"
+
+static unsigned int failures = 0;
+static unsigned int checked = 0;
+
+static float float_from_bits(const uint32 bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof (f));
+    return f;
+} // float_from_bits
+
+static uint32 bits_from_float(const float f)
+{
+    uint32 bits;
+    memcpy(&bits, &f, sizeof (bits));
+    return bits;
+} // bits_from_float
+
+static void report(const uint32 bits, const char *str, const char *why)
+{
+    if (failures++ < 20)
+        printf("FAIL 0x%08X (%.9g): '%s' %s\n", (uint) bits,
+               (double) float_from_bits(bits), str, why);
+} // report
+
+// significant digits in a printFloat() string.
+static int count_digits(const char *str)
+{
+    int first = -1;
+    int last = -1;
+    int i;
+    for (i = 0; (str[i] != '\0') && (str[i] != 'e'); i++)
+    {
+        if ((str[i] >= '1') && (str[i] <= '9'))
+        {
+            if (first == -1)
+                first = i;
+            last = i;
+        } // if
+    } // for
+
+    if (first == -1)
+        return 1;  // zero.
+
+    int retval = 0;
+    for (i = first; i <= last; i++)
+        retval += (str[i] != '.');
+    return retval;
+} // count_digits
+
+static void check_float(const uint32 bits, const int check_shortest)
+{
+    const float f = float_from_bits(bits);
+    char buf[64];
+
+    if (isnan(f) || isinf(f))
+        return;  // these don't round trip, and nothing emits them on purpose.
+
+    checked++;
+
+    const size_t len = MOJOSHADER_printFloat(buf, sizeof (buf), f);
+    if ((len >= sizeof (buf)) || (strlen(buf) != len))
+    {
+        report(bits, buf, "(bad length)");
+        return;
+    } // if
+    else if (strchr(buf, '.') == NULL)
+    {
+        report(bits, buf, "(no decimal point)");
+        return;
+    } // else if
+    else if (bits_from_float(strtof(buf, NULL)) != bits)
+    {
+        report(bits, buf, "(didn't round trip)");
+        return;
+    } // else if
+
+    if (check_shortest)
+    {
+        // see how few digits the C runtime needs, and make sure we didn't
+        //  need more than that. (This is slow, so it's only sampled.)
+        const int digits = count_digits(buf);
+        int i;
+        for (i = 1; i < digits; i++)
+        {
+            char cmp[64];
+            snprintf(cmp, sizeof (cmp), "%.*e", i - 1, (double) f);
+            if (bits_from_float(strtof(cmp, NULL)) == bits)
+            {
+                report(bits, buf, "(not the shortest)");
+                break;
+            } // if
+        } // for
+    } // if
+} // check_float
+
+// every float from (first) to (last) inclusive. The sign is just a '-', so
+//  the other side gets enough coverage from the rest of the checks.
+static void check_range(const float first, const float last)
+{
+    const uint32 lo = bits_from_float(first);
+    const uint32 hi = bits_from_float(last);
+    for (uint32 bits = lo; bits <= hi; bits++)
+        check_float(bits, 0);
+} // check_range
+
+int main(int argc, char **argv)
+{
+    if ((argc > 1) && (strcmp(argv[1], "-all") == 0))
+    {
+        uint32 bits = 0;
+        do
+        {
+            check_float(bits, 0);
+        } while (++bits != 0);
+    } // if
+    else
+    {
+        check_range(1.0f / 16.0f, 256.0f);
+
+        // the first and last 1024 floats of every binade, including denormals
+        //  and the biggest finite ones.
+        for (uint32 exponent = 0; exponent < 255; exponent++)
+        {
+            for (uint32 mantissa = 0; mantissa < 1024; mantissa++)
+            {
+                const uint32 bits = (exponent << 23);
+                check_float(bits | mantissa, 1);
+                check_float(bits | (0x7FFFFF - mantissa), 1);
+                check_float(0x80000000 | bits | mantissa, 0);
+            } // for
+        } // for
+
+        // and a sampling of everything.
+        uint32 bits = 0;
+        do
+        {
+            check_float(bits, (bits % 7) == 0);
+        } while ((bits += 4099) >= 4099);
+    } // else
+
+    printf("%u floats checked, %u failed.\n", checked, failures);
+    return (failures == 0) ? 0 : 1;
+} // main
+
+// end of testfloat.c ...
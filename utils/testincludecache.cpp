@@ -0,0 +1,227 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Preprocesses a file three times through one include cache: once with the
+//  cache empty, once with it full, and once more after purging it. Every
+//  call to the includeOpen callback is written to the report file, so
+//  unit_tests can make sure each header was only opened once per trip
+//  through an empty cache, no matter how often it was #included. Each run's
+//  output has to match a plain MOJOSHADER_preprocess(), and the files it
+//  lists in (includes) go to the report too. Exits non-zero on a mismatch,
+//  or if preprocessing reported errors.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mojoshader.h"
+
+static FILE *report = NULL;
+static int log_opens = 0;  // open_include writes to (report) if nonzero.
+
+static int open_include(MOJOSHADER_includeType inctype, const char *fname,
+                        const char *parent, const char **outdata,
+                        unsigned int *outbytes, MOJOSHADER_malloc m,
+                        MOJOSHADER_free f, void *d)
+{
+    FILE *io = fopen(fname, "rb");
+    if (io == NULL)
+        return 0;
+
+    if (log_opens)
+        fprintf(report, "open %s\n", fname);
+
+    fseek(io, 0, SEEK_END);
+    const long fsize = ftell(io);
+    fseek(io, 0, SEEK_SET);
+
+    char *data = (char *) m((int) fsize, d);
+    if ((data == NULL) || ((fsize > 0) && (fread(data, fsize, 1, io) != 1)))
+    {
+        if (data != NULL)
+            f(data, d);
+        fclose(io);
+        return 0;
+    } // if
+
+    fclose(io);
+    *outdata = data;
+    *outbytes = (unsigned int) fsize;
+    return 1;
+} // open_include
+
+
+static void close_include(const char *data, MOJOSHADER_malloc m,
+                          MOJOSHADER_free f, void *d)
+{
+    f((void *) data, d);
+} // close_include
+
+
+static int same_includes(const MOJOSHADER_preprocessData *a,
+                         const MOJOSHADER_preprocessData *b)
+{
+    int i;
+    if (a->include_count != b->include_count)
+        return 0;
+    for (i = 0; i < a->include_count; i++)
+    {
+        if ( (a->includes[i].type != b->includes[i].type) ||
+             (strcmp(a->includes[i].filename, b->includes[i].filename) != 0) )
+            return 0;
+    } // for
+    return 1;
+} // same_includes
+
+
+static int do_run(MOJOSHADER_includeCache *cache, const char *what,
+                  const char *fname, const char *buf, const int len,
+                  const MOJOSHADER_preprocessData *plain)
+{
+    const MOJOSHADER_preprocessData *pd;
+    const char *problem = NULL;
+    int i;
+
+    fprintf(report, "%s:\n", what);
+    pd = MOJOSHADER_preprocessWithCache(cache, fname, buf, len, NULL, 0,
+                                        open_include, close_include,
+                                        NULL, NULL, NULL);
+
+    if (pd == NULL)
+        problem = "no result";
+    else if (pd->error_count > 0)
+    {
+        for (i = 0; i < pd->error_count; i++)
+        {
+            fprintf(stderr, "%s:%d: ERROR: %s\n",
+                    pd->errors[i].filename.c_str(),
+                    pd->errors[i].error_position,
+                    pd->errors[i].error.c_str());
+        } // for
+        problem = "errors";
+    } // else if
+    else if ( (pd->output_len != plain->output_len) ||
+              (memcmp(pd->output, plain->output, pd->output_len) != 0) )
+        problem = "output";
+    else if (!same_includes(pd, plain))
+        problem = "includes";
+
+    fprintf(report, "%s %s%s%s\n", problem ? "FAIL" : "PASS", what,
+            problem ? ", doesn't match MOJOSHADER_preprocess: " : "",
+            problem ? problem : "");
+
+    // headers served from the cache still have to show up in (includes).
+    for (i = 0; (pd != NULL) && (i < pd->include_count); i++)
+    {
+        const MOJOSHADER_preprocessInclude *inc = &pd->includes[i];
+        fprintf(report, "include %s %s\n",
+                (inc->type == MOJOSHADER_INCLUDETYPE_LOCAL) ? "local" : "system",
+                inc->filename);
+    } // for
+
+    MOJOSHADER_freePreprocessData(pd);
+    return (problem == NULL);
+} // do_run
+
+
+static int do_file(const char *fname, const char *buf, const int len)
+{
+    const MOJOSHADER_preprocessData *plain;
+    MOJOSHADER_includeCache *cache;
+    int retval = 1;
+
+    plain = MOJOSHADER_preprocess(fname, buf, len, NULL, 0, open_include,
+                                  close_include, NULL, NULL, NULL);
+    if ((plain == NULL) || (plain->error_count > 0))
+    {
+        fprintf(report, "FAIL %s: didn't preprocess\n", fname);
+        MOJOSHADER_freePreprocessData(plain);
+        return 0;
+    } // if
+
+    // the plain run opens everything too; only log the ones through the cache.
+    log_opens = 1;
+    cache = MOJOSHADER_createIncludeCache(NULL, NULL, NULL);
+    if (cache == NULL)
+    {
+        fprintf(report, "FAIL %s: couldn't create cache\n", fname);
+        MOJOSHADER_freePreprocessData(plain);
+        return 0;
+    } // if
+
+    if (!do_run(cache, "empty cache", fname, buf, len, plain))
+        retval = 0;
+    if (!do_run(cache, "full cache", fname, buf, len, plain))
+        retval = 0;
+    MOJOSHADER_purgeIncludeCache(cache);
+    if (!do_run(cache, "purged cache", fname, buf, len, plain))
+        retval = 0;
+
+    MOJOSHADER_destroyIncludeCache(cache);
+    MOJOSHADER_freePreprocessData(plain);
+    return retval;
+} // do_file
+
+
+int main(int argc, char **argv)
+{
+    const char *outfile = NULL;
+    const char *infile = NULL;
+    int retval = 1;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-o") == 0) && (i < argc - 1))
+            outfile = argv[++i];
+        else
+            infile = argv[i];
+    } // for
+
+    if (infile == NULL)
+    {
+        printf("\n\nUSAGE: %s [-o outfile] <file>\n\n", argv[0]);
+        return 1;
+    } // if
+
+    FILE *io = fopen(infile, "rb");
+    if (io == NULL)
+    {
+        printf(" ... fopen('%s') failed.\n", infile);
+        return 1;
+    } // if
+
+    fseek(io, 0, SEEK_END);
+    const long len = ftell(io);
+    fseek(io, 0, SEEK_SET);
+    char *buf = (char *) malloc(len + 1);
+    const int rc = ((buf != NULL) && (fread(buf, len, 1, io) == 1));
+    fclose(io);
+    if (!rc)
+    {
+        printf(" ... fread('%s') failed.\n", infile);
+        free(buf);
+        return 1;
+    } // if
+
+    report = (outfile == NULL) ? stdout : fopen(outfile, "wb");
+    if (report == NULL)
+    {
+        printf(" ... fopen('%s') failed.\n", outfile);
+        free(buf);
+        return 1;
+    } // if
+
+    if (do_file(infile, buf, (int) len))
+        retval = 0;
+
+    if (report != stdout)
+        fclose(report);
+    free(buf);
+    return retval;
+} // main
+
+// end of testincludecache.c ...
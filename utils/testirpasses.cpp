@@ -0,0 +1,88 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Compiles HLSL source and writes out each function's IR before and after
+//  every optimization pass, so unit_tests can check what the passes did.
+//  Exits non-zero if the compile reported errors.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define __MOJOSHADER_INTERNAL__ 1
+#include "../mojoshader_internal.h"
+
+int main(int argc, char **argv)
+{
+    const char *outfile = NULL;
+    const char *infile = NULL;
+    int retval = 1;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if ((strcmp(argv[i], "-o") == 0) && (i < argc - 1))
+            outfile = argv[++i];
+        else
+            infile = argv[i];
+    } // for
+
+    if (infile == NULL)
+    {
+        printf("\n\nUSAGE: %s [-o outfile] <file.hlsl>\n\n", argv[0]);
+        return 1;
+    } // if
+
+    FILE *io = fopen(infile, "rb");
+    if (io == NULL)
+    {
+        printf(" ... fopen('%s') failed.\n", infile);
+        return 1;
+    } // if
+
+    fseek(io, 0, SEEK_END);
+    const long len = ftell(io);
+    fseek(io, 0, SEEK_SET);
+    char *buf = (char *) malloc(len + 1);
+    const int rc = ((buf != NULL) && (fread(buf, len, 1, io) == 1));
+    fclose(io);
+    if (!rc)
+    {
+        printf(" ... fread('%s') failed.\n", infile);
+        free(buf);
+        return 1;
+    } // if
+
+    FILE *out = (outfile == NULL) ? stdout : fopen(outfile, "wb");
+    if (out == NULL)
+    {
+        printf(" ... fopen('%s') failed.\n", outfile);
+        free(buf);
+        return 1;
+    } // if
+
+    const MOJOSHADER_compileData *cd = compiler_trace_ir(out,
+                                        MOJOSHADER_SRC_PROFILE_HLSL_PS_1_1,
+                                        infile, buf, (unsigned int) len,
+                                        NULL, 0, NULL, NULL, NULL, NULL, NULL);
+    if (cd->error_count == 0)
+        retval = 0;
+    else
+    {
+        for (i = 0; i < cd->error_count; i++)
+        {
+            const MOJOSHADER_error *e = &cd->errors[i];
+            fprintf(stderr, "%s:%d: %s\n", e->filename.c_str(),
+                    e->error_position, e->error.c_str());
+        } // for
+    } // else
+
+    MOJOSHADER_freeCompileData(cd);
+    if (out != stdout)
+        fclose(out);
+    free(buf);
+    return retval;
+} // main
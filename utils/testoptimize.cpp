@@ -0,0 +1,255 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Parses shaders with and without MOJOSHADER_parseOptimized()'s passes and
+//  makes sure nothing but the output changed. Exits non-zero on a mismatch.
+//  With "-d <file>", the optimized "d3d" profile output (which is just
+//  assembly) is written there too, so unit_tests can check what was removed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mojoshader.h"
+
+static const char *profiles[] =
+{
+    MOJOSHADER_PROFILE_D3D,
+    MOJOSHADER_PROFILE_BYTECODE,
+    MOJOSHADER_PROFILE_HLSL,
+    MOJOSHADER_PROFILE_GLSL,
+    MOJOSHADER_PROFILE_GLSL120,
+    MOJOSHADER_PROFILE_GLSLES,
+    MOJOSHADER_PROFILE_GLSLES3,
+    MOJOSHADER_PROFILE_ARB1,
+    MOJOSHADER_PROFILE_NV2,
+    MOJOSHADER_PROFILE_NV3,
+    MOJOSHADER_PROFILE_NV4,
+    MOJOSHADER_PROFILE_METAL,
+    MOJOSHADER_PROFILE_SPIRV,
+    MOJOSHADER_PROFILE_GLSPIRV,
+};
+
+static const char *compare_reflection(const MOJOSHADER_parseData *a,
+                                      const MOJOSHADER_parseData *b)
+{
+    int i;
+
+    if (a->error_count != b->error_count)
+        return "error count";
+    for (i = 0; i < a->error_count; i++)
+    {
+        if ( (a->errors[i].error != b->errors[i].error) ||
+             (a->errors[i].filename != b->errors[i].filename) ||
+             (a->errors[i].error_position != b->errors[i].error_position) )
+            return "errors";
+    } // for
+
+    if (a->profile != b->profile)
+        return "profile";
+    else if (a->mainfn != b->mainfn)
+        return "main function";
+    else if (a->instruction_count != b->instruction_count)
+        return "instruction count";
+    else if (a->shader_type != b->shader_type)
+        return "shader type";
+    else if ((a->major_ver != b->major_ver) || (a->minor_ver != b->minor_ver))
+        return "shader version";
+
+    if (a->uniform_count != b->uniform_count)
+        return "uniform count";
+    for (i = 0; i < a->uniform_count; i++)
+    {
+        const MOJOSHADER_uniform *x = &a->uniforms[i];
+        const MOJOSHADER_uniform *y = &b->uniforms[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->array_count != y->array_count) ||
+             (x->constant != y->constant) || (x->name != y->name) )
+            return "uniforms";
+    } // for
+
+    if (a->constant_count != b->constant_count)
+        return "constant count";
+    for (i = 0; i < a->constant_count; i++)
+    {
+        const MOJOSHADER_constant *x = &a->constants[i];
+        const MOJOSHADER_constant *y = &b->constants[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (memcmp(&x->value, &y->value, sizeof (x->value)) != 0) )
+            return "constants";
+    } // for
+
+    if (a->sampler_count != b->sampler_count)
+        return "sampler count";
+    for (i = 0; i < a->sampler_count; i++)
+    {
+        const MOJOSHADER_sampler *x = &a->samplers[i];
+        const MOJOSHADER_sampler *y = &b->samplers[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->name != y->name) || (x->texbem != y->texbem) )
+            return "samplers";
+    } // for
+
+    if (a->input_count != b->input_count)
+        return "input count";
+    for (i = 0; i < a->input_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->inputs[i];
+        const MOJOSHADER_attribute *y = &b->inputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "inputs";
+    } // for
+
+    if (a->output_count != b->output_count)
+        return "output count";
+    for (i = 0; i < a->output_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->outputs[i];
+        const MOJOSHADER_attribute *y = &b->outputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "outputs";
+    } // for
+
+    if (a->swizzle_count != b->swizzle_count)
+        return "swizzle count";
+
+    if (a->symbol_count != b->symbol_count)
+        return "symbol count";
+    for (i = 0; i < a->symbol_count; i++)
+    {
+        const MOJOSHADER_symbol *x = &a->symbols[i];
+        const MOJOSHADER_symbol *y = &b->symbols[i];
+        if ( (x->name != y->name) || (x->register_set != y->register_set) ||
+             (x->register_index != y->register_index) ||
+             (x->register_count != y->register_count) )
+            return "symbols";
+    } // for
+
+    if ((a->preshader == NULL) != (b->preshader == NULL))
+        return "preshader";
+
+    return NULL;
+} // compare_reflection
+
+
+static int dump_optimized(const char *dumpfname, const unsigned char *buf,
+                          const int len)
+{
+    const MOJOSHADER_parseData *pd;
+    int retval = 0;
+
+    pd = MOJOSHADER_parseOptimized(MOJOSHADER_PROFILE_D3D, NULL, buf, len,
+                                   NULL, 0, NULL, 0, MOJOSHADER_OPTIMIZE_ALL,
+                                   NULL, NULL, NULL);
+    if (pd->error_count == 0)
+    {
+        FILE *io = fopen(dumpfname, "wb");
+        if (io == NULL)
+            printf(" ... fopen('%s') failed.\n", dumpfname);
+        else
+        {
+            retval = (fwrite(pd->output.data(), pd->output_len, 1, io) == 1);
+            if (fclose(io) != 0)
+                retval = 0;
+        } // else
+    } // if
+
+    delete pd;
+    return retval;
+} // dump_optimized
+
+
+static int do_optimize(const char *fname, const unsigned char *buf,
+                       const int len, const char *prof)
+{
+    const MOJOSHADER_parseData *pd;
+    const MOJOSHADER_parseData *none;
+    const MOJOSHADER_parseData *opt;
+    const char *problem = NULL;
+    int retval = 1;
+
+    pd = MOJOSHADER_parse(prof, NULL, buf, len, NULL, 0, NULL, 0,
+                          NULL, NULL, NULL);
+    none = MOJOSHADER_parseOptimized(prof, NULL, buf, len, NULL, 0, NULL, 0,
+                                     MOJOSHADER_OPTIMIZE_NONE,
+                                     NULL, NULL, NULL);
+    opt = MOJOSHADER_parseOptimized(prof, NULL, buf, len, NULL, 0, NULL, 0,
+                                    MOJOSHADER_OPTIMIZE_ALL,
+                                    NULL, NULL, NULL);
+
+    if ((problem = compare_reflection(pd, none)) != NULL)
+        retval = 0;
+    else if ((pd->output_len != none->output_len) || (pd->output != none->output))
+    {
+        problem = "unoptimized output";
+        retval = 0;
+    } // else if
+    else if ((problem = compare_reflection(pd, opt)) != NULL)
+        retval = 0;
+    else if (pd->error_count > 0)
+        problem = "both failed the same way";
+    else if (opt->output_len > pd->output_len)
+        problem = "optimized output is larger";  // not wrong, just odd.
+
+    printf("%s %s %s: %d -> %d bytes%s%s%s\n", retval ? "PASS" : "FAIL",
+           fname, prof, pd->output_len, opt->output_len,
+           problem ? " (" : "", problem ? problem : "", problem ? ")" : "");
+
+    delete opt;
+    delete none;
+    delete pd;
+    return retval;
+} // do_optimize
+
+
+int main(int argc, char **argv)
+{
+    const char *dumpfname = NULL;
+    int retval = 0;
+    int first = 1;
+
+    if ((argc > 2) && (strcmp(argv[1], "-d") == 0))
+    {
+        dumpfname = argv[2];
+        first = 3;
+    } // if
+
+    if (argc <= first)
+        printf("\n\nUSAGE: %s [-d dumpfile] [file1] ... [fileN]\n\n", argv[0]);
+    else
+    {
+        size_t p;
+        int i;
+
+        for (i = first; i < argc; i++)
+        {
+            FILE *io = fopen(argv[i], "rb");
+            if (io == NULL)
+            {
+                printf(" ... fopen('%s') failed.\n", argv[i]);
+                retval = 1;
+            } // if
+            else
+            {
+                unsigned char *buf = (unsigned char *) malloc(1000000);
+                int rc = fread(buf, 1, 1000000, io);
+                fclose(io);
+                for (p = 0; p < sizeof (profiles) / sizeof (profiles[0]); p++)
+                {
+                    if (!do_optimize(argv[i], buf, rc, profiles[p]))
+                        retval = 1;
+                } // for
+                if ((dumpfname != NULL) && (!dump_optimized(dumpfname, buf, rc)))
+                    retval = 1;
+                free(buf);
+            } // else
+        } // for
+    } // else
+
+    return retval;
+} // main
+
+// end of testoptimize.c ...
@@ -283,6 +283,35 @@ static void print_attrs(const char *category, const int count,
 } // print_attrs
 
 
+static void print_stats(const MOJOSHADER_parseStats *stats,
+                        unsigned int indent)
+{
+    INDENT(); printf("STATS:\n");
+    indent++;
+    INDENT(); printf("total: %llu ns\n", stats->total_ns);
+    INDENT(); printf("version token: %llu ns\n", stats->version_ns);
+    INDENT(); printf("token loop: %llu ns (preshader %llu ns)\n", stats->tokens_ns, stats->preshader_ns);
+    INDENT(); printf("optimizer: %llu ns\n", stats->optimize_ns);
+    INDENT(); printf("emitters: %llu ns\n", stats->emit_ns);
+    INDENT(); printf("definitions: %llu ns\n", stats->definitions_ns);
+    INDENT(); printf("finalize: %llu ns\n", stats->finalize_ns);
+    INDENT(); printf("parse data: %llu ns\n", stats->parsedata_ns);
+    INDENT(); printf("arena allocations: %u (%llu bytes)\n", stats->arena_allocations, stats->arena_bytes);
+    INDENT(); printf("app allocations: %u (%llu bytes)\n", stats->app_allocations, stats->app_bytes);
+    INDENT(); printf("tokens: %u (%u instructions, %u comments)\n", stats->token_count, stats->instruction_count, stats->comment_count);
+    INDENT(); printf("output sections:");
+    printf(" preflight=%u globals=%u inputs=%u outputs=%u helpers=%u",
+           stats->preflight_bytes, stats->globals_bytes, stats->inputs_bytes,
+           stats->outputs_bytes, stats->helpers_bytes);
+    printf(" subroutines=%u mainline_intro=%u mainline_arguments=%u",
+           stats->subroutines_bytes, stats->mainline_intro_bytes,
+           stats->mainline_arguments_bytes);
+    printf(" mainline_top=%u mainline=%u postflight=%u\n",
+           stats->mainline_top_bytes, stats->mainline_bytes,
+           stats->postflight_bytes);
+} // print_stats
+
+
 static void print_shader(const char *fname, const MOJOSHADER_parseData *pd,
                          unsigned int indent)
 {
@@ -466,6 +495,9 @@ static void print_shader(const char *fname, const MOJOSHADER_parseData *pd,
         } // if
     } // else
 
+    if (pd->stats != NULL)
+        print_stats(pd->stats, indent);
+
     printf("\n\n");
 } // print_shader
 
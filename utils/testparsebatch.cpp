@@ -0,0 +1,302 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Translates each shader under several profiles with MOJOSHADER_parseBatch(),
+//  with a copy of the shader that was cut in half (so it fails to parse)
+//  wedged into the middle of the batch, and makes sure every slot matches
+//  what a serial MOJOSHADER_parse() of the same job gives. The batch runs
+//  once on its own and once through a parse cache. A line per slot goes to
+//  the report file, so unit_tests can compare it. Exits non-zero on a
+//  mismatch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../mojoshader.h"
+
+#define BATCH_THREADS 4
+
+static const char *profiles[] =
+{
+    MOJOSHADER_PROFILE_D3D,
+    MOJOSHADER_PROFILE_BYTECODE,
+    MOJOSHADER_PROFILE_GLSL,
+    MOJOSHADER_PROFILE_GLSL120,
+    MOJOSHADER_PROFILE_ARB1,
+    MOJOSHADER_PROFILE_NV4,
+};
+
+#define PROFILE_COUNT ((int) (sizeof (profiles) / sizeof (profiles[0])))
+#define JOB_COUNT (PROFILE_COUNT + 1)
+
+static const char *compare_reflection(const MOJOSHADER_parseData *a,
+                                      const MOJOSHADER_parseData *b)
+{
+    int i;
+
+    if (a->error_count != b->error_count)
+        return "error count";
+    for (i = 0; i < a->error_count; i++)
+    {
+        if ( (a->errors[i].error != b->errors[i].error) ||
+             (a->errors[i].filename != b->errors[i].filename) ||
+             (a->errors[i].error_position != b->errors[i].error_position) )
+            return "errors";
+    } // for
+
+    if (a->profile != b->profile)
+        return "profile";
+    else if (a->mainfn != b->mainfn)
+        return "main function";
+    else if (a->instruction_count != b->instruction_count)
+        return "instruction count";
+    else if (a->shader_type != b->shader_type)
+        return "shader type";
+    else if ((a->major_ver != b->major_ver) || (a->minor_ver != b->minor_ver))
+        return "shader version";
+
+    if (a->uniform_count != b->uniform_count)
+        return "uniform count";
+    for (i = 0; i < a->uniform_count; i++)
+    {
+        const MOJOSHADER_uniform *x = &a->uniforms[i];
+        const MOJOSHADER_uniform *y = &b->uniforms[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->array_count != y->array_count) ||
+             (x->constant != y->constant) || (x->name != y->name) )
+            return "uniforms";
+    } // for
+
+    if (a->constant_count != b->constant_count)
+        return "constant count";
+    for (i = 0; i < a->constant_count; i++)
+    {
+        const MOJOSHADER_constant *x = &a->constants[i];
+        const MOJOSHADER_constant *y = &b->constants[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (memcmp(&x->value, &y->value, sizeof (x->value)) != 0) )
+            return "constants";
+    } // for
+
+    if (a->sampler_count != b->sampler_count)
+        return "sampler count";
+    for (i = 0; i < a->sampler_count; i++)
+    {
+        const MOJOSHADER_sampler *x = &a->samplers[i];
+        const MOJOSHADER_sampler *y = &b->samplers[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->name != y->name) || (x->texbem != y->texbem) )
+            return "samplers";
+    } // for
+
+    if (a->input_count != b->input_count)
+        return "input count";
+    for (i = 0; i < a->input_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->inputs[i];
+        const MOJOSHADER_attribute *y = &b->inputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "inputs";
+    } // for
+
+    if (a->output_count != b->output_count)
+        return "output count";
+    for (i = 0; i < a->output_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->outputs[i];
+        const MOJOSHADER_attribute *y = &b->outputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "outputs";
+    } // for
+
+    if (a->swizzle_count != b->swizzle_count)
+        return "swizzle count";
+
+    if (a->symbol_count != b->symbol_count)
+        return "symbol count";
+    for (i = 0; i < a->symbol_count; i++)
+    {
+        const MOJOSHADER_symbol *x = &a->symbols[i];
+        const MOJOSHADER_symbol *y = &b->symbols[i];
+        if ( (x->name != y->name) || (x->register_set != y->register_set) ||
+             (x->register_index != y->register_index) ||
+             (x->register_count != y->register_count) )
+            return "symbols";
+    } // for
+
+    if ((a->preshader == NULL) != (b->preshader == NULL))
+        return "preshader";
+
+    return NULL;
+} // compare_reflection
+
+
+// Runs (jobs) through MOJOSHADER_parseBatch() and checks each slot against
+//  (serial), the same jobs parsed one at a time.
+static int do_batch(FILE *report, const char *what,
+                    const MOJOSHADER_parseJob *jobs,
+                    const MOJOSHADER_parseData **serial,
+                    const int broken, MOJOSHADER_parseCache *cache)
+{
+    const MOJOSHADER_parseData *results[JOB_COUNT];
+    const char *problem = NULL;
+    int retval = 1;
+    int want = 0;
+    int rc;
+    int i;
+
+    memset(results, '\0', sizeof (results));
+    rc = MOJOSHADER_parseBatch(jobs, JOB_COUNT, results, BATCH_THREADS,
+                               cache, NULL, NULL, NULL);
+
+    for (i = 0; i < JOB_COUNT; i++)
+    {
+        const MOJOSHADER_parseData *pd = results[i];
+        if (pd == NULL)
+            problem = "no result";
+        else if ((problem = compare_reflection(serial[i], pd)) == NULL)
+        {
+            if ((pd->output_len != serial[i]->output_len) || (pd->output != serial[i]->output))
+                problem = "output";
+            else if ((i == broken) && (pd->error_count == 0))
+                problem = "broken shader translated";
+        } // else if
+
+        if (problem != NULL)
+            retval = 0;
+        if (serial[i]->error_count == 0)
+            want++;
+
+        fprintf(report, "%s %s slot %d %s%s: %s%s%s\n",
+                problem ? "FAIL" : "PASS", what, i, jobs[i].profile,
+                (i == broken) ? " (broken)" : "",
+                (serial[i]->error_count == 0) ? "translated" : "failed to parse",
+                problem ? ", doesn't match serial parse: " : "",
+                problem ? problem : "");
+
+        if (cache != NULL)
+            MOJOSHADER_releaseCachedParseData(cache, pd);
+        else
+            delete pd;
+    } // for
+
+    if (rc != want)
+        retval = 0;
+    fprintf(report, "%s %s: %d of %d translated\n", (rc == want) ? "PASS" : "FAIL",
+            what, rc, JOB_COUNT);
+
+    return retval;
+} // do_batch
+
+
+static int do_file(FILE *report, const unsigned char *buf, const int len)
+{
+    MOJOSHADER_parseJob jobs[JOB_COUNT];
+    const MOJOSHADER_parseData *serial[JOB_COUNT];
+    const int broken = JOB_COUNT / 2;
+    MOJOSHADER_parseCache *cache;
+    int retval = 1;
+    int p = 0;
+    int i;
+
+    memset(jobs, '\0', sizeof (jobs));
+    for (i = 0; i < JOB_COUNT; i++)
+    {
+        MOJOSHADER_parseJob *job = &jobs[i];
+        job->tokenbuf = buf;
+        if (i != broken)
+        {
+            job->profile = profiles[p++];
+            job->bufsize = len;
+        } // if
+        else
+        {
+            job->profile = MOJOSHADER_PROFILE_D3D;
+            job->bufsize = len / 2;  // cut off mid-shader, so it fails.
+        } // else
+
+        serial[i] = MOJOSHADER_parse(job->profile, job->mainfn, job->tokenbuf,
+                                     job->bufsize, job->swiz, job->swizcount,
+                                     job->smap, job->smapcount,
+                                     NULL, NULL, NULL);
+    } // for
+
+    if (!do_batch(report, "batch", jobs, serial, broken, NULL))
+        retval = 0;
+
+    cache = MOJOSHADER_createParseCache(NULL, NULL, NULL, NULL);
+    if (cache == NULL)
+    {
+        fprintf(report, "FAIL cached batch: couldn't create cache\n");
+        retval = 0;
+    } // if
+    else
+    {
+        if (!do_batch(report, "cached batch", jobs, serial, broken, cache))
+            retval = 0;
+        MOJOSHADER_destroyParseCache(cache);
+    } // else
+
+    for (i = 0; i < JOB_COUNT; i++)
+        delete serial[i];
+
+    return retval;
+} // do_file
+
+
+int main(int argc, char **argv)
+{
+    const char *outfile = NULL;
+    int retval = 0;
+    int first = 1;
+
+    if ((argc > 2) && (strcmp(argv[1], "-o") == 0))
+    {
+        outfile = argv[2];
+        first = 3;
+    } // if
+
+    if (argc <= first)
+    {
+        printf("\n\nUSAGE: %s [-o outfile] [file1] ... [fileN]\n\n", argv[0]);
+        return 1;
+    } // if
+
+    FILE *report = (outfile == NULL) ? stdout : fopen(outfile, "wb");
+    if (report == NULL)
+    {
+        printf(" ... fopen('%s') failed.\n", outfile);
+        return 1;
+    } // if
+
+    int i;
+    for (i = first; i < argc; i++)
+    {
+        FILE *io = fopen(argv[i], "rb");
+        if (io == NULL)
+        {
+            printf(" ... fopen('%s') failed.\n", argv[i]);
+            retval = 1;
+        } // if
+        else
+        {
+            unsigned char *buf = (unsigned char *) malloc(1000000);
+            int rc = fread(buf, 1, 1000000, io);
+            fclose(io);
+            if (!do_file(report, buf, rc))
+                retval = 1;
+            free(buf);
+        } // else
+    } // for
+
+    if (report != stdout)
+        fclose(report);
+    return retval;
+} // main
+
+// end of testparsebatch.c ...
+
@@ -0,0 +1,484 @@
+/**
+ * MojoShader; generate shader programs from bytecode of compiled
+ *  Direct3D shaders.
+ *
+ * Please see the file LICENSE.txt in the source's root directory.
+ */
+
+// Runs shaders through MOJOSHADER_parseCached() and makes sure a repeated
+//  parse hits the cache, a new cache reloads the file the first one
+//  persisted, and truncated or corrupt cache files get thrown out and
+//  replaced. Every result is checked against a plain MOJOSHADER_parse().
+//  A line per check goes to the report file, so unit_tests can compare it.
+//  Exits non-zero if anything failed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "../mojoshader.h"
+
+#ifdef _MSC_VER
+#define WIN32_LEAN_AND_MEAN 1
+#include <windows.h>
+#include <direct.h>
+#include <malloc.h>  // for alloca().
+#define snprintf _snprintf
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+#define CACHEFILE_EXT ".mojoshader"
+
+static const char *profiles[] =
+{
+    MOJOSHADER_PROFILE_D3D,
+    MOJOSHADER_PROFILE_BYTECODE,
+    MOJOSHADER_PROFILE_GLSL,
+};
+
+static const char *compare_reflection(const MOJOSHADER_parseData *a,
+                                      const MOJOSHADER_parseData *b)
+{
+    int i;
+
+    if (a->error_count != b->error_count)
+        return "error count";
+    for (i = 0; i < a->error_count; i++)
+    {
+        if ( (a->errors[i].error != b->errors[i].error) ||
+             (a->errors[i].filename != b->errors[i].filename) ||
+             (a->errors[i].error_position != b->errors[i].error_position) )
+            return "errors";
+    } // for
+
+    if (a->profile != b->profile)
+        return "profile";
+    else if (a->mainfn != b->mainfn)
+        return "main function";
+    else if (a->instruction_count != b->instruction_count)
+        return "instruction count";
+    else if (a->shader_type != b->shader_type)
+        return "shader type";
+    else if ((a->major_ver != b->major_ver) || (a->minor_ver != b->minor_ver))
+        return "shader version";
+
+    if (a->uniform_count != b->uniform_count)
+        return "uniform count";
+    for (i = 0; i < a->uniform_count; i++)
+    {
+        const MOJOSHADER_uniform *x = &a->uniforms[i];
+        const MOJOSHADER_uniform *y = &b->uniforms[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->array_count != y->array_count) ||
+             (x->constant != y->constant) || (x->name != y->name) )
+            return "uniforms";
+    } // for
+
+    if (a->constant_count != b->constant_count)
+        return "constant count";
+    for (i = 0; i < a->constant_count; i++)
+    {
+        const MOJOSHADER_constant *x = &a->constants[i];
+        const MOJOSHADER_constant *y = &b->constants[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (memcmp(&x->value, &y->value, sizeof (x->value)) != 0) )
+            return "constants";
+    } // for
+
+    if (a->sampler_count != b->sampler_count)
+        return "sampler count";
+    for (i = 0; i < a->sampler_count; i++)
+    {
+        const MOJOSHADER_sampler *x = &a->samplers[i];
+        const MOJOSHADER_sampler *y = &b->samplers[i];
+        if ( (x->type != y->type) || (x->index != y->index) ||
+             (x->name != y->name) || (x->texbem != y->texbem) )
+            return "samplers";
+    } // for
+
+    if (a->input_count != b->input_count)
+        return "input count";
+    for (i = 0; i < a->input_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->inputs[i];
+        const MOJOSHADER_attribute *y = &b->inputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "inputs";
+    } // for
+
+    if (a->output_count != b->output_count)
+        return "output count";
+    for (i = 0; i < a->output_count; i++)
+    {
+        const MOJOSHADER_attribute *x = &a->outputs[i];
+        const MOJOSHADER_attribute *y = &b->outputs[i];
+        if ((x->usage != y->usage) || (x->index != y->index) || (x->name != y->name))
+            return "outputs";
+    } // for
+
+    if (a->swizzle_count != b->swizzle_count)
+        return "swizzle count";
+
+    if (a->symbol_count != b->symbol_count)
+        return "symbol count";
+    for (i = 0; i < a->symbol_count; i++)
+    {
+        const MOJOSHADER_symbol *x = &a->symbols[i];
+        const MOJOSHADER_symbol *y = &b->symbols[i];
+        if ( (x->name != y->name) || (x->register_set != y->register_set) ||
+             (x->register_index != y->register_index) ||
+             (x->register_count != y->register_count) )
+            return "symbols";
+    } // for
+
+    if ((a->preshader == NULL) != (b->preshader == NULL))
+        return "preshader";
+
+    return NULL;
+} // compare_reflection
+
+
+static const char *compare_parse(const MOJOSHADER_parseData *a,
+                                 const MOJOSHADER_parseData *b)
+{
+    const char *problem = compare_reflection(a, b);
+    if (problem != NULL)
+        return problem;
+    else if ((a->output_len != b->output_len) || (a->output != b->output))
+        return "output";
+    return NULL;
+} // compare_parse
+
+
+// Counts the cache files in (dname), and copies the path of one of them
+//  into (found). With (nuke), everything in there gets deleted instead.
+static int scan_dir(const char *dname, const int nuke, char *found,
+                    const size_t foundlen)
+{
+    const size_t extlen = strlen(CACHEFILE_EXT);
+    char path[1024];
+    int total = 0;
+
+#ifdef _MSC_VER
+    const size_t wildcardlen = strlen(dname) + 3;
+    char *wildcard = (char *) alloca(wildcardlen);
+    snprintf(wildcard, wildcardlen, "%s\\*", dname);
+
+    WIN32_FIND_DATAA dent;
+    HANDLE dirp = FindFirstFileA(wildcard, &dent);
+    if (dirp != INVALID_HANDLE_VALUE)
+    {
+        do
+        {
+            const char *fname = dent.cFileName;
+#else
+    struct dirent *dent = NULL;
+    DIR *dirp = opendir(dname);
+    if (dirp != NULL)
+    {
+        while ((dent = readdir(dirp)) != NULL)
+        {
+            const char *fname = dent->d_name;
+#endif
+            const size_t len = strlen(fname);
+            if ((strcmp(fname, ".") == 0) || (strcmp(fname, "..") == 0))
+                continue;
+
+            snprintf(path, sizeof (path), "%s/%s", dname, fname);
+            if (nuke)
+                remove(path);
+            else if ((len > extlen) && (strcmp(fname + len - extlen, CACHEFILE_EXT) == 0))
+            {
+                if (found != NULL)
+                    snprintf(found, foundlen, "%s", path);
+                total++;
+            } // else if
+#ifdef _MSC_VER
+        } while (FindNextFileA(dirp, &dent) != 0);
+        FindClose(dirp);
+    } // if
+#else
+        } // while
+        closedir(dirp);
+    } // if
+#endif
+
+    return total;
+} // scan_dir
+
+
+static unsigned char *read_file(const char *fname, long *_len)
+{
+    unsigned char *buf = NULL;
+    FILE *io = fopen(fname, "rb");
+    if (io == NULL)
+        return NULL;
+
+    fseek(io, 0, SEEK_END);
+    const long len = ftell(io);
+    fseek(io, 0, SEEK_SET);
+    if (len > 0)
+        buf = (unsigned char *) malloc(len);
+    if ((buf != NULL) && (fread(buf, len, 1, io) != 1))
+    {
+        free(buf);
+        buf = NULL;
+    } // if
+    fclose(io);
+
+    *_len = len;
+    return buf;
+} // read_file
+
+
+static int write_file(const char *fname, const unsigned char *buf,
+                      const long len)
+{
+    FILE *io = fopen(fname, "wb");
+    if (io == NULL)
+        return 0;
+    int retval = (fwrite(buf, len, 1, io) == 1);
+    if (fclose(io) != 0)
+        retval = 0;
+    return retval;
+} // write_file
+
+
+// Parses with a brand new cache on (dname), so the only place a result
+//  can come from is the directory or a fresh translation.
+static const char *parse_new_cache(const char *dname, const char *prof,
+                                   const unsigned char *buf, const int len,
+                                   const MOJOSHADER_parseData *want)
+{
+    MOJOSHADER_parseCache *cache;
+    const MOJOSHADER_parseData *pd;
+    const char *problem = NULL;
+
+    cache = MOJOSHADER_createParseCache(dname, NULL, NULL, NULL);
+    if (cache == NULL)
+        return "couldn't create cache";
+
+    pd = MOJOSHADER_parseCached(cache, prof, NULL, buf, len, NULL, 0, NULL, 0);
+    if (pd == NULL)
+        problem = "out of memory";
+    else
+        problem = compare_parse(want, pd);
+
+    MOJOSHADER_releaseCachedParseData(cache, pd);
+    MOJOSHADER_destroyParseCache(cache);
+    return problem;
+} // parse_new_cache
+
+
+static const char *check_repeat(const char *dname, const char *prof,
+                                const unsigned char *buf, const int len,
+                                const MOJOSHADER_parseData *want)
+{
+    MOJOSHADER_parseCache *cache;
+    const MOJOSHADER_parseData *a;
+    const MOJOSHADER_parseData *b;
+    const char *problem = NULL;
+
+    cache = MOJOSHADER_createParseCache(dname, NULL, NULL, NULL);
+    if (cache == NULL)
+        return "couldn't create cache";
+
+    a = MOJOSHADER_parseCached(cache, prof, NULL, buf, len, NULL, 0, NULL, 0);
+    b = MOJOSHADER_parseCached(cache, prof, NULL, buf, len, NULL, 0, NULL, 0);
+    if ((a == NULL) || (b == NULL))
+        problem = "out of memory";
+    else if (a != b)
+        problem = "second parse missed the cache";
+    else
+        problem = compare_parse(want, a);
+
+    MOJOSHADER_releaseCachedParseData(cache, b);
+    MOJOSHADER_releaseCachedParseData(cache, a);
+    MOJOSHADER_destroyParseCache(cache);
+    return problem;
+} // check_repeat
+
+
+static const char *check_reload(const char *dname, const char *prof,
+                                const unsigned char *buf, const int len,
+                                const MOJOSHADER_parseData *want,
+                                const char *path)
+{
+    struct stat before;
+    struct stat after;
+    const char *problem = NULL;
+
+    if (stat(path, &before) != 0)
+        return "cache file went missing";
+    else if ((problem = parse_new_cache(dname, prof, buf, len, want)) != NULL)
+        return problem;
+    else if (stat(path, &after) != 0)
+        return "cache file went missing";
+
+    // saves rename a new file into place, so a reparse would change this.
+    if ((before.st_ino != after.st_ino) || (before.st_size != after.st_size))
+        return "cache file was rewritten instead of loaded";
+    return NULL;
+} // check_reload
+
+
+static const char *check_replaced(const char *dname, const char *prof,
+                                  const unsigned char *buf, const int len,
+                                  const MOJOSHADER_parseData *want,
+                                  const char *path,
+                                  const unsigned char *orig, const long origlen,
+                                  const unsigned char *bad, const long badlen)
+{
+    const char *problem = NULL;
+    unsigned char *now = NULL;
+    long nowlen = 0;
+
+    if (!write_file(path, bad, badlen))
+        return "couldn't damage cache file";
+    else if ((problem = parse_new_cache(dname, prof, buf, len, want)) != NULL)
+        return problem;
+
+    now = read_file(path, &nowlen);
+    if ((now == NULL) || (nowlen != origlen) || (memcmp(now, orig, origlen) != 0))
+        problem = "bad cache file wasn't replaced";
+    free(now);
+    return problem;
+} // check_replaced
+
+
+static int report_check(FILE *report, const char *prof, const char *what,
+                        const char *problem)
+{
+    fprintf(report, "%s %s: %s%s%s%s\n", problem ? "FAIL" : "PASS", prof,
+            what, problem ? " (" : "", problem ? problem : "",
+            problem ? ")" : "");
+    return (problem == NULL);
+} // report_check
+
+
+static int do_cache(FILE *report, const char *dname, const unsigned char *buf,
+                    const int len, const char *prof)
+{
+    const MOJOSHADER_parseData *want;
+    const char *problem = NULL;
+    unsigned char *orig = NULL;
+    unsigned char *bad = NULL;
+    long origlen = 0;
+    char path[1024];
+    int retval = 1;
+
+    scan_dir(dname, 1, NULL, 0);  // start from an empty directory.
+
+    want = MOJOSHADER_parse(prof, NULL, buf, len, NULL, 0, NULL, 0,
+                            NULL, NULL, NULL);
+
+    problem = check_repeat(dname, prof, buf, len, want);
+    if ((problem == NULL) && (scan_dir(dname, 0, path, sizeof (path)) != 1))
+        problem = "result wasn't persisted";
+    else if ((problem == NULL) && ((orig = read_file(path, &origlen)) == NULL))
+        problem = "couldn't read cache file";
+    retval &= report_check(report, prof, "repeated parse", problem);
+
+    if (orig != NULL)
+    {
+        problem = check_reload(dname, prof, buf, len, want, path);
+        retval &= report_check(report, prof, "reload persisted file", problem);
+
+        problem = check_replaced(dname, prof, buf, len, want, path,
+                                 orig, origlen, orig, origlen / 2);
+        retval &= report_check(report, prof, "truncated cache file", problem);
+
+        bad = (unsigned char *) malloc(origlen);
+        memcpy(bad, orig, origlen);
+        bad[origlen / 2] ^= 0xFF;
+        problem = check_replaced(dname, prof, buf, len, want, path,
+                                 orig, origlen, bad, origlen);
+        retval &= report_check(report, prof, "corrupt cache file", problem);
+        free(bad);
+        free(orig);
+    } // if
+
+    delete want;
+    scan_dir(dname, 1, NULL, 0);
+    return retval;
+} // do_cache
+
+
+int main(int argc, char **argv)
+{
+    const char *outfile = NULL;
+    const char *cachedir = NULL;
+    int retval = 0;
+    int first = 1;
+
+    while ((first < argc - 1) && (argv[first][0] == '-'))
+    {
+        if (strcmp(argv[first], "-o") == 0)
+            outfile = argv[first + 1];
+        else if (strcmp(argv[first], "-c") == 0)
+            cachedir = argv[first + 1];
+        else
+            break;
+        first += 2;
+    } // while
+
+    if ((argc <= first) || (cachedir == NULL))
+    {
+        printf("\n\nUSAGE: %s -c cachedir [-o outfile] [file1] ... [fileN]\n\n", argv[0]);
+        printf("  (cachedir is created, and removed again when we're done.)\n\n");
+        return 1;
+    } // if
+
+    FILE *report = (outfile == NULL) ? stdout : fopen(outfile, "wb");
+    if (report == NULL)
+    {
+        printf(" ... fopen('%s') failed.\n", outfile);
+        return 1;
+    } // if
+
+#ifdef _MSC_VER
+    _mkdir(cachedir);
+#else
+    mkdir(cachedir, 0777);
+#endif
+
+    size_t p;
+    int i;
+
+    for (i = first; i < argc; i++)
+    {
+        FILE *io = fopen(argv[i], "rb");
+        if (io == NULL)
+        {
+            printf(" ... fopen('%s') failed.\n", argv[i]);
+            retval = 1;
+        } // if
+        else
+        {
+            unsigned char *buf = (unsigned char *) malloc(1000000);
+            int rc = fread(buf, 1, 1000000, io);
+            fclose(io);
+            for (p = 0; p < sizeof (profiles) / sizeof (profiles[0]); p++)
+            {
+                if (!do_cache(report, cachedir, buf, rc, profiles[p]))
+                    retval = 1;
+            } // for
+            free(buf);
+        } // else
+    } // for
+
+#ifdef _MSC_VER
+    _rmdir(cachedir);
+#else
+    rmdir(cachedir);
+#endif
+
+    if (report != stdout)
+        fclose(report);
+    return retval;
+} // main
+
+// end of testparsecache.c ...
+